@@ -0,0 +1,965 @@
+/*
+ * aac_utils.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "aac_utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/checks.h"
+#include "base/logging.h"
+
+#include "audio_codec_property.h"
+#include "bit_reader.h"
+#include "buffer.h"
+#include "codec_constants.h"
+#include "esds.h"
+#include "meta_data.h"
+#include "meta_data_utils.h"
+#include "start_code.h"
+
+namespace ave {
+
+namespace {
+
+const int32_t kSamplingFrequencies[] = {96000, 88200, 64000, 48000, 44100,
+                                        32000, 24000, 22050, 16000, 12000,
+                                        11025, 8000,  7350};
+const size_t kNumSamplingFrequencies =
+    sizeof(kSamplingFrequencies) / sizeof(kSamplingFrequencies[0]);
+
+struct ChannelConfiguration {
+  int32_t channels;
+  ChannelLayout layout;
+};
+
+// channelConfiguration, ISO/IEC 14496-3 table 1.19, 0 for the
+// program_config_element and reserved values
+const ChannelConfiguration kChannelConfigurations[] = {
+    {0, CHANNEL_LAYOUT_NONE},
+    {1, CHANNEL_LAYOUT_MONO},
+    {2, CHANNEL_LAYOUT_STEREO},
+    {3, CHANNEL_LAYOUT_SURROUND},
+    {4, CHANNEL_LAYOUT_4_0},
+    {5, CHANNEL_LAYOUT_5_0_BACK},
+    {6, CHANNEL_LAYOUT_5_1_BACK},
+    {8, CHANNEL_LAYOUT_7_1},
+    {0, CHANNEL_LAYOUT_NONE},
+    {0, CHANNEL_LAYOUT_NONE},
+    {0, CHANNEL_LAYOUT_NONE},
+    {7, CHANNEL_LAYOUT_6_1_BACK},
+    {8, CHANNEL_LAYOUT_7_1},
+    // 22.2
+    {24, CHANNEL_LAYOUT_DISCRETE},
+    // 5.1 with two front height channels
+    {8, CHANNEL_LAYOUT_DISCRETE},
+};
+const size_t kNumChannelConfigurations =
+    sizeof(kChannelConfigurations) / sizeof(kChannelConfigurations[0]);
+
+// Layouts of the program_config_element by the channels in front, at the
+// side, at the back and LFE.
+struct ProgramLayout {
+  uint8_t front;
+  uint8_t side;
+  uint8_t back;
+  uint8_t lfe;
+  ChannelLayout layout;
+};
+
+const ProgramLayout kProgramLayouts[] = {
+    {1, 0, 0, 0, CHANNEL_LAYOUT_MONO},
+    {2, 0, 0, 0, CHANNEL_LAYOUT_STEREO},
+    {2, 0, 0, 1, CHANNEL_LAYOUT_2POINT1},
+    {2, 0, 1, 0, CHANNEL_LAYOUT_2_1},
+    {2, 0, 2, 0, CHANNEL_LAYOUT_QUAD},
+    {2, 2, 0, 0, CHANNEL_LAYOUT_2_2},
+    {2, 2, 0, 1, CHANNEL_LAYOUT_4_1_QUAD_SIDE},
+    {3, 0, 0, 0, CHANNEL_LAYOUT_SURROUND},
+    {3, 0, 0, 1, CHANNEL_LAYOUT_3_1},
+    {3, 0, 1, 0, CHANNEL_LAYOUT_4_0},
+    {3, 0, 1, 1, CHANNEL_LAYOUT_4_1},
+    {3, 0, 2, 0, CHANNEL_LAYOUT_5_0_BACK},
+    {3, 0, 2, 1, CHANNEL_LAYOUT_5_1_BACK},
+    {3, 0, 3, 0, CHANNEL_LAYOUT_HEXAGONAL},
+    {3, 0, 3, 1, CHANNEL_LAYOUT_6_1_BACK},
+    {3, 2, 0, 0, CHANNEL_LAYOUT_5_0},
+    {3, 2, 0, 1, CHANNEL_LAYOUT_5_1},
+    {3, 2, 1, 0, CHANNEL_LAYOUT_6_0},
+    {3, 2, 1, 1, CHANNEL_LAYOUT_6_1},
+    {3, 2, 2, 0, CHANNEL_LAYOUT_7_0},
+    {3, 2, 2, 1, CHANNEL_LAYOUT_7_1},
+    {3, 2, 3, 0, CHANNEL_LAYOUT_OCTAGONAL},
+    {4, 2, 0, 0, CHANNEL_LAYOUT_6_0_FRONT},
+    {4, 2, 0, 1, CHANNEL_LAYOUT_6_1_FRONT},
+    {5, 0, 2, 1, CHANNEL_LAYOUT_7_1_WIDE_BACK},
+    {5, 2, 0, 0, CHANNEL_LAYOUT_7_0_FRONT},
+    {5, 2, 0, 1, CHANNEL_LAYOUT_7_1_WIDE},
+};
+
+// syncword and audioMuxLengthBytes of AudioSyncStream()
+const size_t kLOASHeaderSize = 3;
+const size_t kMaxHeaderSize = kADTSHeaderSize;
+const size_t kMaxADTSFrameLength = 0x1fff;
+
+uint32_t GetAudioObjectType(BitReader* br) {
+  uint32_t objectType = br->getBitsWithFallback(5, 0);
+  if (objectType == 31) {
+    objectType = 32 + br->getBitsWithFallback(6, 0);
+  }
+  return objectType;
+}
+
+bool GetSamplingFrequency(BitReader* br, uint8_t* index, int32_t* frequency) {
+  *index = br->getBitsWithFallback(4, 0);
+  if (*index == 0x0f) {
+    *frequency = br->getBitsWithFallback(24, 0);
+    return *frequency > 0;
+  }
+  if (*index >= kNumSamplingFrequencies) {
+    return false;
+  }
+  *frequency = kSamplingFrequencies[*index];
+  return true;
+}
+
+// LatmGetValue(), ISO/IEC 14496-3 1.7.3
+uint32_t LatmGetValue(BitReader* br) {
+  uint32_t bytesForValue = br->getBitsWithFallback(2, 0);
+  uint32_t value = 0;
+  for (uint32_t i = 0; i <= bytesForValue; ++i) {
+    value = (value << 8) | br->getBitsWithFallback(8, 0);
+  }
+  return value;
+}
+
+// StreamMuxConfig(), ISO/IEC 14496-3 1.7.3, for a single program and layer
+status_t ParseStreamMuxConfig(BitReader* br, AudioSpecificConfig* config) {
+  uint32_t audioMuxVersion = br->getBitsWithFallback(1, 0);
+  uint32_t audioMuxVersionA = 0;
+  if (audioMuxVersion) {
+    audioMuxVersionA = br->getBitsWithFallback(1, 0);
+  }
+  if (audioMuxVersionA) {
+    AVE_LOG(LS_WARNING) << "unsupported audioMuxVersionA";
+    return ERROR_UNSUPPORTED;
+  }
+  if (audioMuxVersion) {
+    LatmGetValue(br);  // taraBufferFullness
+  }
+  br->skipBits(1);  // allStreamsSameTimeFraming
+  uint32_t numSubFrames = br->getBitsWithFallback(6, 0);
+  uint32_t numProgram = br->getBitsWithFallback(4, 0);
+  uint32_t numLayer = br->getBitsWithFallback(3, 0);
+  if (numSubFrames != 0 || numProgram != 0 || numLayer != 0) {
+    AVE_LOG(LS_WARNING) << "unsupported LATM multiplex, " << numSubFrames + 1
+                        << " subframes, " << numProgram + 1 << " programs, "
+                        << numLayer + 1 << " layers";
+    return ERROR_UNSUPPORTED;
+  }
+
+  status_t err;
+  if (audioMuxVersion == 0) {
+    err = ParseAudioSpecificConfig(br, config);
+  } else {
+    size_t ascLen = LatmGetValue(br);
+    size_t start = br->numBitsLeft();
+    err = ParseAudioSpecificConfig(br, config);
+    size_t used = start - br->numBitsLeft();
+    if (err == OK && used > ascLen) {
+      err = ERROR_MALFORMED;
+    }
+    if (err == OK) {
+      br->skipBits(ascLen - used);
+    }
+  }
+  if (err != OK) {
+    return err;
+  }
+
+  uint32_t frameLengthType = br->getBitsWithFallback(3, 0);
+  if (frameLengthType != 0) {
+    AVE_LOG(LS_WARNING) << "unsupported frameLengthType " << frameLengthType;
+    return ERROR_UNSUPPORTED;
+  }
+  br->skipBits(8);  // latmBufferFullness
+  if (br->getBitsWithFallback(1, 0)) {  // otherDataPresent
+    if (audioMuxVersion) {
+      LatmGetValue(br);  // otherDataLenBits
+    } else {
+      uint32_t otherDataLenEsc;
+      do {
+        otherDataLenEsc = br->getBitsWithFallback(1, 0);
+        br->skipBits(8);  // otherDataLenTmp
+      } while (otherDataLenEsc && !br->overRead());
+    }
+  }
+  if (br->getBitsWithFallback(1, 0)) {  // crcCheckPresent
+    br->skipBits(8);                    // crcCheckSum
+  }
+  if (br->overRead()) {
+    return ERROR_MALFORMED;
+  }
+  return OK;
+}
+
+bool SameConfig(const AudioSpecificConfig& a, const AudioSpecificConfig& b) {
+  return a.object_type == b.object_type &&
+         a.sampling_frequency == b.sampling_frequency &&
+         a.channel_configuration == b.channel_configuration &&
+         a.num_channels == b.num_channels &&
+         a.channel_layout == b.channel_layout &&
+         a.frame_length_flag == b.frame_length_flag &&
+         a.sbr_present == b.sbr_present && a.ps_present == b.ps_present &&
+         a.extension_sampling_frequency == b.extension_sampling_frequency;
+}
+
+// program_config_element(), ISO/IEC 14496-3 4.4.1.1. |start| is
+// numBitsLeft() at the start of the AudioSpecificConfig, which the
+// byte_alignment() refers to.
+status_t ParseProgramConfigElement(BitReader* br,
+                                   size_t start,
+                                   AudioSpecificConfig* config) {
+  br->skipBits(4 + 2 + 4);  // element_instance_tag, object_type, index
+  uint32_t numFront = br->getBitsWithFallback(4, 0);
+  uint32_t numSide = br->getBitsWithFallback(4, 0);
+  uint32_t numBack = br->getBitsWithFallback(4, 0);
+  uint32_t numLfe = br->getBitsWithFallback(2, 0);
+  uint32_t numAssocData = br->getBitsWithFallback(3, 0);
+  uint32_t numValidCc = br->getBitsWithFallback(4, 0);
+  if (br->getBitsWithFallback(1, 0)) {  // mono_mixdown_present
+    br->skipBits(4);
+  }
+  if (br->getBitsWithFallback(1, 0)) {  // stereo_mixdown_present
+    br->skipBits(4);
+  }
+  if (br->getBitsWithFallback(1, 0)) {  // matrix_mixdown_idx_present
+    br->skipBits(2 + 1);
+  }
+
+  // a channel pair element carries two channels
+  auto countChannels = [br](uint32_t elements) {
+    uint32_t channels = 0;
+    for (uint32_t i = 0; i < elements; ++i) {
+      channels += br->getBitsWithFallback(1, 0) ? 2 : 1;
+      br->skipBits(4);  // element_tag_select
+    }
+    return channels;
+  };
+  uint32_t front = countChannels(numFront);
+  uint32_t side = countChannels(numSide);
+  uint32_t back = countChannels(numBack);
+  br->skipBits(4 * numLfe + 4 * numAssocData + 5 * numValidCc);
+
+  size_t used = start - br->numBitsLeft();
+  br->skipBits((8 - used % 8) % 8);  // byte_alignment()
+  uint32_t commentBytes = br->getBitsWithFallback(8, 0);
+  br->skipBits(8 * commentBytes);
+  if (br->overRead()) {
+    AVE_LOG(LS_ERROR) << "truncated program_config_element";
+    return ERROR_MALFORMED;
+  }
+
+  config->num_channels = front + side + back + numLfe;
+  config->channel_layout = CHANNEL_LAYOUT_DISCRETE;
+  for (const ProgramLayout& layout : kProgramLayouts) {
+    if (layout.front == front && layout.side == side &&
+        layout.back == back && layout.lfe == numLfe) {
+      config->channel_layout = layout.layout;
+      break;
+    }
+  }
+  if (config->num_channels == 0) {
+    AVE_LOG(LS_ERROR) << "program_config_element without channels";
+    return ERROR_MALFORMED;
+  }
+  return OK;
+}
+
+// AudioSpecificConfig(), ISO/IEC 14496-3 1.6.2.1. The backward compatible
+// extension at the end is only looked for if |sized|, the config ends with
+// the data of |br|.
+status_t ReadAudioSpecificConfig(BitReader* br,
+                                 AudioSpecificConfig* config,
+                                 bool sized) {
+  const size_t start = br->numBitsLeft();
+  memset(config, 0, sizeof(*config));
+  config->object_type = GetAudioObjectType(br);
+  if (!GetSamplingFrequency(br, &config->sampling_frequency_index,
+                            &config->sampling_frequency)) {
+    AVE_LOG(LS_ERROR) << "invalid samplingFrequencyIndex";
+    return ERROR_MALFORMED;
+  }
+  uint8_t channelConfiguration = br->getBitsWithFallback(4, 0);
+
+  int32_t extensionObjectType = 0;
+  if (config->object_type == AACObjectHE ||
+      config->object_type == AACObjectHE_PS) {
+    // explicit SBR signalling, the core follows
+    extensionObjectType = AACObjectHE;
+    config->sbr_present = true;
+    config->ps_present = config->object_type == AACObjectHE_PS;
+    uint8_t index;
+    if (!GetSamplingFrequency(br, &index,
+                              &config->extension_sampling_frequency)) {
+      AVE_LOG(LS_ERROR) << "invalid extensionSamplingFrequencyIndex";
+      return ERROR_MALFORMED;
+    }
+    config->object_type = GetAudioObjectType(br);
+    if (config->object_type == 22) {
+      br->skipBits(4);  // extensionChannelConfiguration
+    }
+  }
+
+  // GASpecificConfig(), ISO/IEC 14496-3 4.4.1
+  switch (config->object_type) {
+    case 1:
+    case 2:
+    case 3:
+    case 4:
+    case 6:
+    case 7:
+    case 17:
+    case 19:
+    case 20:
+    case 21:
+    case 22:
+    case 23:
+      break;
+    default:
+      AVE_LOG(LS_WARNING) << "unsupported audioObjectType "
+                          << config->object_type;
+      return ERROR_UNSUPPORTED;
+  }
+  config->frame_length_flag = br->getBitsWithFallback(1, 0);
+  if (br->getBitsWithFallback(1, 0)) {  // dependsOnCoreCoder
+    br->skipBits(14);                   // coreCoderDelay
+  }
+  uint32_t extensionFlag = br->getBitsWithFallback(1, 0);
+  if (channelConfiguration == 0) {
+    status_t err = ParseProgramConfigElement(br, start, config);
+    if (err != OK) {
+      return err;
+    }
+  } else if (!SetAACChannelConfiguration(channelConfiguration, config)) {
+    AVE_LOG(LS_ERROR) << "reserved channelConfiguration "
+                      << static_cast<int>(channelConfiguration);
+    return ERROR_MALFORMED;
+  }
+  if (config->object_type == 6 || config->object_type == 20) {
+    br->skipBits(3);  // layerNr
+  }
+  if (extensionFlag) {
+    if (config->object_type == 22) {
+      br->skipBits(5 + 11);  // numOfSubFrame, layer_length
+    }
+    if (config->object_type == 17 || config->object_type == 19 ||
+        config->object_type == 20 || config->object_type == 23) {
+      br->skipBits(3);  // aac*ResilienceFlag
+    }
+    br->skipBits(1);  // extensionFlag3
+  }
+  if (config->object_type >= 17) {
+    uint32_t epConfig = br->getBitsWithFallback(2, 0);
+    if (epConfig == 2 || epConfig == 3) {
+      AVE_LOG(LS_WARNING) << "unsupported epConfig " << epConfig;
+      return ERROR_UNSUPPORTED;
+    }
+  }
+  if (br->overRead()) {
+    AVE_LOG(LS_ERROR) << "truncated AudioSpecificConfig";
+    return ERROR_MALFORMED;
+  }
+
+  // backward compatible SBR/PS signalling after the core config
+  if (sized && extensionObjectType != AACObjectHE &&
+      br->numBitsLeft() >= 16 && br->getBits(11) == 0x2b7) {
+    extensionObjectType = GetAudioObjectType(br);
+    if (extensionObjectType == AACObjectHE &&
+        br->getBitsWithFallback(1, 0)) {  // sbrPresentFlag
+      config->sbr_present = true;
+      uint8_t index;
+      if (!GetSamplingFrequency(br, &index,
+                                &config->extension_sampling_frequency)) {
+        AVE_LOG(LS_ERROR) << "invalid extensionSamplingFrequencyIndex";
+        return ERROR_MALFORMED;
+      }
+      if (br->numBitsLeft() >= 12 && br->getBits(11) == 0x548) {
+        config->ps_present = br->getBitsWithFallback(1, 0);
+      }
+    }
+    if (br->overRead()) {
+      AVE_LOG(LS_ERROR) << "truncated AudioSpecificConfig extension";
+      return ERROR_MALFORMED;
+    }
+  }
+  if (!config->sbr_present) {
+    config->extension_sampling_frequency = config->sampling_frequency;
+  }
+  return OK;
+}
+
+}  // namespace
+
+status_t ParseAudioSpecificConfig(BitReader* br, AudioSpecificConfig* config) {
+  return ReadAudioSpecificConfig(br, config, false);
+}
+
+status_t ParseAudioSpecificConfig(const uint8_t* data,
+                                  size_t size,
+                                  AudioSpecificConfig* config) {
+  BitReader br(data, size);
+  return ReadAudioSpecificConfig(&br, config, true);
+}
+
+bool SetAACChannelConfiguration(uint8_t channel_configuration,
+                                AudioSpecificConfig* config) {
+  if (channel_configuration >= kNumChannelConfigurations ||
+      kChannelConfigurations[channel_configuration].channels == 0) {
+    return false;
+  }
+  config->channel_configuration = channel_configuration;
+  config->num_channels = kChannelConfigurations[channel_configuration].channels;
+  config->channel_layout = kChannelConfigurations[channel_configuration].layout;
+  return true;
+}
+
+void GetAACOutputProperty(const AudioSpecificConfig& config,
+                          AudioCodecProperty* property,
+                          ChannelLayout* layout) {
+  property->codec_id = CodecId::AV_CODEC_ID_AAC;
+  property->sample_rate = config.sbr_present
+                              ? config.extension_sampling_frequency
+                              : config.sampling_frequency;
+  property->samples_per_channel = config.frame_length_flag ? 960 : 1024;
+  if (config.object_type == AACObjectLD) {
+    property->samples_per_channel /= 2;
+  }
+  if (config.sbr_present) {
+    property->samples_per_channel *= 2;
+  }
+  property->channels = config.num_channels;
+  *layout = config.channel_layout;
+  if (config.ps_present && config.num_channels == 1) {
+    // parametric stereo upmixes the mono core
+    property->channels = 2;
+    *layout = CHANNEL_LAYOUT_STEREO;
+  }
+}
+
+status_t ParseAACCodecProperty(const ESDS& esds,
+                               AudioCodecProperty* property,
+                               ChannelLayout* layout) {
+  const void* data;
+  size_t size;
+  status_t err = esds.getCodecSpecificInfo(&data, &size);
+  if (err != OK) {
+    return err;
+  }
+  AudioSpecificConfig config;
+  err = ParseAudioSpecificConfig(static_cast<const uint8_t*>(data), size,
+                                 &config);
+  if (err != OK) {
+    return err;
+  }
+  GetAACOutputProperty(config, property, layout);
+  return OK;
+}
+
+bool ParseADTSHeader(const uint8_t* data, size_t size, ADTSHeader* header) {
+  // syncword and layer 0
+  if (size < kADTSHeaderSize || data[0] != 0xff ||
+      (data[1] & 0xf6) != 0xf0) {
+    return false;
+  }
+  header->protection_absent = data[1] & 0x01;
+  header->profile = data[2] >> 6;
+  header->sampling_frequency_index = (data[2] >> 2) & 0x0f;
+  header->channel_configuration = ((data[2] & 0x01) << 2) | (data[3] >> 6);
+  header->frame_length =
+      ((data[3] & 0x03) << 11) | (data[4] << 3) | (data[5] >> 5);
+  header->num_raw_data_blocks = (data[6] & 0x03) + 1;
+  header->header_size =
+      kADTSHeaderSize +
+      (header->protection_absent ? 0 : 2 * header->num_raw_data_blocks);
+  return header->sampling_frequency_index < kNumSamplingFrequencies &&
+         header->frame_length >= header->header_size;
+}
+
+AACDeframer::AACDeframer(Format format)
+    : format_(format),
+      header_size_(format == Format::kADTS ? kADTSHeaderSize
+                                           : kLOASHeaderSize),
+      has_config_(false),
+      has_mux_config_(false) {
+  Reset();
+}
+
+void AACDeframer::Reset() {
+  pending_.clear();
+  pending_offset_ = 0;
+  pending_position_ = 0;
+  position_ = 0;
+  timestamps_.clear();
+  synced_ = false;
+  payloads_.clear();
+  base_pts_us_ = -1;
+  samples_since_base_ = 0;
+}
+
+bool AACDeframer::GetConfig(AudioSpecificConfig* config) const {
+  if (!has_config_) {
+    return false;
+  }
+  *config = config_;
+  return true;
+}
+
+bool AACDeframer::MakeCodecSpecificData(MetaData& meta) const {
+  if (!has_config_ || config_.object_type < AACObjectMain ||
+      config_.object_type > AACObjectLTP ||
+      config_.sampling_frequency_index > 11 ||
+      config_.channel_configuration == 0) {
+    return false;
+  }
+  if (!MakeAACCodecSpecificData(meta, config_.object_type - 1,
+                                config_.sampling_frequency_index,
+                                config_.channel_configuration)) {
+    return false;
+  }
+  meta.setInt32(kKeyAACAOT, config_.object_type);
+  return true;
+}
+
+void AACDeframer::Push(const uint8_t* data,
+                       size_t size,
+                       int64_t pts_us,
+                       std::vector<Frame>* frames) {
+  // the frames of the previous call are no longer used
+  pending_.erase(pending_.begin(), pending_.begin() + pending_offset_);
+  pending_position_ += pending_offset_;
+  pending_offset_ = 0;
+  payloads_.clear();
+  // room for every payload copied in the call, so none of them moves
+  payloads_.reserve(pending_.size() + size);
+
+  if (pts_us >= 0) {
+    timestamps_.push_back({position_, pts_us});
+  }
+  const uint64_t position = position_;
+  position_ += size;
+
+  size_t offset = 0;
+  if (!pending_.empty()) {
+    // complete the frame split across chunks, the rest of |data| can then
+    // be sliced in place
+    pending_.reserve(pending_.size() + size);
+    size_t take = size;
+    if (synced_) {
+      uint8_t header[kMaxHeaderSize];
+      size_t n = std::min(pending_.size(), header_size_);
+      memcpy(header, pending_.data(), n);
+      memcpy(header + n, data, std::min(size, header_size_ - n));
+      size_t frameSize =
+          PeekFrameSize(header, std::min(pending_.size() + size, header_size_));
+      if (frameSize > pending_.size()) {
+        take = std::min(size, frameSize - pending_.size());
+      }
+    }
+    pending_.insert(pending_.end(), data, data + take);
+    pending_offset_ = Process(pending_.data(), pending_.size(),
+                              pending_position_, false, frames);
+    if (pending_offset_ < pending_.size()) {
+      pending_.insert(pending_.end(), data + take, data + size);
+      pending_offset_ += Process(
+          pending_.data() + pending_offset_, pending_.size() - pending_offset_,
+          pending_position_ + pending_offset_, false, frames);
+      return;
+    }
+    offset = take;
+  }
+
+  offset += Process(data + offset, size - offset, position + offset, false,
+                    frames);
+  // keep the rest behind the data the frames may point into
+  pending_offset_ = pending_.size();
+  pending_position_ = position + offset - pending_offset_;
+  pending_.insert(pending_.end(), data + offset, data + size);
+}
+
+void AACDeframer::Flush(std::vector<Frame>* frames) {
+  payloads_.clear();
+  payloads_.reserve(pending_.size());
+  pending_offset_ += Process(
+      pending_.data() + pending_offset_, pending_.size() - pending_offset_,
+      pending_position_ + pending_offset_, true, frames);
+  timestamps_.clear();
+  synced_ = false;
+}
+
+size_t AACDeframer::Process(const uint8_t* data,
+                            size_t size,
+                            uint64_t position,
+                            bool eos,
+                            std::vector<Frame>* frames) {
+  size_t pos = 0;
+  while (true) {
+    if (!synced_) {
+      pos += FindSync(data + pos, size - pos);
+      if (size - pos < header_size_) {
+        return eos ? size : pos;
+      }
+      size_t frameSize = PeekFrameSize(data + pos, size - pos);
+      if (frameSize == 0) {
+        ++pos;
+        continue;
+      }
+      size_t next = pos + frameSize;
+      if (next + header_size_ > size) {
+        if (!eos) {
+          return pos;
+        }
+        // the stream ends, a frame that is complete agrees
+        if (next > size) {
+          ++pos;
+          continue;
+        }
+      } else if (PeekFrameSize(data + next, size - next) == 0 ||
+                 !SameStream(data + pos, data + next)) {
+        ++pos;
+        continue;
+      }
+      synced_ = true;
+    }
+
+    if (size - pos < header_size_) {
+      return eos ? size : pos;
+    }
+    size_t frameSize = PeekFrameSize(data + pos, size - pos);
+    if (frameSize == 0) {
+      AVE_LOG(LS_VERBOSE) << "lost AAC sync";
+      synced_ = false;
+      ++pos;
+      continue;
+    }
+    if (frameSize > size - pos) {
+      // a truncated last frame at the end of the stream
+      return eos ? size : pos;
+    }
+    EmitFrame(data + pos, frameSize, position + pos, frames);
+    pos += frameSize;
+  }
+}
+
+size_t AACDeframer::FindSync(const uint8_t* data, size_t size) const {
+  size_t pos = 0;
+  if (format_ == Format::kADTS) {
+    // an ADTS syncword is also an MPEG audio one
+    while (true) {
+      pos += FindMPEGAudioSync(data + pos, size - pos);
+      if (pos == size) {
+        break;
+      }
+      if ((data[pos + 1] & 0xf6) == 0xf0) {
+        return pos;
+      }
+      ++pos;
+    }
+    // the first half of a syncword at the end
+    return size > 0 && data[size - 1] == 0xff ? size - 1 : size;
+  }
+
+  while (pos < size) {
+    const uint8_t* p =
+        static_cast<const uint8_t*>(memchr(data + pos, 0x56, size - pos));
+    if (p == nullptr) {
+      return size;
+    }
+    pos = p - data;
+    if (pos + 1 == size || (data[pos + 1] & 0xe0) == 0xe0) {
+      return pos;
+    }
+    ++pos;
+  }
+  return size;
+}
+
+size_t AACDeframer::PeekFrameSize(const uint8_t* data, size_t size) const {
+  if (format_ == Format::kADTS) {
+    ADTSHeader header;
+    return ParseADTSHeader(data, size, &header) ? header.frame_length : 0;
+  }
+  if (size < kLOASHeaderSize || data[0] != 0x56 ||
+      (data[1] & 0xe0) != 0xe0) {
+    return 0;
+  }
+  return kLOASHeaderSize + (((data[1] & 0x1f) << 8) | data[2]);
+}
+
+bool AACDeframer::SameStream(const uint8_t* a, const uint8_t* b) const {
+  if (format_ == Format::kLOAS) {
+    return true;
+  }
+  // ID, protection_absent, profile, sampling frequency and channels
+  return a[1] == b[1] && (a[2] & 0xfd) == (b[2] & 0xfd) &&
+         (a[3] & 0xc0) == (b[3] & 0xc0);
+}
+
+void AACDeframer::EmitFrame(const uint8_t* data,
+                            size_t size,
+                            uint64_t position,
+                            std::vector<Frame>* frames) {
+  Frame frame;
+  frame.config_changed = false;
+  size_t blocks = 1;
+  if (format_ == Format::kADTS) {
+    ADTSHeader header;
+    ParseADTSHeader(data, size, &header);
+    AudioSpecificConfig config;
+    memset(&config, 0, sizeof(config));
+    config.object_type = header.profile + 1;
+    config.sampling_frequency_index = header.sampling_frequency_index;
+    config.sampling_frequency =
+        kSamplingFrequencies[header.sampling_frequency_index];
+    config.extension_sampling_frequency = config.sampling_frequency;
+    // with channel_configuration 0 the raw data starts with a
+    // program_config_element
+    SetAACChannelConfiguration(header.channel_configuration, &config);
+    SetConfig(config, &frame);
+    if (!header.protection_absent && header.num_raw_data_blocks > 1) {
+      if (!StripBlockCRCs(data, size, header, &frame)) {
+        return;
+      }
+    } else {
+      frame.data = data + header.header_size;
+      frame.size = size - header.header_size;
+    }
+    blocks = header.num_raw_data_blocks;
+  } else {
+    if (!ParseAudioMuxElement(data, size, &frame)) {
+      return;
+    }
+  }
+  if (frame.size == 0) {
+    return;
+  }
+  AudioCodecProperty property;
+  ChannelLayout layout;
+  GetAACOutputProperty(config_, &property, &layout);
+  frame.num_samples =
+      static_cast<int32_t>(property.samples_per_channel * blocks);
+
+  // the last chunk that started at or before the frame
+  size_t used = 0;
+  while (used < timestamps_.size() && timestamps_[used].position <= position) {
+    base_pts_us_ = timestamps_[used].pts_us;
+    samples_since_base_ = 0;
+    ++used;
+  }
+  timestamps_.erase(timestamps_.begin(), timestamps_.begin() + used);
+  frame.pts_us = -1;
+  if (base_pts_us_ >= 0) {
+    frame.pts_us =
+        base_pts_us_ + samples_since_base_ * 1000000 / property.sample_rate;
+  }
+  samples_since_base_ += frame.num_samples;
+  frames->push_back(frame);
+}
+
+bool AACDeframer::StripBlockCRCs(const uint8_t* data,
+                                 size_t size,
+                                 const ADTSHeader& header,
+                                 Frame* frame) {
+  // adts_header_error_check() and adts_raw_data_block_error_check(),
+  // ISO/IEC 14496-3 1.A.3.2.2: the positions of the raw_data_blocks after
+  // the first, relative to it, and a CRC behind every block
+  const uint8_t* blocks = data + header.header_size;
+  const size_t blocksSize = size - header.header_size;
+  const size_t start = payloads_.size();
+  AVE_DCHECK(start + blocksSize <= payloads_.capacity());
+  size_t begin = 0;
+  for (size_t i = 0; i < header.num_raw_data_blocks; ++i) {
+    size_t end = blocksSize;
+    if (i + 1 < header.num_raw_data_blocks) {
+      const uint8_t* position = data + kADTSHeaderSize + 2 * i;
+      end = (position[0] << 8) | position[1];
+    }
+    if (end > blocksSize || end < begin + 2) {
+      AVE_LOG(LS_ERROR) << "bad ADTS raw_data_block position " << end;
+      payloads_.resize(start);
+      return false;
+    }
+    payloads_.insert(payloads_.end(), blocks + begin, blocks + end - 2);
+    begin = end;
+  }
+  frame->data = payloads_.data() + start;
+  frame->size = payloads_.size() - start;
+  return true;
+}
+
+bool AACDeframer::ParseAudioMuxElement(const uint8_t* data,
+                                       size_t size,
+                                       Frame* frame) {
+  // AudioMuxElement(1), ISO/IEC 14496-3 1.7.3
+  data += kLOASHeaderSize;
+  size -= kLOASHeaderSize;
+  BitReader br(data, size);
+  if (!br.getBitsWithFallback(1, 1)) {  // useSameStreamMux
+    AudioSpecificConfig config;
+    if (ParseStreamMuxConfig(&br, &config) != OK) {
+      has_mux_config_ = false;
+      return false;
+    }
+    has_mux_config_ = true;
+    mux_config_ = config;
+  } else if (!has_mux_config_) {
+    AVE_LOG(LS_VERBOSE) << "no StreamMuxConfig yet";
+    return false;
+  }
+
+  // PayloadLengthInfo()
+  size_t length = 0;
+  uint32_t tmp;
+  do {
+    tmp = br.getBitsWithFallback(8, 0);
+    length += tmp;
+  } while (tmp == 255 && !br.overRead());
+  if (br.overRead() || length * 8 > br.numBitsLeft()) {
+    AVE_LOG(LS_ERROR) << "truncated LATM payload";
+    return false;
+  }
+
+  // PayloadMux(), not byte aligned in general
+  size_t bitOffset = size * 8 - br.numBitsLeft();
+  const uint8_t* p = data + bitOffset / 8;
+  size_t shift = bitOffset % 8;
+  size_t start = payloads_.size();
+  AVE_DCHECK(start + length <= payloads_.capacity());
+  payloads_.resize(start + length);
+  uint8_t* out = payloads_.data() + start;
+  if (shift == 0) {
+    memcpy(out, p, length);
+  } else {
+    for (size_t i = 0; i < length; ++i) {
+      out[i] =
+          static_cast<uint8_t>((p[i] << shift) | (p[i + 1] >> (8 - shift)));
+    }
+  }
+
+  SetConfig(mux_config_, frame);
+  frame->data = out;
+  frame->size = length;
+  return true;
+}
+
+void AACDeframer::SetConfig(const AudioSpecificConfig& config, Frame* frame) {
+  if (has_config_ && SameConfig(config, config_)) {
+    return;
+  }
+  if (has_config_) {
+    AVE_LOG(LS_INFO) << "AAC config changed, object type "
+                     << config.object_type << ", "
+                     << config.sampling_frequency << " Hz, channel config "
+                     << static_cast<int>(config.channel_configuration);
+  }
+  frame->config_changed = true;
+  has_config_ = true;
+  config_ = config;
+}
+
+ADTSPacketizer::ADTSPacketizer(const AudioSpecificConfig& config)
+    : init_check_(OK),
+      profile_(config.object_type - 1),
+      sampling_frequency_index_(config.sampling_frequency_index),
+      channel_configuration_(config.channel_configuration) {
+  if (config.object_type < AACObjectMain ||
+      config.object_type > AACObjectLTP ||
+      config.sampling_frequency_index >= kNumSamplingFrequencies ||
+      config.channel_configuration == 0 || config.channel_configuration > 7 ||
+      config.frame_length_flag) {
+    AVE_LOG(LS_ERROR) << "config not representable in ADTS, object type "
+                      << config.object_type;
+    init_check_ = ERROR_UNSUPPORTED;
+  }
+}
+
+status_t ADTSPacketizer::InitCheck() const {
+  return init_check_;
+}
+
+void ADTSPacketizer::WriteHeader(size_t payload_size, uint8_t* out) const {
+  size_t frameLength = payload_size + kADTSHeaderSize;
+  // MPEG-4, layer 0, no CRC
+  out[0] = 0xff;
+  out[1] = 0xf1;
+  out[2] = (profile_ << 6) | (sampling_frequency_index_ << 2) |
+           (channel_configuration_ >> 2);
+  out[3] = ((channel_configuration_ & 0x03) << 6) | (frameLength >> 11);
+  out[4] = (frameLength >> 3) & 0xff;
+  // adts_buffer_fullness 0x7ff for VBR, one raw_data_block
+  out[5] = ((frameLength & 0x07) << 5) | 0x1f;
+  out[6] = 0xfc;
+}
+
+status_t ADTSPacketizer::Packetize(const uint8_t* data,
+                                   size_t size,
+                                   uint8_t* out,
+                                   size_t capacity,
+                                   size_t* out_size) {
+  if (init_check_ != OK) {
+    return init_check_;
+  }
+  if (size + kADTSHeaderSize > kMaxADTSFrameLength) {
+    AVE_LOG(LS_ERROR) << "AAC frame of " << size << " bytes too large for ADTS";
+    return ERROR_OUT_OF_RANGE;
+  }
+  if (size + kADTSHeaderSize > capacity) {
+    return ERROR_BUFFER_TOO_SMALL;
+  }
+  memmove(out + kADTSHeaderSize, data, size);
+  WriteHeader(size, out);
+  *out_size = size + kADTSHeaderSize;
+  return OK;
+}
+
+status_t ADTSPacketizer::Packetize(std::shared_ptr<Buffer>* buffer) {
+  if (init_check_ != OK) {
+    return init_check_;
+  }
+  Buffer* in = buffer->get();
+  size_t size = in->size();
+  if (size + kADTSHeaderSize > kMaxADTSFrameLength) {
+    AVE_LOG(LS_ERROR) << "AAC frame of " << size << " bytes too large for ADTS";
+    return ERROR_OUT_OF_RANGE;
+  }
+
+  if (in->offset() >= kADTSHeaderSize) {
+    in->setRange(in->offset() - kADTSHeaderSize, size + kADTSHeaderSize);
+    WriteHeader(size, in->data());
+    return OK;
+  }
+
+  size_t outSize = 0;
+  if (Packetize(in->data(), size, in->data(), in->capacity() - in->offset(),
+                &outSize) == OK) {
+    in->setRange(in->offset(), outSize);
+    return OK;
+  }
+
+  auto out = Buffer::Create(size + kADTSHeaderSize);
+  status_t err =
+      Packetize(in->data(), size, out->base(), out->capacity(), &outSize);
+  if (err != OK) {
+    return err;
+  }
+  out->setRange(0, outSize);
+  out->copyMetaFrom(*in);
+  *buffer = out;
+  return OK;
+}
+
+}  // namespace ave
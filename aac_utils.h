@@ -0,0 +1,245 @@
+/*
+ * aac_utils.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef AAC_UTILS_H
+#define AAC_UTILS_H
+
+#include <memory>
+#include <vector>
+
+#include "base/constructor_magic.h"
+#include "base/types.h"
+
+#include "channel_layout.h"
+#include "media_errors.h"
+
+namespace ave {
+
+class AudioCodecProperty;
+class BitReader;
+class Buffer;
+class ESDS;
+class MetaData;
+
+// AudioSpecificConfig(), ISO/IEC 14496-3 1.6.2.1.
+struct AudioSpecificConfig {
+  // audioObjectType of the core, AACObjectLC etc., also with SBR and PS
+  int32_t object_type;
+  // 15 if the rate is given explicitly
+  uint8_t sampling_frequency_index;
+  // of the core
+  int32_t sampling_frequency;
+  // 0 if a program_config_element describes the channels
+  uint8_t channel_configuration;
+  // of the core, LFE included
+  int32_t num_channels;
+  ChannelLayout channel_layout;
+  // 960 instead of 1024 samples per frame
+  bool frame_length_flag;
+  // SBR (HE-AAC) and PS (HE-AAC v2), signalled explicitly or backward
+  // compatibly. Without either, SBR may still be signalled implicitly in
+  // the stream.
+  bool sbr_present;
+  bool ps_present;
+  // the SBR output rate, else |sampling_frequency|
+  int32_t extension_sampling_frequency;
+};
+
+// Reads an AudioSpecificConfig of a general audio object type, with the
+// channels of a program_config_element. Returns ERROR_UNSUPPORTED for other
+// object types. The backward compatible SBR/PS extension is only looked for
+// after a config given by |data| and |size|, where its end is known.
+status_t ParseAudioSpecificConfig(BitReader* br, AudioSpecificConfig* config);
+status_t ParseAudioSpecificConfig(const uint8_t* data,
+                                  size_t size,
+                                  AudioSpecificConfig* config);
+
+// Sets the channel fields of |config| from a channelConfiguration, false if
+// it is 0 or reserved.
+bool SetAACChannelConfiguration(uint8_t channel_configuration,
+                                AudioSpecificConfig* config);
+
+// What a decoder outputs for |config|: the sample rate and frame size with
+// SBR, and the stereo upmix of PS.
+void GetAACOutputProperty(const AudioSpecificConfig& config,
+                          AudioCodecProperty* property,
+                          ChannelLayout* layout);
+
+// Parses the AudioSpecificConfig in the DecoderSpecificInfo of |esds|, so
+// the output format is known without decoding a frame.
+status_t ParseAACCodecProperty(const ESDS& esds,
+                               AudioCodecProperty* property,
+                               ChannelLayout* layout);
+
+// adts_fixed_header() and adts_variable_header(), ISO/IEC 13818-7 6.2.
+struct ADTSHeader {
+  // audioObjectType - 1
+  uint8_t profile;
+  uint8_t sampling_frequency_index;
+  uint8_t channel_configuration;
+  bool protection_absent;
+  // 7, with a CRC 2 more for it and 2 for the position of every
+  // raw_data_block after the first
+  size_t header_size;
+  // including the header
+  size_t frame_length;
+  // raw_data_blocks in the frame, 1024 samples each before SBR
+  size_t num_raw_data_blocks;
+};
+
+const size_t kADTSHeaderSize = 7;
+
+// Parses the ADTS header at |data|, false if there is none.
+bool ParseADTSHeader(const uint8_t* data, size_t size, ADTSHeader* header);
+
+// Splits an ADTS or LOAS/LATM (AudioSyncStream, ISO/IEC 14496-3 1.7.2)
+// stream that arrives in arbitrary chunks into raw AAC frames, tracking the
+// AudioSpecificConfig as it changes.
+//
+// ADTS payloads are returned as slices of the chunks pushed, only a frame
+// split across chunks, or one with a CRC behind each of its raw_data_blocks,
+// is copied. LATM payloads are not byte aligned and always copied. A
+// candidate sync word is trusted once the next frame header agrees with it.
+class AACDeframer {
+ public:
+  enum class Format {
+    kADTS,
+    kLOAS,
+  };
+
+  struct Frame {
+    // into the chunk pushed or the deframer, valid until the next call
+    const uint8_t* data;
+    size_t size;
+    // of the chunk the frame started in, else extrapolated from the
+    // previous timestamp and the sample counts, -1 if not known
+    int64_t pts_us;
+    // per channel at the output rate, so doubled by SBR
+    int32_t num_samples;
+    // the config differs from the one of the previous frame
+    bool config_changed;
+  };
+
+  explicit AACDeframer(Format format);
+
+  // Adds the next chunk of the stream, -1 if |pts_us| is not known. Frames
+  // completed by the chunk are appended to |frames|.
+  void Push(const uint8_t* data,
+            size_t size,
+            int64_t pts_us,
+            std::vector<Frame>* frames);
+
+  // Ends the stream, a truncated last frame is dropped.
+  void Flush(std::vector<Frame>* frames);
+
+  // Drops buffered data and the sync, e.g. after a seek. The config is
+  // kept.
+  void Reset();
+
+  // Of the last frame returned, false before the first one.
+  bool GetConfig(AudioSpecificConfig* config) const;
+
+  // Sets the MIME type, rate, channel count and ESDS of the config through
+  // MakeAACCodecSpecificData(). SBR and PS are left to implicit signalling.
+  bool MakeCodecSpecificData(MetaData& meta) const;
+
+ private:
+  struct Timestamp {
+    uint64_t position;
+    int64_t pts_us;
+  };
+
+  // Emits the frames of |data|, which starts |position| bytes into the
+  // stream, and returns the bytes consumed.
+  size_t Process(const uint8_t* data,
+                 size_t size,
+                 uint64_t position,
+                 bool eos,
+                 std::vector<Frame>* frames);
+  size_t FindSync(const uint8_t* data, size_t size) const;
+  // The size of the frame at |data|, 0 if there is no valid header.
+  size_t PeekFrameSize(const uint8_t* data, size_t size) const;
+  // Whether the headers at |a| and |b| belong to the same stream.
+  bool SameStream(const uint8_t* a, const uint8_t* b) const;
+  void EmitFrame(const uint8_t* data,
+                 size_t size,
+                 uint64_t position,
+                 std::vector<Frame>* frames);
+  // Copies the raw_data_blocks of an ADTS frame with a CRC behind each
+  // into |payloads_|, false if their positions are broken.
+  bool StripBlockCRCs(const uint8_t* data,
+                      size_t size,
+                      const ADTSHeader& header,
+                      Frame* frame);
+  bool ParseAudioMuxElement(const uint8_t* data,
+                            size_t size,
+                            Frame* frame);
+  void SetConfig(const AudioSpecificConfig& config, Frame* frame);
+
+  const Format format_;
+  const size_t header_size_;
+
+  // a frame split across chunks, from |pending_offset_| on
+  std::vector<uint8_t> pending_;
+  size_t pending_offset_;
+  // stream position of |pending_|
+  uint64_t pending_position_;
+  uint64_t position_;
+  std::vector<Timestamp> timestamps_;
+  bool synced_;
+
+  bool has_config_;
+  AudioSpecificConfig config_;
+  // StreamMuxConfig() seen, useSameStreamMux refers to it
+  bool has_mux_config_;
+  AudioSpecificConfig mux_config_;
+  // LATM payloads and ADTS frames without their block CRCs
+  std::vector<uint8_t> payloads_;
+
+  // timestamp extrapolation
+  int64_t base_pts_us_;
+  int64_t samples_since_base_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(AACDeframer);
+};
+
+// Puts raw AAC frames behind ADTS headers, e.g. to remux into MPEG-TS.
+class ADTSPacketizer {
+ public:
+  // |config| needs an object type ADTS can carry, Main to LTP, and a
+  // sampling frequency index.
+  explicit ADTSPacketizer(const AudioSpecificConfig& config);
+
+  status_t InitCheck() const;
+
+  // Writes the ADTS frame of the |size| bytes at |data| into |out|, which
+  // has room for |capacity| bytes and may be |data| itself.
+  status_t Packetize(const uint8_t* data,
+                     size_t size,
+                     uint8_t* out,
+                     size_t capacity,
+                     size_t* out_size);
+
+  // Puts the header in front of the range of |*buffer|, in the buffer when
+  // there is room before or after the range, else |*buffer| is replaced by
+  // a new buffer with the same sample meta, int32Data() and a copy of meta().
+  status_t Packetize(std::shared_ptr<Buffer>* buffer);
+
+ private:
+  void WriteHeader(size_t payload_size, uint8_t* out) const;
+
+  status_t init_check_;
+  uint8_t profile_;
+  uint8_t sampling_frequency_index_;
+  uint8_t channel_configuration_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(ADTSPacketizer);
+};
+
+}  // namespace ave
+
+#endif /* !AAC_UTILS_H */
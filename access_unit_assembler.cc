@@ -0,0 +1,311 @@
+/*
+ * access_unit_assembler.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "access_unit_assembler.h"
+
+#include <algorithm>
+
+#include "base/checks.h"
+
+#include "fast_bit_reader.h"
+#include "media_errors.h"
+
+namespace ave {
+
+namespace {
+
+// the length the indexer strips from a start code, see BeginAccessUnit()
+const size_t kStartCodeSize = 3;
+
+}  // namespace
+
+AccessUnitAssembler::AccessUnitAssembler(NALFormat format)
+    : format_(format), indexer_(format) {
+  Reset();
+}
+
+void AccessUnitAssembler::Reset() {
+  indexer_.Reset();
+  avc_.reset();
+  hevc_.resetPicOrderCnt();
+  buffer_.clear();
+  index_offset_ = 0;
+  indexed_.clear();
+  timestamps_.clear();
+  unit_start_ = 0;
+  nals_.clear();
+  has_slice_ = false;
+  has_key_slice_ = false;
+  all_intra_ = true;
+  recovery_point_ = false;
+  unit_nals_.clear();
+  unit_nal_index_.clear();
+}
+
+void AccessUnitAssembler::Push(const uint8_t* data,
+                               size_t size,
+                               int64_t pts_us,
+                               int64_t dts_us,
+                               std::vector<AccessUnit>* units) {
+  Compact();
+  // a chunk without timestamps is recorded as well while others are pending,
+  // so that the stamps of a chunk without a start are not taken by a later
+  // access unit
+  if (size > 0 && (pts_us >= 0 || dts_us >= 0 || !timestamps_.empty())) {
+    timestamps_.push_back({buffer_.size(), pts_us, dts_us});
+  }
+  buffer_.insert(buffer_.end(), data, data + size);
+  Index(false, units);
+}
+
+void AccessUnitAssembler::Flush(std::vector<AccessUnit>* units) {
+  Compact();
+  Index(true, units);
+  timestamps_.clear();
+  // whatever follows starts a new coded video sequence
+  avc_.reset();
+  hevc_.resetPicOrderCnt();
+}
+
+void AccessUnitAssembler::Compact() {
+  unit_nals_.clear();
+  unit_nal_index_.clear();
+
+  size_t keep = nals_.empty() ? index_offset_
+                              : std::min(index_offset_, unit_start_);
+  if (keep == 0) {
+    return;
+  }
+  // the kept part is the incomplete access unit, a few NAL units at most
+  buffer_.erase(buffer_.begin(), buffer_.begin() + keep);
+  index_offset_ -= keep;
+  unit_start_ -= std::min(unit_start_, keep);
+  for (NALPosition& nal : nals_) {
+    nal.nalOffset -= keep;
+  }
+  for (Timestamp& timestamp : timestamps_) {
+    timestamp.offset -= std::min(timestamp.offset, keep);
+  }
+}
+
+void AccessUnitAssembler::Index(bool eos, std::vector<AccessUnit>* units) {
+  const size_t first = units->size();
+
+  indexed_.clear();
+  size_t consumed = indexer_.Index(buffer_.data() + index_offset_,
+                                   buffer_.size() - index_offset_, &indexed_,
+                                   eos);
+  for (NALPosition nal : indexed_) {
+    nal.nalOffset += index_offset_;
+    AddNAL(nal, units);
+  }
+  index_offset_ += consumed;
+  if (eos && !nals_.empty()) {
+    EmitAccessUnit(units);
+  }
+
+  // |unit_nals_| is complete now, it does not move any more
+  for (size_t i = first; i < units->size(); ++i) {
+    (*units)[i].nals = unit_nals_.data() + unit_nal_index_[i - first];
+  }
+}
+
+void AccessUnitAssembler::AddNAL(const NALPosition& nal,
+                                 std::vector<AccessUnit>* units) {
+  const uint8_t* data = buffer_.data() + nal.nalOffset;
+  NALInfo info;
+  if (format_ == NALFormat::kAVC) {
+    ClassifyAVC(data, nal.nalSize, &info);
+  } else {
+    ClassifyHEVC(data, nal.nalSize, &info);
+  }
+
+  if (info.starts_access_unit && !nals_.empty()) {
+    EmitAccessUnit(units);
+  }
+  if (nals_.empty()) {
+    BeginAccessUnit(nal);
+  }
+  nals_.push_back(nal);
+
+  recovery_point_ = recovery_point_ || info.recovery_point;
+  if (info.is_slice) {
+    if (!has_slice_) {
+      current_.pic_order_cnt = info.pic_order_cnt;
+    }
+    has_slice_ = true;
+    has_key_slice_ = has_key_slice_ || info.is_key;
+    all_intra_ = all_intra_ && info.is_intra;
+  }
+}
+
+void AccessUnitAssembler::ClassifyAVC(const uint8_t* nal,
+                                      size_t size,
+                                      NALInfo* info) {
+  // Rec. ITU-T H.264 7.4.1.2.3
+  uint8_t type = nal[0] & 0x1f;
+  switch (type) {
+    case 9:  // access unit delimiter
+      info->starts_access_unit = true;
+      break;
+    case 7:  // SPS
+    case 8:  // PPS
+      (void)avc_.addNalUnit(nal, size);
+      info->starts_access_unit = has_slice_;
+      break;
+    case 6:  // SEI
+      info->recovery_point = AvcParameterSets::hasRecoveryPoint(nal, size);
+      info->starts_access_unit = has_slice_;
+      break;
+    case 14:
+    case 15:
+    case 16:
+    case 17:
+    case 18:
+      info->starts_access_unit = has_slice_;
+      break;
+    case 1:
+    case 5: {
+      info->is_slice = true;
+      info->is_key = type == 5;
+      bool firstSlice;
+      AvcSliceHeader header;
+      if (avc_.parseSliceHeader(nal, size, &header) == OK) {
+        firstSlice = avc_.addSlice(header);
+        info->is_intra = header.sliceType == kAvcSliceTypeI ||
+                         header.sliceType == kAvcSliceTypeSI;
+        info->pic_order_cnt = avc_.picOrderCnt();
+      } else {
+        // without the PPS, a picture starts with macroblock 0
+        FastNALBitReader br(nal + 1, size - 1);
+        firstSlice = br.getUEWithFallback(1) == 0;
+      }
+      info->starts_access_unit = has_slice_ && firstSlice;
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void AccessUnitAssembler::ClassifyHEVC(const uint8_t* nal,
+                                       size_t size,
+                                       NALInfo* info) {
+  // Rec. ITU-T H.265 7.4.2.4.4
+  if (size < 2) {
+    return;
+  }
+  uint8_t type = (nal[0] >> 1) & 0x3f;
+  uint8_t layerId = ((nal[0] & 0x01) << 5) | (nal[1] >> 3);
+  if (type < 32) {
+    info->is_slice = true;
+    info->is_key = type >= 16 && type <= 23;
+    info->is_intra = info->is_key;
+    if (layerId != 0) {
+      return;
+    }
+    bool firstSlice;
+    HevcSliceHeader header;
+    if (hevc_.parseSliceHeader(nal, size, &header) == OK) {
+      firstSlice = header.firstSliceSegmentInPic;
+      info->is_intra = header.sliceType == kHevcSliceTypeI;
+      if (firstSlice) {
+        info->pic_order_cnt = hevc_.computePicOrderCnt(header);
+      }
+    } else {
+      // first_slice_segment_in_pic_flag
+      firstSlice = size > 2 && (nal[2] & 0x80) != 0;
+    }
+    info->starts_access_unit = has_slice_ && firstSlice;
+    return;
+  }
+
+  if (layerId != 0) {
+    return;
+  }
+  switch (type) {
+    case 35:  // access unit delimiter
+      info->starts_access_unit = true;
+      break;
+    case kHevcNalUnitTypeVps:
+    case kHevcNalUnitTypeSps:
+    case kHevcNalUnitTypePps:
+      (void)hevc_.parseNalUnit(nal, size);
+      info->starts_access_unit = has_slice_;
+      break;
+    case 36:  // end of sequence
+      hevc_.resetPicOrderCnt();
+      break;
+    case kHevcNalUnitTypePrefixSei:
+    case 41:
+    case 42:
+    case 43:
+    case 44:
+      info->starts_access_unit = has_slice_;
+      break;
+    default:
+      info->starts_access_unit = has_slice_ && type >= 48 && type <= 55;
+      break;
+  }
+}
+
+void AccessUnitAssembler::BeginAccessUnit(const NALPosition& nal) {
+  AVE_DCHECK_GE(nal.nalOffset, kStartCodeSize);
+  unit_start_ = nal.nalOffset - kStartCodeSize;
+  current_ = AccessUnit();
+  current_.pts_us = -1;
+  current_.dts_us = -1;
+  has_slice_ = false;
+  has_key_slice_ = false;
+  all_intra_ = true;
+  recovery_point_ = false;
+
+  // the timestamps of the last chunk that has them and a byte of the start
+  // code, with the zero byte of a four byte one. Stamps of earlier chunks,
+  // without a start of their own, are dropped.
+  size_t code_start = unit_start_;
+  if (code_start > 0 && buffer_[code_start - 1] == 0) {
+    --code_start;
+  }
+  size_t used = 0;
+  while (used < timestamps_.size() &&
+         timestamps_[used].offset < nal.nalOffset) {
+    const Timestamp& timestamp = timestamps_[used];
+    // every later chunk is recorded while a stamp is pending
+    size_t end = used + 1 < timestamps_.size() ? timestamps_[used + 1].offset
+                                               : buffer_.size();
+    if (end > code_start && (timestamp.pts_us >= 0 || timestamp.dts_us >= 0)) {
+      current_.pts_us = timestamp.pts_us;
+      current_.dts_us = timestamp.dts_us;
+    }
+    ++used;
+  }
+  timestamps_.erase(timestamps_.begin(), timestamps_.begin() + used);
+}
+
+void AccessUnitAssembler::EmitAccessUnit(std::vector<AccessUnit>* units) {
+  AVE_DCHECK(!nals_.empty());
+  const NALPosition& last = nals_.back();
+  AccessUnit unit = current_;
+  unit.data = buffer_.data() + unit_start_;
+  unit.size = last.nalOffset + last.nalSize - unit_start_;
+  unit.nals = nullptr;
+  unit.num_nals = nals_.size();
+  unit.sync = has_key_slice_ ||
+              (format_ == NALFormat::kAVC && has_slice_ && all_intra_ &&
+               recovery_point_);
+
+  unit_nal_index_.push_back(unit_nals_.size());
+  for (const NALPosition& nal : nals_) {
+    unit_nals_.push_back({static_cast<uint32_t>(nal.nalOffset - unit_start_),
+                          nal.nalSize, nal.nalType});
+  }
+  units->push_back(unit);
+  nals_.clear();
+}
+
+}  // namespace ave
@@ -0,0 +1,127 @@
+/*
+ * access_unit_assembler.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef ACCESS_UNIT_ASSEMBLER_H
+#define ACCESS_UNIT_ASSEMBLER_H
+
+#include <vector>
+
+#include "base/constructor_magic.h"
+#include "base/types.h"
+
+#include "avc_parameter_sets.h"
+#include "avc_utils.h"
+#include "hevc_utils.h"
+
+namespace ave {
+
+// Cuts an H.264 or HEVC Annex-B elementary stream that arrives in arbitrary
+// chunks, e.g. TS or RTP payloads, into access units. A new access unit
+// starts at an access unit delimiter, at a parameter set or prefix SEI that
+// follows a slice, and at the first slice of a new picture, which the slice
+// headers tell (frame_num, POC and the other 7.4.1.2.4 fields for H.264,
+// first_slice_segment_in_pic_flag for HEVC).
+//
+// Access units are returned as views into the internal buffer, which holds
+// the data of the access unit in progress only. Bytes that were already
+// scanned are not scanned again when the next chunk arrives.
+class AccessUnitAssembler {
+ public:
+  struct AccessUnit {
+    // Annex-B data from the start code of the first NAL unit on, valid until
+    // the next call to the assembler
+    const uint8_t* data;
+    size_t size;
+    // offsets are relative to |data|
+    const NALPosition* nals;
+    size_t num_nals;
+    // of the chunk the access unit started in, -1 if not known
+    int64_t pts_us;
+    int64_t dts_us;
+    // IDR/IRAP, or H.264 I picture with a recovery point SEI
+    bool sync;
+    // PicOrderCnt of the primary picture, 0 without a decodable slice header
+    int32_t pic_order_cnt;
+  };
+
+  explicit AccessUnitAssembler(NALFormat format);
+
+  // Adds the next chunk of the stream. The timestamps, -1 if not known,
+  // belong to the first access unit that starts in the chunk. Access units
+  // completed by the chunk are appended to |units|.
+  void Push(const uint8_t* data,
+            size_t size,
+            int64_t pts_us,
+            int64_t dts_us,
+            std::vector<AccessUnit>* units);
+
+  // Ends the stream, the access unit in progress is appended to |units|.
+  void Flush(std::vector<AccessUnit>* units);
+
+  // Drops buffered data, e.g. after a seek. Parameter sets are kept.
+  void Reset();
+
+ private:
+  struct Timestamp {
+    size_t offset;
+    int64_t pts_us;
+    int64_t dts_us;
+  };
+
+  // What a NAL unit means for the access unit in progress.
+  struct NALInfo {
+    bool starts_access_unit = false;
+    bool is_slice = false;
+    // IDR/IRAP slice
+    bool is_key = false;
+    bool is_intra = false;
+    bool recovery_point = false;
+    // valid for the first slice of a picture
+    int32_t pic_order_cnt = 0;
+  };
+
+  // Drops the data of the access units returned by the previous call.
+  void Compact();
+  void Index(bool eos, std::vector<AccessUnit>* units);
+  void AddNAL(const NALPosition& nal, std::vector<AccessUnit>* units);
+  // Feeds parameter sets and slice headers to the parsers.
+  void ClassifyAVC(const uint8_t* nal, size_t size, NALInfo* info);
+  void ClassifyHEVC(const uint8_t* nal, size_t size, NALInfo* info);
+  void BeginAccessUnit(const NALPosition& nal);
+  void EmitAccessUnit(std::vector<AccessUnit>* units);
+
+  const NALFormat format_;
+  NALIndexer indexer_;
+  AvcParameterSets avc_;
+  HevcParameterSets hevc_;
+
+  std::vector<uint8_t> buffer_;
+  // where the NAL indexer resumes, the start code of its pending NAL unit
+  size_t index_offset_;
+  std::vector<NALPosition> indexed_;
+  std::vector<Timestamp> timestamps_;
+
+  // the access unit in progress, offsets into |buffer_|
+  size_t unit_start_;
+  std::vector<NALPosition> nals_;
+  AccessUnit current_;
+  bool has_slice_;
+  bool has_key_slice_;
+  bool all_intra_;
+  bool recovery_point_;
+
+  // NAL units of the returned access units, |unit_nal_index_| has the first
+  // one of each
+  std::vector<NALPosition> unit_nals_;
+  std::vector<size_t> unit_nal_index_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(AccessUnitAssembler);
+};
+
+}  // namespace ave
+
+#endif /* !ACCESS_UNIT_ASSEMBLER_H */
@@ -0,0 +1,566 @@
+/*
+ * audio_resampler.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "audio_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <tuple>
+
+#include "base/checks.h"
+#include "base/logging.h"
+
+#include "channel_layout.h"
+#include "media_packet.h"
+#include "vector_math.h"
+
+namespace ave {
+
+struct AudioResampler::FilterBank {
+  // interpolation rows of taps coefficients, row p for the outputs p /
+  // interpolation input samples after the start of their window
+  std::vector<float> coefficients;
+};
+
+namespace {
+
+const int64_t kMaxPhases = 2048;
+// input frames converted at a time, and output frames filtered at a time
+const size_t kBlockFrames = 512;
+
+const struct {
+  size_t taps;
+  double attenuation_db;
+} kQualities[] = {
+    {24, 60.0},
+    {64, 90.0},
+    {128, 110.0},
+};
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser
+// window.
+double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 50; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+bool GetPacketEncoding(const AudioSampleInfo& info, AudioEncoding* encoding) {
+  switch (info.codec_id) {
+    case CodecId::AV_CODEC_ID_PCM_U8:
+      *encoding = kAudioEncodingPcm8bit;
+      return true;
+    case CodecId::AV_CODEC_ID_PCM_S16LE:
+      *encoding = kAudioEncodingPcm16bit;
+      return true;
+    case CodecId::AV_CODEC_ID_PCM_S24LE:
+      *encoding = kAudioEncodingPcm24bitPacked;
+      return true;
+    case CodecId::AV_CODEC_ID_PCM_S32LE:
+      *encoding = kAudioEncodingPcm32bit;
+      return true;
+    case CodecId::AV_CODEC_ID_PCM_F32LE:
+      *encoding = kAudioEncodingPcmFloat;
+      return true;
+    case CodecId::AV_CODEC_ID_NONE:
+      break;
+    default:
+      return false;
+  }
+  // raw PCM described by its sample size only
+  switch (info.bits_per_sample) {
+    case 8:
+      *encoding = kAudioEncodingPcm8bit;
+      return true;
+    case 16:
+      *encoding = kAudioEncodingPcm16bit;
+      return true;
+    case 24:
+      *encoding = kAudioEncodingPcm24bitPacked;
+      return true;
+    case 32:
+      *encoding = kAudioEncodingPcm32bit;
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+// static
+std::shared_ptr<const AudioResampler::FilterBank>
+AudioResampler::GetFilterBank(int64_t interpolation,
+                              size_t taps,
+                              double cutoff,
+                              double beta) {
+  using Key = std::tuple<int64_t, size_t, double, double>;
+  // leaked on purpose, resamplers may be destroyed during exit.
+  static std::mutex* lock = new std::mutex();
+  static auto* banks = new std::map<Key, std::weak_ptr<const FilterBank>>();
+
+  const Key key(interpolation, taps, cutoff, beta);
+  std::lock_guard<std::mutex> guard(*lock);
+  auto it = banks->find(key);
+  if (it != banks->end()) {
+    std::shared_ptr<const FilterBank> bank = it->second.lock();
+    if (bank) {
+      return bank;
+    }
+  }
+
+  // Row p holds the windowed sinc at the distances between the taps and
+  // an output p / interpolation input samples after the middle of the
+  // window. Each row is normalized to unity gain at DC.
+  auto bank = std::make_shared<FilterBank>();
+  bank->coefficients.resize(interpolation * taps);
+  const double half = taps / 2.0;
+  const double window_scale = 1.0 / BesselI0(beta);
+  std::vector<double> row(taps);
+  for (int64_t p = 0; p < interpolation; p++) {
+    double sum = 0.0;
+    for (size_t k = 0; k < taps; k++) {
+      double distance = static_cast<double>(p) / interpolation + half - 1 -
+                        static_cast<double>(k);
+      double x = distance / half;
+      double window =
+          BesselI0(beta * std::sqrt(std::max(0.0, 1.0 - x * x))) *
+          window_scale;
+      double arg = M_PI * cutoff * distance;
+      double sinc = arg == 0.0 ? 1.0 : std::sin(arg) / arg;
+      row[k] = sinc * window;
+      sum += row[k];
+    }
+    float* coefficients = &bank->coefficients[p * taps];
+    for (size_t k = 0; k < taps; k++) {
+      coefficients[k] = static_cast<float>(row[k] / sum);
+    }
+  }
+
+  for (auto entry = banks->begin(); entry != banks->end();) {
+    if (entry->second.expired()) {
+      entry = banks->erase(entry);
+    } else {
+      ++entry;
+    }
+  }
+  (*banks)[key] = bank;
+  return bank;
+}
+
+AudioResampler::AudioResampler(int input_rate,
+                               int output_rate,
+                               int channels,
+                               Quality quality,
+                               bool low_latency)
+    : input_rate_(input_rate),
+      output_rate_(output_rate),
+      channels_(channels),
+      init_check_(NO_INIT),
+      interpolation_(1),
+      decimation_(1),
+      taps_(8),
+      buffered_(0),
+      position_(0),
+      phase_(0),
+      input_frames_(0),
+      output_frames_(0),
+      packet_encoding_(kAudioEncodingPcm16bit),
+      base_timestamp_us_(-1) {
+  if (input_rate <= 0 || output_rate <= 0 || channels <= 0 ||
+      channels > kMaxConcurrentChannels) {
+    AVE_LOG(LS_ERROR) << "unsupported resampling of " << channels
+                      << " channels from " << input_rate << " to "
+                      << output_rate;
+    init_check_ = ERROR_UNSUPPORTED;
+    return;
+  }
+  int64_t divisor = std::gcd(input_rate, output_rate);
+  interpolation_ = output_rate / divisor;
+  decimation_ = input_rate / divisor;
+  if (interpolation_ > kMaxPhases) {
+    AVE_LOG(LS_ERROR) << "resampling from " << input_rate << " to "
+                      << output_rate << " needs " << interpolation_
+                      << " filter phases";
+    init_check_ = ERROR_UNSUPPORTED;
+    return;
+  }
+
+  // The filter is designed for the lower of the two rates: |length| taps
+  // per sample of it, a cutoff that puts the end of the Kaiser transition
+  // band at its Nyquist frequency.
+  const auto& params = kQualities[static_cast<int>(quality)];
+  size_t length = low_latency ? params.taps / 2 : params.taps;
+  length = std::max<size_t>(8, (length + 7) & ~size_t(7));
+  double transition = (params.attenuation_db - 7.95) /
+                      (2.285 * static_cast<double>(length) * M_PI);
+  double beta = 0.1102 * (params.attenuation_db - 8.7);
+  double ratio = static_cast<double>(output_rate) / input_rate;
+  double cutoff = (1.0 - transition / 2) * std::min(1.0, ratio);
+  if (ratio < 1.0) {
+    length = static_cast<size_t>(std::ceil(length / ratio));
+  }
+  taps_ = (length + 7) & ~size_t(7);
+  bank_ = GetFilterBank(interpolation_, taps_, cutoff, beta);
+
+  buffers_.resize(channels);
+  out_planes_.resize(channels);
+  in_plane_ptrs_.resize(channels);
+  out_plane_ptrs_.resize(channels);
+  for (int ch = 0; ch < channels; ch++) {
+    buffers_[ch].resize(taps_ + kBlockFrames);
+    out_planes_[ch].resize(kBlockFrames);
+    out_plane_ptrs_[ch] = out_planes_[ch].data();
+  }
+  interleaved_.resize(kBlockFrames * channels);
+  Reset();
+  init_check_ = OK;
+}
+
+status_t AudioResampler::InitCheck() const {
+  return init_check_;
+}
+
+size_t AudioResampler::GetOutputFrames(size_t frames) const {
+  if (init_check_ != OK) {
+    return 0;
+  }
+  // Output n starts its window floor((phase_ + n * decimation_) /
+  // interpolation_) frames after |position_|, count the ones whose window
+  // ends within the input.
+  int64_t last = static_cast<int64_t>(buffered_ + frames) -
+                 static_cast<int64_t>(taps_ + position_);
+  if (last < 0) {
+    return 0;
+  }
+  return ((last + 1) * interpolation_ - 1 - phase_) / decimation_ + 1;
+}
+
+size_t AudioResampler::GetFlushFrames() const {
+  if (init_check_ != OK) {
+    return 0;
+  }
+  // every output before the end of the input
+  uint64_t total =
+      (input_frames_ * interpolation_ + decimation_ - 1) / decimation_;
+  return total - output_frames_;
+}
+
+status_t AudioResampler::Resample(AudioEncoding encoding,
+                                  const void* in,
+                                  size_t frames,
+                                  void* out,
+                                  size_t capacity,
+                                  size_t* out_frames) {
+  *out_frames = 0;
+  if (init_check_ != OK) {
+    return init_check_;
+  }
+  if (GetPcmSampleSize(encoding) == 0) {
+    AVE_LOG(LS_ERROR) << "unsupported encoding " << encoding;
+    return ERROR_UNSUPPORTED;
+  }
+  if (capacity < GetOutputFrames(frames)) {
+    return ERROR_BUFFER_TOO_SMALL;
+  }
+  return ResampleBlocks(encoding, static_cast<const uint8_t*>(in), frames,
+                        static_cast<uint8_t*>(out), out_frames);
+}
+
+status_t AudioResampler::Resample(MediaPacket& in, MediaPacket& out) {
+  if (init_check_ != OK) {
+    return init_check_;
+  }
+  AudioSampleInfo* info = in.audio_info();
+  if (in.media_type() != MediaType::AUDIO || info == nullptr) {
+    AVE_LOG(LS_ERROR) << "not an audio packet";
+    return ERROR_MALFORMED;
+  }
+  AudioEncoding encoding;
+  if (!GetPacketEncoding(*info, &encoding)) {
+    AVE_LOG(LS_ERROR) << "unsupported PCM codec "
+                      << static_cast<int>(info->codec_id) << " of "
+                      << info->bits_per_sample << " bits";
+    return ERROR_UNSUPPORTED;
+  }
+  if (info->sample_rate_hz != input_rate_ || info->channels != channels_) {
+    AVE_LOG(LS_ERROR) << "packet of " << info->channels << " channels at "
+                      << info->sample_rate_hz << " Hz, expected "
+                      << channels_ << " at " << input_rate_;
+    return ERROR_UNSUPPORTED;
+  }
+  size_t frame_size = GetPcmSampleSize(encoding) * channels_;
+  size_t frames = info->samples_per_channel >= 0
+                      ? static_cast<size_t>(info->samples_per_channel)
+                      : in.size() / frame_size;
+  if (frames * frame_size > in.size()) {
+    AVE_LOG(LS_ERROR) << "packet of " << in.size() << " bytes for "
+                      << frames << " frames";
+    return ERROR_MALFORMED;
+  }
+
+  if (base_timestamp_us_ < 0 && info->timestamp_us >= 0) {
+    base_timestamp_us_ = info->timestamp_us -
+                         static_cast<int64_t>(input_frames_) * 1000000 /
+                             input_rate_;
+  }
+  packet_encoding_ = encoding;
+  packet_info_ = *info;
+
+  uint64_t first_frame = output_frames_;
+  size_t out_frames = GetOutputFrames(frames);
+  if (out_frames > 0) {
+    out.SetMediaType(MediaType::AUDIO);
+    out.SetSize(out_frames * frame_size);
+  }
+  status_t status = ResampleBlocks(encoding, in.data(), frames,
+                                   out_frames > 0 ? out.data() : nullptr,
+                                   &out_frames);
+  if (status != OK) {
+    return status;
+  }
+  if (out_frames == 0) {
+    return NOT_ENOUGH_DATA;
+  }
+
+  AudioSampleInfo* out_info = out.audio_info();
+  *out_info = packet_info_;
+  out_info->sample_rate_hz = output_rate_;
+  out_info->samples_per_channel = static_cast<int64_t>(out_frames);
+  out_info->timestamp_us =
+      base_timestamp_us_ < 0
+          ? -1
+          : base_timestamp_us_ + static_cast<int64_t>(first_frame) * 1000000 /
+                                     output_rate_;
+  return OK;
+}
+
+status_t AudioResampler::Flush(AudioEncoding encoding,
+                               void* out,
+                               size_t capacity,
+                               size_t* out_frames) {
+  *out_frames = 0;
+  if (init_check_ != OK) {
+    return init_check_;
+  }
+  size_t frame_size = GetPcmSampleSize(encoding) * channels_;
+  if (frame_size == 0) {
+    AVE_LOG(LS_ERROR) << "unsupported encoding " << encoding;
+    return ERROR_UNSUPPORTED;
+  }
+  size_t remaining = GetFlushFrames();
+  if (capacity < remaining) {
+    return ERROR_BUFFER_TOO_SMALL;
+  }
+
+  // Silence after the end of the stream completes the windows of the
+  // outputs still missing.
+  uint8_t* dest = static_cast<uint8_t*>(out);
+  size_t zeros = latency_frames();
+  while (remaining > 0 && zeros > 0) {
+    Compact();
+    size_t count = std::min(zeros, kBlockFrames);
+    for (auto& buffer : buffers_) {
+      std::fill_n(buffer.begin() + buffered_, count, 0.0f);
+    }
+    buffered_ += count;
+    zeros -= count;
+
+    size_t produced;
+    do {
+      produced = Process(std::min(remaining, kBlockFrames));
+      status_t status = Store(encoding, produced, dest);
+      if (status != OK) {
+        Reset();
+        return status;
+      }
+      dest += produced * frame_size;
+      *out_frames += produced;
+      remaining -= produced;
+    } while (produced == kBlockFrames && remaining > 0);
+  }
+  AVE_DCHECK_EQ(remaining, 0u);
+  Reset();
+  return OK;
+}
+
+status_t AudioResampler::Flush(MediaPacket& out) {
+  if (init_check_ != OK) {
+    return init_check_;
+  }
+  size_t frames = GetFlushFrames();
+  if (frames == 0) {
+    Reset();
+    return NOT_ENOUGH_DATA;
+  }
+  int64_t timestamp_us =
+      base_timestamp_us_ < 0
+          ? -1
+          : base_timestamp_us_ +
+                static_cast<int64_t>(output_frames_) * 1000000 / output_rate_;
+
+  out.SetMediaType(MediaType::AUDIO);
+  out.SetSize(frames * GetPcmSampleSize(packet_encoding_) * channels_);
+  status_t status = Flush(packet_encoding_, out.data(), frames, &frames);
+  if (status != OK) {
+    return status;
+  }
+  AudioSampleInfo* out_info = out.audio_info();
+  *out_info = packet_info_;
+  out_info->sample_rate_hz = output_rate_;
+  out_info->samples_per_channel = static_cast<int64_t>(frames);
+  out_info->timestamp_us = timestamp_us;
+  return OK;
+}
+
+void AudioResampler::Reset() {
+  if (buffers_.empty()) {
+    return;
+  }
+  // The first output is centered on the first input, the half of its
+  // window before the stream is silence.
+  buffered_ = latency_frames() - 1;
+  for (auto& buffer : buffers_) {
+    std::fill_n(buffer.begin(), buffered_, 0.0f);
+  }
+  position_ = 0;
+  phase_ = 0;
+  input_frames_ = 0;
+  output_frames_ = 0;
+  dither_ = PcmDither();
+  base_timestamp_us_ = -1;
+}
+
+size_t AudioResampler::Process(size_t limit) {
+  const float* coefficients = bank_->coefficients.data();
+  const size_t step = static_cast<size_t>(decimation_ / interpolation_);
+  const int64_t phase_step = decimation_ % interpolation_;
+  size_t produced = 0;
+  while (produced < limit && position_ + taps_ <= buffered_) {
+    const float* phase = coefficients + phase_ * taps_;
+    for (int ch = 0; ch < channels_; ch++) {
+      const float* window = buffers_[ch].data() + position_;
+      out_planes_[ch][produced] =
+          vector_math::DotProduct(window, phase, taps_);
+    }
+    produced++;
+    position_ += step;
+    phase_ += phase_step;
+    if (phase_ >= interpolation_) {
+      phase_ -= interpolation_;
+      position_++;
+    }
+  }
+  output_frames_ += produced;
+  return produced;
+}
+
+status_t AudioResampler::Append(AudioEncoding encoding,
+                                const void* in,
+                                size_t frames) {
+  AVE_DCHECK_LE(frames, kBlockFrames);
+  for (int ch = 0; ch < channels_; ch++) {
+    in_plane_ptrs_[ch] = buffers_[ch].data() + buffered_;
+  }
+  const void* samples = in;
+  if (encoding != kAudioEncodingPcmFloat) {
+    status_t status = ConvertPcm(encoding, in, kAudioEncodingPcmFloat,
+                                 interleaved_.data(), frames * channels_);
+    if (status != OK) {
+      return status;
+    }
+    samples = interleaved_.data();
+  }
+  status_t status = DeinterleavePcm(kAudioEncodingPcmFloat, samples, channels_,
+                                    frames, in_plane_ptrs_.data());
+  if (status != OK) {
+    return status;
+  }
+  buffered_ += frames;
+  input_frames_ += frames;
+  return OK;
+}
+
+status_t AudioResampler::Store(AudioEncoding encoding,
+                               size_t frames,
+                               void* out) {
+  if (frames == 0) {
+    return OK;
+  }
+  if (encoding == kAudioEncodingPcmFloat) {
+    return InterleavePcm(kAudioEncodingPcmFloat, out_plane_ptrs_.data(),
+                         channels_, frames, out);
+  }
+  status_t status = InterleavePcm(kAudioEncodingPcmFloat,
+                                  out_plane_ptrs_.data(), channels_, frames,
+                                  interleaved_.data());
+  if (status != OK) {
+    return status;
+  }
+  return ConvertPcm(kAudioEncodingPcmFloat, interleaved_.data(), encoding,
+                    out, frames * channels_, &dither_);
+}
+
+void AudioResampler::Compact() {
+  size_t consumed = std::min(position_, buffered_);
+  if (consumed == 0) {
+    return;
+  }
+  size_t left = buffered_ - consumed;
+  for (auto& buffer : buffers_) {
+    std::memmove(buffer.data(), buffer.data() + consumed,
+                 left * sizeof(float));
+  }
+  buffered_ = left;
+  position_ -= consumed;
+}
+
+status_t AudioResampler::ResampleBlocks(AudioEncoding encoding,
+                                        const uint8_t* in,
+                                        size_t frames,
+                                        uint8_t* out,
+                                        size_t* out_frames) {
+  const size_t frame_size = GetPcmSampleSize(encoding) * channels_;
+  *out_frames = 0;
+  while (frames > 0) {
+    Compact();
+    size_t count = std::min(frames, kBlockFrames);
+    status_t status = Append(encoding, in, count);
+    if (status != OK) {
+      return status;
+    }
+    in += count * frame_size;
+    frames -= count;
+
+    size_t produced;
+    do {
+      produced = Process(kBlockFrames);
+      status = Store(encoding, produced, out);
+      if (status != OK) {
+        return status;
+      }
+      if (produced > 0) {
+        out += produced * frame_size;
+      }
+      *out_frames += produced;
+    } while (produced == kBlockFrames);
+  }
+  return OK;
+}
+
+}  // namespace ave
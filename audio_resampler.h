@@ -0,0 +1,175 @@
+/*
+ * audio_resampler.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef AUDIO_RESAMPLER_H
+#define AUDIO_RESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "base/constructor_magic.h"
+#include "base/types.h"
+
+#include "media_defs.h"
+#include "media_errors.h"
+#include "media_utils.h"
+#include "pcm_conversion.h"
+
+namespace ave {
+
+class MediaPacket;
+
+// Converts the sample rate of interleaved PCM with a polyphase windowed
+// sinc filter. The rates are reduced to L / M, e.g. 160 / 147 from 44.1 to
+// 48 kHz, and the filter is split into L phases, so every output sample is
+// one dot product of the input with a precomputed phase. The phases are
+// built once per ratio and quality and shared between resamplers.
+//
+// The output is aligned with the input, the first output sample is at the
+// time of the first input sample. The filter holds back latency_frames()
+// input frames until Flush() ends the stream, after which exactly
+// ceil(input frames * output rate / input rate) frames have been produced.
+//
+// Samples are filtered in float, the integer encodings are converted with
+// ConvertPcm(). Not thread safe.
+class AudioResampler {
+ public:
+  enum class Quality {
+    // 24 taps per phase, about 60 dB of stopband attenuation
+    kLow,
+    // 64 taps, about 90 dB
+    kMedium,
+    // 128 taps, about 110 dB
+    kHigh,
+  };
+
+  // Up to 2048 filter phases, which covers the ratios between the usual
+  // rates from 8 to 192 kHz. Up to kMaxConcurrentChannels channels.
+  // |low_latency| halves the filter length and with it the latency, at the
+  // price of a wider transition band. When downsampling the filter is
+  // stretched by the ratio to keep the transition band in place.
+  AudioResampler(int input_rate,
+                 int output_rate,
+                 int channels,
+                 Quality quality = Quality::kMedium,
+                 bool low_latency = false);
+
+  status_t InitCheck() const;
+
+  // The frames the next Resample() of |frames| input frames produces.
+  size_t GetOutputFrames(size_t frames) const;
+
+  // Resamples |frames| interleaved frames of |encoding| from |in| into
+  // |out|, which has room for |capacity| frames, at least
+  // GetOutputFrames(frames). The frames written are returned in
+  // |*out_frames|, maybe 0 at the start of the stream.
+  status_t Resample(AudioEncoding encoding,
+                    const void* in,
+                    size_t frames,
+                    void* out,
+                    size_t capacity,
+                    size_t* out_frames);
+
+  // Resamples an audio packet with the input rate and channel count into
+  // |out|, which is resized and gets the AudioSampleInfo of |in| at the
+  // output rate. The timestamps continue from the first packet after
+  // construction or Reset(). Returns NOT_ENOUGH_DATA if the packet only
+  // filled the filter, |out| is untouched then.
+  status_t Resample(MediaPacket& in, MediaPacket& out);
+
+  // The frames Flush() writes.
+  size_t GetFlushFrames() const;
+
+  // Ends the stream: writes the frames held back by the filter into |out|,
+  // which has room for |capacity| frames, and resets.
+  status_t Flush(AudioEncoding encoding,
+                 void* out,
+                 size_t capacity,
+                 size_t* out_frames);
+  // In the format of the last packet, NOT_ENOUGH_DATA if nothing is left.
+  status_t Flush(MediaPacket& out);
+
+  // Drops the buffered input, e.g. after a seek.
+  void Reset();
+
+  int input_rate() const { return input_rate_; }
+  int output_rate() const { return output_rate_; }
+  int channels() const { return channels_; }
+  // Taps per filter phase.
+  size_t taps() const { return taps_; }
+  // Input frames needed after an instant before its output is complete.
+  size_t latency_frames() const { return taps_ / 2; }
+
+ private:
+  struct FilterBank;
+
+  // Builds the phases of a ratio or returns the ones another resampler
+  // built.
+  static std::shared_ptr<const FilterBank> GetFilterBank(
+      int64_t interpolation,
+      size_t taps,
+      double cutoff,
+      double beta);
+
+  // Filters the input buffered so far into |out_planes_|, at most |limit|
+  // frames, and returns how many.
+  size_t Process(size_t limit);
+  // Appends |frames| of |in| to |buffers_|, at most kBlockFrames.
+  status_t Append(AudioEncoding encoding, const void* in, size_t frames);
+  // Converts |frames| of |out_planes_| to |out|.
+  status_t Store(AudioEncoding encoding, size_t frames, void* out);
+  // Drops the input before the next filter window.
+  void Compact();
+  status_t ResampleBlocks(AudioEncoding encoding,
+                          const uint8_t* in,
+                          size_t frames,
+                          uint8_t* out,
+                          size_t* out_frames);
+
+  const int input_rate_;
+  const int output_rate_;
+  const int channels_;
+  status_t init_check_;
+  // the ratio reduced to output_rate_ / input_rate_ = interpolation_ /
+  // decimation_
+  int64_t interpolation_;
+  int64_t decimation_;
+  size_t taps_;
+  std::shared_ptr<const FilterBank> bank_;
+
+  // one buffer of float input per channel
+  std::vector<std::vector<float>> buffers_;
+  size_t buffered_;
+  // start of the next filter window in |buffers_|, may be past the end
+  // when downsampling
+  size_t position_;
+  // filter phase of the next output
+  int64_t phase_;
+  // since construction or Reset()
+  uint64_t input_frames_;
+  uint64_t output_frames_;
+
+  std::vector<std::vector<float>> out_planes_;
+  std::vector<const void*> out_plane_ptrs_;
+  std::vector<void*> in_plane_ptrs_;
+  std::vector<float> interleaved_;
+  PcmDither dither_;
+
+  // format of the last packet
+  AudioEncoding packet_encoding_;
+  AudioSampleInfo packet_info_;
+  // of the first input frame, -1 if not known
+  int64_t base_timestamp_us_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(AudioResampler);
+};
+
+}  // namespace ave
+
+#endif /* !AUDIO_RESAMPLER_H */
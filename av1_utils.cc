@@ -0,0 +1,389 @@
+/*
+ * av1_utils.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "av1_utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+
+#include "fast_bit_reader.h"
+#include "media_errors.h"
+
+namespace ave {
+
+namespace {
+
+const uint32_t kSelectScreenContentTools = 2;
+const uint32_t kSelectIntegerMv = 2;
+const uint8_t kAllFrames = 0xff;
+
+// leb128(), 4.10.5. Returns the number of bytes read, 0 if malformed.
+size_t ReadLeb128(const uint8_t* data, size_t size, uint64_t* value) {
+  *value = 0;
+  for (size_t i = 0; i < 8 && i < size; ++i) {
+    *value |= static_cast<uint64_t>(data[i] & 0x7f) << (i * 7);
+    if (!(data[i] & 0x80)) {
+      return *value <= 0xffffffffull ? i + 1 : 0;
+    }
+  }
+  return 0;
+}
+
+// uvlc(), 4.10.3
+uint32_t ReadUvlc(FastRawBitReader* br) {
+  uint32_t leadingZeros = 0;
+  while (br->getBitsWithFallback(1, 1) == 0) {
+    ++leadingZeros;
+  }
+  if (leadingZeros >= 32) {
+    return 0xffffffff;
+  }
+  return br->getBitsWithFallback(leadingZeros, 0) + (1u << leadingZeros) - 1;
+}
+
+}  // namespace
+
+Av1ObuReader::Av1ObuReader(const uint8_t* data, size_t size)
+    : mData(data), mSize(size) {}
+
+status_t Av1ObuReader::next(Av1Obu* obu) {
+  if (mSize == 0) {
+    return ERROR_END_OF_STREAM;
+  }
+  // obu_header(), 5.3.2
+  uint8_t header = mData[0];
+  if (header & 0x80) {
+    AVE_LOG(LS_ERROR) << "obu_forbidden_bit set";
+    return ERROR_MALFORMED;
+  }
+  obu->type = (header >> 3) & 0x0f;
+  obu->hasExtension = (header & 0x04) != 0;
+  bool hasSizeField = (header & 0x02) != 0;
+  size_t headerSize = obu->hasExtension ? 2 : 1;
+  if (mSize < headerSize) {
+    return ERROR_MALFORMED;
+  }
+  obu->temporalId = obu->hasExtension ? mData[1] >> 5 : 0;
+  obu->spatialId = obu->hasExtension ? (mData[1] >> 3) & 0x03 : 0;
+
+  size_t payloadSize = mSize - headerSize;
+  if (hasSizeField) {
+    uint64_t obuSize;
+    size_t n = ReadLeb128(mData + headerSize, mSize - headerSize, &obuSize);
+    if (n == 0 || obuSize > mSize - headerSize - n) {
+      AVE_LOG(LS_ERROR) << "invalid obu_size";
+      return ERROR_MALFORMED;
+    }
+    headerSize += n;
+    payloadSize = obuSize;
+  }
+
+  obu->data = mData;
+  obu->size = headerSize + payloadSize;
+  obu->payload = mData + headerSize;
+  obu->payloadSize = payloadSize;
+  mData += obu->size;
+  mSize -= obu->size;
+  return OK;
+}
+
+status_t ParseAv1SequenceHeader(const uint8_t* data,
+                                size_t size,
+                                Av1SequenceHeader* header) {
+  // sequence_header_obu(), 5.5.1
+  FastRawBitReader br(data, size);
+  memset(header, 0, sizeof(*header));
+  header->seqProfile = br.getBitsWithFallback(3, 0);
+  header->stillPicture = br.getBitsWithFallback(1, 0);
+  header->reducedStillPictureHeader = br.getBitsWithFallback(1, 0);
+  if (header->reducedStillPictureHeader) {
+    header->operatingPointsCnt = 1;
+    header->seqLevelIdx[0] = br.getBitsWithFallback(5, 0);
+  } else {
+    bool timingInfoPresent = br.getBitsWithFallback(1, 0);
+    if (timingInfoPresent) {
+      br.skipBits(32);  // num_units_in_display_tick
+      br.skipBits(32);  // time_scale
+      header->equalPictureInterval = br.getBitsWithFallback(1, 0);
+      if (header->equalPictureInterval) {
+        ReadUvlc(&br);  // num_ticks_per_picture_minus_1
+      }
+      header->decoderModelInfoPresent = br.getBitsWithFallback(1, 0);
+    }
+    uint32_t bufferDelayLength = 0;
+    if (header->decoderModelInfoPresent) {
+      bufferDelayLength = br.getBitsWithFallback(5, 0) + 1;
+      br.skipBits(32);  // num_units_in_decoding_tick
+      header->bufferRemovalTimeLength = br.getBitsWithFallback(5, 0) + 1;
+      header->framePresentationTimeLength = br.getBitsWithFallback(5, 0) + 1;
+    }
+    bool initialDisplayDelayPresent = br.getBitsWithFallback(1, 0);
+    header->operatingPointsCnt = br.getBitsWithFallback(5, 0) + 1;
+    for (uint32_t i = 0; i < header->operatingPointsCnt; ++i) {
+      header->operatingPointIdc[i] = br.getBitsWithFallback(12, 0);
+      header->seqLevelIdx[i] = br.getBitsWithFallback(5, 0);
+      if (header->seqLevelIdx[i] > 7) {
+        br.skipBits(1);  // seq_tier
+      }
+      if (header->decoderModelInfoPresent) {
+        header->decoderModelPresentForThisOp[i] =
+            br.getBitsWithFallback(1, 0);
+        if (header->decoderModelPresentForThisOp[i]) {
+          // decoder_buffer_delay, encoder_buffer_delay, low_delay_mode_flag
+          br.skipBits(2 * bufferDelayLength + 1);
+        }
+      }
+      if (initialDisplayDelayPresent && br.getBitsWithFallback(1, 0)) {
+        br.skipBits(4);  // initial_display_delay_minus_1
+      }
+    }
+  }
+
+  header->frameWidthBits = br.getBitsWithFallback(4, 0) + 1;
+  header->frameHeightBits = br.getBitsWithFallback(4, 0) + 1;
+  header->maxFrameWidth =
+      br.getBitsWithFallback(header->frameWidthBits, 0) + 1;
+  header->maxFrameHeight =
+      br.getBitsWithFallback(header->frameHeightBits, 0) + 1;
+  if (!header->reducedStillPictureHeader) {
+    header->frameIdNumbersPresent = br.getBitsWithFallback(1, 0);
+  }
+  if (header->frameIdNumbersPresent) {
+    uint32_t deltaFrameIdLength = br.getBitsWithFallback(4, 0) + 2;
+    header->frameIdLength =
+        br.getBitsWithFallback(3, 0) + 1 + deltaFrameIdLength;
+  }
+  // use_128x128_superblock, enable_filter_intra, enable_intra_edge_filter
+  br.skipBits(3);
+  header->forceScreenContentTools = kSelectScreenContentTools;
+  header->forceIntegerMv = kSelectIntegerMv;
+  if (!header->reducedStillPictureHeader) {
+    // enable_interintra_compound, enable_masked_compound,
+    // enable_warped_motion, enable_dual_filter
+    br.skipBits(4);
+    bool enableOrderHint = br.getBitsWithFallback(1, 0);
+    if (enableOrderHint) {
+      br.skipBits(2);  // enable_jnt_comp, enable_ref_frame_mvs
+    }
+    if (!br.getBitsWithFallback(1, 0)) {  // seq_choose_screen_content_tools
+      header->forceScreenContentTools = br.getBitsWithFallback(1, 0);
+    }
+    if (header->forceScreenContentTools > 0) {
+      if (!br.getBitsWithFallback(1, 0)) {  // seq_choose_integer_mv
+        header->forceIntegerMv = br.getBitsWithFallback(1, 0);
+      }
+    }
+    if (enableOrderHint) {
+      header->orderHintBits = br.getBitsWithFallback(3, 0) + 1;
+    }
+  }
+  header->enableSuperres = br.getBitsWithFallback(1, 0);
+  br.skipBits(2);  // enable_cdef, enable_restoration
+
+  // color_config(), 5.5.2
+  bool highBitdepth = br.getBitsWithFallback(1, 0);
+  header->bitDepth = 8;
+  if (header->seqProfile == 2 && highBitdepth) {
+    header->bitDepth = br.getBitsWithFallback(1, 0) ? 12 : 10;
+  } else if (header->seqProfile <= 2 && highBitdepth) {
+    header->bitDepth = 10;
+  }
+  if (header->seqProfile != 1) {
+    header->monoChrome = br.getBitsWithFallback(1, 0);
+  }
+
+  if (br.overRead()) {
+    AVE_LOG(LS_ERROR) << "truncated sequence header";
+    return ERROR_MALFORMED;
+  }
+  return OK;
+}
+
+status_t ParseAv1FrameHeader(const Av1SequenceHeader& sequenceHeader,
+                             const Av1Obu& obu,
+                             Av1FrameHeader* header) {
+  // uncompressed_header(), 5.9.2
+  const Av1SequenceHeader& seq = sequenceHeader;
+  FastRawBitReader br(obu.payload, obu.payloadSize);
+  memset(header, 0, sizeof(*header));
+  if (seq.reducedStillPictureHeader) {
+    header->frameType = kAv1KeyFrame;
+    header->showFrame = true;
+    header->errorResilientMode = true;
+  } else {
+    header->showExistingFrame = br.getBitsWithFallback(1, 0);
+    if (header->showExistingFrame) {
+      header->frameToShowMapIdx = br.getBitsWithFallback(3, 0);
+      header->showFrame = true;
+      if (br.overRead()) {
+        return ERROR_MALFORMED;
+      }
+      return OK;
+    }
+    header->frameType = br.getBitsWithFallback(2, 0);
+    header->showFrame = br.getBitsWithFallback(1, 0);
+    if (header->showFrame && seq.decoderModelInfoPresent &&
+        !seq.equalPictureInterval) {
+      br.skipBits(seq.framePresentationTimeLength);  // temporal_point_info()
+    }
+    if (!header->showFrame) {
+      br.skipBits(1);  // showable_frame
+    }
+    if (header->frameType == kAv1SwitchFrame || header->isKeyFrame()) {
+      header->errorResilientMode = true;
+    } else {
+      header->errorResilientMode = br.getBitsWithFallback(1, 0);
+    }
+  }
+  const bool frameIsIntra = header->frameType == kAv1KeyFrame ||
+                            header->frameType == kAv1IntraOnlyFrame;
+
+  br.skipBits(1);  // disable_cdf_update
+  uint32_t allowScreenContentTools = seq.forceScreenContentTools;
+  if (allowScreenContentTools == kSelectScreenContentTools) {
+    allowScreenContentTools = br.getBitsWithFallback(1, 0);
+  }
+  if (allowScreenContentTools && seq.forceIntegerMv == kSelectIntegerMv) {
+    br.skipBits(1);  // force_integer_mv
+  }
+  if (seq.frameIdNumbersPresent) {
+    br.skipBits(seq.frameIdLength);  // current_frame_id
+  }
+  bool frameSizeOverride = false;
+  if (header->frameType == kAv1SwitchFrame) {
+    frameSizeOverride = true;
+  } else if (!seq.reducedStillPictureHeader) {
+    frameSizeOverride = br.getBitsWithFallback(1, 0);
+  }
+  br.skipBits(seq.orderHintBits);  // order_hint
+  if (!frameIsIntra && !header->errorResilientMode) {
+    br.skipBits(3);  // primary_ref_frame
+  }
+  if (seq.decoderModelInfoPresent && br.getBitsWithFallback(1, 0)) {
+    for (uint32_t op = 0; op < seq.operatingPointsCnt; ++op) {
+      if (!seq.decoderModelPresentForThisOp[op]) {
+        continue;
+      }
+      uint32_t idc = seq.operatingPointIdc[op];
+      bool inTemporalLayer = (idc >> obu.temporalId) & 1;
+      bool inSpatialLayer = (idc >> (obu.spatialId + 8)) & 1;
+      if (idc == 0 || (inTemporalLayer && inSpatialLayer)) {
+        br.skipBits(seq.bufferRemovalTimeLength);  // buffer_removal_time
+      }
+    }
+  }
+  if (header->frameType == kAv1SwitchFrame || header->isKeyFrame()) {
+    header->refreshFrameFlags = kAllFrames;
+  } else {
+    header->refreshFrameFlags = br.getBitsWithFallback(8, 0);
+  }
+
+  if (frameIsIntra) {
+    if (header->refreshFrameFlags != kAllFrames &&
+        header->errorResilientMode && seq.orderHintBits > 0) {
+      br.skipBits(8 * seq.orderHintBits);  // ref_order_hint[]
+    }
+    // frame_size(), 5.9.5
+    header->frameWidth = seq.maxFrameWidth;
+    header->frameHeight = seq.maxFrameHeight;
+    if (frameSizeOverride) {
+      header->frameWidth = br.getBitsWithFallback(seq.frameWidthBits, 0) + 1;
+      header->frameHeight =
+          br.getBitsWithFallback(seq.frameHeightBits, 0) + 1;
+    }
+  }
+
+  if (br.overRead()) {
+    AVE_LOG(LS_ERROR) << "truncated frame header";
+    return ERROR_MALFORMED;
+  }
+  return OK;
+}
+
+status_t SplitAv1TemporalUnits(const uint8_t* data,
+                               size_t size,
+                               std::vector<Av1TemporalUnit>* units) {
+  units->clear();
+  Av1ObuReader reader(data, size);
+  Av1Obu obu;
+  status_t err;
+  while ((err = reader.next(&obu)) == OK) {
+    size_t offset = obu.data - data;
+    if (units->empty() || obu.type == kAv1ObuTemporalDelimiter) {
+      if (units->empty() || units->back().size > 0) {
+        units->push_back({offset, 0});
+      }
+    }
+    units->back().size = offset + obu.size - units->back().offset;
+  }
+  return err == ERROR_END_OF_STREAM ? OK : err;
+}
+
+Av1Parser::Av1Parser() {
+  reset();
+}
+
+void Av1Parser::reset() {
+  mHasSequenceHeader = false;
+  memset(&mSequenceHeader, 0, sizeof(mSequenceHeader));
+}
+
+status_t Av1Parser::parseTemporalUnit(const uint8_t* data,
+                                      size_t size,
+                                      Av1TemporalUnitInfo* info) {
+  memset(info, 0, sizeof(*info));
+  Av1ObuReader reader(data, size);
+  Av1Obu obu;
+  status_t err;
+  bool hasIntraSize = false;
+  while ((err = reader.next(&obu)) == OK) {
+    if (obu.type == kAv1ObuSequenceHeader) {
+      Av1SequenceHeader header;
+      if (ParseAv1SequenceHeader(obu.payload, obu.payloadSize, &header) ==
+          OK) {
+        mSequenceHeader = header;
+        mHasSequenceHeader = true;
+        info->hasSequenceHeader = true;
+      }
+      continue;
+    }
+    if (obu.type != kAv1ObuFrameHeader && obu.type != kAv1ObuFrame) {
+      continue;
+    }
+
+    if (!info->hasFrame) {
+      info->temporalId = obu.temporalId;
+      info->spatialId = obu.spatialId;
+    }
+    info->maxSpatialId = std::max(info->maxSpatialId, obu.spatialId);
+    Av1FrameHeader header;
+    if (!mHasSequenceHeader ||
+        ParseAv1FrameHeader(mSequenceHeader, obu, &header) != OK) {
+      info->hasFrame = true;
+      continue;
+    }
+    if (!info->hasFrame) {
+      info->frameType = header.frameType;
+    }
+    info->hasFrame = true;
+    info->isKeyFrame = info->isKeyFrame || header.isKeyFrame();
+    if (header.frameWidth > 0 && obu.spatialId >= info->maxSpatialId) {
+      info->width = header.frameWidth;
+      info->height = header.frameHeight;
+      hasIntraSize = true;
+    }
+  }
+  if (!hasIntraSize && mHasSequenceHeader) {
+    info->width = mSequenceHeader.maxFrameWidth;
+    info->height = mSequenceHeader.maxFrameHeight;
+  }
+  return err == ERROR_END_OF_STREAM ? OK : err;
+}
+
+}  // namespace ave
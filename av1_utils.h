@@ -0,0 +1,191 @@
+/*
+ * av1_utils.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef AV1_UTILS_H
+#define AV1_UTILS_H
+
+#include <vector>
+
+#include "base/constructor_magic.h"
+#include "base/types.h"
+
+namespace ave {
+
+// AV1 bitstream 6.2.2
+enum {
+  kAv1ObuSequenceHeader = 1,
+  kAv1ObuTemporalDelimiter = 2,
+  kAv1ObuFrameHeader = 3,
+  kAv1ObuTileGroup = 4,
+  kAv1ObuMetadata = 5,
+  kAv1ObuFrame = 6,
+  kAv1ObuRedundantFrameHeader = 7,
+  kAv1ObuTileList = 8,
+  kAv1ObuPadding = 15,
+};
+
+// AV1 bitstream 6.8.2
+enum {
+  kAv1KeyFrame = 0,
+  kAv1InterFrame = 1,
+  kAv1IntraOnlyFrame = 2,
+  kAv1SwitchFrame = 3,
+};
+
+// One OBU of a low overhead bitstream format sample, 5.2. Pointers refer to
+// the parsed data, nothing is copied.
+struct Av1Obu {
+  uint8_t type;
+  bool hasExtension;
+  // 0 without obu_extension_header
+  uint8_t temporalId;
+  uint8_t spatialId;
+  // the whole OBU, from its header on
+  const uint8_t* data;
+  size_t size;
+  const uint8_t* payload;
+  size_t payloadSize;
+};
+
+// Walks the OBUs of a sample or temporal unit. The last OBU may omit its
+// obu_size field, it then extends to the end of the data.
+class Av1ObuReader {
+ public:
+  Av1ObuReader(const uint8_t* data, size_t size);
+
+  // Returns OK with the next OBU, ERROR_END_OF_STREAM after the last one or
+  // ERROR_MALFORMED.
+  status_t next(Av1Obu* obu);
+
+ private:
+  const uint8_t* mData;
+  size_t mSize;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(Av1ObuReader);
+};
+
+// AV1 bitstream 5.5, up to color_config() bit depth and monochrome.
+struct Av1SequenceHeader {
+  uint8_t seqProfile;
+  bool stillPicture;
+  bool reducedStillPictureHeader;
+  bool equalPictureInterval;
+  bool decoderModelInfoPresent;
+  uint32_t bufferRemovalTimeLength;
+  uint32_t framePresentationTimeLength;
+  uint32_t operatingPointsCnt;
+  uint16_t operatingPointIdc[32];
+  uint8_t seqLevelIdx[32];
+  bool decoderModelPresentForThisOp[32];
+  uint32_t frameWidthBits;
+  uint32_t frameHeightBits;
+  uint32_t maxFrameWidth;
+  uint32_t maxFrameHeight;
+  bool frameIdNumbersPresent;
+  // idLen, with frameIdNumbersPresent
+  uint32_t frameIdLength;
+  // seq_force_screen_content_tools and seq_force_integer_mv, 2 is
+  // SELECT_SCREEN_CONTENT_TOOLS/SELECT_INTEGER_MV
+  uint32_t forceScreenContentTools;
+  uint32_t forceIntegerMv;
+  // OrderHintBits, 0 without enable_order_hint
+  uint32_t orderHintBits;
+  bool enableSuperres;
+  uint32_t bitDepth;
+  bool monoChrome;
+};
+
+// AV1 bitstream 5.9.2, up to frame_size(), which is only parsed for intra
+// frames because inter frames may take their size from a reference.
+struct Av1FrameHeader {
+  bool showExistingFrame;
+  uint8_t frameToShowMapIdx;
+  // not parsed with showExistingFrame, the type is that of the shown frame
+  uint8_t frameType;
+  bool showFrame;
+  bool errorResilientMode;
+  uint8_t refreshFrameFlags;
+  // frame_size() of intra frames, 0 otherwise
+  uint32_t frameWidth;
+  uint32_t frameHeight;
+
+  // KEY_FRAME with show_frame, a random access point. Showing an existing
+  // frame needs the earlier frames, so it never is one.
+  bool isKeyFrame() const {
+    return !showExistingFrame && frameType == kAv1KeyFrame && showFrame;
+  }
+};
+
+status_t ParseAv1SequenceHeader(const uint8_t* data,
+                                size_t size,
+                                Av1SequenceHeader* header);
+
+// Parses the frame header at the start of an OBU_FRAME_HEADER or OBU_FRAME
+// payload. |obu| gives the layer ids that buffer_removal_time depends on.
+status_t ParseAv1FrameHeader(const Av1SequenceHeader& sequenceHeader,
+                             const Av1Obu& obu,
+                             Av1FrameHeader* header);
+
+// A temporal unit within a sample, 7.5. Each one starts with a temporal
+// delimiter, except possibly the first.
+struct Av1TemporalUnit {
+  size_t offset;
+  size_t size;
+};
+
+// Replaces |units| with the temporal units of a sample.
+status_t SplitAv1TemporalUnits(const uint8_t* data,
+                               size_t size,
+                               std::vector<Av1TemporalUnit>* units);
+
+// What a temporal unit holds, from its sequence and frame headers.
+struct Av1TemporalUnitInfo {
+  bool hasFrame;
+  // has a shown key frame, i.e. decoding can start here
+  bool isKeyFrame;
+  bool hasSequenceHeader;
+  // of the first frame header
+  uint8_t frameType;
+  uint8_t temporalId;
+  uint8_t spatialId;
+  // highest spatial layer of the temporal unit
+  uint8_t maxSpatialId;
+  // of the key or intra frame of the highest spatial layer, else the
+  // maximum of the sequence header
+  uint32_t width;
+  uint32_t height;
+};
+
+// Keeps the sequence header of an AV1 stream so frame headers of the
+// following temporal units can be parsed.
+class Av1Parser {
+ public:
+  Av1Parser();
+
+  const Av1SequenceHeader* sequenceHeader() const {
+    return mHasSequenceHeader ? &mSequenceHeader : nullptr;
+  }
+
+  // Parses a temporal unit in low overhead bitstream format. Frame headers
+  // before the first sequence header cannot be parsed, and are only reported
+  // with their layer ids.
+  status_t parseTemporalUnit(const uint8_t* data,
+                             size_t size,
+                             Av1TemporalUnitInfo* info);
+
+  void reset();
+
+ private:
+  bool mHasSequenceHeader;
+  Av1SequenceHeader mSequenceHeader;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(Av1Parser);
+};
+
+}  // namespace ave
+
+#endif /* !AV1_UTILS_H */
@@ -0,0 +1,703 @@
+/*
+ * avc_parameter_sets.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "avc_parameter_sets.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/checks.h"
+#include "base/logging.h"
+
+#include "avc_utils.h"
+#include "fast_bit_reader.h"
+#include "media_errors.h"
+
+namespace ave {
+
+namespace {
+
+enum {
+  kNalUnitTypeSlice = 1,
+  kNalUnitTypeIdrSlice = 5,
+  kNalUnitTypeSei = 6,
+  kNalUnitTypeSps = 7,
+  kNalUnitTypePps = 8,
+};
+
+const uint32_t kSeiRecoveryPoint = 6;
+
+bool HasChromaFormat(uint8_t profileIdc) {
+  switch (profileIdc) {
+    case 44:
+    case 83:
+    case 86:
+    case 100:
+    case 110:
+    case 118:
+    case 122:
+    case 128:
+    case 134:
+    case 135:
+    case 138:
+    case 139:
+    case 244:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void skipScalingList(FastNALBitReader* br, size_t sizeOfScalingList) {
+  int32_t lastScale = 8;
+  int32_t nextScale = 8;
+  for (size_t j = 0; j < sizeOfScalingList; ++j) {
+    if (nextScale != 0) {
+      int32_t deltaScale = br->getSEWithFallback(0);
+      nextScale = (lastScale + deltaScale + 256) % 256;
+    }
+    lastScale = (nextScale == 0) ? lastScale : nextScale;
+  }
+}
+
+// ref_pic_list_modification() for one list
+void skipRefPicListModification(FastNALBitReader* br) {
+  if (!br->getBitsWithFallback(1, 0)) {
+    return;
+  }
+  for (;;) {
+    uint32_t idc = br->getUEWithFallback(3);
+    if (idc == 3 || br->overRead()) {
+      break;
+    }
+    br->getUEWithFallback(0);  // abs_diff_pic_num_minus1 or long_term_pic_num
+  }
+}
+
+// pred_weight_table() entries for one list
+void skipWeights(FastNALBitReader* br, uint32_t numRefIdxActive, bool chroma) {
+  for (uint32_t i = 0; i < numRefIdxActive && !br->overRead(); ++i) {
+    if (br->getBitsWithFallback(1, 0)) {  // luma_weight_flag
+      br->getSEWithFallback(0);
+      br->getSEWithFallback(0);
+    }
+    if (chroma && br->getBitsWithFallback(1, 0)) {  // chroma_weight_flag
+      for (int j = 0; j < 4; ++j) {
+        br->getSEWithFallback(0);
+      }
+    }
+  }
+}
+
+int32_t CeilLog2(uint32_t x) {
+  return x <= 1 ? 0 : 32 - __builtin_clz(x - 1);
+}
+
+}  // namespace
+
+AvcParameterSets::AvcParameterSets() {
+  memset(mSps, 0, sizeof(mSps));
+  memset(mPps, 0, sizeof(mPps));
+  reset();
+}
+
+void AvcParameterSets::reset() {
+  mHasLastSlice = false;
+  memset(&mLastSlice, 0, sizeof(mLastSlice));
+  mPicOrderCnt = 0;
+  mPicOrderCntMsb = 0;
+  mTopFieldOrderCnt = 0;
+  mBottomFieldOrderCnt = 0;
+  mFrameNumOffset = 0;
+  mPrevPicOrderCntMsb = 0;
+  mPrevPicOrderCntLsb = 0;
+  mPrevFrameNumOffset = 0;
+  mPrevFrameNum = 0;
+}
+
+const AvcSps* AvcParameterSets::getSps(uint32_t id) const {
+  return id < kMaxSps && mSps[id].valid ? &mSps[id] : nullptr;
+}
+
+const AvcPps* AvcParameterSets::getPps(uint32_t id) const {
+  return id < kMaxPps && mPps[id].valid ? &mPps[id] : nullptr;
+}
+
+status_t AvcParameterSets::addNalUnit(const uint8_t* data, size_t size) {
+  if (size < 1) {
+    AVE_LOG(LS_ERROR) << "empty NAL";
+    return ERROR_MALFORMED;
+  }
+  switch (data[0] & 0x1f) {
+    case kNalUnitTypeSps:
+      return parseSps(data + 1, size - 1);
+    case kNalUnitTypePps:
+      return parsePps(data + 1, size - 1);
+    default:
+      return OK;
+  }
+}
+
+status_t AvcParameterSets::parseSps(const uint8_t* data, size_t size) {
+  // See Rec. ITU-T H.264 (08/2021) 7.3.2.1.1 for reference
+  FastNALBitReader br(data, size);
+  AvcSps sps;
+  memset(&sps, 0, sizeof(sps));
+
+  sps.profileIdc = br.getBitsWithFallback(8, 0);
+  sps.constraintFlags = br.getBitsWithFallback(8, 0);
+  sps.levelIdc = br.getBitsWithFallback(8, 0);
+  uint32_t spsId = br.getUEWithFallback(kMaxSps);
+  if (spsId >= kMaxSps) {
+    AVE_LOG(LS_ERROR) << "invalid seq_parameter_set_id " << spsId;
+    return ERROR_MALFORMED;
+  }
+
+  sps.chromaFormatIdc = 1;
+  sps.bitDepthLuma = 8;
+  sps.bitDepthChroma = 8;
+  if (HasChromaFormat(sps.profileIdc)) {
+    sps.chromaFormatIdc = br.getUEWithFallback(0);
+    if (sps.chromaFormatIdc > 3) {
+      return ERROR_MALFORMED;
+    }
+    if (sps.chromaFormatIdc == 3) {
+      sps.separateColourPlane = br.getBitsWithFallback(1, 0);
+    }
+    sps.bitDepthLuma = br.getUEWithFallback(0) + 8;
+    sps.bitDepthChroma = br.getUEWithFallback(0) + 8;
+    br.skipBits(1);  // qpprime_y_zero_transform_bypass_flag
+    if (br.getBitsWithFallback(1, 0)) {  // seq_scaling_matrix_present_flag
+      size_t numLists = sps.chromaFormatIdc != 3 ? 8 : 12;
+      for (size_t i = 0; i < numLists; ++i) {
+        if (br.getBitsWithFallback(1, 0)) {  // seq_scaling_list_present_flag
+          skipScalingList(&br, i < 6 ? 16 : 64);
+        }
+      }
+    }
+  }
+
+  sps.log2MaxFrameNum = br.getUEWithFallback(0) + 4;
+  sps.picOrderCntType = br.getUEWithFallback(0);
+  if (sps.log2MaxFrameNum > 16 || sps.picOrderCntType > 2) {
+    return ERROR_MALFORMED;
+  }
+  if (sps.picOrderCntType == 0) {
+    sps.log2MaxPicOrderCntLsb = br.getUEWithFallback(0) + 4;
+    if (sps.log2MaxPicOrderCntLsb > 16) {
+      return ERROR_MALFORMED;
+    }
+  } else if (sps.picOrderCntType == 1) {
+    sps.deltaPicOrderAlwaysZero = br.getBitsWithFallback(1, 0);
+    sps.offsetForNonRefPic = br.getSEWithFallback(0);
+    sps.offsetForTopToBottomField = br.getSEWithFallback(0);
+    sps.numRefFramesInPicOrderCntCycle = br.getUEWithFallback(0);
+    if (sps.numRefFramesInPicOrderCntCycle >
+        static_cast<uint32_t>(NELEM(sps.offsetForRefFrame))) {
+      return ERROR_MALFORMED;
+    }
+    for (uint32_t i = 0; i < sps.numRefFramesInPicOrderCntCycle; ++i) {
+      sps.offsetForRefFrame[i] = br.getSEWithFallback(0);
+    }
+  }
+
+  sps.maxNumRefFrames = br.getUEWithFallback(0);
+  br.skipBits(1);  // gaps_in_frame_num_value_allowed_flag
+  int64_t widthInMbs = br.getUEWithFallback(0) + int64_t{1};
+  int64_t heightInMapUnits = br.getUEWithFallback(0) + int64_t{1};
+  sps.frameMbsOnly = br.getBitsWithFallback(1, 0);
+  if (!sps.frameMbsOnly) {
+    br.skipBits(1);  // mb_adaptive_frame_field_flag
+  }
+  br.skipBits(1);  // direct_8x8_inference_flag
+
+  int64_t width = widthInMbs * 16;
+  int64_t height = heightInMapUnits * 16 * (sps.frameMbsOnly ? 1 : 2);
+  if (br.getBitsWithFallback(1, 0)) {  // frame_cropping_flag
+    int64_t left = br.getUEWithFallback(0);
+    int64_t right = br.getUEWithFallback(0);
+    int64_t top = br.getUEWithFallback(0);
+    int64_t bottom = br.getUEWithFallback(0);
+    uint32_t chromaArrayType =
+        sps.separateColourPlane ? 0 : sps.chromaFormatIdc;
+    int64_t cropUnitX = 1;
+    int64_t cropUnitY = sps.frameMbsOnly ? 1 : 2;
+    if (chromaArrayType != 0) {
+      cropUnitX = chromaArrayType == 3 ? 1 : 2;
+      cropUnitY *= chromaArrayType == 1 ? 2 : 1;
+    }
+    width -= (left + right) * cropUnitX;
+    height -= (top + bottom) * cropUnitY;
+  }
+  if (width <= 0 || height <= 0 || width > INT32_MAX || height > INT32_MAX) {
+    AVE_LOG(LS_ERROR) << "invalid SPS dimensions " << width << "x" << height;
+    return ERROR_MALFORMED;
+  }
+  sps.width = static_cast<int32_t>(width);
+  sps.height = static_cast<int32_t>(height);
+
+  if (br.getBitsWithFallback(1, 0)) {    // vui_parameters_present_flag
+    if (br.getBitsWithFallback(1, 0)) {  // aspect_ratio_info_present_flag
+      static const struct {
+        int32_t width, height;
+      } kFixedSARs[] = {
+          {0, 0},  // Invalid
+          {1, 1},    {12, 11}, {10, 11}, {16, 11}, {40, 33}, {24, 11},
+          {20, 11},  {32, 11}, {80, 33}, {18, 11}, {15, 11}, {64, 33},
+          {160, 99}, {4, 3},   {3, 2},   {2, 1},
+      };
+      uint32_t aspectRatioIdc = br.getBitsWithFallback(8, 0);
+      if (aspectRatioIdc == 255 /* Extended_SAR */) {
+        sps.sarWidth = br.getBitsWithFallback(16, 0);
+        sps.sarHeight = br.getBitsWithFallback(16, 0);
+      } else if (aspectRatioIdc < static_cast<uint32_t>(NELEM(kFixedSARs))) {
+        sps.sarWidth = kFixedSARs[aspectRatioIdc].width;
+        sps.sarHeight = kFixedSARs[aspectRatioIdc].height;
+      }
+    }
+    // the rest of the VUI is not needed
+  }
+
+  if (br.overRead()) {
+    return ERROR_MALFORMED;
+  }
+  sps.valid = true;
+  mSps[spsId] = sps;
+  return OK;
+}
+
+status_t AvcParameterSets::parsePps(const uint8_t* data, size_t size) {
+  // See Rec. ITU-T H.264 (08/2021) 7.3.2.2 for reference
+  FastNALBitReader br(data, size);
+  AvcPps pps;
+  memset(&pps, 0, sizeof(pps));
+
+  uint32_t ppsId = br.getUEWithFallback(kMaxPps);
+  pps.spsId = br.getUEWithFallback(kMaxSps);
+  if (ppsId >= kMaxPps || pps.spsId >= kMaxSps) {
+    AVE_LOG(LS_ERROR) << "invalid PPS " << ppsId << " for SPS " << pps.spsId;
+    return ERROR_MALFORMED;
+  }
+  pps.entropyCodingMode = br.getBitsWithFallback(1, 0);
+  pps.bottomFieldPicOrderInFramePresent = br.getBitsWithFallback(1, 0);
+  pps.numSliceGroups = br.getUEWithFallback(0) + 1;
+  if (pps.numSliceGroups > 8) {
+    return ERROR_MALFORMED;
+  }
+  if (pps.numSliceGroups > 1) {
+    uint32_t sliceGroupMapType = br.getUEWithFallback(0);
+    if (sliceGroupMapType == 0) {
+      for (uint32_t i = 0; i < pps.numSliceGroups; ++i) {
+        br.getUEWithFallback(0);  // run_length_minus1
+      }
+    } else if (sliceGroupMapType == 2) {
+      for (uint32_t i = 0; i + 1 < pps.numSliceGroups; ++i) {
+        br.getUEWithFallback(0);  // top_left
+        br.getUEWithFallback(0);  // bottom_right
+      }
+    } else if (sliceGroupMapType >= 3 && sliceGroupMapType <= 5) {
+      br.skipBits(1);           // slice_group_change_direction_flag
+      br.getUEWithFallback(0);  // slice_group_change_rate_minus1
+    } else if (sliceGroupMapType == 6) {
+      uint32_t picSizeInMapUnits = br.getUEWithFallback(0) + 1;
+      br.skipBits(static_cast<size_t>(picSizeInMapUnits) *
+                  CeilLog2(pps.numSliceGroups));  // slice_group_id
+    }
+  }
+  pps.numRefIdxL0DefaultActive = br.getUEWithFallback(0) + 1;
+  pps.numRefIdxL1DefaultActive = br.getUEWithFallback(0) + 1;
+  if (pps.numRefIdxL0DefaultActive > 32 || pps.numRefIdxL1DefaultActive > 32) {
+    return ERROR_MALFORMED;
+  }
+  pps.weightedPred = br.getBitsWithFallback(1, 0);
+  pps.weightedBipredIdc = br.getBitsWithFallback(2, 0);
+  br.getSEWithFallback(0);  // pic_init_qp_minus26
+  br.getSEWithFallback(0);  // pic_init_qs_minus26
+  br.getSEWithFallback(0);  // chroma_qp_index_offset
+  br.skipBits(1);           // deblocking_filter_control_present_flag
+  br.skipBits(1);           // constrained_intra_pred_flag
+  pps.redundantPicCntPresent = br.getBitsWithFallback(1, 0);
+  // the range extension fields are not needed
+
+  if (br.overRead()) {
+    return ERROR_MALFORMED;
+  }
+  pps.valid = true;
+  mPps[ppsId] = pps;
+  return OK;
+}
+
+status_t AvcParameterSets::parseSliceHeader(const uint8_t* data,
+                                            size_t size,
+                                            AvcSliceHeader* header) const {
+  // See Rec. ITU-T H.264 (08/2021) 7.3.3 for reference
+  if (size < 2) {
+    return ERROR_MALFORMED;
+  }
+  memset(header, 0, sizeof(*header));
+  header->nalUnitType = data[0] & 0x1f;
+  header->nalRefIdc = (data[0] >> 5) & 3;
+  if (header->nalUnitType != kNalUnitTypeSlice &&
+      header->nalUnitType != kNalUnitTypeIdrSlice) {
+    return ERROR_UNSUPPORTED;
+  }
+
+  FastNALBitReader br(data + 1, size - 1);
+  header->firstMbInSlice = br.getUEWithFallback(0);
+  header->sliceType = br.getUEWithFallback(0) % 5;
+  header->ppsId = br.getUEWithFallback(kMaxPps);
+  const AvcPps* pps = getPps(header->ppsId);
+  const AvcSps* sps = pps != nullptr ? getSps(pps->spsId) : nullptr;
+  if (sps == nullptr) {
+    AVE_LOG(LS_VERBOSE) << "slice refers to missing PPS " << header->ppsId;
+    return ERROR_MALFORMED;
+  }
+
+  if (sps->separateColourPlane) {
+    br.skipBits(2);  // colour_plane_id
+  }
+  header->frameNum = br.getBitsWithFallback(sps->log2MaxFrameNum, 0);
+  if (!sps->frameMbsOnly) {
+    header->fieldPic = br.getBitsWithFallback(1, 0);
+    if (header->fieldPic) {
+      header->bottomField = br.getBitsWithFallback(1, 0);
+    }
+  }
+  if (header->isIdr()) {
+    header->idrPicId = br.getUEWithFallback(0);
+  }
+  if (sps->picOrderCntType == 0) {
+    header->picOrderCntLsb =
+        br.getBitsWithFallback(sps->log2MaxPicOrderCntLsb, 0);
+    if (pps->bottomFieldPicOrderInFramePresent && !header->fieldPic) {
+      header->deltaPicOrderCntBottom = br.getSEWithFallback(0);
+    }
+  }
+  if (sps->picOrderCntType == 1 && !sps->deltaPicOrderAlwaysZero) {
+    header->deltaPicOrderCnt[0] = br.getSEWithFallback(0);
+    if (pps->bottomFieldPicOrderInFramePresent && !header->fieldPic) {
+      header->deltaPicOrderCnt[1] = br.getSEWithFallback(0);
+    }
+  }
+  if (pps->redundantPicCntPresent) {
+    header->redundantPicCnt = br.getUEWithFallback(0);
+  }
+
+  // the rest is only needed to find memory_management_control_operation 5
+  if (header->nalRefIdc == 0 || header->isIdr()) {
+    return br.overRead() ? ERROR_MALFORMED : OK;
+  }
+
+  const uint32_t sliceType = header->sliceType;
+  const bool isB = sliceType == kAvcSliceTypeB;
+  const bool isP = sliceType == kAvcSliceTypeP || sliceType == kAvcSliceTypeSP;
+  if (isB) {
+    br.skipBits(1);  // direct_spatial_mv_pred_flag
+  }
+  uint32_t numRefIdxL0Active = pps->numRefIdxL0DefaultActive;
+  uint32_t numRefIdxL1Active = pps->numRefIdxL1DefaultActive;
+  if (isP || isB) {
+    if (br.getBitsWithFallback(1, 0)) {  // num_ref_idx_active_override_flag
+      numRefIdxL0Active = br.getUEWithFallback(0) + 1;
+      if (isB) {
+        numRefIdxL1Active = br.getUEWithFallback(0) + 1;
+      }
+    }
+    if (numRefIdxL0Active > 32 || numRefIdxL1Active > 32) {
+      return ERROR_MALFORMED;
+    }
+    skipRefPicListModification(&br);
+    if (isB) {
+      skipRefPicListModification(&br);
+    }
+  }
+  if ((pps->weightedPred && isP) || (pps->weightedBipredIdc == 1 && isB)) {
+    bool chroma = !sps->separateColourPlane && sps->chromaFormatIdc != 0;
+    br.getUEWithFallback(0);  // luma_log2_weight_denom
+    if (chroma) {
+      br.getUEWithFallback(0);  // chroma_log2_weight_denom
+    }
+    skipWeights(&br, numRefIdxL0Active, chroma);
+    if (isB) {
+      skipWeights(&br, numRefIdxL1Active, chroma);
+    }
+  }
+
+  // dec_ref_pic_marking()
+  if (br.getBitsWithFallback(1, 0)) {  // adaptive_ref_pic_marking_mode_flag
+    for (;;) {
+      uint32_t mmco = br.getUEWithFallback(0);
+      if (mmco == 0 || br.overRead()) {
+        break;
+      }
+      if (mmco == 5) {
+        header->hasMmco5 = true;
+      }
+      if (mmco == 1 || mmco == 3) {
+        br.getUEWithFallback(0);  // difference_of_pic_nums_minus1
+      }
+      if (mmco == 2) {
+        br.getUEWithFallback(0);  // long_term_pic_num
+      }
+      if (mmco == 3 || mmco == 6) {
+        br.getUEWithFallback(0);  // long_term_frame_idx
+      }
+      if (mmco == 4) {
+        br.getUEWithFallback(0);  // max_long_term_frame_idx_plus1
+      }
+    }
+  }
+
+  return br.overRead() ? ERROR_MALFORMED : OK;
+}
+
+bool AvcParameterSets::isFirstSliceOfPicture(
+    const AvcSliceHeader& header) const {
+  // 7.4.1.2.4
+  if (!mHasLastSlice) {
+    return true;
+  }
+  const AvcSliceHeader& last = mLastSlice;
+  if (header.frameNum != last.frameNum || header.ppsId != last.ppsId ||
+      header.fieldPic != last.fieldPic ||
+      header.bottomField != last.bottomField ||
+      (header.nalRefIdc == 0) != (last.nalRefIdc == 0) ||
+      header.isIdr() != last.isIdr() ||
+      (header.isIdr() && header.idrPicId != last.idrPicId)) {
+    return true;
+  }
+  const AvcPps* pps = getPps(header.ppsId);
+  const AvcSps* sps = pps != nullptr ? getSps(pps->spsId) : nullptr;
+  if (sps == nullptr) {
+    return true;
+  }
+  if (sps->picOrderCntType == 0) {
+    return header.picOrderCntLsb != last.picOrderCntLsb ||
+           header.deltaPicOrderCntBottom != last.deltaPicOrderCntBottom;
+  }
+  if (sps->picOrderCntType == 1) {
+    return header.deltaPicOrderCnt[0] != last.deltaPicOrderCnt[0] ||
+           header.deltaPicOrderCnt[1] != last.deltaPicOrderCnt[1];
+  }
+  return false;
+}
+
+bool AvcParameterSets::addSlice(const AvcSliceHeader& header) {
+  // redundant pictures do not change the decoding state
+  if (header.redundantPicCnt > 0) {
+    return false;
+  }
+  bool first = isFirstSliceOfPicture(header);
+  if (first) {
+    startPicture(header);
+  }
+  mHasLastSlice = true;
+  mLastSlice = header;
+  return first;
+}
+
+void AvcParameterSets::startPicture(const AvcSliceHeader& header) {
+  // the picture that ends becomes the previous one, with the values that
+  // memory_management_control_operation 5 resets, 8.2.1
+  if (mHasLastSlice) {
+    const AvcSliceHeader& last = mLastSlice;
+    if (last.nalRefIdc != 0) {
+      if (last.hasMmco5) {
+        mPrevPicOrderCntMsb = 0;
+        // TopFieldOrderCnt after it was reduced by tempPicOrderCnt
+        mPrevPicOrderCntLsb =
+            last.fieldPic && last.bottomField
+                ? 0
+                : mTopFieldOrderCnt - (last.fieldPic ? mTopFieldOrderCnt
+                                                     : mPicOrderCnt);
+      } else {
+        mPrevPicOrderCntMsb = mPicOrderCntMsb;
+        mPrevPicOrderCntLsb = static_cast<int32_t>(last.picOrderCntLsb);
+      }
+    }
+    mPrevFrameNumOffset = last.hasMmco5 ? 0 : mFrameNumOffset;
+    mPrevFrameNum = last.hasMmco5 ? 0 : last.frameNum;
+  }
+
+  const AvcPps* pps = getPps(header.ppsId);
+  const AvcSps* sps = pps != nullptr ? getSps(pps->spsId) : nullptr;
+  if (sps == nullptr) {
+    return;
+  }
+
+  int32_t top = 0;
+  int32_t bottom = 0;
+  if (sps->picOrderCntType == 0) {
+    // 8.2.1.1
+    if (header.isIdr()) {
+      mPrevPicOrderCntMsb = 0;
+      mPrevPicOrderCntLsb = 0;
+    }
+    const int32_t maxLsb = 1 << sps->log2MaxPicOrderCntLsb;
+    const int32_t lsb = static_cast<int32_t>(header.picOrderCntLsb);
+    const int32_t prevLsb = mPrevPicOrderCntLsb;
+    if (lsb < prevLsb && prevLsb - lsb >= maxLsb / 2) {
+      mPicOrderCntMsb = mPrevPicOrderCntMsb + maxLsb;
+    } else if (lsb > prevLsb && lsb - prevLsb > maxLsb / 2) {
+      mPicOrderCntMsb = mPrevPicOrderCntMsb - maxLsb;
+    } else {
+      mPicOrderCntMsb = mPrevPicOrderCntMsb;
+    }
+    top = mPicOrderCntMsb + lsb;
+    bottom = header.fieldPic ? top : top + header.deltaPicOrderCntBottom;
+  } else {
+    // 8.2.1.2 and 8.2.1.3
+    const int32_t maxFrameNum = 1 << sps->log2MaxFrameNum;
+    if (header.isIdr()) {
+      mFrameNumOffset = 0;
+    } else if (mPrevFrameNum > header.frameNum) {
+      mFrameNumOffset = mPrevFrameNumOffset + maxFrameNum;
+    } else {
+      mFrameNumOffset = mPrevFrameNumOffset;
+    }
+    const int32_t frameNum = static_cast<int32_t>(header.frameNum);
+
+    if (sps->picOrderCntType == 1) {
+      const int32_t cycle =
+          static_cast<int32_t>(sps->numRefFramesInPicOrderCntCycle);
+      int32_t absFrameNum = cycle != 0 ? mFrameNumOffset + frameNum : 0;
+      if (header.nalRefIdc == 0 && absFrameNum > 0) {
+        --absFrameNum;
+      }
+      int32_t expected = 0;
+      if (absFrameNum > 0) {
+        int32_t expectedDeltaPerCycle = 0;
+        for (int32_t i = 0; i < cycle; ++i) {
+          expectedDeltaPerCycle += sps->offsetForRefFrame[i];
+        }
+        int32_t cycleCnt = (absFrameNum - 1) / cycle;
+        int32_t frameNumInCycle = (absFrameNum - 1) % cycle;
+        expected = cycleCnt * expectedDeltaPerCycle;
+        for (int32_t i = 0; i <= frameNumInCycle; ++i) {
+          expected += sps->offsetForRefFrame[i];
+        }
+      }
+      if (header.nalRefIdc == 0) {
+        expected += sps->offsetForNonRefPic;
+      }
+      if (!header.fieldPic) {
+        top = expected + header.deltaPicOrderCnt[0];
+        bottom = top + sps->offsetForTopToBottomField +
+                 header.deltaPicOrderCnt[1];
+      } else if (!header.bottomField) {
+        top = bottom = expected + header.deltaPicOrderCnt[0];
+      } else {
+        top = bottom = expected + sps->offsetForTopToBottomField +
+                       header.deltaPicOrderCnt[0];
+      }
+    } else {
+      int32_t temp = 0;
+      if (!header.isIdr()) {
+        temp = 2 * (mFrameNumOffset + frameNum) -
+               (header.nalRefIdc == 0 ? 1 : 0);
+      }
+      top = bottom = temp;
+    }
+  }
+
+  mTopFieldOrderCnt = top;
+  mBottomFieldOrderCnt = bottom;
+  if (!header.fieldPic) {
+    mPicOrderCnt = std::min(top, bottom);
+  } else {
+    mPicOrderCnt = header.bottomField ? bottom : top;
+  }
+}
+
+// static
+bool AvcParameterSets::hasRecoveryPoint(const uint8_t* data, size_t size) {
+  if (size < 1 || (data[0] & 0x1f) != kNalUnitTypeSei) {
+    return false;
+  }
+  FastNALBitReader br(data + 1, size - 1);
+  // sei_message() until rbsp_trailing_bits()
+  while (br.numBitsLeft() > 8 && !br.overRead()) {
+    uint32_t payloadType = 0;
+    uint32_t payloadSize = 0;
+    uint32_t byte;
+    while ((byte = br.getBitsWithFallback(8, 0)) == 0xff) {
+      payloadType += 255;
+    }
+    payloadType += byte;
+    while ((byte = br.getBitsWithFallback(8, 0)) == 0xff) {
+      payloadSize += 255;
+    }
+    payloadSize += byte;
+    if (payloadType == kSeiRecoveryPoint) {
+      return true;
+    }
+    br.skipBits(static_cast<size_t>(payloadSize) * 8);
+  }
+  return false;
+}
+
+status_t AvcParameterSets::parseAccessUnit(const uint8_t* data,
+                                           size_t size,
+                                           AvcAccessUnitInfo* info) {
+  memset(info, 0, sizeof(*info));
+  bool allIntra = true;
+  bool recoveryPoint = false;
+
+  const uint8_t* nalStart;
+  size_t nalSize;
+  while (getNextNALUnit(&data, &size, &nalStart, &nalSize, true) == OK) {
+    if (nalSize == 0) {
+      continue;
+    }
+    uint8_t nalType = nalStart[0] & 0x1f;
+    if (nalType == kNalUnitTypeSps || nalType == kNalUnitTypePps) {
+      status_t err = addNalUnit(nalStart, nalSize);
+      if (err != OK) {
+        return err;
+      }
+    } else if (nalType == kNalUnitTypeSei && !info->hasPicture) {
+      recoveryPoint = recoveryPoint || hasRecoveryPoint(nalStart, nalSize);
+    } else if (nalType == kNalUnitTypeSlice ||
+               nalType == kNalUnitTypeIdrSlice) {
+      AvcSliceHeader header;
+      status_t err = parseSliceHeader(nalStart, nalSize, &header);
+      if (err != OK) {
+        return err;
+      }
+      if (header.redundantPicCnt > 0) {
+        continue;
+      }
+      if (info->hasPicture && isFirstSliceOfPicture(header)) {
+        // a second picture, e.g. the other field. It is left out of the
+        // POC and frame_num state until its own access unit is parsed.
+        break;
+      }
+      bool first = addSlice(header);
+      if (!info->hasPicture) {
+        info->hasPicture = true;
+        info->startsNewPicture = first;
+        info->isIdr = header.isIdr();
+        info->isReference = header.nalRefIdc != 0;
+        info->fieldPic = header.fieldPic;
+        info->bottomField = header.bottomField;
+        info->sliceType = header.sliceType;
+        info->frameNum = header.frameNum;
+        info->picOrderCnt = picOrderCnt();
+      }
+      if (header.sliceType != kAvcSliceTypeI &&
+          header.sliceType != kAvcSliceTypeSI) {
+        allIntra = false;
+      }
+    }
+  }
+
+  info->isKeyFrame =
+      info->isIdr || (info->hasPicture && allIntra && recoveryPoint);
+  return OK;
+}
+
+}  // namespace ave
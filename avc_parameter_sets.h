@@ -0,0 +1,186 @@
+/*
+ * avc_parameter_sets.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef AVC_PARAMETER_SETS_H
+#define AVC_PARAMETER_SETS_H
+
+#include "base/constructor_magic.h"
+#include "base/types.h"
+
+namespace ave {
+
+enum {
+  kAvcSliceTypeP = 0,
+  kAvcSliceTypeB = 1,
+  kAvcSliceTypeI = 2,
+  kAvcSliceTypeSP = 3,
+  kAvcSliceTypeSI = 4,
+};
+
+// Rec. ITU-T H.264 7.3.2.1.1, the fields slice header parsing and picture
+// order count derivation need, plus the picture geometry.
+struct AvcSps {
+  bool valid;
+  uint8_t profileIdc;
+  uint8_t constraintFlags;
+  uint8_t levelIdc;
+  uint32_t chromaFormatIdc;
+  bool separateColourPlane;
+  uint32_t bitDepthLuma;
+  uint32_t bitDepthChroma;
+  uint32_t log2MaxFrameNum;
+  uint32_t picOrderCntType;
+  uint32_t log2MaxPicOrderCntLsb;
+  bool deltaPicOrderAlwaysZero;
+  int32_t offsetForNonRefPic;
+  int32_t offsetForTopToBottomField;
+  uint32_t numRefFramesInPicOrderCntCycle;
+  int32_t offsetForRefFrame[255];
+  uint32_t maxNumRefFrames;
+  bool frameMbsOnly;
+  // cropped
+  int32_t width;
+  int32_t height;
+  int32_t sarWidth;
+  int32_t sarHeight;
+};
+
+// Rec. ITU-T H.264 7.3.2.2, up to the fields the slice header depends on.
+struct AvcPps {
+  bool valid;
+  uint32_t spsId;
+  bool entropyCodingMode;
+  bool bottomFieldPicOrderInFramePresent;
+  uint32_t numSliceGroups;
+  uint32_t numRefIdxL0DefaultActive;
+  uint32_t numRefIdxL1DefaultActive;
+  bool weightedPred;
+  uint32_t weightedBipredIdc;
+  bool redundantPicCntPresent;
+};
+
+// Rec. ITU-T H.264 7.3.3 up to dec_ref_pic_marking().
+struct AvcSliceHeader {
+  uint8_t nalUnitType;
+  uint8_t nalRefIdc;
+  uint32_t firstMbInSlice;
+  // slice_type % 5, one of kAvcSliceType*
+  uint32_t sliceType;
+  uint32_t ppsId;
+  uint32_t frameNum;
+  bool fieldPic;
+  bool bottomField;
+  uint32_t idrPicId;
+  uint32_t picOrderCntLsb;
+  int32_t deltaPicOrderCntBottom;
+  int32_t deltaPicOrderCnt[2];
+  uint32_t redundantPicCnt;
+  // memory_management_control_operation 5 is present
+  bool hasMmco5;
+
+  bool isIdr() const { return nalUnitType == 5; }
+};
+
+// What an access unit is, from the slice headers of its primary picture.
+struct AvcAccessUnitInfo {
+  bool hasPicture;
+  bool isIdr;
+  // IDR, or only I slices and a recovery point SEI
+  bool isKeyFrame;
+  // nal_ref_idc of the primary picture is not 0
+  bool isReference;
+  // the first slice starts a new primary picture rather than continuing the
+  // one of the previous access unit, i.e. the access unit is not a split
+  // part or a second field of it
+  bool startsNewPicture;
+  bool fieldPic;
+  bool bottomField;
+  uint32_t sliceType;
+  uint32_t frameNum;
+  // PicOrderCnt(), the smaller of the field order counts of a frame
+  int32_t picOrderCnt;
+};
+
+// Keeps the SPS and PPS of an H.264 stream by id and decodes slice headers
+// against them. Picture order count and picture boundary state carries over
+// from one call to the next, so access units have to be passed in decoding
+// order. Nothing is allocated after construction.
+class AvcParameterSets {
+ public:
+  static constexpr size_t kMaxSps = 32;
+  static constexpr size_t kMaxPps = 256;
+
+  AvcParameterSets();
+
+  // Parses SPS and PPS NAL units (without start code), other types are
+  // ignored.
+  status_t addNalUnit(const uint8_t* data, size_t size);
+
+  const AvcSps* getSps(uint32_t id) const;
+  const AvcPps* getPps(uint32_t id) const;
+
+  // Decodes the header of a slice NAL unit (type 1 or 5, without start
+  // code).
+  status_t parseSliceHeader(const uint8_t* data,
+                            size_t size,
+                            AvcSliceHeader* header) const;
+
+  // Feeds the slices of the stream in decoding order. Returns true if
+  // |header| starts a new primary coded picture, 7.4.1.2.4, whose picture
+  // order count is then derived, 8.2.1.
+  bool addSlice(const AvcSliceHeader& header);
+
+  // PicOrderCnt() of the current picture, the smaller of its field order
+  // counts for a frame.
+  int32_t picOrderCnt() const { return mPicOrderCnt; }
+
+  // Walks the Annex-B access unit once: parameter sets are added, slice
+  // headers are fed to addSlice() and SEI is checked for a recovery point.
+  // |info| describes the first primary picture in the access unit.
+  status_t parseAccessUnit(const uint8_t* data,
+                           size_t size,
+                           AvcAccessUnitInfo* info);
+
+  // Whether the SEI NAL unit (without start code) carries a recovery point
+  // message.
+  static bool hasRecoveryPoint(const uint8_t* data, size_t size);
+
+  // Forgets the previous picture, e.g. after a seek.
+  void reset();
+
+ private:
+  status_t parseSps(const uint8_t* data, size_t size);
+  status_t parsePps(const uint8_t* data, size_t size);
+
+  bool isFirstSliceOfPicture(const AvcSliceHeader& header) const;
+  // ends the current picture and derives the order count of the next one
+  void startPicture(const AvcSliceHeader& header);
+
+  AvcSps mSps[kMaxSps];
+  AvcPps mPps[kMaxPps];
+
+  // last slice, of the current picture
+  bool mHasLastSlice;
+  AvcSliceHeader mLastSlice;
+
+  // 8.2.1 state of the current picture and the previous (reference) one
+  int32_t mPicOrderCnt;
+  int32_t mPicOrderCntMsb;
+  int32_t mTopFieldOrderCnt;
+  int32_t mBottomFieldOrderCnt;
+  int32_t mFrameNumOffset;
+  int32_t mPrevPicOrderCntMsb;
+  int32_t mPrevPicOrderCntLsb;
+  int32_t mPrevFrameNumOffset;
+  uint32_t mPrevFrameNum;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(AvcParameterSets);
+};
+
+}  // namespace ave
+
+#endif /* !AVC_PARAMETER_SETS_H */
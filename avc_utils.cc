@@ -7,20 +7,20 @@
 
 #include "avc_utils.h"
 
+#include <algorithm>
 #include <utility>
 
 #include "base/checks.h"
 #include "base/logging.h"
 
 #include "bit_reader.h"
+#include "start_code.h"
 
 namespace ave {
 
 unsigned parseUE(BitReader* br) {
-  unsigned numZeroes = 0;
-  while (br->getBits(1) == 0) {
-    ++numZeroes;
-  }
+  size_t numZeroes = br->skipLeadingZeroBits();
+  AVE_CHECK(!br->overRead());  // truncated prefix
 
   unsigned x = br->getBits(numZeroes);
 
@@ -28,10 +28,9 @@ unsigned parseUE(BitReader* br) {
 }
 
 unsigned parseUEWithFallback(BitReader* br, unsigned fallback) {
-  unsigned numZeroes = 0;
-  while (br->getBitsWithFallback(1, 1) == 0) {
-    ++numZeroes;
-  }
+  // a prefix that ends with the data is taken as complete, the suffix read
+  // then fails unless it is empty.
+  size_t numZeroes = br->skipLeadingZeroBits();
   uint32_t x;
   if (numZeroes < 32) {
     if (br->getBitsGraceful(numZeroes, &x)) {
@@ -290,17 +289,11 @@ status_t getNextNALUnit(const uint8_t** _data,
     return -EAGAIN;
   }
 
-  size_t offset = 0;
-
   // A valid startcode consists of at least two 0x00 bytes followed by 0x01.
-  for (; offset + 2 < size; ++offset) {
-    if (data[offset + 2] == 0x01 && data[offset] == 0x00 &&
-        data[offset + 1] == 0x00) {
-      break;
-    }
-  }
-  if (offset + 2 >= size) {
-    *_data = &data[offset];
+  size_t offset = FindStartCode(data, size);
+  if (offset == size) {
+    // keep the last two bytes, they may be the beginning of a start code.
+    *_data = &data[size - 2];
     *_size = 2;
     return -EAGAIN;
   }
@@ -308,25 +301,15 @@ status_t getNextNALUnit(const uint8_t** _data,
 
   size_t startOffset = offset;
 
-  for (;;) {
-    while (offset < size && data[offset] != 0x01) {
-      ++offset;
-    }
-
-    if (offset == size) {
-      if (startCodeFollows) {
-        offset = size + 2;
-        break;
-      }
-
+  // |offset| ends up on the 0x01 of the next start code.
+  size_t next = FindStartCode(data + startOffset, size - startOffset);
+  if (next == size - startOffset) {
+    if (!startCodeFollows) {
       return -EAGAIN;
     }
-
-    if (data[offset - 1] == 0x00 && data[offset - 2] == 0x00) {
-      break;
-    }
-
-    ++offset;
+    offset = size + 2;
+  } else {
+    offset = startOffset + next + 2;
   }
 
   size_t endOffset = offset - 2;
@@ -355,7 +338,7 @@ static std::shared_ptr<Buffer> FindNAL(const uint8_t* data,
   size_t nalSize;
   while (getNextNALUnit(&data, &size, &nalStart, &nalSize, true) == OK) {
     if (nalSize > 0 && (nalStart[0] & 0x1f) == nalType) {
-      auto buffer = std::make_shared<Buffer>(nalSize);
+      auto buffer = Buffer::Create(nalSize);
       memcpy(buffer->data(), nalStart, nalSize);
       return buffer;
     }
@@ -364,6 +347,90 @@ static std::shared_ptr<Buffer> FindNAL(const uint8_t* data,
   return NULL;
 }
 
+NALIndexer::NALIndexer(NALFormat format)
+    : format_(format), pending_(false), scan_offset_(0) {}
+
+void NALIndexer::Reset() {
+  pending_ = false;
+  scan_offset_ = 0;
+}
+
+void NALIndexer::AddNAL(const uint8_t* data,
+                        size_t start,
+                        size_t end,
+                        std::vector<NALPosition>* nals) const {
+  // trailing_zero_8bits, and the leading zero of a four byte start code
+  while (end > start && data[end - 1] == 0x00) {
+    --end;
+  }
+  if (end == start) {
+    return;
+  }
+
+  uint8_t type = format_ == NALFormat::kAVC ? (data[start] & 0x1f)
+                                             : ((data[start] >> 1) & 0x3f);
+  nals->push_back({static_cast<uint32_t>(start),
+                   static_cast<uint32_t>(end - start), type});
+}
+
+size_t NALIndexer::Index(const uint8_t* data,
+                         size_t size,
+                         std::vector<NALPosition>* nals,
+                         bool eos) {
+  AVE_DCHECK_LE(size, UINT32_MAX);
+  size_t offset = std::min(scan_offset_, size);
+  size_t nalStart;
+
+  if (pending_) {
+    nalStart = 3;
+  } else {
+    size_t startCode = offset + FindStartCode(data + offset, size - offset);
+    if (startCode == size) {
+      if (eos) {
+        scan_offset_ = 0;
+        return size;
+      }
+      // the last two bytes may begin a start code
+      size_t keep = std::min<size_t>(size, 2);
+      scan_offset_ = 0;
+      return size - keep;
+    }
+    pending_ = true;
+    nalStart = startCode + 3;
+    offset = nalStart;
+  }
+
+  for (;;) {
+    size_t next = offset + FindStartCode(data + offset, size - offset);
+    if (next == size) {
+      break;
+    }
+    AddNAL(data, nalStart, next, nals);
+    nalStart = next + 3;
+    offset = nalStart;
+  }
+
+  if (eos) {
+    AddNAL(data, nalStart, size, nals);
+    Reset();
+    return size;
+  }
+
+  // keep the pending NAL unit from its start code on, and rescan the last
+  // two bytes in case a start code is split across chunks.
+  size_t consumed = nalStart - 3;
+  scan_offset_ = std::max(size >= 2 ? size - 2 : 0, nalStart) - consumed;
+  return consumed;
+}
+
+void FindNALUnits(const uint8_t* data,
+                  size_t size,
+                  NALFormat format,
+                  std::vector<NALPosition>* nals) {
+  NALIndexer indexer(format);
+  indexer.Index(data, size, nals, true);
+}
+
 const char* AVCProfileToString(uint8_t profile) {
   switch (profile) {
     case kAVCProfileBaseline:
@@ -409,7 +476,7 @@ std::shared_ptr<Buffer> MakeAVCCodecSpecificData(
   size_t csdSize = 1 + 3 + 1 + 1 + 2 * 1 + seqParamSet->size() + 1 + 2 * 1 +
                    picParamSet->size();
 
-  auto csd = std::make_shared<Buffer>(csdSize);
+  auto csd = Buffer::Create(csdSize);
   uint8_t* out = csd->data();
 
   *out++ = 0x01;                            // configurationVersion
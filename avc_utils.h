@@ -8,6 +8,8 @@
 #ifndef AVC_UTILS_H
 #define AVC_UTILS_H
 
+#include <vector>
+
 #include "base/types.h"
 
 #include "buffer.h"
@@ -32,8 +34,61 @@ enum {
 struct NALPosition {
   uint32_t nalOffset;
   uint32_t nalSize;
+  // nal_unit_type of the AVC or HEVC NAL header
+  uint8_t nalType;
+};
+
+enum class NALFormat {
+  kAVC,
+  kHEVC,
 };
 
+// Splits Annex-B data into NAL units in one pass over the stream. Offsets
+// exclude the start codes, and trailing zero bytes are stripped.
+//
+// For streaming input the caller keeps the unconsumed tail of its buffer and
+// appends newly received bytes to it:
+//
+//   size_t consumed = indexer.Index(buffer.data(), buffer.size(), &nals);
+//   ... use |nals| ...
+//   buffer.erase(buffer.begin(), buffer.begin() + consumed);
+//
+// Only the bytes added since the previous call are scanned again, and a NAL
+// unit or start code split between two chunks is reported once complete.
+class NALIndexer {
+ public:
+  explicit NALIndexer(NALFormat format);
+
+  // Appends the NAL units completed within |data| to |nals|, with offsets
+  // relative to |data|. Returns the number of leading bytes that are no
+  // longer needed, the rest has to be passed again with the next call. With
+  // |eos| the last NAL unit ends at the end of |data|.
+  size_t Index(const uint8_t* data,
+               size_t size,
+               std::vector<NALPosition>* nals,
+               bool eos = false);
+
+  void Reset();
+
+ private:
+  void AddNAL(const uint8_t* data,
+              size_t start,
+              size_t end,
+              std::vector<NALPosition>* nals) const;
+
+  const NALFormat format_;
+  // the kept data starts with the start code of a pending NAL unit
+  bool pending_;
+  // where to resume scanning in the kept data
+  size_t scan_offset_;
+};
+
+// Splits a whole access unit or chunk of Annex-B data into NAL units.
+void FindNALUnits(const uint8_t* data,
+                  size_t size,
+                  NALFormat format,
+                  std::vector<NALPosition>* nals);
+
 // Optionally returns sample aspect ratio as well.
 void FindAVCDimensions(const std::shared_ptr<Buffer>& seqParamSet,
                        int32_t* width,
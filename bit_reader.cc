@@ -96,6 +96,28 @@ bool BitReader::skipBits(size_t n) {
   return true;
 }
 
+size_t BitReader::skipLeadingZeroBits() {
+  size_t numZeroes = 0;
+  for (;;) {
+    if (mNumBitsLeft == 0 && !fillReservoir()) {
+      return numZeroes;
+    }
+
+    if (mReservoir != 0) {
+      // bits past mNumBitsLeft may be stale after putBits()
+      size_t zeros = __builtin_clz(mReservoir);
+      if (zeros < mNumBitsLeft) {
+        size_t n = zeros + 1;
+        mReservoir = n < 32 ? mReservoir << n : 0;
+        mNumBitsLeft -= n;
+        return numZeroes + zeros;
+      }
+    }
+    numZeroes += mNumBitsLeft;
+    mNumBitsLeft = 0;
+  }
+}
+
 void BitReader::putBits(uint32_t x, size_t n) {
   if (mOverRead) {
     return;
@@ -121,8 +143,8 @@ const uint8_t* BitReader::data() const {
   return mData - (mNumBitsLeft + 7) / 8;
 }
 
-NALBitReader::NALBitReader(const uint8_t* data, size_t size)
-    : BitReader(data, size), mNumZeros(0) {}
+NALBitReader::NALBitReader(const uint8_t* data, size_t size, bool unescaped)
+    : BitReader(data, size), mNumZeros(0), mUnescaped(unescaped) {}
 
 bool NALBitReader::atLeastNumBitsLeft(size_t n) const {
   // check against raw size and reservoir bits first
@@ -130,6 +152,9 @@ bool NALBitReader::atLeastNumBitsLeft(size_t n) const {
   if (n > numBits) {
     return false;
   }
+  if (mUnescaped) {
+    return true;
+  }
 
   ssize_t numBitsRemaining = (ssize_t)n - (ssize_t)mNumBitsLeft;
 
@@ -157,6 +182,10 @@ bool NALBitReader::atLeastNumBitsLeft(size_t n) const {
 }
 
 bool NALBitReader::fillReservoir() {
+  if (mUnescaped) {
+    return BitReader::fillReservoir();
+  }
+
   if (mSize == 0) {
     mOverRead = true;
     return false;
@@ -35,6 +35,11 @@ class BitReader {
   // always succeed.
   bool skipBits(size_t n);
 
+  // Skips zero bits and the one bit that ends them, as in the prefix of an
+  // Exp-Golomb code, and returns the number of zero bits. Stops at the end of
+  // the data. Runs of zeros are counted a reservoir at a time.
+  size_t skipLeadingZeroBits();
+
   // "Puts" |n| bits with the value |x| back virtually into the bit stream. The
   // put-back bits are not actually written into the data, but are tracked in a
   // separate buffer that can store at most 32 bits. This is a no-op if the
@@ -64,12 +69,15 @@ class BitReader {
 
 class NALBitReader : public BitReader {
  public:
-  NALBitReader(const uint8_t* data, size_t size);
+  // With |unescaped|, |data| is RBSP that already had its emulation
+  // prevention bytes removed, e.g. by EBSPToRBSP(), and is read as is.
+  NALBitReader(const uint8_t* data, size_t size, bool unescaped = false);
 
   bool atLeastNumBitsLeft(size_t n) const;
 
  private:
   int32_t mNumZeros;
+  const bool mUnescaped;
 
   virtual bool fillReservoir();
 
@@ -13,26 +13,54 @@
 #include "base/checks.h"
 
 namespace ave {
-Buffer::Buffer(size_t capacity)
+Buffer::Buffer(size_t capacity, const void* site)
     : data_(malloc(capacity)),
       capacity_(capacity),
       range_offset_(0),
       range_length_(capacity),
       int32_data_(0),
-      owns_data_(true) {}
+      owns_data_(true),
+      allocation_(BufferTracker::GetInstance().Track(
+          "Buffer",
+          capacity,
+          site ? site : __builtin_return_address(0))) {}
 
-Buffer::Buffer(void* data, size_t capacity)
+Buffer::Buffer(void* data, size_t capacity, const void* site)
     : data_(data),
       capacity_(capacity),
       range_offset_(0),
       range_length_(capacity),
       int32_data_(0),
-      owns_data_(false) {}
+      owns_data_(false),
+      // wrapped memory is owned by somebody else, only count the buffer.
+      allocation_(BufferTracker::GetInstance().Track(
+          "Buffer",
+          0,
+          site ? site : __builtin_return_address(0))) {}
+
+// The factories are not inlined, so that their return address is the
+// allocation site.
+
+// static
+__attribute__((noinline)) std::shared_ptr<Buffer> Buffer::Create(
+    size_t capacity) {
+  return std::make_shared<Buffer>(capacity, __builtin_return_address(0));
+}
+
+// static
+__attribute__((noinline)) std::shared_ptr<Buffer> Buffer::Create(
+    void* data,
+    size_t capacity) {
+  return std::make_shared<Buffer>(data, capacity,
+                                  __builtin_return_address(0));
+}
 
 // static
-std::shared_ptr<Buffer> Buffer::CreateAsCopy(const void* data,
-                                             size_t capacity) {
-  std::shared_ptr<Buffer> res(std::make_shared<Buffer>(capacity));
+__attribute__((noinline)) std::shared_ptr<Buffer> Buffer::CreateAsCopy(
+    const void* data,
+    size_t capacity) {
+  std::shared_ptr<Buffer> res(
+      std::make_shared<Buffer>(capacity, __builtin_return_address(0)));
   memcpy(res->data(), data, capacity);
   return res;
 }
@@ -54,6 +82,12 @@ void Buffer::setRange(size_t offset, size_t size) {
   range_length_ = size;
 }
 
+void Buffer::setTrackingTag(const char* tag) {
+  if (allocation_) {
+    allocation_->SetTag(tag);
+  }
+}
+
 std::shared_ptr<Message> Buffer::meta() {
   if (meta_.get() == nullptr) {
     meta_ = std::make_shared<Message>();
@@ -61,4 +95,10 @@ std::shared_ptr<Message> Buffer::meta() {
   return meta_;
 }
 
+void Buffer::copyMetaFrom(const Buffer& other) {
+  sample_meta_ = other.sample_meta_;
+  int32_data_ = other.int32_data_;
+  meta_ = other.meta_ != nullptr ? other.meta_->dup() : nullptr;
+}
+
 } /* namespace ave */
@@ -13,14 +13,38 @@
 #include "base/constructor_magic.h"
 #include "base/types.h"
 
+#include "buffer_tracker.h"
 #include "message.h"
 
 namespace ave {
 
+// Per-sample fields nearly every compressed buffer carries. They live inline
+// in the buffer, meta() is only needed for less common keys. pts_us and
+// codec_config replace the "timeUs" and "csd" keys of meta(), codec specific
+// data no longer carries those.
+struct SampleMeta {
+  int64_t pts_us = -1;
+  int64_t dts_us = -1;
+  int64_t duration_us = -1;
+  // temporal/spatial layer of scalable streams
+  int32_t layer_id = 0;
+  bool sync = false;
+  bool eos = false;
+  bool codec_config = false;
+};
+
 class Buffer {
  public:
-  Buffer(size_t capacity);
-  Buffer(void* data, size_t capacity);
+  // |site| is the allocation site accounted by BufferTracker, the caller of
+  // the constructor if null. std::make_shared() would make that a standard
+  // library function for every buffer, so prefer Create().
+  Buffer(size_t capacity, const void* site = nullptr);
+  // wraps |data|, which stays owned by the caller
+  Buffer(void* data, size_t capacity, const void* site = nullptr);
+
+  // accounted to the caller
+  static std::shared_ptr<Buffer> Create(size_t capacity);
+  static std::shared_ptr<Buffer> Create(void* data, size_t capacity);
 
   uint8_t* base() { return (uint8_t*)data_; }
   uint8_t* data() { return (uint8_t*)data_ + range_offset_; }
@@ -34,11 +58,23 @@ class Buffer {
                                               size_t capacity);
   void setInt32Data(int32_t data) { int32_data_ = data; }
   int32_t int32Data() const { return int32_data_; }
+
+  SampleMeta& sampleMeta() { return sample_meta_; }
+  const SampleMeta& sampleMeta() const { return sample_meta_; }
+  // allocated on first use, check hasMeta() first when only reading.
   std::shared_ptr<Message> meta();
+  bool hasMeta() const { return meta_ != nullptr; }
+  // Replaces the sample meta, int32Data() and meta() with those of |other|,
+  // meta() is duplicated. For buffers that take over another's payload.
+  void copyMetaFrom(const Buffer& other);
+
+  // accounts the buffer under |tag| if BufferTracker is enabled
+  void setTrackingTag(const char* tag);
 
   virtual ~Buffer();
 
  private:
+  SampleMeta sample_meta_;
   std::shared_ptr<Message> meta_;
   void* data_;
   size_t capacity_;
@@ -46,6 +82,7 @@ class Buffer {
   size_t range_length_;
   int32_t int32_data_;
   bool owns_data_;
+  std::unique_ptr<BufferTracker::Allocation> allocation_;
 
   AVE_DISALLOW_COPY_AND_ASSIGN(Buffer);
 };
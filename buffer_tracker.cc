@@ -0,0 +1,275 @@
+/*
+ * buffer_tracker.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "buffer_tracker.h"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+namespace ave {
+
+namespace {
+
+// "symbol+0x12" for |site| if it can be resolved, the raw address otherwise.
+std::string SiteToString(const void* site) {
+  std::ostringstream os;
+  Dl_info info;
+  if (site != nullptr && dladdr(site, &info) != 0 && info.dli_sname) {
+    int status = 0;
+    char* demangled =
+        abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    os << (status == 0 && demangled ? demangled : info.dli_sname) << "+0x"
+       << std::hex
+       << (reinterpret_cast<uintptr_t>(site) -
+           reinterpret_cast<uintptr_t>(info.dli_saddr));
+    free(demangled);
+  } else {
+    os << site;
+  }
+  return os.str();
+}
+
+}  // namespace
+
+void BufferTracker::TagCounters::Add(int64_t bytes) {
+  int64_t live =
+      live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  int64_t peak = peak_bytes.load(std::memory_order_relaxed);
+  while (live > peak &&
+         !peak_bytes.compare_exchange_weak(peak, live,
+                                           std::memory_order_relaxed)) {
+  }
+}
+
+BufferTracker::Allocation::Allocation(BufferTracker* tracker,
+                                      TagCounters* tag,
+                                      const void* site,
+                                      size_t bytes)
+    : tracker_(tracker),
+      tag_(tag),
+      site_(site),
+      bytes_(bytes),
+      thread_(std::this_thread::get_id()),
+      prev_(nullptr),
+      next_(nullptr) {}
+
+BufferTracker::Allocation::~Allocation() {
+  tracker_->Unlink(this);
+}
+
+void BufferTracker::Allocation::SetTag(const char* tag) {
+  tracker_->Retag(this, tag);
+}
+
+void BufferTracker::Allocation::Resize(size_t bytes) {
+  tracker_->Resize(this, bytes);
+}
+
+// static
+BufferTracker& BufferTracker::GetInstance() {
+  // leaked on purpose, allocations may be released during exit.
+  static BufferTracker* tracker = new BufferTracker();
+  return *tracker;
+}
+
+BufferTracker::BufferTracker()
+    : enabled_(false), report_leaks_(false), live_(nullptr) {}
+
+void BufferTracker::SetEnabled(bool enabled) {
+  enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void BufferTracker::SetReportLeaksOnLooperStop(bool report) {
+  report_leaks_.store(report, std::memory_order_relaxed);
+}
+
+std::unique_ptr<BufferTracker::Allocation> BufferTracker::Track(
+    const char* tag,
+    size_t bytes,
+    const void* site) {
+  if (!enabled()) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  std::unique_ptr<Allocation> allocation(
+      new Allocation(this, GetTag(tag), site, bytes));
+  Link(allocation.get());
+  return allocation;
+}
+
+BufferTracker::TagCounters* BufferTracker::GetTag(const char* tag) {
+  auto& counters = tags_[tag];
+  if (counters == nullptr) {
+    counters = std::make_unique<TagCounters>(tag);
+  }
+  return counters.get();
+}
+
+void BufferTracker::Link(Allocation* allocation) {
+  int64_t bytes = static_cast<int64_t>(allocation->bytes_);
+  allocation->tag_->Add(bytes);
+  allocation->tag_->live_count.fetch_add(1, std::memory_order_relaxed);
+  allocation->tag_->total_count.fetch_add(1, std::memory_order_relaxed);
+
+  SiteCounters& site = sites_[{allocation->site_, allocation->tag_}];
+  site.live_bytes += bytes;
+  site.live_count++;
+
+  allocation->next_ = live_;
+  if (live_ != nullptr) {
+    live_->prev_ = allocation;
+  }
+  live_ = allocation;
+}
+
+void BufferTracker::Unlink(Allocation* allocation) {
+  std::lock_guard<std::mutex> guard(lock_);
+  int64_t bytes = static_cast<int64_t>(allocation->bytes_);
+  allocation->tag_->live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+  allocation->tag_->live_count.fetch_sub(1, std::memory_order_relaxed);
+
+  auto it = sites_.find({allocation->site_, allocation->tag_});
+  if (it != sites_.end()) {
+    it->second.live_bytes -= bytes;
+    if (--it->second.live_count == 0) {
+      sites_.erase(it);
+    }
+  }
+
+  if (allocation->prev_ != nullptr) {
+    allocation->prev_->next_ = allocation->next_;
+  } else {
+    live_ = allocation->next_;
+  }
+  if (allocation->next_ != nullptr) {
+    allocation->next_->prev_ = allocation->prev_;
+  }
+}
+
+void BufferTracker::Retag(Allocation* allocation, const char* tag) {
+  std::lock_guard<std::mutex> guard(lock_);
+  TagCounters* to = GetTag(tag);
+  TagCounters* from = allocation->tag_;
+  if (to == from) {
+    return;
+  }
+
+  int64_t bytes = static_cast<int64_t>(allocation->bytes_);
+  from->live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+  from->live_count.fetch_sub(1, std::memory_order_relaxed);
+  from->total_count.fetch_sub(1, std::memory_order_relaxed);
+  to->Add(bytes);
+  to->live_count.fetch_add(1, std::memory_order_relaxed);
+  to->total_count.fetch_add(1, std::memory_order_relaxed);
+
+  auto it = sites_.find({allocation->site_, from});
+  if (it != sites_.end()) {
+    it->second.live_bytes -= bytes;
+    if (--it->second.live_count == 0) {
+      sites_.erase(it);
+    }
+  }
+  SiteCounters& site = sites_[{allocation->site_, to}];
+  site.live_bytes += bytes;
+  site.live_count++;
+
+  allocation->tag_ = to;
+}
+
+void BufferTracker::Resize(Allocation* allocation, size_t bytes) {
+  std::lock_guard<std::mutex> guard(lock_);
+  int64_t delta =
+      static_cast<int64_t>(bytes) - static_cast<int64_t>(allocation->bytes_);
+  if (delta == 0) {
+    return;
+  }
+  allocation->tag_->Add(delta);
+  sites_[{allocation->site_, allocation->tag_}].live_bytes += delta;
+  allocation->bytes_ = bytes;
+}
+
+std::vector<BufferTracker::TagStats> BufferTracker::GetTagStats() const {
+  std::vector<TagStats> stats;
+  std::lock_guard<std::mutex> guard(lock_);
+  stats.reserve(tags_.size());
+  for (const auto& it : tags_) {
+    const TagCounters& tag = *it.second;
+    stats.push_back({tag.name, tag.live_bytes.load(std::memory_order_relaxed),
+                     tag.live_count.load(std::memory_order_relaxed),
+                     tag.peak_bytes.load(std::memory_order_relaxed),
+                     tag.total_count.load(std::memory_order_relaxed)});
+  }
+  std::sort(stats.begin(), stats.end(),
+            [](const TagStats& a, const TagStats& b) { return a.tag < b.tag; });
+  return stats;
+}
+
+std::vector<BufferTracker::SiteStats> BufferTracker::GetSiteStats() const {
+  std::vector<SiteStats> stats;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stats.reserve(sites_.size());
+    for (const auto& it : sites_) {
+      stats.push_back({it.first.site, it.first.tag->name,
+                       it.second.live_bytes, it.second.live_count});
+    }
+  }
+  std::sort(stats.begin(), stats.end(),
+            [](const SiteStats& a, const SiteStats& b) {
+              return a.live_bytes > b.live_bytes ||
+                     (a.live_bytes == b.live_bytes &&
+                      a.live_count > b.live_count);
+            });
+  return stats;
+}
+
+std::string BufferTracker::Dump() const {
+  std::ostringstream os;
+  os << "BufferTracker (" << (enabled() ? "enabled" : "disabled") << ")\n";
+  for (const auto& tag : GetTagStats()) {
+    os << "  " << tag.tag << ": live " << tag.live_bytes << " bytes in "
+       << tag.live_count << " buffers, peak " << tag.peak_bytes
+       << " bytes, total " << tag.total_count << " buffers\n";
+  }
+  os << "allocation sites:\n";
+  for (const auto& site : GetSiteStats()) {
+    os << "  " << SiteToString(site.site) << " [" << site.tag
+       << "]: " << site.live_bytes << " bytes in " << site.live_count
+       << " buffers\n";
+  }
+  return os.str();
+}
+
+std::string BufferTracker::DumpLive(std::thread::id thread) const {
+  std::map<SiteKey, SiteCounters> sites;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (Allocation* allocation = live_; allocation != nullptr;
+         allocation = allocation->next_) {
+      if (allocation->thread_ == thread) {
+        SiteCounters& site = sites[{allocation->site_, allocation->tag_}];
+        site.live_bytes += static_cast<int64_t>(allocation->bytes_);
+        site.live_count++;
+      }
+    }
+  }
+
+  std::ostringstream os;
+  for (const auto& it : sites) {
+    os << "  " << SiteToString(it.first.site) << " [" << it.first.tag->name
+       << "]: " << it.second.live_bytes << " bytes in "
+       << it.second.live_count << " buffers\n";
+  }
+  return os.str();
+}
+
+}  // namespace ave
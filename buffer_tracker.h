@@ -0,0 +1,163 @@
+/*
+ * buffer_tracker.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef BUFFER_TRACKER_H
+#define BUFFER_TRACKER_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "base/constructor_magic.h"
+
+namespace ave {
+
+// Optional accounting of Buffer, MediaBuffer and MediaPacket memory, to find
+// out which pipeline stage is holding on to buffers. Tracking is off by
+// default and only allocations made while it is enabled are accounted, so the
+// cost when disabled is a relaxed atomic load per allocation.
+//
+// Every tracked allocation is counted under a tag (the allocating class by
+// default, callers may retag e.g. "demuxer" or "decoder-output") and under
+// the code address it was allocated from.
+class BufferTracker {
+  struct TagCounters;
+
+ public:
+  struct TagStats {
+    std::string tag;
+    int64_t live_bytes;
+    int64_t live_count;
+    int64_t peak_bytes;
+    // allocations since tracking was enabled
+    int64_t total_count;
+  };
+
+  struct SiteStats {
+    const void* site;
+    std::string tag;
+    int64_t live_bytes;
+    int64_t live_count;
+  };
+
+  // Record of a live allocation, the accounting is undone when it is
+  // destroyed.
+  class Allocation {
+   public:
+    ~Allocation();
+
+    // |tag| must be a string literal or otherwise outlive the process.
+    void SetTag(const char* tag);
+    void Resize(size_t bytes);
+
+   private:
+    friend class BufferTracker;
+    Allocation(BufferTracker* tracker,
+               TagCounters* tag,
+               const void* site,
+               size_t bytes);
+
+    BufferTracker* const tracker_;
+    TagCounters* tag_;
+    const void* const site_;
+    size_t bytes_;
+    const std::thread::id thread_;
+
+    // intrusive list of live allocations, guarded by tracker_->lock_
+    Allocation* prev_;
+    Allocation* next_;
+
+    AVE_DISALLOW_COPY_AND_ASSIGN(Allocation);
+  };
+
+  static BufferTracker& GetInstance();
+
+  void SetEnabled(bool enabled);
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  // Debug mode, Looper::stop() logs the tracked buffers allocated on its
+  // thread that are still alive.
+  void SetReportLeaksOnLooperStop(bool report);
+  bool report_leaks_on_looper_stop() const {
+    return report_leaks_.load(std::memory_order_relaxed);
+  }
+
+  // Returns nullptr when tracking is disabled. |site| is usually
+  // __builtin_return_address(0) of the allocating function.
+  std::unique_ptr<Allocation> Track(const char* tag,
+                                    size_t bytes,
+                                    const void* site);
+
+  // Snapshot of the per-tag counters.
+  std::vector<TagStats> GetTagStats() const;
+  // Live allocations grouped by allocation site, largest first.
+  std::vector<SiteStats> GetSiteStats() const;
+
+  // Human readable tag table and site histogram.
+  std::string Dump() const;
+  // Live allocations made on |thread|, empty if there are none.
+  std::string DumpLive(std::thread::id thread) const;
+
+ private:
+  struct TagCounters {
+    explicit TagCounters(const char* name) : name(name) {}
+
+    const char* const name;
+    std::atomic<int64_t> live_bytes{0};
+    std::atomic<int64_t> live_count{0};
+    std::atomic<int64_t> peak_bytes{0};
+    std::atomic<int64_t> total_count{0};
+
+    void Add(int64_t bytes);
+  };
+
+  struct SiteKey {
+    const void* site;
+    const TagCounters* tag;
+    bool operator<(const SiteKey& other) const {
+      return site < other.site || (site == other.site && tag < other.tag);
+    }
+  };
+
+  struct SiteCounters {
+    int64_t live_bytes = 0;
+    int64_t live_count = 0;
+  };
+
+  BufferTracker();
+  ~BufferTracker() = delete;
+
+  // called with |lock_| held
+  TagCounters* GetTag(const char* tag);
+  void Link(Allocation* allocation);
+
+  // called from Allocation
+  void Unlink(Allocation* allocation);
+  void Retag(Allocation* allocation, const char* tag);
+  void Resize(Allocation* allocation, size_t bytes);
+
+  std::atomic<bool> enabled_;
+  std::atomic<bool> report_leaks_;
+
+  mutable std::mutex lock_;
+  // tags are never removed, so allocations can keep a TagCounters pointer
+  // and update the counters without the lock.
+  std::unordered_map<std::string, std::unique_ptr<TagCounters>> tags_;
+  std::map<SiteKey, SiteCounters> sites_;
+  Allocation* live_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(BufferTracker);
+};
+
+}  // namespace ave
+
+#endif /* !BUFFER_TRACKER_H */
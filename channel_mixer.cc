@@ -0,0 +1,531 @@
+/*
+ * channel_mixer.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "channel_mixer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "base/checks.h"
+#include "base/logging.h"
+
+#include "pcm_conversion.h"
+#include "vector_math.h"
+
+namespace ave {
+
+namespace {
+
+// -3 dB, the power of a channel folded into two others is preserved.
+const float kEqualPowerScale = static_cast<float>(M_SQRT1_2);
+
+// Frames converted to float at a time, small enough for the scratch of 8
+// channels to stay in L1.
+const size_t kBlockFrames = 256;
+
+size_t BytesPerSample(AudioEncoding encoding) {
+  switch (encoding) {
+    case kAudioEncodingPcm16bit:
+      return sizeof(int16_t);
+    case kAudioEncodingPcm32bit:
+      return sizeof(int32_t);
+    case kAudioEncodingPcmFloat:
+      return sizeof(float);
+    default:
+      return 0;
+  }
+}
+
+}  // namespace
+
+ChannelMixingMatrix::ChannelMixingMatrix(ChannelLayout input_layout,
+                                         int input_channels,
+                                         ChannelLayout output_layout,
+                                         int output_channels)
+    : input_layout_(input_layout),
+      input_channels_(input_channels),
+      output_layout_(output_layout),
+      output_channels_(output_channels),
+      matrix_(nullptr) {
+  // The back pair of 5.x sits where the side pair of 7.x does, map them
+  // directly instead of folding the back into the side channels.
+  if (input_layout_ == CHANNEL_LAYOUT_5_0_BACK &&
+      output_layout_ == CHANNEL_LAYOUT_7_0) {
+    input_layout_ = CHANNEL_LAYOUT_5_0;
+  } else if (input_layout_ == CHANNEL_LAYOUT_5_1_BACK &&
+             output_layout_ == CHANNEL_LAYOUT_7_1) {
+    input_layout_ = CHANNEL_LAYOUT_5_1;
+  }
+}
+
+bool ChannelMixingMatrix::CreateTransformationMatrix(
+    std::vector<std::vector<float>>* matrix) {
+  matrix_ = matrix;
+  matrix_->assign(output_channels_, std::vector<float>(input_channels_, 0));
+  unaccounted_inputs_.clear();
+
+  // Discrete channels have no positions, copy as many as both sides have
+  // and leave the rest silent.
+  if (input_layout_ == CHANNEL_LAYOUT_DISCRETE ||
+      output_layout_ == CHANNEL_LAYOUT_DISCRETE) {
+    int passthrough = std::min(input_channels_, output_channels_);
+    for (int i = 0; i < passthrough; i++) {
+      (*matrix_)[i][i] = 1;
+    }
+    return true;
+  }
+
+  // Route the channels both layouts have.
+  for (int ch = LEFT; ch <= CHANNELS_MAX; ch++) {
+    Channels channel = static_cast<Channels>(ch);
+    int input_index = ChannelOrder(input_layout_, channel);
+    if (input_index < 0) {
+      continue;
+    }
+    int output_index = ChannelOrder(output_layout_, channel);
+    if (output_index < 0) {
+      unaccounted_inputs_.push_back(channel);
+      continue;
+    }
+    AVE_DCHECK_LT(output_index, output_channels_);
+    AVE_DCHECK_LT(input_index, input_channels_);
+    (*matrix_)[output_index][input_index] = 1;
+  }
+
+  if (!unaccounted_inputs_.empty()) {
+    // Front LR into center.
+    if (IsUnaccounted(LEFT)) {
+      // A full scale stereo mix would clip at -3 dB, halve it instead.
+      float scale =
+          (output_layout_ == CHANNEL_LAYOUT_MONO && input_channels_ == 2)
+              ? 0.5f
+              : kEqualPowerScale;
+      Mix(LEFT, CENTER, scale);
+      Mix(RIGHT, CENTER, scale);
+    }
+
+    // Center into front LR, mono is copied to both.
+    if (IsUnaccounted(CENTER)) {
+      float scale =
+          input_layout_ == CHANNEL_LAYOUT_MONO ? 1.0f : kEqualPowerScale;
+      MixWithoutAccounting(CENTER, LEFT, scale);
+      Mix(CENTER, RIGHT, scale);
+    }
+
+    // Back LR into side LR, back center, front LR or front center.
+    if (IsUnaccounted(BACK_LEFT)) {
+      if (HasOutputChannel(SIDE_LEFT)) {
+        // moved as is if the side channels are free
+        float scale = HasInputChannel(SIDE_LEFT) ? kEqualPowerScale : 1.0f;
+        Mix(BACK_LEFT, SIDE_LEFT, scale);
+        Mix(BACK_RIGHT, SIDE_RIGHT, scale);
+      } else if (HasOutputChannel(BACK_CENTER)) {
+        Mix(BACK_LEFT, BACK_CENTER, kEqualPowerScale);
+        Mix(BACK_RIGHT, BACK_CENTER, kEqualPowerScale);
+      } else if (HasOutputChannel(LEFT)) {
+        Mix(BACK_LEFT, LEFT, kEqualPowerScale);
+        Mix(BACK_RIGHT, RIGHT, kEqualPowerScale);
+      } else {
+        Mix(BACK_LEFT, CENTER, kEqualPowerScale);
+        Mix(BACK_RIGHT, CENTER, kEqualPowerScale);
+      }
+    }
+
+    // Side LR into back LR, back center, front LR or front center.
+    if (IsUnaccounted(SIDE_LEFT)) {
+      if (HasOutputChannel(BACK_LEFT)) {
+        float scale = HasInputChannel(BACK_LEFT) ? kEqualPowerScale : 1.0f;
+        Mix(SIDE_LEFT, BACK_LEFT, scale);
+        Mix(SIDE_RIGHT, BACK_RIGHT, scale);
+      } else if (HasOutputChannel(BACK_CENTER)) {
+        Mix(SIDE_LEFT, BACK_CENTER, kEqualPowerScale);
+        Mix(SIDE_RIGHT, BACK_CENTER, kEqualPowerScale);
+      } else if (HasOutputChannel(LEFT)) {
+        Mix(SIDE_LEFT, LEFT, kEqualPowerScale);
+        Mix(SIDE_RIGHT, RIGHT, kEqualPowerScale);
+      } else {
+        Mix(SIDE_LEFT, CENTER, kEqualPowerScale);
+        Mix(SIDE_RIGHT, CENTER, kEqualPowerScale);
+      }
+    }
+
+    // Back center into back LR, side LR, front LR or front center.
+    if (IsUnaccounted(BACK_CENTER)) {
+      if (HasOutputChannel(BACK_LEFT)) {
+        MixWithoutAccounting(BACK_CENTER, BACK_LEFT, kEqualPowerScale);
+        Mix(BACK_CENTER, BACK_RIGHT, kEqualPowerScale);
+      } else if (HasOutputChannel(SIDE_LEFT)) {
+        MixWithoutAccounting(BACK_CENTER, SIDE_LEFT, kEqualPowerScale);
+        Mix(BACK_CENTER, SIDE_RIGHT, kEqualPowerScale);
+      } else if (HasOutputChannel(LEFT)) {
+        MixWithoutAccounting(BACK_CENTER, LEFT, kEqualPowerScale);
+        Mix(BACK_CENTER, RIGHT, kEqualPowerScale);
+      } else {
+        Mix(BACK_CENTER, CENTER, kEqualPowerScale);
+      }
+    }
+
+    // LR of center into front LR or front center.
+    if (IsUnaccounted(LEFT_OF_CENTER)) {
+      if (HasOutputChannel(LEFT)) {
+        Mix(LEFT_OF_CENTER, LEFT, kEqualPowerScale);
+        Mix(RIGHT_OF_CENTER, RIGHT, kEqualPowerScale);
+      } else {
+        Mix(LEFT_OF_CENTER, CENTER, kEqualPowerScale);
+        Mix(RIGHT_OF_CENTER, CENTER, kEqualPowerScale);
+      }
+    }
+
+    // BS.775 drops the LFE from a downmix, folding it into full range
+    // channels only adds rumble.
+    if (IsUnaccounted(LFE)) {
+      AccountFor(LFE);
+    }
+
+    AVE_DCHECK(unaccounted_inputs_.empty());
+  }
+
+  for (const auto& row : *matrix_) {
+    int mappings = 0;
+    for (float scale : row) {
+      if (scale == 0) {
+        continue;
+      }
+      if (scale != 1 || ++mappings > 1) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool ChannelMixingMatrix::IsUnaccounted(Channels ch) const {
+  return std::find(unaccounted_inputs_.begin(), unaccounted_inputs_.end(),
+                   ch) != unaccounted_inputs_.end();
+}
+
+bool ChannelMixingMatrix::HasInputChannel(Channels ch) const {
+  return ChannelOrder(input_layout_, ch) >= 0;
+}
+
+bool ChannelMixingMatrix::HasOutputChannel(Channels ch) const {
+  return ChannelOrder(output_layout_, ch) >= 0;
+}
+
+void ChannelMixingMatrix::Mix(Channels input_ch,
+                              Channels output_ch,
+                              float scale) {
+  MixWithoutAccounting(input_ch, output_ch, scale);
+  AccountFor(input_ch);
+}
+
+void ChannelMixingMatrix::MixWithoutAccounting(Channels input_ch,
+                                               Channels output_ch,
+                                               float scale) {
+  int input_index = ChannelOrder(input_layout_, input_ch);
+  int output_index = ChannelOrder(output_layout_, output_ch);
+  AVE_DCHECK_GE(input_index, 0);
+  AVE_DCHECK_GE(output_index, 0);
+  AVE_DCHECK_EQ((*matrix_)[output_index][input_index], 0);
+  (*matrix_)[output_index][input_index] = scale;
+}
+
+void ChannelMixingMatrix::AccountFor(Channels ch) {
+  unaccounted_inputs_.erase(std::find(unaccounted_inputs_.begin(),
+                                      unaccounted_inputs_.end(), ch));
+}
+
+ChannelMixer::ChannelMixer(ChannelLayout input_layout,
+                           ChannelLayout output_layout)
+    : input_channels_(ChannelLayoutToChannelCount(input_layout)),
+      output_channels_(ChannelLayoutToChannelCount(output_layout)) {
+  Initialize(input_layout, output_layout);
+}
+
+ChannelMixer::ChannelMixer(ChannelLayout input_layout,
+                           int input_channels,
+                           ChannelLayout output_layout,
+                           int output_channels)
+    : input_channels_(input_channels), output_channels_(output_channels) {
+  Initialize(input_layout, output_layout);
+}
+
+void ChannelMixer::Initialize(ChannelLayout input_layout,
+                              ChannelLayout output_layout) {
+  AVE_CHECK_GT(input_channels_, 0);
+  AVE_CHECK_GT(output_channels_, 0);
+  if (input_layout != CHANNEL_LAYOUT_DISCRETE) {
+    AVE_CHECK_EQ(input_channels_, ChannelLayoutToChannelCount(input_layout));
+  }
+  if (output_layout != CHANNEL_LAYOUT_DISCRETE) {
+    AVE_CHECK_EQ(output_channels_,
+                 ChannelLayoutToChannelCount(output_layout));
+  }
+
+  ChannelMixingMatrix matrix_builder(input_layout, input_channels_,
+                                     output_layout, output_channels_);
+  bool remapping = matrix_builder.CreateTransformationMatrix(&matrix_);
+
+  if (remapping) {
+    mode_ = input_channels_ == output_channels_ ? Mode::kIdentity
+                                                : Mode::kReorder;
+    sources_.assign(output_channels_, -1);
+    for (int output = 0; output < output_channels_; output++) {
+      for (int input = 0; input < input_channels_; input++) {
+        if (matrix_[output][input] != 0) {
+          sources_[output] = input;
+        }
+      }
+      if (sources_[output] != output) {
+        mode_ = Mode::kReorder;
+      }
+    }
+    return;
+  }
+
+  // discrete layouts are only remapped, the layouts mixed have at most
+  // kMaxConcurrentChannels channels, as the (de)interleavers require
+  mode_ = Mode::kMix;
+  AVE_DCHECK_LE(std::max(input_channels_, output_channels_),
+                kMaxConcurrentChannels);
+  taps_.resize(output_channels_);
+  used_inputs_.assign(input_channels_, false);
+  for (int output = 0; output < output_channels_; output++) {
+    for (int input = 0; input < input_channels_; input++) {
+      float scale = matrix_[output][input];
+      if (scale != 0) {
+        taps_[output].push_back({input, scale});
+        used_inputs_[input] = true;
+      }
+    }
+  }
+  interleaved_scratch_.resize(std::max(input_channels_, output_channels_) *
+                              kBlockFrames);
+  in_scratch_.resize(input_channels_ * kBlockFrames);
+  out_scratch_.resize(output_channels_ * kBlockFrames);
+  for (int ch = 0; ch < input_channels_; ch++) {
+    scratch_in_.push_back(in_scratch_.data() + ch * kBlockFrames);
+  }
+  for (int ch = 0; ch < output_channels_; ch++) {
+    scratch_out_.push_back(out_scratch_.data() + ch * kBlockFrames);
+  }
+  planes_in_.resize(input_channels_);
+  planes_out_.resize(output_channels_);
+}
+
+template <typename T>
+void ChannelMixer::Reorder(const T* in, T* out, size_t frames) const {
+  const int* sources = sources_.data();
+  for (size_t i = 0; i < frames; i++) {
+    for (int ch = 0; ch < output_channels_; ch++) {
+      out[ch] = sources[ch] < 0 ? T(0) : in[sources[ch]];
+    }
+    in += input_channels_;
+    out += output_channels_;
+  }
+}
+
+template <typename T>
+void ChannelMixer::ReorderPlanar(const T* const* in,
+                                 T* const* out,
+                                 size_t frames) const {
+  for (int ch = 0; ch < output_channels_; ch++) {
+    if (sources_[ch] < 0) {
+      memset(out[ch], 0, frames * sizeof(T));
+    } else if (in[sources_[ch]] != out[ch]) {
+      memcpy(out[ch], in[sources_[ch]], frames * sizeof(T));
+    }
+  }
+}
+
+// Float output is not clipped, the renderer does that, integer output
+// saturates in ConvertPcm().
+void ChannelMixer::Mix(AudioEncoding encoding,
+                       const void* in,
+                       void* out,
+                       size_t frames) {
+  const bool is_float = encoding == kAudioEncodingPcmFloat;
+  const size_t sample_size = BytesPerSample(encoding);
+  const uint8_t* src = static_cast<const uint8_t*>(in);
+  uint8_t* dst = static_cast<uint8_t*>(out);
+  float* interleaved = interleaved_scratch_.data();
+  for (size_t done = 0; done < frames; done += kBlockFrames) {
+    size_t count = std::min(kBlockFrames, frames - done);
+    const float* block_in = reinterpret_cast<const float*>(src);
+    if (!is_float) {
+      ConvertPcm(encoding, src, kAudioEncodingPcmFloat, interleaved,
+                 count * input_channels_);
+      block_in = interleaved;
+    }
+    DeinterleavePcm(kAudioEncodingPcmFloat, block_in, input_channels_, count,
+                    reinterpret_cast<void* const*>(scratch_in_.data()));
+
+    MixBlock(scratch_in_.data(), scratch_out_.data(), count);
+
+    float* block_out = is_float ? reinterpret_cast<float*>(dst) : interleaved;
+    InterleavePcm(kAudioEncodingPcmFloat,
+                  reinterpret_cast<const void* const*>(scratch_out_.data()),
+                  output_channels_, count, block_out);
+    if (!is_float) {
+      ConvertPcm(kAudioEncodingPcmFloat, interleaved, encoding, dst,
+                 count * output_channels_);
+    }
+    src += count * input_channels_ * sample_size;
+    dst += count * output_channels_ * sample_size;
+  }
+}
+
+void ChannelMixer::MixPlanar(AudioEncoding encoding,
+                             const void* const* in,
+                             void* const* out,
+                             size_t frames) {
+  const size_t sample_size = BytesPerSample(encoding);
+  for (size_t done = 0; done < frames; done += kBlockFrames) {
+    size_t count = std::min(kBlockFrames, frames - done);
+    size_t offset = done * sample_size;
+    for (int ch = 0; ch < input_channels_; ch++) {
+      if (used_inputs_[ch]) {
+        ConvertPcm(encoding, static_cast<const uint8_t*>(in[ch]) + offset,
+                   kAudioEncodingPcmFloat, scratch_in_[ch], count);
+      }
+    }
+
+    MixBlock(scratch_in_.data(), scratch_out_.data(), count);
+
+    for (int ch = 0; ch < output_channels_; ch++) {
+      ConvertPcm(kAudioEncodingPcmFloat, scratch_out_[ch], encoding,
+                 static_cast<uint8_t*>(out[ch]) + offset, count);
+    }
+  }
+}
+
+void ChannelMixer::MixPlanarFloat(const float* const* in,
+                                  float* const* out,
+                                  size_t frames) {
+  std::copy(in, in + input_channels_, planes_in_.begin());
+  std::copy(out, out + output_channels_, planes_out_.begin());
+  // an output written over an input still to be read by a later output goes
+  // through the scratch block
+  bool in_place = false;
+  for (int ch = 0; ch < input_channels_; ch++) {
+    if (used_inputs_[ch] &&
+        std::find(out, out + output_channels_, in[ch]) !=
+            out + output_channels_) {
+      in_place = true;
+    }
+  }
+  for (size_t done = 0; done < frames; done += kBlockFrames) {
+    size_t count = std::min(kBlockFrames, frames - done);
+    if (in_place) {
+      MixBlock(planes_in_.data(), scratch_out_.data(), count);
+      for (int ch = 0; ch < output_channels_; ch++) {
+        memcpy(planes_out_[ch], scratch_out_[ch], count * sizeof(float));
+      }
+    } else {
+      MixBlock(planes_in_.data(), planes_out_.data(), count);
+    }
+    for (auto& plane : planes_in_) {
+      plane += count;
+    }
+    for (auto& plane : planes_out_) {
+      plane += count;
+    }
+  }
+}
+
+void ChannelMixer::MixBlock(const float* const* in,
+                            float* const* out,
+                            size_t frames) {
+  for (int ch = 0; ch < output_channels_; ch++) {
+    const auto& taps = taps_[ch];
+    if (taps.empty()) {
+      memset(out[ch], 0, frames * sizeof(float));
+      continue;
+    }
+    vector_math::FMUL(in[taps[0].input], taps[0].scale, frames, out[ch]);
+    for (size_t i = 1; i < taps.size(); i++) {
+      vector_math::FMAC(in[taps[i].input], taps[i].scale, frames, out[ch]);
+    }
+  }
+}
+
+status_t ChannelMixer::Transform(AudioEncoding encoding,
+                                 const void* in,
+                                 void* out,
+                                 size_t frames) {
+  size_t sample_size = BytesPerSample(encoding);
+  if (sample_size == 0) {
+    AVE_LOG(LS_ERROR) << "unsupported encoding " << encoding;
+    return ERROR_UNSUPPORTED;
+  }
+
+  switch (mode_) {
+    case Mode::kIdentity:
+      if (in != out) {
+        memcpy(out, in, frames * input_channels_ * sample_size);
+      }
+      break;
+    case Mode::kReorder:
+      if (encoding == kAudioEncodingPcm16bit) {
+        Reorder(static_cast<const int16_t*>(in), static_cast<int16_t*>(out),
+                frames);
+      } else if (encoding == kAudioEncodingPcm32bit) {
+        Reorder(static_cast<const int32_t*>(in), static_cast<int32_t*>(out),
+                frames);
+      } else {
+        Reorder(static_cast<const float*>(in), static_cast<float*>(out),
+                frames);
+      }
+      break;
+    case Mode::kMix:
+      Mix(encoding, in, out, frames);
+      break;
+  }
+  return OK;
+}
+
+status_t ChannelMixer::TransformPlanar(AudioEncoding encoding,
+                                       const void* const* in,
+                                       void* const* out,
+                                       size_t frames) {
+  size_t sample_size = BytesPerSample(encoding);
+  if (sample_size == 0) {
+    AVE_LOG(LS_ERROR) << "unsupported encoding " << encoding;
+    return ERROR_UNSUPPORTED;
+  }
+
+  switch (mode_) {
+    case Mode::kIdentity:
+      for (int ch = 0; ch < output_channels_; ch++) {
+        if (in[ch] != out[ch]) {
+          memcpy(out[ch], in[ch], frames * sample_size);
+        }
+      }
+      break;
+    case Mode::kReorder:
+      if (sample_size == sizeof(int16_t)) {
+        ReorderPlanar(reinterpret_cast<const int16_t* const*>(in),
+                      reinterpret_cast<int16_t* const*>(out), frames);
+      } else {
+        ReorderPlanar(reinterpret_cast<const int32_t* const*>(in),
+                      reinterpret_cast<int32_t* const*>(out), frames);
+      }
+      break;
+    case Mode::kMix:
+      if (encoding == kAudioEncodingPcmFloat) {
+        MixPlanarFloat(reinterpret_cast<const float* const*>(in),
+                       reinterpret_cast<float* const*>(out), frames);
+      } else {
+        MixPlanar(encoding, in, out, frames);
+      }
+      break;
+  }
+  return OK;
+}
+
+}  // namespace ave
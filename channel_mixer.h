@@ -0,0 +1,165 @@
+/*
+ * channel_mixer.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef CHANNEL_MIXER_H
+#define CHANNEL_MIXER_H
+
+#include <vector>
+
+#include "base/constructor_magic.h"
+#include "base/types.h"
+
+#include "channel_layout.h"
+#include "media_defs.h"
+#include "media_errors.h"
+
+namespace ave {
+
+// Builds the matrix that maps the channels of one layout onto another, the
+// rules follow ITU-R BS.775: channels missing from the output are folded
+// into their nearest neighbours at -3 dB, so 5.1 to stereo is
+// L' = L + 0.707 C + 0.707 SL. An LFE the output has no place for is
+// dropped. With a discrete layout on either side the channels are passed
+// through by index.
+class ChannelMixingMatrix {
+ public:
+  ChannelMixingMatrix(ChannelLayout input_layout,
+                      int input_channels,
+                      ChannelLayout output_layout,
+                      int output_channels);
+
+  // Fills |matrix| with |output_channels| rows of |input_channels|
+  // coefficients. Returns true if every output is a copy of at most one
+  // input, i.e. the channels only need to be reordered.
+  bool CreateTransformationMatrix(std::vector<std::vector<float>>* matrix);
+
+ private:
+  bool IsUnaccounted(Channels ch) const;
+  bool HasInputChannel(Channels ch) const;
+  bool HasOutputChannel(Channels ch) const;
+  // Routes |input_ch| into |output_ch| at |scale| and marks it as done.
+  void Mix(Channels input_ch, Channels output_ch, float scale);
+  // Same but leaves |input_ch| unaccounted, for channels that go to more
+  // than one output.
+  void MixWithoutAccounting(Channels input_ch, Channels output_ch, float scale);
+  void AccountFor(Channels ch);
+
+  ChannelLayout input_layout_;
+  const int input_channels_;
+  const ChannelLayout output_layout_;
+  const int output_channels_;
+
+  std::vector<Channels> unaccounted_inputs_;
+  std::vector<std::vector<float>>* matrix_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(ChannelMixingMatrix);
+};
+
+// Converts interleaved or planar PCM from one channel layout to another.
+// Identity conversions are a copy and pure reorderings move samples without
+// touching their values. Everything else is mixed in float with SIMD and
+// saturated back to the integer formats.
+//
+// Supports kAudioEncodingPcm16bit, kAudioEncodingPcm32bit and
+// kAudioEncodingPcmFloat. Not thread safe, the mixer keeps scratch buffers.
+class ChannelMixer {
+ public:
+  ChannelMixer(ChannelLayout input_layout, ChannelLayout output_layout);
+  // For CHANNEL_LAYOUT_DISCRETE, or to check the counts of other layouts.
+  ChannelMixer(ChannelLayout input_layout,
+               int input_channels,
+               ChannelLayout output_layout,
+               int output_channels);
+
+  // Converts |frames| interleaved frames from |in| into |out|, which must
+  // not overlap.
+  status_t Transform(AudioEncoding encoding,
+                     const void* in,
+                     void* out,
+                     size_t frames);
+
+  // Same for planar audio, one pointer per channel. When mixing, an output
+  // plane may also be one of the input planes.
+  status_t TransformPlanar(AudioEncoding encoding,
+                           const void* const* in,
+                           void* const* out,
+                           size_t frames);
+
+  int input_channels() const { return input_channels_; }
+  int output_channels() const { return output_channels_; }
+  const std::vector<std::vector<float>>& matrix() const { return matrix_; }
+
+  // No work besides a copy.
+  bool IsIdentity() const { return mode_ == Mode::kIdentity; }
+  // Samples are only moved between channels.
+  bool IsReorder() const { return mode_ == Mode::kReorder; }
+
+ private:
+  enum class Mode {
+    kIdentity,
+    kReorder,
+    kMix,
+  };
+
+  // An input channel and its coefficient in an output channel.
+  struct Tap {
+    int input;
+    float scale;
+  };
+
+  void Initialize(ChannelLayout input_layout, ChannelLayout output_layout);
+
+  template <typename T>
+  void Reorder(const T* in, T* out, size_t frames) const;
+  template <typename T>
+  void ReorderPlanar(const T* const* in, T* const* out, size_t frames) const;
+  // Blocks of integer samples are converted to and from float with
+  // ConvertPcm(), interleaved ones are split into planes with
+  // DeinterleavePcm() and put back with InterleavePcm().
+  void Mix(AudioEncoding encoding, const void* in, void* out, size_t frames);
+  void MixPlanar(AudioEncoding encoding,
+                 const void* const* in,
+                 void* const* out,
+                 size_t frames);
+  // Planar float needs no conversion, the caller's planes are mixed directly
+  // unless an output is also an input.
+  void MixPlanarFloat(const float* const* in,
+                      float* const* out,
+                      size_t frames);
+  // Mixes |frames| samples of each of |in| into each of |out|.
+  void MixBlock(const float* const* in, float* const* out, size_t frames);
+
+  const int input_channels_;
+  const int output_channels_;
+  Mode mode_;
+
+  std::vector<std::vector<float>> matrix_;
+  // kReorder: the input of each output channel, -1 for silence
+  std::vector<int> sources_;
+  // kMix: the non zero coefficients of each output channel
+  std::vector<std::vector<Tap>> taps_;
+  // inputs used by any output, the others of planar audio are not even
+  // converted
+  std::vector<bool> used_inputs_;
+
+  // a block of interleaved float, input or output
+  std::vector<float> interleaved_scratch_;
+  // a block of planar float input and output
+  std::vector<float> in_scratch_;
+  std::vector<float> out_scratch_;
+  std::vector<float*> scratch_in_;
+  std::vector<float*> scratch_out_;
+  // the caller's planes of planar float
+  std::vector<const float*> planes_in_;
+  std::vector<float*> planes_out_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(ChannelMixer);
+};
+
+}  // namespace ave
+
+#endif /* !CHANNEL_MIXER_H */
@@ -0,0 +1,999 @@
+/*
+ * color_transform.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "color_transform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "base/logging.h"
+
+#include "color_utils.h"
+#include "media_packet.h"
+#include "worker_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AVE_TRANSFORM_X86 1
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define AVE_TRANSFORM_NEON 1
+#endif
+
+namespace ave {
+
+namespace {
+
+// Nodes of the LUT per axis, the nodes are evenly spaced over the codes.
+const int32_t kLutSize = 33;
+// of the position of a code between two nodes
+const int kFracBits = 12;
+// of the destination codes in the LUT
+const int kCodeFracBits = 4;
+// int16_t of a node: Y, Cb, Cr and padding, so a node is 8 bytes
+const int32_t kStrideV = 4;
+const int32_t kStrideU = kStrideV * kLutSize;
+const int32_t kStrideY = kStrideU * kLutSize;
+
+// Rows of a band converted by one task, even for the chroma.
+const uint32_t kBandRows = 32;
+
+// BT.2408 reference white, the peak of SDR.
+const double kSdrWhite = 203.0;
+const double kPqPeak = 10000.0;
+const double kDefaultHdrPeak = 1000.0;
+
+struct TransformFormat {
+  PixelFormat format;
+  int bits;
+  int bytes;
+  // of the samples in their bytes, P010 keeps them in the high bits
+  int shift;
+  size_t num_planes;
+  int32_t col_inc[2];
+  // Cr before Cb in the interleaved chroma
+  bool swap_uv;
+};
+
+// clang-format off
+const TransformFormat kFormats[] = {
+  {AV_PIX_FMT_YUV420P,     8,  1, 0, 3, {1, 1}, false},
+  {AV_PIX_FMT_NV12,        8,  1, 0, 2, {1, 2}, false},
+  {AV_PIX_FMT_NV21,        8,  1, 0, 2, {1, 2}, true},
+  {AV_PIX_FMT_YUV420P10LE, 10, 2, 0, 3, {2, 2}, false},
+  {AV_PIX_FMT_P010LE,      10, 2, 6, 2, {2, 4}, false},
+};
+// clang-format on
+
+const TransformFormat* FindFormat(const FrameView& view) {
+  for (const auto& format : kFormats) {
+    if (format.format != view.format()) {
+      continue;
+    }
+    if (view.num_planes() != format.num_planes ||
+        view.plane(0).col_inc != format.col_inc[0]) {
+      return nullptr;
+    }
+    for (size_t i = 1; i < format.num_planes; i++) {
+      if (view.plane(i).col_inc != format.col_inc[1]) {
+        return nullptr;
+      }
+    }
+    return &format;
+  }
+  return nullptr;
+}
+
+// The unused high bits of the 10-bit formats are masked off, the
+// lookups index tables of 1 << |bits| entries.
+uint16_t LoadSample(const uint8_t* p, const TransformFormat& format) {
+  if (format.bytes == 1) {
+    return p[0];
+  }
+  return static_cast<uint16_t>(((p[0] | p[1] << 8) >> format.shift) &
+                               ((1 << format.bits) - 1));
+}
+
+void StoreSample(uint8_t* p, uint16_t value, const TransformFormat& format) {
+  if (format.bytes == 1) {
+    p[0] = static_cast<uint8_t>(value);
+    return;
+  }
+  value = static_cast<uint16_t>(value << format.shift);
+  p[0] = static_cast<uint8_t>(value);
+  p[1] = static_cast<uint8_t>(value >> 8);
+}
+
+// The sample of Cb (|channel| 0) or Cr (1) at |x|, |y| of the chroma planes.
+uint8_t* ChromaSample(const FrameView& view,
+                      const TransformFormat& format,
+                      int channel,
+                      uint32_t x,
+                      uint32_t y) {
+  if (format.num_planes == 3) {
+    const FrameView::Plane& plane = view.plane(1 + channel);
+    return plane.row(y) + x * plane.col_inc;
+  }
+  const FrameView::Plane& plane = view.plane(1);
+  int offset = (channel == 1) != format.swap_uv ? format.bytes : 0;
+  return plane.row(y) + x * plane.col_inc + offset;
+}
+
+// Kr and Kb of the matrix.
+void GetLumaWeights(ColorAspects::MatrixCoeffs matrix, double* kr, double* kb) {
+  switch (matrix) {
+    case ColorAspects::MatrixBT470_6M:
+      *kr = 0.30;
+      *kb = 0.11;
+      break;
+    case ColorAspects::MatrixBT601_6:
+      *kr = 0.299;
+      *kb = 0.114;
+      break;
+    case ColorAspects::MatrixSMPTE240M:
+      *kr = 0.212;
+      *kb = 0.087;
+      break;
+    case ColorAspects::MatrixBT2020:
+    case ColorAspects::MatrixBT2020Constant:
+      *kr = 0.2627;
+      *kb = 0.0593;
+      break;
+    default:
+      *kr = 0.2126;
+      *kb = 0.0722;
+      break;
+  }
+}
+
+// x and y of red, green, blue and white.
+struct Chromaticities {
+  double xy[4][2];
+};
+
+const Chromaticities& GetChromaticities(ColorAspects::Primaries primaries) {
+  static const Chromaticities kBT709 = {
+      {{0.640, 0.330}, {0.300, 0.600}, {0.150, 0.060}, {0.3127, 0.3290}}};
+  static const Chromaticities kBT470M = {
+      {{0.670, 0.330}, {0.210, 0.710}, {0.140, 0.080}, {0.310, 0.316}}};
+  static const Chromaticities kBT601_625 = {
+      {{0.640, 0.330}, {0.290, 0.600}, {0.150, 0.060}, {0.3127, 0.3290}}};
+  static const Chromaticities kBT601_525 = {
+      {{0.630, 0.340}, {0.310, 0.595}, {0.155, 0.070}, {0.3127, 0.3290}}};
+  static const Chromaticities kFilm = {
+      {{0.681, 0.319}, {0.243, 0.692}, {0.145, 0.049}, {0.310, 0.316}}};
+  static const Chromaticities kBT2020 = {
+      {{0.708, 0.292}, {0.170, 0.797}, {0.131, 0.046}, {0.3127, 0.3290}}};
+  switch (primaries) {
+    case ColorAspects::PrimariesBT470_6M:
+      return kBT470M;
+    case ColorAspects::PrimariesBT601_6_625:
+      return kBT601_625;
+    case ColorAspects::PrimariesBT601_6_525:
+      return kBT601_525;
+    case ColorAspects::PrimariesGenericFilm:
+      return kFilm;
+    case ColorAspects::PrimariesBT2020:
+      return kBT2020;
+    default:
+      return kBT709;
+  }
+}
+
+using Matrix3 = double[3][3];
+
+bool Invert(const Matrix3 m, Matrix3 out) {
+  double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+               m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+               m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+  if (std::fabs(det) < 1e-12) {
+    return false;
+  }
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      // the cofactor of j, i
+      int r0 = (j + 1) % 3;
+      int r1 = (j + 2) % 3;
+      int c0 = (i + 1) % 3;
+      int c1 = (i + 2) % 3;
+      out[i][j] = (m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0]) / det;
+    }
+  }
+  return true;
+}
+
+void Multiply(const Matrix3 a, const Matrix3 b, Matrix3 out) {
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      out[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j];
+    }
+  }
+}
+
+// Linear RGB to XYZ, white at Y = 1.
+bool RgbToXyz(const Chromaticities& c, Matrix3 out) {
+  Matrix3 primaries;
+  for (int i = 0; i < 3; i++) {
+    double x = c.xy[i][0];
+    double y = c.xy[i][1];
+    primaries[0][i] = x / y;
+    primaries[1][i] = 1.0;
+    primaries[2][i] = (1.0 - x - y) / y;
+  }
+  Matrix3 inverse;
+  if (!Invert(primaries, inverse)) {
+    return false;
+  }
+  const double wx = c.xy[3][0];
+  const double wy = c.xy[3][1];
+  const double white[3] = {wx / wy, 1.0, (1.0 - wx - wy) / wy};
+  for (int i = 0; i < 3; i++) {
+    double scale = inverse[i][0] * white[0] + inverse[i][1] * white[1] +
+                   inverse[i][2] * white[2];
+    for (int j = 0; j < 3; j++) {
+      out[j][i] = primaries[j][i] * scale;
+    }
+  }
+  return true;
+}
+
+// The transfer functions are extended to negative values by symmetry, so
+// they round trip the codes out of range too.
+double OddPow(double value, double exponent) {
+  return value < 0 ? -std::pow(-value, exponent) : std::pow(value, exponent);
+}
+
+// SMPTE ST 2084, the signal to cd/m^2 and back.
+const double kPqM1 = 2610.0 / 16384;
+const double kPqM2 = 2523.0 / 4096 * 128;
+const double kPqC1 = 3424.0 / 4096;
+const double kPqC2 = 2413.0 / 4096 * 32;
+const double kPqC3 = 2392.0 / 4096 * 32;
+
+double PqToNits(double e) {
+  double p = std::pow(std::fabs(e), 1.0 / kPqM2);
+  double l = std::pow(std::max(p - kPqC1, 0.0) / (kPqC2 - kPqC3 * p),
+                      1.0 / kPqM1);
+  return std::copysign(kPqPeak * l, e);
+}
+
+double NitsToPq(double nits) {
+  double l = std::pow(std::fabs(nits) / kPqPeak, kPqM1);
+  double e = std::pow((kPqC1 + kPqC2 * l) / (1.0 + kPqC3 * l), kPqM2);
+  return std::copysign(e, nits);
+}
+
+// ARIB STD-B67, the signal to scene light in [0, 1] and back.
+const double kHlgA = 0.17883277;
+const double kHlgB = 1.0 - 4.0 * kHlgA;
+const double kHlgC = 0.5 - kHlgA * std::log(4.0 * kHlgA);
+
+double HlgToScene(double e) {
+  double v = std::fabs(e);
+  double l = v <= 0.5 ? v * v / 3.0
+                      : (std::exp((v - kHlgC) / kHlgA) + kHlgB) / 12.0;
+  return std::copysign(l, e);
+}
+
+double SceneToHlg(double l) {
+  double v = std::fabs(l);
+  double e = v <= 1.0 / 12 ? std::sqrt(3.0 * v)
+                           : kHlgA * std::log(12.0 * v - kHlgB) + kHlgC;
+  return std::copysign(e, l);
+}
+
+// The SDR transfers as display gammas relative to white, BT.1886 for the
+// camera ones.
+double SdrToLinear(ColorAspects::Transfer transfer, double e) {
+  switch (transfer) {
+    case ColorAspects::TransferLinear:
+      return e;
+    case ColorAspects::TransferSRGB: {
+      double v = std::fabs(e);
+      double l = v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+      return std::copysign(l, e);
+    }
+    case ColorAspects::TransferGamma22:
+      return OddPow(e, 2.2);
+    case ColorAspects::TransferGamma28:
+      return OddPow(e, 2.8);
+    case ColorAspects::TransferST428:
+      return OddPow(e, 2.6);
+    default:
+      return OddPow(e, 2.4);
+  }
+}
+
+double LinearToSdr(ColorAspects::Transfer transfer, double l) {
+  switch (transfer) {
+    case ColorAspects::TransferLinear:
+      return l;
+    case ColorAspects::TransferSRGB: {
+      double v = std::fabs(l);
+      double e = v <= 0.0031308 ? v * 12.92
+                                : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+      return std::copysign(e, l);
+    }
+    case ColorAspects::TransferGamma22:
+      return OddPow(l, 1.0 / 2.2);
+    case ColorAspects::TransferGamma28:
+      return OddPow(l, 1.0 / 2.8);
+    case ColorAspects::TransferST428:
+      return OddPow(l, 1.0 / 2.6);
+    default:
+      return OddPow(l, 1.0 / 2.4);
+  }
+}
+
+// Y' in [0, 1] and Cb, Cr in [-0.5, 0.5] of a |bits| code and back.
+double CodeToLuma(double code, int bits, bool full_range) {
+  if (full_range) {
+    return code / ((1 << bits) - 1);
+  }
+  return (code / (1 << (bits - 8)) - 16.0) / 219.0;
+}
+
+double CodeToChroma(double code, int bits, bool full_range) {
+  if (full_range) {
+    return (code - (1 << (bits - 1))) / ((1 << bits) - 1);
+  }
+  return (code / (1 << (bits - 8)) - 128.0) / 224.0;
+}
+
+double LumaToCode(double value, int bits, bool full_range) {
+  if (full_range) {
+    return value * ((1 << bits) - 1);
+  }
+  return (value * 219.0 + 16.0) * (1 << (bits - 8));
+}
+
+double ChromaToCode(double value, int bits, bool full_range) {
+  if (full_range) {
+    return value * ((1 << bits) - 1) + (1 << (bits - 1));
+  }
+  return (value * 224.0 + 128.0) * (1 << (bits - 8));
+}
+
+// Converts |width| pixels of full resolution Y, Cb and Cr codes through
+// the LUT.
+using ApplyFunction = void (*)(const int32_t* positions,
+                               const int16_t* nodes,
+                               int32_t max_code,
+                               const uint16_t* const src[3],
+                               uint16_t* const dst[3],
+                               int width);
+
+// Tetrahedral interpolation: the cube around a pixel is split into six
+// tetrahedra along its diagonal, the one of the pixel goes from the first
+// node along the axis of the largest fraction, then along the second
+// largest to the opposite node. Ties give the ambiguous nodes no weight.
+// The nodes may be out of the code range, the results are clamped to it.
+void ApplyScalarRange(const int32_t* positions,
+                      const int16_t* nodes,
+                      int32_t max_code,
+                      const uint16_t* const src[3],
+                      uint16_t* const dst[3],
+                      int begin,
+                      int width) {
+  const int32_t one = 1 << kFracBits;
+  const int32_t round = 1 << (kFracBits + kCodeFracBits - 1);
+  for (int x = begin; x < width; x++) {
+    int32_t p[3];
+    int32_t f[3];
+    for (int c = 0; c < 3; c++) {
+      p[c] = positions[src[c][x]];
+      f[c] = p[c] & 0xffff;
+    }
+    const int16_t* n0 = nodes + (p[0] >> 16) * kStrideY +
+                        (p[1] >> 16) * kStrideU + (p[2] >> 16) * kStrideV;
+    const int32_t f_max = std::max(f[0], std::max(f[1], f[2]));
+    const int32_t f_min = std::min(f[0], std::min(f[1], f[2]));
+    const int32_t f_mid = f[0] + f[1] + f[2] - f_max - f_min;
+    const int32_t a = f[0] >= f[1] && f[0] >= f[2]
+                          ? kStrideY
+                          : (f[1] >= f[2] ? kStrideU : kStrideV);
+    const int32_t min_stride = f[2] <= f[1] && f[2] <= f[0]
+                                   ? kStrideV
+                                   : (f[1] <= f[0] ? kStrideU : kStrideY);
+    const int32_t b = kStrideY + kStrideU + kStrideV - min_stride;
+    const int16_t* na = n0 + a;
+    const int16_t* nb = n0 + b;
+    const int16_t* n1 = n0 + kStrideY + kStrideU + kStrideV;
+    for (int c = 0; c < 3; c++) {
+      int32_t sum = round + n0[c] * (one - f_max) + na[c] * (f_max - f_mid) +
+                    nb[c] * (f_mid - f_min) + n1[c] * f_min;
+      sum >>= kFracBits + kCodeFracBits;
+      dst[c][x] = static_cast<uint16_t>(std::min(std::max(sum, 0), max_code));
+    }
+  }
+}
+
+void ApplyScalar(const int32_t* positions,
+                 const int16_t* nodes,
+                 int32_t max_code,
+                 const uint16_t* const src[3],
+                 uint16_t* const dst[3],
+                 int width) {
+  ApplyScalarRange(positions, nodes, max_code, src, dst, 0, width);
+}
+
+#if defined(AVE_TRANSFORM_X86)
+
+#define AVE_TRANSFORM_AVX2 __attribute__((target("avx2")))
+
+// Eight pixels at a time, the positions and the nodes are gathered. A node
+// is read as two ints, Y and Cb, then Cr and the padding.
+AVE_TRANSFORM_AVX2 void ApplyAVX2(const int32_t* positions,
+                                  const int16_t* nodes,
+                                  int32_t max_code,
+                                  const uint16_t* const src[3],
+                                  uint16_t* const dst[3],
+                                  int width) {
+  const __m256i low = _mm256_set1_epi32(0xffff);
+  const __m256i max = _mm256_set1_epi32(max_code);
+  const __m256i one = _mm256_set1_epi32(1 << kFracBits);
+  const __m256i round =
+      _mm256_set1_epi32(1 << (kFracBits + kCodeFracBits - 1));
+  // in bytes
+  const __m256i stride_y = _mm256_set1_epi32(kStrideY * 2);
+  const __m256i stride_u = _mm256_set1_epi32(kStrideU * 2);
+  const __m256i stride_v = _mm256_set1_epi32(kStrideV * 2);
+  const __m256i stride_all =
+      _mm256_set1_epi32((kStrideY + kStrideU + kStrideV) * 2);
+  const int* first = reinterpret_cast<const int*>(nodes);
+  const int* second = reinterpret_cast<const int*>(nodes + 2);
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m256i p[3];
+    __m256i f[3];
+    for (int c = 0; c < 3; c++) {
+      __m256i codes = _mm256_cvtepu16_epi32(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[c] + x)));
+      p[c] = _mm256_i32gather_epi32(positions, codes, 4);
+      f[c] = _mm256_and_si256(p[c], low);
+    }
+    __m256i offset = _mm256_add_epi32(
+        _mm256_add_epi32(
+            _mm256_mullo_epi32(_mm256_srli_epi32(p[0], 16), stride_y),
+            _mm256_mullo_epi32(_mm256_srli_epi32(p[1], 16), stride_u)),
+        _mm256_mullo_epi32(_mm256_srli_epi32(p[2], 16), stride_v));
+
+    __m256i f_max = _mm256_max_epi32(f[0], _mm256_max_epi32(f[1], f[2]));
+    __m256i f_min = _mm256_min_epi32(f[0], _mm256_min_epi32(f[1], f[2]));
+    __m256i f_mid = _mm256_sub_epi32(
+        _mm256_add_epi32(f[0], _mm256_add_epi32(f[1], f[2])),
+        _mm256_add_epi32(f_max, f_min));
+    // the same choices as the scalar loop
+    __m256i y_not_max = _mm256_or_si256(_mm256_cmpgt_epi32(f[1], f[0]),
+                                        _mm256_cmpgt_epi32(f[2], f[0]));
+    __m256i a = _mm256_blendv_epi8(
+        stride_y,
+        _mm256_blendv_epi8(stride_u, stride_v, _mm256_cmpgt_epi32(f[2], f[1])),
+        y_not_max);
+    __m256i v_not_min = _mm256_or_si256(_mm256_cmpgt_epi32(f[2], f[1]),
+                                        _mm256_cmpgt_epi32(f[2], f[0]));
+    __m256i min_stride = _mm256_blendv_epi8(
+        stride_v,
+        _mm256_blendv_epi8(stride_u, stride_y, _mm256_cmpgt_epi32(f[1], f[0])),
+        v_not_min);
+    __m256i b = _mm256_sub_epi32(stride_all, min_stride);
+
+    const __m256i offsets[4] = {offset, _mm256_add_epi32(offset, a),
+                                _mm256_add_epi32(offset, b),
+                                _mm256_add_epi32(offset, stride_all)};
+    const __m256i weights[4] = {_mm256_sub_epi32(one, f_max),
+                                _mm256_sub_epi32(f_max, f_mid),
+                                _mm256_sub_epi32(f_mid, f_min), f_min};
+    __m256i sums[3] = {round, round, round};
+    for (int i = 0; i < 4; i++) {
+      __m256i yu = _mm256_i32gather_epi32(first, offsets[i], 1);
+      __m256i v = _mm256_i32gather_epi32(second, offsets[i], 1);
+      // sign extended
+      const __m256i values[3] = {
+          _mm256_srai_epi32(_mm256_slli_epi32(yu, 16), 16),
+          _mm256_srai_epi32(yu, 16),
+          _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16)};
+      for (int c = 0; c < 3; c++) {
+        sums[c] = _mm256_add_epi32(sums[c],
+                                   _mm256_mullo_epi32(values[c], weights[i]));
+      }
+    }
+    for (int c = 0; c < 3; c++) {
+      __m256i codes = _mm256_min_epi32(
+          _mm256_srai_epi32(sums[c], kFracBits + kCodeFracBits), max);
+      codes = _mm256_permute4x64_epi64(_mm256_packus_epi32(codes, codes),
+                                       0x08);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[c] + x),
+                       _mm256_castsi256_si128(codes));
+    }
+  }
+  ApplyScalarRange(positions, nodes, max_code, src, dst, x, width);
+}
+
+#undef AVE_TRANSFORM_AVX2
+
+#endif
+
+#if defined(AVE_TRANSFORM_NEON)
+
+// A pixel at a time with Y, Cb and Cr of a node in a vector.
+void ApplyNEON(const int32_t* positions,
+               const int16_t* nodes,
+               int32_t max_code,
+               const uint16_t* const src[3],
+               uint16_t* const dst[3],
+               int width) {
+  const int32_t one = 1 << kFracBits;
+  const uint16x4_t max = vdup_n_u16(static_cast<uint16_t>(max_code));
+  for (int x = 0; x < width; x++) {
+    int32_t p[3];
+    int32_t f[3];
+    for (int c = 0; c < 3; c++) {
+      p[c] = positions[src[c][x]];
+      f[c] = p[c] & 0xffff;
+    }
+    const int16_t* n0 = nodes + (p[0] >> 16) * kStrideY +
+                        (p[1] >> 16) * kStrideU + (p[2] >> 16) * kStrideV;
+    const int32_t f_max = std::max(f[0], std::max(f[1], f[2]));
+    const int32_t f_min = std::min(f[0], std::min(f[1], f[2]));
+    const int32_t f_mid = f[0] + f[1] + f[2] - f_max - f_min;
+    const int32_t a = f[0] >= f[1] && f[0] >= f[2]
+                          ? kStrideY
+                          : (f[1] >= f[2] ? kStrideU : kStrideV);
+    const int32_t min_stride = f[2] <= f[1] && f[2] <= f[0]
+                                   ? kStrideV
+                                   : (f[1] <= f[0] ? kStrideU : kStrideY);
+    const int32_t b = kStrideY + kStrideU + kStrideV - min_stride;
+    int32x4_t sum = vmull_n_s16(vld1_s16(n0), one - f_max);
+    sum = vmlal_n_s16(sum, vld1_s16(n0 + a), f_max - f_mid);
+    sum = vmlal_n_s16(sum, vld1_s16(n0 + b), f_mid - f_min);
+    sum = vmlal_n_s16(sum, vld1_s16(n0 + kStrideY + kStrideU + kStrideV),
+                      f_min);
+    uint16x4_t codes =
+        vmin_u16(vqrshrun_n_s32(sum, kFracBits + kCodeFracBits), max);
+    dst[0][x] = vget_lane_u16(codes, 0);
+    dst[1][x] = vget_lane_u16(codes, 1);
+    dst[2][x] = vget_lane_u16(codes, 2);
+  }
+}
+
+#endif
+
+// Converts the rows [|begin|, |end|) of |src| into |dst|, |begin| even.
+void TransformRows(const FrameView& src,
+                   const TransformFormat& src_format,
+                   const FrameView& dst,
+                   const TransformFormat& dst_format,
+                   const int32_t* positions,
+                   const int16_t* nodes,
+                   int32_t max_code,
+                   ApplyFunction apply,
+                   uint32_t begin,
+                   uint32_t end) {
+  const uint32_t width = src.width();
+  const uint32_t chroma_width = (width + 1) / 2;
+  std::vector<uint16_t> in(3 * width);
+  std::vector<uint16_t> out(3 * width);
+  std::vector<uint32_t> sums(2 * chroma_width);
+  const uint16_t* const in_rows[3] = {&in[0], &in[width], &in[2 * width]};
+  uint16_t* const out_rows[3] = {&out[0], &out[width], &out[2 * width]};
+  const FrameView::Plane& src_luma = src.plane(0);
+  const FrameView::Plane& dst_luma = dst.plane(0);
+
+  for (uint32_t y = begin; y < end; y += 2) {
+    const uint32_t rows = std::min(2u, end - y);
+    const uint32_t chroma_y = y / 2;
+    // the chroma of the pixels, the same in both rows
+    for (uint32_t x = 0; x < chroma_width; x++) {
+      for (int c = 0; c < 2; c++) {
+        uint16_t sample =
+            LoadSample(ChromaSample(src, src_format, c, x, chroma_y),
+                       src_format);
+        in[(c + 1) * width + 2 * x] = sample;
+        if (2 * x + 1 < width) {
+          in[(c + 1) * width + 2 * x + 1] = sample;
+        }
+      }
+    }
+    std::fill(sums.begin(), sums.end(), 0);
+    for (uint32_t r = 0; r < rows; r++) {
+      const uint8_t* src_row = src_luma.row(y + r);
+      for (uint32_t x = 0; x < width; x++) {
+        in[x] = LoadSample(src_row + x * src_luma.col_inc, src_format);
+      }
+      apply(positions, nodes, max_code, in_rows, out_rows,
+            static_cast<int>(width));
+      uint8_t* dst_row = dst_luma.row(y + r);
+      for (uint32_t x = 0; x < width; x++) {
+        StoreSample(dst_row + x * dst_luma.col_inc, out[x], dst_format);
+        sums[x / 2] += out[width + x];
+        sums[chroma_width + x / 2] += out[2 * width + x];
+      }
+    }
+    for (uint32_t x = 0; x < chroma_width; x++) {
+      const uint32_t count = rows * (2 * x + 1 < width ? 2 : 1);
+      for (int c = 0; c < 2; c++) {
+        uint32_t sum = sums[c * chroma_width + x];
+        StoreSample(ChromaSample(dst, dst_format, c, x, chroma_y),
+                    static_cast<uint16_t>((sum + count / 2) / count),
+                    dst_format);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+// The conversion of normalized Y'CbCr, in double precision.
+struct ColorTransform::Pipeline {
+  double src_kr;
+  double src_kb;
+  double dst_kr;
+  double dst_kb;
+  bool src_full_range;
+  bool dst_full_range;
+  ColorAspects::Transfer src_transfer;
+  ColorAspects::Transfer dst_transfer;
+  // linear RGB of the source primaries to the destination ones
+  bool convert_gamut;
+  Matrix3 gamut;
+  // luminance of linear RGB, for the HLG OOTF
+  double src_luminance[3];
+  double dst_luminance[3];
+  // the HLG display peak and its system gamma
+  double hlg_peak;
+  double hlg_gamma;
+  // in cd/m^2
+  double src_peak;
+  double dst_peak;
+  bool tone_mapping;
+  // the peaks in PQ
+  double src_peak_pq;
+  double dst_peak_pq;
+
+  // BT.2390 EETF, compresses the highlights above a knee in PQ.
+  double ToneMap(double nits) const;
+  void Map(const double in[3], double out[3]) const;
+};
+
+struct ColorTransform::Lut {
+  // (node << 16) | fraction of every source code, the same for all axes
+  std::vector<int32_t> positions;
+  // Y, Cb, Cr and 0 of every node, Y major, in destination codes with
+  // kCodeFracBits fractional bits. Not clamped to the codes, so the
+  // interpolation stays linear up to the edges of the range.
+  std::vector<int16_t> nodes;
+  int32_t max_code = 0;
+};
+
+struct ColorTransform::Kernels {
+  ApplyFunction apply;
+};
+
+double ColorTransform::Pipeline::ToneMap(double nits) const {
+  double e = std::min(NitsToPq(nits) / src_peak_pq, 1.0);
+  const double max_lum = dst_peak_pq / src_peak_pq;
+  const double knee = std::max(1.5 * max_lum - 0.5, 0.0);
+  if (e > knee) {
+    // a Hermite spline from the knee to the destination peak
+    double t = (e - knee) / (1.0 - knee);
+    double t2 = t * t;
+    double t3 = t2 * t;
+    e = (2 * t3 - 3 * t2 + 1) * knee + (t3 - 2 * t2 + t) * (1.0 - knee) +
+        (-2 * t3 + 3 * t2) * max_lum;
+  }
+  return PqToNits(e * src_peak_pq);
+}
+
+void ColorTransform::Pipeline::Map(const double in[3], double out[3]) const {
+  // to R'G'B'
+  double rgb[3];
+  rgb[0] = in[0] + 2 * (1 - src_kr) * in[2];
+  rgb[2] = in[0] + 2 * (1 - src_kb) * in[1];
+  rgb[1] = (in[0] - src_kr * rgb[0] - src_kb * rgb[2]) / (1 - src_kr - src_kb);
+
+  // to display light in cd/m^2
+  if (src_transfer == ColorAspects::TransferST2084) {
+    for (double& value : rgb) {
+      value = PqToNits(value);
+    }
+  } else if (src_transfer == ColorAspects::TransferHLG) {
+    for (double& value : rgb) {
+      value = HlgToScene(value);
+    }
+    double ys = src_luminance[0] * rgb[0] + src_luminance[1] * rgb[1] +
+                src_luminance[2] * rgb[2];
+    double scale = ys > 0 ? hlg_peak * std::pow(ys, hlg_gamma - 1) : 0.0;
+    for (double& value : rgb) {
+      value *= scale;
+    }
+  } else {
+    for (double& value : rgb) {
+      value = kSdrWhite * SdrToLinear(src_transfer, value);
+    }
+  }
+
+  if (tone_mapping) {
+    // of the largest component, which keeps the hue
+    double peak = std::max(rgb[0], std::max(rgb[1], rgb[2]));
+    if (peak > 0) {
+      double scale = ToneMap(peak) / peak;
+      for (double& value : rgb) {
+        value *= scale;
+      }
+    }
+  }
+  if (convert_gamut) {
+    double converted[3];
+    for (int i = 0; i < 3; i++) {
+      converted[i] = gamut[i][0] * rgb[0] + gamut[i][1] * rgb[1] +
+                     gamut[i][2] * rgb[2];
+    }
+    std::copy(converted, converted + 3, rgb);
+  }
+  if (convert_gamut || tone_mapping) {
+    for (double& value : rgb) {
+      value = std::min(std::max(value, 0.0), dst_peak);
+    }
+  }
+
+  // to the destination R'G'B'
+  if (dst_transfer == ColorAspects::TransferST2084) {
+    for (double& value : rgb) {
+      value = NitsToPq(value);
+    }
+  } else if (dst_transfer == ColorAspects::TransferHLG) {
+    double yd = dst_luminance[0] * rgb[0] + dst_luminance[1] * rgb[1] +
+                dst_luminance[2] * rgb[2];
+    double ys = yd > 0 ? std::pow(yd / hlg_peak, 1 / hlg_gamma) : 0.0;
+    double scale = ys > 0 ? 1 / (hlg_peak * std::pow(ys, hlg_gamma - 1)) : 0.0;
+    for (double& value : rgb) {
+      value = SceneToHlg(value * scale);
+    }
+  } else {
+    for (double& value : rgb) {
+      value = LinearToSdr(dst_transfer, value / kSdrWhite);
+    }
+  }
+
+  // to Y'CbCr
+  out[0] = dst_kr * rgb[0] + (1 - dst_kr - dst_kb) * rgb[1] + dst_kb * rgb[2];
+  out[1] = (rgb[2] - out[0]) / (2 * (1 - dst_kb));
+  out[2] = (rgb[0] - out[0]) / (2 * (1 - dst_kr));
+}
+
+ColorTransform::ColorTransform(const ColorAspects& src_aspects,
+                               const ColorAspects& dst_aspects,
+                               int32_t width,
+                               int32_t height,
+                               const HDRStaticInfo* hdr_info)
+    : init_check_(NO_INIT), kernels_(nullptr) {
+  ColorAspects src = src_aspects;
+  ColorAspects dst = dst_aspects;
+  ColorUtils::setDefaultCodecColorAspectsIfNeeded(src, width, height);
+  ColorUtils::setDefaultCodecColorAspectsIfNeeded(dst, width, height);
+
+  auto pipeline = std::make_unique<Pipeline>();
+  GetLumaWeights(src.mMatrixCoeffs, &pipeline->src_kr, &pipeline->src_kb);
+  GetLumaWeights(dst.mMatrixCoeffs, &pipeline->dst_kr, &pipeline->dst_kb);
+  pipeline->src_full_range = src.mRange == ColorAspects::RangeFull;
+  pipeline->dst_full_range = dst.mRange == ColorAspects::RangeFull;
+  pipeline->src_transfer = src.mTransfer;
+  pipeline->dst_transfer = dst.mTransfer;
+
+  const Chromaticities& src_primaries = GetChromaticities(src.mPrimaries);
+  const Chromaticities& dst_primaries = GetChromaticities(dst.mPrimaries);
+  Matrix3 src_to_xyz;
+  Matrix3 dst_to_xyz;
+  Matrix3 xyz_to_dst;
+  if (!RgbToXyz(src_primaries, src_to_xyz) ||
+      !RgbToXyz(dst_primaries, dst_to_xyz) ||
+      !Invert(dst_to_xyz, xyz_to_dst)) {
+    AVE_LOG(LS_ERROR) << "invalid primaries " << src.mPrimaries << " and "
+                      << dst.mPrimaries;
+    return;
+  }
+  pipeline->convert_gamut = &src_primaries != &dst_primaries;
+  Multiply(xyz_to_dst, src_to_xyz, pipeline->gamut);
+  for (int i = 0; i < 3; i++) {
+    pipeline->src_luminance[i] = src_to_xyz[1][i];
+    pipeline->dst_luminance[i] = dst_to_xyz[1][i];
+  }
+
+  double content_peak = kDefaultHdrPeak;
+  double display_peak = kDefaultHdrPeak;
+  if (hdr_info != nullptr && hdr_info->mID == HDRStaticInfo::kType1) {
+    const HDRStaticInfo::Type1& info = hdr_info->sType1;
+    if (info.mMaxDisplayLuminance > 0) {
+      display_peak = info.mMaxDisplayLuminance;
+      content_peak = display_peak;
+    }
+    if (info.mMaxContentLightLevel > 0) {
+      content_peak = info.mMaxContentLightLevel;
+    }
+  }
+  pipeline->hlg_peak = display_peak;
+  pipeline->hlg_gamma = 1.2 + 0.42 * std::log10(display_peak / 1000.0);
+  auto peak = [&](ColorAspects::Transfer transfer, bool source) {
+    switch (transfer) {
+      case ColorAspects::TransferST2084:
+        return source ? std::min(std::max(content_peak, kSdrWhite), kPqPeak)
+                      : kPqPeak;
+      case ColorAspects::TransferHLG:
+        return display_peak;
+      default:
+        return kSdrWhite;
+    }
+  };
+  pipeline->src_peak = peak(src.mTransfer, true);
+  pipeline->dst_peak = peak(dst.mTransfer, false);
+  pipeline->tone_mapping = pipeline->src_peak > pipeline->dst_peak;
+  pipeline->src_peak_pq = NitsToPq(pipeline->src_peak);
+  pipeline->dst_peak_pq = NitsToPq(pipeline->dst_peak);
+  pipeline_ = std::move(pipeline);
+
+  const Impl kPreferred[] = {Impl::kAVX2, Impl::kNEON, Impl::kScalar};
+  for (Impl impl : kPreferred) {
+    kernels_ = GetKernels(impl);
+    if (kernels_ != nullptr) {
+      break;
+    }
+  }
+  init_check_ = OK;
+}
+
+ColorTransform::~ColorTransform() = default;
+
+status_t ColorTransform::InitCheck() const {
+  return init_check_;
+}
+
+bool ColorTransform::tone_mapping() const {
+  return pipeline_ != nullptr && pipeline_->tone_mapping;
+}
+
+const ColorTransform::Kernels* ColorTransform::GetKernels(Impl impl) {
+  static const Kernels kScalar = {ApplyScalar};
+  switch (impl) {
+    case Impl::kScalar:
+      return &kScalar;
+#if defined(AVE_TRANSFORM_X86)
+    case Impl::kAVX2: {
+      static const Kernels kAVX2 = {ApplyAVX2};
+      return __builtin_cpu_supports("avx2") ? &kAVX2 : nullptr;
+    }
+#endif
+#if defined(AVE_TRANSFORM_NEON)
+    case Impl::kNEON: {
+      static const Kernels kNEON = {ApplyNEON};
+      return &kNEON;
+    }
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+status_t ColorTransform::SetImplForTesting(Impl impl) {
+  const Kernels* kernels = GetKernels(impl);
+  if (kernels == nullptr) {
+    return ERROR_UNSUPPORTED;
+  }
+  kernels_ = kernels;
+  return OK;
+}
+
+const ColorTransform::Lut& ColorTransform::GetLut(int src_bits,
+                                                  int dst_bits) {
+  std::unique_ptr<Lut>& lut = luts_[src_bits > 8][dst_bits > 8];
+  if (lut != nullptr) {
+    return *lut;
+  }
+
+  lut = std::make_unique<Lut>();
+  const int32_t src_max = (1 << src_bits) - 1;
+  const int32_t dst_max = ((1 << dst_bits) - 1) << kCodeFracBits;
+  lut->max_code = (1 << dst_bits) - 1;
+  lut->positions.resize(src_max + 1);
+  for (int32_t code = 0; code <= src_max; code++) {
+    int32_t position = static_cast<int32_t>(
+        ((int64_t{code} * (kLutSize - 1) << kFracBits) + src_max / 2) /
+        src_max);
+    // the last code is the end of the last cube
+    int32_t node = std::min(position >> kFracBits, kLutSize - 2);
+    lut->positions[code] = node << 16 | (position - (node << kFracBits));
+  }
+
+  const Pipeline& p = *pipeline_;
+  lut->nodes.resize(size_t{kLutSize} * kLutSize * kLutSize * 4);
+  int16_t* node = lut->nodes.data();
+  for (int32_t y = 0; y < kLutSize; y++) {
+    for (int32_t u = 0; u < kLutSize; u++) {
+      for (int32_t v = 0; v < kLutSize; v++) {
+        const double step = static_cast<double>(src_max) / (kLutSize - 1);
+        const double in[3] = {
+            CodeToLuma(y * step, src_bits, p.src_full_range),
+            CodeToChroma(u * step, src_bits, p.src_full_range),
+            CodeToChroma(v * step, src_bits, p.src_full_range)};
+        double out[3];
+        p.Map(in, out);
+        const double codes[3] = {
+            LumaToCode(out[0], dst_bits, p.dst_full_range),
+            ChromaToCode(out[1], dst_bits, p.dst_full_range),
+            ChromaToCode(out[2], dst_bits, p.dst_full_range)};
+        for (int c = 0; c < 3; c++) {
+          double code = std::round(codes[c] * (1 << kCodeFracBits));
+          node[c] = static_cast<int16_t>(std::min(
+              std::max(code, -static_cast<double>(dst_max)), 2.0 * dst_max));
+        }
+        node[3] = 0;
+        node += 4;
+      }
+    }
+  }
+  return *lut;
+}
+
+status_t ColorTransform::Transform(const FrameView& src,
+                                   const FrameView& dst,
+                                   WorkerPool* pool) {
+  if (init_check_ != OK) {
+    return init_check_;
+  }
+  if (!src.valid() || !dst.valid() || src.width() != dst.width() ||
+      src.height() != dst.height()) {
+    AVE_LOG(LS_ERROR) << "can not transform the colors of "
+                      << src.width() << "x" << src.height() << " into "
+                      << dst.width() << "x" << dst.height();
+    return BAD_VALUE;
+  }
+  const TransformFormat* src_format = FindFormat(src);
+  const TransformFormat* dst_format = FindFormat(dst);
+  if (src_format == nullptr || dst_format == nullptr) {
+    AVE_LOG(LS_ERROR) << "can not transform the colors of pixel format "
+                      << src.format() << " into " << dst.format();
+    return ERROR_UNSUPPORTED;
+  }
+
+  const Lut& lut = GetLut(src_format->bits, dst_format->bits);
+  const ApplyFunction apply = kernels_->apply;
+  const uint32_t height = src.height();
+  const size_t bands = (height + kBandRows - 1) / kBandRows;
+  ParallelFor(pool, bands, [&](size_t index) {
+    uint32_t begin = static_cast<uint32_t>(index) * kBandRows;
+    TransformRows(src, *src_format, dst, *dst_format, lut.positions.data(),
+                  lut.nodes.data(), lut.max_code, apply, begin,
+                  std::min(begin + kBandRows, height));
+  });
+  return OK;
+}
+
+status_t ColorTransform::Transform(MediaPacket& src,
+                                   MediaPacket& dst,
+                                   WorkerPool* pool) {
+  FrameView in = FrameView::Create(src);
+  VideoSampleInfo* info = dst.video_info();
+  if (!in.valid() || info == nullptr) {
+    AVE_LOG(LS_ERROR) << "can not transform, the packets are no video frames";
+    return BAD_VALUE;
+  }
+
+  status_t err = FrameView::PrepareOutput(src, dst, info->pixel_format,
+                                          in.width(), in.height());
+  if (err != OK) {
+    return err;
+  }
+
+  FrameView out = FrameView::Create(dst);
+  return Transform(in, out, pool);
+}
+
+}  // namespace ave
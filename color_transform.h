@@ -0,0 +1,107 @@
+/*
+ * color_transform.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef COLOR_TRANSFORM_H
+#define COLOR_TRANSFORM_H
+
+#include <cstdint>
+#include <memory>
+
+#include "base/constructor_magic.h"
+#include "base/types.h"
+
+#include "frame_view.h"
+#include "media/hardware/video_api.h"
+#include "media_errors.h"
+
+namespace ave {
+
+class MediaPacket;
+class WorkerPool;
+
+// Converts the pixels of video frames from one ColorAspects to another:
+// the primaries (e.g. BT.2020 to BT.709, out of gamut colors are clipped),
+// the transfer, tone mapping PQ and HLG to SDR with the BT.2390 EETF, and
+// the matrix and range.
+//
+// The whole conversion is baked into a 3D LUT of Y'CbCr with 33 nodes per
+// axis, built on first use for every pair of bit depths, and applied with
+// tetrahedral interpolation. SDR white is 203 cd/m^2 as in BT.2408, so an
+// SDR frame keeps its brightness in a PQ or HLG one and back.
+//
+// Supported are 4:2:0 frames of YUV420P, NV12, NV21, YUV420P10LE and
+// P010LE in any combination. The chroma of a 2x2 block is the average of
+// the converted chroma of its four pixels.
+//
+// Transform() may be called from one thread at a time.
+class ColorTransform {
+ public:
+  // The unspecified fields of the aspects are defaulted for a |width| x
+  // |height| frame by ColorUtils::setDefaultCodecColorAspectsIfNeeded().
+  // |hdr_info| gives the peak of PQ content, the max content light level
+  // or else the mastering display's, and the display peak of HLG; 1000
+  // cd/m^2 without it.
+  ColorTransform(const ColorAspects& src_aspects,
+                 const ColorAspects& dst_aspects,
+                 int32_t width,
+                 int32_t height,
+                 const HDRStaticInfo* hdr_info = nullptr);
+  ~ColorTransform();
+
+  status_t InitCheck() const;
+
+  // Converts |src| into |dst|, which must have the same size. With a |pool|
+  // the frame is split into bands of rows converted in parallel, the
+  // output does not depend on it.
+  status_t Transform(const FrameView& src,
+                     const FrameView& dst,
+                     WorkerPool* pool = nullptr);
+
+  // Converts the frame described by the VideoSampleInfo of |src| into the
+  // pixel format of |dst|'s. The other fields of |dst|'s VideoSampleInfo
+  // are taken from |src|, a stride of 0 or less packs the rows tightly.
+  // |dst| grows if it is too small and can.
+  status_t Transform(MediaPacket& src,
+                     MediaPacket& dst,
+                     WorkerPool* pool = nullptr);
+
+  // Whether the source peak is above the destination's and compressed.
+  bool tone_mapping() const;
+
+  enum class Impl {
+    kScalar,
+    kAVX2,
+    kNEON,
+  };
+
+  // Uses the kernels of |impl| from now on, ERROR_UNSUPPORTED if they are
+  // not built in or not supported by this CPU. All implementations give
+  // the same pixels. For tests and benchmarks.
+  status_t SetImplForTesting(Impl impl);
+
+ private:
+  struct Pipeline;
+  struct Lut;
+  struct Kernels;
+
+  static const Kernels* GetKernels(Impl impl);
+
+  // The LUT from |src_bits| to |dst_bits| samples, built if needed.
+  const Lut& GetLut(int src_bits, int dst_bits);
+
+  status_t init_check_;
+  std::unique_ptr<Pipeline> pipeline_;
+  // of 8 and 10 bit sources and destinations
+  std::unique_ptr<Lut> luts_[2][2];
+  const Kernels* kernels_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(ColorTransform);
+};
+
+}  // namespace ave
+
+#endif /* !COLOR_TRANSFORM_H */
@@ -7,6 +7,8 @@
 
 #include "color_utils.h"
 
+#include <array>
+
 #include "base/checks.h"
 #include "base/logging.h"
 
@@ -22,37 +24,50 @@ typedef ColorUtils CU;
 #define HI_UINT16(a) (((a) >> 8) & 0xFF)
 #define LO_UINT16(a) ((a) & 0xFF)
 
-const static Lookup<CU::ColorRange, CA::Range> sRanges{{
+namespace {
+
+// An entry of the tables below. When mapping either way, the first entry
+// with the value wins.
+template <typename A, typename B>
+struct Mapping {
+  A first;
+  B second;
+};
+
+struct StandardAspects {
+  CA::Primaries primaries;
+  CA::MatrixCoeffs coeffs;
+};
+
+constexpr Mapping<CU::ColorRange, CA::Range> kRanges[] = {
     {CU::kColorRangeLimited, CA::RangeLimited},
     {CU::kColorRangeFull, CA::RangeFull},
     {CU::kColorRangeUnspecified, CA::RangeUnspecified},
-}};
-
-const static Lookup<CU::ColorStandard,
-                    std::pair<CA::Primaries, CA::MatrixCoeffs>>
-    sStandards{{
-        {CU::kColorStandardUnspecified,
-         {CA::PrimariesUnspecified, CA::MatrixUnspecified}},
-        {CU::kColorStandardBT709, {CA::PrimariesBT709_5, CA::MatrixBT709_5}},
-        {CU::kColorStandardBT601_625,
-         {CA::PrimariesBT601_6_625, CA::MatrixBT601_6}},
-        {CU::kColorStandardBT601_625_Unadjusted,
-         // this is a really close match
-         {CA::PrimariesBT601_6_625, CA::MatrixBT709_5}},
-        {CU::kColorStandardBT601_525,
-         {CA::PrimariesBT601_6_525, CA::MatrixBT601_6}},
-        {CU::kColorStandardBT601_525_Unadjusted,
-         {CA::PrimariesBT601_6_525, CA::MatrixSMPTE240M}},
-        {CU::kColorStandardBT2020, {CA::PrimariesBT2020, CA::MatrixBT2020}},
-        {CU::kColorStandardBT2020Constant,
-         {CA::PrimariesBT2020, CA::MatrixBT2020Constant}},
-        {CU::kColorStandardBT470M, {CA::PrimariesBT470_6M, CA::MatrixBT470_6M}},
-        // NOTE: there is no close match to the matrix used by standard film,
-        // chose closest
-        {CU::kColorStandardFilm, {CA::PrimariesGenericFilm, CA::MatrixBT2020}},
-    }};
-
-const static Lookup<CU::ColorTransfer, CA::Transfer> sTransfers{{
+};
+
+constexpr Mapping<CU::ColorStandard, StandardAspects> kStandards[] = {
+    {CU::kColorStandardUnspecified,
+     {CA::PrimariesUnspecified, CA::MatrixUnspecified}},
+    {CU::kColorStandardBT709, {CA::PrimariesBT709_5, CA::MatrixBT709_5}},
+    {CU::kColorStandardBT601_625,
+     {CA::PrimariesBT601_6_625, CA::MatrixBT601_6}},
+    {CU::kColorStandardBT601_625_Unadjusted,
+     // this is a really close match
+     {CA::PrimariesBT601_6_625, CA::MatrixBT709_5}},
+    {CU::kColorStandardBT601_525,
+     {CA::PrimariesBT601_6_525, CA::MatrixBT601_6}},
+    {CU::kColorStandardBT601_525_Unadjusted,
+     {CA::PrimariesBT601_6_525, CA::MatrixSMPTE240M}},
+    {CU::kColorStandardBT2020, {CA::PrimariesBT2020, CA::MatrixBT2020}},
+    {CU::kColorStandardBT2020Constant,
+     {CA::PrimariesBT2020, CA::MatrixBT2020Constant}},
+    {CU::kColorStandardBT470M, {CA::PrimariesBT470_6M, CA::MatrixBT470_6M}},
+    // NOTE: there is no close match to the matrix used by standard film,
+    // chose closest
+    {CU::kColorStandardFilm, {CA::PrimariesGenericFilm, CA::MatrixBT2020}},
+};
+
+constexpr Mapping<CU::ColorTransfer, CA::Transfer> kTransfers[] = {
     {CU::kColorTransferUnspecified, CA::TransferUnspecified},
     {CU::kColorTransferLinear, CA::TransferLinear},
     {CU::kColorTransferSRGB, CA::TransferSRGB},
@@ -61,42 +76,239 @@ const static Lookup<CU::ColorTransfer, CA::Transfer> sTransfers{{
     {CU::kColorTransferGamma28, CA::TransferGamma28},
     {CU::kColorTransferST2084, CA::TransferST2084},
     {CU::kColorTransferHLG, CA::TransferHLG},
-}};
+};
+
+constexpr Mapping<int32_t, CA::Primaries> kIsoPrimaries[] = {
+    {1, CA::PrimariesBT709_5},
+    {2, CA::PrimariesUnspecified},
+    {4, CA::PrimariesBT470_6M},
+    {5, CA::PrimariesBT601_6_625},
+    {6, CA::PrimariesBT601_6_525 /* main */},
+    {7, CA::PrimariesBT601_6_525},
+    // -- ITU T.832 201201 ends here
+    {8, CA::PrimariesGenericFilm},
+    {9, CA::PrimariesBT2020},
+    {10, CA::PrimariesOther /* XYZ */},
+};
+
+constexpr Mapping<int32_t, CA::Transfer> kIsoTransfers[] = {
+    {1, CA::TransferSMPTE170M /* main */},
+    {2, CA::TransferUnspecified},
+    {4, CA::TransferGamma22},
+    {5, CA::TransferGamma28},
+    {6, CA::TransferSMPTE170M},
+    {7, CA::TransferSMPTE240M},
+    {8, CA::TransferLinear},
+    {9, CA::TransferOther /* log 100:1 */},
+    {10, CA::TransferOther /* log 316:1 */},
+    {11, CA::TransferXvYCC},
+    {12, CA::TransferBT1361},
+    {13, CA::TransferSRGB},
+    // -- ITU T.832 201201 ends here
+    {14, CA::TransferSMPTE170M},
+    {15, CA::TransferSMPTE170M},
+    {16, CA::TransferST2084},
+    {17, CA::TransferST428},
+    {18, CA::TransferHLG},
+};
+
+constexpr Mapping<int32_t, CA::MatrixCoeffs> kIsoMatrixCoeffs[] = {
+    {0, CA::MatrixOther},
+    {1, CA::MatrixBT709_5},
+    {2, CA::MatrixUnspecified},
+    {4, CA::MatrixBT470_6M},
+    {6, CA::MatrixBT601_6 /* main */},
+    {5, CA::MatrixBT601_6},
+    {7, CA::MatrixSMPTE240M},
+    {8, CA::MatrixOther /* YCgCo */},
+    // -- ITU T.832 201201 ends here
+    {9, CA::MatrixBT2020},
+    {10, CA::MatrixBT2020Constant},
+};
+
+constexpr bool isValid(CA::Primaries p) {
+  return p <= CA::PrimariesOther;
+}
+
+constexpr bool isDefined(CA::Primaries p) {
+  return p <= CA::PrimariesBT2020;
+}
+
+constexpr bool isValid(CA::MatrixCoeffs c) {
+  return c <= CA::MatrixOther;
+}
 
-static bool isValid(ColorAspects::Primaries p) {
-  return p <= ColorAspects::PrimariesOther;
+constexpr bool isDefined(CA::MatrixCoeffs c) {
+  return c <= CA::MatrixBT2020Constant;
 }
 
-static bool isDefined(ColorAspects::Primaries p) {
-  return p <= ColorAspects::PrimariesBT2020;
+constexpr bool isValid(CA::Range r) {
+  return r <= CA::RangeOther;
 }
 
-static bool isValid(ColorAspects::MatrixCoeffs c) {
-  return c <= ColorAspects::MatrixOther;
+constexpr bool isValid(CA::Transfer t) {
+  return t <= CA::TransferOther;
 }
 
-static bool isDefined(ColorAspects::MatrixCoeffs c) {
-  return c <= ColorAspects::MatrixBT2020Constant;
+constexpr bool isDefined(CA::Transfer t) {
+  return t <= CA::TransferHLG ||
+         (t >= CA::TransferSMPTE240M && t <= CA::TransferST428);
 }
 
+// The tables above are turned into dense arrays at compile time, indexed by
+// the values they map from, so that a conversion is an array load. Valid
+// aspects are below 0x100, the platform and ISO values of the tables are
+// below 0x20.
+constexpr size_t kNumAspectValues = 0x100;
+constexpr size_t kNumTableValues = 0x20;
+
+constexpr uint32_t kNumDefinedPrimaries = CA::PrimariesBT2020 + 1;
+constexpr uint32_t kNumDefinedCoeffs = CA::MatrixBT2020Constant + 1;
+
+template <typename T>
+struct Found {
+  T value;
+  bool found;
+};
+
+template <size_t N, typename A, typename B, size_t M>
+constexpr std::array<Found<B>, N> mapFirst(const Mapping<A, B> (&table)[M]) {
+  std::array<Found<B>, N> res{};
+  // backwards, so that the first entry of a value is written last
+  for (size_t i = M; i-- > 0;) {
+    size_t key = static_cast<size_t>(table[i].first);
+    if (key < N) {
+      res[key] = {table[i].second, true};
+    }
+  }
+  return res;
+}
+
+template <size_t N, typename A, typename B, size_t M>
+constexpr std::array<Found<A>, N> mapSecond(const Mapping<A, B> (&table)[M]) {
+  std::array<Found<A>, N> res{};
+  for (size_t i = M; i-- > 0;) {
+    size_t key = static_cast<size_t>(table[i].second);
+    if (key < N) {
+      res[key] = {table[i].first, true};
+    }
+  }
+  return res;
+}
+
+// platform and ISO values to aspects
+constexpr auto kRangeAspects = mapFirst<kNumTableValues>(kRanges);
+constexpr auto kStandardAspects = mapFirst<kNumTableValues>(kStandards);
+constexpr auto kTransferAspects = mapFirst<kNumTableValues>(kTransfers);
+constexpr auto kIsoPrimaryAspects = mapFirst<kNumTableValues>(kIsoPrimaries);
+constexpr auto kIsoTransferAspects = mapFirst<kNumTableValues>(kIsoTransfers);
+constexpr auto kIsoCoeffAspects = mapFirst<kNumTableValues>(kIsoMatrixCoeffs);
+
+// The entry of |table| for |value|, nullptr if there is none.
+template <typename T, size_t N>
+const T* find(const std::array<Found<T>, N>& table, int32_t value) {
+  if (value < 0 || static_cast<size_t>(value) >= N || !table[value].found) {
+    return nullptr;
+  }
+  return &table[value].value;
+}
+
+constexpr std::array<int32_t, kNumAspectValues> makePlatformRanges() {
+  auto ranges = mapSecond<kNumAspectValues>(kRanges);
+  std::array<int32_t, kNumAspectValues> res{};
+  for (size_t i = 0; i < kNumAspectValues; ++i) {
+    // all platform values are in kRanges
+    res[i] = ranges[i].found ? ranges[i].value
+                             : CU::kColorRangeVendorStart + (int32_t)i;
+  }
+  return res;
+}
+
+constexpr std::array<int32_t, kNumAspectValues> makePlatformTransfers() {
+  auto transfers = mapSecond<kNumAspectValues>(kTransfers);
+  std::array<int32_t, kNumAspectValues> res{};
+  for (size_t i = 0; i < kNumAspectValues; ++i) {
+    if (transfers[i].found) {
+      res[i] = transfers[i].value;
+    } else if (isDefined((CA::Transfer)i)) {
+      res[i] = CU::kColorTransferExtendedStart + (int32_t)i;
+    } else {
+      res[i] = CU::kColorTransferVendorStart + (int32_t)i;
+    }
+  }
+  return res;
+}
+
+// of the defined primaries and coeffs, the others are all vendor values
+struct PlatformStandards {
+  int32_t standards[kNumDefinedCoeffs][kNumDefinedPrimaries];
+};
+
+constexpr PlatformStandards makePlatformStandards() {
+  PlatformStandards res{};
+  for (uint32_t c = 0; c < kNumDefinedCoeffs; ++c) {
+    for (uint32_t p = 0; p < kNumDefinedPrimaries; ++p) {
+      res.standards[c][p] =
+          CU::kColorStandardExtendedStart + p + c * kNumDefinedPrimaries;
+    }
+  }
+  for (size_t i = sizeof(kStandards) / sizeof(kStandards[0]); i-- > 0;) {
+    const StandardAspects& aspects = kStandards[i].second;
+    res.standards[aspects.coeffs][aspects.primaries] = kStandards[i].first;
+  }
+  return res;
+}
+
+// The ISO value of every aspect value. Other and the values without one
+// get the one of Unspecified.
+template <typename B, size_t M>
+constexpr std::array<int32_t, kNumAspectValues> makeIsoValues(
+    const Mapping<int32_t, B> (&table)[M],
+    B unspecified,
+    B other) {
+  auto values = mapSecond<kNumAspectValues>(table);
+  std::array<int32_t, kNumAspectValues> res{};
+  for (size_t i = 0; i < kNumAspectValues; ++i) {
+    res[i] = i != other && values[i].found ? values[i].value
+                                           : values[unspecified].value;
+  }
+  return res;
+}
+
+constexpr auto kPlatformRanges = makePlatformRanges();
+constexpr auto kPlatformTransfers = makePlatformTransfers();
+constexpr PlatformStandards kPlatformStandards = makePlatformStandards();
+
+constexpr auto kIsoPrimaryValues = makeIsoValues(
+    kIsoPrimaries, CA::PrimariesUnspecified, CA::PrimariesOther);
+constexpr auto kIsoTransferValues = makeIsoValues(
+    kIsoTransfers, CA::TransferUnspecified, CA::TransferOther);
+constexpr auto kIsoCoeffValues = makeIsoValues(
+    kIsoMatrixCoeffs, CA::MatrixUnspecified, CA::MatrixOther);
+
+static_assert(kIsoPrimaryValues[CA::PrimariesOther] == 2 &&
+                  kIsoTransferValues[CA::TransferOther] == 2 &&
+                  kIsoCoeffValues[CA::MatrixOther] == 2,
+              "Unspecified must have an ISO value");
+
+// the standard of valid |primaries| and |coeffs|
+inline int32_t platformStandard(uint32_t primaries, uint32_t coeffs) {
+  if (primaries < kNumDefinedPrimaries && coeffs < kNumDefinedCoeffs) {
+    return kPlatformStandards.standards[coeffs][primaries];
+  }
+  return CU::kColorStandardVendorStart + primaries + coeffs * 0x100;
+}
+
+}  // namespace
+
 // static
 int32_t ColorUtils::wrapColorAspectsIntoColorStandard(
     ColorAspects::Primaries primaries,
     ColorAspects::MatrixCoeffs coeffs) {
-  ColorStandard res;
-  if (sStandards.map(std::make_pair(primaries, coeffs), &res)) {
-    return res;
-  } else if (!isValid(primaries) || !isValid(coeffs)) {
+  if (!isValid(primaries) || !isValid(coeffs)) {
     return kColorStandardUnspecified;
   }
-
-  // check platform media limits
-  uint32_t numPrimaries = ColorAspects::PrimariesBT2020 + 1;
-  if (isDefined(primaries) && isDefined(coeffs)) {
-    return kColorStandardExtendedStart + primaries + coeffs * numPrimaries;
-  } else {
-    return kColorStandardVendorStart + primaries + coeffs * 0x100;
-  }
+  return platformStandard(primaries, coeffs);
 }
 
 // static
@@ -104,10 +316,9 @@ status_t ColorUtils::unwrapColorAspectsFromColorStandard(
     int32_t standard,
     ColorAspects::Primaries* primaries,
     ColorAspects::MatrixCoeffs* coeffs) {
-  std::pair<ColorAspects::Primaries, ColorAspects::MatrixCoeffs> res;
-  if (sStandards.map((ColorStandard)standard, &res)) {
-    *primaries = res.first;
-    *coeffs = res.second;
+  if (const StandardAspects* res = find(kStandardAspects, standard)) {
+    *primaries = res->primaries;
+    *coeffs = res->coeffs;
     return OK;
   }
 
@@ -130,33 +341,20 @@ status_t ColorUtils::unwrapColorAspectsFromColorStandard(
   return BAD_VALUE;
 }
 
-static bool isValid(ColorAspects::Range r) {
-  return r <= ColorAspects::RangeOther;
-}
-
-static bool isDefined(ColorAspects::Range r) {
-  return r <= ColorAspects::RangeLimited;
-}
-
 //  static
 int32_t ColorUtils::wrapColorAspectsIntoColorRange(ColorAspects::Range range) {
-  ColorRange res;
-  if (sRanges.map(range, &res)) {
-    return res;
-  } else if (!isValid(range)) {
+  if (!isValid(range)) {
     return kColorRangeUnspecified;
-  } else {
-    AVE_CHECK(!isDefined(range));
-    // all platform values are in sRanges
-    return kColorRangeVendorStart + range;
   }
+  return kPlatformRanges[range];
 }
 
 // static
 status_t ColorUtils::unwrapColorAspectsFromColorRange(
     int32_t range,
     ColorAspects::Range* aspect) {
-  if (sRanges.map((ColorRange)range, aspect)) {
+  if (const ColorAspects::Range* res = find(kRangeAspects, range)) {
+    *aspect = *res;
     return OK;
   }
 
@@ -170,37 +368,21 @@ status_t ColorUtils::unwrapColorAspectsFromColorRange(
   return BAD_VALUE;
 }
 
-static bool isValid(ColorAspects::Transfer t) {
-  return t <= ColorAspects::TransferOther;
-}
-
-static bool isDefined(ColorAspects::Transfer t) {
-  return t <= ColorAspects::TransferHLG ||
-         (t >= ColorAspects::TransferSMPTE240M &&
-          t <= ColorAspects::TransferST428);
-}
-
 //  static
 int32_t ColorUtils::wrapColorAspectsIntoColorTransfer(
     ColorAspects::Transfer transfer) {
-  ColorTransfer res;
-  if (sTransfers.map(transfer, &res)) {
-    return res;
-  } else if (!isValid(transfer)) {
+  if (!isValid(transfer)) {
     return kColorTransferUnspecified;
-  } else if (isDefined(transfer)) {
-    return kColorTransferExtendedStart + transfer;
-  } else {
-    // all platform values are in sRanges
-    return kColorTransferVendorStart + transfer;
   }
+  return kPlatformTransfers[transfer];
 }
 
 // static
 status_t ColorUtils::unwrapColorAspectsFromColorTransfer(
     int32_t transfer,
     ColorAspects::Transfer* aspect) {
-  if (sTransfers.map((ColorTransfer)transfer, aspect)) {
+  if (const ColorAspects::Transfer* res = find(kTransferAspects, transfer)) {
+    *aspect = *res;
     return OK;
   }
 
@@ -250,53 +432,17 @@ status_t ColorUtils::convertCodecColorAspectsToPlatformAspects(
   }
 }
 
-const static Lookup<int32_t, ColorAspects::Primaries> sIsoPrimaries{{
-    {1, ColorAspects::PrimariesBT709_5},
-    {2, ColorAspects::PrimariesUnspecified},
-    {4, ColorAspects::PrimariesBT470_6M},
-    {5, ColorAspects::PrimariesBT601_6_625},
-    {6, ColorAspects::PrimariesBT601_6_525 /* main */},
-    {7, ColorAspects::PrimariesBT601_6_525},
-    // -- ITU T.832 201201 ends here
-    {8, ColorAspects::PrimariesGenericFilm},
-    {9, ColorAspects::PrimariesBT2020},
-    {10, ColorAspects::PrimariesOther /* XYZ */},
-}};
-
-const static Lookup<int32_t, ColorAspects::Transfer> sIsoTransfers{{
-    {1, ColorAspects::TransferSMPTE170M /* main */},
-    {2, ColorAspects::TransferUnspecified},
-    {4, ColorAspects::TransferGamma22},
-    {5, ColorAspects::TransferGamma28},
-    {6, ColorAspects::TransferSMPTE170M},
-    {7, ColorAspects::TransferSMPTE240M},
-    {8, ColorAspects::TransferLinear},
-    {9, ColorAspects::TransferOther /* log 100:1 */},
-    {10, ColorAspects::TransferOther /* log 316:1 */},
-    {11, ColorAspects::TransferXvYCC},
-    {12, ColorAspects::TransferBT1361},
-    {13, ColorAspects::TransferSRGB},
-    // -- ITU T.832 201201 ends here
-    {14, ColorAspects::TransferSMPTE170M},
-    {15, ColorAspects::TransferSMPTE170M},
-    {16, ColorAspects::TransferST2084},
-    {17, ColorAspects::TransferST428},
-    {18, ColorAspects::TransferHLG},
-}};
-
-const static Lookup<int32_t, ColorAspects::MatrixCoeffs> sIsoMatrixCoeffs{{
-    {0, ColorAspects::MatrixOther},
-    {1, ColorAspects::MatrixBT709_5},
-    {2, ColorAspects::MatrixUnspecified},
-    {4, ColorAspects::MatrixBT470_6M},
-    {6, ColorAspects::MatrixBT601_6 /* main */},
-    {5, ColorAspects::MatrixBT601_6},
-    {7, ColorAspects::MatrixSMPTE240M},
-    {8, ColorAspects::MatrixOther /* YCgCo */},
-    // -- ITU T.832 201201 ends here
-    {9, ColorAspects::MatrixBT2020},
-    {10, ColorAspects::MatrixBT2020Constant},
-}};
+// static
+void ColorUtils::convertPackedCodecColorAspectsToPlatformAspects(
+    uint32_t packed,
+    int32_t* range,
+    int32_t* standard,
+    int32_t* transfer) {
+  // every byte is a valid aspect
+  *range = kPlatformRanges[(packed >> 24) & 0xFF];
+  *standard = platformStandard((packed >> 16) & 0xFF, (packed >> 8) & 0xFF);
+  *transfer = kPlatformTransfers[packed & 0xFF];
+}
 
 // static
 void ColorUtils::convertCodecColorAspectsToIsoAspects(
@@ -305,36 +451,42 @@ void ColorUtils::convertCodecColorAspectsToIsoAspects(
     int32_t* transfer,
     int32_t* coeffs,
     bool* fullRange) {
-  if (aspects.mPrimaries == ColorAspects::PrimariesOther ||
-      !sIsoPrimaries.map(aspects.mPrimaries, primaries)) {
-    AVE_CHECK(sIsoPrimaries.map(ColorAspects::PrimariesUnspecified, primaries));
-  }
-  if (aspects.mTransfer == ColorAspects::TransferOther ||
-      !sIsoTransfers.map(aspects.mTransfer, transfer)) {
-    AVE_CHECK(sIsoTransfers.map(ColorAspects::TransferUnspecified, transfer));
-  }
-  if (aspects.mMatrixCoeffs == ColorAspects::MatrixOther ||
-      !sIsoMatrixCoeffs.map(aspects.mMatrixCoeffs, coeffs)) {
-    AVE_CHECK(sIsoMatrixCoeffs.map(ColorAspects::MatrixUnspecified, coeffs));
-  }
+  *primaries = kIsoPrimaryValues[isValid(aspects.mPrimaries)
+                                     ? aspects.mPrimaries
+                                     : ColorAspects::PrimariesUnspecified];
+  *transfer = kIsoTransferValues[isValid(aspects.mTransfer)
+                                     ? aspects.mTransfer
+                                     : ColorAspects::TransferUnspecified];
+  *coeffs = kIsoCoeffValues[isValid(aspects.mMatrixCoeffs)
+                                ? aspects.mMatrixCoeffs
+                                : ColorAspects::MatrixUnspecified];
   *fullRange = aspects.mRange == ColorAspects::RangeFull;
 }
 
+// static
+void ColorUtils::convertPackedCodecColorAspectsToIsoAspects(uint32_t packed,
+                                                            int32_t* primaries,
+                                                            int32_t* transfer,
+                                                            int32_t* coeffs,
+                                                            bool* fullRange) {
+  *primaries = kIsoPrimaryValues[(packed >> 16) & 0xFF];
+  *transfer = kIsoTransferValues[packed & 0xFF];
+  *coeffs = kIsoCoeffValues[(packed >> 8) & 0xFF];
+  *fullRange = ((packed >> 24) & 0xFF) == ColorAspects::RangeFull;
+}
+
 // static
 void ColorUtils::convertIsoColorAspectsToCodecAspects(int32_t primaries,
                                                       int32_t transfer,
                                                       int32_t coeffs,
                                                       bool fullRange,
                                                       ColorAspects& aspects) {
-  if (!sIsoPrimaries.map(primaries, &aspects.mPrimaries)) {
-    aspects.mPrimaries = ColorAspects::PrimariesUnspecified;
-  }
-  if (!sIsoTransfers.map(transfer, &aspects.mTransfer)) {
-    aspects.mTransfer = ColorAspects::TransferUnspecified;
-  }
-  if (!sIsoMatrixCoeffs.map(coeffs, &aspects.mMatrixCoeffs)) {
-    aspects.mMatrixCoeffs = ColorAspects::MatrixUnspecified;
-  }
+  const ColorAspects::Primaries* p = find(kIsoPrimaryAspects, primaries);
+  aspects.mPrimaries = p ? *p : ColorAspects::PrimariesUnspecified;
+  const ColorAspects::Transfer* t = find(kIsoTransferAspects, transfer);
+  aspects.mTransfer = t ? *t : ColorAspects::TransferUnspecified;
+  const ColorAspects::MatrixCoeffs* c = find(kIsoCoeffAspects, coeffs);
+  aspects.mMatrixCoeffs = c ? *c : ColorAspects::MatrixUnspecified;
   aspects.mRange =
       fullRange ? ColorAspects::RangeFull : ColorAspects::RangeLimited;
 }
@@ -346,11 +498,13 @@ void ColorUtils::convertIsoColorAspectsToPlatformAspects(int32_t primaries,
                                                          int32_t* range,
                                                          int32_t* standard,
                                                          int32_t* outtransfer) {
+  // the codec aspects from ISO ones are all valid
   ColorAspects aspects;
   convertIsoColorAspectsToCodecAspects(primaries, intransfer, coeffs, fullRange,
                                        aspects);
-  convertCodecColorAspectsToPlatformAspects(aspects, range, standard,
-                                            outtransfer);
+  *range = kPlatformRanges[aspects.mRange];
+  *standard = platformStandard(aspects.mPrimaries, aspects.mMatrixCoeffs);
+  *outtransfer = kPlatformTransfers[aspects.mTransfer];
 }
 
 // static
@@ -370,6 +524,18 @@ uint32_t ColorUtils::packToU32(const ColorAspects& aspects) {
          (aspects.mMatrixCoeffs << 8) | aspects.mTransfer;
 }
 
+// static
+status_t ColorUtils::packToU32Checked(const ColorAspects& aspects,
+                                      uint32_t* packed) {
+  // a valid aspect fits its byte
+  if (!isValid(aspects.mRange) || !isValid(aspects.mPrimaries) ||
+      !isValid(aspects.mMatrixCoeffs) || !isValid(aspects.mTransfer)) {
+    return BAD_VALUE;
+  }
+  *packed = packToU32(aspects);
+  return OK;
+}
+
 // static
 void ColorUtils::setDefaultCodecColorAspectsIfNeeded(ColorAspects& aspects,
                                                      int32_t width,
@@ -811,7 +977,7 @@ void ColorUtils::fillHdrStaticInfoBuffer(const HDRStaticInfo& info,
 // static
 void ColorUtils::setHDRStaticInfoIntoFormat(const HDRStaticInfo& info,
                                             std::shared_ptr<Message>& format) {
-  auto infoBuffer = std::make_shared<Buffer>(25);
+  auto infoBuffer = Buffer::Create(25);
 
   // Convert the data in infoBuffer to little endian format as defined by
   // CTA-861-3
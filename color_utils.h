@@ -126,6 +126,12 @@ struct ColorUtils {
       int32_t* range,
       int32_t* standard,
       int32_t* transfer);
+  // same for aspects packed by packToU32Checked(), which are always valid
+  static void convertPackedCodecColorAspectsToPlatformAspects(
+      uint32_t packed,
+      int32_t* range,
+      int32_t* standard,
+      int32_t* transfer);
 
   // converts Other values to Unspecified
   static void convertCodecColorAspectsToIsoAspects(const ColorAspects& aspects,
@@ -133,6 +139,11 @@ struct ColorUtils {
                                                    int32_t* transfer,
                                                    int32_t* coeffs,
                                                    bool* fullRange);
+  static void convertPackedCodecColorAspectsToIsoAspects(uint32_t packed,
+                                                         int32_t* primaries,
+                                                         int32_t* transfer,
+                                                         int32_t* coeffs,
+                                                         bool* fullRange);
   // converts unsupported values to Other
   static void convertIsoColorAspectsToCodecAspects(int32_t primaries,
                                                    int32_t transfer,
@@ -152,6 +163,10 @@ struct ColorUtils {
 
   // pack a full ColorAspects struct into a uint32_t
   static uint32_t packToU32(const ColorAspects& aspects);
+  // Same, but BAD_VALUE instead of mixing an aspect into the byte of the next
+  // one when it is not valid, as those read from MetaData may be.
+  static status_t packToU32Checked(const ColorAspects& aspects,
+                                   uint32_t* packed);
 
   // updates Unspecified color aspects to their defaults based on the video size
   static void setDefaultCodecColorAspectsIfNeeded(ColorAspects& aspects,
@@ -0,0 +1,289 @@
+/*
+ * dma_buf_handle.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "dma_buf_handle.h"
+
+#include <fcntl.h>
+#include <linux/dma-buf.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "base/checks.h"
+#include "base/logging.h"
+
+#include "media_errors.h"
+
+namespace ave {
+
+namespace {
+
+// Sent along with the descriptor by SendHandle().
+struct HandleHeader {
+  uint64_t size;
+  uint32_t type;
+};
+
+}  // namespace
+
+// static
+std::shared_ptr<DmaBufHandle> DmaBufHandle::CreateMemfd(size_t size,
+                                                        const char* name) {
+  if (size == 0) {
+    return nullptr;
+  }
+
+  int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    AVE_LOG(LS_ERROR) << "memfd_create failed: " << strerror(errno);
+    return nullptr;
+  }
+
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    AVE_LOG(LS_ERROR) << "ftruncate(" << size
+                      << ") failed: " << strerror(errno);
+    close(fd);
+    return nullptr;
+  }
+
+  // peers may map the fd, make sure nobody can shrink it under them.
+  if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) !=
+      0) {
+    AVE_LOG(LS_WARNING) << "sealing memfd failed: " << strerror(errno);
+  }
+
+  return std::make_shared<DmaBufHandle>(fd, size, Type::kMemfd,
+                                        protect_parameter());
+}
+
+// static
+std::shared_ptr<DmaBufHandle> DmaBufHandle::Adopt(int fd,
+                                                  size_t size,
+                                                  Type type) {
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  if (size == 0) {
+    off_t end = lseek(fd, 0, SEEK_END);
+    if (end <= 0) {
+      AVE_LOG(LS_ERROR) << "can not query size of fd " << fd;
+      close(fd);
+      return nullptr;
+    }
+    lseek(fd, 0, SEEK_SET);
+    size = static_cast<size_t>(end);
+  }
+
+  return std::make_shared<DmaBufHandle>(fd, size, type, protect_parameter());
+}
+
+// static
+std::shared_ptr<DmaBufHandle> DmaBufHandle::Import(int fd,
+                                                   size_t size,
+                                                   Type type) {
+  if (fd < 0) {
+    return nullptr;
+  }
+  return Adopt(fcntl(fd, F_DUPFD_CLOEXEC, 0), size, type);
+}
+
+// static
+status_t DmaBufHandle::SendHandle(int socket, const DmaBufHandle& handle) {
+  // zeroed first, so the padding sent to the peer holds no stack contents
+  HandleHeader header;
+  memset(&header, 0, sizeof(header));
+  header.size = handle.size();
+  header.type = static_cast<uint32_t>(handle.type());
+  struct iovec iov = {&header, sizeof(header)};
+
+  char control[CMSG_SPACE(sizeof(int))];
+  memset(control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  int fd = handle.fd();
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  ssize_t ret;
+  do {
+    ret = sendmsg(socket, &msg, MSG_NOSIGNAL);
+  } while (ret < 0 && errno == EINTR);
+
+  if (ret < 0) {
+    int err = errno;
+    AVE_LOG(LS_ERROR) << "sendmsg failed: " << strerror(err);
+    return -err;
+  }
+  // errno is not set by a short write
+  if (ret != static_cast<ssize_t>(sizeof(header))) {
+    AVE_LOG(LS_ERROR) << "sendmsg sent " << ret << " of " << sizeof(header)
+                      << " bytes";
+    return ERROR_IO;
+  }
+  return OK;
+}
+
+// static
+std::shared_ptr<DmaBufHandle> DmaBufHandle::ReceiveHandle(int socket) {
+  HandleHeader header;
+  struct iovec iov = {&header, sizeof(header)};
+
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t ret;
+  do {
+    ret = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+  } while (ret < 0 && errno == EINTR);
+
+  // Take every descriptor the peer passed, so none leaks when the message
+  // is rejected.
+  std::vector<int> fds;
+  if (ret > 0) {
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        continue;
+      }
+      size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (size_t i = 0; i < count; i++) {
+        int received;
+        memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+        fds.push_back(received);
+      }
+    }
+  }
+  auto close_fds = [&fds]() {
+    for (int received : fds) {
+      close(received);
+    }
+  };
+
+  if (ret != static_cast<ssize_t>(sizeof(header)) || fds.size() != 1 ||
+      (msg.msg_flags & (MSG_CTRUNC | MSG_TRUNC)) != 0) {
+    AVE_LOG(LS_ERROR) << "recvmsg failed, ret: " << ret
+                      << ", fds: " << fds.size()
+                      << ", flags: " << msg.msg_flags;
+    close_fds();
+    return nullptr;
+  }
+  int fd = fds[0];
+
+  if (header.type > static_cast<uint32_t>(Type::kDmaBuf)) {
+    close(fd);
+    return nullptr;
+  }
+
+  // data() maps header.size bytes, a peer must not claim more than the
+  // buffer holds.
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 0 ||
+      header.size > static_cast<uint64_t>(st.st_size)) {
+    AVE_LOG(LS_ERROR) << "received fd " << fd << " is smaller than "
+                      << header.size << " bytes";
+    close(fd);
+    return nullptr;
+  }
+
+  return Adopt(fd, header.size, static_cast<Type>(header.type));
+}
+
+DmaBufHandle::DmaBufHandle(int fd, size_t size, Type type, protect_parameter)
+    : fd_(fd), size_(size), type_(type), mapping_(nullptr) {}
+
+DmaBufHandle::~DmaBufHandle() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, size_);
+    mapping_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+uint8_t* DmaBufHandle::data() {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (mapping_ == nullptr) {
+    void* addr =
+        mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (addr == MAP_FAILED) {
+      AVE_LOG(LS_ERROR) << "mmap fd " << fd_ << " size " << size_
+                        << " failed: " << strerror(errno);
+      return nullptr;
+    }
+    mapping_ = static_cast<uint8_t*>(addr);
+  }
+  return mapping_;
+}
+
+bool DmaBufHandle::mapped() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return mapping_ != nullptr;
+}
+
+status_t DmaBufHandle::BeginCpuAccess(uint32_t flags) {
+  return Sync(flags, false);
+}
+
+status_t DmaBufHandle::EndCpuAccess(uint32_t flags) {
+  return Sync(flags, true);
+}
+
+status_t DmaBufHandle::Sync(uint32_t flags, bool end) {
+  if ((flags & kSyncReadWrite) == 0 || (flags & ~kSyncReadWrite) != 0) {
+    return BAD_VALUE;
+  }
+
+  if (type_ != Type::kDmaBuf) {
+    // memfd is plain cacheable memory, nothing to do.
+    return OK;
+  }
+
+  struct dma_buf_sync sync;
+  sync.flags = (end ? DMA_BUF_SYNC_END : DMA_BUF_SYNC_START) |
+               ((flags & kSyncRead) ? DMA_BUF_SYNC_READ : 0) |
+               ((flags & kSyncWrite) ? DMA_BUF_SYNC_WRITE : 0);
+
+  int ret;
+  do {
+    ret = ioctl(fd_, DMA_BUF_IOCTL_SYNC, &sync);
+  } while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+
+  if (ret < 0) {
+    int err = errno;
+    AVE_LOG(LS_ERROR) << "DMA_BUF_IOCTL_SYNC failed: " << strerror(err);
+    return -err;
+  }
+  return OK;
+}
+
+int DmaBufHandle::DupFd() const {
+  return fcntl(fd_, F_DUPFD_CLOEXEC, 0);
+}
+
+}  // namespace ave
@@ -0,0 +1,96 @@
+/*
+ * dma_buf_handle.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef DMA_BUF_HANDLE_H
+#define DMA_BUF_HANDLE_H
+
+#include <memory>
+#include <mutex>
+
+#include "base/constructor_magic.h"
+#include "base/errors.h"
+#include "base/types.h"
+
+namespace ave {
+
+// A file descriptor backed memory block that can be shared with other
+// processes and devices. The fd is either a memfd (plain shared memory) or a
+// dma-buf exported by a driver. The mapping is created lazily on the first
+// data() call, and both the mapping and the fd are released together with the
+// last reference to the handle.
+class DmaBufHandle {
+ protected:
+  // for private construct
+  struct protect_parameter {
+    explicit protect_parameter() {}
+  };
+
+ public:
+  enum class Type {
+    kMemfd,
+    kDmaBuf,
+  };
+
+  enum SyncFlags : uint32_t {
+    kSyncRead = 1 << 0,
+    kSyncWrite = 1 << 1,
+    kSyncReadWrite = kSyncRead | kSyncWrite,
+  };
+
+  // Allocates a sealed memfd of |size| bytes. Returns nullptr on failure.
+  static std::shared_ptr<DmaBufHandle> CreateMemfd(size_t size,
+                                                   const char* name = "ave");
+
+  // Takes ownership of |fd|. If |size| is 0 the size is queried from the fd.
+  static std::shared_ptr<DmaBufHandle> Adopt(int fd, size_t size, Type type);
+
+  // Same as Adopt(), but works on a duplicate of |fd|, the caller keeps
+  // ownership of the original descriptor.
+  static std::shared_ptr<DmaBufHandle> Import(int fd, size_t size, Type type);
+
+  // Passes |handle| to the peer of the unix domain |socket| (SCM_RIGHTS).
+  static status_t SendHandle(int socket, const DmaBufHandle& handle);
+  // Receives a handle sent by SendHandle(). Returns nullptr on failure.
+  static std::shared_ptr<DmaBufHandle> ReceiveHandle(int socket);
+
+  DmaBufHandle(int fd, size_t size, Type type, protect_parameter);
+  ~DmaBufHandle();
+
+  int fd() const { return fd_; }
+  size_t size() const { return size_; }
+  Type type() const { return type_; }
+
+  // Maps the whole buffer on first use. Returns nullptr if mapping failed.
+  uint8_t* data();
+  bool mapped() const;
+
+  // Brackets CPU access to the mapping. For dma-buf this issues
+  // DMA_BUF_IOCTL_SYNC so caches are coherent with the device, for memfd it
+  // is a no-op. Calls must be paired with the same |flags|.
+  status_t BeginCpuAccess(uint32_t flags = kSyncReadWrite);
+  status_t EndCpuAccess(uint32_t flags = kSyncReadWrite);
+
+  // Returns a new descriptor referring to the same buffer, owned by the
+  // caller. Returns -1 on failure.
+  int DupFd() const;
+
+ private:
+  status_t Sync(uint32_t flags, bool end);
+
+  const int fd_;
+  const size_t size_;
+  const Type type_;
+
+  mutable std::mutex lock_;
+  uint8_t* mapping_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(DmaBufHandle);
+};
+
+}  // namespace ave
+
+#endif /* !DMA_BUF_HANDLE_H */
@@ -0,0 +1,288 @@
+/*
+ * fast_bit_reader.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef FAST_BIT_READER_H
+#define FAST_BIT_READER_H
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/checks.h"
+#include "base/constructor_magic.h"
+#include "base/types.h"
+
+namespace ave {
+
+// Byte sources for FastBitReader. Refill() appends bytes to the left-aligned
+// |cache| holding |bits| valid bits (|bits| < 64) and returns the new count.
+// The bits below the count may already hold the following stream bits, they
+// are only ever OR-ed with the same values again.
+
+// Plain bytes.
+class RawByteSource {
+ public:
+  RawByteSource(const uint8_t* data, size_t size)
+      : data_(data), end_(data + size) {}
+
+  size_t Refill(uint64_t* cache, size_t bits) {
+    if (end_ - data_ >= 8) {
+      *cache |= LoadBE64(data_) >> bits;
+      data_ += (63 - bits) >> 3;
+      return bits | 56;
+    }
+    while (bits <= 56 && data_ < end_) {
+      *cache |= static_cast<uint64_t>(*data_++) << (56 - bits);
+      bits += 8;
+    }
+    return bits;
+  }
+
+  // Skips up to |n| bytes, returns the number skipped.
+  size_t Skip(size_t n) {
+    n = std::min(n, bytesLeft());
+    data_ += n;
+    return n;
+  }
+
+  size_t bytesLeft() const { return end_ - data_; }
+  const uint8_t* data() const { return data_; }
+
+  static uint64_t LoadBE64(const uint8_t* p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+  }
+
+ private:
+  const uint8_t* data_;
+  const uint8_t* end_;
+};
+
+// NAL unit payload, emulation_prevention_three_byte (00 00 03) is dropped
+// while reading. Words without any 03 byte are loaded whole.
+class EmulationPreventionByteSource {
+ public:
+  EmulationPreventionByteSource(const uint8_t* data, size_t size)
+      : data_(data), end_(data + size), zeros_(0) {}
+
+  size_t Refill(uint64_t* cache, size_t bits) {
+    if (end_ - data_ >= 8) {
+      uint64_t word = RawByteSource::LoadBE64(data_);
+      if (!HasByte(word, 0x03)) {
+        size_t n = (63 - bits) >> 3;
+        *cache |= word >> bits;
+        if (n > 0) {
+          // zero bytes ending the consumed part, at most the two that matter
+          uint8_t last = data_[n - 1];
+          uint8_t before = n > 1 ? data_[n - 2] : (zeros_ > 0 ? 0 : 1);
+          zeros_ = last != 0 ? 0 : before != 0 ? 1 : 2;
+        }
+        data_ += n;
+        return bits | 56;
+      }
+    }
+    while (bits <= 56 && data_ < end_) {
+      uint8_t byte = *data_++;
+      if (zeros_ >= 2 && byte == 0x03) {
+        zeros_ = 0;
+        continue;
+      }
+      zeros_ = byte == 0 ? std::min(zeros_ + 1, 2) : 0;
+      *cache |= static_cast<uint64_t>(byte) << (56 - bits);
+      bits += 8;
+    }
+    return bits;
+  }
+
+  size_t Skip(size_t n) {
+    size_t skipped = 0;
+    while (skipped < n && data_ < end_) {
+      uint8_t byte = *data_++;
+      if (zeros_ >= 2 && byte == 0x03) {
+        zeros_ = 0;
+        continue;
+      }
+      zeros_ = byte == 0 ? std::min(zeros_ + 1, 2) : 0;
+      ++skipped;
+    }
+    return skipped;
+  }
+
+  // raw bytes, including emulation prevention bytes
+  size_t bytesLeft() const { return end_ - data_; }
+  const uint8_t* data() const { return data_; }
+
+ private:
+  static bool HasByte(uint64_t word, uint8_t value) {
+    uint64_t x = word ^ (0x0101010101010101ull * value);
+    return ((x - 0x0101010101010101ull) & ~x & 0x8080808080808080ull) != 0;
+  }
+
+  const uint8_t* data_;
+  const uint8_t* end_;
+  int zeros_;
+};
+
+// BitReader with a 64-bit reservoir refilled by whole unaligned word loads.
+// The byte source is a template parameter, so refills are inlined instead of
+// going through a virtual call. Reads have the same semantics as BitReader.
+template <typename Source>
+class FastBitReader {
+ public:
+  FastBitReader(const uint8_t* data, size_t size)
+      : source_(data, size), cache_(0), bits_(0), over_read_(false) {}
+
+  // Returns the next |n| bits (n <= 32) without consuming them, bits past the
+  // end of the data read as 0.
+  uint32_t showBits(size_t n) {
+    AVE_DCHECK_LE(n, 32u);
+    if (bits_ < n) {
+      bits_ = source_.Refill(&cache_, bits_);
+    }
+    return n == 0 ? 0 : static_cast<uint32_t>(cache_ >> (64 - n));
+  }
+
+  // Tries to get |n| bits. If not successful, returns false. Reading 0 bits
+  // will always succeed and write 0 in |out|.
+  bool getBitsGraceful(size_t n, uint32_t* out) {
+    if (n > 32) {
+      return false;
+    }
+    if (bits_ < n) {
+      bits_ = source_.Refill(&cache_, bits_);
+      if (bits_ < n) {
+        cache_ = 0;
+        bits_ = 0;
+        over_read_ = true;
+        return false;
+      }
+    }
+    *out = n == 0 ? 0 : static_cast<uint32_t>(cache_ >> (64 - n));
+    consume(n);
+    return true;
+  }
+
+  // Gets |n| bits and returns result. ABORTS if unsuccessful.
+  uint32_t getBits(size_t n) {
+    uint32_t ret = 0;
+    AVE_CHECK(getBitsGraceful(n, &ret));
+    return ret;
+  }
+
+  uint32_t getBitsWithFallback(size_t n, uint32_t fallback) {
+    uint32_t ret = fallback;
+    (void)getBitsGraceful(n, &ret);
+    return ret;
+  }
+
+  // Tries to skip |n| bits. Returns true iff successful.
+  bool skipBits(size_t n) {
+    if (n <= bits_) {
+      consume(n);
+      return true;
+    }
+    n -= bits_;
+    cache_ = 0;
+    bits_ = 0;
+    size_t bytes = n / 8;
+    if (source_.Skip(bytes) != bytes) {
+      over_read_ = true;
+      return false;
+    }
+    uint32_t dummy;
+    return getBitsGraceful(n % 8, &dummy);
+  }
+
+  // Exp-Golomb ue(v) and se(v), same results as parseUE(), parseSE() and
+  // their fallback versions in avc_utils. A code that fits in the reservoir
+  // is decoded from its leading zero count and consumed in one step.
+  bool getUEGraceful(uint32_t* out) {
+    if (bits_ < 32) {
+      bits_ = source_.Refill(&cache_, bits_);
+    }
+    if (cache_ != 0) {
+      size_t len = 2 * __builtin_clzll(cache_) + 1;
+      if (len <= bits_) {
+        *out = static_cast<uint32_t>(cache_ >> (64 - len)) - 1;
+        consume(len);
+        return true;
+      }
+    }
+    return getUEGracefulSlow(out);
+  }
+
+  uint32_t getUE() {
+    uint32_t ret = 0;
+    AVE_CHECK(getUEGraceful(&ret));
+    return ret;
+  }
+
+  uint32_t getUEWithFallback(uint32_t fallback) {
+    uint32_t ret;
+    return getUEGraceful(&ret) ? ret : fallback;
+  }
+
+  int32_t getSE() { return toSigned(getUE()); }
+
+  int32_t getSEWithFallback(int32_t fallback) {
+    uint32_t ret;
+    return getUEGraceful(&ret) ? toSigned(ret) : fallback;
+  }
+
+  size_t numBitsLeft() const { return source_.bytesLeft() * 8 + bits_; }
+
+  // The byte holding the next unread bit, for plain byte sources.
+  const uint8_t* data() const { return source_.data() - (bits_ + 7) / 8; }
+
+  bool overRead() const { return over_read_; }
+
+ private:
+  // Long codes and codes at the end of the data, bit by bit.
+  bool getUEGracefulSlow(uint32_t* out) {
+    size_t numZeroes = 0;
+    while (getBitsWithFallback(1, 1) == 0) {
+      ++numZeroes;
+    }
+    uint32_t x;
+    if (numZeroes >= 32) {
+      skipBits(numZeroes);
+      return false;
+    }
+    if (!getBitsGraceful(numZeroes, &x)) {
+      return false;
+    }
+    *out = x + (1u << numZeroes) - 1;
+    return true;
+  }
+
+  static int32_t toSigned(uint32_t codeNum) {
+    return (codeNum & 1) ? (codeNum + 1) / 2 : -int32_t(codeNum / 2);
+  }
+
+  // |n| <= bits_, which is below 64
+  void consume(size_t n) {
+    cache_ <<= n;
+    bits_ -= n;
+  }
+
+  Source source_;
+  uint64_t cache_;  // left-aligned bits
+  size_t bits_;
+  bool over_read_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(FastBitReader);
+};
+
+using FastRawBitReader = FastBitReader<RawByteSource>;
+using FastNALBitReader = FastBitReader<EmulationPreventionByteSource>;
+
+}  // namespace ave
+
+#endif /* !FAST_BIT_READER_H */
@@ -0,0 +1,444 @@
+/*
+ * frame_view.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "frame_view.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "base/logging.h"
+
+#include "dma_buf_handle.h"
+#include "media_errors.h"
+#include "media_packet.h"
+#include "message.h"
+#include "meta_data.h"
+
+namespace ave {
+
+namespace {
+
+struct FormatInfo {
+  PixelFormat format;
+  uint8_t num_planes;
+  // bytes per sample of each plane, 2 for the UV plane of NV12
+  uint8_t bytes[FrameView::kMaxPlanes];
+  // chroma subsampling of planes 1 and 2
+  uint8_t log2_chroma_w;
+  uint8_t log2_chroma_h;
+};
+
+// clang-format off
+const FormatInfo kFormatInfos[] = {
+  {AV_PIX_FMT_YUV420P,     3, {1, 1, 1, 0}, 1, 1},
+  {AV_PIX_FMT_YUVJ420P,    3, {1, 1, 1, 0}, 1, 1},
+  {AV_PIX_FMT_YUV422P,     3, {1, 1, 1, 0}, 1, 0},
+  {AV_PIX_FMT_YUVJ422P,    3, {1, 1, 1, 0}, 1, 0},
+  {AV_PIX_FMT_YUV444P,     3, {1, 1, 1, 0}, 0, 0},
+  {AV_PIX_FMT_YUVJ444P,    3, {1, 1, 1, 0}, 0, 0},
+  {AV_PIX_FMT_YUV440P,     3, {1, 1, 1, 0}, 0, 1},
+  {AV_PIX_FMT_YUV410P,     3, {1, 1, 1, 0}, 2, 2},
+  {AV_PIX_FMT_YUV411P,     3, {1, 1, 1, 0}, 2, 0},
+  {AV_PIX_FMT_YUVA420P,    4, {1, 1, 1, 1}, 1, 1},
+  {AV_PIX_FMT_YUV420P10LE, 3, {2, 2, 2, 0}, 1, 1},
+  {AV_PIX_FMT_YUV420P10BE, 3, {2, 2, 2, 0}, 1, 1},
+  {AV_PIX_FMT_YUV420P12LE, 3, {2, 2, 2, 0}, 1, 1},
+  {AV_PIX_FMT_YUV420P12BE, 3, {2, 2, 2, 0}, 1, 1},
+  {AV_PIX_FMT_YUV420P16LE, 3, {2, 2, 2, 0}, 1, 1},
+  {AV_PIX_FMT_YUV420P16BE, 3, {2, 2, 2, 0}, 1, 1},
+  {AV_PIX_FMT_YUV422P10LE, 3, {2, 2, 2, 0}, 1, 0},
+  {AV_PIX_FMT_YUV422P10BE, 3, {2, 2, 2, 0}, 1, 0},
+  {AV_PIX_FMT_YUV444P10LE, 3, {2, 2, 2, 0}, 0, 0},
+  {AV_PIX_FMT_YUV444P10BE, 3, {2, 2, 2, 0}, 0, 0},
+  {AV_PIX_FMT_NV12,        2, {1, 2, 0, 0}, 1, 1},
+  {AV_PIX_FMT_NV21,        2, {1, 2, 0, 0}, 1, 1},
+  {AV_PIX_FMT_NV16,        2, {1, 2, 0, 0}, 1, 0},
+  {AV_PIX_FMT_NV24,        2, {1, 2, 0, 0}, 0, 0},
+  {AV_PIX_FMT_NV42,        2, {1, 2, 0, 0}, 0, 0},
+  {AV_PIX_FMT_P010LE,      2, {2, 4, 0, 0}, 1, 1},
+  {AV_PIX_FMT_P010BE,      2, {2, 4, 0, 0}, 1, 1},
+  {AV_PIX_FMT_P016LE,      2, {2, 4, 0, 0}, 1, 1},
+  {AV_PIX_FMT_P016BE,      2, {2, 4, 0, 0}, 1, 1},
+  {AV_PIX_FMT_GRAY8,       1, {1, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_GRAY10LE,    1, {2, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_GRAY16LE,    1, {2, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_GRAY16BE,    1, {2, 0, 0, 0}, 0, 0},
+  // packed 4:2:2, the chroma subsampling only constrains the crop origin
+  {AV_PIX_FMT_YUYV422,     1, {2, 0, 0, 0}, 1, 0},
+  {AV_PIX_FMT_UYVY422,     1, {2, 0, 0, 0}, 1, 0},
+  {AV_PIX_FMT_RGB24,       1, {3, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_BGR24,       1, {3, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_ARGB,        1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_RGBA,        1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_ABGR,        1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_BGRA,        1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_0RGB,        1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_RGB0,        1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_X2RGB10LE,   1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_RGB565LE,    1, {2, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_RGB565BE,    1, {2, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_BGR565LE,    1, {2, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_BGR565BE,    1, {2, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_GBRP,        3, {1, 1, 1, 0}, 0, 0},
+};
+// clang-format on
+
+const FormatInfo* FindFormatInfo(PixelFormat format) {
+  for (const auto& info : kFormatInfos) {
+    if (info.format == format) {
+      return &info;
+    }
+  }
+  return nullptr;
+}
+
+uint32_t CeilDiv(uint32_t value, uint32_t divisor) {
+  return (value + divisor - 1) / divisor;
+}
+
+bool IsChromaPlane(size_t index) {
+  return index == 1 || index == 2;
+}
+
+// Fills |planes| and the byte |offsets| of the planes, returns the total
+// size or 0 if the layout is not valid.
+size_t ComputeLayout(const FormatInfo& info,
+                     uint32_t width,
+                     uint32_t height,
+                     uint32_t stride,
+                     FrameView::Plane* planes,
+                     size_t* offsets) {
+  if (width == 0 || height == 0) {
+    return 0;
+  }
+  const uint64_t row_bytes = uint64_t{width} * info.bytes[0];
+  const uint64_t luma_stride = stride != 0 ? stride : row_bytes;
+  if (luma_stride < row_bytes || luma_stride > INT32_MAX) {
+    return 0;
+  }
+
+  uint64_t offset = 0;
+  for (size_t i = 0; i < info.num_planes; i++) {
+    FrameView::Plane& plane = planes[i];
+    uint64_t plane_stride = luma_stride;
+    if (IsChromaPlane(i)) {
+      plane.horiz_subsampling = 1u << info.log2_chroma_w;
+      plane.vert_subsampling = 1u << info.log2_chroma_h;
+      uint32_t luma_samples =
+          static_cast<uint32_t>(luma_stride / info.bytes[0]);
+      plane_stride = uint64_t{CeilDiv(luma_samples, plane.horiz_subsampling)} *
+                     info.bytes[i];
+    }
+    plane.width = CeilDiv(width, plane.horiz_subsampling);
+    plane.height = CeilDiv(height, plane.vert_subsampling);
+    plane.col_inc = info.bytes[i];
+    plane.stride = static_cast<int32_t>(plane_stride);
+    offsets[i] = static_cast<size_t>(offset);
+    offset += plane_stride * plane.height;
+  }
+  return offset > SIZE_MAX ? 0 : static_cast<size_t>(offset);
+}
+
+// Guesses the PixelFormat of the YUV layouts codecs commonly report.
+PixelFormat GuessFormat(const MediaImage2& image) {
+  if (image.mType == MediaImage2::MEDIA_IMAGE_TYPE_Y &&
+      image.mBitDepthAllocated == 8 && image.mPlane[0].mColInc == 1) {
+    return AV_PIX_FMT_GRAY8;
+  }
+  if (image.mType != MediaImage2::MEDIA_IMAGE_TYPE_YUV ||
+      image.mNumPlanes != 3) {
+    return AV_PIX_FMT_NONE;
+  }
+
+  const auto& y = image.mPlane[MediaImage2::Y];
+  const auto& u = image.mPlane[MediaImage2::U];
+  const auto& v = image.mPlane[MediaImage2::V];
+  const int32_t bytes = image.mBitDepthAllocated / 8;
+  if (y.mColInc != bytes || u.mColInc != v.mColInc ||
+      u.mRowInc != v.mRowInc || u.mHorizSubsampling != v.mHorizSubsampling ||
+      u.mVertSubsampling != v.mVertSubsampling) {
+    return AV_PIX_FMT_NONE;
+  }
+
+  const uint32_t hs = u.mHorizSubsampling;
+  const uint32_t vs = u.mVertSubsampling;
+  if (u.mColInc == bytes) {
+    if (bytes == 1) {
+      if (hs == 2 && vs == 2) {
+        return AV_PIX_FMT_YUV420P;
+      } else if (hs == 2 && vs == 1) {
+        return AV_PIX_FMT_YUV422P;
+      } else if (hs == 1 && vs == 1) {
+        return AV_PIX_FMT_YUV444P;
+      }
+    } else if (image.mBitDepth == 16 && hs == 2 && vs == 2) {
+      // MediaImage2 samples are MSB aligned, only full 16 bit matches
+      return AV_PIX_FMT_YUV420P16LE;
+    }
+    return AV_PIX_FMT_NONE;
+  }
+
+  if (u.mColInc != 2 * bytes) {
+    return AV_PIX_FMT_NONE;
+  }
+  bool uv = v.mOffset == u.mOffset + static_cast<uint32_t>(bytes);
+  bool vu = u.mOffset == v.mOffset + static_cast<uint32_t>(bytes);
+  if (bytes == 1) {
+    if (hs == 2 && vs == 2) {
+      return uv ? AV_PIX_FMT_NV12 : vu ? AV_PIX_FMT_NV21 : AV_PIX_FMT_NONE;
+    } else if (hs == 2 && vs == 1 && uv) {
+      return AV_PIX_FMT_NV16;
+    } else if (hs == 1 && vs == 1) {
+      return uv ? AV_PIX_FMT_NV24 : vu ? AV_PIX_FMT_NV42 : AV_PIX_FMT_NONE;
+    }
+  } else if (uv && hs == 2 && vs == 2) {
+    if (image.mBitDepth == 10) {
+      return AV_PIX_FMT_P010LE;
+    } else if (image.mBitDepth == 16) {
+      return AV_PIX_FMT_P016LE;
+    }
+  }
+  return AV_PIX_FMT_NONE;
+}
+
+}  // namespace
+
+size_t FrameView::Plane::size() const {
+  if (height == 0 || width == 0) {
+    return 0;
+  }
+  return static_cast<size_t>(std::abs(stride)) * (height - 1) +
+         static_cast<size_t>(width) * std::abs(col_inc);
+}
+
+FrameView::FrameView()
+    : format_(AV_PIX_FMT_NONE),
+      width_(0),
+      height_(0),
+      align_x_(1),
+      align_y_(1),
+      num_planes_(0) {}
+
+// static
+size_t FrameView::FrameSize(PixelFormat format,
+                            uint32_t width,
+                            uint32_t height,
+                            uint32_t stride) {
+  const FormatInfo* info = FindFormatInfo(format);
+  if (info == nullptr) {
+    return 0;
+  }
+  Plane planes[kMaxPlanes];
+  size_t offsets[kMaxPlanes];
+  return ComputeLayout(*info, width, height, stride, planes, offsets);
+}
+
+// static
+FrameView FrameView::Create(uint8_t* data,
+                            size_t size,
+                            PixelFormat format,
+                            uint32_t width,
+                            uint32_t height,
+                            uint32_t stride) {
+  FrameView view;
+  const FormatInfo* info = FindFormatInfo(format);
+  if (data == nullptr || info == nullptr) {
+    return view;
+  }
+
+  size_t offsets[kMaxPlanes];
+  size_t frame_size =
+      ComputeLayout(*info, width, height, stride, view.planes_, offsets);
+  if (frame_size == 0 || frame_size > size) {
+    return FrameView();
+  }
+
+  for (size_t i = 0; i < info->num_planes; i++) {
+    view.planes_[i].data = data + offsets[i];
+  }
+  view.format_ = format;
+  view.width_ = width;
+  view.height_ = height;
+  view.align_x_ = 1u << info->log2_chroma_w;
+  view.align_y_ = 1u << info->log2_chroma_h;
+  view.num_planes_ = info->num_planes;
+  return view;
+}
+
+// static
+FrameView FrameView::Create(uint8_t* data,
+                            size_t size,
+                            const MediaImage2& image) {
+  FrameView view;
+  if (data == nullptr || image.mType == MediaImage2::MEDIA_IMAGE_TYPE_UNKNOWN ||
+      image.mNumPlanes == 0 || image.mNumPlanes > kMaxPlanes ||
+      image.mWidth == 0 || image.mHeight == 0 ||
+      (image.mBitDepthAllocated != 8 && image.mBitDepthAllocated != 16)) {
+    return view;
+  }
+
+  const int64_t bytes = image.mBitDepthAllocated / 8;
+  uint32_t align_x = 1;
+  uint32_t align_y = 1;
+  for (size_t i = 0; i < image.mNumPlanes; i++) {
+    const MediaImage2::PlaneInfo& info = image.mPlane[i];
+    if (info.mHorizSubsampling == 0 || info.mVertSubsampling == 0 ||
+        info.mColInc == 0) {
+      return view;
+    }
+
+    Plane& plane = view.planes_[i];
+    plane.width = CeilDiv(image.mWidth, info.mHorizSubsampling);
+    plane.height = CeilDiv(image.mHeight, info.mVertSubsampling);
+    plane.stride = info.mRowInc;
+    plane.col_inc = info.mColInc;
+    plane.horiz_subsampling = info.mHorizSubsampling;
+    plane.vert_subsampling = info.mVertSubsampling;
+
+    // first and last byte touched by the plane, strides may be negative.
+    int64_t row_span = int64_t{info.mRowInc} * (plane.height - 1);
+    int64_t col_span = int64_t{info.mColInc} * (plane.width - 1);
+    int64_t first = int64_t{info.mOffset} + std::min<int64_t>(row_span, 0) +
+                    std::min<int64_t>(col_span, 0);
+    int64_t last = int64_t{info.mOffset} + std::max<int64_t>(row_span, 0) +
+                   std::max<int64_t>(col_span, 0) + bytes;
+    if (first < 0 || last > static_cast<int64_t>(size)) {
+      return view;
+    }
+    plane.data = data + info.mOffset;
+
+    align_x = std::max(align_x, info.mHorizSubsampling);
+    align_y = std::max(align_y, info.mVertSubsampling);
+  }
+
+  view.format_ = GuessFormat(image);
+  view.width_ = image.mWidth;
+  view.height_ = image.mHeight;
+  view.align_x_ = align_x;
+  view.align_y_ = align_y;
+  view.num_planes_ = image.mNumPlanes;
+
+  // semi-planar formats have a single interleaved chroma plane, which starts
+  // at whichever of U and V comes first.
+  if (view.format_ == AV_PIX_FMT_NV21 || view.format_ == AV_PIX_FMT_NV42) {
+    view.planes_[1].data = view.planes_[2].data;
+  }
+  switch (view.format_) {
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_NV21:
+    case AV_PIX_FMT_NV16:
+    case AV_PIX_FMT_NV24:
+    case AV_PIX_FMT_NV42:
+    case AV_PIX_FMT_P010LE:
+    case AV_PIX_FMT_P016LE:
+      view.planes_[2] = Plane();
+      view.num_planes_ = 2;
+      break;
+    default:
+      break;
+  }
+  return view;
+}
+
+// static
+FrameView FrameView::Create(MediaPacket& packet) {
+  const VideoSampleInfo* info = packet.video_info();
+  if (info == nullptr || info->width <= 0 || info->height <= 0) {
+    return FrameView();
+  }
+  return Create(packet.data(), packet.size(), info->pixel_format,
+                static_cast<uint32_t>(info->width),
+                static_cast<uint32_t>(info->height),
+                info->stride > 0 ? static_cast<uint32_t>(info->stride) : 0);
+}
+
+// static
+status_t FrameView::PrepareOutput(MediaPacket& src,
+                                  MediaPacket& dst,
+                                  PixelFormat format,
+                                  uint32_t width,
+                                  uint32_t height) {
+  const VideoSampleInfo* src_info = src.video_info();
+  VideoSampleInfo* info = dst.video_info();
+  if (src_info == nullptr || info == nullptr) {
+    return BAD_VALUE;
+  }
+
+  const int16_t stride = info->stride;
+  size_t size = FrameSize(format, width, height, stride > 0 ? stride : 0);
+  if (size == 0) {
+    AVE_LOG(LS_ERROR) << "unsupported frame " << format << " " << width
+                      << "x" << height << " stride " << stride;
+    return ERROR_UNSUPPORTED;
+  }
+  if (dst.size() < size) {
+    const auto& handle = dst.dma_buf_handle();
+    if (handle ? handle->size() < size
+               : dst.buffer_type() !=
+                     MediaPacket::PacketBufferType::kTypeNormal) {
+      AVE_LOG(LS_ERROR) << "the output packet is too small, " << dst.size()
+                        << " < " << size;
+      return BAD_VALUE;
+    }
+    dst.SetSize(size);
+  }
+  *info = *src_info;
+  info->pixel_format = format;
+  info->width = static_cast<int16_t>(width);
+  info->height = static_cast<int16_t>(height);
+  info->stride = stride;
+  return OK;
+}
+
+FrameView FrameView::Crop(uint32_t left,
+                          uint32_t top,
+                          uint32_t width,
+                          uint32_t height) const {
+  if (!valid() || width == 0 || height == 0 || left >= width_ ||
+      top >= height_ || width > width_ - left || height > height_ - top ||
+      left % align_x_ != 0 || top % align_y_ != 0) {
+    return FrameView();
+  }
+
+  FrameView view = *this;
+  view.width_ = width;
+  view.height_ = height;
+  for (size_t i = 0; i < num_planes_; i++) {
+    Plane& plane = view.planes_[i];
+    plane.data += static_cast<ptrdiff_t>(top / plane.vert_subsampling) *
+                      plane.stride +
+                  static_cast<ptrdiff_t>(left / plane.horiz_subsampling) *
+                      plane.col_inc;
+    plane.width = CeilDiv(width, plane.horiz_subsampling);
+    plane.height = CeilDiv(height, plane.vert_subsampling);
+  }
+  return view;
+}
+
+FrameView FrameView::Crop(const MetaData& meta) const {
+  int32_t left, top, right, bottom;
+  if (!meta.findRect(kKeyCropRect, &left, &top, &right, &bottom)) {
+    return *this;
+  }
+  if (left < 0 || top < 0 || right < left || bottom < top) {
+    return FrameView();
+  }
+  return Crop(left, top, right - left + 1, bottom - top + 1);
+}
+
+FrameView FrameView::Crop(const Message& format) const {
+  int32_t left, top, right, bottom;
+  if (!format.findRect("crop", &left, &top, &right, &bottom)) {
+    return *this;
+  }
+  if (left < 0 || top < 0 || right < left || bottom < top) {
+    return FrameView();
+  }
+  return Crop(left, top, right - left + 1, bottom - top + 1);
+}
+
+}  // namespace ave
@@ -0,0 +1,167 @@
+/*
+ * frame_view.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef FRAME_VIEW_H
+#define FRAME_VIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "base/errors.h"
+#include "media/hardware/video_api.h"
+#include "pixel_format.h"
+
+namespace ave {
+
+class MediaPacket;
+class Message;
+class MetaData;
+
+// A non-owning view of the planes of a raw video frame. The view only
+// describes where the pixels are, it never copies them, so it must not
+// outlive the buffer it was created from.
+class FrameView {
+ public:
+  static const size_t kMaxPlanes = 4;
+
+  struct Plane {
+    uint8_t* data = nullptr;
+    // bytes between two rows, negative for bottom-up images
+    int32_t stride = 0;
+    // bytes between two samples of a row
+    int32_t col_inc = 0;
+    // in samples of this plane
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // compared to the largest plane
+    uint32_t horiz_subsampling = 1;
+    uint32_t vert_subsampling = 1;
+
+    uint8_t* row(uint32_t y) const {
+      return data + static_cast<ptrdiff_t>(y) * stride;
+    }
+    // bytes covered by the plane, the padding of the last row excluded
+    size_t size() const;
+  };
+
+  // Iterates over the rows of a plane:
+  //   for (uint8_t* row : view.rows(0)) { ... }
+  class RowIterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = uint8_t*;
+    using difference_type = ptrdiff_t;
+    using pointer = uint8_t**;
+    using reference = uint8_t*;
+
+    RowIterator(uint8_t* row, int32_t stride) : row_(row), stride_(stride) {}
+
+    uint8_t* operator*() const { return row_; }
+    RowIterator& operator++() {
+      row_ += stride_;
+      return *this;
+    }
+    bool operator==(const RowIterator& other) const {
+      return row_ == other.row_;
+    }
+    bool operator!=(const RowIterator& other) const {
+      return row_ != other.row_;
+    }
+
+   private:
+    uint8_t* row_;
+    int32_t stride_;
+  };
+
+  // Holds a copy of the plane, so it stays valid after the view is gone.
+  class RowRange {
+   public:
+    explicit RowRange(const Plane& plane) : plane_(plane) {}
+    RowIterator begin() const { return {plane_.data, plane_.stride}; }
+    RowIterator end() const {
+      return {plane_.row(plane_.height), plane_.stride};
+    }
+
+   private:
+    Plane plane_;
+  };
+
+  // An invalid view.
+  FrameView();
+
+  // Describes a frame of |format| laid out the usual way: planes stored one
+  // after another, the luma plane rows |stride| bytes apart (0 means tightly
+  // packed) and the chroma strides derived from it. Returns an invalid view
+  // if |format| is not supported or |size| is too small.
+  static FrameView Create(uint8_t* data,
+                          size_t size,
+                          PixelFormat format,
+                          uint32_t width,
+                          uint32_t height,
+                          uint32_t stride = 0);
+
+  // Describes a frame whose layout is given by a codec in |image|.
+  static FrameView Create(uint8_t* data,
+                          size_t size,
+                          const MediaImage2& image);
+
+  // Uses the pixel format, size and stride of the packet's VideoSampleInfo.
+  static FrameView Create(MediaPacket& packet);
+
+  // Makes |dst| ready to receive |src| as a |width| x |height| frame of
+  // |format|, laid out with the stride already set in |dst|: grows |dst| if
+  // it is too small and resizable, then copies the sample info of |src| with
+  // the new format and size. Returns ERROR_UNSUPPORTED if the frame size can
+  // not be computed, BAD_VALUE if |dst| can not hold the frame.
+  static status_t PrepareOutput(MediaPacket& src,
+                                MediaPacket& dst,
+                                PixelFormat format,
+                                uint32_t width,
+                                uint32_t height);
+
+  // Bytes needed by Create() for a frame of |format|, 0 if unsupported.
+  static size_t FrameSize(PixelFormat format,
+                          uint32_t width,
+                          uint32_t height,
+                          uint32_t stride = 0);
+
+  bool valid() const { return num_planes_ > 0; }
+  // AV_PIX_FMT_NONE for MediaImage2 layouts without a PixelFormat equivalent
+  PixelFormat format() const { return format_; }
+  uint32_t width() const { return width_; }
+  uint32_t height() const { return height_; }
+  size_t num_planes() const { return num_planes_; }
+  const Plane& plane(size_t index) const { return planes_[index]; }
+  RowRange rows(size_t index) const { return RowRange(planes_[index]); }
+
+  // Returns a view of the |width| x |height| rectangle at |left|, |top|.
+  // The origin has to be aligned to the chroma subsampling, otherwise (or if
+  // the rectangle is out of the frame) an invalid view is returned.
+  FrameView Crop(uint32_t left,
+                 uint32_t top,
+                 uint32_t width,
+                 uint32_t height) const;
+  // Crops to kKeyCropRect / "crop" (right and bottom inclusive). Returns the
+  // view unchanged if no crop rectangle is present.
+  FrameView Crop(const MetaData& meta) const;
+  FrameView Crop(const Message& format) const;
+
+ private:
+  PixelFormat format_;
+  uint32_t width_;
+  uint32_t height_;
+  // alignment of the crop origin
+  uint32_t align_x_;
+  uint32_t align_y_;
+  size_t num_planes_;
+  Plane planes_[kMaxPlanes];
+};
+
+}  // namespace ave
+
+#endif /* !FRAME_VIEW_H */
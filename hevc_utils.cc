@@ -7,6 +7,9 @@
 
 #include "hevc_utils.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "base/checks.h"
 #include "base/logging.h"
 
@@ -15,8 +18,6 @@
 #include "buffer.h"
 #include "media_errors.h"
 
-#define UNUSED_PARAM __attribute__((unused))
-
 namespace ave {
 
 static const uint8_t kHevcNalUnitTypes[8] = {
@@ -26,9 +27,19 @@ static const uint8_t kHevcNalUnitTypes[8] = {
     kHevcNalUnitTypePrefixSei,     kHevcNalUnitTypeSuffixSei,
 };
 
-HevcParameterSets::HevcParameterSets() : mInfo(kInfoNone) {}
+HevcParameterSets::HevcParameterSets()
+    : mInfo(kInfoNone),
+      mFirstPicture(true),
+      mPrevPicOrderCntLsb(0),
+      mPrevPicOrderCntMsb(0) {
+  memset(mVps, 0, sizeof(mVps));
+  memset(mSps, 0, sizeof(mSps));
+  memset(mPps, 0, sizeof(mPps));
+  memset(&mFirstVps, 0, sizeof(mFirstVps));
+  memset(&mFirstSps, 0, sizeof(mFirstSps));
+}
 
-status_t HevcParameterSets::addNalUnit(const uint8_t* data, size_t size) {
+status_t HevcParameterSets::parseNalUnit(const uint8_t* data, size_t size) {
   if (size < 1) {
     AVE_LOG(LS_ERROR) << "empty NAL b/35467107";
     return ERROR_MALFORMED;
@@ -68,44 +79,113 @@ status_t HevcParameterSets::addNalUnit(const uint8_t* data, size_t size) {
 
   if (err != OK) {
     AVE_LOG(LS_ERROR) << "error parsing VPS or SPS or PPS";
+  }
+  return err;
+}
+
+status_t HevcParameterSets::addNalUnit(const uint8_t* data, size_t size) {
+  status_t err = parseNalUnit(data, size);
+  if (err != OK) {
     return err;
   }
 
+  uint8_t nalUnitType = (data[0] >> 1) & 0x3f;
   auto buffer = Buffer::CreateAsCopy(data, size);
   buffer->setInt32Data(nalUnitType);
   mNalUnits.push_back(buffer);
   return OK;
 }
 
-template <typename T>
-static bool findParam(uint32_t key,
-                      T* param,
-                      std::unordered_map<uint32_t, uint64_t>& params) {
+bool HevcParameterSets::findParam(uint32_t key, uint64_t* param) const {
   AVE_CHECK(param);
-  auto search = params.find(key);
+  if (key <= kGeneralLevelIdc) {
+    if (!mFirstVps.valid) {
+      return false;
+    }
+    const HevcProfileTierLevel& ptl = mFirstVps.profileTierLevel;
+    switch (key) {
+      case kGeneralProfileSpace:
+        *param = ptl.generalProfileSpace;
+        return true;
+      case kGeneralTierFlag:
+        *param = ptl.generalTierFlag;
+        return true;
+      case kGeneralProfileIdc:
+        *param = ptl.generalProfileIdc;
+        return true;
+      case kGeneralProfileCompatibilityFlags:
+        *param = ptl.generalProfileCompatibilityFlags;
+        return true;
+      case kGeneralConstraintIndicatorFlags:
+        *param = ptl.generalConstraintIndicatorFlags;
+        return true;
+      default:
+        *param = ptl.generalLevelIdc;
+        return true;
+    }
+  }
 
-  if (search == params.end()) {
+  if (!mFirstSps.valid) {
     return false;
   }
+  const HevcSps& sps = mFirstSps;
+  const HevcVui& vui = sps.vui;
+  const bool hasColour =
+      sps.vuiParametersPresent && vui.colourDescriptionPresent;
+  switch (key) {
+    case kChromaFormatIdc:
+      *param = sps.chromaFormatIdc;
+      return true;
+    case kBitDepthLumaMinus8:
+      *param = sps.bitDepthLumaMinus8;
+      return true;
+    case kBitDepthChromaMinus8:
+      *param = sps.bitDepthChromaMinus8;
+      return true;
+    case kVideoFullRangeFlag:
+      if (!sps.vuiParametersPresent || !vui.videoSignalTypePresent) {
+        return false;
+      }
+      *param = vui.videoFullRange;
+      return true;
+    case kColourPrimaries:
+      *param = vui.colourPrimaries;
+      return hasColour;
+    case kTransferCharacteristics:
+      *param = vui.transferCharacteristics;
+      return hasColour;
+    case kMatrixCoeffs:
+      *param = vui.matrixCoeffs;
+      return hasColour;
+    default:
+      return false;
+  }
+}
 
-  *param = static_cast<T>(search->second);
+template <typename T>
+bool HevcParameterSets::findParamAs(uint32_t key, T* param) const {
+  uint64_t value;
+  if (!findParam(key, &value)) {
+    return false;
+  }
+  *param = static_cast<T>(value);
   return true;
 }
 
 bool HevcParameterSets::findParam8(uint32_t key, uint8_t* param) {
-  return findParam(key, param, mParams);
+  return findParamAs(key, param);
 }
 
 bool HevcParameterSets::findParam16(uint32_t key, uint16_t* param) {
-  return findParam(key, param, mParams);
+  return findParamAs(key, param);
 }
 
 bool HevcParameterSets::findParam32(uint32_t key, uint32_t* param) {
-  return findParam(key, param, mParams);
+  return findParamAs(key, param);
 }
 
 bool HevcParameterSets::findParam64(uint32_t key, uint64_t* param) {
-  return findParam(key, param, mParams);
+  return findParamAs(key, param);
 }
 
 size_t HevcParameterSets::getNumNalUnitsOfType(uint8_t type) {
@@ -140,134 +220,334 @@ bool HevcParameterSets::write(size_t index, uint8_t* dest, size_t size) {
   return true;
 }
 
+// profile_tier_level(1, maxSubLayersMinus1), 7.3.3
+static void parseProfileTierLevel(NALBitReader* reader,
+                                  uint8_t maxSubLayersMinus1,
+                                  HevcProfileTierLevel* ptl) {
+  ptl->generalProfileSpace = reader->getBitsWithFallback(2, 0);
+  ptl->generalTierFlag = reader->getBitsWithFallback(1, 0);
+  ptl->generalProfileIdc = reader->getBitsWithFallback(5, 0);
+  ptl->generalProfileCompatibilityFlags = reader->getBitsWithFallback(32, 0);
+  ptl->generalConstraintIndicatorFlags =
+      ((uint64_t)reader->getBitsWithFallback(16, 0) << 32) |
+      reader->getBitsWithFallback(32, 0);
+  ptl->generalLevelIdc = reader->getBitsWithFallback(8, 0);
+  // 96 bits total for general profile.
+  if (maxSubLayersMinus1 > 0) {
+    bool subLayerProfilePresentFlag[8];
+    bool subLayerLevelPresentFlag[8];
+    for (int i = 0; i < maxSubLayersMinus1; ++i) {
+      subLayerProfilePresentFlag[i] = reader->getBitsWithFallback(1, 0);
+      subLayerLevelPresentFlag[i] = reader->getBitsWithFallback(1, 0);
+    }
+    // Skip reserved
+    reader->skipBits(2 * (8 - maxSubLayersMinus1));
+    for (int i = 0; i < maxSubLayersMinus1; ++i) {
+      if (subLayerProfilePresentFlag[i]) {
+        // Skip profile
+        reader->skipBits(88);
+      }
+      if (subLayerLevelPresentFlag[i]) {
+        // Skip sub_layer_level_idc[i]
+        reader->skipBits(8);
+      }
+    }
+  }
+}
+
+// scaling_list_data(), 7.3.4
+static void skipScalingListData(NALBitReader* reader) {
+  for (uint32_t sizeId = 0; sizeId < 4; ++sizeId) {
+    for (uint32_t matrixId = 0; matrixId < 6;
+         matrixId += (sizeId == 3) ? 3 : 1) {
+      if (!reader->getBitsWithFallback(1, 1)) {
+        // scaling_list_pred_mode_flag[sizeId][matrixId]
+        // scaling_list_pred_matrix_id_delta[sizeId][matrixId]
+        skipUE(reader);
+      } else {
+        uint32_t coefNum = std::min(64, (1 << (4 + (sizeId << 1))));
+        if (sizeId > 1) {
+          skipSE(reader);  // scaling_list_dc_coef_minus8[sizeId - 2][matrixId]
+        }
+        for (uint32_t i = 0; i < coefNum; ++i) {
+          skipSE(reader);  // scaling_list_delta_coef
+        }
+      }
+    }
+  }
+}
+
+// sub_layer_hrd_parameters(), E.2.3, keeps the first CPB specification
+static void parseSubLayerHrd(NALBitReader* reader,
+                             const HevcHrdParameters& hrd,
+                             bool keep,
+                             HevcSubLayerHrd* subLayer) {
+  for (uint32_t i = 0; i <= subLayer->cpbCntMinus1; ++i) {
+    uint64_t bitRateValueMinus1 = parseUEWithFallback(reader, 0);
+    uint64_t cpbSizeValueMinus1 = parseUEWithFallback(reader, 0);
+    if (hrd.subPicHrdParamsPresent) {
+      skipUE(reader);  // cpb_size_du_value_minus1[i]
+      skipUE(reader);  // bit_rate_du_value_minus1[i]
+    }
+    bool cbr = reader->getBitsWithFallback(1, 0);
+    if (keep && i == 0) {
+      subLayer->bitRate = (bitRateValueMinus1 + 1) << (6 + hrd.bitRateScale);
+      subLayer->cpbSize = (cpbSizeValueMinus1 + 1) << (4 + hrd.cpbSizeScale);
+      subLayer->cbr = cbr;
+    }
+    if (reader->overRead()) {
+      return;
+    }
+  }
+}
+
+// hrd_parameters(1, maxSubLayersMinus1), E.2.2
+static status_t parseHrdParameters(NALBitReader* reader,
+                                   uint8_t maxSubLayersMinus1,
+                                   HevcHrdParameters* hrd) {
+  hrd->nalHrdParametersPresent = reader->getBitsWithFallback(1, 0);
+  hrd->vclHrdParametersPresent = reader->getBitsWithFallback(1, 0);
+  if (hrd->nalHrdParametersPresent || hrd->vclHrdParametersPresent) {
+    hrd->subPicHrdParamsPresent = reader->getBitsWithFallback(1, 0);
+    if (hrd->subPicHrdParamsPresent) {
+      hrd->tickDivisorMinus2 = reader->getBitsWithFallback(8, 0);
+      // du_cpb_removal_delay_increment_length_minus1,
+      // sub_pic_cpb_params_in_pic_timing_sei_flag and
+      // dpb_output_delay_du_length_minus1
+      reader->skipBits(5 + 1 + 5);
+    }
+    hrd->bitRateScale = reader->getBitsWithFallback(4, 0);
+    hrd->cpbSizeScale = reader->getBitsWithFallback(4, 0);
+    if (hrd->subPicHrdParamsPresent) {
+      reader->skipBits(4);  // cpb_size_du_scale
+    }
+    hrd->initialCpbRemovalDelayLengthMinus1 =
+        reader->getBitsWithFallback(5, 0);
+    hrd->auCpbRemovalDelayLengthMinus1 = reader->getBitsWithFallback(5, 0);
+    hrd->dpbOutputDelayLengthMinus1 = reader->getBitsWithFallback(5, 0);
+  }
+  for (uint32_t i = 0; i <= maxSubLayersMinus1; ++i) {
+    HevcSubLayerHrd* subLayer = &hrd->subLayers[i];
+    subLayer->fixedPicRateGeneral = reader->getBitsWithFallback(1, 0);
+    subLayer->fixedPicRateWithinCvs = subLayer->fixedPicRateGeneral;
+    if (!subLayer->fixedPicRateGeneral) {
+      subLayer->fixedPicRateWithinCvs = reader->getBitsWithFallback(1, 0);
+    }
+    if (subLayer->fixedPicRateWithinCvs) {
+      subLayer->elementalDurationInTcMinus1 = parseUEWithFallback(reader, 0);
+    } else {
+      subLayer->lowDelayHrd = reader->getBitsWithFallback(1, 0);
+    }
+    if (!subLayer->lowDelayHrd) {
+      subLayer->cpbCntMinus1 = parseUEWithFallback(reader, 0);
+      if (subLayer->cpbCntMinus1 > 31) {
+        return ERROR_MALFORMED;
+      }
+    }
+    if (hrd->nalHrdParametersPresent) {
+      parseSubLayerHrd(reader, *hrd, true, subLayer);
+    }
+    if (hrd->vclHrdParametersPresent) {
+      parseSubLayerHrd(reader, *hrd, !hrd->nalHrdParametersPresent, subLayer);
+    }
+    if (reader->overRead()) {
+      return ERROR_MALFORMED;
+    }
+  }
+  return OK;
+}
+
+// vui_parameters(), E.2.1
+static status_t parseVui(NALBitReader* reader,
+                         uint8_t maxSubLayersMinus1,
+                         HevcVui* vui) {
+  vui->aspectRatioInfoPresent = reader->getBitsWithFallback(1, 0);
+  if (vui->aspectRatioInfoPresent) {
+    vui->aspectRatioIdc = reader->getBitsWithFallback(8, 0);
+    if (vui->aspectRatioIdc == 0xFF /* EXTENDED_SAR */) {
+      vui->sarWidth = reader->getBitsWithFallback(16, 0);
+      vui->sarHeight = reader->getBitsWithFallback(16, 0);
+    }
+  }
+  vui->overscanInfoPresent = reader->getBitsWithFallback(1, 0);
+  if (vui->overscanInfoPresent) {
+    vui->overscanAppropriate = reader->getBitsWithFallback(1, 0);
+  }
+  vui->videoSignalTypePresent = reader->getBitsWithFallback(1, 0);
+  if (vui->videoSignalTypePresent) {
+    vui->videoFormat = reader->getBitsWithFallback(3, 0);
+    vui->videoFullRange = reader->getBitsWithFallback(1, 0);
+    vui->colourDescriptionPresent = reader->getBitsWithFallback(1, 0);
+    if (vui->colourDescriptionPresent) {
+      vui->colourPrimaries = reader->getBitsWithFallback(8, 0);
+      vui->transferCharacteristics = reader->getBitsWithFallback(8, 0);
+      vui->matrixCoeffs = reader->getBitsWithFallback(8, 0);
+    }
+  }
+  vui->chromaLocInfoPresent = reader->getBitsWithFallback(1, 0);
+  if (vui->chromaLocInfoPresent) {
+    vui->chromaSampleLocTypeTopField = parseUEWithFallback(reader, 0);
+    vui->chromaSampleLocTypeBottomField = parseUEWithFallback(reader, 0);
+  }
+  vui->neutralChromaIndication = reader->getBitsWithFallback(1, 0);
+  vui->fieldSeq = reader->getBitsWithFallback(1, 0);
+  vui->frameFieldInfoPresent = reader->getBitsWithFallback(1, 0);
+  vui->defaultDisplayWindow = reader->getBitsWithFallback(1, 0);
+  if (vui->defaultDisplayWindow) {
+    vui->defDispWinLeftOffset = parseUEWithFallback(reader, 0);
+    vui->defDispWinRightOffset = parseUEWithFallback(reader, 0);
+    vui->defDispWinTopOffset = parseUEWithFallback(reader, 0);
+    vui->defDispWinBottomOffset = parseUEWithFallback(reader, 0);
+  }
+  vui->timingInfoPresent = reader->getBitsWithFallback(1, 0);
+  if (vui->timingInfoPresent) {
+    vui->numUnitsInTick = reader->getBitsWithFallback(32, 0);
+    vui->timeScale = reader->getBitsWithFallback(32, 0);
+    vui->pocProportionalToTiming = reader->getBitsWithFallback(1, 0);
+    if (vui->pocProportionalToTiming) {
+      vui->numTicksPocDiffOneMinus1 = parseUEWithFallback(reader, 0);
+    }
+    vui->hrdParametersPresent = reader->getBitsWithFallback(1, 0);
+    if (vui->hrdParametersPresent) {
+      status_t err =
+          parseHrdParameters(reader, maxSubLayersMinus1, &vui->hrd);
+      if (err != OK) {
+        return err;
+      }
+    }
+  }
+  vui->bitstreamRestriction = reader->getBitsWithFallback(1, 0);
+  if (vui->bitstreamRestriction) {
+    vui->tilesFixedStructure = reader->getBitsWithFallback(1, 0);
+    vui->motionVectorsOverPicBoundaries = reader->getBitsWithFallback(1, 0);
+    vui->restrictedRefPicLists = reader->getBitsWithFallback(1, 0);
+    vui->minSpatialSegmentationIdc = parseUEWithFallback(reader, 0);
+    vui->maxBytesPerPicDenom = parseUEWithFallback(reader, 0);
+    vui->maxBitsPerMinCuDenom = parseUEWithFallback(reader, 0);
+    vui->log2MaxMvLengthHorizontal = parseUEWithFallback(reader, 0);
+    vui->log2MaxMvLengthVertical = parseUEWithFallback(reader, 0);
+  }
+  return reader->overRead() ? ERROR_MALFORMED : OK;
+}
+
 status_t HevcParameterSets::parseVps(const uint8_t* data, size_t size) {
   // See Rec. ITU-T H.265 v3 (04/2015) Chapter 7.3.2.1 for reference
   NALBitReader reader(data, size);
-  // Skip vps_video_parameter_set_id
-  reader.skipBits(4);
+  HevcVps vps;
+  memset(&vps, 0, sizeof(vps));
+  uint32_t vpsId = reader.getBitsWithFallback(4, 0);
   // Skip vps_base_layer_internal_flag
   reader.skipBits(1);
   // Skip vps_base_layer_available_flag
   reader.skipBits(1);
   // Skip vps_max_layers_minus_1
   reader.skipBits(6);
-  // Skip vps_max_sub_layers_minus1
-  reader.skipBits(3);
+  vps.maxSubLayersMinus1 = reader.getBitsWithFallback(3, 0);
   // Skip vps_temporal_id_nesting_flags
   reader.skipBits(1);
   // Skip reserved
   reader.skipBits(16);
-
-  if (reader.atLeastNumBitsLeft(96)) {
-    mParams.emplace(kGeneralProfileSpace, reader.getBits(2));
-    mParams.emplace(kGeneralTierFlag, reader.getBits(1));
-    mParams.emplace(kGeneralProfileIdc, reader.getBits(5));
-    mParams.emplace(kGeneralProfileCompatibilityFlags, reader.getBits(32));
-    mParams.emplace(kGeneralConstraintIndicatorFlags,
-                    ((uint64_t)reader.getBits(16) << 32) | reader.getBits(32));
-    mParams.emplace(kGeneralLevelIdc, reader.getBits(8));
-    // 96 bits total for general profile.
-  } else {
-    reader.skipBits(96);
+  parseProfileTierLevel(&reader, vps.maxSubLayersMinus1,
+                        &vps.profileTierLevel);
+  if (reader.overRead() || vps.maxSubLayersMinus1 > 6) {
+    return ERROR_MALFORMED;
   }
 
-  return reader.overRead() ? ERROR_MALFORMED : OK;
+  vps.valid = true;
+  mVps[vpsId] = vps;
+  if (!mFirstVps.valid) {
+    mFirstVps = vps;
+  }
+  return OK;
 }
 
 status_t HevcParameterSets::parseSps(const uint8_t* data, size_t size) {
   // See Rec. ITU-T H.265 v3 (04/2015) Chapter 7.3.2.2 for reference
   NALBitReader reader(data, size);
-  // Skip sps_video_parameter_set_id
-  reader.skipBits(4);
-  uint8_t maxSubLayersMinus1 = reader.getBitsWithFallback(3, 0);
+  HevcSps sps;
+  memset(&sps, 0, sizeof(sps));
+  sps.vpsId = reader.getBitsWithFallback(4, 0);
+  sps.maxSubLayersMinus1 = reader.getBitsWithFallback(3, 0);
+  if (sps.maxSubLayersMinus1 > 6) {
+    return ERROR_MALFORMED;
+  }
   // Skip sps_temporal_id_nesting_flag;
   reader.skipBits(1);
-  // Skip general profile
-  reader.skipBits(96);
-  if (maxSubLayersMinus1 > 0) {
-    bool subLayerProfilePresentFlag[8];
-    bool subLayerLevelPresentFlag[8];
-    for (int i = 0; i < maxSubLayersMinus1; ++i) {
-      subLayerProfilePresentFlag[i] = reader.getBitsWithFallback(1, 0);
-      subLayerLevelPresentFlag[i] = reader.getBitsWithFallback(1, 0);
-    }
-    // Skip reserved
-    reader.skipBits(2 * (8 - maxSubLayersMinus1));
-    for (int i = 0; i < maxSubLayersMinus1; ++i) {
-      if (subLayerProfilePresentFlag[i]) {
-        // Skip profile
-        reader.skipBits(88);
-      }
-      if (subLayerLevelPresentFlag[i]) {
-        // Skip sub_layer_level_idc[i]
-        reader.skipBits(8);
-      }
-    }
+  parseProfileTierLevel(&reader, sps.maxSubLayersMinus1,
+                        &sps.profileTierLevel);
+  uint32_t spsId = parseUEWithFallback(&reader, kMaxSps);
+  if (spsId >= kMaxSps) {
+    AVE_LOG(LS_ERROR) << "invalid sps_seq_parameter_set_id " << spsId;
+    return ERROR_MALFORMED;
   }
-  // Skip sps_seq_parameter_set_id
-  skipUE(&reader);
-  uint8_t chromaFormatIdc = parseUEWithFallback(&reader, 0);
-  mParams.emplace(kChromaFormatIdc, chromaFormatIdc);
-  if (chromaFormatIdc == 3) {
-    // Skip separate_colour_plane_flag
-    reader.skipBits(1);
+  sps.chromaFormatIdc = parseUEWithFallback(&reader, 0);
+  if (sps.chromaFormatIdc > 3) {
+    return ERROR_MALFORMED;
   }
-  // Skip pic_width_in_luma_samples
-  skipUE(&reader);
-  // Skip pic_height_in_luma_samples
-  skipUE(&reader);
+  if (sps.chromaFormatIdc == 3) {
+    sps.separateColourPlane = reader.getBitsWithFallback(1, 0);
+  }
+  sps.picWidthInLumaSamples = parseUEWithFallback(&reader, 0);
+  sps.picHeightInLumaSamples = parseUEWithFallback(&reader, 0);
+  int64_t width = sps.picWidthInLumaSamples;
+  int64_t height = sps.picHeightInLumaSamples;
   if (reader.getBitsWithFallback(1, 0) /* i.e. conformance_window_flag */) {
-    // Skip conf_win_left_offset
-    skipUE(&reader);
-    // Skip conf_win_right_offset
-    skipUE(&reader);
-    // Skip conf_win_top_offset
-    skipUE(&reader);
-    // Skip conf_win_bottom_offset
-    skipUE(&reader);
-  }
-  mParams.emplace(kBitDepthLumaMinus8, parseUEWithFallback(&reader, 0));
-  mParams.emplace(kBitDepthChromaMinus8, parseUEWithFallback(&reader, 0));
+    int64_t subWidth = 1;
+    int64_t subHeight = 1;
+    if (!sps.separateColourPlane) {
+      subWidth = sps.chromaFormatIdc == 1 || sps.chromaFormatIdc == 2 ? 2 : 1;
+      subHeight = sps.chromaFormatIdc == 1 ? 2 : 1;
+    }
+    // conf_win_left/right/top/bottom_offset
+    width -= subWidth * parseUEWithFallback(&reader, 0);
+    width -= subWidth * parseUEWithFallback(&reader, 0);
+    height -= subHeight * parseUEWithFallback(&reader, 0);
+    height -= subHeight * parseUEWithFallback(&reader, 0);
+  }
+  if (width <= 0 || height <= 0 || width > INT32_MAX || height > INT32_MAX) {
+    AVE_LOG(LS_ERROR) << "invalid SPS dimensions " << width << "x" << height;
+    return ERROR_MALFORMED;
+  }
+  sps.width = static_cast<int32_t>(width);
+  sps.height = static_cast<int32_t>(height);
+  sps.bitDepthLumaMinus8 = parseUEWithFallback(&reader, 0);
+  sps.bitDepthChromaMinus8 = parseUEWithFallback(&reader, 0);
 
   // log2_max_pic_order_cnt_lsb_minus4
-  size_t log2MaxPicOrderCntLsb = parseUEWithFallback(&reader, 0) + (size_t)4;
+  sps.log2MaxPicOrderCntLsb = parseUEWithFallback(&reader, 0) + 4;
+  if (sps.log2MaxPicOrderCntLsb > 16) {
+    return ERROR_MALFORMED;
+  }
   bool spsSubLayerOrderingInfoPresentFlag = reader.getBitsWithFallback(1, 0);
-  for (uint32_t i = spsSubLayerOrderingInfoPresentFlag ? 0 : maxSubLayersMinus1;
-       i <= maxSubLayersMinus1; ++i) {
-    skipUE(&reader);  // sps_max_dec_pic_buffering_minus1[i]
-    skipUE(&reader);  // sps_max_num_reorder_pics[i]
-    skipUE(&reader);  // sps_max_latency_increase_plus1[i]
+  for (uint32_t i = spsSubLayerOrderingInfoPresentFlag
+                        ? 0
+                        : sps.maxSubLayersMinus1;
+       i <= sps.maxSubLayersMinus1; ++i) {
+    sps.maxDecPicBufferingMinus1[i] = parseUEWithFallback(&reader, 0);
+    sps.maxNumReorderPics[i] = parseUEWithFallback(&reader, 0);
+    sps.maxLatencyIncreasePlus1[i] = parseUEWithFallback(&reader, 0);
   }
 
-  skipUE(&reader);  // log2_min_luma_coding_block_size_minus3
-  skipUE(&reader);  // log2_diff_max_min_luma_coding_block_size
+  // log2_min_luma_coding_block_size_minus3
+  sps.log2MinLumaCodingBlockSize = parseUEWithFallback(&reader, 0) + 3;
+  // log2_diff_max_min_luma_coding_block_size
+  sps.log2CtbSize =
+      sps.log2MinLumaCodingBlockSize + parseUEWithFallback(&reader, 0);
+  if (sps.log2CtbSize > 6) {
+    return ERROR_MALFORMED;
+  }
+  uint32_t ctbSize = 1u << sps.log2CtbSize;
+  sps.picSizeInCtbs = ((sps.picWidthInLumaSamples + ctbSize - 1) >>
+                       sps.log2CtbSize) *
+                      ((sps.picHeightInLumaSamples + ctbSize - 1) >>
+                       sps.log2CtbSize);
   skipUE(&reader);  // log2_min_luma_transform_block_size_minus2
   skipUE(&reader);  // log2_diff_max_min_luma_transform_block_size
   skipUE(&reader);  // max_transform_hierarchy_depth_inter
   skipUE(&reader);  // max_transform_hierarchy_depth_intra
   if (reader.getBitsWithFallback(1, 0)) {  // scaling_list_enabled_flag u(1)
-    // scaling_list_data
-    if (reader.getBitsWithFallback(1,
-                                   0)) {  // sps_scaling_list_data_present_flag
-      for (uint32_t sizeId = 0; sizeId < 4; ++sizeId) {
-        for (uint32_t matrixId = 0; matrixId < 6;
-             matrixId += (sizeId == 3) ? 3 : 1) {
-          if (!reader.getBitsWithFallback(1, 1)) {
-            // scaling_list_pred_mode_flag[sizeId][matrixId]
-            skipUE(
-                &reader);  // scaling_list_pred_matrix_id_delta[sizeId][matrixId]
-          } else {
-            uint32_t coefNum = std::min(64, (1 << (4 + (sizeId << 1))));
-            if (sizeId > 1) {
-              skipSE(&reader);  // scaling_list_dc_coef_minus8[sizeId −
-                                // 2][matrixId]
-            }
-            for (uint32_t i = 0; i < coefNum; ++i) {
-              skipSE(&reader);  // scaling_list_delta_coef
-            }
-          }
-        }
-      }
+    if (reader.getBitsWithFallback(1, 0)) {  // sps_scaling_list_data_present
+      skipScalingListData(&reader);
     }
   }
   reader.skipBits(1);  // amp_enabled_flag
@@ -279,9 +559,12 @@ status_t HevcParameterSets::parseSps(const uint8_t* data, size_t size) {
     skipUE(&reader);     // log2_diff_max_min_pcm_luma_coding_block_size
     reader.skipBits(1);  // pcm_loop_filter_disabled_flag
   }
-  uint32_t numShortTermRefPicSets = parseUEWithFallback(&reader, 0);
+  sps.numShortTermRefPicSets = parseUEWithFallback(&reader, 0);
+  if (sps.numShortTermRefPicSets > 64) {
+    return ERROR_MALFORMED;
+  }
   uint32_t numPics = 0;
-  for (uint32_t i = 0; i < numShortTermRefPicSets; ++i) {
+  for (uint32_t i = 0; i < sps.numShortTermRefPicSets; ++i) {
     // st_ref_pic_set(i)
     if (i != 0 && reader.getBitsWithFallback(
                       1, 0)) {  // inter_ref_pic_set_prediction_flag
@@ -314,60 +597,254 @@ status_t HevcParameterSets::parseSps(const uint8_t* data, size_t size) {
       return ERROR_MALFORMED;
     }
   }
-  if (reader.getBitsWithFallback(1, 0)) {  // long_term_ref_pics_present_flag
+  sps.longTermRefPicsPresent = reader.getBitsWithFallback(1, 0);
+  if (sps.longTermRefPicsPresent) {
     uint32_t numLongTermRefPicSps = parseUEWithFallback(&reader, 0);
     for (uint32_t i = 0; i < numLongTermRefPicSps; ++i) {
-      reader.skipBits(log2MaxPicOrderCntLsb);  // lt_ref_pic_poc_lsb_sps[i]
+      reader.skipBits(sps.log2MaxPicOrderCntLsb);  // lt_ref_pic_poc_lsb_sps
       reader.skipBits(1);  // used_by_curr_pic_lt_sps_flag[i]
       if (reader.overRead()) {
         return ERROR_MALFORMED;
       }
     }
   }
-  reader.skipBits(1);  // sps_temporal_mvp_enabled_flag
+  sps.temporalMvpEnabled = reader.getBitsWithFallback(1, 0);
   reader.skipBits(1);  // strong_intra_smoothing_enabled_flag
-  if (reader.getBitsWithFallback(1, 0)) {    // vui_parameters_present_flag
-    if (reader.getBitsWithFallback(1, 0)) {  // aspect_ratio_info_present_flag
-      uint32_t aspectRatioIdc = reader.getBitsWithFallback(8, 0);
-      if (aspectRatioIdc == 0xFF /* EXTENDED_SAR */) {
-        reader.skipBits(16);  // sar_width
-        reader.skipBits(16);  // sar_height
+  sps.vuiParametersPresent = reader.getBitsWithFallback(1, 0);
+  if (sps.vuiParametersPresent) {
+    status_t err = parseVui(&reader, sps.maxSubLayersMinus1, &sps.vui);
+    if (err != OK) {
+      return err;
+    }
+    const HevcVui& vui = sps.vui;
+    if (vui.videoSignalTypePresent && vui.colourDescriptionPresent) {
+      mInfo = (Info)(mInfo | kInfoHasColorDescription);
+      if (vui.transferCharacteristics == 16 /* ST 2084 */
+          || vui.transferCharacteristics == 18 /* ARIB STD-B67 HLG */) {
+        mInfo = (Info)(mInfo | kInfoIsHdr);
       }
     }
-    if (reader.getBitsWithFallback(1, 0)) {  // overscan_info_present_flag
-      reader.skipBits(1);                    // overscan_appropriate_flag
+  }
+  // skip the SPS extensions
+
+  if (reader.overRead()) {
+    return ERROR_MALFORMED;
+  }
+  sps.valid = true;
+  mSps[spsId] = sps;
+  if (!mFirstSps.valid) {
+    mFirstSps = sps;
+  }
+  return OK;
+}
+
+status_t HevcParameterSets::parsePps(const uint8_t* data, size_t size) {
+  // See Rec. ITU-T H.265 v3 (04/2015) Chapter 7.3.2.3.1 for reference
+  NALBitReader reader(data, size);
+  HevcPps pps;
+  memset(&pps, 0, sizeof(pps));
+  uint32_t ppsId = parseUEWithFallback(&reader, kMaxPps);
+  pps.spsId = parseUEWithFallback(&reader, kMaxSps);
+  if (ppsId >= kMaxPps || pps.spsId >= kMaxSps) {
+    AVE_LOG(LS_ERROR) << "invalid PPS " << ppsId << " for SPS " << pps.spsId;
+    return ERROR_MALFORMED;
+  }
+  pps.dependentSliceSegmentsEnabled = reader.getBitsWithFallback(1, 0);
+  pps.outputFlagPresent = reader.getBitsWithFallback(1, 0);
+  pps.numExtraSliceHeaderBits = reader.getBitsWithFallback(3, 0);
+  pps.signDataHiding = reader.getBitsWithFallback(1, 0);
+  pps.cabacInitPresent = reader.getBitsWithFallback(1, 0);
+  pps.numRefIdxL0DefaultActiveMinus1 = parseUEWithFallback(&reader, 0);
+  pps.numRefIdxL1DefaultActiveMinus1 = parseUEWithFallback(&reader, 0);
+  pps.initQpMinus26 = parseSEWithFallback(&reader, 0);
+  pps.constrainedIntraPred = reader.getBitsWithFallback(1, 0);
+  pps.transformSkipEnabled = reader.getBitsWithFallback(1, 0);
+  pps.cuQpDeltaEnabled = reader.getBitsWithFallback(1, 0);
+  if (pps.cuQpDeltaEnabled) {
+    pps.diffCuQpDeltaDepth = parseUEWithFallback(&reader, 0);
+  }
+  pps.cbQpOffset = parseSEWithFallback(&reader, 0);
+  pps.crQpOffset = parseSEWithFallback(&reader, 0);
+  pps.sliceChromaQpOffsetsPresent = reader.getBitsWithFallback(1, 0);
+  pps.weightedPred = reader.getBitsWithFallback(1, 0);
+  pps.weightedBipred = reader.getBitsWithFallback(1, 0);
+  pps.transquantBypassEnabled = reader.getBitsWithFallback(1, 0);
+  pps.tilesEnabled = reader.getBitsWithFallback(1, 0);
+  pps.entropyCodingSyncEnabled = reader.getBitsWithFallback(1, 0);
+  if (pps.tilesEnabled) {
+    pps.numTileColumnsMinus1 = parseUEWithFallback(&reader, 0);
+    pps.numTileRowsMinus1 = parseUEWithFallback(&reader, 0);
+    if (pps.numTileColumnsMinus1 > 19 || pps.numTileRowsMinus1 > 21) {
+      return ERROR_MALFORMED;
     }
-    if (reader.getBitsWithFallback(1, 0)) {  // video_signal_type_present_flag
-      reader.skipBits(3);                    // video_format
-      uint32_t videoFullRangeFlag;
-      if (reader.getBitsGraceful(1, &videoFullRangeFlag)) {
-        mParams.emplace(kVideoFullRangeFlag, videoFullRangeFlag);
+    pps.uniformSpacing = reader.getBitsWithFallback(1, 0);
+    if (!pps.uniformSpacing) {
+      for (uint32_t i = 0; i < pps.numTileColumnsMinus1; ++i) {
+        skipUE(&reader);  // column_width_minus1[i]
       }
-      if (reader.getBitsWithFallback(1,
-                                     0)) {  // colour_description_present_flag
-        mInfo = (Info)(mInfo | kInfoHasColorDescription);
-        uint32_t colourPrimaries, transferCharacteristics, matrixCoeffs;
-        if (reader.getBitsGraceful(8, &colourPrimaries)) {
-          mParams.emplace(kColourPrimaries, colourPrimaries);
-        }
-        if (reader.getBitsGraceful(8, &transferCharacteristics)) {
-          mParams.emplace(kTransferCharacteristics, transferCharacteristics);
-          if (transferCharacteristics == 16 /* ST 2084 */
-              || transferCharacteristics == 18 /* ARIB STD-B67 HLG */) {
-            mInfo = (Info)(mInfo | kInfoIsHdr);
-          }
-        }
-        if (reader.getBitsGraceful(8, &matrixCoeffs)) {
-          mParams.emplace(kMatrixCoeffs, matrixCoeffs);
-        }
+      for (uint32_t i = 0; i < pps.numTileRowsMinus1; ++i) {
+        skipUE(&reader);  // row_height_minus1[i]
       }
-      // skip rest of VUI
     }
+    pps.loopFilterAcrossTilesEnabled = reader.getBitsWithFallback(1, 0);
+  }
+  pps.loopFilterAcrossSlicesEnabled = reader.getBitsWithFallback(1, 0);
+  pps.deblockingFilterControlPresent = reader.getBitsWithFallback(1, 0);
+  if (pps.deblockingFilterControlPresent) {
+    pps.deblockingFilterOverrideEnabled = reader.getBitsWithFallback(1, 0);
+    pps.deblockingFilterDisabled = reader.getBitsWithFallback(1, 0);
+    if (!pps.deblockingFilterDisabled) {
+      pps.betaOffsetDiv2 = parseSEWithFallback(&reader, 0);
+      pps.tcOffsetDiv2 = parseSEWithFallback(&reader, 0);
+    }
+  }
+  pps.scalingListDataPresent = reader.getBitsWithFallback(1, 0);
+  if (pps.scalingListDataPresent) {
+    skipScalingListData(&reader);
+  }
+  pps.listsModificationPresent = reader.getBitsWithFallback(1, 0);
+  pps.log2ParallelMergeLevelMinus2 = parseUEWithFallback(&reader, 0);
+  pps.sliceSegmentHeaderExtensionPresent = reader.getBitsWithFallback(1, 0);
+  // skip the PPS extensions
+
+  if (reader.overRead()) {
+    return ERROR_MALFORMED;
+  }
+  pps.valid = true;
+  mPps[ppsId] = pps;
+  return OK;
+}
+
+const HevcVps* HevcParameterSets::getVps(uint32_t id) const {
+  return id < kMaxVps && mVps[id].valid ? &mVps[id] : nullptr;
+}
+
+const HevcSps* HevcParameterSets::getSps(uint32_t id) const {
+  return id < kMaxSps && mSps[id].valid ? &mSps[id] : nullptr;
+}
+
+const HevcPps* HevcParameterSets::getPps(uint32_t id) const {
+  return id < kMaxPps && mPps[id].valid ? &mPps[id] : nullptr;
+}
+
+status_t HevcParameterSets::parseSliceHeader(
+    const uint8_t* data,
+    size_t size,
+    HevcSliceHeader* header,
+    const HevcSliceHeader* independent) const {
+  // See Rec. ITU-T H.265 v3 (04/2015) Chapter 7.3.6.1 for reference
+  if (size < 3) {
+    return ERROR_MALFORMED;
+  }
+  // |independent| may be |header| itself
+  const bool hasIndependent = independent != nullptr;
+  const HevcSliceHeader inherited =
+      hasIndependent ? *independent : HevcSliceHeader();
+  memset(header, 0, sizeof(*header));
+  header->nalUnitType = (data[0] >> 1) & 0x3f;
+  header->temporalId = (data[1] & 0x07) - 1;
+  if (header->nalUnitType > 21 ||
+      (header->nalUnitType > 9 && header->nalUnitType < 16)) {
+    return ERROR_UNSUPPORTED;
+  }
+
+  NALBitReader reader(data + 2, size - 2);
+  header->firstSliceSegmentInPic = reader.getBitsWithFallback(1, 0);
+  if (header->isIrap()) {
+    header->noOutputOfPriorPics = reader.getBitsWithFallback(1, 0);
+  }
+  header->ppsId = parseUEWithFallback(&reader, kMaxPps);
+  const HevcPps* pps = getPps(header->ppsId);
+  const HevcSps* sps = pps != nullptr ? getSps(pps->spsId) : nullptr;
+  if (sps == nullptr) {
+    AVE_LOG(LS_VERBOSE) << "slice refers to missing PPS " << header->ppsId;
+    return ERROR_MALFORMED;
+  }
+
+  if (!header->firstSliceSegmentInPic) {
+    if (pps->dependentSliceSegmentsEnabled) {
+      header->dependentSliceSegment = reader.getBitsWithFallback(1, 0);
+    }
+    // Ceil(Log2(PicSizeInCtbsY)) bits
+    uint32_t addressBits =
+        sps->picSizeInCtbs > 1 ? 32 - __builtin_clz(sps->picSizeInCtbs - 1)
+                               : 0;
+    header->sliceSegmentAddress =
+        reader.getBitsWithFallback(addressBits, 0);
+  }
+  header->picOutputFlag = true;
+  if (header->dependentSliceSegment) {
+    // the rest is inherited from the independent slice segment
+    if (hasIndependent) {
+      header->sliceType = inherited.sliceType;
+      header->picOutputFlag = inherited.picOutputFlag;
+      header->picOrderCntLsb = inherited.picOrderCntLsb;
+    } else {
+      header->sliceType = kHevcSliceTypeUnknown;
+    }
+    return reader.overRead() ? ERROR_MALFORMED : OK;
+  }
+
+  // slice_reserved_flag[i]
+  reader.skipBits(pps->numExtraSliceHeaderBits);
+  header->sliceType = parseUEWithFallback(&reader, 0);
+  if (header->sliceType > kHevcSliceTypeI) {
+    return ERROR_MALFORMED;
+  }
+  if (pps->outputFlagPresent) {
+    header->picOutputFlag = reader.getBitsWithFallback(1, 1);
+  }
+  if (sps->separateColourPlane) {
+    reader.skipBits(2);  // colour_plane_id
+  }
+  if (!header->isIdr()) {
+    header->picOrderCntLsb =
+        reader.getBitsWithFallback(sps->log2MaxPicOrderCntLsb, 0);
   }
 
   return reader.overRead() ? ERROR_MALFORMED : OK;
 }
 
+int32_t HevcParameterSets::computePicOrderCnt(const HevcSliceHeader& header) {
+  // See Rec. ITU-T H.265 v3 (04/2015) Chapter 8.3.1 for reference
+  const HevcPps* pps = getPps(header.ppsId);
+  const HevcSps* sps = pps != nullptr ? getSps(pps->spsId) : nullptr;
+  if (sps == nullptr) {
+    return 0;
+  }
+  const int32_t maxLsb = 1 << sps->log2MaxPicOrderCntLsb;
+  const int32_t lsb = static_cast<int32_t>(header.picOrderCntLsb);
+
+  // IDR and BLA pictures always start a coded video sequence, a CRA only as
+  // the first picture
+  const bool noRaslOutput =
+      header.isIrap() && (header.nalUnitType < 21 || mFirstPicture);
+  int32_t msb = 0;
+  if (!noRaslOutput) {
+    if (lsb < mPrevPicOrderCntLsb &&
+        mPrevPicOrderCntLsb - lsb >= maxLsb / 2) {
+      msb = mPrevPicOrderCntMsb + maxLsb;
+    } else if (lsb > mPrevPicOrderCntLsb &&
+               lsb - mPrevPicOrderCntLsb > maxLsb / 2) {
+      msb = mPrevPicOrderCntMsb - maxLsb;
+    } else {
+      msb = mPrevPicOrderCntMsb;
+    }
+  }
+  mFirstPicture = false;
+
+  // prevTid0Pic: TemporalId 0 and not a RASL, RADL or sub-layer
+  // non-reference picture
+  const uint8_t type = header.nalUnitType;
+  const bool subLayerNonReference = type <= 14 && (type % 2) == 0;
+  if (header.temporalId == 0 && !subLayerNonReference &&
+      (type < 6 || type > 9)) {
+    mPrevPicOrderCntLsb = lsb;
+    mPrevPicOrderCntMsb = msb;
+  }
+  return msb + lsb;
+}
+
 void HevcParameterSets::FindHEVCDimensions(
     const std::shared_ptr<Buffer>& SpsBuffer,
     int32_t* width,
@@ -418,11 +895,6 @@ void HevcParameterSets::FindHEVCDimensions(
   *height = parseUEWithFallback(&reader, 0);
 }
 
-status_t HevcParameterSets::parsePps(const uint8_t* data UNUSED_PARAM,
-                                     size_t size UNUSED_PARAM) {
-  return OK;
-}
-
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
 
 status_t HevcParameterSets::makeHvcc(uint8_t* hvcc,
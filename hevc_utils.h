@@ -9,7 +9,6 @@
 #define HEVC_UTILS_H
 
 #include <memory>
-#include <unordered_map>
 #include <vector>
 
 #include "base/constructor_magic.h"
@@ -60,6 +59,189 @@ enum {
   kMatrixCoeffs,
 };
 
+// profile_tier_level() general part, Rec. ITU-T H.265 7.3.3.
+struct HevcProfileTierLevel {
+  uint8_t generalProfileSpace;
+  uint8_t generalTierFlag;
+  uint8_t generalProfileIdc;
+  uint32_t generalProfileCompatibilityFlags;
+  // 48 bits
+  uint64_t generalConstraintIndicatorFlags;
+  uint8_t generalLevelIdc;
+};
+
+struct HevcVps {
+  bool valid;
+  uint8_t maxSubLayersMinus1;
+  HevcProfileTierLevel profileTierLevel;
+};
+
+// sub_layer_hrd_parameters() of the first CPB specification, E.2.3
+struct HevcSubLayerHrd {
+  bool fixedPicRateGeneral;
+  bool fixedPicRateWithinCvs;
+  uint32_t elementalDurationInTcMinus1;
+  bool lowDelayHrd;
+  uint32_t cpbCntMinus1;
+  // BitRate[0] and CpbSize[0] in bits, from the NAL HRD if present
+  uint64_t bitRate;
+  uint64_t cpbSize;
+  bool cbr;
+};
+
+// hrd_parameters(), E.2.2
+struct HevcHrdParameters {
+  bool nalHrdParametersPresent;
+  bool vclHrdParametersPresent;
+  bool subPicHrdParamsPresent;
+  uint8_t tickDivisorMinus2;
+  uint8_t bitRateScale;
+  uint8_t cpbSizeScale;
+  uint8_t initialCpbRemovalDelayLengthMinus1;
+  uint8_t auCpbRemovalDelayLengthMinus1;
+  uint8_t dpbOutputDelayLengthMinus1;
+  HevcSubLayerHrd subLayers[8];
+};
+
+// vui_parameters(), E.2.1
+struct HevcVui {
+  bool aspectRatioInfoPresent;
+  uint8_t aspectRatioIdc;
+  uint16_t sarWidth;
+  uint16_t sarHeight;
+  bool overscanInfoPresent;
+  bool overscanAppropriate;
+  bool videoSignalTypePresent;
+  uint8_t videoFormat;
+  bool videoFullRange;
+  bool colourDescriptionPresent;
+  uint8_t colourPrimaries;
+  uint8_t transferCharacteristics;
+  uint8_t matrixCoeffs;
+  bool chromaLocInfoPresent;
+  uint32_t chromaSampleLocTypeTopField;
+  uint32_t chromaSampleLocTypeBottomField;
+  bool neutralChromaIndication;
+  bool fieldSeq;
+  bool frameFieldInfoPresent;
+  bool defaultDisplayWindow;
+  uint32_t defDispWinLeftOffset;
+  uint32_t defDispWinRightOffset;
+  uint32_t defDispWinTopOffset;
+  uint32_t defDispWinBottomOffset;
+  bool timingInfoPresent;
+  uint32_t numUnitsInTick;
+  uint32_t timeScale;
+  bool pocProportionalToTiming;
+  uint32_t numTicksPocDiffOneMinus1;
+  bool hrdParametersPresent;
+  HevcHrdParameters hrd;
+  bool bitstreamRestriction;
+  bool tilesFixedStructure;
+  bool motionVectorsOverPicBoundaries;
+  bool restrictedRefPicLists;
+  uint32_t minSpatialSegmentationIdc;
+  uint32_t maxBytesPerPicDenom;
+  uint32_t maxBitsPerMinCuDenom;
+  uint32_t log2MaxMvLengthHorizontal;
+  uint32_t log2MaxMvLengthVertical;
+};
+
+// seq_parameter_set_rbsp(), 7.3.2.2, up to the VUI.
+struct HevcSps {
+  bool valid;
+  uint8_t vpsId;
+  uint8_t maxSubLayersMinus1;
+  HevcProfileTierLevel profileTierLevel;
+  uint8_t chromaFormatIdc;
+  bool separateColourPlane;
+  uint32_t picWidthInLumaSamples;
+  uint32_t picHeightInLumaSamples;
+  // after the conformance window
+  int32_t width;
+  int32_t height;
+  uint8_t bitDepthLumaMinus8;
+  uint8_t bitDepthChromaMinus8;
+  uint32_t log2MaxPicOrderCntLsb;
+  uint32_t maxDecPicBufferingMinus1[8];
+  uint32_t maxNumReorderPics[8];
+  uint32_t maxLatencyIncreasePlus1[8];
+  uint32_t log2MinLumaCodingBlockSize;
+  uint32_t log2CtbSize;
+  uint32_t picSizeInCtbs;
+  uint32_t numShortTermRefPicSets;
+  bool longTermRefPicsPresent;
+  bool temporalMvpEnabled;
+  bool vuiParametersPresent;
+  HevcVui vui;
+};
+
+// pic_parameter_set_rbsp(), 7.3.2.3.1, without the extensions.
+struct HevcPps {
+  bool valid;
+  uint32_t spsId;
+  bool dependentSliceSegmentsEnabled;
+  bool outputFlagPresent;
+  uint8_t numExtraSliceHeaderBits;
+  bool signDataHiding;
+  bool cabacInitPresent;
+  uint32_t numRefIdxL0DefaultActiveMinus1;
+  uint32_t numRefIdxL1DefaultActiveMinus1;
+  int32_t initQpMinus26;
+  bool constrainedIntraPred;
+  bool transformSkipEnabled;
+  bool cuQpDeltaEnabled;
+  uint32_t diffCuQpDeltaDepth;
+  int32_t cbQpOffset;
+  int32_t crQpOffset;
+  bool sliceChromaQpOffsetsPresent;
+  bool weightedPred;
+  bool weightedBipred;
+  bool transquantBypassEnabled;
+  bool tilesEnabled;
+  bool entropyCodingSyncEnabled;
+  uint32_t numTileColumnsMinus1;
+  uint32_t numTileRowsMinus1;
+  bool uniformSpacing;
+  bool loopFilterAcrossTilesEnabled;
+  bool loopFilterAcrossSlicesEnabled;
+  bool deblockingFilterControlPresent;
+  bool deblockingFilterOverrideEnabled;
+  bool deblockingFilterDisabled;
+  int32_t betaOffsetDiv2;
+  int32_t tcOffsetDiv2;
+  bool scalingListDataPresent;
+  bool listsModificationPresent;
+  uint32_t log2ParallelMergeLevelMinus2;
+  bool sliceSegmentHeaderExtensionPresent;
+};
+
+enum {
+  kHevcSliceTypeB = 0,
+  kHevcSliceTypeP = 1,
+  kHevcSliceTypeI = 2,
+  // of a dependent slice segment parsed without its independent one
+  kHevcSliceTypeUnknown = 3,
+};
+
+// slice_segment_header(), 7.3.6.1, up to slice_pic_order_cnt_lsb.
+struct HevcSliceHeader {
+  uint8_t nalUnitType;
+  uint8_t temporalId;
+  bool firstSliceSegmentInPic;
+  bool noOutputOfPriorPics;
+  uint32_t ppsId;
+  bool dependentSliceSegment;
+  uint32_t sliceSegmentAddress;
+  // kHevcSliceType*, of the independent slice segment for dependent ones
+  uint32_t sliceType;
+  bool picOutputFlag;
+  uint32_t picOrderCntLsb;
+
+  bool isIrap() const { return nalUnitType >= 16 && nalUnitType <= 23; }
+  bool isIdr() const { return nalUnitType == 19 || nalUnitType == 20; }
+};
+
 class HevcParameterSets {
  public:
   enum Info : uint32_t {
@@ -71,6 +253,9 @@ class HevcParameterSets {
   HevcParameterSets();
 
   status_t addNalUnit(const uint8_t* data, size_t size);
+  // Like addNalUnit() without keeping a copy of the NAL unit for
+  // makeHvcc(), for parameter sets repeated in a stream.
+  status_t parseNalUnit(const uint8_t* data, size_t size);
 
   bool findParam8(uint32_t key, uint8_t* param);
   bool findParam16(uint32_t key, uint16_t* param);
@@ -91,16 +276,54 @@ class HevcParameterSets {
   Info getInfo() const { return mInfo; }
   static bool IsHevcIDR(const uint8_t* data, size_t size);
 
+  const HevcVps* getVps(uint32_t id) const;
+  const HevcSps* getSps(uint32_t id) const;
+  const HevcPps* getPps(uint32_t id) const;
+
+  // Decodes the start of a slice segment NAL unit (including the two byte
+  // NAL unit header) against the parameter sets added so far. A dependent
+  // slice segment takes the fields it does not code from |independent|, the
+  // header of the preceding independent slice segment, and gets
+  // kHevcSliceTypeUnknown without one.
+  status_t parseSliceHeader(const uint8_t* data,
+                            size_t size,
+                            HevcSliceHeader* header,
+                            const HevcSliceHeader* independent = nullptr) const;
+
+  // Derives PicOrderCntVal, 8.3.1, from the header of the first slice
+  // segment of each picture, passed in decoding order.
+  int32_t computePicOrderCnt(const HevcSliceHeader& header);
+  // The next CRA starts a new coded video sequence, e.g. after a seek or an
+  // end of sequence NAL unit.
+  void resetPicOrderCnt() { mFirstPicture = true; }
+
  private:
+  static constexpr size_t kMaxVps = 16;
+  static constexpr size_t kMaxSps = 16;
+  static constexpr size_t kMaxPps = 64;
+
   status_t parseVps(const uint8_t* data, size_t size);
   status_t parseSps(const uint8_t* data, size_t size);
   status_t parsePps(const uint8_t* data, size_t size);
 
-  // KeyedVector<uint32_t, uint64_t> mParams;
-  std::unordered_map<uint32_t, uint64_t> mParams;
+  bool findParam(uint32_t key, uint64_t* param) const;
+  template <typename T>
+  bool findParamAs(uint32_t key, T* param) const;
+
+  HevcVps mVps[kMaxVps];
+  HevcSps mSps[kMaxSps];
+  HevcPps mPps[kMaxPps];
+  // the findParam*() keys are answered from copies of the first VPS and SPS
+  // added, later sets with the same id do not change them
+  HevcVps mFirstVps;
+  HevcSps mFirstSps;
   std::vector<std::shared_ptr<Buffer>> mNalUnits;
   Info mInfo;
 
+  bool mFirstPicture;
+  int32_t mPrevPicOrderCntLsb;
+  int32_t mPrevPicOrderCntMsb;
+
   AVE_DISALLOW_COPY_AND_ASSIGN(HevcParameterSets);
 };
 } /* namespace ave */
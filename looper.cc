@@ -15,6 +15,8 @@
 #include <thread>
 
 #include "../base/count_down_latch.h"
+#include "base/logging.h"
+#include "buffer_tracker.h"
 #include "handler_roster.h"
 #include "message.h"
 
@@ -49,6 +51,7 @@ int32_t Looper::start(int32_t priority) {
   }
 
   thread_ = std::make_unique<std::thread>(&Looper::loop, this);
+  thread_id_ = thread_->get_id();
   looping_ = true;
   start_latch_.Wait();
   return 0;
@@ -65,6 +68,16 @@ int32_t Looper::stop() {
   if (thread_.get()) {
     thread_->join();
     thread_.release();
+
+    BufferTracker& tracker = BufferTracker::GetInstance();
+    if (tracker.report_leaks_on_looper_stop()) {
+      std::string live = tracker.DumpLive(thread_id_);
+      if (!live.empty()) {
+        AVE_LOG(LS_WARNING) << "looper " << name_
+                            << " stopped with live buffers:\n"
+                            << live;
+      }
+    }
   }
   return 0;
 }
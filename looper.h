@@ -67,6 +67,7 @@ class Looper : public std::enable_shared_from_this<Looper> {
   std::string name_;
   int32_t priority_;
   std::unique_ptr<std::thread> thread_;
+  std::thread::id thread_id_;
   bool looping_;
   base::CountDownLatch start_latch_;
   bool stopped_;
@@ -12,8 +12,27 @@
 namespace ave {
 
 MediaBuffer::MediaBuffer(std::shared_ptr<Message> meta,
-                         std::shared_ptr<Buffer> buffer)
-    : meta_(std::move(meta)), buffer_(std::move(buffer)) {}
+                         std::shared_ptr<Buffer> buffer,
+                         const void* site)
+    : meta_(std::move(meta)),
+      buffer_(std::move(buffer)),
+      allocation_(BufferTracker::GetInstance().Track(
+          "MediaBuffer",
+          0,
+          site ? site : __builtin_return_address(0))) {}
+
+MediaBuffer::MediaBuffer(std::shared_ptr<Buffer> buffer, const void* site)
+    : MediaBuffer(nullptr,
+                  std::move(buffer),
+                  site ? site : __builtin_return_address(0)) {}
+
+// static
+__attribute__((noinline)) std::shared_ptr<MediaBuffer> MediaBuffer::Create(
+    std::shared_ptr<Buffer> buffer,
+    std::shared_ptr<Message> meta) {
+  return std::make_shared<MediaBuffer>(std::move(meta), std::move(buffer),
+                                       __builtin_return_address(0));
+}
 
 uint8_t* MediaBuffer::base() {
   return buffer_->base();
@@ -35,6 +54,9 @@ size_t MediaBuffer::offset() const {
 }
 
 std::shared_ptr<Message> MediaBuffer::meta() {
+  if (meta_ == nullptr) {
+    meta_ = std::make_shared<Message>();
+  }
   return meta_;
 }
 
@@ -42,8 +64,16 @@ void MediaBuffer::setRange(size_t offset, size_t size) {
   buffer_->setRange(offset, size);
 }
 
+void MediaBuffer::setTrackingTag(const char* tag) {
+  if (allocation_) {
+    allocation_->SetTag(tag);
+  }
+}
+
 void MediaBuffer::setMeta(std::shared_ptr<Message> meta) {
-  meta_->clear();
+  if (meta_ != nullptr) {
+    meta_->clear();
+  }
   meta_ = std::move(meta);
 }
 
@@ -14,7 +14,18 @@
 namespace ave {
 class MediaBuffer {
  public:
-  MediaBuffer(std::shared_ptr<Message> meta, std::shared_ptr<Buffer> buffer);
+  // |meta| may be null, it is then allocated on the first meta() call.
+  // |site| is the allocation site accounted by BufferTracker, as for Buffer.
+  MediaBuffer(std::shared_ptr<Message> meta,
+              std::shared_ptr<Buffer> buffer,
+              const void* site = nullptr);
+  explicit MediaBuffer(std::shared_ptr<Buffer> buffer,
+                       const void* site = nullptr);
+
+  // accounted to the caller
+  static std::shared_ptr<MediaBuffer> Create(
+      std::shared_ptr<Buffer> buffer,
+      std::shared_ptr<Message> meta = nullptr);
   virtual ~MediaBuffer() = default;
 
   uint8_t* base();
@@ -22,14 +33,24 @@ class MediaBuffer {
   size_t capacity() const;
   size_t size() const;
   size_t offset() const;
+
+  SampleMeta& sampleMeta() { return sample_meta_; }
+  const SampleMeta& sampleMeta() const { return sample_meta_; }
   std::shared_ptr<Message> meta();
+  bool hasMeta() const { return meta_ != nullptr; }
 
   void setRange(size_t offset, size_t size);
   void setMeta(std::shared_ptr<Message> meta);
 
+  // accounts the MediaBuffer under |tag| if BufferTracker is enabled, the
+  // payload bytes are accounted to the wrapped Buffer.
+  void setTrackingTag(const char* tag);
+
  private:
+  SampleMeta sample_meta_;
   std::shared_ptr<Message> meta_;
   std::shared_ptr<Buffer> buffer_;
+  std::unique_ptr<BufferTracker::Allocation> allocation_;
 };
 }  // namespace ave
 
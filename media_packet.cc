@@ -8,16 +8,28 @@
 #include "media_packet.h"
 #include "base/checks.h"
 
+#include "dma_buf_handle.h"
+
 namespace ave {
 
-MediaPacket MediaPacket::Create(size_t size) {
-  return MediaPacket(size, protect_parameter());
+// not inlined, so that the return address is the allocation site
+__attribute__((noinline)) MediaPacket MediaPacket::Create(size_t size) {
+  MediaPacket packet(size, protect_parameter());
+  packet.allocation_ = BufferTracker::GetInstance().Track(
+      "MediaPacket", size, __builtin_return_address(0));
+  return packet;
 }
 
 MediaPacket MediaPacket::CreateWithHandle(void* handle) {
   return MediaPacket(handle, protect_parameter());
 }
 
+MediaPacket MediaPacket::CreateWithHandle(
+    std::shared_ptr<DmaBufHandle> handle) {
+  AVE_CHECK(handle != nullptr);
+  return MediaPacket(std::move(handle), protect_parameter());
+}
+
 MediaPacket::MediaPacket(size_t size, protect_parameter)
     : size_(size),
       data_(std::make_shared<base::Buffer8>(size)),
@@ -34,16 +46,28 @@ MediaPacket::MediaPacket(void* handle, protect_parameter)
       media_type_(MediaType::UNKNOWN),
       sample_info_(0) {}
 
+MediaPacket::MediaPacket(std::shared_ptr<DmaBufHandle> handle,
+                         protect_parameter)
+    : size_(handle->size()),
+      data_(nullptr),
+      native_handle_(handle.get()),
+      dma_buf_handle_(std::move(handle)),
+      buffer_type_(PacketBufferType::kTypeNativeHandle),
+      media_type_(MediaType::UNKNOWN),
+      sample_info_(0) {}
+
 MediaPacket::~MediaPacket() {}
 
 MediaPacket::MediaPacket(const MediaPacket& other) {
   if (other.buffer_type_ == PacketBufferType::kTypeNormal) {
     data_ = other.data_;
+    allocation_ = other.allocation_;
     native_handle_ = nullptr;
     buffer_type_ = PacketBufferType::kTypeNormal;
   } else {
     data_ = nullptr;
     native_handle_ = other.native_handle_;
+    dma_buf_handle_ = other.dma_buf_handle_;
     buffer_type_ = PacketBufferType::kTypeNativeHandle;
   }
 
@@ -69,16 +93,34 @@ void MediaPacket::SetMediaType(MediaType type) {
 }
 
 void MediaPacket::SetSize(size_t size) {
-  AVE_DCHECK(buffer_type_ == PacketBufferType::kTypeNormal);
   AVE_DCHECK(size > 0);
+  if (dma_buf_handle_) {
+    // valid payload inside the fixed size handle
+    AVE_DCHECK_LE(size, dma_buf_handle_->size());
+    size_ = size;
+    return;
+  }
+  AVE_DCHECK(buffer_type_ == PacketBufferType::kTypeNormal);
   data_->SetSize(size);
   size_ = data_->size();
+  if (allocation_) {
+    allocation_->Resize(data_->capacity());
+  }
 }
 
 void MediaPacket::SetData(uint8_t* data, size_t size) {
   AVE_DCHECK(buffer_type_ == PacketBufferType::kTypeNormal);
   data_->SetData(data, size);
   size_ = data_->size();
+  if (allocation_) {
+    allocation_->Resize(data_->capacity());
+  }
+}
+
+void MediaPacket::SetTrackingTag(const char* tag) {
+  if (allocation_) {
+    allocation_->SetTag(tag);
+  }
 }
 
 AudioSampleInfo* MediaPacket::audio_info() {
@@ -92,6 +134,8 @@ VideoSampleInfo* MediaPacket::video_info() {
 uint8_t* MediaPacket::data() {
   if (buffer_type_ == PacketBufferType::kTypeNormal) {
     return data_->data();
+  } else if (dma_buf_handle_) {
+    return dma_buf_handle_->data();
   } else {
     return nullptr;
   }
@@ -13,10 +13,13 @@
 
 #include "base/buffer.h"
 
+#include "buffer_tracker.h"
 #include "media_utils.h"
 
 namespace ave {
 
+class DmaBufHandle;
+
 class MediaPacket {
  protected:
   // for private construct
@@ -32,10 +35,14 @@ class MediaPacket {
 
   static MediaPacket Create(size_t size);
   static MediaPacket CreateWithHandle(void* handle);
+  // memfd/dma-buf backed packet, data() maps the handle on demand and the fd
+  // is closed when the last packet referring to it goes away.
+  static MediaPacket CreateWithHandle(std::shared_ptr<DmaBufHandle> handle);
 
  private:
   explicit MediaPacket(size_t size, protect_parameter);
   MediaPacket(void* handle, protect_parameter);
+  MediaPacket(std::shared_ptr<DmaBufHandle> handle, protect_parameter);
 
  public:
   ~MediaPacket();
@@ -45,6 +52,9 @@ class MediaPacket {
   void SetMediaType(MediaType type);
   void SetSize(size_t size);
   void SetData(uint8_t* data, size_t size);
+  // accounts the payload under |tag| if BufferTracker is enabled, copies
+  // share the accounting of the payload.
+  void SetTrackingTag(const char* tag);
 
   // get sample info
   // TODO(youfa) complete other MediaType info when merge avelayer
@@ -58,13 +68,19 @@ class MediaPacket {
   MediaType media_type() const { return media_type_; }
   PacketBufferType buffer_type() const { return buffer_type_; }
   void* native_handle() const { return native_handle_; }
+  // nullptr unless created with a DmaBufHandle
+  const std::shared_ptr<DmaBufHandle>& dma_buf_handle() const {
+    return dma_buf_handle_;
+  }
 
  private:
   using SampleInfo = std::variant<int, AudioSampleInfo, VideoSampleInfo>;
 
   size_t size_;
   std::shared_ptr<base::Buffer8> data_;
+  std::shared_ptr<BufferTracker::Allocation> allocation_;
   void* native_handle_;
+  std::shared_ptr<DmaBufHandle> dma_buf_handle_;
   PacketBufferType buffer_type_;
   MediaType media_type_;
 
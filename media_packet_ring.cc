@@ -0,0 +1,402 @@
+/*
+ * media_packet_ring.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "media_packet_ring.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#include "base/checks.h"
+#include "base/logging.h"
+
+#include "media_errors.h"
+
+namespace ave {
+
+namespace {
+
+const uint32_t kRingMagic = 0x41564552;  // "AVER"
+const uint32_t kRingVersion = 1;
+const size_t kCacheLineSize = 64;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "futex words must be plain 32-bit memory");
+static_assert(std::is_trivially_copyable<AudioSampleInfo>::value &&
+                  std::is_trivially_copyable<VideoSampleInfo>::value,
+              "sample info travels through shared memory");
+
+size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+int64_t NowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// The mapping is shared between processes, so the private futex ops can not
+// be used here.
+void FutexWait(std::atomic<uint32_t>* word,
+               uint32_t expected,
+               int64_t timeout_us) {
+  struct timespec ts;
+  struct timespec* timeout = nullptr;
+  if (timeout_us >= 0) {
+    ts.tv_sec = timeout_us / 1000000;
+    ts.tv_nsec = (timeout_us % 1000000) * 1000;
+    timeout = &ts;
+  }
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected,
+          timeout, nullptr, 0);
+}
+
+void Signal(std::atomic<uint32_t>* event) {
+  event->fetch_add(1, std::memory_order_seq_cst);
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(event), FUTEX_WAKE, INT32_MAX,
+          nullptr, nullptr, 0);
+}
+
+// Waits until |pred| holds. |event| is the futex the other side bumps when it
+// makes progress while |waiting| is set.
+template <typename Pred>
+bool WaitFor(std::atomic<uint32_t>* event,
+             std::atomic<uint32_t>* waiting,
+             int64_t timeout_us,
+             Pred pred) {
+  if (pred()) {
+    return true;
+  }
+  if (timeout_us == 0) {
+    return false;
+  }
+
+  int64_t deadline_us = timeout_us > 0 ? NowUs() + timeout_us : -1;
+  for (;;) {
+    uint32_t value = event->load(std::memory_order_seq_cst);
+    waiting->store(1, std::memory_order_seq_cst);
+    // re-check after publishing |waiting| so a concurrent update either sees
+    // the flag or is seen here.
+    if (pred()) {
+      waiting->store(0, std::memory_order_relaxed);
+      return true;
+    }
+
+    int64_t remaining_us = -1;
+    if (deadline_us >= 0) {
+      remaining_us = deadline_us - NowUs();
+      if (remaining_us <= 0) {
+        waiting->store(0, std::memory_order_relaxed);
+        return pred();
+      }
+    }
+    FutexWait(event, value, remaining_us);
+    waiting->store(0, std::memory_order_relaxed);
+
+    if (pred()) {
+      return true;
+    }
+  }
+}
+
+}  // namespace
+
+struct MediaPacketRing::RingHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t slot_capacity;
+  uint32_t slot_stride;
+
+  // written by the producer
+  alignas(kCacheLineSize) std::atomic<uint32_t> head;
+  std::atomic<uint32_t> head_event;
+  std::atomic<uint32_t> producer_waiting;
+
+  // written by the consumer
+  alignas(kCacheLineSize) std::atomic<uint32_t> tail;
+  std::atomic<uint32_t> tail_event;
+  std::atomic<uint32_t> consumer_waiting;
+
+  alignas(kCacheLineSize) std::atomic<uint32_t> closed;
+};
+
+struct MediaPacketRing::SlotHeader {
+  int32_t media_type;
+  uint32_t size;
+  union {
+    AudioSampleInfo audio;
+    VideoSampleInfo video;
+  } info;
+};
+
+static const size_t kRingHeaderSize =
+    AlignUp(sizeof(MediaPacketRing::RingHeader), kCacheLineSize);
+static const size_t kSlotHeaderSize =
+    AlignUp(sizeof(MediaPacketRing::SlotHeader), kCacheLineSize);
+
+void MediaPacketRing::Slot::SetSize(size_t size) {
+  AVE_CHECK_LE(size, capacity_);
+  size_ = size;
+  header_->size = static_cast<uint32_t>(size);
+}
+
+void MediaPacketRing::Slot::SetMediaType(MediaType type) {
+  media_type_ = type;
+  header_->media_type = static_cast<int32_t>(type);
+  switch (type) {
+    case MediaType::AUDIO:
+      header_->info.audio = AudioSampleInfo();
+      break;
+    case MediaType::VIDEO:
+      header_->info.video = VideoSampleInfo();
+      break;
+    default:
+      break;
+  }
+}
+
+AudioSampleInfo* MediaPacketRing::Slot::audio_info() {
+  return media_type() == MediaType::AUDIO ? &header_->info.audio : nullptr;
+}
+
+VideoSampleInfo* MediaPacketRing::Slot::video_info() {
+  return media_type() == MediaType::VIDEO ? &header_->info.video : nullptr;
+}
+
+// static
+std::shared_ptr<MediaPacketRing> MediaPacketRing::Create(
+    size_t slot_count,
+    size_t slot_capacity) {
+  if (slot_count == 0 || slot_capacity == 0 || slot_capacity > UINT32_MAX) {
+    return nullptr;
+  }
+
+  size_t stride = kSlotHeaderSize + AlignUp(slot_capacity, kCacheLineSize);
+  auto handle = DmaBufHandle::CreateMemfd(
+      kRingHeaderSize + stride * slot_count, "ave-packet-ring");
+  if (handle == nullptr || handle->data() == nullptr) {
+    return nullptr;
+  }
+
+  // memfd is zero filled, only the constant part needs to be written.
+  RingHeader* ring = new (handle->data()) RingHeader();
+  ring->slot_count = static_cast<uint32_t>(slot_count);
+  ring->slot_capacity = static_cast<uint32_t>(slot_capacity);
+  ring->slot_stride = static_cast<uint32_t>(stride);
+  ring->version = kRingVersion;
+  std::atomic_thread_fence(std::memory_order_release);
+  ring->magic = kRingMagic;
+
+  return std::make_shared<MediaPacketRing>(std::move(handle), slot_count,
+                                           slot_capacity, stride,
+                                           protect_parameter());
+}
+
+// static
+std::shared_ptr<MediaPacketRing> MediaPacketRing::Attach(
+    std::shared_ptr<DmaBufHandle> handle) {
+  if (handle == nullptr || handle->size() < kRingHeaderSize ||
+      handle->data() == nullptr) {
+    return nullptr;
+  }
+
+  // the peer may still write the header, so every field is read exactly once
+  const volatile RingHeader* ring =
+      reinterpret_cast<RingHeader*>(handle->data());
+  uint32_t magic = ring->magic;
+  uint32_t version = ring->version;
+  if (magic != kRingMagic || version != kRingVersion) {
+    AVE_LOG(LS_ERROR) << "not a packet ring, magic: " << magic
+                      << ", version: " << version;
+    return nullptr;
+  }
+
+  size_t slot_count = ring->slot_count;
+  size_t slot_capacity = ring->slot_capacity;
+  size_t stride = ring->slot_stride;
+  if (slot_count == 0 || slot_capacity == 0 || stride % kCacheLineSize != 0 ||
+      stride < kSlotHeaderSize + slot_capacity ||
+      (handle->size() - kRingHeaderSize) / stride < slot_count) {
+    AVE_LOG(LS_ERROR) << "packet ring layout does not fit its handle";
+    return nullptr;
+  }
+
+  return std::make_shared<MediaPacketRing>(std::move(handle), slot_count,
+                                           slot_capacity, stride,
+                                           protect_parameter());
+}
+
+MediaPacketRing::MediaPacketRing(std::shared_ptr<DmaBufHandle> handle,
+                                 size_t slot_count,
+                                 size_t slot_capacity,
+                                 size_t slot_stride,
+                                 protect_parameter)
+    : handle_(std::move(handle)),
+      ring_(reinterpret_cast<RingHeader*>(handle_->data())),
+      slots_(handle_->data() + kRingHeaderSize),
+      slot_count_(slot_count),
+      slot_capacity_(slot_capacity),
+      slot_stride_(slot_stride),
+      writing_(false),
+      reading_(false) {}
+
+MediaPacketRing::~MediaPacketRing() = default;
+
+MediaPacketRing::SlotHeader* MediaPacketRing::slotAt(uint32_t index) {
+  return reinterpret_cast<SlotHeader*>(slots_ +
+                                       (index % slot_count_) * slot_stride_);
+}
+
+MediaPacketRing::Slot* MediaPacketRing::AcquireWriteSlot(int64_t timeout_us) {
+  AVE_DCHECK(!writing_);
+  uint32_t head = ring_->head.load(std::memory_order_relaxed);
+  bool ready = WaitFor(&ring_->tail_event, &ring_->producer_waiting, timeout_us,
+                       [this, head]() {
+                         return closed() ||
+                                head - ring_->tail.load(
+                                           std::memory_order_acquire) <
+                                    slot_count_;
+                       });
+  if (!ready || closed()) {
+    return nullptr;
+  }
+
+  SlotHeader* header = slotAt(head);
+  header->media_type = static_cast<int32_t>(MediaType::UNKNOWN);
+  header->size = 0;
+  write_slot_.header_ = header;
+  write_slot_.data_ = reinterpret_cast<uint8_t*>(header) + kSlotHeaderSize;
+  write_slot_.capacity_ = slot_capacity_;
+  write_slot_.size_ = 0;
+  write_slot_.media_type_ = MediaType::UNKNOWN;
+  writing_ = true;
+  return &write_slot_;
+}
+
+void MediaPacketRing::CommitWriteSlot() {
+  AVE_DCHECK(writing_);
+  writing_ = false;
+  ring_->head.fetch_add(1, std::memory_order_seq_cst);
+  if (ring_->consumer_waiting.load(std::memory_order_seq_cst)) {
+    Signal(&ring_->head_event);
+  }
+}
+
+status_t MediaPacketRing::Write(MediaPacket& packet, int64_t timeout_us) {
+  if (packet.size() > slot_capacity()) {
+    return ERROR_BUFFER_TOO_SMALL;
+  }
+
+  Slot* slot = AcquireWriteSlot(timeout_us);
+  if (slot == nullptr) {
+    return closed() ? static_cast<status_t>(ERROR_END_OF_STREAM) : TIMED_OUT;
+  }
+
+  if (packet.size() > 0) {
+    memcpy(slot->data(), packet.data(), packet.size());
+  }
+  slot->SetSize(packet.size());
+  slot->SetMediaType(packet.media_type());
+  if (packet.audio_info()) {
+    *slot->audio_info() = *packet.audio_info();
+  } else if (packet.video_info()) {
+    *slot->video_info() = *packet.video_info();
+  }
+  CommitWriteSlot();
+  return OK;
+}
+
+MediaPacketRing::Slot* MediaPacketRing::AcquireReadSlot(int64_t timeout_us) {
+  return acquireReadSlot(timeout_us) == OK ? &read_slot_ : nullptr;
+}
+
+status_t MediaPacketRing::acquireReadSlot(int64_t timeout_us) {
+  AVE_DCHECK(!reading_);
+  uint32_t tail = ring_->tail.load(std::memory_order_relaxed);
+  auto readable = [this, tail]() {
+    return ring_->head.load(std::memory_order_acquire) != tail;
+  };
+  bool ready = WaitFor(&ring_->head_event, &ring_->consumer_waiting, timeout_us,
+                       [this, &readable]() { return readable() || closed(); });
+  // pending slots are still delivered after Close()
+  if (!ready || !readable()) {
+    return closed() ? static_cast<status_t>(ERROR_END_OF_STREAM) : TIMED_OUT;
+  }
+
+  SlotHeader* header = slotAt(tail);
+  // the producer may still write the header, so it is read exactly once
+  const volatile SlotHeader* shared = header;
+  size_t size = shared->size;
+  int32_t media_type = shared->media_type;
+  reading_ = true;
+  if (size > slot_capacity_ ||
+      media_type < static_cast<int32_t>(MediaType::UNKNOWN) ||
+      media_type >= static_cast<int32_t>(MediaType::NB)) {
+    AVE_LOG(LS_ERROR) << "dropping corrupt slot, size: " << size
+                      << ", media type: " << media_type;
+    ReleaseReadSlot();
+    return ERROR_MALFORMED;
+  }
+
+  read_slot_.header_ = header;
+  read_slot_.data_ = reinterpret_cast<uint8_t*>(header) + kSlotHeaderSize;
+  read_slot_.capacity_ = slot_capacity_;
+  read_slot_.size_ = size;
+  read_slot_.media_type_ = static_cast<MediaType>(media_type);
+  return OK;
+}
+
+void MediaPacketRing::ReleaseReadSlot() {
+  AVE_DCHECK(reading_);
+  reading_ = false;
+  ring_->tail.fetch_add(1, std::memory_order_seq_cst);
+  if (ring_->producer_waiting.load(std::memory_order_seq_cst)) {
+    Signal(&ring_->tail_event);
+  }
+}
+
+status_t MediaPacketRing::Read(std::unique_ptr<MediaPacket>& packet,
+                               int64_t timeout_us) {
+  status_t err = acquireReadSlot(timeout_us);
+  if (err != OK) {
+    return err;
+  }
+
+  Slot* slot = &read_slot_;
+  packet = std::make_unique<MediaPacket>(
+      MediaPacket::Create(slot->size() > 0 ? slot->size() : 1));
+  packet->SetData(slot->data(), slot->size());
+  packet->SetMediaType(slot->media_type());
+  if (slot->audio_info()) {
+    *packet->audio_info() = *slot->audio_info();
+  } else if (slot->video_info()) {
+    *packet->video_info() = *slot->video_info();
+  }
+  ReleaseReadSlot();
+  return OK;
+}
+
+void MediaPacketRing::Close() {
+  ring_->closed.store(1, std::memory_order_seq_cst);
+  Signal(&ring_->head_event);
+  Signal(&ring_->tail_event);
+}
+
+bool MediaPacketRing::closed() const {
+  return ring_->closed.load(std::memory_order_acquire) != 0;
+}
+
+}  // namespace ave
@@ -0,0 +1,138 @@
+/*
+ * media_packet_ring.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef MEDIA_PACKET_RING_H
+#define MEDIA_PACKET_RING_H
+
+#include <memory>
+
+#include "base/constructor_magic.h"
+#include "base/errors.h"
+
+#include "dma_buf_handle.h"
+#include "media_packet.h"
+#include "media_utils.h"
+
+namespace ave {
+
+// Single-producer single-consumer ring of MediaPacket slots living in a memfd,
+// so a demuxer and a decoder in different processes can exchange samples
+// without copying them through a socket.
+//
+// One side calls Create() and passes handle() to the peer (e.g. with
+// DmaBufHandle::SendHandle()), which calls Attach(). Payloads are written in
+// place into the slot returned by AcquireWriteSlot() and sample info travels
+// inline in the slot header. Both sides sleep on futexes in the shared
+// mapping, and wakeups are only issued when the other side is waiting.
+class MediaPacketRing {
+ protected:
+  // for private construct
+  struct protect_parameter {
+    explicit protect_parameter() {}
+  };
+
+ public:
+  // shared memory layout, see media_packet_ring.cc
+  struct RingHeader;
+  struct SlotHeader;
+
+  // A slot of the ring, valid between Acquire*Slot() and
+  // CommitWriteSlot()/ReleaseReadSlot(). The size and media type of a read
+  // slot are taken once from the shared memory and validated.
+  class Slot {
+   public:
+    uint8_t* data() { return data_; }
+    size_t capacity() const { return capacity_; }
+    size_t size() const { return size_; }
+    MediaType media_type() const { return media_type_; }
+
+    // producer only
+    void SetSize(size_t size);
+    void SetMediaType(MediaType type);
+
+    AudioSampleInfo* audio_info();
+    VideoSampleInfo* video_info();
+
+   private:
+    friend class MediaPacketRing;
+    Slot()
+        : header_(nullptr),
+          data_(nullptr),
+          capacity_(0),
+          size_(0),
+          media_type_(MediaType::UNKNOWN) {}
+
+    SlotHeader* header_;
+    uint8_t* data_;
+    size_t capacity_;
+    size_t size_;
+    MediaType media_type_;
+  };
+
+  // Creates a ring with |slot_count| slots of |slot_capacity| payload bytes.
+  static std::shared_ptr<MediaPacketRing> Create(size_t slot_count,
+                                                 size_t slot_capacity);
+  // Maps a ring created by another process. Returns nullptr if |handle| does
+  // not contain a valid ring. The layout is read once here, later changes of
+  // it in the shared memory are ignored.
+  static std::shared_ptr<MediaPacketRing> Attach(
+      std::shared_ptr<DmaBufHandle> handle);
+
+  MediaPacketRing(std::shared_ptr<DmaBufHandle> handle,
+                  size_t slot_count,
+                  size_t slot_capacity,
+                  size_t slot_stride,
+                  protect_parameter);
+  ~MediaPacketRing();
+
+  const std::shared_ptr<DmaBufHandle>& handle() const { return handle_; }
+  size_t slot_count() const { return slot_count_; }
+  size_t slot_capacity() const { return slot_capacity_; }
+
+  // Producer side. |timeout_us| < 0 waits forever, 0 does not wait.
+  // Returns nullptr if the ring stayed full or was closed.
+  Slot* AcquireWriteSlot(int64_t timeout_us = -1);
+  void CommitWriteSlot();
+  // Copies |packet| into the next slot.
+  status_t Write(MediaPacket& packet, int64_t timeout_us = -1);
+
+  // Consumer side. Returns nullptr if the ring stayed empty or was closed and
+  // drained, or if the next slot is corrupt, which is then dropped.
+  Slot* AcquireReadSlot(int64_t timeout_us = -1);
+  void ReleaseReadSlot();
+  // Copies the next slot into a newly allocated packet. Returns
+  // ERROR_MALFORMED and drops the slot if its size is above the capacity or
+  // its media type is unknown.
+  status_t Read(std::unique_ptr<MediaPacket>& packet, int64_t timeout_us = -1);
+
+  // Wakes up both sides, pending slots can still be read.
+  void Close();
+  bool closed() const;
+
+ private:
+  SlotHeader* slotAt(uint32_t index);
+  status_t acquireReadSlot(int64_t timeout_us);
+
+  std::shared_ptr<DmaBufHandle> handle_;
+  RingHeader* ring_;
+  uint8_t* slots_;
+  // private copies of the layout, the peer can not change them
+  const size_t slot_count_;
+  const size_t slot_capacity_;
+  const size_t slot_stride_;
+
+  Slot write_slot_;
+  Slot read_slot_;
+  bool writing_;
+  bool reading_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(MediaPacketRing);
+};
+
+}  // namespace ave
+
+#endif /* !MEDIA_PACKET_RING_H */
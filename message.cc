@@ -303,6 +303,11 @@ bool Message::findObject(const char* name,
 std::shared_ptr<Message> Message::dup() const {
   std::shared_ptr<Message> message =
       std::make_shared<Message>(what_, handler_.lock());
+  // nested messages, buffers and objects are shared, not duplicated
+  for (const auto& item : items_) {
+    message->items_.emplace(item.first,
+                            std::make_shared<Item>(*item.second));
+  }
 
   return message;
 }
@@ -149,7 +149,8 @@ class Message : public std::enable_shared_from_this<Message> {
 
   status_t postReply(const std::shared_ptr<ReplyToken>& replyId);
 
-  // return a depp copy of Message
+  // Returns a copy of the what, handler and items. Nested messages, buffers
+  // and objects are shared with the copy, not duplicated.
   std::shared_ptr<Message> dup() const;
 
  private:
@@ -29,8 +29,7 @@ bool MakeAVCCodecSpecificData(MetaData& meta,
   int32_t height;
   int32_t sarWidth;
   int32_t sarHeight;
-  std::shared_ptr<Buffer> accessUnit =
-      std::make_shared<Buffer>((void*)(data), size);
+  std::shared_ptr<Buffer> accessUnit = Buffer::Create((void*)(data), size);
   std::shared_ptr<Buffer> csd = MakeAVCCodecSpecificData(
       accessUnit, &width, &height, &sarWidth, &sarHeight);
   if (csd == nullptr) {
@@ -59,8 +58,7 @@ bool MakeAVCCodecSpecificData(std::shared_ptr<Message>& meta,
   int32_t height;
   int32_t sarWidth;
   int32_t sarHeight;
-  std::shared_ptr<Buffer> accessUnit =
-      std::make_shared<Buffer>((void*)data, size);
+  std::shared_ptr<Buffer> accessUnit = Buffer::Create((void*)data, size);
   std::shared_ptr<Buffer> csd = MakeAVCCodecSpecificData(
       accessUnit, &width, &height, &sarWidth, &sarHeight);
   if (csd == nullptr) {
@@ -182,7 +180,7 @@ bool MakeAACCodecSpecificData(std::shared_ptr<Message>& meta,
                                           16000, 12000, 11025, 8000};
   int32_t sampleRate = kSamplingFreq[sampling_freq_index];
 
-  auto csdBuffer = std::make_shared<Buffer>(csd, sizeof(csd));
+  auto csdBuffer = Buffer::Create(csd, sizeof(csd));
 
   meta->setBuffer("csd-0", csdBuffer);
   meta->setString("mime", MEDIA_MIMETYPE_AUDIO_AAC);
@@ -8,7 +8,10 @@
 #ifndef META_DATA_UTILS_H
 #define META_DATA_UTILS_H
 
+#include <memory>
+
 #include "meta_data.h"
+#include "message.h"
 
 namespace ave {
 
@@ -0,0 +1,292 @@
+/*
+ * mpeg_audio_framer.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "mpeg_audio_framer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+
+#include "avc_utils.h"
+#include "start_code.h"
+
+namespace ave {
+
+namespace {
+
+// sync, version, layer and sampling rate stay the same within a stream
+const uint32_t kSyncMask = 0xfffe0c00;
+const size_t kHeaderSize = 4;
+const size_t kId3HeaderSize = 10;
+
+uint32_t ReadBE32(const uint8_t* p) {
+  return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) |
+         p[3];
+}
+
+}  // namespace
+
+bool ParseMPEGAudioVbrHeader(const uint8_t* frame,
+                             size_t size,
+                             MPEGAudioVbrHeader* header) {
+  if (size < kHeaderSize) {
+    return false;
+  }
+  memset(header, 0, sizeof(*header));
+  header->encoder_delay = -1;
+  header->encoder_padding = -1;
+
+  // the Xing header follows the side information of the first granule
+  uint32_t frameHeader = ReadBE32(frame);
+  bool mpeg1 = ((frameHeader >> 19) & 3) == 3;
+  bool mono = ((frameHeader >> 6) & 3) == 3;
+  bool crc = !((frameHeader >> 16) & 1);
+  size_t offset = kHeaderSize + (crc ? 2 : 0) +
+                  (mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+  if (offset + 8 <= size && (!memcmp(frame + offset, "Xing", 4) ||
+                             !memcmp(frame + offset, "Info", 4))) {
+    header->type = frame[offset] == 'X' ? MPEGAudioVbrHeader::Type::kXing
+                                        : MPEGAudioVbrHeader::Type::kInfo;
+    uint32_t flags = ReadBE32(frame + offset + 4);
+    offset += 8;
+    if ((flags & 0x01) && offset + 4 <= size) {
+      header->num_frames = ReadBE32(frame + offset);
+      offset += 4;
+    }
+    if ((flags & 0x02) && offset + 4 <= size) {
+      header->num_bytes = ReadBE32(frame + offset);
+      offset += 4;
+    }
+    if ((flags & 0x04) && offset + sizeof(header->toc) <= size) {
+      header->has_toc = true;
+      memcpy(header->toc, frame + offset, sizeof(header->toc));
+      offset += sizeof(header->toc);
+    }
+    if (flags & 0x08) {
+      offset += 4;  // quality
+    }
+    // LAME tag, ffmpeg writes the same layout: 9 bytes of encoder version,
+    // then the 12 bit delay and padding 21 bytes in
+    if (offset + 24 <= size && (!memcmp(frame + offset, "LAME", 4) ||
+                                !memcmp(frame + offset, "Lavf", 4) ||
+                                !memcmp(frame + offset, "Lavc", 4))) {
+      const uint8_t* p = frame + offset + 21;
+      header->encoder_delay = (p[0] << 4) | (p[1] >> 4);
+      header->encoder_padding = ((p[1] & 0x0f) << 8) | p[2];
+    }
+    return true;
+  }
+
+  // VBRI is always 32 bytes after the frame header
+  offset = kHeaderSize + 32;
+  if (offset + 18 <= size && !memcmp(frame + offset, "VBRI", 4)) {
+    header->type = MPEGAudioVbrHeader::Type::kVbri;
+    header->num_bytes = ReadBE32(frame + offset + 10);
+    header->num_frames = ReadBE32(frame + offset + 14);
+    return true;
+  }
+  return false;
+}
+
+MPEGAudioFramer::MPEGAudioFramer(size_t sync_frames)
+    : sync_frames_(std::max<size_t>(sync_frames, 1)) {
+  Reset();
+}
+
+void MPEGAudioFramer::Reset() {
+  buffer_.clear();
+  offset_ = 0;
+  timestamps_.clear();
+  at_start_ = true;
+  skip_ = 0;
+  synced_ = false;
+  sync_header_ = 0;
+  first_frame_ = true;
+  has_vbr_header_ = false;
+  base_pts_us_ = -1;
+  samples_since_base_ = 0;
+}
+
+void MPEGAudioFramer::Push(const uint8_t* data,
+                           size_t size,
+                           int64_t pts_us,
+                           std::vector<Frame>* frames) {
+  // the data before |offset_| belongs to frames already returned
+  buffer_.erase(buffer_.begin(), buffer_.begin() + offset_);
+  for (Timestamp& timestamp : timestamps_) {
+    timestamp.offset -= std::min(timestamp.offset, offset_);
+  }
+  offset_ = 0;
+
+  if (pts_us >= 0) {
+    timestamps_.push_back({buffer_.size(), pts_us});
+  }
+  buffer_.insert(buffer_.end(), data, data + size);
+  Process(false, frames);
+}
+
+void MPEGAudioFramer::Flush(std::vector<Frame>* frames) {
+  Process(true, frames);
+  timestamps_.clear();
+}
+
+void MPEGAudioFramer::Process(bool eos, std::vector<Frame>* frames) {
+  while (true) {
+    if (at_start_ && !SkipId3(eos)) {
+      return;
+    }
+    if (skip_ > 0) {
+      size_t n = std::min(skip_, buffer_.size() - offset_);
+      offset_ += n;
+      skip_ -= n;
+      if (skip_ > 0) {
+        return;
+      }
+    }
+
+    const uint8_t* data = buffer_.data();
+    if (!synced_) {
+      size_t size = buffer_.size() - offset_;
+      size_t pos = offset_ + FindMPEGAudioSync(data + offset_, size);
+      if (pos + kHeaderSize > buffer_.size()) {
+        // an FF at the end may be the first half of a sync word
+        if (eos) {
+          offset_ = buffer_.size();
+        } else if (pos == buffer_.size() && size > 0 &&
+                   buffer_.back() == 0xff) {
+          offset_ = buffer_.size() - 1;
+        } else {
+          offset_ = pos;
+        }
+        return;
+      }
+      Confirm confirm = ConfirmSync(pos, eos);
+      if (confirm == Confirm::kNeedMoreData) {
+        offset_ = pos;
+        return;
+      }
+      if (confirm == Confirm::kNo) {
+        offset_ = pos + 1;
+        continue;
+      }
+      synced_ = true;
+      sync_header_ = ReadBE32(data + pos);
+      offset_ = pos;
+    }
+
+    size_t size = buffer_.size() - offset_;
+    if (size < kHeaderSize) {
+      if (eos) {
+        offset_ = buffer_.size();
+      }
+      return;
+    }
+    uint32_t header = ReadBE32(data + offset_);
+    size_t frameSize;
+    if ((header & kSyncMask) != (sync_header_ & kSyncMask) ||
+        !GetMPEGAudioFrameSize(header, &frameSize)) {
+      AVE_LOG(LS_VERBOSE) << "lost MPEG audio sync";
+      synced_ = false;
+      offset_ += 1;
+      continue;
+    }
+    if (frameSize > size) {
+      if (eos) {
+        // truncated last frame
+        offset_ = buffer_.size();
+      }
+      return;
+    }
+    EmitFrame(offset_, frameSize, header, frames);
+    offset_ += frameSize;
+  }
+}
+
+bool MPEGAudioFramer::SkipId3(bool eos) {
+  const size_t size = buffer_.size() - offset_;
+  if (size < kId3HeaderSize && !eos) {
+    return false;
+  }
+  at_start_ = false;
+  const uint8_t* p = buffer_.data() + offset_;
+  if (size >= kId3HeaderSize && !memcmp(p, "ID3", 3)) {
+    // syncsafe size without the header, and the footer if flagged
+    skip_ = kId3HeaderSize + ((p[6] & 0x7f) << 21) + ((p[7] & 0x7f) << 14) +
+            ((p[8] & 0x7f) << 7) + (p[9] & 0x7f);
+    if (p[5] & 0x10) {
+      skip_ += kId3HeaderSize;
+    }
+  }
+  return true;
+}
+
+MPEGAudioFramer::Confirm MPEGAudioFramer::ConfirmSync(size_t offset,
+                                                      bool eos) const {
+  const uint8_t* data = buffer_.data();
+  uint32_t header = ReadBE32(data + offset);
+  size_t frameSize;
+  if (!GetMPEGAudioFrameSize(header, &frameSize)) {
+    return Confirm::kNo;
+  }
+  size_t pos = offset;
+  for (size_t i = 1; i < sync_frames_; ++i) {
+    pos += frameSize;
+    if (pos + kHeaderSize > buffer_.size()) {
+      if (!eos) {
+        return Confirm::kNeedMoreData;
+      }
+      // the stream ends, the frames that are there agree
+      return pos <= buffer_.size() ? Confirm::kYes : Confirm::kNo;
+    }
+    uint32_t next = ReadBE32(data + pos);
+    if ((next & kSyncMask) != (header & kSyncMask) ||
+        !GetMPEGAudioFrameSize(next, &frameSize)) {
+      return Confirm::kNo;
+    }
+  }
+  return Confirm::kYes;
+}
+
+void MPEGAudioFramer::EmitFrame(size_t offset,
+                                size_t size,
+                                uint32_t header,
+                                std::vector<Frame>* frames) {
+  const uint8_t* data = buffer_.data() + offset;
+  if (first_frame_) {
+    first_frame_ = false;
+    if (ParseMPEGAudioVbrHeader(data, size, &vbr_header_)) {
+      has_vbr_header_ = true;
+      return;
+    }
+  }
+
+  Frame frame;
+  frame.data = data;
+  frame.size = size;
+  size_t frameSize;
+  GetMPEGAudioFrameSize(header, &frameSize, &frame.sample_rate,
+                        &frame.channels, &frame.bitrate, &frame.num_samples);
+
+  // the last chunk that started at or before the frame
+  size_t used = 0;
+  while (used < timestamps_.size() && timestamps_[used].offset <= offset) {
+    base_pts_us_ = timestamps_[used].pts_us;
+    samples_since_base_ = 0;
+    ++used;
+  }
+  timestamps_.erase(timestamps_.begin(), timestamps_.begin() + used);
+  frame.pts_us = -1;
+  if (base_pts_us_ >= 0) {
+    frame.pts_us =
+        base_pts_us_ + samples_since_base_ * 1000000 / frame.sample_rate;
+  }
+  samples_since_base_ += frame.num_samples;
+  frames->push_back(frame);
+}
+
+}  // namespace ave
@@ -0,0 +1,135 @@
+/*
+ * mpeg_audio_framer.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef MPEG_AUDIO_FRAMER_H
+#define MPEG_AUDIO_FRAMER_H
+
+#include <vector>
+
+#include "base/constructor_magic.h"
+#include "base/types.h"
+
+namespace ave {
+
+// Xing/Info or VBRI header in the first frame of an MP3 stream. The frame
+// holds no audio.
+struct MPEGAudioVbrHeader {
+  enum class Type {
+    kXing,
+    // Xing layout written by LAME for CBR streams
+    kInfo,
+    kVbri,
+  };
+  Type type;
+  // 0 if not present
+  uint32_t num_frames;
+  uint32_t num_bytes;
+  bool has_toc;
+  uint8_t toc[100];
+  // from the LAME tag, in samples, -1 without one. These go to
+  // kKeyEncoderDelay and kKeyEncoderPadding.
+  int32_t encoder_delay;
+  int32_t encoder_padding;
+};
+
+// Parses the Xing/Info or VBRI header of |frame|, a whole MPEG audio frame.
+// Returns false if it has none.
+bool ParseMPEGAudioVbrHeader(const uint8_t* frame,
+                             size_t size,
+                             MPEGAudioVbrHeader* header);
+
+// Splits an MPEG-1/2/2.5 layer I-III elementary stream that arrives in
+// arbitrary chunks into frames. Sync words are found with
+// FindMPEGAudioSync(), and a candidate frame header is only trusted once the
+// headers of the next |sync_frames| - 1 frames agree with it. A frame whose
+// header does not match the stream any more drops the sync, and scanning
+// resumes right after its sync word.
+//
+// A leading ID3v2 tag is skipped, and a Xing/Info/VBRI frame is reported
+// through vbr_header() instead of being returned.
+class MPEGAudioFramer {
+ public:
+  struct Frame {
+    // valid until the next call to the framer
+    const uint8_t* data;
+    size_t size;
+    // of the chunk the frame started in, else extrapolated from the
+    // previous timestamp and the sample counts, -1 if not known
+    int64_t pts_us;
+    int32_t num_samples;
+    int32_t sample_rate;
+    int32_t channels;
+    // kbit/s
+    int32_t bitrate;
+  };
+
+  explicit MPEGAudioFramer(size_t sync_frames = 3);
+
+  // Adds the next chunk of the stream, -1 if |pts_us| is not known. Frames
+  // completed by the chunk are appended to |frames|.
+  void Push(const uint8_t* data,
+            size_t size,
+            int64_t pts_us,
+            std::vector<Frame>* frames);
+
+  // Ends the stream. Sync candidates near the end are confirmed by the
+  // frames that are there, a truncated last frame is dropped.
+  void Flush(std::vector<Frame>* frames);
+
+  // Drops buffered data and the sync, e.g. after a seek.
+  void Reset();
+
+  const MPEGAudioVbrHeader* vbr_header() const {
+    return has_vbr_header_ ? &vbr_header_ : nullptr;
+  }
+
+ private:
+  struct Timestamp {
+    size_t offset;
+    int64_t pts_us;
+  };
+
+  enum class Confirm {
+    kYes,
+    kNo,
+    kNeedMoreData,
+  };
+
+  void Process(bool eos, std::vector<Frame>* frames);
+  // Skips an ID3v2 tag at the start of the stream, false until its header
+  // is complete.
+  bool SkipId3(bool eos);
+  Confirm ConfirmSync(size_t offset, bool eos) const;
+  void EmitFrame(size_t offset,
+                 size_t size,
+                 uint32_t header,
+                 std::vector<Frame>* frames);
+
+  const size_t sync_frames_;
+  std::vector<uint8_t> buffer_;
+  // where scanning resumes
+  size_t offset_;
+  std::vector<Timestamp> timestamps_;
+
+  bool at_start_;
+  size_t skip_;
+  bool synced_;
+  uint32_t sync_header_;
+  bool first_frame_;
+  bool has_vbr_header_;
+  MPEGAudioVbrHeader vbr_header_;
+
+  // timestamp extrapolation
+  int64_t base_pts_us_;
+  int64_t samples_since_base_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(MPEGAudioFramer);
+};
+
+}  // namespace ave
+
+#endif /* !MPEG_AUDIO_FRAMER_H */
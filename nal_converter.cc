@@ -0,0 +1,261 @@
+/*
+ * nal_converter.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "nal_converter.h"
+
+#include <cstring>
+
+#include "base/checks.h"
+#include "base/logging.h"
+
+#include "media_errors.h"
+
+namespace ave {
+
+namespace {
+
+const uint8_t kStartCode[] = {0x00, 0x00, 0x00, 0x01};
+
+// free pooled buffers are reused for the next samples, a remux keeps a few
+// of them in flight at most
+const size_t kMaxPoolSize = 8;
+const size_t kPoolGranularity = 4096;
+
+void WriteHeader(uint8_t* out, uint32_t nal_size, size_t length_size) {
+  for (size_t i = length_size; i > 0; --i) {
+    out[i - 1] = static_cast<uint8_t>(nal_size);
+    nal_size >>= 8;
+  }
+}
+
+}  // namespace
+
+NALConverter::NALConverter(size_t length_size) : length_size_(length_size) {
+  AVE_CHECK(length_size == 1 || length_size == 2 || length_size == 4);
+}
+
+status_t NALConverter::ToLengthPrefixed(const uint8_t* data,
+                                        size_t size,
+                                        uint8_t* out,
+                                        size_t capacity,
+                                        size_t* out_size) {
+  status_t err = IndexAnnexB(data, size, out_size);
+  if (err != OK) {
+    return err;
+  }
+  return Write(data, out, capacity, *out_size, false);
+}
+
+status_t NALConverter::ToAnnexB(const uint8_t* data,
+                                size_t size,
+                                uint8_t* out,
+                                size_t capacity,
+                                size_t* out_size) {
+  status_t err = IndexLengthPrefixed(data, size, out_size);
+  if (err != OK) {
+    return err;
+  }
+  return Write(data, out, capacity, *out_size, true);
+}
+
+status_t NALConverter::ToLengthPrefixed(std::shared_ptr<Buffer>* buffer) {
+  return Convert(buffer, false);
+}
+
+status_t NALConverter::ToAnnexB(std::shared_ptr<Buffer>* buffer) {
+  return Convert(buffer, true);
+}
+
+status_t NALConverter::ToLengthPrefixed(
+    std::vector<std::shared_ptr<Buffer>>* buffers) {
+  for (auto& buffer : *buffers) {
+    status_t err = Convert(&buffer, false);
+    if (err != OK) {
+      return err;
+    }
+  }
+  return OK;
+}
+
+status_t NALConverter::ToAnnexB(std::vector<std::shared_ptr<Buffer>>* buffers) {
+  for (auto& buffer : *buffers) {
+    status_t err = Convert(&buffer, true);
+    if (err != OK) {
+      return err;
+    }
+  }
+  return OK;
+}
+
+status_t NALConverter::IndexAnnexB(const uint8_t* data,
+                                   size_t size,
+                                   size_t* out_size) {
+  nals_.clear();
+  FindNALUnits(data, size, NALFormat::kAVC, &nals_);
+  const uint64_t max_nal_size = (1ull << (8 * length_size_)) - 1;
+  size_t total = 0;
+  for (const NALPosition& nal : nals_) {
+    if (nal.nalSize > max_nal_size) {
+      AVE_LOG(LS_ERROR) << "NAL unit of " << nal.nalSize
+                        << " bytes exceeds the length size " << length_size_;
+      return ERROR_OUT_OF_RANGE;
+    }
+    total += length_size_ + nal.nalSize;
+  }
+  *out_size = total;
+  return OK;
+}
+
+status_t NALConverter::IndexLengthPrefixed(const uint8_t* data,
+                                           size_t size,
+                                           size_t* out_size) {
+  nals_.clear();
+  size_t offset = 0;
+  size_t total = 0;
+  while (offset < size) {
+    if (size - offset < length_size_) {
+      AVE_LOG(LS_ERROR) << "truncated NAL length at " << offset;
+      return ERROR_MALFORMED;
+    }
+    uint32_t nal_size = 0;
+    for (size_t i = 0; i < length_size_; ++i) {
+      nal_size = (nal_size << 8) | data[offset + i];
+    }
+    offset += length_size_;
+    if (nal_size > size - offset) {
+      AVE_LOG(LS_ERROR) << "NAL unit of " << nal_size << " bytes at "
+                        << offset << " exceeds the sample";
+      return ERROR_MALFORMED;
+    }
+    // an empty NAL unit would end up as a bare start code
+    if (nal_size > 0) {
+      nals_.push_back({static_cast<uint32_t>(offset), nal_size, 0});
+      total += sizeof(kStartCode) + nal_size;
+    }
+    offset += nal_size;
+  }
+  *out_size = total;
+  return OK;
+}
+
+status_t NALConverter::Write(const uint8_t* data,
+                             uint8_t* out,
+                             size_t capacity,
+                             size_t out_size,
+                             bool to_annexb) {
+  if (out_size > capacity) {
+    return ERROR_BUFFER_TOO_SMALL;
+  }
+  const size_t header_size = to_annexb ? sizeof(kStartCode) : length_size_;
+
+  bool backward = false;
+  if (out == data) {
+    // Every NAL unit moves towards the front or every one towards the back,
+    // otherwise one would overwrite another that was not moved yet.
+    bool front = true;
+    bool back = true;
+    size_t pos = 0;
+    for (const NALPosition& nal : nals_) {
+      pos += header_size;
+      front = front && pos <= nal.nalOffset;
+      back = back && pos >= nal.nalOffset;
+      pos += nal.nalSize;
+    }
+    if (!front && !back) {
+      return ERROR_BUFFER_TOO_SMALL;
+    }
+    backward = !front;
+  }
+
+  if (backward) {
+    // the header may overlap the old position of its own NAL unit only, so
+    // it is written after the payload moved
+    size_t pos = out_size;
+    for (size_t i = nals_.size(); i > 0; --i) {
+      const NALPosition& nal = nals_[i - 1];
+      pos -= nal.nalSize;
+      memmove(out + pos, data + nal.nalOffset, nal.nalSize);
+      pos -= header_size;
+      if (to_annexb) {
+        memcpy(out + pos, kStartCode, sizeof(kStartCode));
+      } else {
+        WriteHeader(out + pos, nal.nalSize, length_size_);
+      }
+    }
+    return OK;
+  }
+
+  size_t pos = 0;
+  for (const NALPosition& nal : nals_) {
+    if (to_annexb) {
+      memcpy(out + pos, kStartCode, sizeof(kStartCode));
+    } else {
+      WriteHeader(out + pos, nal.nalSize, length_size_);
+    }
+    pos += header_size;
+    if (out + pos != data + nal.nalOffset) {
+      memmove(out + pos, data + nal.nalOffset, nal.nalSize);
+    }
+    pos += nal.nalSize;
+  }
+  return OK;
+}
+
+status_t NALConverter::Convert(std::shared_ptr<Buffer>* buffer,
+                               bool to_annexb) {
+  Buffer* in = buffer->get();
+  size_t out_size = 0;
+  status_t err = to_annexb ? IndexLengthPrefixed(in->data(), in->size(),
+                                                 &out_size)
+                           : IndexAnnexB(in->data(), in->size(), &out_size);
+  if (err != OK) {
+    return err;
+  }
+
+  if (Write(in->data(), in->data(), in->capacity() - in->offset(), out_size,
+            to_annexb) == OK) {
+    in->setRange(in->offset(), out_size);
+    return OK;
+  }
+
+  std::shared_ptr<Buffer> out = AcquireBuffer(out_size);
+  err = Write(in->data(), out->base(), out->capacity(), out_size, to_annexb);
+  AVE_DCHECK(err == OK);
+  out->setRange(0, out_size);
+  // a reused buffer still carries the meta of its previous sample
+  out->copyMetaFrom(*in);
+  *buffer = out;
+  return OK;
+}
+
+std::shared_ptr<Buffer> NALConverter::AcquireBuffer(size_t size) {
+  // a buffer only the pool refers to is no longer used by the caller
+  for (const auto& buffer : pool_) {
+    if (buffer.use_count() == 1 && buffer->capacity() >= size) {
+      return buffer;
+    }
+  }
+
+  size_t capacity = (size + kPoolGranularity - 1) / kPoolGranularity *
+                    kPoolGranularity;
+  auto buffer = Buffer::Create(capacity);
+  buffer->setTrackingTag("NALConverter");
+  if (pool_.size() < kMaxPoolSize) {
+    pool_.push_back(buffer);
+    return buffer;
+  }
+  // replace a free buffer that turned out to be too small
+  for (auto& pooled : pool_) {
+    if (pooled.use_count() == 1) {
+      pooled = buffer;
+      break;
+    }
+  }
+  return buffer;
+}
+
+}  // namespace ave
@@ -0,0 +1,86 @@
+/*
+ * nal_converter.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef NAL_CONVERTER_H
+#define NAL_CONVERTER_H
+
+#include <memory>
+#include <vector>
+
+#include "base/constructor_magic.h"
+#include "base/types.h"
+
+#include "avc_utils.h"
+#include "buffer.h"
+
+namespace ave {
+
+// Rewrites H.264/HEVC samples between Annex-B, with start codes, and the
+// length prefixed packaging of MP4 (AVCC/HVCC), whose NAL units start with a
+// 1, 2 or 4 byte big endian size. Annex-B output uses 4 byte start codes.
+//
+// A sample is converted in place when the result fits the capacity of its
+// buffer and no NAL unit has to move over data that is not converted yet,
+// e.g. always between 4 byte start codes and 4 byte lengths. Otherwise the
+// result goes to a buffer of the converter's pool, which is reused once the
+// caller drops it. Not thread safe, use one converter per stream.
+class NALConverter {
+ public:
+  explicit NALConverter(size_t length_size);
+
+  size_t length_size() const { return length_size_; }
+
+  // Converts |size| bytes at |data| into |out|, which has room for
+  // |capacity| bytes and may be |data| itself. Returns ERROR_BUFFER_TOO_SMALL
+  // if the result does not fit, and also if |out| is |data| but the NAL units
+  // cannot be moved in place.
+  status_t ToLengthPrefixed(const uint8_t* data,
+                            size_t size,
+                            uint8_t* out,
+                            size_t capacity,
+                            size_t* out_size);
+  status_t ToAnnexB(const uint8_t* data,
+                    size_t size,
+                    uint8_t* out,
+                    size_t capacity,
+                    size_t* out_size);
+
+  // Converts the range of |*buffer|. If that cannot be done in place,
+  // |*buffer| is replaced by a pooled buffer with the result and the same
+  // sample meta, int32Data() and a copy of meta().
+  status_t ToLengthPrefixed(std::shared_ptr<Buffer>* buffer);
+  status_t ToAnnexB(std::shared_ptr<Buffer>* buffer);
+
+  // Converts every buffer of a batch, stops at the first error.
+  status_t ToLengthPrefixed(std::vector<std::shared_ptr<Buffer>>* buffers);
+  status_t ToAnnexB(std::vector<std::shared_ptr<Buffer>>* buffers);
+
+ private:
+  // Finds the NAL units, returns the size of the converted data.
+  status_t IndexAnnexB(const uint8_t* data, size_t size, size_t* out_size);
+  status_t IndexLengthPrefixed(const uint8_t* data,
+                               size_t size,
+                               size_t* out_size);
+  // Writes the NAL units of |nals_|, each behind a start code or length.
+  status_t Write(const uint8_t* data,
+                 uint8_t* out,
+                 size_t capacity,
+                 size_t out_size,
+                 bool to_annexb);
+  status_t Convert(std::shared_ptr<Buffer>* buffer, bool to_annexb);
+  std::shared_ptr<Buffer> AcquireBuffer(size_t size);
+
+  const size_t length_size_;
+  std::vector<NALPosition> nals_;
+  std::vector<std::shared_ptr<Buffer>> pool_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(NALConverter);
+};
+
+}  // namespace ave
+
+#endif /* !NAL_CONVERTER_H */
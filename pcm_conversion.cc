@@ -0,0 +1,1941 @@
+/*
+ * pcm_conversion.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "pcm_conversion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "base/logging.h"
+
+#include "channel_layout.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AVE_PCM_X86 1
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define AVE_PCM_NEON 1
+#endif
+
+namespace ave {
+
+namespace {
+
+enum Format {
+  kU8,
+  kS16,
+  kS24,
+  kS32,
+  kF32,
+  kNumFormats,
+};
+
+const size_t kSampleSizes[kNumFormats] = {1, 2, 3, 4, 4};
+
+// The next step from one format to another, the format itself if there is
+// a direct kernel. The direct kernels connect 8 bit only to 16 bit and 24
+// bit only to 32 bit, those are exact or a plain rounding away.
+const Format kNextHop[kNumFormats][kNumFormats] = {
+    // U8
+    {kU8, kS16, kS16, kS16, kS16},
+    // S16
+    {kU8, kS16, kS32, kS32, kF32},
+    // S24
+    {kS32, kS32, kS24, kS32, kS32},
+    // S32
+    {kS16, kS16, kS24, kS32, kF32},
+    // F32
+    {kS16, kS16, kS32, kS32, kF32},
+};
+
+// Samples converted at a time on the way through another format.
+const size_t kBlockSamples = 256;
+
+int ToFormat(AudioEncoding encoding) {
+  switch (encoding) {
+    case kAudioEncodingPcm8bit:
+      return kU8;
+    case kAudioEncodingPcm16bit:
+      return kS16;
+    case kAudioEncodingPcm24bitPacked:
+      return kS24;
+    case kAudioEncodingPcm32bit:
+      return kS32;
+    case kAudioEncodingPcmFloat:
+      return kF32;
+    default:
+      return -1;
+  }
+}
+
+constexpr int Pair(int from, int to) {
+  return from * kNumFormats + to;
+}
+
+const float kS16Scale = 32768.0f;
+const float kS32Scale = 2147483648.0f;
+
+// The scalar conversions define the results, the vector versions match
+// them bit for bit. Narrowing adds the highest dropped bit, i.e. rounds
+// halves up, and saturates the one value that overflows.
+
+inline int16_t S32ToS16(int32_t x) {
+  int32_t r = (x >> 16) + ((x >> 15) & 1);
+  return static_cast<int16_t>(std::min(r, 32767));
+}
+
+inline uint8_t S16ToU8(int16_t x) {
+  int32_t r = (x >> 8) + ((x >> 7) & 1);
+  return static_cast<uint8_t>(std::min(r, 127) + 128);
+}
+
+inline int32_t S32ToS24(int32_t x) {
+  int32_t r = (x >> 8) + ((x >> 7) & 1);
+  return std::min(r, 0x7fffff);
+}
+
+// |x| already scaled, rounded to nearest even like the vector conversions.
+inline int16_t ScaledFloatToS16(float x) {
+  x = std::min(std::max(x, -32768.0f), 32767.0f);
+  return static_cast<int16_t>(lrintf(x));
+}
+
+// 2^31 - 1 is not a float, anything from 2^31 on saturates.
+inline int32_t ScaledFloatToS32(float x) {
+  if (x >= kS32Scale) {
+    return std::numeric_limits<int32_t>::max();
+  }
+  if (x <= -kS32Scale) {
+    return std::numeric_limits<int32_t>::min();
+  }
+  return static_cast<int32_t>(lrintf(x));
+}
+
+inline uint32_t NextRandom(uint32_t* state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+// The difference of two uniform values, triangular in (-1, 1) LSB.
+inline float TriangularNoise(uint32_t r) {
+  return static_cast<float>(static_cast<int32_t>(r & 0xffff) -
+                            static_cast<int32_t>(r >> 16)) *
+         (1.0f / 65536);
+}
+
+void U8ToS16Scalar(const void* in, void* out, size_t samples) {
+  const uint8_t* src = static_cast<const uint8_t*>(in);
+  int16_t* dst = static_cast<int16_t*>(out);
+  for (size_t i = 0; i < samples; i++) {
+    dst[i] = static_cast<int16_t>((src[i] - 128) * 256);
+  }
+}
+
+void S16ToU8Scalar(const void* in, void* out, size_t samples) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  uint8_t* dst = static_cast<uint8_t*>(out);
+  for (size_t i = 0; i < samples; i++) {
+    dst[i] = S16ToU8(src[i]);
+  }
+}
+
+void S16ToS32Scalar(const void* in, void* out, size_t samples) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  int32_t* dst = static_cast<int32_t*>(out);
+  for (size_t i = 0; i < samples; i++) {
+    dst[i] = src[i] * 65536;
+  }
+}
+
+void S32ToS16Scalar(const void* in, void* out, size_t samples) {
+  const int32_t* src = static_cast<const int32_t*>(in);
+  int16_t* dst = static_cast<int16_t*>(out);
+  for (size_t i = 0; i < samples; i++) {
+    dst[i] = S32ToS16(src[i]);
+  }
+}
+
+void S24ToS32Scalar(const void* in, void* out, size_t samples) {
+  const uint8_t* src = static_cast<const uint8_t*>(in);
+  int32_t* dst = static_cast<int32_t*>(out);
+  for (size_t i = 0; i < samples; i++, src += 3) {
+    uint32_t x = (src[0] << 8) | (src[1] << 16) | (uint32_t(src[2]) << 24);
+    dst[i] = static_cast<int32_t>(x);
+  }
+}
+
+void S32ToS24Scalar(const void* in, void* out, size_t samples) {
+  const int32_t* src = static_cast<const int32_t*>(in);
+  uint8_t* dst = static_cast<uint8_t*>(out);
+  for (size_t i = 0; i < samples; i++, dst += 3) {
+    int32_t x = S32ToS24(src[i]);
+    dst[0] = static_cast<uint8_t>(x);
+    dst[1] = static_cast<uint8_t>(x >> 8);
+    dst[2] = static_cast<uint8_t>(x >> 16);
+  }
+}
+
+void S16ToFloatScalar(const void* in, void* out, size_t samples) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  float* dst = static_cast<float*>(out);
+  for (size_t i = 0; i < samples; i++) {
+    dst[i] = src[i] * (1.0f / kS16Scale);
+  }
+}
+
+void FloatToS16Scalar(const void* in, void* out, size_t samples) {
+  const float* src = static_cast<const float*>(in);
+  int16_t* dst = static_cast<int16_t*>(out);
+  for (size_t i = 0; i < samples; i++) {
+    dst[i] = ScaledFloatToS16(src[i] * kS16Scale);
+  }
+}
+
+void S32ToFloatScalar(const void* in, void* out, size_t samples) {
+  const int32_t* src = static_cast<const int32_t*>(in);
+  float* dst = static_cast<float*>(out);
+  for (size_t i = 0; i < samples; i++) {
+    dst[i] = static_cast<float>(src[i]) * (1.0f / kS32Scale);
+  }
+}
+
+void FloatToS32Scalar(const void* in, void* out, size_t samples) {
+  const float* src = static_cast<const float*>(in);
+  int32_t* dst = static_cast<int32_t*>(out);
+  for (size_t i = 0; i < samples; i++) {
+    dst[i] = ScaledFloatToS32(src[i] * kS32Scale);
+  }
+}
+
+// Sample i takes its noise from generator i % 8 in every version.
+void FloatToS16DitherScalar(const float* in,
+                            int16_t* out,
+                            size_t samples,
+                            uint32_t* state) {
+  for (size_t i = 0; i < samples; i++) {
+    float noise = TriangularNoise(NextRandom(&state[i & 7]));
+    out[i] = ScaledFloatToS16(in[i] * kS16Scale + noise);
+  }
+}
+
+#if defined(AVE_PCM_X86) && defined(__SSE2__)
+// Rounds 2 x 4 int32 to 16 bit, see S32ToS16().
+inline __m128i RoundS32ToS16SSE2(__m128i a, __m128i b) {
+  a = _mm_add_epi32(_mm_srai_epi32(a, 16),
+                    _mm_srli_epi32(_mm_slli_epi32(a, 16), 31));
+  b = _mm_add_epi32(_mm_srai_epi32(b, 16),
+                    _mm_srli_epi32(_mm_slli_epi32(b, 16), 31));
+  return _mm_packs_epi32(a, b);
+}
+
+// Clamps and rounds 2 x 4 scaled floats to 16 bit.
+inline __m128i ScaledFloatToS16SSE2(__m128 a, __m128 b) {
+  const __m128 lo = _mm_set1_ps(-32768.0f);
+  const __m128 hi = _mm_set1_ps(32767.0f);
+  a = _mm_min_ps(_mm_max_ps(a, lo), hi);
+  b = _mm_min_ps(_mm_max_ps(b, lo), hi);
+  return _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+}
+
+inline __m128i NextRandomSSE2(__m128i* state) {
+  __m128i x = *state;
+  x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+  x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+  x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+  *state = x;
+  return x;
+}
+
+inline __m128 TriangularNoiseSSE2(__m128i r) {
+  __m128i diff = _mm_sub_epi32(_mm_and_si128(r, _mm_set1_epi32(0xffff)),
+                               _mm_srli_epi32(r, 16));
+  return _mm_mul_ps(_mm_cvtepi32_ps(diff), _mm_set1_ps(1.0f / 65536));
+}
+
+void U8ToS16SSE2(const void* in, void* out, size_t samples) {
+  const uint8_t* src = static_cast<const uint8_t*>(in);
+  int16_t* dst = static_cast<int16_t*>(out);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    x = _mm_xor_si128(x, bias);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_unpacklo_epi8(zero, x));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8),
+                     _mm_unpackhi_epi8(zero, x));
+  }
+  U8ToS16Scalar(src + i, dst + i, samples - i);
+}
+
+void S16ToU8SSE2(const void* in, void* out, size_t samples) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  uint8_t* dst = static_cast<uint8_t*>(out);
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+    a = _mm_add_epi16(_mm_srai_epi16(a, 8),
+                      _mm_and_si128(_mm_srli_epi16(a, 7), one));
+    b = _mm_add_epi16(_mm_srai_epi16(b, 8),
+                      _mm_and_si128(_mm_srli_epi16(b, 7), one));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_xor_si128(_mm_packs_epi16(a, b), bias));
+  }
+  S16ToU8Scalar(src + i, dst + i, samples - i);
+}
+
+void S16ToS32SSE2(const void* in, void* out, size_t samples) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  int32_t* dst = static_cast<int32_t*>(out);
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_unpacklo_epi16(zero, x));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4),
+                     _mm_unpackhi_epi16(zero, x));
+  }
+  S16ToS32Scalar(src + i, dst + i, samples - i);
+}
+
+void S32ToS16SSE2(const void* in, void* out, size_t samples) {
+  const int32_t* src = static_cast<const int32_t*>(in);
+  int16_t* dst = static_cast<int16_t*>(out);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     RoundS32ToS16SSE2(a, b));
+  }
+  S32ToS16Scalar(src + i, dst + i, samples - i);
+}
+
+void S16ToFloatSSE2(const void* in, void* out, size_t samples) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  float* dst = static_cast<float*>(out);
+  const __m128 scale = _mm_set1_ps(1.0f / kS16Scale);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+  S16ToFloatScalar(src + i, dst + i, samples - i);
+}
+
+void FloatToS16SSE2(const void* in, void* out, size_t samples) {
+  const float* src = static_cast<const float*>(in);
+  int16_t* dst = static_cast<int16_t*>(out);
+  const __m128 scale = _mm_set1_ps(kS16Scale);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+    __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     ScaledFloatToS16SSE2(a, b));
+  }
+  FloatToS16Scalar(src + i, dst + i, samples - i);
+}
+
+void S32ToFloatSSE2(const void* in, void* out, size_t samples) {
+  const int32_t* src = static_cast<const int32_t*>(in);
+  float* dst = static_cast<float*>(out);
+  const __m128 scale = _mm_set1_ps(1.0f / kS32Scale);
+  size_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+  }
+  S32ToFloatScalar(src + i, dst + i, samples - i);
+}
+
+// cvtps gives INT32_MIN for anything out of range, flipping its bits where
+// the input was too large turns that into INT32_MAX.
+void FloatToS32SSE2(const void* in, void* out, size_t samples) {
+  const float* src = static_cast<const float*>(in);
+  int32_t* dst = static_cast<int32_t*>(out);
+  const __m128 scale = _mm_set1_ps(kS32Scale);
+  const __m128 lo = _mm_set1_ps(-kS32Scale);
+  size_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    __m128 x = _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), lo);
+    __m128i r = _mm_cvtps_epi32(x);
+    r = _mm_xor_si128(r, _mm_castps_si128(_mm_cmpge_ps(x, scale)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+  }
+  FloatToS32Scalar(src + i, dst + i, samples - i);
+}
+
+void FloatToS16DitherSSE2(const float* in,
+                          int16_t* out,
+                          size_t samples,
+                          uint32_t* state) {
+  __m128i state_lo = _mm_loadu_si128(reinterpret_cast<__m128i*>(state));
+  __m128i state_hi = _mm_loadu_si128(reinterpret_cast<__m128i*>(state + 4));
+  const __m128 scale = _mm_set1_ps(kS16Scale);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+    __m128 b = _mm_mul_ps(_mm_loadu_ps(in + i + 4), scale);
+    a = _mm_add_ps(a, TriangularNoiseSSE2(NextRandomSSE2(&state_lo)));
+    b = _mm_add_ps(b, TriangularNoiseSSE2(NextRandomSSE2(&state_hi)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                     ScaledFloatToS16SSE2(a, b));
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state), state_lo);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state_hi);
+  FloatToS16DitherScalar(in + i, out + i, samples - i, state);
+}
+#endif
+
+#if defined(AVE_PCM_X86)
+// pack and unpack work within 128 bit lanes, the 64 bit permutes put the
+// results back in order.
+
+#define AVE_PCM_AVX2 __attribute__((target("avx2")))
+
+AVE_PCM_AVX2 inline __m256i ScaledFloatToS16AVX2(__m256 a, __m256 b) {
+  const __m256 lo = _mm256_set1_ps(-32768.0f);
+  const __m256 hi = _mm256_set1_ps(32767.0f);
+  a = _mm256_min_ps(_mm256_max_ps(a, lo), hi);
+  b = _mm256_min_ps(_mm256_max_ps(b, lo), hi);
+  __m256i r = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+  return _mm256_permute4x64_epi64(r, 0xd8);
+}
+
+AVE_PCM_AVX2 inline __m256i NextRandomAVX2(__m256i* state) {
+  __m256i x = *state;
+  x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+  x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+  x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+  *state = x;
+  return x;
+}
+
+AVE_PCM_AVX2 inline __m256 TriangularNoiseAVX2(__m256i r) {
+  __m256i diff =
+      _mm256_sub_epi32(_mm256_and_si256(r, _mm256_set1_epi32(0xffff)),
+                       _mm256_srli_epi32(r, 16));
+  return _mm256_mul_ps(_mm256_cvtepi32_ps(diff),
+                       _mm256_set1_ps(1.0f / 65536));
+}
+
+AVE_PCM_AVX2 void U8ToS16AVX2(const void* in, void* out, size_t samples) {
+  const uint8_t* src = static_cast<const uint8_t*>(in);
+  int16_t* dst = static_cast<int16_t*>(out);
+  const __m256i bias = _mm256_set1_epi16(128);
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m256i x = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+    x = _mm256_slli_epi16(_mm256_sub_epi16(x, bias), 8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), x);
+  }
+  U8ToS16Scalar(src + i, dst + i, samples - i);
+}
+
+AVE_PCM_AVX2 void S16ToU8AVX2(const void* in, void* out, size_t samples) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  uint8_t* dst = static_cast<uint8_t*>(out);
+  const __m256i one = _mm256_set1_epi16(1);
+  const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80));
+  size_t i = 0;
+  for (; i + 32 <= samples; i += 32) {
+    __m256i a =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i b =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 16));
+    a = _mm256_add_epi16(_mm256_srai_epi16(a, 8),
+                         _mm256_and_si256(_mm256_srli_epi16(a, 7), one));
+    b = _mm256_add_epi16(_mm256_srai_epi16(b, 8),
+                         _mm256_and_si256(_mm256_srli_epi16(b, 7), one));
+    __m256i r = _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xd8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_xor_si256(r, bias));
+  }
+  S16ToU8Scalar(src + i, dst + i, samples - i);
+}
+
+AVE_PCM_AVX2 void S16ToS32AVX2(const void* in, void* out, size_t samples) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  int32_t* dst = static_cast<int32_t*>(out);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m256i x = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_slli_epi32(x, 16));
+  }
+  S16ToS32Scalar(src + i, dst + i, samples - i);
+}
+
+AVE_PCM_AVX2 void S32ToS16AVX2(const void* in, void* out, size_t samples) {
+  const int32_t* src = static_cast<const int32_t*>(in);
+  int16_t* dst = static_cast<int16_t*>(out);
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m256i a =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i b =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 8));
+    a = _mm256_add_epi32(_mm256_srai_epi32(a, 16),
+                         _mm256_srli_epi32(_mm256_slli_epi32(a, 16), 31));
+    b = _mm256_add_epi32(_mm256_srai_epi32(b, 16),
+                         _mm256_srli_epi32(_mm256_slli_epi32(b, 16), 31));
+    __m256i r = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), r);
+  }
+  S32ToS16Scalar(src + i, dst + i, samples - i);
+}
+
+// Four samples per 128 bit shuffle, the loads read a sample and a third
+// ahead.
+AVE_PCM_AVX2 void S24ToS32AVX2(const void* in, void* out, size_t samples) {
+  const uint8_t* src = static_cast<const uint8_t*>(in);
+  int32_t* dst = static_cast<int32_t*>(out);
+  const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7,
+                                        8, -1, 9, 10, 11);
+  size_t i = 0;
+  for (; (i + 4) * 3 + 4 <= samples * 3; i += 4) {
+    __m128i x =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_shuffle_epi8(x, shuffle));
+  }
+  S24ToS32Scalar(src + i * 3, dst + i, samples - i);
+}
+
+AVE_PCM_AVX2 void S32ToS24AVX2(const void* in, void* out, size_t samples) {
+  const int32_t* src = static_cast<const int32_t*>(in);
+  uint8_t* dst = static_cast<uint8_t*>(out);
+  const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13,
+                                        14, -1, -1, -1, -1);
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i max = _mm_set1_epi32(0x7fffff);
+  size_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    x = _mm_add_epi32(_mm_srai_epi32(x, 8),
+                      _mm_and_si128(_mm_srli_epi32(x, 7), one));
+    x = _mm_shuffle_epi8(_mm_min_epi32(x, max), shuffle);
+    // exactly 12 bytes, the next ones may still be input
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i * 3), x);
+    int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(x, 8));
+    memcpy(dst + i * 3 + 8, &tail, 4);
+  }
+  S32ToS24Scalar(src + i, dst + i * 3, samples - i);
+}
+
+AVE_PCM_AVX2 void S16ToFloatAVX2(const void* in, void* out, size_t samples) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  float* dst = static_cast<float*>(out);
+  const __m256 scale = _mm256_set1_ps(1.0f / kS16Scale);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m256i x = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+  }
+  S16ToFloatScalar(src + i, dst + i, samples - i);
+}
+
+AVE_PCM_AVX2 void FloatToS16AVX2(const void* in, void* out, size_t samples) {
+  const float* src = static_cast<const float*>(in);
+  int16_t* dst = static_cast<int16_t*>(out);
+  const __m256 scale = _mm256_set1_ps(kS16Scale);
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+    __m256 b = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        ScaledFloatToS16AVX2(a, b));
+  }
+  FloatToS16Scalar(src + i, dst + i, samples - i);
+}
+
+AVE_PCM_AVX2 void S32ToFloatAVX2(const void* in, void* out, size_t samples) {
+  const int32_t* src = static_cast<const int32_t*>(in);
+  float* dst = static_cast<float*>(out);
+  const __m256 scale = _mm256_set1_ps(1.0f / kS32Scale);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m256i x =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+  }
+  S32ToFloatScalar(src + i, dst + i, samples - i);
+}
+
+AVE_PCM_AVX2 void FloatToS32AVX2(const void* in, void* out, size_t samples) {
+  const float* src = static_cast<const float*>(in);
+  int32_t* dst = static_cast<int32_t*>(out);
+  const __m256 scale = _mm256_set1_ps(kS32Scale);
+  const __m256 lo = _mm256_set1_ps(-kS32Scale);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m256 x =
+        _mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), lo);
+    __m256i r = _mm256_cvtps_epi32(x);
+    r = _mm256_xor_si256(
+        r, _mm256_castps_si256(_mm256_cmp_ps(x, scale, _CMP_GE_OQ)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), r);
+  }
+  FloatToS32Scalar(src + i, dst + i, samples - i);
+}
+
+AVE_PCM_AVX2 void FloatToS16DitherAVX2(const float* in,
+                                       int16_t* out,
+                                       size_t samples,
+                                       uint32_t* state) {
+  __m256i lanes = _mm256_loadu_si256(reinterpret_cast<__m256i*>(state));
+  const __m256 scale = _mm256_set1_ps(kS16Scale);
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+    a = _mm256_add_ps(a, TriangularNoiseAVX2(NextRandomAVX2(&lanes)));
+    __m256 b = _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale);
+    b = _mm256_add_ps(b, TriangularNoiseAVX2(NextRandomAVX2(&lanes)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+                        ScaledFloatToS16AVX2(a, b));
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(state), lanes);
+  FloatToS16DitherScalar(in + i, out + i, samples - i, state);
+}
+
+#undef AVE_PCM_AVX2
+#endif
+
+#if defined(AVE_PCM_NEON)
+// The NEON narrowing shifts round halves up and saturate, exactly like the
+// scalar code, and float conversion saturates by itself.
+
+inline int16x8_t ScaledFloatToS16NEON(float32x4_t a, float32x4_t b) {
+  const float32x4_t lo = vdupq_n_f32(-32768.0f);
+  const float32x4_t hi = vdupq_n_f32(32767.0f);
+  a = vminq_f32(vmaxq_f32(a, lo), hi);
+  b = vminq_f32(vmaxq_f32(b, lo), hi);
+  return vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)),
+                      vqmovn_s32(vcvtnq_s32_f32(b)));
+}
+
+inline uint32x4_t NextRandomNEON(uint32x4_t* state) {
+  uint32x4_t x = *state;
+  x = veorq_u32(x, vshlq_n_u32(x, 13));
+  x = veorq_u32(x, vshrq_n_u32(x, 17));
+  x = veorq_u32(x, vshlq_n_u32(x, 5));
+  *state = x;
+  return x;
+}
+
+inline float32x4_t TriangularNoiseNEON(uint32x4_t r) {
+  int32x4_t diff =
+      vsubq_s32(vreinterpretq_s32_u32(vandq_u32(r, vdupq_n_u32(0xffff))),
+                vreinterpretq_s32_u32(vshrq_n_u32(r, 16)));
+  return vmulq_n_f32(vcvtq_f32_s32(diff), 1.0f / 65536);
+}
+
+void U8ToS16NEON(const void* in, void* out, size_t samples) {
+  const uint8_t* src = static_cast<const uint8_t*>(in);
+  int16_t* dst = static_cast<int16_t*>(out);
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    int8x16_t x =
+        vreinterpretq_s8_u8(veorq_u8(vld1q_u8(src + i), vdupq_n_u8(0x80)));
+    vst1q_s16(dst + i, vshll_n_s8(vget_low_s8(x), 8));
+    vst1q_s16(dst + i + 8, vshll_high_n_s8(x, 8));
+  }
+  U8ToS16Scalar(src + i, dst + i, samples - i);
+}
+
+void S16ToU8NEON(const void* in, void* out, size_t samples) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  uint8_t* dst = static_cast<uint8_t*>(out);
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    int8x16_t x = vcombine_s8(vqrshrn_n_s16(vld1q_s16(src + i), 8),
+                              vqrshrn_n_s16(vld1q_s16(src + i + 8), 8));
+    vst1q_u8(dst + i, veorq_u8(vreinterpretq_u8_s8(x), vdupq_n_u8(0x80)));
+  }
+  S16ToU8Scalar(src + i, dst + i, samples - i);
+}
+
+void S16ToS32NEON(const void* in, void* out, size_t samples) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  int32_t* dst = static_cast<int32_t*>(out);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    int16x8_t x = vld1q_s16(src + i);
+    vst1q_s32(dst + i, vshll_n_s16(vget_low_s16(x), 16));
+    vst1q_s32(dst + i + 4, vshll_high_n_s16(x, 16));
+  }
+  S16ToS32Scalar(src + i, dst + i, samples - i);
+}
+
+void S32ToS16NEON(const void* in, void* out, size_t samples) {
+  const int32_t* src = static_cast<const int32_t*>(in);
+  int16_t* dst = static_cast<int16_t*>(out);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    vst1q_s16(dst + i, vcombine_s16(vqrshrn_n_s32(vld1q_s32(src + i), 16),
+                                    vqrshrn_n_s32(vld1q_s32(src + i + 4), 16)));
+  }
+  S32ToS16Scalar(src + i, dst + i, samples - i);
+}
+
+// 16 samples at a time through the byte planes of vld3.
+void S24ToS32NEON(const void* in, void* out, size_t samples) {
+  const uint8_t* src = static_cast<const uint8_t*>(in);
+  int32_t* dst = static_cast<int32_t*>(out);
+  const uint8x16_t zero = vdupq_n_u8(0);
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    uint8x16x3_t x = vld3q_u8(src + i * 3);
+    // byte 0 shifted up, bytes 1 and 2 as the upper half
+    uint8x16x2_t lo = vzipq_u8(zero, x.val[0]);
+    uint8x16x2_t hi = vzipq_u8(x.val[1], x.val[2]);
+    for (int half = 0; half < 2; half++) {
+      uint16x8x2_t r = vzipq_u16(vreinterpretq_u16_u8(lo.val[half]),
+                                 vreinterpretq_u16_u8(hi.val[half]));
+      vst1q_s32(dst + i + half * 8, vreinterpretq_s32_u16(r.val[0]));
+      vst1q_s32(dst + i + half * 8 + 4, vreinterpretq_s32_u16(r.val[1]));
+    }
+  }
+  S24ToS32Scalar(src + i * 3, dst + i, samples - i);
+}
+
+void S32ToS24NEON(const void* in, void* out, size_t samples) {
+  const int32_t* src = static_cast<const int32_t*>(in);
+  uint8_t* dst = static_cast<uint8_t*>(out);
+  const int32x4_t max = vdupq_n_s32(0x7fffff);
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    uint8x16_t r[4];
+    for (int j = 0; j < 4; j++) {
+      int32x4_t x = vminq_s32(vrshrq_n_s32(vld1q_s32(src + i + j * 4), 8), max);
+      r[j] = vreinterpretq_u8_s32(x);
+    }
+    // bytes 0 and 2, and 1 and 3, of each sample, then split again
+    uint8x16_t even01 = vuzp1q_u8(r[0], r[1]);
+    uint8x16_t even23 = vuzp1q_u8(r[2], r[3]);
+    uint8x16_t odd01 = vuzp2q_u8(r[0], r[1]);
+    uint8x16_t odd23 = vuzp2q_u8(r[2], r[3]);
+    uint8x16x3_t planes;
+    planes.val[0] = vuzp1q_u8(even01, even23);
+    planes.val[1] = vuzp1q_u8(odd01, odd23);
+    planes.val[2] = vuzp2q_u8(even01, even23);
+    vst3q_u8(dst + i * 3, planes);
+  }
+  S32ToS24Scalar(src + i, dst + i * 3, samples - i);
+}
+
+void S16ToFloatNEON(const void* in, void* out, size_t samples) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  float* dst = static_cast<float*>(out);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    int16x8_t x = vld1q_s16(src + i);
+    vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))),
+                                   1.0f / kS16Scale));
+    vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_high_s16(x)),
+                                       1.0f / kS16Scale));
+  }
+  S16ToFloatScalar(src + i, dst + i, samples - i);
+}
+
+void FloatToS16NEON(const void* in, void* out, size_t samples) {
+  const float* src = static_cast<const float*>(in);
+  int16_t* dst = static_cast<int16_t*>(out);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    float32x4_t a = vmulq_n_f32(vld1q_f32(src + i), kS16Scale);
+    float32x4_t b = vmulq_n_f32(vld1q_f32(src + i + 4), kS16Scale);
+    vst1q_s16(dst + i, ScaledFloatToS16NEON(a, b));
+  }
+  FloatToS16Scalar(src + i, dst + i, samples - i);
+}
+
+void S32ToFloatNEON(const void* in, void* out, size_t samples) {
+  const int32_t* src = static_cast<const int32_t*>(in);
+  float* dst = static_cast<float*>(out);
+  size_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i)),
+                                   1.0f / kS32Scale));
+  }
+  S32ToFloatScalar(src + i, dst + i, samples - i);
+}
+
+void FloatToS32NEON(const void* in, void* out, size_t samples) {
+  const float* src = static_cast<const float*>(in);
+  int32_t* dst = static_cast<int32_t*>(out);
+  size_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    vst1q_s32(dst + i,
+              vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i), kS32Scale)));
+  }
+  FloatToS32Scalar(src + i, dst + i, samples - i);
+}
+
+void FloatToS16DitherNEON(const float* in,
+                          int16_t* out,
+                          size_t samples,
+                          uint32_t* state) {
+  uint32x4_t state_lo = vld1q_u32(state);
+  uint32x4_t state_hi = vld1q_u32(state + 4);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    float32x4_t a = vmulq_n_f32(vld1q_f32(in + i), kS16Scale);
+    float32x4_t b = vmulq_n_f32(vld1q_f32(in + i + 4), kS16Scale);
+    a = vaddq_f32(a, TriangularNoiseNEON(NextRandomNEON(&state_lo)));
+    b = vaddq_f32(b, TriangularNoiseNEON(NextRandomNEON(&state_hi)));
+    vst1q_s16(out + i, ScaledFloatToS16NEON(a, b));
+  }
+  vst1q_u32(state, state_lo);
+  vst1q_u32(state + 4, state_hi);
+  FloatToS16DitherScalar(in + i, out + i, samples - i, state);
+}
+#endif
+
+PcmConvertProc GetScalarConverter(int pair) {
+  switch (pair) {
+    case Pair(kU8, kS16):
+      return U8ToS16Scalar;
+    case Pair(kS16, kU8):
+      return S16ToU8Scalar;
+    case Pair(kS16, kS32):
+      return S16ToS32Scalar;
+    case Pair(kS32, kS16):
+      return S32ToS16Scalar;
+    case Pair(kS24, kS32):
+      return S24ToS32Scalar;
+    case Pair(kS32, kS24):
+      return S32ToS24Scalar;
+    case Pair(kS16, kF32):
+      return S16ToFloatScalar;
+    case Pair(kF32, kS16):
+      return FloatToS16Scalar;
+    case Pair(kS32, kF32):
+      return S32ToFloatScalar;
+    case Pair(kF32, kS32):
+      return FloatToS32Scalar;
+    default:
+      return nullptr;
+  }
+}
+
+#if defined(AVE_PCM_X86) && defined(__SSE2__)
+PcmConvertProc GetSSE2Converter(int pair) {
+  switch (pair) {
+    case Pair(kU8, kS16):
+      return U8ToS16SSE2;
+    case Pair(kS16, kU8):
+      return S16ToU8SSE2;
+    case Pair(kS16, kS32):
+      return S16ToS32SSE2;
+    case Pair(kS32, kS16):
+      return S32ToS16SSE2;
+    case Pair(kS16, kF32):
+      return S16ToFloatSSE2;
+    case Pair(kF32, kS16):
+      return FloatToS16SSE2;
+    case Pair(kS32, kF32):
+      return S32ToFloatSSE2;
+    case Pair(kF32, kS32):
+      return FloatToS32SSE2;
+    default:
+      // 24 bit needs the byte shuffle of SSSE3
+      return nullptr;
+  }
+}
+#endif
+
+#if defined(AVE_PCM_X86)
+PcmConvertProc GetAVX2Converter(int pair) {
+  if (!__builtin_cpu_supports("avx2")) {
+    return nullptr;
+  }
+  switch (pair) {
+    case Pair(kU8, kS16):
+      return U8ToS16AVX2;
+    case Pair(kS16, kU8):
+      return S16ToU8AVX2;
+    case Pair(kS16, kS32):
+      return S16ToS32AVX2;
+    case Pair(kS32, kS16):
+      return S32ToS16AVX2;
+    case Pair(kS24, kS32):
+      return S24ToS32AVX2;
+    case Pair(kS32, kS24):
+      return S32ToS24AVX2;
+    case Pair(kS16, kF32):
+      return S16ToFloatAVX2;
+    case Pair(kF32, kS16):
+      return FloatToS16AVX2;
+    case Pair(kS32, kF32):
+      return S32ToFloatAVX2;
+    case Pair(kF32, kS32):
+      return FloatToS32AVX2;
+    default:
+      return nullptr;
+  }
+}
+#endif
+
+#if defined(AVE_PCM_NEON)
+PcmConvertProc GetNEONConverter(int pair) {
+  switch (pair) {
+    case Pair(kU8, kS16):
+      return U8ToS16NEON;
+    case Pair(kS16, kU8):
+      return S16ToU8NEON;
+    case Pair(kS16, kS32):
+      return S16ToS32NEON;
+    case Pair(kS32, kS16):
+      return S32ToS16NEON;
+    case Pair(kS24, kS32):
+      return S24ToS32NEON;
+    case Pair(kS32, kS24):
+      return S32ToS24NEON;
+    case Pair(kS16, kF32):
+      return S16ToFloatNEON;
+    case Pair(kF32, kS16):
+      return FloatToS16NEON;
+    case Pair(kS32, kF32):
+      return S32ToFloatNEON;
+    case Pair(kF32, kS32):
+      return FloatToS32NEON;
+    default:
+      return nullptr;
+  }
+}
+#endif
+
+PcmConvertProc GetConverter(PcmImpl impl, int pair) {
+  switch (impl) {
+    case PcmImpl::kScalar:
+      return GetScalarConverter(pair);
+#if defined(AVE_PCM_X86) && defined(__SSE2__)
+    case PcmImpl::kSSE2:
+      return GetSSE2Converter(pair);
+#endif
+#if defined(AVE_PCM_X86)
+    case PcmImpl::kAVX2:
+      return GetAVX2Converter(pair);
+#endif
+#if defined(AVE_PCM_NEON)
+    case PcmImpl::kNEON:
+      return GetNEONConverter(pair);
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+const PcmImpl kPreferred[] = {
+    PcmImpl::kAVX2,
+    PcmImpl::kSSE2,
+    PcmImpl::kNEON,
+    PcmImpl::kScalar,
+};
+
+// The widest implementation of every direct kernel the CPU supports.
+struct Kernels {
+  PcmConvertProc convert[kNumFormats][kNumFormats];
+  PcmDitherProc dither;
+};
+
+Kernels SelectKernels() {
+  Kernels kernels = {};
+  for (int from = 0; from < kNumFormats; from++) {
+    for (int to = 0; to < kNumFormats; to++) {
+      for (PcmImpl impl : kPreferred) {
+        kernels.convert[from][to] = GetConverter(impl, Pair(from, to));
+        if (kernels.convert[from][to] != nullptr) {
+          break;
+        }
+      }
+    }
+  }
+  for (PcmImpl impl : kPreferred) {
+    kernels.dither = GetPcmDitherConverter(impl);
+    if (kernels.dither != nullptr) {
+      break;
+    }
+  }
+  return kernels;
+}
+
+const Kernels& GetKernels() {
+  static const Kernels kernels = SelectKernels();
+  return kernels;
+}
+
+void Convert(int from,
+             int to,
+             const uint8_t* in,
+             uint8_t* out,
+             size_t samples,
+             uint32_t* dither_state) {
+  const Kernels& kernels = GetKernels();
+  int hop = kNextHop[from][to];
+  if (hop == to) {
+    if (dither_state != nullptr && from == kF32 && to == kS16) {
+      kernels.dither(reinterpret_cast<const float*>(in),
+                     reinterpret_cast<int16_t*>(out), samples, dither_state);
+    } else {
+      kernels.convert[from][to](in, out, samples);
+    }
+    return;
+  }
+
+  // Chunk by chunk through |block|, the output of a chunk is written after
+  // its input has been read, so narrowing in place works.
+  alignas(32) uint8_t block[kBlockSamples * sizeof(int32_t)];
+  for (size_t done = 0; done < samples; done += kBlockSamples) {
+    size_t count = std::min(kBlockSamples, samples - done);
+    kernels.convert[from][hop](in + done * kSampleSizes[from], block, count);
+    Convert(hop, to, block, out + done * kSampleSizes[to], count, nullptr);
+  }
+}
+
+// Copies whole samples with a constant size, the compiler turns the memcpy
+// into a single move.
+template <size_t kSize, size_t kChannels>
+void InterleaveScalar(const void* const* planes, size_t frames, void* out) {
+  const uint8_t* src[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    src[ch] = static_cast<const uint8_t*>(planes[ch]);
+  }
+  uint8_t* dst = static_cast<uint8_t*>(out);
+  for (size_t i = 0; i < frames; i++) {
+    for (size_t ch = 0; ch < kChannels; ch++) {
+      memcpy(dst, src[ch] + i * kSize, kSize);
+      dst += kSize;
+    }
+  }
+}
+
+template <size_t kSize, size_t kChannels>
+void DeinterleaveScalar(const void* in, size_t frames, void* const* planes) {
+  const uint8_t* src = static_cast<const uint8_t*>(in);
+  uint8_t* dst[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    dst[ch] = static_cast<uint8_t*>(planes[ch]);
+  }
+  for (size_t i = 0; i < frames; i++) {
+    for (size_t ch = 0; ch < kChannels; ch++) {
+      memcpy(dst[ch] + i * kSize, src, kSize);
+      src += kSize;
+    }
+  }
+}
+
+using InterleaveProc = void (*)(const void* const* planes,
+                                size_t frames,
+                                void* out);
+using DeinterleaveProc = void (*)(const void* in,
+                                  size_t frames,
+                                  void* const* planes);
+
+// Stereo, by far the most common case, is unpacked with vector shuffles.
+#if defined(AVE_PCM_X86) && defined(__SSE2__)
+void InterleaveStereo16SSE2(const void* const* planes,
+                            size_t frames,
+                            void* out) {
+  const int16_t* left = static_cast<const int16_t*>(planes[0]);
+  const int16_t* right = static_cast<const int16_t*>(planes[1]);
+  int16_t* dst = static_cast<int16_t*>(out);
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2),
+                     _mm_unpacklo_epi16(l, r));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2 + 8),
+                     _mm_unpackhi_epi16(l, r));
+  }
+  const void* rest[] = {left + i, right + i};
+  InterleaveScalar<2, 2>(rest, frames - i, dst + i * 2);
+}
+
+void DeinterleaveStereo16SSE2(const void* in,
+                              size_t frames,
+                              void* const* planes) {
+  const int16_t* src = static_cast<const int16_t*>(in);
+  int16_t* left = static_cast<int16_t*>(planes[0]);
+  int16_t* right = static_cast<int16_t*>(planes[1]);
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m128i a =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+    __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2 + 8));
+    // sign extended, so the saturating pack keeps every value
+    __m128i l = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                                _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+    __m128i r = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(left + i), l);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(right + i), r);
+  }
+  void* rest[] = {left + i, right + i};
+  DeinterleaveScalar<2, 2>(src + i * 2, frames - i, rest);
+}
+
+void InterleaveStereo32SSE2(const void* const* planes,
+                            size_t frames,
+                            void* out) {
+  const int32_t* left = static_cast<const int32_t*>(planes[0]);
+  const int32_t* right = static_cast<const int32_t*>(planes[1]);
+  int32_t* dst = static_cast<int32_t*>(out);
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2),
+                     _mm_unpacklo_epi32(l, r));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2 + 4),
+                     _mm_unpackhi_epi32(l, r));
+  }
+  const void* rest[] = {left + i, right + i};
+  InterleaveScalar<4, 2>(rest, frames - i, dst + i * 2);
+}
+
+void DeinterleaveStereo32SSE2(const void* in,
+                              size_t frames,
+                              void* const* planes) {
+  const int32_t* src = static_cast<const int32_t*>(in);
+  int32_t* left = static_cast<int32_t*>(planes[0]);
+  int32_t* right = static_cast<int32_t*>(planes[1]);
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    __m128 a = _mm_castsi128_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2)));
+    __m128 b = _mm_castsi128_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2 + 4)));
+    // shuffles move bits, float samples come out unchanged
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(left + i),
+        _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))));
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(right + i),
+        _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+  }
+  void* rest[] = {left + i, right + i};
+  DeinterleaveScalar<4, 2>(src + i * 2, frames - i, rest);
+}
+#endif
+
+#if defined(AVE_PCM_NEON)
+void InterleaveStereo16NEON(const void* const* planes,
+                            size_t frames,
+                            void* out) {
+  const uint16_t* left = static_cast<const uint16_t*>(planes[0]);
+  const uint16_t* right = static_cast<const uint16_t*>(planes[1]);
+  uint16_t* dst = static_cast<uint16_t*>(out);
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    uint16x8x2_t x = {{vld1q_u16(left + i), vld1q_u16(right + i)}};
+    vst2q_u16(dst + i * 2, x);
+  }
+  const void* rest[] = {left + i, right + i};
+  InterleaveScalar<2, 2>(rest, frames - i, dst + i * 2);
+}
+
+void DeinterleaveStereo16NEON(const void* in,
+                              size_t frames,
+                              void* const* planes) {
+  const uint16_t* src = static_cast<const uint16_t*>(in);
+  uint16_t* left = static_cast<uint16_t*>(planes[0]);
+  uint16_t* right = static_cast<uint16_t*>(planes[1]);
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    uint16x8x2_t x = vld2q_u16(src + i * 2);
+    vst1q_u16(left + i, x.val[0]);
+    vst1q_u16(right + i, x.val[1]);
+  }
+  void* rest[] = {left + i, right + i};
+  DeinterleaveScalar<2, 2>(src + i * 2, frames - i, rest);
+}
+
+void InterleaveStereo32NEON(const void* const* planes,
+                            size_t frames,
+                            void* out) {
+  const uint32_t* left = static_cast<const uint32_t*>(planes[0]);
+  const uint32_t* right = static_cast<const uint32_t*>(planes[1]);
+  uint32_t* dst = static_cast<uint32_t*>(out);
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    uint32x4x2_t x = {{vld1q_u32(left + i), vld1q_u32(right + i)}};
+    vst2q_u32(dst + i * 2, x);
+  }
+  const void* rest[] = {left + i, right + i};
+  InterleaveScalar<4, 2>(rest, frames - i, dst + i * 2);
+}
+
+void DeinterleaveStereo32NEON(const void* in,
+                              size_t frames,
+                              void* const* planes) {
+  const uint32_t* src = static_cast<const uint32_t*>(in);
+  uint32_t* left = static_cast<uint32_t*>(planes[0]);
+  uint32_t* right = static_cast<uint32_t*>(planes[1]);
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    uint32x4x2_t x = vld2q_u32(src + i * 2);
+    vst1q_u32(left + i, x.val[0]);
+    vst1q_u32(right + i, x.val[1]);
+  }
+  void* rest[] = {left + i, right + i};
+  DeinterleaveScalar<4, 2>(src + i * 2, frames - i, rest);
+}
+#endif
+
+// Mono is a plain copy.
+template <size_t kSize>
+void InterleaveMono(const void* const* planes, size_t frames, void* out) {
+  memcpy(out, planes[0], frames * kSize);
+}
+
+template <size_t kSize>
+void DeinterleaveMono(const void* in, size_t frames, void* const* planes) {
+  memcpy(planes[0], in, frames * kSize);
+}
+
+// 4, 6 and 8 channels are moved in groups of four channels, transposed with
+// vector shuffles, and a pair for the last two of 6 channels.
+#if defined(AVE_PCM_X86) && defined(__SSE2__)
+template <size_t kChannels>
+void InterleaveMulti16SSE2(const void* const* planes,
+                           size_t frames,
+                           void* out) {
+  static_assert(kChannels % 2 == 0, "channels are moved in pairs");
+  const int16_t* src[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    src[ch] = static_cast<const int16_t*>(planes[ch]);
+  }
+  int16_t* dst = static_cast<int16_t*>(out);
+  // |v| holds 4 channels of 2 frames
+  auto store_frames = [](int16_t* first, __m128i v) {
+    if (kChannels == 4) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(first), v);
+    } else {
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(first), v);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(first + kChannels),
+                       _mm_unpackhi_epi64(v, v));
+    }
+  };
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    int16_t* frame = dst + i * kChannels;
+    size_t ch = 0;
+    for (; ch + 4 <= kChannels; ch += 4) {
+      __m128i p0 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[ch] + i));
+      __m128i p1 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[ch + 1] + i));
+      __m128i p2 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[ch + 2] + i));
+      __m128i p3 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[ch + 3] + i));
+      __m128i a_lo = _mm_unpacklo_epi16(p0, p1);
+      __m128i a_hi = _mm_unpackhi_epi16(p0, p1);
+      __m128i b_lo = _mm_unpacklo_epi16(p2, p3);
+      __m128i b_hi = _mm_unpackhi_epi16(p2, p3);
+      store_frames(frame + ch, _mm_unpacklo_epi32(a_lo, b_lo));
+      store_frames(frame + 2 * kChannels + ch, _mm_unpackhi_epi32(a_lo, b_lo));
+      store_frames(frame + 4 * kChannels + ch, _mm_unpacklo_epi32(a_hi, b_hi));
+      store_frames(frame + 6 * kChannels + ch, _mm_unpackhi_epi32(a_hi, b_hi));
+    }
+    if (ch < kChannels) {
+      __m128i p0 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[ch] + i));
+      __m128i p1 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[ch + 1] + i));
+      __m128i pairs[] = {_mm_unpacklo_epi16(p0, p1),
+                         _mm_unpackhi_epi16(p0, p1)};
+      for (size_t f = 0; f < 8; f++) {
+        int32_t pair = _mm_cvtsi128_si32(pairs[f / 4]);
+        pairs[f / 4] = _mm_srli_si128(pairs[f / 4], 4);
+        memcpy(frame + f * kChannels + ch, &pair, sizeof(pair));
+      }
+    }
+  }
+  const void* rest[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    rest[ch] = src[ch] + i;
+  }
+  InterleaveScalar<2, kChannels>(rest, frames - i, dst + i * kChannels);
+}
+
+template <size_t kChannels>
+void DeinterleaveMulti16SSE2(const void* in,
+                             size_t frames,
+                             void* const* planes) {
+  static_assert(kChannels % 2 == 0, "channels are moved in pairs");
+  const int16_t* src = static_cast<const int16_t*>(in);
+  int16_t* dst[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    dst[ch] = static_cast<int16_t*>(planes[ch]);
+  }
+  // 4 channels of 2 frames
+  auto load_frames = [](const int16_t* first) {
+    if (kChannels == 4) {
+      return _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    }
+    return _mm_unpacklo_epi64(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(first)),
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(first + kChannels)));
+  };
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    const int16_t* frame = src + i * kChannels;
+    size_t ch = 0;
+    for (; ch + 4 <= kChannels; ch += 4) {
+      __m128i f01 = load_frames(frame + ch);
+      __m128i f23 = load_frames(frame + 2 * kChannels + ch);
+      __m128i f45 = load_frames(frame + 4 * kChannels + ch);
+      __m128i f67 = load_frames(frame + 6 * kChannels + ch);
+      // frames 0 to 3 of channels 0 and 1, and of 2 and 3, then 4 to 7
+      __m128i t0 = _mm_unpacklo_epi16(f01, f23);
+      __m128i t1 = _mm_unpackhi_epi16(f01, f23);
+      __m128i lo01 = _mm_unpacklo_epi16(t0, t1);
+      __m128i lo23 = _mm_unpackhi_epi16(t0, t1);
+      t0 = _mm_unpacklo_epi16(f45, f67);
+      t1 = _mm_unpackhi_epi16(f45, f67);
+      __m128i hi01 = _mm_unpacklo_epi16(t0, t1);
+      __m128i hi23 = _mm_unpackhi_epi16(t0, t1);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[ch] + i),
+                       _mm_unpacklo_epi64(lo01, hi01));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[ch + 1] + i),
+                       _mm_unpackhi_epi64(lo01, hi01));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[ch + 2] + i),
+                       _mm_unpacklo_epi64(lo23, hi23));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[ch + 3] + i),
+                       _mm_unpackhi_epi64(lo23, hi23));
+    }
+    if (ch < kChannels) {
+      int32_t pairs[8];
+      for (size_t f = 0; f < 8; f++) {
+        memcpy(&pairs[f], frame + f * kChannels + ch, sizeof(pairs[f]));
+      }
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pairs));
+      __m128i b =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(pairs + 4));
+      // sign extended, so the saturating pack keeps every value
+      __m128i l = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                                  _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+      __m128i r =
+          _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[ch] + i), l);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[ch + 1] + i), r);
+    }
+  }
+  void* rest[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    rest[ch] = dst[ch] + i;
+  }
+  DeinterleaveScalar<2, kChannels>(src + i * kChannels, frames - i, rest);
+}
+
+template <size_t kChannels>
+void InterleaveMulti32SSE2(const void* const* planes,
+                           size_t frames,
+                           void* out) {
+  static_assert(kChannels % 2 == 0, "channels are moved in pairs");
+  const int32_t* src[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    src[ch] = static_cast<const int32_t*>(planes[ch]);
+  }
+  int32_t* dst = static_cast<int32_t*>(out);
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    int32_t* frame = dst + i * kChannels;
+    size_t ch = 0;
+    for (; ch + 4 <= kChannels; ch += 4) {
+      // shuffles move bits, float samples come out unchanged
+      __m128 r0 = _mm_castsi128_ps(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[ch] + i)));
+      __m128 r1 = _mm_castsi128_ps(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[ch + 1] + i)));
+      __m128 r2 = _mm_castsi128_ps(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[ch + 2] + i)));
+      __m128 r3 = _mm_castsi128_ps(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[ch + 3] + i)));
+      _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(frame + ch),
+                       _mm_castps_si128(r0));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(frame + kChannels + ch),
+                       _mm_castps_si128(r1));
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i*>(frame + 2 * kChannels + ch),
+          _mm_castps_si128(r2));
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i*>(frame + 3 * kChannels + ch),
+          _mm_castps_si128(r3));
+    }
+    if (ch < kChannels) {
+      __m128i p0 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[ch] + i));
+      __m128i p1 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[ch + 1] + i));
+      __m128i lo = _mm_unpacklo_epi32(p0, p1);
+      __m128i hi = _mm_unpackhi_epi32(p0, p1);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(frame + ch), lo);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(frame + kChannels + ch),
+                       _mm_unpackhi_epi64(lo, lo));
+      _mm_storel_epi64(
+          reinterpret_cast<__m128i*>(frame + 2 * kChannels + ch), hi);
+      _mm_storel_epi64(
+          reinterpret_cast<__m128i*>(frame + 3 * kChannels + ch),
+          _mm_unpackhi_epi64(hi, hi));
+    }
+  }
+  const void* rest[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    rest[ch] = src[ch] + i;
+  }
+  InterleaveScalar<4, kChannels>(rest, frames - i, dst + i * kChannels);
+}
+
+template <size_t kChannels>
+void DeinterleaveMulti32SSE2(const void* in,
+                             size_t frames,
+                             void* const* planes) {
+  static_assert(kChannels % 2 == 0, "channels are moved in pairs");
+  const int32_t* src = static_cast<const int32_t*>(in);
+  int32_t* dst[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    dst[ch] = static_cast<int32_t*>(planes[ch]);
+  }
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    const int32_t* frame = src + i * kChannels;
+    size_t ch = 0;
+    for (; ch + 4 <= kChannels; ch += 4) {
+      __m128 r0 = _mm_castsi128_ps(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(frame + ch)));
+      __m128 r1 = _mm_castsi128_ps(_mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(frame + kChannels + ch)));
+      __m128 r2 = _mm_castsi128_ps(_mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(frame + 2 * kChannels + ch)));
+      __m128 r3 = _mm_castsi128_ps(_mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(frame + 3 * kChannels + ch)));
+      _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[ch] + i),
+                       _mm_castps_si128(r0));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[ch + 1] + i),
+                       _mm_castps_si128(r1));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[ch + 2] + i),
+                       _mm_castps_si128(r2));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[ch + 3] + i),
+                       _mm_castps_si128(r3));
+    }
+    if (ch < kChannels) {
+      __m128 f01 = _mm_castsi128_ps(_mm_unpacklo_epi64(
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(frame + ch)),
+          _mm_loadl_epi64(
+              reinterpret_cast<const __m128i*>(frame + kChannels + ch))));
+      __m128 f23 = _mm_castsi128_ps(_mm_unpacklo_epi64(
+          _mm_loadl_epi64(
+              reinterpret_cast<const __m128i*>(frame + 2 * kChannels + ch)),
+          _mm_loadl_epi64(
+              reinterpret_cast<const __m128i*>(frame + 3 * kChannels + ch))));
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i*>(dst[ch] + i),
+          _mm_castps_si128(_mm_shuffle_ps(f01, f23, _MM_SHUFFLE(2, 0, 2, 0))));
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i*>(dst[ch + 1] + i),
+          _mm_castps_si128(_mm_shuffle_ps(f01, f23, _MM_SHUFFLE(3, 1, 3, 1))));
+    }
+  }
+  void* rest[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    rest[ch] = dst[ch] + i;
+  }
+  DeinterleaveScalar<4, kChannels>(src + i * kChannels, frames - i, rest);
+}
+#endif
+
+#if defined(AVE_PCM_NEON)
+// Channel pairs are zipped into lanes twice as wide, which vst2q, vst3q and
+// vst4q interleave as 2, 3 or 4 channels.
+inline void StoreLanes(uint32_t* dst, const uint32x4_t (&v)[2]) {
+  uint32x4x2_t x = {{v[0], v[1]}};
+  vst2q_u32(dst, x);
+}
+
+inline void StoreLanes(uint32_t* dst, const uint32x4_t (&v)[3]) {
+  uint32x4x3_t x = {{v[0], v[1], v[2]}};
+  vst3q_u32(dst, x);
+}
+
+inline void StoreLanes(uint32_t* dst, const uint32x4_t (&v)[4]) {
+  uint32x4x4_t x = {{v[0], v[1], v[2], v[3]}};
+  vst4q_u32(dst, x);
+}
+
+inline void StoreLanes(uint64_t* dst, const uint64x2_t (&v)[2]) {
+  uint64x2x2_t x = {{v[0], v[1]}};
+  vst2q_u64(dst, x);
+}
+
+inline void StoreLanes(uint64_t* dst, const uint64x2_t (&v)[3]) {
+  uint64x2x3_t x = {{v[0], v[1], v[2]}};
+  vst3q_u64(dst, x);
+}
+
+inline void StoreLanes(uint64_t* dst, const uint64x2_t (&v)[4]) {
+  uint64x2x4_t x = {{v[0], v[1], v[2], v[3]}};
+  vst4q_u64(dst, x);
+}
+
+inline void LoadLanes(const uint32_t* src, uint32x4_t (&v)[2]) {
+  uint32x4x2_t x = vld2q_u32(src);
+  v[0] = x.val[0];
+  v[1] = x.val[1];
+}
+
+inline void LoadLanes(const uint32_t* src, uint32x4_t (&v)[3]) {
+  uint32x4x3_t x = vld3q_u32(src);
+  v[0] = x.val[0];
+  v[1] = x.val[1];
+  v[2] = x.val[2];
+}
+
+inline void LoadLanes(const uint32_t* src, uint32x4_t (&v)[4]) {
+  uint32x4x4_t x = vld4q_u32(src);
+  v[0] = x.val[0];
+  v[1] = x.val[1];
+  v[2] = x.val[2];
+  v[3] = x.val[3];
+}
+
+inline void LoadLanes(const uint64_t* src, uint64x2_t (&v)[2]) {
+  uint64x2x2_t x = vld2q_u64(src);
+  v[0] = x.val[0];
+  v[1] = x.val[1];
+}
+
+inline void LoadLanes(const uint64_t* src, uint64x2_t (&v)[3]) {
+  uint64x2x3_t x = vld3q_u64(src);
+  v[0] = x.val[0];
+  v[1] = x.val[1];
+  v[2] = x.val[2];
+}
+
+inline void LoadLanes(const uint64_t* src, uint64x2_t (&v)[4]) {
+  uint64x2x4_t x = vld4q_u64(src);
+  v[0] = x.val[0];
+  v[1] = x.val[1];
+  v[2] = x.val[2];
+  v[3] = x.val[3];
+}
+
+template <size_t kChannels>
+void InterleaveMulti16NEON(const void* const* planes,
+                           size_t frames,
+                           void* out) {
+  static_assert(kChannels % 2 == 0, "channels are moved in pairs");
+  const size_t kPairs = kChannels / 2;
+  const uint16_t* src[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    src[ch] = static_cast<const uint16_t*>(planes[ch]);
+  }
+  uint16_t* dst = static_cast<uint16_t*>(out);
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    uint32x4_t lo[kPairs];
+    uint32x4_t hi[kPairs];
+    for (size_t p = 0; p < kPairs; p++) {
+      uint16x8_t a = vld1q_u16(src[2 * p] + i);
+      uint16x8_t b = vld1q_u16(src[2 * p + 1] + i);
+      lo[p] = vreinterpretq_u32_u16(vzip1q_u16(a, b));
+      hi[p] = vreinterpretq_u32_u16(vzip2q_u16(a, b));
+    }
+    StoreLanes(reinterpret_cast<uint32_t*>(dst + i * kChannels), lo);
+    StoreLanes(reinterpret_cast<uint32_t*>(dst + (i + 4) * kChannels), hi);
+  }
+  const void* rest[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    rest[ch] = src[ch] + i;
+  }
+  InterleaveScalar<2, kChannels>(rest, frames - i, dst + i * kChannels);
+}
+
+template <size_t kChannels>
+void DeinterleaveMulti16NEON(const void* in,
+                             size_t frames,
+                             void* const* planes) {
+  static_assert(kChannels % 2 == 0, "channels are moved in pairs");
+  const size_t kPairs = kChannels / 2;
+  const uint16_t* src = static_cast<const uint16_t*>(in);
+  uint16_t* dst[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    dst[ch] = static_cast<uint16_t*>(planes[ch]);
+  }
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    uint32x4_t lo[kPairs];
+    uint32x4_t hi[kPairs];
+    LoadLanes(reinterpret_cast<const uint32_t*>(src + i * kChannels), lo);
+    LoadLanes(reinterpret_cast<const uint32_t*>(src + (i + 4) * kChannels),
+              hi);
+    for (size_t p = 0; p < kPairs; p++) {
+      uint16x8_t a = vreinterpretq_u16_u32(lo[p]);
+      uint16x8_t b = vreinterpretq_u16_u32(hi[p]);
+      vst1q_u16(dst[2 * p] + i, vuzp1q_u16(a, b));
+      vst1q_u16(dst[2 * p + 1] + i, vuzp2q_u16(a, b));
+    }
+  }
+  void* rest[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    rest[ch] = dst[ch] + i;
+  }
+  DeinterleaveScalar<2, kChannels>(src + i * kChannels, frames - i, rest);
+}
+
+template <size_t kChannels>
+void InterleaveMulti32NEON(const void* const* planes,
+                           size_t frames,
+                           void* out) {
+  static_assert(kChannels % 2 == 0, "channels are moved in pairs");
+  const size_t kPairs = kChannels / 2;
+  const uint32_t* src[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    src[ch] = static_cast<const uint32_t*>(planes[ch]);
+  }
+  uint32_t* dst = static_cast<uint32_t*>(out);
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    uint64x2_t lo[kPairs];
+    uint64x2_t hi[kPairs];
+    for (size_t p = 0; p < kPairs; p++) {
+      uint32x4_t a = vld1q_u32(src[2 * p] + i);
+      uint32x4_t b = vld1q_u32(src[2 * p + 1] + i);
+      lo[p] = vreinterpretq_u64_u32(vzip1q_u32(a, b));
+      hi[p] = vreinterpretq_u64_u32(vzip2q_u32(a, b));
+    }
+    StoreLanes(reinterpret_cast<uint64_t*>(dst + i * kChannels), lo);
+    StoreLanes(reinterpret_cast<uint64_t*>(dst + (i + 2) * kChannels), hi);
+  }
+  const void* rest[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    rest[ch] = src[ch] + i;
+  }
+  InterleaveScalar<4, kChannels>(rest, frames - i, dst + i * kChannels);
+}
+
+template <size_t kChannels>
+void DeinterleaveMulti32NEON(const void* in,
+                             size_t frames,
+                             void* const* planes) {
+  static_assert(kChannels % 2 == 0, "channels are moved in pairs");
+  const size_t kPairs = kChannels / 2;
+  const uint32_t* src = static_cast<const uint32_t*>(in);
+  uint32_t* dst[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    dst[ch] = static_cast<uint32_t*>(planes[ch]);
+  }
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    uint64x2_t lo[kPairs];
+    uint64x2_t hi[kPairs];
+    LoadLanes(reinterpret_cast<const uint64_t*>(src + i * kChannels), lo);
+    LoadLanes(reinterpret_cast<const uint64_t*>(src + (i + 2) * kChannels),
+              hi);
+    for (size_t p = 0; p < kPairs; p++) {
+      uint32x4_t a = vreinterpretq_u32_u64(lo[p]);
+      uint32x4_t b = vreinterpretq_u32_u64(hi[p]);
+      vst1q_u32(dst[2 * p] + i, vuzp1q_u32(a, b));
+      vst1q_u32(dst[2 * p + 1] + i, vuzp2q_u32(a, b));
+    }
+  }
+  void* rest[kChannels];
+  for (size_t ch = 0; ch < kChannels; ch++) {
+    rest[ch] = dst[ch] + i;
+  }
+  DeinterleaveScalar<4, kChannels>(src + i * kChannels, frames - i, rest);
+}
+#endif
+
+// The vector kernels of 4, 6 and 8 channels, 8 and 24 bit samples are
+// moved by the scalar ones.
+template <size_t kSize, size_t kChannels>
+InterleaveProc GetMultiInterleaver() {
+#if defined(AVE_PCM_X86) && defined(__SSE2__)
+  if (kSize == 2) {
+    return InterleaveMulti16SSE2<kChannels>;
+  }
+  if (kSize == 4) {
+    return InterleaveMulti32SSE2<kChannels>;
+  }
+#elif defined(AVE_PCM_NEON)
+  if (kSize == 2) {
+    return InterleaveMulti16NEON<kChannels>;
+  }
+  if (kSize == 4) {
+    return InterleaveMulti32NEON<kChannels>;
+  }
+#endif
+  return InterleaveScalar<kSize, kChannels>;
+}
+
+template <size_t kSize, size_t kChannels>
+DeinterleaveProc GetMultiDeinterleaver() {
+#if defined(AVE_PCM_X86) && defined(__SSE2__)
+  if (kSize == 2) {
+    return DeinterleaveMulti16SSE2<kChannels>;
+  }
+  if (kSize == 4) {
+    return DeinterleaveMulti32SSE2<kChannels>;
+  }
+#elif defined(AVE_PCM_NEON)
+  if (kSize == 2) {
+    return DeinterleaveMulti16NEON<kChannels>;
+  }
+  if (kSize == 4) {
+    return DeinterleaveMulti32NEON<kChannels>;
+  }
+#endif
+  return DeinterleaveScalar<kSize, kChannels>;
+}
+
+template <size_t kSize>
+InterleaveProc GetInterleaver(size_t channels) {
+  switch (channels) {
+    case 1:
+      return InterleaveMono<kSize>;
+    case 2:
+#if defined(AVE_PCM_X86) && defined(__SSE2__)
+      if (kSize == 2) {
+        return InterleaveStereo16SSE2;
+      }
+      if (kSize == 4) {
+        return InterleaveStereo32SSE2;
+      }
+#elif defined(AVE_PCM_NEON)
+      if (kSize == 2) {
+        return InterleaveStereo16NEON;
+      }
+      if (kSize == 4) {
+        return InterleaveStereo32NEON;
+      }
+#endif
+      return InterleaveScalar<kSize, 2>;
+    case 3:
+      return InterleaveScalar<kSize, 3>;
+    case 4:
+      return GetMultiInterleaver<kSize, 4>();
+    case 5:
+      return InterleaveScalar<kSize, 5>;
+    case 6:
+      return GetMultiInterleaver<kSize, 6>();
+    case 7:
+      return InterleaveScalar<kSize, 7>;
+    case 8:
+      return GetMultiInterleaver<kSize, 8>();
+    default:
+      return nullptr;
+  }
+}
+
+template <size_t kSize>
+DeinterleaveProc GetDeinterleaver(size_t channels) {
+  switch (channels) {
+    case 1:
+      return DeinterleaveMono<kSize>;
+    case 2:
+#if defined(AVE_PCM_X86) && defined(__SSE2__)
+      if (kSize == 2) {
+        return DeinterleaveStereo16SSE2;
+      }
+      if (kSize == 4) {
+        return DeinterleaveStereo32SSE2;
+      }
+#elif defined(AVE_PCM_NEON)
+      if (kSize == 2) {
+        return DeinterleaveStereo16NEON;
+      }
+      if (kSize == 4) {
+        return DeinterleaveStereo32NEON;
+      }
+#endif
+      return DeinterleaveScalar<kSize, 2>;
+    case 3:
+      return DeinterleaveScalar<kSize, 3>;
+    case 4:
+      return GetMultiDeinterleaver<kSize, 4>();
+    case 5:
+      return DeinterleaveScalar<kSize, 5>;
+    case 6:
+      return GetMultiDeinterleaver<kSize, 6>();
+    case 7:
+      return DeinterleaveScalar<kSize, 7>;
+    case 8:
+      return GetMultiDeinterleaver<kSize, 8>();
+    default:
+      return nullptr;
+  }
+}
+
+InterleaveProc GetInterleaver(size_t sample_size, size_t channels) {
+  switch (sample_size) {
+    case 1:
+      return GetInterleaver<1>(channels);
+    case 2:
+      return GetInterleaver<2>(channels);
+    case 3:
+      return GetInterleaver<3>(channels);
+    case 4:
+      return GetInterleaver<4>(channels);
+    default:
+      return nullptr;
+  }
+}
+
+DeinterleaveProc GetDeinterleaver(size_t sample_size, size_t channels) {
+  switch (sample_size) {
+    case 1:
+      return GetDeinterleaver<1>(channels);
+    case 2:
+      return GetDeinterleaver<2>(channels);
+    case 3:
+      return GetDeinterleaver<3>(channels);
+    case 4:
+      return GetDeinterleaver<4>(channels);
+    default:
+      return nullptr;
+  }
+}
+
+}  // namespace
+
+size_t GetPcmSampleSize(AudioEncoding encoding) {
+  int format = ToFormat(encoding);
+  return format < 0 ? 0 : kSampleSizes[format];
+}
+
+PcmDither::PcmDither(uint32_t seed) {
+  // xorshift must not start at 0, spread the seed with a splitmix style
+  // step so the lanes are unrelated
+  for (int i = 0; i < 8; i++) {
+    uint32_t x = seed + 0x9e3779b9u * (i + 1);
+    x = (x ^ (x >> 16)) * 0x85ebca6bu;
+    x = (x ^ (x >> 13)) * 0xc2b2ae35u;
+    x ^= x >> 16;
+    state_[i] = x != 0 ? x : 1;
+  }
+}
+
+status_t ConvertPcm(AudioEncoding from,
+                    const void* in,
+                    AudioEncoding to,
+                    void* out,
+                    size_t samples,
+                    PcmDither* dither) {
+  int from_format = ToFormat(from);
+  int to_format = ToFormat(to);
+  if (from_format < 0 || to_format < 0) {
+    AVE_LOG(LS_ERROR) << "unsupported PCM conversion " << from << " to "
+                      << to;
+    return ERROR_UNSUPPORTED;
+  }
+  if (from_format == to_format) {
+    if (in != out) {
+      memcpy(out, in, samples * kSampleSizes[from_format]);
+    }
+    return OK;
+  }
+  Convert(from_format, to_format, static_cast<const uint8_t*>(in),
+          static_cast<uint8_t*>(out), samples,
+          dither != nullptr ? dither->state_ : nullptr);
+  return OK;
+}
+
+status_t InterleavePcm(AudioEncoding encoding,
+                       const void* const* planes,
+                       size_t channels,
+                       size_t frames,
+                       void* out) {
+  InterleaveProc interleave =
+      GetInterleaver(GetPcmSampleSize(encoding), channels);
+  if (interleave == nullptr) {
+    AVE_LOG(LS_ERROR) << "can not interleave " << channels
+                      << " channels of encoding " << encoding;
+    return ERROR_UNSUPPORTED;
+  }
+  interleave(planes, frames, out);
+  return OK;
+}
+
+status_t DeinterleavePcm(AudioEncoding encoding,
+                         const void* in,
+                         size_t channels,
+                         size_t frames,
+                         void* const* planes) {
+  DeinterleaveProc deinterleave =
+      GetDeinterleaver(GetPcmSampleSize(encoding), channels);
+  if (deinterleave == nullptr) {
+    AVE_LOG(LS_ERROR) << "can not deinterleave " << channels
+                      << " channels of encoding " << encoding;
+    return ERROR_UNSUPPORTED;
+  }
+  deinterleave(in, frames, planes);
+  return OK;
+}
+
+PcmConvertProc GetPcmConverter(PcmImpl impl,
+                               AudioEncoding from,
+                               AudioEncoding to) {
+  int from_format = ToFormat(from);
+  int to_format = ToFormat(to);
+  if (from_format < 0 || to_format < 0) {
+    return nullptr;
+  }
+  return GetConverter(impl, Pair(from_format, to_format));
+}
+
+PcmDitherProc GetPcmDitherConverter(PcmImpl impl) {
+  switch (impl) {
+    case PcmImpl::kScalar:
+      return FloatToS16DitherScalar;
+#if defined(AVE_PCM_X86) && defined(__SSE2__)
+    case PcmImpl::kSSE2:
+      return FloatToS16DitherSSE2;
+#endif
+#if defined(AVE_PCM_X86)
+    case PcmImpl::kAVX2:
+      return __builtin_cpu_supports("avx2") ? FloatToS16DitherAVX2 : nullptr;
+#endif
+#if defined(AVE_PCM_NEON)
+    case PcmImpl::kNEON:
+      return FloatToS16DitherNEON;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+}  // namespace ave
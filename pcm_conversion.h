@@ -0,0 +1,97 @@
+/*
+ * pcm_conversion.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef PCM_CONVERSION_H
+#define PCM_CONVERSION_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "base/types.h"
+
+#include "media_defs.h"
+#include "media_errors.h"
+
+namespace ave {
+
+// Bytes per sample of a PCM |encoding|, 0 if it is not one.
+size_t GetPcmSampleSize(AudioEncoding encoding);
+
+// The state of the TPDF dither added when float is converted to 16 bit, so
+// that quiet passages decay into noise instead of distortion. Keep one per
+// stream, the noise continues across calls.
+class PcmDither {
+ public:
+  explicit PcmDither(uint32_t seed = 0x6d2b79f5);
+
+ private:
+  friend status_t ConvertPcm(AudioEncoding from,
+                             const void* in,
+                             AudioEncoding to,
+                             void* out,
+                             size_t samples,
+                             PcmDither* dither);
+
+  // one xorshift32 generator per vector lane
+  uint32_t state_[8];
+};
+
+// Converts |samples| samples from one PCM encoding to another, the sample
+// count does not depend on the channel count.
+//
+// 8 bit samples are unsigned, 24 bit ones packed little endian, float is
+// nominally in [-1, 1). Narrowing rounds to the nearest value and saturates,
+// float is scaled by 2^(bits - 1) like Android's audio primitives. Without
+// a direct kernel, e.g. 8 to 24 bit, the conversion goes through 16 or 32
+// bit blocks. |dither| is only used from float to 16 bit.
+//
+// |out| may be |in| if the output samples are not wider, otherwise the
+// buffers must not overlap.
+status_t ConvertPcm(AudioEncoding from,
+                    const void* in,
+                    AudioEncoding to,
+                    void* out,
+                    size_t samples,
+                    PcmDither* dither = nullptr);
+
+// Interleaves |channels| planes of |frames| samples into |out|, and back.
+// Up to kMaxConcurrentChannels channels.
+status_t InterleavePcm(AudioEncoding encoding,
+                       const void* const* planes,
+                       size_t channels,
+                       size_t frames,
+                       void* out);
+status_t DeinterleavePcm(AudioEncoding encoding,
+                         const void* in,
+                         size_t channels,
+                         size_t frames,
+                         void* const* planes);
+
+enum class PcmImpl {
+  kScalar,
+  kSSE2,
+  kAVX2,
+  kNEON,
+};
+
+using PcmConvertProc = void (*)(const void* in, void* out, size_t samples);
+using PcmDitherProc = void (*)(const float* in,
+                               int16_t* out,
+                               size_t samples,
+                               uint32_t* state);
+
+// Returns the given implementation of a direct conversion, or nullptr if it
+// is not built in, not supported by this CPU or the pair has no direct
+// kernel. For tests and benchmarks.
+PcmConvertProc GetPcmConverter(PcmImpl impl,
+                               AudioEncoding from,
+                               AudioEncoding to);
+PcmDitherProc GetPcmDitherConverter(PcmImpl impl);
+
+}  // namespace ave
+
+#endif /* !PCM_CONVERSION_H */
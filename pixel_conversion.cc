@@ -0,0 +1,1063 @@
+/*
+ * pixel_conversion.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "pixel_conversion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "base/checks.h"
+#include "base/logging.h"
+
+#include "color_utils.h"
+#include "media_packet.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AVE_PIXEL_X86 1
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define AVE_PIXEL_NEON 1
+#endif
+
+namespace ave {
+
+namespace {
+
+// The matrix of a YuvColorSpace in fixed point. Every implementation does
+// the same integer arithmetic, so they agree to the bit.
+struct YuvConstants {
+  // R'G'B' to Y'CbCr in Q15, the offsets include the rounding
+  int16_t y_r, y_g, y_b;
+  int16_t u_r, u_g, u_b;
+  int16_t v_r, v_g, v_b;
+  int32_t y_offset;
+  int32_t uv_offset;
+  // Y'CbCr to R'G'B' in Q13, g_u and g_v are subtracted
+  int16_t y_scale;
+  int16_t y_sub;
+  int16_t r_v, g_u, g_v, b_u;
+};
+
+YuvConstants MakeYuvConstants(const YuvColorSpace& color) {
+  double kr;
+  double kb;
+  switch (color.matrix) {
+    case YuvColorSpace::kBT709:
+      kr = 0.2126;
+      kb = 0.0722;
+      break;
+    case YuvColorSpace::kBT2020:
+      kr = 0.2627;
+      kb = 0.0593;
+      break;
+    case YuvColorSpace::kBT601:
+    default:
+      kr = 0.299;
+      kb = 0.114;
+      break;
+  }
+  const double kg = 1.0 - kr - kb;
+  const double y_range = color.full_range ? 1.0 : 219.0 / 255.0;
+  const double c_range = color.full_range ? 1.0 : 224.0 / 255.0;
+  // computed in int32, q15(y_range) is 32768 for full range, only the
+  // coefficients themselves have to fit in int16
+  auto q15 = [](double value) {
+    return static_cast<int32_t>(std::lround(value * 32768));
+  };
+  auto q13 = [](double value) {
+    return static_cast<int32_t>(std::lround(value * 8192));
+  };
+  auto s16 = [](int32_t value) {
+    AVE_DCHECK(value >= std::numeric_limits<int16_t>::min() &&
+               value <= std::numeric_limits<int16_t>::max());
+    return static_cast<int16_t>(value);
+  };
+
+  YuvConstants k;
+  // the rows sum up exactly, so white and grey stay white and grey
+  const int32_t y_r = q15(kr * y_range);
+  const int32_t y_b = q15(kb * y_range);
+  k.y_r = s16(y_r);
+  k.y_b = s16(y_b);
+  k.y_g = s16(q15(y_range) - y_r - y_b);
+  const int32_t u_r = q15(-kr / (2 * (1 - kb)) * c_range);
+  const int32_t u_b = q15(0.5 * c_range);
+  k.u_r = s16(u_r);
+  k.u_b = s16(u_b);
+  k.u_g = s16(-u_r - u_b);
+  const int32_t v_r = q15(0.5 * c_range);
+  const int32_t v_b = q15(-kb / (2 * (1 - kr)) * c_range);
+  k.v_r = s16(v_r);
+  k.v_b = s16(v_b);
+  k.v_g = s16(-v_r - v_b);
+  k.y_offset = (color.full_range ? 0 : 16 << 15) + (1 << 14);
+  k.uv_offset = (128 << 15) + (1 << 14);
+
+  k.y_scale = s16(q13(1.0 / y_range));
+  k.y_sub = color.full_range ? 0 : 16;
+  k.r_v = s16(q13(2 * (1 - kr) / c_range));
+  k.g_u = s16(q13(2 * kb * (1 - kb) / kg / c_range));
+  k.g_v = s16(q13(2 * kr * (1 - kr) / kg / c_range));
+  k.b_u = s16(q13(2 * (1 - kb) / c_range));
+  return k;
+}
+
+// The row kernels of an implementation. Widths are in samples of the
+// output plane, except for the YUYV and RGBA ones which take the luma
+// width. The SIMD kernels finish the row with the scalar ones.
+struct RowKernels {
+  void (*split_uv)(const uint8_t* uv, uint8_t* u, uint8_t* v, int width);
+  void (*merge_uv)(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width);
+  // P010 keeps the 10 bits in the high bits of the samples
+  void (*split_uv_p010)(const uint16_t* uv,
+                        uint16_t* u,
+                        uint16_t* v,
+                        int width);
+  void (*merge_uv_p010)(const uint16_t* u,
+                        const uint16_t* v,
+                        uint16_t* uv,
+                        int width);
+  void (*p010_to_i010)(const uint16_t* in, uint16_t* out, int width);
+  void (*i010_to_p010)(const uint16_t* in, uint16_t* out, int width);
+  void (*yuyv_to_y)(const uint8_t* yuyv, uint8_t* y, int width);
+  void (*yuyv_to_uv)(const uint8_t* row0,
+                     const uint8_t* row1,
+                     uint8_t* u,
+                     uint8_t* v,
+                     int width);
+  void (*rgba_to_y)(const uint8_t* rgba,
+                    uint8_t* y,
+                    int width,
+                    const YuvConstants& k);
+  void (*rgba_to_uv)(const uint8_t* row0,
+                     const uint8_t* row1,
+                     uint8_t* u,
+                     uint8_t* v,
+                     int width,
+                     const YuvConstants& k);
+  void (*i420_to_rgba)(const uint8_t* y,
+                       const uint8_t* u,
+                       const uint8_t* v,
+                       uint8_t* rgba,
+                       int width,
+                       const YuvConstants& k);
+};
+
+uint8_t Clamp255(int32_t value) {
+  return static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+}
+
+void SplitUVScalar(const uint8_t* uv, uint8_t* u, uint8_t* v, int width) {
+  for (int x = 0; x < width; x++) {
+    u[x] = uv[2 * x];
+    v[x] = uv[2 * x + 1];
+  }
+}
+
+void MergeUVScalar(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width) {
+  for (int x = 0; x < width; x++) {
+    uv[2 * x] = u[x];
+    uv[2 * x + 1] = v[x];
+  }
+}
+
+void SplitUVP010Scalar(const uint16_t* uv,
+                       uint16_t* u,
+                       uint16_t* v,
+                       int width) {
+  for (int x = 0; x < width; x++) {
+    u[x] = static_cast<uint16_t>(uv[2 * x] >> 6);
+    v[x] = static_cast<uint16_t>(uv[2 * x + 1] >> 6);
+  }
+}
+
+void MergeUVP010Scalar(const uint16_t* u,
+                       const uint16_t* v,
+                       uint16_t* uv,
+                       int width) {
+  for (int x = 0; x < width; x++) {
+    uv[2 * x] = static_cast<uint16_t>(u[x] << 6);
+    uv[2 * x + 1] = static_cast<uint16_t>(v[x] << 6);
+  }
+}
+
+void P010ToI010Scalar(const uint16_t* in, uint16_t* out, int width) {
+  for (int x = 0; x < width; x++) {
+    out[x] = static_cast<uint16_t>(in[x] >> 6);
+  }
+}
+
+void I010ToP010Scalar(const uint16_t* in, uint16_t* out, int width) {
+  for (int x = 0; x < width; x++) {
+    out[x] = static_cast<uint16_t>(in[x] << 6);
+  }
+}
+
+void YUYVToYScalar(const uint8_t* yuyv, uint8_t* y, int width) {
+  for (int x = 0; x < width; x++) {
+    y[x] = yuyv[2 * x];
+  }
+}
+
+void YUYVToUVScalar(const uint8_t* row0,
+                    const uint8_t* row1,
+                    uint8_t* u,
+                    uint8_t* v,
+                    int width) {
+  for (int x = 0; x < width / 2; x++) {
+    u[x] = static_cast<uint8_t>((row0[4 * x + 1] + row1[4 * x + 1] + 1) >> 1);
+    v[x] = static_cast<uint8_t>((row0[4 * x + 3] + row1[4 * x + 3] + 1) >> 1);
+  }
+}
+
+void RGBAToYScalar(const uint8_t* rgba,
+                   uint8_t* y,
+                   int width,
+                   const YuvConstants& k) {
+  for (int x = 0; x < width; x++) {
+    const uint8_t* p = rgba + 4 * x;
+    y[x] = Clamp255((k.y_r * p[0] + k.y_g * p[1] + k.y_b * p[2] + k.y_offset) >>
+                    15);
+  }
+}
+
+// The last column of an odd width is repeated.
+void RGBAToUVScalar(const uint8_t* row0,
+                    const uint8_t* row1,
+                    uint8_t* u,
+                    uint8_t* v,
+                    int width,
+                    const YuvConstants& k) {
+  for (int x = 0; 2 * x < width; x++) {
+    const uint8_t* a = row0 + 8 * x;
+    const uint8_t* b = row1 + 8 * x;
+    const int next = 2 * x + 1 < width ? 4 : 0;
+    int32_t rgb[3];
+    for (int c = 0; c < 3; c++) {
+      rgb[c] = (a[c] + a[c + next] + b[c] + b[c + next] + 2) >> 2;
+    }
+    u[x] = Clamp255(
+        (k.u_r * rgb[0] + k.u_g * rgb[1] + k.u_b * rgb[2] + k.uv_offset) >> 15);
+    v[x] = Clamp255(
+        (k.v_r * rgb[0] + k.v_g * rgb[1] + k.v_b * rgb[2] + k.uv_offset) >> 15);
+  }
+}
+
+void I420ToRGBAScalar(const uint8_t* y,
+                      const uint8_t* u,
+                      const uint8_t* v,
+                      uint8_t* rgba,
+                      int width,
+                      const YuvConstants& k) {
+  const int32_t round = 1 << 12;
+  for (int x = 0; x < width; x++) {
+    int32_t luma = (y[x] - k.y_sub) * k.y_scale + round;
+    int32_t cb = u[x / 2] - 128;
+    int32_t cr = v[x / 2] - 128;
+    uint8_t* p = rgba + 4 * x;
+    p[0] = Clamp255((luma + k.r_v * cr) >> 13);
+    p[1] = Clamp255((luma - k.g_u * cb - k.g_v * cr) >> 13);
+    p[2] = Clamp255((luma + k.b_u * cb) >> 13);
+    p[3] = 255;
+  }
+}
+
+const RowKernels kScalarKernels = {
+    SplitUVScalar,     MergeUVScalar,    SplitUVP010Scalar,
+    MergeUVP010Scalar, P010ToI010Scalar, I010ToP010Scalar,
+    YUYVToYScalar,     YUYVToUVScalar,   RGBAToYScalar,
+    RGBAToUVScalar,    I420ToRGBAScalar,
+};
+
+#if defined(AVE_PIXEL_X86)
+
+#define AVE_PIXEL_AVX2 __attribute__((target("avx2")))
+
+AVE_PIXEL_AVX2 inline __m256i LoadAVX2(const void* p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+AVE_PIXEL_AVX2 inline void StoreAVX2(void* p, __m256i value) {
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), value);
+}
+
+// The weights of R, G and B for every pixel of 16 bit RGBA lanes.
+AVE_PIXEL_AVX2 inline __m256i PixelWeightsAVX2(int16_t r,
+                                               int16_t g,
+                                               int16_t b) {
+  return _mm256_setr_epi16(r, g, b, 0, r, g, b, 0, r, g, b, 0, r, g, b, 0);
+}
+
+AVE_PIXEL_AVX2 void SplitUVAVX2(const uint8_t* uv,
+                                uint8_t* u,
+                                uint8_t* v,
+                                int width) {
+  const __m256i mask = _mm256_set1_epi16(0x00ff);
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    __m256i a = LoadAVX2(uv + 2 * x);
+    __m256i b = LoadAVX2(uv + 2 * x + 32);
+    __m256i us = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+                                     _mm256_and_si256(b, mask));
+    __m256i vs = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+                                     _mm256_srli_epi16(b, 8));
+    StoreAVX2(u + x, _mm256_permute4x64_epi64(us, 0xd8));
+    StoreAVX2(v + x, _mm256_permute4x64_epi64(vs, 0xd8));
+  }
+  SplitUVScalar(uv + 2 * x, u + x, v + x, width - x);
+}
+
+AVE_PIXEL_AVX2 void MergeUVAVX2(const uint8_t* u,
+                                const uint8_t* v,
+                                uint8_t* uv,
+                                int width) {
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    // samples 0-7 and 16-23 in the low lane, the unpacks work per lane
+    __m256i us = _mm256_permute4x64_epi64(LoadAVX2(u + x), 0xd8);
+    __m256i vs = _mm256_permute4x64_epi64(LoadAVX2(v + x), 0xd8);
+    StoreAVX2(uv + 2 * x, _mm256_unpacklo_epi8(us, vs));
+    StoreAVX2(uv + 2 * x + 32, _mm256_unpackhi_epi8(us, vs));
+  }
+  MergeUVScalar(u + x, v + x, uv + 2 * x, width - x);
+}
+
+AVE_PIXEL_AVX2 void SplitUVP010AVX2(const uint16_t* uv,
+                                    uint16_t* u,
+                                    uint16_t* v,
+                                    int width) {
+  const __m256i mask = _mm256_set1_epi32(0xffff);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m256i a = LoadAVX2(uv + 2 * x);
+    __m256i b = LoadAVX2(uv + 2 * x + 16);
+    __m256i us =
+        _mm256_packus_epi32(_mm256_srli_epi32(_mm256_and_si256(a, mask), 6),
+                            _mm256_srli_epi32(_mm256_and_si256(b, mask), 6));
+    __m256i vs = _mm256_packus_epi32(_mm256_srli_epi32(a, 22),
+                                     _mm256_srli_epi32(b, 22));
+    StoreAVX2(u + x, _mm256_permute4x64_epi64(us, 0xd8));
+    StoreAVX2(v + x, _mm256_permute4x64_epi64(vs, 0xd8));
+  }
+  SplitUVP010Scalar(uv + 2 * x, u + x, v + x, width - x);
+}
+
+AVE_PIXEL_AVX2 void MergeUVP010AVX2(const uint16_t* u,
+                                    const uint16_t* v,
+                                    uint16_t* uv,
+                                    int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m256i us = _mm256_permute4x64_epi64(
+        _mm256_slli_epi16(LoadAVX2(u + x), 6), 0xd8);
+    __m256i vs = _mm256_permute4x64_epi64(
+        _mm256_slli_epi16(LoadAVX2(v + x), 6), 0xd8);
+    StoreAVX2(uv + 2 * x, _mm256_unpacklo_epi16(us, vs));
+    StoreAVX2(uv + 2 * x + 16, _mm256_unpackhi_epi16(us, vs));
+  }
+  MergeUVP010Scalar(u + x, v + x, uv + 2 * x, width - x);
+}
+
+AVE_PIXEL_AVX2 void P010ToI010AVX2(const uint16_t* in,
+                                   uint16_t* out,
+                                   int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    StoreAVX2(out + x, _mm256_srli_epi16(LoadAVX2(in + x), 6));
+  }
+  P010ToI010Scalar(in + x, out + x, width - x);
+}
+
+AVE_PIXEL_AVX2 void I010ToP010AVX2(const uint16_t* in,
+                                   uint16_t* out,
+                                   int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    StoreAVX2(out + x, _mm256_slli_epi16(LoadAVX2(in + x), 6));
+  }
+  I010ToP010Scalar(in + x, out + x, width - x);
+}
+
+AVE_PIXEL_AVX2 void YUYVToYAVX2(const uint8_t* yuyv, uint8_t* y, int width) {
+  const __m256i mask = _mm256_set1_epi16(0x00ff);
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    __m256i a = _mm256_and_si256(LoadAVX2(yuyv + 2 * x), mask);
+    __m256i b = _mm256_and_si256(LoadAVX2(yuyv + 2 * x + 32), mask);
+    StoreAVX2(y + x,
+              _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+  }
+  YUYVToYScalar(yuyv + 2 * x, y + x, width - x);
+}
+
+AVE_PIXEL_AVX2 void YUYVToUVAVX2(const uint8_t* row0,
+                                 const uint8_t* row1,
+                                 uint8_t* u,
+                                 uint8_t* v,
+                                 int width) {
+  const __m256i mask = _mm256_set1_epi16(0x00ff);
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    __m256i a =
+        _mm256_avg_epu8(LoadAVX2(row0 + 2 * x), LoadAVX2(row1 + 2 * x));
+    __m256i b = _mm256_avg_epu8(LoadAVX2(row0 + 2 * x + 32),
+                                LoadAVX2(row1 + 2 * x + 32));
+    // U V U V ... of 16 pixel pairs
+    __m256i uv = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8)),
+        0xd8);
+    __m256i planar = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(_mm256_and_si256(uv, mask),
+                            _mm256_srli_epi16(uv, 8)),
+        0xd8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x / 2),
+                     _mm256_castsi256_si128(planar));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(v + x / 2),
+                     _mm256_extracti128_si256(planar, 1));
+  }
+  YUYVToUVScalar(row0 + 2 * x, row1 + 2 * x, u + x / 2, v + x / 2,
+                 width - x);
+}
+
+// Weighted sums of the R, G and B of 8 pixels, in order.
+AVE_PIXEL_AVX2 inline __m256i WeightRGBAAVX2(__m256i lo,
+                                             __m256i hi,
+                                             __m256i weights) {
+  // pixels 0 1 4 5 | 2 3 6 7
+  __m256i sums = _mm256_hadd_epi32(_mm256_madd_epi16(lo, weights),
+                                   _mm256_madd_epi16(hi, weights));
+  return _mm256_permutevar8x32_epi32(sums,
+                                     _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+}
+
+AVE_PIXEL_AVX2 inline __m256i RGBAToY8AVX2(const uint8_t* rgba,
+                                           __m256i weights,
+                                           __m256i offset) {
+  __m256i pixels = LoadAVX2(rgba);
+  __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(pixels));
+  __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(pixels, 1));
+  return _mm256_srai_epi32(
+      _mm256_add_epi32(WeightRGBAAVX2(lo, hi, weights), offset), 15);
+}
+
+AVE_PIXEL_AVX2 void RGBAToYAVX2(const uint8_t* rgba,
+                                uint8_t* y,
+                                int width,
+                                const YuvConstants& k) {
+  const __m256i weights = PixelWeightsAVX2(k.y_r, k.y_g, k.y_b);
+  const __m256i offset = _mm256_set1_epi32(k.y_offset);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m256i a = RGBAToY8AVX2(rgba + 4 * x, weights, offset);
+    __m256i b = RGBAToY8AVX2(rgba + 4 * x + 32, weights, offset);
+    __m256i words =
+        _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xd8);
+    __m256i bytes = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(words, words), 0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + x),
+                     _mm256_castsi256_si128(bytes));
+  }
+  RGBAToYScalar(rgba + 4 * x, y + x, width - x, k);
+}
+
+// U and V of the 2x2 blocks of 8 pixels of two rows: u0-u3 v0-v3.
+AVE_PIXEL_AVX2 inline __m256i RGBAToUV4AVX2(const uint8_t* row0,
+                                            const uint8_t* row1,
+                                            __m256i u_weights,
+                                            __m256i v_weights,
+                                            __m256i offset) {
+  __m256i a = LoadAVX2(row0);
+  __m256i b = LoadAVX2(row1);
+  // vertical sums of pixels 0-3 and 4-7, two pixels per lane
+  __m256i lo =
+      _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(a)),
+                       _mm256_cvtepu8_epi16(_mm256_castsi256_si128(b)));
+  __m256i hi =
+      _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(a, 1)),
+                       _mm256_cvtepu8_epi16(_mm256_extracti128_si256(b, 1)));
+  lo = _mm256_add_epi16(lo, _mm256_shuffle_epi32(lo, 0x4e));
+  hi = _mm256_add_epi16(hi, _mm256_shuffle_epi32(hi, 0x4e));
+  // blocks 0 2 | 1 3
+  __m256i sums = _mm256_unpacklo_epi64(lo, hi);
+  __m256i rgb =
+      _mm256_srli_epi16(_mm256_add_epi16(sums, _mm256_set1_epi16(2)), 2);
+  // u0 u2 v0 v2 | u1 u3 v1 v3
+  __m256i uv = _mm256_hadd_epi32(_mm256_madd_epi16(rgb, u_weights),
+                                 _mm256_madd_epi16(rgb, v_weights));
+  uv = _mm256_permutevar8x32_epi32(uv,
+                                   _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+  return _mm256_srai_epi32(_mm256_add_epi32(uv, offset), 15);
+}
+
+AVE_PIXEL_AVX2 void RGBAToUVAVX2(const uint8_t* row0,
+                                 const uint8_t* row1,
+                                 uint8_t* u,
+                                 uint8_t* v,
+                                 int width,
+                                 const YuvConstants& k) {
+  const __m256i u_weights = PixelWeightsAVX2(k.u_r, k.u_g, k.u_b);
+  const __m256i v_weights = PixelWeightsAVX2(k.v_r, k.v_g, k.v_b);
+  const __m256i offset = _mm256_set1_epi32(k.uv_offset);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m256i a = RGBAToUV4AVX2(row0 + 4 * x, row1 + 4 * x, u_weights,
+                              v_weights, offset);
+    __m256i b = RGBAToUV4AVX2(row0 + 4 * x + 32, row1 + 4 * x + 32,
+                              u_weights, v_weights, offset);
+    // u0-u7 | v0-v7
+    __m256i words = _mm256_packs_epi32(a, b);
+    __m256i bytes = _mm256_packus_epi16(words, words);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2),
+                     _mm256_castsi256_si128(bytes));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2),
+                     _mm256_extracti128_si256(bytes, 1));
+  }
+  RGBAToUVScalar(row0 + 4 * x, row1 + 4 * x, u + x / 2, v + x / 2,
+                 width - x, k);
+}
+
+// 4 chroma samples repeated for 8 pixels, minus 128.
+AVE_PIXEL_AVX2 inline __m256i LoadChroma8AVX2(const uint8_t* p) {
+  int32_t bits;
+  memcpy(&bits, p, sizeof(bits));
+  __m128i samples = _mm_cvtsi32_si128(bits);
+  return _mm256_sub_epi32(
+      _mm256_cvtepu8_epi32(_mm_unpacklo_epi8(samples, samples)),
+      _mm256_set1_epi32(128));
+}
+
+AVE_PIXEL_AVX2 void I420ToRGBAAVX2(const uint8_t* y,
+                                   const uint8_t* u,
+                                   const uint8_t* v,
+                                   uint8_t* rgba,
+                                   int width,
+                                   const YuvConstants& k) {
+  const __m256i y_sub = _mm256_set1_epi32(k.y_sub);
+  const __m256i y_scale = _mm256_set1_epi32(k.y_scale);
+  const __m256i r_v = _mm256_set1_epi32(k.r_v);
+  const __m256i g_u = _mm256_set1_epi32(k.g_u);
+  const __m256i g_v = _mm256_set1_epi32(k.g_v);
+  const __m256i b_u = _mm256_set1_epi32(k.b_u);
+  const __m256i round = _mm256_set1_epi32(1 << 12);
+  const __m256i alpha = _mm256_set1_epi32(255);
+  // R G B A planes of 4 pixels per lane to RGBA pixels
+  const __m256i interleave =
+      _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+                       0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i luma8 =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + x));
+    __m256i luma = _mm256_add_epi32(
+        _mm256_mullo_epi32(
+            _mm256_sub_epi32(_mm256_cvtepu8_epi32(luma8), y_sub), y_scale),
+        round);
+    __m256i cb = LoadChroma8AVX2(u + x / 2);
+    __m256i cr = LoadChroma8AVX2(v + x / 2);
+    __m256i r = _mm256_srai_epi32(
+        _mm256_add_epi32(luma, _mm256_mullo_epi32(cr, r_v)), 13);
+    __m256i g = _mm256_srai_epi32(
+        _mm256_sub_epi32(
+            _mm256_sub_epi32(luma, _mm256_mullo_epi32(cb, g_u)),
+            _mm256_mullo_epi32(cr, g_v)),
+        13);
+    __m256i b = _mm256_srai_epi32(
+        _mm256_add_epi32(luma, _mm256_mullo_epi32(cb, b_u)), 13);
+    __m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(r, g),
+                                        _mm256_packs_epi32(b, alpha));
+    StoreAVX2(rgba + 4 * x, _mm256_shuffle_epi8(bytes, interleave));
+  }
+  I420ToRGBAScalar(y + x, u + x / 2, v + x / 2, rgba + 4 * x, width - x, k);
+}
+
+#undef AVE_PIXEL_AVX2
+
+const RowKernels kAVX2Kernels = {
+    SplitUVAVX2,     MergeUVAVX2,    SplitUVP010AVX2,
+    MergeUVP010AVX2, P010ToI010AVX2, I010ToP010AVX2,
+    YUYVToYAVX2,     YUYVToUVAVX2,   RGBAToYAVX2,
+    RGBAToUVAVX2,    I420ToRGBAAVX2,
+};
+
+#endif
+
+#if defined(AVE_PIXEL_NEON)
+
+void SplitUVNEON(const uint8_t* uv, uint8_t* u, uint8_t* v, int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    uint8x16x2_t samples = vld2q_u8(uv + 2 * x);
+    vst1q_u8(u + x, samples.val[0]);
+    vst1q_u8(v + x, samples.val[1]);
+  }
+  SplitUVScalar(uv + 2 * x, u + x, v + x, width - x);
+}
+
+void MergeUVNEON(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    uint8x16x2_t samples = {{vld1q_u8(u + x), vld1q_u8(v + x)}};
+    vst2q_u8(uv + 2 * x, samples);
+  }
+  MergeUVScalar(u + x, v + x, uv + 2 * x, width - x);
+}
+
+void SplitUVP010NEON(const uint16_t* uv,
+                     uint16_t* u,
+                     uint16_t* v,
+                     int width) {
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    uint16x8x2_t samples = vld2q_u16(uv + 2 * x);
+    vst1q_u16(u + x, vshrq_n_u16(samples.val[0], 6));
+    vst1q_u16(v + x, vshrq_n_u16(samples.val[1], 6));
+  }
+  SplitUVP010Scalar(uv + 2 * x, u + x, v + x, width - x);
+}
+
+void MergeUVP010NEON(const uint16_t* u,
+                     const uint16_t* v,
+                     uint16_t* uv,
+                     int width) {
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    uint16x8x2_t samples = {{vshlq_n_u16(vld1q_u16(u + x), 6),
+                             vshlq_n_u16(vld1q_u16(v + x), 6)}};
+    vst2q_u16(uv + 2 * x, samples);
+  }
+  MergeUVP010Scalar(u + x, v + x, uv + 2 * x, width - x);
+}
+
+void P010ToI010NEON(const uint16_t* in, uint16_t* out, int width) {
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    vst1q_u16(out + x, vshrq_n_u16(vld1q_u16(in + x), 6));
+  }
+  P010ToI010Scalar(in + x, out + x, width - x);
+}
+
+void I010ToP010NEON(const uint16_t* in, uint16_t* out, int width) {
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    vst1q_u16(out + x, vshlq_n_u16(vld1q_u16(in + x), 6));
+  }
+  I010ToP010Scalar(in + x, out + x, width - x);
+}
+
+void YUYVToYNEON(const uint8_t* yuyv, uint8_t* y, int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    vst1q_u8(y + x, vld2q_u8(yuyv + 2 * x).val[0]);
+  }
+  YUYVToYScalar(yuyv + 2 * x, y + x, width - x);
+}
+
+void YUYVToUVNEON(const uint8_t* row0,
+                  const uint8_t* row1,
+                  uint8_t* u,
+                  uint8_t* v,
+                  int width) {
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    // Y0 U Y1 V
+    uint8x16x4_t a = vld4q_u8(row0 + 2 * x);
+    uint8x16x4_t b = vld4q_u8(row1 + 2 * x);
+    vst1q_u8(u + x / 2, vrhaddq_u8(a.val[1], b.val[1]));
+    vst1q_u8(v + x / 2, vrhaddq_u8(a.val[3], b.val[3]));
+  }
+  YUYVToUVScalar(row0 + 2 * x, row1 + 2 * x, u + x / 2, v + x / 2,
+                 width - x);
+}
+
+// (r * wr + g * wg + b * wb + offset) >> 15 of 8 pixels, saturated.
+inline uint8x8_t WeightRGBNEON(int16x8_t r,
+                               int16x8_t g,
+                               int16x8_t b,
+                               int16_t wr,
+                               int16_t wg,
+                               int16_t wb,
+                               int32x4_t offset) {
+  int32x4_t lo = vmlal_n_s16(offset, vget_low_s16(r), wr);
+  lo = vmlal_n_s16(lo, vget_low_s16(g), wg);
+  lo = vmlal_n_s16(lo, vget_low_s16(b), wb);
+  int32x4_t hi = vmlal_n_s16(offset, vget_high_s16(r), wr);
+  hi = vmlal_n_s16(hi, vget_high_s16(g), wg);
+  hi = vmlal_n_s16(hi, vget_high_s16(b), wb);
+  return vqmovn_u16(vcombine_u16(vqmovun_s32(vshrq_n_s32(lo, 15)),
+                                 vqmovun_s32(vshrq_n_s32(hi, 15))));
+}
+
+inline int16x8_t WidenNEON(uint8x8_t value) {
+  return vreinterpretq_s16_u16(vmovl_u8(value));
+}
+
+void RGBAToYNEON(const uint8_t* rgba,
+                 uint8_t* y,
+                 int width,
+                 const YuvConstants& k) {
+  const int32x4_t offset = vdupq_n_s32(k.y_offset);
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    uint8x8x4_t pixels = vld4_u8(rgba + 4 * x);
+    vst1_u8(y + x, WeightRGBNEON(WidenNEON(pixels.val[0]),
+                                 WidenNEON(pixels.val[1]),
+                                 WidenNEON(pixels.val[2]), k.y_r, k.y_g,
+                                 k.y_b, offset));
+  }
+  RGBAToYScalar(rgba + 4 * x, y + x, width - x, k);
+}
+
+void RGBAToUVNEON(const uint8_t* row0,
+                  const uint8_t* row1,
+                  uint8_t* u,
+                  uint8_t* v,
+                  int width,
+                  const YuvConstants& k) {
+  const int32x4_t offset = vdupq_n_s32(k.uv_offset);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    uint8x16x4_t a = vld4q_u8(row0 + 4 * x);
+    uint8x16x4_t b = vld4q_u8(row1 + 4 * x);
+    int16x8_t rgb[3];
+    for (int c = 0; c < 3; c++) {
+      // the averages of the 2x2 blocks, rounded
+      uint16x8_t sums = vpadalq_u8(vpaddlq_u8(a.val[c]), b.val[c]);
+      rgb[c] = vreinterpretq_s16_u16(vrshrq_n_u16(sums, 2));
+    }
+    vst1_u8(u + x / 2, WeightRGBNEON(rgb[0], rgb[1], rgb[2], k.u_r, k.u_g,
+                                     k.u_b, offset));
+    vst1_u8(v + x / 2, WeightRGBNEON(rgb[0], rgb[1], rgb[2], k.v_r, k.v_g,
+                                     k.v_b, offset));
+  }
+  RGBAToUVScalar(row0 + 4 * x, row1 + 4 * x, u + x / 2, v + x / 2,
+                 width - x, k);
+}
+
+inline uint8x8_t NarrowNEON(int32x4_t lo, int32x4_t hi) {
+  return vqmovn_u16(vcombine_u16(vqmovun_s32(vrshrq_n_s32(lo, 13)),
+                                 vqmovun_s32(vrshrq_n_s32(hi, 13))));
+}
+
+// 8 pixels, the chroma already repeated for every pixel.
+inline uint8x8x4_t YuvToRGBA8NEON(uint8x8_t y,
+                                  uint8x8_t u,
+                                  uint8x8_t v,
+                                  const YuvConstants& k) {
+  int16x8_t luma = vsubq_s16(WidenNEON(y), vdupq_n_s16(k.y_sub));
+  int16x8_t cb = vsubq_s16(WidenNEON(u), vdupq_n_s16(128));
+  int16x8_t cr = vsubq_s16(WidenNEON(v), vdupq_n_s16(128));
+  int32x4_t luma_lo = vmull_n_s16(vget_low_s16(luma), k.y_scale);
+  int32x4_t luma_hi = vmull_n_s16(vget_high_s16(luma), k.y_scale);
+
+  uint8x8x4_t pixels;
+  pixels.val[0] =
+      NarrowNEON(vmlal_n_s16(luma_lo, vget_low_s16(cr), k.r_v),
+                 vmlal_n_s16(luma_hi, vget_high_s16(cr), k.r_v));
+  pixels.val[1] = NarrowNEON(
+      vmlsl_n_s16(vmlsl_n_s16(luma_lo, vget_low_s16(cb), k.g_u),
+                  vget_low_s16(cr), k.g_v),
+      vmlsl_n_s16(vmlsl_n_s16(luma_hi, vget_high_s16(cb), k.g_u),
+                  vget_high_s16(cr), k.g_v));
+  pixels.val[2] =
+      NarrowNEON(vmlal_n_s16(luma_lo, vget_low_s16(cb), k.b_u),
+                 vmlal_n_s16(luma_hi, vget_high_s16(cb), k.b_u));
+  pixels.val[3] = vdup_n_u8(255);
+  return pixels;
+}
+
+void I420ToRGBANEON(const uint8_t* y,
+                    const uint8_t* u,
+                    const uint8_t* v,
+                    uint8_t* rgba,
+                    int width,
+                    const YuvConstants& k) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    uint8x16_t luma = vld1q_u8(y + x);
+    uint8x8_t cb = vld1_u8(u + x / 2);
+    uint8x8_t cr = vld1_u8(v + x / 2);
+    uint8x8x2_t cbs = vzip_u8(cb, cb);
+    uint8x8x2_t crs = vzip_u8(cr, cr);
+    vst4_u8(rgba + 4 * x,
+            YuvToRGBA8NEON(vget_low_u8(luma), cbs.val[0], crs.val[0], k));
+    vst4_u8(rgba + 4 * x + 32,
+            YuvToRGBA8NEON(vget_high_u8(luma), cbs.val[1], crs.val[1], k));
+  }
+  I420ToRGBAScalar(y + x, u + x / 2, v + x / 2, rgba + 4 * x, width - x, k);
+}
+
+const RowKernels kNEONKernels = {
+    SplitUVNEON,     MergeUVNEON,    SplitUVP010NEON,
+    MergeUVP010NEON, P010ToI010NEON, I010ToP010NEON,
+    YUYVToYNEON,     YUYVToUVNEON,   RGBAToYNEON,
+    RGBAToUVNEON,    I420ToRGBANEON,
+};
+
+#endif
+
+const RowKernels* GetRowKernels(PixelImpl impl) {
+  switch (impl) {
+    case PixelImpl::kScalar:
+      return &kScalarKernels;
+#if defined(AVE_PIXEL_X86)
+    case PixelImpl::kAVX2:
+      return __builtin_cpu_supports("avx2") ? &kAVX2Kernels : nullptr;
+#endif
+#if defined(AVE_PIXEL_NEON)
+    case PixelImpl::kNEON:
+      return &kNEONKernels;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+const PixelImpl kPreferred[] = {
+    PixelImpl::kAVX2,
+    PixelImpl::kNEON,
+    PixelImpl::kScalar,
+};
+
+const RowKernels& GetBestRowKernels() {
+  static const RowKernels* kernels = []() {
+    for (PixelImpl impl : kPreferred) {
+      if (const RowKernels* found = GetRowKernels(impl)) {
+        return found;
+      }
+    }
+    return &kScalarKernels;
+  }();
+  return *kernels;
+}
+
+// The layouts the kernels handle, checked against the views since one
+// from a MediaImage2 may space its samples differently.
+struct Layout {
+  PixelFormat format;
+  size_t num_planes;
+  int32_t col_inc[3];
+};
+
+const Layout kLayouts[] = {
+    {AV_PIX_FMT_YUV420P, 3, {1, 1, 1}},
+    {AV_PIX_FMT_NV12, 2, {1, 2, 0}},
+    {AV_PIX_FMT_YUYV422, 1, {2, 0, 0}},
+    {AV_PIX_FMT_P010LE, 2, {2, 4, 0}},
+    {AV_PIX_FMT_YUV420P10LE, 3, {2, 2, 2}},
+    {AV_PIX_FMT_RGBA, 1, {4, 0, 0}},
+};
+
+bool HasKnownLayout(const FrameView& view) {
+  for (const auto& layout : kLayouts) {
+    if (layout.format != view.format()) {
+      continue;
+    }
+    if (view.num_planes() != layout.num_planes) {
+      return false;
+    }
+    for (size_t i = 0; i < layout.num_planes; i++) {
+      if (view.plane(i).col_inc != layout.col_inc[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+constexpr int Pair(PixelFormat from, PixelFormat to) {
+  return static_cast<int>(from) * 1024 + static_cast<int>(to);
+}
+
+const uint16_t* Row16(const FrameView::Plane& plane, uint32_t y) {
+  return reinterpret_cast<const uint16_t*>(plane.row(y));
+}
+
+uint16_t* MutableRow16(const FrameView::Plane& plane, uint32_t y) {
+  return reinterpret_cast<uint16_t*>(plane.row(y));
+}
+
+void CopyPlane(const FrameView::Plane& src, const FrameView::Plane& dst) {
+  const size_t bytes = size_t{src.width} * src.col_inc;
+  for (uint32_t y = 0; y < src.height; y++) {
+    memcpy(dst.row(y), src.row(y), bytes);
+  }
+}
+
+status_t Convert(const FrameView& src,
+                 const FrameView& dst,
+                 const YuvColorSpace& color,
+                 const RowKernels& kernels) {
+  if (!src.valid() || !dst.valid() || src.width() != dst.width() ||
+      src.height() != dst.height()) {
+    AVE_LOG(LS_ERROR) << "can not convert a " << src.width() << "x"
+                      << src.height() << " frame to " << dst.width() << "x"
+                      << dst.height();
+    return BAD_VALUE;
+  }
+  if (!HasKnownLayout(src) || !HasKnownLayout(dst) ||
+      (src.format() == AV_PIX_FMT_YUYV422 && src.width() % 2 != 0)) {
+    AVE_LOG(LS_ERROR) << "unsupported pixel conversion " << src.format()
+                      << " to " << dst.format();
+    return ERROR_UNSUPPORTED;
+  }
+
+  const int width = static_cast<int>(src.width());
+  const uint32_t height = src.height();
+  const int chroma_width = static_cast<int>((src.width() + 1) / 2);
+  const uint32_t chroma_height = (height + 1) / 2;
+  if (src.format() == dst.format()) {
+    for (size_t i = 0; i < src.num_planes(); i++) {
+      CopyPlane(src.plane(i), dst.plane(i));
+    }
+    return OK;
+  }
+
+  const FrameView::Plane& s0 = src.plane(0);
+  const FrameView::Plane& s1 = src.plane(1);
+  const FrameView::Plane& s2 = src.plane(2);
+  const FrameView::Plane& d0 = dst.plane(0);
+  const FrameView::Plane& d1 = dst.plane(1);
+  const FrameView::Plane& d2 = dst.plane(2);
+  switch (Pair(src.format(), dst.format())) {
+    case Pair(AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P):
+      CopyPlane(s0, d0);
+      for (uint32_t y = 0; y < chroma_height; y++) {
+        kernels.split_uv(s1.row(y), d1.row(y), d2.row(y), chroma_width);
+      }
+      return OK;
+    case Pair(AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12):
+      CopyPlane(s0, d0);
+      for (uint32_t y = 0; y < chroma_height; y++) {
+        kernels.merge_uv(s1.row(y), s2.row(y), d1.row(y), chroma_width);
+      }
+      return OK;
+    case Pair(AV_PIX_FMT_P010LE, AV_PIX_FMT_YUV420P10LE):
+      for (uint32_t y = 0; y < height; y++) {
+        kernels.p010_to_i010(Row16(s0, y), MutableRow16(d0, y), width);
+      }
+      for (uint32_t y = 0; y < chroma_height; y++) {
+        kernels.split_uv_p010(Row16(s1, y), MutableRow16(d1, y),
+                              MutableRow16(d2, y), chroma_width);
+      }
+      return OK;
+    case Pair(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE):
+      for (uint32_t y = 0; y < height; y++) {
+        kernels.i010_to_p010(Row16(s0, y), MutableRow16(d0, y), width);
+      }
+      for (uint32_t y = 0; y < chroma_height; y++) {
+        kernels.merge_uv_p010(Row16(s1, y), Row16(s2, y), MutableRow16(d1, y),
+                              chroma_width);
+      }
+      return OK;
+    case Pair(AV_PIX_FMT_YUYV422, AV_PIX_FMT_YUV420P):
+      for (uint32_t y = 0; y < height; y++) {
+        kernels.yuyv_to_y(s0.row(y), d0.row(y), width);
+      }
+      // the last row of an odd height is paired with itself
+      for (uint32_t y = 0; y < chroma_height; y++) {
+        kernels.yuyv_to_uv(s0.row(2 * y),
+                           s0.row(std::min(2 * y + 1, height - 1)),
+                           d1.row(y), d2.row(y), width);
+      }
+      return OK;
+    case Pair(AV_PIX_FMT_RGBA, AV_PIX_FMT_YUV420P): {
+      const YuvConstants k = MakeYuvConstants(color);
+      for (uint32_t y = 0; y < height; y++) {
+        kernels.rgba_to_y(s0.row(y), d0.row(y), width, k);
+      }
+      for (uint32_t y = 0; y < chroma_height; y++) {
+        kernels.rgba_to_uv(s0.row(2 * y),
+                           s0.row(std::min(2 * y + 1, height - 1)),
+                           d1.row(y), d2.row(y), width, k);
+      }
+      return OK;
+    }
+    case Pair(AV_PIX_FMT_YUV420P, AV_PIX_FMT_RGBA): {
+      const YuvConstants k = MakeYuvConstants(color);
+      for (uint32_t y = 0; y < height; y++) {
+        kernels.i420_to_rgba(s0.row(y), s1.row(y / 2), s2.row(y / 2),
+                             d0.row(y), width, k);
+      }
+      return OK;
+    }
+    default:
+      AVE_LOG(LS_ERROR) << "unsupported pixel conversion " << src.format()
+                        << " to " << dst.format();
+      return ERROR_UNSUPPORTED;
+  }
+}
+
+}  // namespace
+
+YuvColorSpace GetYuvColorSpace(const ColorAspects& aspects,
+                               int32_t width,
+                               int32_t height) {
+  ColorAspects defaulted = aspects;
+  ColorUtils::setDefaultCodecColorAspectsIfNeeded(defaulted, width, height);
+
+  YuvColorSpace color;
+  switch (defaulted.mMatrixCoeffs) {
+    case ColorAspects::MatrixBT709_5:
+      color.matrix = YuvColorSpace::kBT709;
+      break;
+    case ColorAspects::MatrixBT2020:
+    case ColorAspects::MatrixBT2020Constant:
+      color.matrix = YuvColorSpace::kBT2020;
+      break;
+    default:
+      color.matrix = YuvColorSpace::kBT601;
+      break;
+  }
+  color.full_range = defaulted.mRange == ColorAspects::RangeFull;
+  return color;
+}
+
+status_t ConvertFrame(const FrameView& src,
+                      const FrameView& dst,
+                      const YuvColorSpace& color) {
+  return Convert(src, dst, color, GetBestRowKernels());
+}
+
+status_t ConvertFrame(const FrameView& src,
+                      const FrameView& dst,
+                      const YuvColorSpace& color,
+                      PixelImpl impl) {
+  const RowKernels* kernels = GetRowKernels(impl);
+  if (kernels == nullptr) {
+    return ERROR_UNSUPPORTED;
+  }
+  return Convert(src, dst, color, *kernels);
+}
+
+status_t ConvertFrame(MediaPacket& src,
+                      MediaPacket& dst,
+                      const ColorAspects& aspects) {
+  FrameView in = FrameView::Create(src);
+  VideoSampleInfo* info = dst.video_info();
+  if (!in.valid() || info == nullptr) {
+    AVE_LOG(LS_ERROR) << "can not convert, the packets are no video frames";
+    return BAD_VALUE;
+  }
+
+  status_t err = FrameView::PrepareOutput(src, dst, info->pixel_format,
+                                          in.width(), in.height());
+  if (err != OK) {
+    return err;
+  }
+
+  FrameView out = FrameView::Create(dst);
+  return ConvertFrame(
+      in, out, GetYuvColorSpace(aspects, info->width, info->height));
+}
+
+}  // namespace ave
@@ -0,0 +1,83 @@
+/*
+ * pixel_conversion.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef PIXEL_CONVERSION_H
+#define PIXEL_CONVERSION_H
+
+#include <cstdint>
+
+#include "base/types.h"
+
+#include "frame_view.h"
+#include "media/hardware/video_api.h"
+#include "media_errors.h"
+
+namespace ave {
+
+class MediaPacket;
+
+// How Y'CbCr relates to R'G'B' in a conversion between the two.
+struct YuvColorSpace {
+  enum Matrix {
+    kBT601,
+    kBT709,
+    kBT2020,
+  };
+
+  Matrix matrix = kBT601;
+  // 0-255 instead of 16-235 luma and 16-240 chroma
+  bool full_range = false;
+};
+
+// Picks the matrix and range of |aspects|, the unspecified ones are
+// defaulted from the frame size by
+// ColorUtils::setDefaultCodecColorAspectsIfNeeded(). BT.470 M and SMPTE
+// 240M are converted as BT.601, constant luminance BT.2020 as the non
+// constant one.
+YuvColorSpace GetYuvColorSpace(const ColorAspects& aspects,
+                               int32_t width,
+                               int32_t height);
+
+// Converts the pixels of |src| into |dst|, which must have the same size.
+// Supported are
+//   NV12 <-> YUV420P
+//   YUYV422 -> YUV420P, the chroma of two rows averaged
+//   P010LE <-> YUV420P10LE
+//   RGBA <-> YUV420P, in |color|; chroma is averaged over 2x2 pixels and
+//   upsampled by repeating it
+// and copying between two views of one of these formats. Both views may
+// have any stride, including a negative one. Returns ERROR_UNSUPPORTED for
+// other pairs and odd widths of YUYV422.
+status_t ConvertFrame(const FrameView& src,
+                      const FrameView& dst,
+                      const YuvColorSpace& color = YuvColorSpace());
+
+// Converts the frame described by the VideoSampleInfo of |src| into the
+// pixel format of |dst|'s, in the matrix and range of |aspects|. The other
+// fields of |dst|'s VideoSampleInfo are taken from |src|, a stride of 0 or
+// less packs the rows tightly. |dst| grows if it is too small and can.
+status_t ConvertFrame(MediaPacket& src,
+                      MediaPacket& dst,
+                      const ColorAspects& aspects);
+
+enum class PixelImpl {
+  kScalar,
+  kAVX2,
+  kNEON,
+};
+
+// ConvertFrame() with the row kernels of |impl|, ERROR_UNSUPPORTED if they
+// are not built in or not supported by this CPU. All implementations give
+// the same pixels. For tests and benchmarks.
+status_t ConvertFrame(const FrameView& src,
+                      const FrameView& dst,
+                      const YuvColorSpace& color,
+                      PixelImpl impl);
+
+}  // namespace ave
+
+#endif /* !PIXEL_CONVERSION_H */
@@ -0,0 +1,69 @@
+/*
+ * rbsp.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "rbsp.h"
+
+#include <cstring>
+
+#include "start_code.h"
+
+namespace ave {
+
+size_t EBSPToRBSP(const uint8_t* ebsp, size_t size, uint8_t* rbsp) {
+  size_t in = 0;
+  size_t out = 0;
+  while (in < size) {
+    size_t run = FindEmulationPrevention(ebsp + in, size - in);
+    if (run == size - in) {
+      // no (more) emulation prevention bytes
+      if (rbsp + out != ebsp + in) {
+        memmove(rbsp + out, ebsp + in, run);
+      }
+      out += run;
+      break;
+    }
+    // keep 00 00, drop 03
+    run += 2;
+    if (rbsp + out != ebsp + in) {
+      memmove(rbsp + out, ebsp + in, run);
+    }
+    out += run;
+    in += run + 1;
+  }
+  return out;
+}
+
+bool HasEmulationPrevention(const uint8_t* ebsp, size_t size) {
+  return FindEmulationPrevention(ebsp, size) != size;
+}
+
+size_t RBSPToEBSP(const uint8_t* rbsp, size_t size, uint8_t* ebsp) {
+  size_t in = 0;
+  size_t out = 0;
+  while (in < size) {
+    size_t run = FindStartCodeEmulation(rbsp + in, size - in);
+    if (run == size - in) {
+      memcpy(ebsp + out, rbsp + in, run);
+      out += run;
+      break;
+    }
+    // 00 00 03, the escaped byte starts the next run and may begin another
+    // 00 00 sequence.
+    memcpy(ebsp + out, rbsp + in, run + 2);
+    out += run + 2;
+    ebsp[out++] = 0x03;
+    in += run + 2;
+  }
+
+  // a payload ending with cabac_zero_word gets a final 03
+  if (out > 0 && ebsp[out - 1] == 0x00) {
+    ebsp[out++] = 0x03;
+  }
+  return out;
+}
+
+}  // namespace ave
@@ -0,0 +1,42 @@
+/*
+ * rbsp.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef RBSP_H
+#define RBSP_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ave {
+
+// Conversion between a NAL unit payload with emulation_prevention_three_byte
+// (EBSP) and the raw byte sequence payload (RBSP). Both scan with
+// FindEmulationPrevention()/FindStartCodeEmulation() and copy whole runs, so
+// payloads without anything to escape cost little more than a memcpy.
+
+// Removes the emulation prevention bytes of |ebsp| into |rbsp|, which has
+// room for |size| bytes and may be |ebsp| itself for in-place conversion.
+// Returns the RBSP size.
+size_t EBSPToRBSP(const uint8_t* ebsp, size_t size, uint8_t* rbsp);
+
+// Returns true if |ebsp| contains emulation prevention bytes, i.e. it can not
+// be read as RBSP directly.
+bool HasEmulationPrevention(const uint8_t* ebsp, size_t size);
+
+// Size |ebsp| needs in RBSPToEBSP() for |size| bytes of RBSP.
+constexpr size_t MaxEBSPSize(size_t size) {
+  return size + size / 2 + 1;
+}
+
+// Inserts emulation prevention bytes into |rbsp|, writing MaxEBSPSize(size)
+// bytes at most to |ebsp|, and returns the EBSP size. |ebsp| must not
+// overlap |rbsp|.
+size_t RBSPToEBSP(const uint8_t* rbsp, size_t size, uint8_t* ebsp);
+
+}  // namespace ave
+
+#endif /* !RBSP_H */
@@ -0,0 +1,338 @@
+/*
+ * start_code.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "start_code.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AVE_START_CODE_X86 1
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define AVE_START_CODE_NEON 1
+#endif
+
+namespace ave {
+
+namespace {
+
+// The scanners look for two zero bytes followed by a third byte that is
+// either exactly kThird, or anything up to kThird with kOrLess.
+template <uint8_t kThird, bool kOrLess>
+inline bool ThirdByteMatches(uint8_t byte) {
+  return kOrLess ? byte <= kThird : byte == kThird;
+}
+
+// Skips ahead as far as the byte two positions on allows: a match can only
+// begin at |i| if data[i + 2] is a third byte, and only at i + 1 or i + 2 if
+// it is 0, so anything above kThird rules out three positions at once.
+template <uint8_t kThird, bool kOrLess>
+size_t FindScalar(const uint8_t* data, size_t size) {
+  size_t i = 0;
+  while (i + 2 < size) {
+    if (data[i + 2] > kThird) {
+      i += 3;
+    } else if (data[i + 1] != 0) {
+      i += 2;
+    } else if (data[i] != 0 ||
+               !ThirdByteMatches<kThird, kOrLess>(data[i + 2])) {
+      i++;
+    } else {
+      return i;
+    }
+  }
+  return size;
+}
+
+// The vector versions look for zero bytes first, nearly every block of a
+// coded slice has none and is skipped after one compare. Blocks with zeros
+// are verified exactly by comparing the block and its two successors against
+// the pattern.
+
+#if defined(AVE_START_CODE_X86) && defined(__SSE2__)
+template <uint8_t kThird, bool kOrLess>
+size_t FindSSE2(const uint8_t* data, size_t size) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i third = _mm_set1_epi8(kThird);
+  size_t i = 0;
+  // the last candidate of a block reads two bytes past it
+  for (; i + 16 + 2 <= size; i += 16) {
+    __m128i z0 = _mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), zero);
+    if (_mm_movemask_epi8(z0) == 0) {
+      continue;
+    }
+    __m128i z1 = _mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1)), zero);
+    __m128i b2 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 2));
+    __m128i t2 = kOrLess ? _mm_cmpeq_epi8(_mm_min_epu8(b2, third), b2)
+                         : _mm_cmpeq_epi8(b2, third);
+    int mask = _mm_movemask_epi8(_mm_and_si128(z0, _mm_and_si128(z1, t2)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + FindScalar<kThird, kOrLess>(data + i, size - i);
+}
+#endif
+
+#if defined(AVE_START_CODE_X86)
+template <uint8_t kThird, bool kOrLess>
+__attribute__((target("avx2"))) size_t FindAVX2(const uint8_t* data,
+                                                size_t size) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i third = _mm256_set1_epi8(kThird);
+  size_t i = 0;
+  for (; i + 32 + 2 <= size; i += 32) {
+    __m256i z0 = _mm256_cmpeq_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), zero);
+    if (_mm256_movemask_epi8(z0) == 0) {
+      continue;
+    }
+    __m256i z1 = _mm256_cmpeq_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1)),
+        zero);
+    __m256i b2 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 2));
+    __m256i t2 = kOrLess ? _mm256_cmpeq_epi8(_mm256_min_epu8(b2, third), b2)
+                         : _mm256_cmpeq_epi8(b2, third);
+    uint32_t mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_and_si256(z0, _mm256_and_si256(z1, t2))));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + FindScalar<kThird, kOrLess>(data + i, size - i);
+}
+#endif
+
+#if defined(AVE_START_CODE_NEON)
+template <uint8_t kThird, bool kOrLess>
+size_t FindNEON(const uint8_t* data, size_t size) {
+  const uint8x16_t zero = vdupq_n_u8(0);
+  const uint8x16_t third = vdupq_n_u8(kThird);
+  size_t i = 0;
+  for (; i + 16 + 2 <= size; i += 16) {
+    uint8x16_t z0 = vceqq_u8(vld1q_u8(data + i), zero);
+    if (vmaxvq_u8(z0) == 0) {
+      continue;
+    }
+    uint8x16_t z1 = vceqq_u8(vld1q_u8(data + i + 1), zero);
+    uint8x16_t b2 = vld1q_u8(data + i + 2);
+    uint8x16_t t2 = kOrLess ? vcleq_u8(b2, third) : vceqq_u8(b2, third);
+    uint8x16_t match = vandq_u8(z0, vandq_u8(z1, t2));
+    // narrow to four bits per byte to get a scalar mask
+    uint64_t mask = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(match), 4)), 0);
+    if (mask != 0) {
+      return i + (__builtin_ctzll(mask) >> 2);
+    }
+  }
+  return i + FindScalar<kThird, kOrLess>(data + i, size - i);
+}
+#endif
+
+// MPEG audio frame sync: an FF byte followed by a byte with its top three
+// bits set. FF bytes are rare in compressed audio, blocks without one are
+// skipped after one compare.
+size_t FindSyncScalar(const uint8_t* data, size_t size) {
+  for (size_t i = 0; i + 1 < size; i++) {
+    const void* ff = memchr(data + i, 0xff, size - 1 - i);
+    if (ff == nullptr) {
+      break;
+    }
+    i = static_cast<const uint8_t*>(ff) - data;
+    if ((data[i + 1] & 0xe0) == 0xe0) {
+      return i;
+    }
+  }
+  return size;
+}
+
+#if defined(AVE_START_CODE_X86) && defined(__SSE2__)
+size_t FindSyncSSE2(const uint8_t* data, size_t size) {
+  const __m128i ff = _mm_set1_epi8(static_cast<char>(0xff));
+  const __m128i e0 = _mm_set1_epi8(static_cast<char>(0xe0));
+  size_t i = 0;
+  for (; i + 16 + 1 <= size; i += 16) {
+    __m128i b0 = _mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), ff);
+    if (_mm_movemask_epi8(b0) == 0) {
+      continue;
+    }
+    __m128i b1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+    __m128i t1 = _mm_cmpeq_epi8(_mm_and_si128(b1, e0), e0);
+    int mask = _mm_movemask_epi8(_mm_and_si128(b0, t1));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + FindSyncScalar(data + i, size - i);
+}
+#endif
+
+#if defined(AVE_START_CODE_X86)
+__attribute__((target("avx2"))) size_t FindSyncAVX2(const uint8_t* data,
+                                                    size_t size) {
+  const __m256i ff = _mm256_set1_epi8(static_cast<char>(0xff));
+  const __m256i e0 = _mm256_set1_epi8(static_cast<char>(0xe0));
+  size_t i = 0;
+  for (; i + 32 + 1 <= size; i += 32) {
+    __m256i b0 = _mm256_cmpeq_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), ff);
+    if (_mm256_movemask_epi8(b0) == 0) {
+      continue;
+    }
+    __m256i b1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1));
+    __m256i t1 = _mm256_cmpeq_epi8(_mm256_and_si256(b1, e0), e0);
+    uint32_t mask =
+        static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(b0, t1)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + FindSyncScalar(data + i, size - i);
+}
+#endif
+
+#if defined(AVE_START_CODE_NEON)
+size_t FindSyncNEON(const uint8_t* data, size_t size) {
+  const uint8x16_t ff = vdupq_n_u8(0xff);
+  const uint8x16_t e0 = vdupq_n_u8(0xe0);
+  size_t i = 0;
+  for (; i + 16 + 1 <= size; i += 16) {
+    uint8x16_t b0 = vceqq_u8(vld1q_u8(data + i), ff);
+    if (vmaxvq_u8(b0) == 0) {
+      continue;
+    }
+    uint8x16_t t1 = vceqq_u8(vandq_u8(vld1q_u8(data + i + 1), e0), e0);
+    uint8x16_t match = vandq_u8(b0, t1);
+    uint64_t mask = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(match), 4)), 0);
+    if (mask != 0) {
+      return i + (__builtin_ctzll(mask) >> 2);
+    }
+  }
+  return i + FindSyncScalar(data + i, size - i);
+}
+#endif
+
+StartCodeFinder GetSyncFinder(StartCodeImpl impl) {
+  switch (impl) {
+    case StartCodeImpl::kScalar:
+      return FindSyncScalar;
+#if defined(AVE_START_CODE_X86) && defined(__SSE2__)
+    case StartCodeImpl::kSSE2:
+      return FindSyncSSE2;
+#endif
+#if defined(AVE_START_CODE_X86)
+    case StartCodeImpl::kAVX2:
+      return __builtin_cpu_supports("avx2") ? FindSyncAVX2 : nullptr;
+#endif
+#if defined(AVE_START_CODE_NEON)
+    case StartCodeImpl::kNEON:
+      return FindSyncNEON;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+template <uint8_t kThird, bool kOrLess>
+StartCodeFinder GetFinder(StartCodeImpl impl) {
+  switch (impl) {
+    case StartCodeImpl::kScalar:
+      return FindScalar<kThird, kOrLess>;
+#if defined(AVE_START_CODE_X86) && defined(__SSE2__)
+    case StartCodeImpl::kSSE2:
+      return FindSSE2<kThird, kOrLess>;
+#endif
+#if defined(AVE_START_CODE_X86)
+    case StartCodeImpl::kAVX2:
+      return __builtin_cpu_supports("avx2") ? FindAVX2<kThird, kOrLess>
+                                            : nullptr;
+#endif
+#if defined(AVE_START_CODE_NEON)
+    case StartCodeImpl::kNEON:
+      return FindNEON<kThird, kOrLess>;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+const StartCodeImpl kPreferred[] = {
+    StartCodeImpl::kAVX2,
+    StartCodeImpl::kSSE2,
+    StartCodeImpl::kNEON,
+};
+
+// The widest implementation the CPU supports.
+template <uint8_t kThird, bool kOrLess>
+StartCodeFinder SelectFinder() {
+  for (StartCodeImpl impl : kPreferred) {
+    StartCodeFinder finder = GetFinder<kThird, kOrLess>(impl);
+    if (finder != nullptr) {
+      return finder;
+    }
+  }
+  return FindScalar<kThird, kOrLess>;
+}
+
+StartCodeFinder SelectSyncFinder() {
+  for (StartCodeImpl impl : kPreferred) {
+    StartCodeFinder finder = GetSyncFinder(impl);
+    if (finder != nullptr) {
+      return finder;
+    }
+  }
+  return FindSyncScalar;
+}
+
+}  // namespace
+
+size_t FindStartCode(const uint8_t* data, size_t size) {
+  static const StartCodeFinder finder = SelectFinder<0x01, false>();
+  return finder(data, size);
+}
+
+size_t FindEmulationPrevention(const uint8_t* data, size_t size) {
+  static const StartCodeFinder finder = SelectFinder<0x03, false>();
+  return finder(data, size);
+}
+
+size_t FindStartCodeEmulation(const uint8_t* data, size_t size) {
+  static const StartCodeFinder finder = SelectFinder<0x03, true>();
+  return finder(data, size);
+}
+
+size_t FindMPEGAudioSync(const uint8_t* data, size_t size) {
+  static const StartCodeFinder finder = SelectSyncFinder();
+  return finder(data, size);
+}
+
+StartCodeFinder GetStartCodeFinder(StartCodeImpl impl, ScanPattern pattern) {
+  switch (pattern) {
+    case ScanPattern::kStartCode:
+      return GetFinder<0x01, false>(impl);
+    case ScanPattern::kEmulationPrevention:
+      return GetFinder<0x03, false>(impl);
+    case ScanPattern::kStartCodeEmulation:
+      return GetFinder<0x03, true>(impl);
+    case ScanPattern::kMPEGAudioSync:
+      return GetSyncFinder(impl);
+  }
+  return nullptr;
+}
+
+}  // namespace ave
@@ -0,0 +1,59 @@
+/*
+ * start_code.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef START_CODE_H
+#define START_CODE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ave {
+
+// Returns the offset of the first 00 00 01 start code prefix in |data|, or
+// |size| if there is none. This is the Annex-B scanner behind
+// getNextNALUnit() and findNextNalStartCode(); it uses the widest SIMD
+// implementation the CPU supports.
+size_t FindStartCode(const uint8_t* data, size_t size);
+
+// Returns the offset of the first 00 00 03 sequence, whose 03 is an
+// emulation_prevention_three_byte in a NAL unit payload, or |size|.
+size_t FindEmulationPrevention(const uint8_t* data, size_t size);
+
+// Returns the offset of the first 00 00 0x sequence with x <= 3, which has to
+// be escaped when writing a NAL unit payload, or |size|.
+size_t FindStartCodeEmulation(const uint8_t* data, size_t size);
+
+// Returns the offset of the first MPEG audio frame sync, 11 set bits from a
+// byte boundary on, or |size|. Whether a proper header follows is up to the
+// caller.
+size_t FindMPEGAudioSync(const uint8_t* data, size_t size);
+
+enum class StartCodeImpl {
+  kScalar,
+  kSSE2,
+  kAVX2,
+  kNEON,
+};
+
+enum class ScanPattern {
+  kStartCode,
+  kEmulationPrevention,
+  kStartCodeEmulation,
+  kMPEGAudioSync,
+};
+
+using StartCodeFinder = size_t (*)(const uint8_t* data, size_t size);
+
+// Returns the given implementation, or nullptr if it is not built in or not
+// supported by this CPU. For tests and benchmarks.
+StartCodeFinder GetStartCodeFinder(
+    StartCodeImpl impl,
+    ScanPattern pattern = ScanPattern::kStartCode);
+
+}  // namespace ave
+
+#endif /* !START_CODE_H */
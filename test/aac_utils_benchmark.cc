@@ -0,0 +1,193 @@
+/*
+ * aac_utils_benchmark.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../aac_utils.h"
+#include "../buffer.h"
+#include "../codec_constants.h"
+#include "bit_writer.h"
+
+namespace ave {
+
+namespace {
+
+// about 15 minutes of 128 kbit/s stereo at 48 kHz
+const size_t kNumFrames = 40000;
+const int kRounds = 5;
+
+AudioSpecificConfig MakeConfig() {
+  AudioSpecificConfig config{};
+  config.object_type = AACObjectLC;
+  config.sampling_frequency_index = 3;
+  config.sampling_frequency = 48000;
+  config.channel_configuration = 2;
+  return config;
+}
+
+std::vector<std::vector<uint8_t>> MakePayloads() {
+  std::mt19937 rng(1);
+  std::vector<std::vector<uint8_t>> payloads(kNumFrames);
+  for (auto& payload : payloads) {
+    payload.resize(250 + rng() % 200);
+    for (auto& byte : payload) {
+      byte = static_cast<uint8_t>(rng());
+    }
+  }
+  return payloads;
+}
+
+std::vector<uint8_t> MakeADTS(
+    const std::vector<std::vector<uint8_t>>& payloads) {
+  ADTSPacketizer packetizer(MakeConfig());
+  std::vector<uint8_t> stream;
+  for (const auto& payload : payloads) {
+    size_t offset = stream.size();
+    stream.resize(offset + payload.size() + kADTSHeaderSize);
+    size_t size = 0;
+    EXPECT_EQ(packetizer.Packetize(payload.data(), payload.size(),
+                                   stream.data() + offset,
+                                   stream.size() - offset, &size),
+              OK);
+  }
+  return stream;
+}
+
+// StreamMuxConfig in every element, as broadcast streams send it
+std::vector<uint8_t> MakeLOAS(
+    const std::vector<std::vector<uint8_t>>& payloads) {
+  std::vector<uint8_t> stream;
+  for (const auto& payload : payloads) {
+    BitWriter writer;
+    writer.Put(0, 1);  // useSameStreamMux
+    writer.Put(0, 1);  // audioMuxVersion
+    writer.Put(1, 1);  // allStreamsSameTimeFraming
+    writer.Put(0, 6 + 4 + 3);
+    writer.Put(AACObjectLC, 5);
+    writer.Put(3, 4);
+    writer.Put(2, 4);
+    writer.Put(0, 3);
+    writer.Put(0, 3);  // frameLengthType
+    writer.Put(0xff, 8);
+    writer.Put(0, 2);
+    size_t length = payload.size();
+    for (; length >= 255; length -= 255) {
+      writer.Put(255, 8);
+    }
+    writer.Put(length, 8);
+    for (uint8_t byte : payload) {
+      writer.Put(byte, 8);
+    }
+    std::vector<uint8_t> element = writer.Finish();
+    stream.push_back(0x56);
+    stream.push_back(0xe0 | static_cast<uint8_t>(element.size() >> 8));
+    stream.push_back(static_cast<uint8_t>(element.size()));
+    stream.insert(stream.end(), element.begin(), element.end());
+  }
+  return stream;
+}
+
+// Pushes |stream| in |chunkSize| byte chunks, as TS packet payloads or
+// whole PES packets arrive.
+void MeasureDeframer(const char* name,
+                     const std::vector<uint8_t>& stream,
+                     AACDeframer::Format format,
+                     size_t chunkSize) {
+  size_t frames = 0;
+  uint64_t checksum = 0;
+  double seconds = 0;
+  std::vector<AACDeframer::Frame> out;
+  for (int round = 0; round < kRounds; round++) {
+    AACDeframer deframer(format);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < stream.size(); offset += chunkSize) {
+      size_t size = std::min(chunkSize, stream.size() - offset);
+      out.clear();
+      deframer.Push(stream.data() + offset, size, -1, &out);
+      for (const auto& frame : out) {
+        checksum += frame.size + frame.data[0];
+      }
+      frames += out.size();
+    }
+    out.clear();
+    deframer.Flush(&out);
+    frames += out.size();
+    seconds += std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  }
+  printf("%s: %.1f MB/s, %.2f M frames/s (checksum %llu)\n", name,
+         stream.size() * kRounds / seconds / 1e6, frames / seconds / 1e6,
+         static_cast<unsigned long long>(checksum / kRounds));
+}
+
+// Packetizes fresh buffers with |headroom| bytes in front of the payload,
+// only the packetizer is timed.
+void MeasurePacketizer(const char* name,
+                       const std::vector<std::vector<uint8_t>>& payloads,
+                       size_t headroom) {
+  ADTSPacketizer packetizer(MakeConfig());
+  size_t bytes = 0;
+  uint64_t checksum = 0;
+  double seconds = 0;
+  for (int round = 0; round < kRounds; round++) {
+    std::vector<std::shared_ptr<Buffer>> buffers;
+    for (const auto& payload : payloads) {
+      auto buffer = std::make_shared<Buffer>(payload.size() + headroom);
+      memcpy(buffer->base() + headroom, payload.data(), payload.size());
+      buffer->setRange(headroom, payload.size());
+      buffers.push_back(buffer);
+      bytes += payload.size();
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (auto& buffer : buffers) {
+      ASSERT_EQ(packetizer.Packetize(&buffer), OK);
+    }
+    seconds += std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+    for (const auto& buffer : buffers) {
+      checksum += buffer->size() + buffer->data()[3];
+    }
+  }
+  printf("%s: %.1f MB/s, %.2f M frames/s (checksum %llu)\n", name,
+         bytes / seconds / 1e6, payloads.size() * kRounds / seconds / 1e6,
+         static_cast<unsigned long long>(checksum / kRounds));
+}
+
+}  // namespace
+
+TEST(AACUtilsBenchmark, Deframe) {
+  auto payloads = MakePayloads();
+  auto adts = MakeADTS(payloads);
+  auto loas = MakeLOAS(payloads);
+
+  MeasureDeframer("ADTS, 184 byte chunks", adts, AACDeframer::Format::kADTS,
+                  184);
+  MeasureDeframer("ADTS, 64 KiB chunks", adts, AACDeframer::Format::kADTS,
+                  65536);
+  MeasureDeframer("LOAS, 184 byte chunks", loas, AACDeframer::Format::kLOAS,
+                  184);
+  MeasureDeframer("LOAS, 64 KiB chunks", loas, AACDeframer::Format::kLOAS,
+                  65536);
+}
+
+TEST(AACUtilsBenchmark, Packetize) {
+  auto payloads = MakePayloads();
+  MeasurePacketizer("ADTS, header in the headroom", payloads,
+                    kADTSHeaderSize);
+  MeasurePacketizer("ADTS, new buffer", payloads, 0);
+}
+
+}  // namespace ave
@@ -0,0 +1,537 @@
+/*
+ * aac_utils_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../aac_utils.h"
+#include "../audio_codec_property.h"
+#include "../bit_reader.h"
+#include "../buffer.h"
+#include "../codec_constants.h"
+#include "../esds.h"
+#include "../meta_data.h"
+#include "../meta_data_utils.h"
+#include "bit_writer.h"
+
+namespace ave {
+
+namespace {
+
+using Frame = AACDeframer::Frame;
+
+AudioSpecificConfig MakeConfig(int32_t objectType,
+                               uint8_t frequencyIndex,
+                               int32_t frequency,
+                               uint8_t channels) {
+  AudioSpecificConfig config{};
+  config.object_type = objectType;
+  config.sampling_frequency_index = frequencyIndex;
+  config.sampling_frequency = frequency;
+  config.channel_configuration = channels;
+  return config;
+}
+
+std::vector<std::vector<uint8_t>> MakePayloads(size_t count, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::vector<std::vector<uint8_t>> payloads(count);
+  for (auto& payload : payloads) {
+    payload.resize(100 + rng() % 700);
+    for (auto& byte : payload) {
+      byte = static_cast<uint8_t>(rng());
+    }
+  }
+  return payloads;
+}
+
+std::vector<uint8_t> MakeADTS(const AudioSpecificConfig& config,
+                              const std::vector<std::vector<uint8_t>>& frames) {
+  ADTSPacketizer packetizer(config);
+  EXPECT_EQ(packetizer.InitCheck(), OK);
+  std::vector<uint8_t> stream;
+  for (const auto& frame : frames) {
+    std::vector<uint8_t> out(frame.size() + kADTSHeaderSize);
+    size_t size = 0;
+    EXPECT_EQ(packetizer.Packetize(frame.data(), frame.size(), out.data(),
+                                   out.size(), &size),
+              OK);
+    stream.insert(stream.end(), out.begin(), out.begin() + size);
+  }
+  return stream;
+}
+
+// AudioSyncStream() with an AudioMuxElement(1) per payload, the
+// StreamMuxConfig in the first one only. The config is AAC LC at 48 kHz, or
+// with |sbr| HE-AAC at 48 kHz over a 24 kHz core.
+std::vector<uint8_t> MakeLOAS(
+    const std::vector<std::vector<uint8_t>>& payloads,
+    bool sbr = false) {
+  std::vector<uint8_t> stream;
+  for (size_t i = 0; i < payloads.size(); ++i) {
+    BitWriter writer;
+    writer.Put(i > 0, 1);  // useSameStreamMux
+    if (i == 0) {
+      writer.Put(0, 1);  // audioMuxVersion
+      writer.Put(1, 1);  // allStreamsSameTimeFraming
+      writer.Put(0, 6 + 4 + 3);
+      if (sbr) {
+        // explicit hierarchical signalling, stereo
+        writer.Put(5, 5);
+        writer.Put(6, 4);
+        writer.Put(2, 4);
+        writer.Put(3, 4);  // extensionSamplingFrequencyIndex
+        writer.Put(2, 5);
+      } else {
+        // AAC LC, 48 kHz, stereo
+        writer.Put(2, 5);
+        writer.Put(3, 4);
+        writer.Put(2, 4);
+      }
+      writer.Put(0, 3);  // GASpecificConfig
+      writer.Put(0, 3);  // frameLengthType
+      writer.Put(0xff, 8);
+      writer.Put(0, 1);  // otherDataPresent
+      writer.Put(0, 1);  // crcCheckPresent
+    }
+    size_t length = payloads[i].size();
+    for (; length >= 255; length -= 255) {
+      writer.Put(255, 8);
+    }
+    writer.Put(length, 8);
+    for (uint8_t byte : payloads[i]) {
+      writer.Put(byte, 8);
+    }
+    std::vector<uint8_t> element = writer.Finish();
+    stream.push_back(0x56);
+    stream.push_back(0xe0 | static_cast<uint8_t>(element.size() >> 8));
+    stream.push_back(static_cast<uint8_t>(element.size()));
+    stream.insert(stream.end(), element.begin(), element.end());
+  }
+  return stream;
+}
+
+struct Result {
+  std::vector<std::string> frames;
+  std::vector<int64_t> pts;
+  std::vector<size_t> config_changes;
+};
+
+Result Deframe(AACDeframer* deframer,
+               const std::vector<uint8_t>& stream,
+               uint32_t seed,
+               int64_t ptsUs,
+               int32_t numSamples = 1024) {
+  std::mt19937 rng(seed);
+  Result result;
+  std::vector<Frame> frames;
+  auto collect = [&]() {
+    for (const Frame& frame : frames) {
+      if (frame.config_changed) {
+        result.config_changes.push_back(result.frames.size());
+      }
+      result.frames.emplace_back(reinterpret_cast<const char*>(frame.data),
+                                 frame.size);
+      result.pts.push_back(frame.pts_us);
+      EXPECT_EQ(frame.num_samples, numSamples);
+    }
+    frames.clear();
+  };
+  size_t offset = 0;
+  while (offset < stream.size()) {
+    size_t size = std::min<size_t>(1 + rng() % 1500, stream.size() - offset);
+    deframer->Push(stream.data() + offset, size, offset == 0 ? ptsUs : -1,
+                   &frames);
+    collect();
+    offset += size;
+  }
+  deframer->Flush(&frames);
+  collect();
+  return result;
+}
+
+std::string AsString(const std::vector<uint8_t>& data) {
+  return std::string(data.begin(), data.end());
+}
+
+}  // namespace
+
+TEST(AACUtilsTest, ADTSRoundTrip) {
+  AudioSpecificConfig config = MakeConfig(AACObjectLC, 4, 44100, 2);
+  auto payloads = MakePayloads(30, 1);
+  std::vector<uint8_t> stream = {0x12, 0xff, 0xf1, 0x00};
+  std::vector<uint8_t> adts = MakeADTS(config, payloads);
+  stream.insert(stream.end(), adts.begin(), adts.end());
+
+  for (uint32_t seed = 0; seed < 20; ++seed) {
+    AACDeframer deframer(AACDeframer::Format::kADTS);
+    Result result = Deframe(&deframer, stream, seed, 5000);
+    ASSERT_EQ(result.frames.size(), payloads.size()) << seed;
+    for (size_t i = 0; i < payloads.size(); ++i) {
+      EXPECT_EQ(result.frames[i], AsString(payloads[i]));
+      EXPECT_EQ(result.pts[i],
+                5000 + static_cast<int64_t>(i) * 1024 * 1000000 / 44100);
+    }
+    EXPECT_EQ(result.config_changes, std::vector<size_t>{0});
+
+    AudioSpecificConfig out;
+    ASSERT_TRUE(deframer.GetConfig(&out));
+    EXPECT_EQ(out.object_type, AACObjectLC);
+    EXPECT_EQ(out.sampling_frequency, 44100);
+    EXPECT_EQ(out.channel_configuration, 2);
+  }
+}
+
+TEST(AACUtilsTest, ADTSZeroCopy) {
+  AudioSpecificConfig config = MakeConfig(AACObjectLC, 3, 48000, 2);
+  std::vector<uint8_t> stream = MakeADTS(config, MakePayloads(10, 2));
+
+  AACDeframer deframer(AACDeframer::Format::kADTS);
+  std::vector<Frame> frames;
+  // the last frame waits for the next header or the end of the stream
+  size_t half = stream.size() / 2;
+  deframer.Push(stream.data(), half, 0, &frames);
+  deframer.Push(stream.data() + half, stream.size() - half, -1, &frames);
+  deframer.Flush(&frames);
+  ASSERT_EQ(frames.size(), 10u);
+  size_t copied = 0;
+  for (const Frame& frame : frames) {
+    if (frame.data < stream.data() ||
+        frame.data >= stream.data() + stream.size()) {
+      ++copied;
+    }
+  }
+  // only the frame across the chunks
+  EXPECT_LE(copied, 1u);
+}
+
+TEST(AACUtilsTest, ADTSConfigChangeAndResync) {
+  auto payloads = MakePayloads(20, 3);
+  std::vector<std::vector<uint8_t>> first(payloads.begin(),
+                                          payloads.begin() + 10);
+  std::vector<std::vector<uint8_t>> second(payloads.begin() + 10,
+                                           payloads.end());
+  std::vector<uint8_t> stream =
+      MakeADTS(MakeConfig(AACObjectLC, 4, 44100, 2), first);
+  const uint8_t kJunk[] = {0x00, 0xff, 0x00, 0x47, 0x11};
+  stream.insert(stream.end(), kJunk, kJunk + sizeof(kJunk));
+  std::vector<uint8_t> adts =
+      MakeADTS(MakeConfig(AACObjectLC, 3, 48000, 1), second);
+  stream.insert(stream.end(), adts.begin(), adts.end());
+
+  for (uint32_t seed = 0; seed < 20; ++seed) {
+    AACDeframer deframer(AACDeframer::Format::kADTS);
+    Result result = Deframe(&deframer, stream, seed, -1);
+    ASSERT_EQ(result.frames.size(), payloads.size()) << seed;
+    for (size_t i = 0; i < payloads.size(); ++i) {
+      EXPECT_EQ(result.frames[i], AsString(payloads[i]));
+    }
+    EXPECT_EQ(result.config_changes, (std::vector<size_t>{0, 10}));
+
+    MetaData meta;
+    ASSERT_TRUE(deframer.MakeCodecSpecificData(meta));
+    int32_t value = 0;
+    EXPECT_TRUE(meta.findInt32(kKeySampleRate, &value));
+    EXPECT_EQ(value, 48000);
+    EXPECT_TRUE(meta.findInt32(kKeyChannelCount, &value));
+    EXPECT_EQ(value, 1);
+    EXPECT_TRUE(meta.findInt32(kKeyAACAOT, &value));
+    EXPECT_EQ(value, AACObjectLC);
+  }
+}
+
+TEST(AACUtilsTest, LOAS) {
+  auto payloads = MakePayloads(30, 4);
+  std::vector<uint8_t> stream = MakeLOAS(payloads);
+
+  for (uint32_t seed = 0; seed < 20; ++seed) {
+    AACDeframer deframer(AACDeframer::Format::kLOAS);
+    Result result = Deframe(&deframer, stream, seed, 0);
+    ASSERT_EQ(result.frames.size(), payloads.size()) << seed;
+    for (size_t i = 0; i < payloads.size(); ++i) {
+      EXPECT_EQ(result.frames[i], AsString(payloads[i]));
+      EXPECT_EQ(result.pts[i], static_cast<int64_t>(i) * 1024 * 1000 / 48);
+    }
+    AudioSpecificConfig config;
+    ASSERT_TRUE(deframer.GetConfig(&config));
+    EXPECT_EQ(config.object_type, AACObjectLC);
+    EXPECT_EQ(config.sampling_frequency, 48000);
+    EXPECT_EQ(config.channel_configuration, 2);
+  }
+
+  // useSameStreamMux before any StreamMuxConfig
+  AACDeframer deframer(AACDeframer::Format::kLOAS);
+  Result result = Deframe(&deframer,
+                          std::vector<uint8_t>(stream.begin() + 3 +
+                                                   stream[2],
+                                               stream.end()),
+                          0, -1);
+  EXPECT_TRUE(result.frames.empty());
+}
+
+TEST(AACUtilsTest, LOASWithSBR) {
+  auto payloads = MakePayloads(10, 5);
+  std::vector<uint8_t> stream = MakeLOAS(payloads, true);
+
+  AACDeframer deframer(AACDeframer::Format::kLOAS);
+  // a core frame of 1024 samples at 24 kHz decodes to 2048 at 48 kHz
+  Result result = Deframe(&deframer, stream, 0, 0, 2048);
+  ASSERT_EQ(result.frames.size(), payloads.size());
+  for (size_t i = 0; i < payloads.size(); ++i) {
+    EXPECT_EQ(result.frames[i], AsString(payloads[i]));
+    EXPECT_EQ(result.pts[i], static_cast<int64_t>(i) * 2048 * 1000 / 48);
+  }
+  AudioSpecificConfig config;
+  ASSERT_TRUE(deframer.GetConfig(&config));
+  EXPECT_TRUE(config.sbr_present);
+  EXPECT_EQ(config.sampling_frequency, 24000);
+  EXPECT_EQ(config.extension_sampling_frequency, 48000);
+}
+
+TEST(AACUtilsTest, ADTSBlockCRCs) {
+  // an adts_frame of three raw_data_blocks with a CRC behind each, the
+  // header followed by the positions of the last two and its own CRC
+  auto blocks = MakePayloads(3, 6);
+  std::vector<uint8_t> body;
+  std::vector<size_t> positions;
+  for (const auto& block : blocks) {
+    positions.push_back(body.size());
+    body.insert(body.end(), block.begin(), block.end());
+    body.push_back(0xc0);
+    body.push_back(0xc1);
+  }
+  const size_t length = kADTSHeaderSize + 2 * blocks.size() + body.size();
+  // MPEG-4, AAC LC, 44.1 kHz, stereo
+  std::vector<uint8_t> frame = {
+      0xff,
+      0xf0,
+      0x50,
+      static_cast<uint8_t>(0x80 | (length >> 11)),
+      static_cast<uint8_t>(length >> 3),
+      static_cast<uint8_t>((length << 5) | 0x1f),
+      static_cast<uint8_t>(0xfc | (blocks.size() - 1)),
+  };
+  for (size_t i = 1; i < positions.size(); ++i) {
+    frame.push_back(static_cast<uint8_t>(positions[i] >> 8));
+    frame.push_back(static_cast<uint8_t>(positions[i]));
+  }
+  frame.push_back(0xe0);
+  frame.push_back(0xe1);
+  frame.insert(frame.end(), body.begin(), body.end());
+  ASSERT_EQ(frame.size(), length);
+
+  ADTSHeader header;
+  ASSERT_TRUE(ParseADTSHeader(frame.data(), frame.size(), &header));
+  EXPECT_EQ(header.num_raw_data_blocks, 3u);
+  EXPECT_EQ(header.header_size, kADTSHeaderSize + 6);
+
+  std::vector<uint8_t> stream = frame;
+  stream.insert(stream.end(), frame.begin(), frame.end());
+  std::string expected;
+  for (const auto& block : blocks) {
+    expected += AsString(block);
+  }
+  for (uint32_t seed = 0; seed < 10; ++seed) {
+    AACDeframer deframer(AACDeframer::Format::kADTS);
+    Result result = Deframe(&deframer, stream, seed, 0, 3 * 1024);
+    ASSERT_EQ(result.frames.size(), 2u) << seed;
+    EXPECT_EQ(result.frames[0], expected);
+    EXPECT_EQ(result.frames[1], expected);
+    EXPECT_EQ(result.pts[1], int64_t{3 * 1024} * 1000000 / 44100);
+  }
+
+  // a position past the end drops the frame
+  frame[kADTSHeaderSize] = 0xff;
+  AACDeframer deframer(AACDeframer::Format::kADTS);
+  Result result = Deframe(&deframer, frame, 0, 0, 3 * 1024);
+  EXPECT_TRUE(result.frames.empty());
+}
+
+TEST(AACUtilsTest, AudioSpecificConfig) {
+  // HE-AAC with explicit signalling: SBR at 48 kHz over LC at 24 kHz
+  BitWriter writer;
+  writer.Put(AACObjectHE, 5);
+  writer.Put(6, 4);
+  writer.Put(2, 4);
+  writer.Put(3, 4);
+  writer.Put(AACObjectLC, 5);
+  writer.Put(0, 3);
+  std::vector<uint8_t> asc = writer.Finish();
+  AudioSpecificConfig config;
+  ASSERT_EQ(ParseAudioSpecificConfig(asc.data(), asc.size(), &config), OK);
+  EXPECT_EQ(config.object_type, AACObjectLC);
+  EXPECT_EQ(config.sampling_frequency, 24000);
+  EXPECT_EQ(config.channel_configuration, 2);
+  EXPECT_TRUE(config.sbr_present);
+  EXPECT_FALSE(config.ps_present);
+  EXPECT_EQ(config.extension_sampling_frequency, 48000);
+
+  // explicit rate, 960 sample frames
+  BitWriter explicitRate;
+  explicitRate.Put(AACObjectLC, 5);
+  explicitRate.Put(15, 4);
+  explicitRate.Put(37800, 24);
+  explicitRate.Put(1, 4);
+  explicitRate.Put(4, 3);
+  asc = explicitRate.Finish();
+  ASSERT_EQ(ParseAudioSpecificConfig(asc.data(), asc.size(), &config), OK);
+  EXPECT_EQ(config.sampling_frequency_index, 15);
+  EXPECT_EQ(config.sampling_frequency, 37800);
+  EXPECT_TRUE(config.frame_length_flag);
+
+  const uint8_t kTruncated[] = {0x12};
+  EXPECT_EQ(ParseAudioSpecificConfig(kTruncated, sizeof(kTruncated), &config),
+            ERROR_MALFORMED);
+
+  // reserved channelConfiguration
+  const uint8_t kReserved[] = {0x11, 0xc0};
+  EXPECT_EQ(ParseAudioSpecificConfig(kReserved, sizeof(kReserved), &config),
+            ERROR_MALFORMED);
+}
+
+TEST(AACUtilsTest, ProgramConfigElement) {
+  BitWriter writer;
+  writer.Put(AACObjectLC, 5);
+  writer.Put(3, 4);
+  writer.Put(0, 4);  // channelConfiguration
+  writer.Put(0, 3);  // GASpecificConfig
+  // program_config_element: C, L/R in front, Ls/Rs at the side, LFE
+  writer.Put(0, 4 + 2);
+  writer.Put(3, 4);
+  writer.Put(2, 4);
+  writer.Put(1, 4);
+  writer.Put(0, 4);
+  writer.Put(1, 2);
+  writer.Put(0, 3 + 4);
+  writer.Put(0, 3);  // no mixdowns
+  // is_cpe and element_tag_select
+  writer.Put(0x00, 1 + 4);
+  writer.Put(0x10, 1 + 4);
+  writer.Put(0x11, 1 + 4);
+  writer.Put(0, 4);  // LFE element_tag_select
+  writer.Put(0, 3);  // byte_alignment()
+  writer.Put(2, 8);
+  writer.Put(0x4142, 16);  // comment
+  std::vector<uint8_t> asc = writer.Finish();
+
+  AudioSpecificConfig config;
+  ASSERT_EQ(ParseAudioSpecificConfig(asc.data(), asc.size(), &config), OK);
+  EXPECT_EQ(config.channel_configuration, 0);
+  EXPECT_EQ(config.num_channels, 6);
+  EXPECT_EQ(config.channel_layout, CHANNEL_LAYOUT_5_1);
+
+  // truncated in the comment
+  asc.pop_back();
+  EXPECT_EQ(ParseAudioSpecificConfig(asc.data(), asc.size(), &config),
+            ERROR_MALFORMED);
+}
+
+TEST(AACUtilsTest, OutputProperty) {
+  // LC at 22.05 kHz with SBR and PS signalled backward compatibly
+  BitWriter writer;
+  writer.Put(AACObjectLC, 5);
+  writer.Put(7, 4);
+  writer.Put(1, 4);
+  writer.Put(0, 3);
+  writer.Put(0x2b7, 11);
+  writer.Put(AACObjectHE, 5);
+  writer.Put(1, 1);
+  writer.Put(4, 4);
+  writer.Put(0x548, 11);
+  writer.Put(1, 1);
+  std::vector<uint8_t> asc = writer.Finish();
+
+  AudioSpecificConfig config;
+  ASSERT_EQ(ParseAudioSpecificConfig(asc.data(), asc.size(), &config), OK);
+  EXPECT_EQ(config.object_type, AACObjectLC);
+  EXPECT_TRUE(config.sbr_present);
+  EXPECT_TRUE(config.ps_present);
+  AudioCodecProperty property;
+  ChannelLayout layout;
+  GetAACOutputProperty(config, &property, &layout);
+  EXPECT_EQ(property.codec_id, CodecId::AV_CODEC_ID_AAC);
+  EXPECT_EQ(property.sample_rate, 44100);
+  EXPECT_EQ(property.samples_per_channel, 2048u);
+  EXPECT_EQ(property.channels, 2u);
+  EXPECT_EQ(layout, CHANNEL_LAYOUT_STEREO);
+
+  // the extension is not looked for where the config may continue
+  BitReader br(asc.data(), asc.size());
+  ASSERT_EQ(ParseAudioSpecificConfig(&br, &config), OK);
+  EXPECT_FALSE(config.sbr_present);
+  GetAACOutputProperty(config, &property, &layout);
+  EXPECT_EQ(property.sample_rate, 22050);
+  EXPECT_EQ(property.channels, 1u);
+  EXPECT_EQ(layout, CHANNEL_LAYOUT_MONO);
+
+  // from an ESDS, 5.1 at 48 kHz
+  MetaData meta;
+  ASSERT_TRUE(MakeAACCodecSpecificData(meta, AACObjectLC - 1, 3, 6));
+  uint32_t type;
+  const void* data;
+  size_t size;
+  ASSERT_TRUE(meta.findData(kKeyESDS, &type, &data, &size));
+  ESDS esds(data, size);
+  ASSERT_EQ(ParseAACCodecProperty(esds, &property, &layout), OK);
+  EXPECT_EQ(property.sample_rate, 48000);
+  EXPECT_EQ(property.samples_per_channel, 1024u);
+  EXPECT_EQ(property.channels, 6u);
+  EXPECT_EQ(layout, CHANNEL_LAYOUT_5_1_BACK);
+}
+
+TEST(AACUtilsTest, PacketizeBuffer) {
+  AudioSpecificConfig config = MakeConfig(AACObjectLC, 4, 44100, 2);
+  ADTSPacketizer packetizer(config);
+  const uint8_t kPayload[] = {1, 2, 3, 4, 5};
+
+  // room in front of the range
+  auto buffer = std::make_shared<Buffer>(32);
+  memcpy(buffer->base() + 16, kPayload, sizeof(kPayload));
+  buffer->setRange(16, sizeof(kPayload));
+  Buffer* original = buffer.get();
+  ASSERT_EQ(packetizer.Packetize(&buffer), OK);
+  EXPECT_EQ(buffer.get(), original);
+  EXPECT_EQ(buffer->offset(), 16 - kADTSHeaderSize);
+  ADTSHeader header;
+  ASSERT_TRUE(ParseADTSHeader(buffer->data(), buffer->size(), &header));
+  EXPECT_EQ(header.frame_length, buffer->size());
+  EXPECT_EQ(header.profile, AACObjectLC - 1);
+  EXPECT_EQ(header.sampling_frequency_index, 4);
+  EXPECT_EQ(header.channel_configuration, 2);
+  EXPECT_EQ(memcmp(buffer->data() + kADTSHeaderSize, kPayload,
+                   sizeof(kPayload)),
+            0);
+
+  // no room at all
+  buffer = Buffer::CreateAsCopy(kPayload, sizeof(kPayload));
+  buffer->sampleMeta().pts_us = 1234;
+  buffer->setInt32Data(5);
+  buffer->meta()->setInt64("durationUs", 23219);
+  original = buffer.get();
+  ASSERT_EQ(packetizer.Packetize(&buffer), OK);
+  EXPECT_NE(buffer.get(), original);
+  EXPECT_EQ(buffer->size(), sizeof(kPayload) + kADTSHeaderSize);
+  EXPECT_EQ(buffer->sampleMeta().pts_us, 1234);
+  EXPECT_EQ(buffer->int32Data(), 5);
+  int64_t duration_us = 0;
+  EXPECT_TRUE(buffer->meta()->findInt64("durationUs", &duration_us));
+  EXPECT_EQ(duration_us, 23219);
+
+  ADTSPacketizer he(MakeConfig(AACObjectHE, 3, 48000, 2));
+  EXPECT_EQ(he.InitCheck(), ERROR_UNSUPPORTED);
+  std::vector<uint8_t> large(8192);
+  size_t size;
+  EXPECT_EQ(packetizer.Packetize(large.data(), large.size(), large.data(),
+                                 large.size(), &size),
+            ERROR_OUT_OF_RANGE);
+}
+
+}  // namespace ave
@@ -0,0 +1,255 @@
+/*
+ * access_unit_assembler_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../access_unit_assembler.h"
+#include "bit_writer.h"
+
+namespace ave {
+
+namespace {
+
+using AccessUnit = AccessUnitAssembler::AccessUnit;
+
+// Baseline SPS with 4 bit frame_num and pic_order_cnt_lsb.
+std::vector<uint8_t> MakeAvcSps() {
+  BitWriter bw;
+  bw.Put(66, 8);
+  bw.Put(0, 8);
+  bw.Put(30, 8);
+  bw.PutUE(0);  // seq_parameter_set_id
+  bw.PutUE(0);
+  bw.PutUE(0);  // pic_order_cnt_type
+  bw.PutUE(0);
+  bw.PutUE(1);
+  bw.Put(0, 1);
+  bw.PutUE(19);
+  bw.PutUE(14);
+  bw.Put(6, 3);  // frame_mbs_only_flag, direct_8x8_inference_flag
+  bw.Put(0, 2);
+  return bw.FinishNAL({0x67});
+}
+
+std::vector<uint8_t> MakeAvcPps() {
+  BitWriter bw;
+  bw.PutUE(0);
+  bw.PutUE(0);
+  bw.Put(0, 2);
+  bw.PutUE(0);
+  bw.PutUE(0);
+  bw.PutUE(0);
+  bw.Put(0, 3);
+  bw.PutSE(0);
+  bw.PutSE(0);
+  bw.PutSE(0);
+  bw.Put(4, 3);
+  return bw.FinishNAL({0x68});
+}
+
+std::vector<uint8_t> MakeAvcSlice(bool idr,
+                                  uint32_t sliceType,
+                                  uint32_t frameNum,
+                                  uint32_t pocLsb,
+                                  uint32_t firstMb) {
+  BitWriter bw;
+  bw.PutUE(firstMb);
+  bw.PutUE(sliceType);
+  bw.PutUE(0);
+  bw.Put(frameNum, 4);
+  if (idr) {
+    bw.PutUE(0);
+  }
+  bw.Put(pocLsb, 4);
+  if (!idr) {
+    if (sliceType == kAvcSliceTypeP) {
+      bw.Put(0, 2);
+    }
+    bw.Put(0, 1);
+  }
+  // some slice data, with a zero run that needs escaping
+  bw.Put(0, 24);
+  bw.Put(0xabcdef, 24);
+  return bw.FinishNAL({static_cast<uint8_t>(idr ? 0x65 : 0x41)});
+}
+
+void Append(std::vector<uint8_t>* stream, const std::vector<uint8_t>& nal) {
+  const uint8_t kStartCode[] = {0x00, 0x00, 0x00, 0x01};
+  stream->insert(stream->end(), kStartCode, kStartCode + sizeof(kStartCode));
+  stream->insert(stream->end(), nal.begin(), nal.end());
+}
+
+struct Unit {
+  std::string data;
+  size_t numNals;
+  int64_t ptsUs;
+  bool sync;
+  int32_t poc;
+};
+
+// Pushes |stream| in chunks of random size, the chunk holding the first byte
+// of each access unit gets its timestamp.
+std::vector<Unit> Assemble(NALFormat format,
+                           const std::vector<uint8_t>& stream,
+                           const std::vector<size_t>& unitOffsets,
+                           uint32_t seed) {
+  std::mt19937 rng(seed);
+  AccessUnitAssembler assembler(format);
+  std::vector<Unit> result;
+  std::vector<AccessUnit> units;
+  auto collect = [&]() {
+    for (const auto& unit : units) {
+      const char* data = reinterpret_cast<const char*>(unit.data);
+      // every NAL unit lies in the access unit
+      for (size_t i = 0; i < unit.num_nals; ++i) {
+        EXPECT_LE(unit.nals[i].nalOffset + unit.nals[i].nalSize, unit.size);
+      }
+      result.push_back({std::string(data, unit.size), unit.num_nals,
+                        unit.pts_us, unit.sync, unit.pic_order_cnt});
+    }
+    units.clear();
+  };
+
+  size_t offset = 0;
+  size_t nextUnit = 0;
+  while (offset < stream.size()) {
+    size_t size = std::min<size_t>(1 + rng() % 40, stream.size() - offset);
+    int64_t ptsUs = -1;
+    // a chunk boundary right at the start of each access unit, as in PES
+    if (nextUnit < unitOffsets.size() && offset == unitOffsets[nextUnit]) {
+      ptsUs = 1000 * (nextUnit + 1);
+      ++nextUnit;
+    }
+    if (nextUnit < unitOffsets.size()) {
+      size = std::min(size, unitOffsets[nextUnit] - offset);
+    }
+    assembler.Push(stream.data() + offset, size, ptsUs, ptsUs, &units);
+    collect();
+    offset += size;
+  }
+  assembler.Flush(&units);
+  collect();
+  return result;
+}
+
+}  // namespace
+
+TEST(AccessUnitAssemblerTest, AVC) {
+  std::vector<uint8_t> stream;
+  std::vector<size_t> unitOffsets;
+  std::vector<std::vector<uint8_t>> units(5);
+  Append(&units[0], MakeAvcSps());
+  Append(&units[0], MakeAvcPps());
+  Append(&units[0], MakeAvcSlice(true, kAvcSliceTypeI, 0, 0, 0));
+  Append(&units[0], MakeAvcSlice(true, kAvcSliceTypeI, 0, 0, 150));
+  Append(&units[1], MakeAvcSlice(false, kAvcSliceTypeP, 1, 6, 0));
+  Append(&units[1], MakeAvcSlice(false, kAvcSliceTypeP, 1, 6, 150));
+  Append(&units[2], MakeAvcSlice(false, kAvcSliceTypeP, 2, 2, 0));
+  // an I picture with a recovery point SEI
+  Append(&units[3], {0x09, 0x10});                    // AUD
+  Append(&units[3], {0x06, 0x06, 0x01, 0x84, 0x80});  // recovery point
+  Append(&units[3], MakeAvcSlice(false, kAvcSliceTypeI, 3, 10, 0));
+  // repeated parameter sets start the next access unit
+  Append(&units[4], MakeAvcSps());
+  Append(&units[4], MakeAvcPps());
+  Append(&units[4], MakeAvcSlice(false, kAvcSliceTypeP, 4, 14, 0));
+  for (const auto& unit : units) {
+    unitOffsets.push_back(stream.size());
+    stream.insert(stream.end(), unit.begin(), unit.end());
+  }
+
+  const struct {
+    size_t numNals;
+    bool sync;
+    int32_t poc;
+  } kExpected[] = {
+      {4, true, 0}, {2, false, 6}, {1, false, 2}, {3, true, 10}, {3, false, 14},
+  };
+  for (uint32_t seed = 0; seed < 20; ++seed) {
+    std::vector<Unit> result =
+        Assemble(NALFormat::kAVC, stream, unitOffsets, seed);
+    ASSERT_EQ(result.size(), units.size());
+    for (size_t i = 0; i < result.size(); ++i) {
+      // the leading zero of the four byte start code is not part of it
+      EXPECT_EQ(result[i].data,
+                std::string(units[i].begin() + 1, units[i].end()));
+      EXPECT_EQ(result[i].numNals, kExpected[i].numNals);
+      EXPECT_EQ(result[i].sync, kExpected[i].sync) << i;
+      EXPECT_EQ(result[i].poc, kExpected[i].poc) << i;
+      EXPECT_EQ(result[i].ptsUs, static_cast<int64_t>(1000 * (i + 1)));
+    }
+  }
+}
+
+TEST(AccessUnitAssemblerTest, HEVCWithoutParameterSets) {
+  // slices that cannot be parsed fall back to first_slice_segment_in_pic_flag
+  const std::vector<uint8_t> kUnits[] = {
+      {0x00, 0x00, 0x01, 0x46, 0x01, 0x10,               // AUD
+       0x00, 0x00, 0x01, 0x26, 0x01, 0xaf, 0x12,         // IDR, first
+       0x00, 0x00, 0x01, 0x26, 0x01, 0x2f, 0x34},        // IDR
+      {0x00, 0x00, 0x01, 0x02, 0x01, 0xd0, 0x56},        // TRAIL_R, first
+      {0x00, 0x00, 0x01, 0x4e, 0x01, 0x05, 0x01, 0x80,   // prefix SEI
+       0x00, 0x00, 0x01, 0x02, 0x01, 0xd0, 0x78,         // TRAIL_R, first
+       0x00, 0x00, 0x01, 0x50, 0x01, 0x05, 0x01, 0x80},  // suffix SEI
+      {0x00, 0x00, 0x01, 0x2a, 0x01, 0xaf, 0x9a},        // CRA, first
+  };
+  std::vector<uint8_t> stream;
+  std::vector<size_t> unitOffsets;
+  for (const auto& unit : kUnits) {
+    unitOffsets.push_back(stream.size());
+    stream.insert(stream.end(), unit.begin(), unit.end());
+  }
+
+  const bool kSync[] = {true, false, false, true};
+  for (uint32_t seed = 0; seed < 20; ++seed) {
+    std::vector<Unit> result =
+        Assemble(NALFormat::kHEVC, stream, unitOffsets, seed);
+    ASSERT_EQ(result.size(), 4u);
+    for (size_t i = 0; i < result.size(); ++i) {
+      EXPECT_EQ(result[i].data,
+                std::string(kUnits[i].begin(), kUnits[i].end()));
+      EXPECT_EQ(result[i].sync, kSync[i]);
+    }
+  }
+}
+
+TEST(AccessUnitAssemblerTest, StampOfChunkWithoutStartIsDropped) {
+  const std::vector<uint8_t> kFirst = {
+      0x00, 0x00, 0x01, 0x26, 0x01, 0xaf, 0x12,  // IDR, first
+  };
+  const std::vector<uint8_t> kContinuation = {
+      0x00, 0x00, 0x01, 0x26, 0x01, 0x2f, 0x34,  // IDR
+  };
+  const std::vector<uint8_t> kSecond = {
+      0x00, 0x00, 0x01, 0x02, 0x01, 0xd0, 0x56,  // TRAIL_R, first
+  };
+  const std::vector<uint8_t> kThird = {
+      0x00, 0x00, 0x01, 0x02, 0x01, 0xd0, 0x78,  // TRAIL_R, first
+  };
+  AccessUnitAssembler assembler(NALFormat::kHEVC);
+  std::vector<AccessUnit> units;
+  assembler.Push(kFirst.data(), kFirst.size(), 1000, 1000, &units);
+  // a stamp on a chunk that continues the first access unit
+  assembler.Push(kContinuation.data(), kContinuation.size(), 5000, 5000,
+                 &units);
+  assembler.Push(kSecond.data(), kSecond.size(), -1, -1, &units);
+  assembler.Push(kThird.data(), kThird.size(), 3000, 2000, &units);
+  assembler.Flush(&units);
+  ASSERT_EQ(units.size(), 3u);
+  EXPECT_EQ(units[0].pts_us, 1000);
+  EXPECT_EQ(units[0].num_nals, 2u);
+  EXPECT_EQ(units[1].pts_us, -1);
+  EXPECT_EQ(units[1].dts_us, -1);
+  EXPECT_EQ(units[2].pts_us, 3000);
+  EXPECT_EQ(units[2].dts_us, 2000);
+}
+
+}  // namespace ave
@@ -0,0 +1,259 @@
+/*
+ * audio_resampler_benchmark.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../audio_resampler.h"
+#include "../vector_math.h"
+
+namespace ave {
+
+namespace {
+
+const int kChannels = 2;
+// 10 ms at 48 kHz, as a render callback asks for it
+const size_t kChunkFrames = 480;
+
+const struct {
+  int input_rate;
+  int output_rate;
+} kRates[] = {
+    {44100, 48000},
+    {48000, 44100},
+    {16000, 48000},
+    {48000, 16000},
+};
+
+const struct {
+  AudioResampler::Quality quality;
+  bool low_latency;
+  const char* name;
+} kModes[] = {
+    {AudioResampler::Quality::kLow, false, "low"},
+    {AudioResampler::Quality::kMedium, true, "medium, low latency"},
+    {AudioResampler::Quality::kMedium, false, "medium"},
+    {AudioResampler::Quality::kHigh, false, "high"},
+};
+
+// Three tones below the Nyquist frequency of the lower rate, the highest
+// one in the transition band of the shorter filters.
+double Signal(double seconds, int low_rate) {
+  return 0.3 * std::sin(2 * M_PI * 0.01 * low_rate * seconds) +
+         0.3 * std::sin(2 * M_PI * 0.13 * low_rate * seconds + 1) +
+         0.3 * std::sin(2 * M_PI * 0.37 * low_rate * seconds + 2);
+}
+
+std::vector<float> MakeInput(int rate, int low_rate, double seconds) {
+  size_t frames = static_cast<size_t>(rate * seconds);
+  std::vector<float> samples(frames * kChannels);
+  for (size_t i = 0; i < frames; i++) {
+    for (int c = 0; c < kChannels; c++) {
+      samples[i * kChannels + c] =
+          static_cast<float>(Signal(double(i) / rate, low_rate));
+    }
+  }
+  return samples;
+}
+
+double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 50; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+// The textbook resampler: every output sample evaluates the windowed sinc
+// at its exact position in double, with the filter of Quality::kHigh.
+std::vector<float> NaiveResample(const std::vector<float>& in,
+                                 int input_rate,
+                                 int output_rate) {
+  const double attenuation_db = 110.0;
+  const double beta = 0.1102 * (attenuation_db - 8.7);
+  const double ratio = double(output_rate) / input_rate;
+  double half = 64;
+  double transition = (attenuation_db - 7.95) / (2.285 * 2 * half * M_PI);
+  double cutoff = (1.0 - transition / 2) * std::min(1.0, ratio);
+  if (ratio < 1.0) {
+    half = std::ceil(half / ratio);
+  }
+  const double window_scale = 1.0 / BesselI0(beta);
+
+  const int64_t in_frames = in.size() / kChannels;
+  const int64_t out_frames =
+      (in_frames * output_rate + input_rate - 1) / input_rate;
+  std::vector<float> out(out_frames * kChannels);
+  for (int64_t n = 0; n < out_frames; n++) {
+    double t = double(n) * input_rate / output_rate;
+    int64_t first = static_cast<int64_t>(std::floor(t - half)) + 1;
+    int64_t last = static_cast<int64_t>(std::floor(t + half));
+    double sums[kChannels] = {};
+    double weights = 0;
+    for (int64_t j = first; j <= last; j++) {
+      double distance = t - j;
+      double x = distance / half;
+      double window =
+          BesselI0(beta * std::sqrt(std::max(0.0, 1.0 - x * x))) *
+          window_scale;
+      double arg = M_PI * cutoff * distance;
+      double weight = (arg == 0.0 ? 1.0 : std::sin(arg) / arg) * window;
+      weights += weight;
+      if (j < 0 || j >= in_frames) {
+        continue;
+      }
+      for (int c = 0; c < kChannels; c++) {
+        sums[c] += weight * in[j * kChannels + c];
+      }
+    }
+    for (int c = 0; c < kChannels; c++) {
+      out[n * kChannels + c] = static_cast<float>(sums[c] / weights);
+    }
+  }
+  return out;
+}
+
+std::vector<float> Resample(AudioResampler& resampler,
+                            const std::vector<float>& in) {
+  size_t frames = in.size() / kChannels;
+  std::vector<float> out(
+      (resampler.GetOutputFrames(frames) + resampler.GetFlushFrames() +
+       resampler.latency_frames() * 4 + kChunkFrames * 4) *
+      kChannels);
+  size_t written = 0;
+  for (size_t done = 0; done < frames; done += kChunkFrames) {
+    size_t count = std::min(kChunkFrames, frames - done);
+    size_t out_frames;
+    resampler.Resample(kAudioEncodingPcmFloat, &in[done * kChannels], count,
+                       &out[written * kChannels],
+                       out.size() / kChannels - written, &out_frames);
+    written += out_frames;
+  }
+  size_t out_frames;
+  resampler.Flush(kAudioEncodingPcmFloat, &out[written * kChannels],
+                  out.size() / kChannels - written, &out_frames);
+  out.resize((written + out_frames) * kChannels);
+  return out;
+}
+
+// Signal to noise ratio against the exact signal, leaving out the first
+// and last |margin| frames where the filter sees the silence around the
+// stream.
+double SNR(const std::vector<float>& out,
+           int rate,
+           int low_rate,
+           size_t margin) {
+  double signal = 0;
+  double noise = 0;
+  size_t frames = out.size() / kChannels;
+  for (size_t i = margin; i + margin < frames; i++) {
+    double expected = Signal(double(i) / rate, low_rate);
+    for (int c = 0; c < kChannels; c++) {
+      double error = out[i * kChannels + c] - expected;
+      signal += expected * expected;
+      noise += error * error;
+    }
+  }
+  return 10 * std::log10(signal / (noise + 1e-30));
+}
+
+template <typename Run>
+double Seconds(Run run) {
+  auto start = std::chrono::steady_clock::now();
+  run();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+}  // namespace
+
+TEST(AudioResamplerBenchmark, Resample) {
+  const double kSeconds = 10;
+  const double kNaiveSeconds = 0.5;
+  for (const auto& rates : kRates) {
+    int low_rate = std::min(rates.input_rate, rates.output_rate);
+    // the margin of the longest filter, at the output rate
+    size_t margin = 64 * 2 * rates.output_rate / low_rate + 16;
+    printf("%d to %d Hz, stereo float\n", rates.input_rate,
+           rates.output_rate);
+
+    std::vector<float> naive_in =
+        MakeInput(rates.input_rate, low_rate, kNaiveSeconds);
+    std::vector<float> naive_out;
+    double seconds = Seconds([&]() {
+      naive_out = NaiveResample(naive_in, rates.input_rate, rates.output_rate);
+    });
+    printf("  %-22s %8.1fx realtime  SNR %6.1f dB\n", "naive reference",
+           kNaiveSeconds / seconds,
+           SNR(naive_out, rates.output_rate, low_rate, margin));
+
+    std::vector<float> in = MakeInput(rates.input_rate, low_rate, kSeconds);
+    for (const auto& mode : kModes) {
+      AudioResampler resampler(rates.input_rate, rates.output_rate,
+                               kChannels, mode.quality, mode.low_latency);
+      ASSERT_EQ(resampler.InitCheck(), OK);
+      std::vector<float> out;
+      seconds = Seconds([&]() { out = Resample(resampler, in); });
+
+      // against the reference over the same span
+      std::vector<float> head(in.begin(), in.begin() + naive_in.size());
+      std::vector<float> head_out = Resample(resampler, head);
+      double max_diff = 0;
+      for (size_t i = margin * kChannels;
+           i + margin * kChannels < head_out.size(); i++) {
+        max_diff = std::max(max_diff,
+                            std::fabs(double(head_out[i]) - naive_out[i]));
+      }
+      printf("  %-22s %8.1fx realtime  SNR %6.1f dB  vs naive %6.1f dB\n",
+             mode.name, kSeconds / seconds,
+             SNR(out, rates.output_rate, low_rate, margin),
+             20 * std::log10(max_diff + 1e-30));
+    }
+  }
+}
+
+// The inner loop on its own, with the filter lengths of the qualities.
+TEST(AudioResamplerBenchmark, DotProduct) {
+  const struct {
+    vector_math::Impl impl;
+    const char* name;
+  } kImpls[] = {
+      {vector_math::Impl::kScalar, "scalar"},
+      {vector_math::Impl::kSSE, "SSE"},
+      {vector_math::Impl::kAVX2, "AVX2"},
+      {vector_math::Impl::kNEON, "NEON"},
+  };
+  const size_t kRounds = 2000000;
+  std::vector<float> a(4096, 0.5f);
+  std::vector<float> b(4096, 0.25f);
+  for (size_t taps : {24, 64, 128}) {
+    for (const auto& impl : kImpls) {
+      vector_math::DotProductProc dot = vector_math::GetDotProduct(impl.impl);
+      if (dot == nullptr) {
+        continue;
+      }
+      float sum = 0;
+      double seconds = Seconds([&]() {
+        for (size_t i = 0; i < kRounds; i++) {
+          sum += dot(a.data() + (i & 1023), b.data(), taps);
+        }
+      });
+      printf("%3zu taps %-8s %8.1f M outputs/s (%g)\n", taps, impl.name,
+             kRounds / seconds / 1e6, sum);
+    }
+  }
+}
+
+}  // namespace ave
@@ -0,0 +1,342 @@
+/*
+ * audio_resampler_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../audio_resampler.h"
+#include "../media_packet.h"
+
+namespace ave {
+
+namespace {
+
+const struct {
+  int input_rate;
+  int output_rate;
+} kRates[] = {
+    {44100, 48000}, {48000, 44100}, {16000, 48000},
+    {48000, 16000}, {8000, 44100},  {48000, 48000},
+};
+
+const AudioResampler::Quality kQualities[] = {
+    AudioResampler::Quality::kLow,
+    AudioResampler::Quality::kMedium,
+    AudioResampler::Quality::kHigh,
+};
+
+// |frames| interleaved frames of a |frequency| Hz sine, with the phase of
+// channel c shifted by c radians.
+std::vector<float> MakeSine(double frequency,
+                            int rate,
+                            int channels,
+                            size_t frames,
+                            double amplitude = 0.5) {
+  std::vector<float> samples(frames * channels);
+  for (size_t i = 0; i < frames; i++) {
+    for (int c = 0; c < channels; c++) {
+      samples[i * channels + c] = static_cast<float>(
+          amplitude * std::sin(2 * M_PI * frequency * i / rate + c));
+    }
+  }
+  return samples;
+}
+
+// Resamples all of |in| in chunks of at most |chunk| frames and flushes.
+std::vector<float> ResampleAll(AudioResampler& resampler,
+                               const std::vector<float>& in,
+                               size_t chunk) {
+  const int channels = resampler.channels();
+  const size_t frames = in.size() / channels;
+  std::vector<float> out;
+  for (size_t done = 0; done < frames;) {
+    size_t count = std::min(chunk, frames - done);
+    size_t expected = resampler.GetOutputFrames(count);
+    size_t old_size = out.size();
+    out.resize(old_size + expected * channels);
+    size_t written = 0;
+    EXPECT_EQ(resampler.Resample(kAudioEncodingPcmFloat,
+                                 &in[done * channels], count,
+                                 out.data() + old_size, expected, &written),
+              OK);
+    EXPECT_EQ(written, expected);
+    done += count;
+  }
+  size_t old_size = out.size();
+  size_t expected = resampler.GetFlushFrames();
+  out.resize(old_size + expected * channels);
+  size_t written = 0;
+  EXPECT_EQ(resampler.Flush(kAudioEncodingPcmFloat, out.data() + old_size,
+                            expected, &written),
+            OK);
+  EXPECT_EQ(written, expected);
+  return out;
+}
+
+// The largest difference from the sine MakeSine() makes at the output rate,
+// in dB of full scale, ignoring |margin| frames at both ends.
+double MaxErrorDb(const std::vector<float>& out,
+                  double frequency,
+                  int rate,
+                  int channels,
+                  size_t margin) {
+  size_t frames = out.size() / channels;
+  std::vector<float> expected = MakeSine(frequency, rate, channels, frames);
+  double max_error = 0;
+  for (size_t i = margin * channels; i + margin * channels < out.size();
+       i++) {
+    max_error = std::max(max_error, std::fabs(double(out[i]) - expected[i]));
+  }
+  return 20 * std::log10(max_error + 1e-12);
+}
+
+}  // namespace
+
+TEST(AudioResamplerTest, InitCheck) {
+  for (const auto& rates : kRates) {
+    AudioResampler resampler(rates.input_rate, rates.output_rate, 2);
+    EXPECT_EQ(resampler.InitCheck(), OK);
+  }
+  // 47999 / 44100 has 47999 phases
+  EXPECT_EQ(AudioResampler(44100, 47999, 2).InitCheck(), ERROR_UNSUPPORTED);
+  EXPECT_EQ(AudioResampler(0, 48000, 2).InitCheck(), ERROR_UNSUPPORTED);
+  EXPECT_EQ(AudioResampler(44100, 48000, 9).InitCheck(), ERROR_UNSUPPORTED);
+
+  AudioResampler resampler(44100, 48000, 2);
+  std::vector<float> samples(64);
+  size_t frames = 1;
+  EXPECT_EQ(resampler.Resample(kAudioEncodingPcm16bit, samples.data(), 0,
+                               samples.data(), 0, &frames),
+            OK);
+  EXPECT_EQ(frames, 0u);
+  EXPECT_EQ(resampler.Resample(static_cast<AudioEncoding>(1), samples.data(),
+                               8, samples.data(), 32, &frames),
+            ERROR_UNSUPPORTED);
+}
+
+TEST(AudioResamplerTest, OutputFrames) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<size_t> chunk_size(0, 3000);
+  for (const auto& rates : kRates) {
+    AudioResampler resampler(rates.input_rate, rates.output_rate, 1);
+    std::vector<float> in(3000);
+    // room for the input and what the filter held back
+    std::vector<float> out(3000 * 6 + 1000);
+    uint64_t total_in = 0;
+    uint64_t total_out = 0;
+    for (int i = 0; i < 50; i++) {
+      size_t frames = chunk_size(rng);
+      size_t expected = resampler.GetOutputFrames(frames);
+      size_t written;
+      // one frame short
+      if (expected > 0) {
+        EXPECT_EQ(resampler.Resample(kAudioEncodingPcmFloat, in.data(),
+                                     frames, out.data(), expected - 1,
+                                     &written),
+                  ERROR_BUFFER_TOO_SMALL);
+      }
+      ASSERT_EQ(resampler.Resample(kAudioEncodingPcmFloat, in.data(), frames,
+                                   out.data(), out.size(), &written),
+                OK);
+      EXPECT_EQ(written, expected);
+      total_in += frames;
+      total_out += written;
+    }
+    // the output stops behind the input by the latency
+    EXPECT_LE(total_out * rates.input_rate,
+              (total_in - resampler.latency_frames()) * rates.output_rate +
+                  rates.input_rate);
+
+    size_t written;
+    ASSERT_EQ(resampler.Flush(kAudioEncodingPcmFloat, out.data(), out.size(),
+                              &written),
+              OK);
+    total_out += written;
+    uint64_t expected =
+        (total_in * rates.output_rate + rates.input_rate - 1) /
+        rates.input_rate;
+    EXPECT_EQ(total_out, expected)
+        << rates.input_rate << " to " << rates.output_rate;
+    EXPECT_EQ(resampler.GetFlushFrames(), 0u);
+  }
+}
+
+TEST(AudioResamplerTest, Chunking) {
+  std::vector<float> in = MakeSine(997, 44100, 2, 20000);
+  AudioResampler whole_resampler(44100, 48000, 2);
+  std::vector<float> whole = ResampleAll(whole_resampler, in, in.size());
+  for (size_t chunk : {1, 7, 441, 4096}) {
+    AudioResampler resampler(44100, 48000, 2);
+    std::vector<float> out = ResampleAll(resampler, in, chunk);
+    ASSERT_EQ(out, whole) << chunk;
+  }
+  // a resampler is as good as new after the flush
+  std::vector<float> again = ResampleAll(whole_resampler, in, 1000);
+  EXPECT_EQ(again, whole);
+}
+
+TEST(AudioResamplerTest, Accuracy) {
+  // the highest error allowed for a tone in the passband, the low latency
+  // filter of the low quality rolls off early
+  const double kMaxErrorDb[] = {-60, -95, -115};
+  const double kMaxLowLatencyErrorDb[] = {-35, -90, -115};
+  for (const auto& rates : kRates) {
+    for (size_t q = 0; q < 3; q++) {
+      for (bool low_latency : {false, true}) {
+        AudioResampler resampler(rates.input_rate, rates.output_rate, 2,
+                                 kQualities[q], low_latency);
+        int low_rate = std::min(rates.input_rate, rates.output_rate);
+        for (double frequency : {50.0, low_rate * 0.1, low_rate * 0.3}) {
+          std::vector<float> in =
+              MakeSine(frequency, rates.input_rate, 2, rates.input_rate / 4);
+          std::vector<float> out = ResampleAll(resampler, in, 960);
+          size_t margin = resampler.latency_frames() * rates.output_rate /
+                              rates.input_rate +
+                          1;
+          double error =
+              MaxErrorDb(out, frequency, rates.output_rate, 2, margin);
+          EXPECT_LT(error, low_latency ? kMaxLowLatencyErrorDb[q]
+                                       : kMaxErrorDb[q])
+              << rates.input_rate << " to " << rates.output_rate
+              << ", quality " << q << (low_latency ? " low latency" : "")
+              << ", " << frequency << " Hz";
+        }
+      }
+    }
+  }
+}
+
+TEST(AudioResamplerTest, StopBand) {
+  // no alias of a tone above the output Nyquist frequency
+  const double kMaxLevelDb[] = {-90, -115, -130};
+  for (size_t q = 0; q < 3; q++) {
+    AudioResampler resampler(48000, 16000, 1, kQualities[q]);
+    std::vector<float> in = MakeSine(12000, 48000, 1, 48000, 1.0);
+    std::vector<float> out = ResampleAll(resampler, in, 960);
+    size_t margin = resampler.latency_frames() / 3 + 1;
+    double energy = 0;
+    for (size_t i = margin; i + margin < out.size(); i++) {
+      energy += double(out[i]) * out[i];
+    }
+    double rms = std::sqrt(energy / (out.size() - 2 * margin));
+    EXPECT_LT(20 * std::log10(rms + 1e-12), kMaxLevelDb[q]) << q;
+  }
+}
+
+TEST(AudioResamplerTest, Latency) {
+  AudioResampler resampler(16000, 48000, 1);
+  AudioResampler low_latency(16000, 48000, 1,
+                             AudioResampler::Quality::kMedium, true);
+  EXPECT_EQ(resampler.latency_frames(), resampler.taps() / 2);
+  EXPECT_EQ(low_latency.latency_frames() * 2, resampler.latency_frames());
+  // nothing comes out until the window of the first output is complete
+  EXPECT_EQ(resampler.GetOutputFrames(resampler.latency_frames()), 0u);
+  // the three outputs up to the second input frame
+  EXPECT_EQ(resampler.GetOutputFrames(resampler.latency_frames() + 1), 3u);
+  EXPECT_EQ(low_latency.GetOutputFrames(low_latency.latency_frames() + 1),
+            3u);
+
+  // downsampling stretches the filter
+  AudioResampler down(48000, 16000, 1);
+  EXPECT_EQ(down.taps(), resampler.taps() * 3);
+}
+
+TEST(AudioResamplerTest, IntegerEncodings) {
+  const size_t kFrames = 4800;
+  std::vector<float> in = MakeSine(440, 48000, 2, kFrames);
+  std::vector<int16_t> in16(in.size());
+  ASSERT_EQ(ConvertPcm(kAudioEncodingPcmFloat, in.data(),
+                       kAudioEncodingPcm16bit, in16.data(), in.size()),
+            OK);
+  std::vector<float> from16(in.size());
+  ASSERT_EQ(ConvertPcm(kAudioEncodingPcm16bit, in16.data(),
+                       kAudioEncodingPcmFloat, from16.data(), in.size()),
+            OK);
+
+  AudioResampler float_resampler(48000, 44100, 2);
+  std::vector<float> expected = ResampleAll(float_resampler, from16, 480);
+
+  AudioResampler resampler(48000, 44100, 2);
+  std::vector<int16_t> out(expected.size());
+  size_t written;
+  ASSERT_EQ(resampler.Resample(kAudioEncodingPcm16bit, in16.data(), kFrames,
+                               out.data(), out.size() / 2, &written),
+            OK);
+  size_t flushed;
+  ASSERT_EQ(resampler.Flush(kAudioEncodingPcm16bit, out.data() + written * 2,
+                            out.size() / 2 - written, &flushed),
+            OK);
+  ASSERT_EQ((written + flushed) * 2, expected.size());
+  for (size_t i = 0; i < out.size(); i++) {
+    // rounding and the dither
+    ASSERT_NEAR(out[i], expected[i] * 32768, 2) << i;
+  }
+}
+
+TEST(AudioResamplerTest, MediaPacket) {
+  // the first packet does not complete the window of the first output
+  const size_t kFrames[] = {20, 441, 441, 441, 441, 441, 441, 441, 441, 441};
+  AudioResampler resampler(44100, 48000, 2);
+  std::vector<float> samples = MakeSine(1000, 44100, 2, 20 + 441 * 9);
+  std::vector<int16_t> pcm(samples.size());
+  ConvertPcm(kAudioEncodingPcmFloat, samples.data(), kAudioEncodingPcm16bit,
+             pcm.data(), samples.size());
+
+  MediaPacket out = MediaPacket::Create(0);
+  size_t total_in = 0;
+  size_t total_out = 0;
+  for (size_t frames : kFrames) {
+    MediaPacket in = MediaPacket::Create(frames * 4);
+    in.SetMediaType(MediaType::AUDIO);
+    memcpy(in.data(), &pcm[total_in * 2], frames * 4);
+    AudioSampleInfo* info = in.audio_info();
+    info->codec_id = CodecId::AV_CODEC_ID_PCM_S16LE;
+    info->sample_rate_hz = 44100;
+    info->channels = 2;
+    info->bits_per_sample = 16;
+    info->timestamp_us = 1000000 + total_in * 1000000 / 44100;
+    total_in += frames;
+
+    status_t status = resampler.Resample(in, out);
+    if (frames < resampler.latency_frames()) {
+      ASSERT_EQ(status, NOT_ENOUGH_DATA);
+      continue;
+    }
+    ASSERT_EQ(status, OK);
+    AudioSampleInfo* out_info = out.audio_info();
+    ASSERT_NE(out_info, nullptr);
+    EXPECT_EQ(out_info->sample_rate_hz, 48000);
+    EXPECT_EQ(out_info->channels, 2);
+    EXPECT_EQ(out_info->codec_id, CodecId::AV_CODEC_ID_PCM_S16LE);
+    EXPECT_EQ(out.size(), out_info->samples_per_channel * 4u);
+    // the first output frame is at the time of the first input frame
+    EXPECT_EQ(out_info->timestamp_us,
+              static_cast<int64_t>(1000000 + total_out * 1000000 / 48000));
+    total_out += out_info->samples_per_channel;
+  }
+
+  ASSERT_EQ(resampler.Flush(out), OK);
+  EXPECT_EQ(out.audio_info()->timestamp_us,
+            static_cast<int64_t>(1000000 + total_out * 1000000 / 48000));
+  total_out += out.audio_info()->samples_per_channel;
+  EXPECT_EQ(total_out, (total_in * 48000 + 44099) / 44100);
+  EXPECT_EQ(resampler.Flush(out), NOT_ENOUGH_DATA);
+
+  // the rate has to match
+  MediaPacket in = MediaPacket::Create(4);
+  in.SetMediaType(MediaType::AUDIO);
+  in.audio_info()->codec_id = CodecId::AV_CODEC_ID_PCM_S16LE;
+  in.audio_info()->sample_rate_hz = 48000;
+  in.audio_info()->channels = 2;
+  EXPECT_EQ(resampler.Resample(in, out), ERROR_UNSUPPORTED);
+}
+
+}  // namespace ave
@@ -0,0 +1,276 @@
+/*
+ * av1_utils_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <cstring>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../av1_utils.h"
+#include "../media_errors.h"
+#include "bit_writer.h"
+
+namespace ave {
+
+namespace {
+
+// Main profile 1280x720, 7 bit order hints, two operating points of an L1T2
+// stream.
+std::vector<uint8_t> MakeSequenceHeader() {
+  BitWriter bw;
+  bw.Put(0, 3);  // seq_profile
+  bw.Put(0, 1);  // still_picture
+  bw.Put(0, 1);  // reduced_still_picture_header
+  bw.Put(0, 1);  // timing_info_present_flag
+  bw.Put(0, 1);  // initial_display_delay_present_flag
+  bw.Put(1, 5);  // operating_points_cnt_minus_1
+  bw.Put(0x103, 12);
+  bw.Put(8, 5);  // seq_level_idx
+  bw.Put(0, 1);  // seq_tier
+  bw.Put(0x101, 12);
+  bw.Put(8, 5);
+  bw.Put(0, 1);
+  bw.Put(10, 4);  // frame_width_bits_minus_1
+  bw.Put(10, 4);
+  bw.Put(1279, 11);
+  bw.Put(719, 11);
+  bw.Put(0, 1);  // frame_id_numbers_present_flag
+  bw.Put(0, 3);
+  bw.Put(0, 4);
+  bw.Put(1, 1);  // enable_order_hint
+  bw.Put(0, 2);
+  bw.Put(1, 1);  // seq_choose_screen_content_tools
+  bw.Put(1, 1);  // seq_choose_integer_mv
+  bw.Put(6, 3);  // order_hint_bits_minus_1
+  bw.Put(0, 3);
+  bw.Put(0, 1);  // high_bitdepth
+  bw.Put(0, 1);  // mono_chrome
+  bw.Put(0, 1);  // color_description_present_flag
+  bw.Put(0, 4);
+  bw.Put(0, 1);  // film_grain_params_present
+  bw.Put(1, 1);
+  return bw.Finish();
+}
+
+std::vector<uint8_t> MakeKeyFrameHeader(uint32_t width, uint32_t height) {
+  BitWriter bw;
+  bw.Put(0, 1);  // show_existing_frame
+  bw.Put(0, 2);  // frame_type
+  bw.Put(1, 1);  // show_frame
+  bw.Put(0, 1);  // disable_cdf_update
+  bw.Put(0, 1);  // allow_screen_content_tools
+  bw.Put(1, 1);  // frame_size_override_flag
+  bw.Put(0, 7);  // order_hint
+  bw.Put(width - 1, 11);
+  bw.Put(height - 1, 11);
+  bw.Put(0, 16);
+  return bw.Finish();
+}
+
+std::vector<uint8_t> MakeShowExistingFrameHeader(uint8_t mapIdx) {
+  BitWriter bw;
+  bw.Put(1, 1);  // show_existing_frame
+  bw.Put(mapIdx, 3);
+  return bw.Finish();
+}
+
+std::vector<uint8_t> MakeInterFrameHeader() {
+  BitWriter bw;
+  bw.Put(0, 1);
+  bw.Put(1, 2);  // frame_type
+  bw.Put(1, 1);
+  bw.Put(0, 1);  // error_resilient_mode
+  bw.Put(0, 1);
+  bw.Put(0, 1);
+  bw.Put(0, 1);
+  bw.Put(1, 7);
+  bw.Put(0, 3);  // primary_ref_frame
+  bw.Put(0x02, 8);
+  bw.Put(0, 16);
+  return bw.Finish();
+}
+
+void AppendObu(std::vector<uint8_t>* data,
+               uint8_t type,
+               const std::vector<uint8_t>& payload,
+               int temporalId = -1,
+               int spatialId = 0) {
+  bool extension = temporalId >= 0;
+  data->push_back((type << 3) | (extension ? 0x04 : 0) | 0x02);
+  if (extension) {
+    data->push_back((temporalId << 5) | (spatialId << 3));
+  }
+  size_t size = payload.size();
+  do {
+    data->push_back((size & 0x7f) | (size > 0x7f ? 0x80 : 0));
+    size >>= 7;
+  } while (size > 0);
+  data->insert(data->end(), payload.begin(), payload.end());
+}
+
+}  // namespace
+
+TEST(Av1UtilsTest, ObuReader) {
+  std::vector<uint8_t> data;
+  AppendObu(&data, kAv1ObuTemporalDelimiter, {});
+  AppendObu(&data, kAv1ObuPadding, std::vector<uint8_t>(200, 0xaa), 2, 1);
+  // the last OBU without obu_size
+  data.push_back(kAv1ObuTileGroup << 3);
+  data.push_back(0x12);
+  data.push_back(0x34);
+
+  Av1ObuReader reader(data.data(), data.size());
+  Av1Obu obu;
+  ASSERT_EQ(reader.next(&obu), OK);
+  EXPECT_EQ(obu.type, kAv1ObuTemporalDelimiter);
+  EXPECT_EQ(obu.size, 2u);
+  EXPECT_EQ(obu.payloadSize, 0u);
+  ASSERT_EQ(reader.next(&obu), OK);
+  EXPECT_EQ(obu.type, kAv1ObuPadding);
+  EXPECT_TRUE(obu.hasExtension);
+  EXPECT_EQ(obu.temporalId, 2);
+  EXPECT_EQ(obu.spatialId, 1);
+  EXPECT_EQ(obu.payloadSize, 200u);
+  EXPECT_EQ(obu.payload, data.data() + 2 + 2 + 2);
+  ASSERT_EQ(reader.next(&obu), OK);
+  EXPECT_EQ(obu.type, kAv1ObuTileGroup);
+  EXPECT_EQ(obu.payloadSize, 2u);
+  EXPECT_EQ(reader.next(&obu), ERROR_END_OF_STREAM);
+
+  // obu_size past the end
+  const uint8_t kTruncated[] = {kAv1ObuFrame << 3 | 0x02, 0x05, 0x00};
+  Av1ObuReader truncated(kTruncated, sizeof(kTruncated));
+  EXPECT_EQ(truncated.next(&obu), ERROR_MALFORMED);
+}
+
+TEST(Av1UtilsTest, SequenceHeader) {
+  std::vector<uint8_t> payload = MakeSequenceHeader();
+  Av1SequenceHeader header;
+  ASSERT_EQ(ParseAv1SequenceHeader(payload.data(), payload.size(), &header),
+            OK);
+  EXPECT_EQ(header.seqProfile, 0);
+  EXPECT_EQ(header.operatingPointsCnt, 2u);
+  EXPECT_EQ(header.operatingPointIdc[0], 0x103);
+  EXPECT_EQ(header.operatingPointIdc[1], 0x101);
+  EXPECT_EQ(header.seqLevelIdx[0], 8);
+  EXPECT_EQ(header.maxFrameWidth, 1280u);
+  EXPECT_EQ(header.maxFrameHeight, 720u);
+  EXPECT_EQ(header.orderHintBits, 7u);
+  EXPECT_EQ(header.forceScreenContentTools, 2u);
+  EXPECT_EQ(header.bitDepth, 8u);
+  EXPECT_FALSE(header.monoChrome);
+
+  EXPECT_EQ(ParseAv1SequenceHeader(payload.data(), 4, &header),
+            ERROR_MALFORMED);
+}
+
+TEST(Av1UtilsTest, TemporalUnits) {
+  std::vector<uint8_t> data;
+  AppendObu(&data, kAv1ObuTemporalDelimiter, {});
+  AppendObu(&data, kAv1ObuSequenceHeader, MakeSequenceHeader());
+  AppendObu(&data, kAv1ObuFrame, MakeKeyFrameHeader(640, 360), 0);
+  size_t second = data.size();
+  AppendObu(&data, kAv1ObuTemporalDelimiter, {});
+  AppendObu(&data, kAv1ObuFrameHeader, MakeInterFrameHeader(), 1);
+  AppendObu(&data, kAv1ObuTileGroup, {0x00, 0x11}, 1);
+
+  std::vector<Av1TemporalUnit> units;
+  ASSERT_EQ(SplitAv1TemporalUnits(data.data(), data.size(), &units), OK);
+  ASSERT_EQ(units.size(), 2u);
+  EXPECT_EQ(units[0].offset, 0u);
+  EXPECT_EQ(units[0].size, second);
+  EXPECT_EQ(units[1].offset, second);
+  EXPECT_EQ(units[1].size, data.size() - second);
+
+  // the units of an earlier sample are dropped
+  ASSERT_EQ(SplitAv1TemporalUnits(data.data() + second, data.size() - second,
+                                  &units),
+            OK);
+  ASSERT_EQ(units.size(), 1u);
+  EXPECT_EQ(units[0].offset, 0u);
+  EXPECT_EQ(units[0].size, data.size() - second);
+
+  Av1Parser parser;
+  Av1TemporalUnitInfo info;
+  // no sequence header yet, only the layer ids are known
+  ASSERT_EQ(parser.parseTemporalUnit(data.data() + second,
+                                     data.size() - second, &info),
+            OK);
+  EXPECT_TRUE(info.hasFrame);
+  EXPECT_FALSE(info.isKeyFrame);
+  EXPECT_EQ(info.temporalId, 1);
+  EXPECT_EQ(info.width, 0u);
+
+  ASSERT_EQ(parser.parseTemporalUnit(data.data(), second, &info), OK);
+  EXPECT_TRUE(info.hasSequenceHeader);
+  EXPECT_TRUE(info.isKeyFrame);
+  EXPECT_EQ(info.frameType, kAv1KeyFrame);
+  EXPECT_EQ(info.temporalId, 0);
+  EXPECT_EQ(info.width, 640u);
+  EXPECT_EQ(info.height, 360u);
+
+  ASSERT_EQ(parser.parseTemporalUnit(data.data() + second,
+                                     data.size() - second, &info),
+            OK);
+  EXPECT_FALSE(info.isKeyFrame);
+  EXPECT_EQ(info.frameType, kAv1InterFrame);
+  EXPECT_EQ(info.temporalId, 1);
+  EXPECT_EQ(info.spatialId, 0);
+  // inter frames keep the size of the sequence header
+  EXPECT_EQ(info.width, 1280u);
+  EXPECT_EQ(info.height, 720u);
+}
+
+TEST(Av1UtilsTest, ShowExistingFrame) {
+  Av1SequenceHeader sequenceHeader;
+  std::vector<uint8_t> sequence = MakeSequenceHeader();
+  ASSERT_EQ(ParseAv1SequenceHeader(sequence.data(), sequence.size(),
+                                   &sequenceHeader),
+            OK);
+  std::vector<uint8_t> payload = MakeShowExistingFrameHeader(3);
+  Av1Obu obu;
+  memset(&obu, 0, sizeof(obu));
+  obu.type = kAv1ObuFrameHeader;
+  obu.payload = payload.data();
+  obu.payloadSize = payload.size();
+  Av1FrameHeader header;
+  ASSERT_EQ(ParseAv1FrameHeader(sequenceHeader, obu, &header), OK);
+  EXPECT_TRUE(header.showExistingFrame);
+  EXPECT_EQ(header.frameToShowMapIdx, 3);
+  EXPECT_TRUE(header.showFrame);
+  EXPECT_FALSE(header.isKeyFrame());
+
+  // the temporal unit showing a hidden key frame is no sync point
+  std::vector<uint8_t> data;
+  AppendObu(&data, kAv1ObuTemporalDelimiter, {});
+  AppendObu(&data, kAv1ObuSequenceHeader, sequence);
+  AppendObu(&data, kAv1ObuFrameHeader, payload, 0);
+  Av1Parser parser;
+  Av1TemporalUnitInfo info;
+  ASSERT_EQ(parser.parseTemporalUnit(data.data(), data.size(), &info), OK);
+  EXPECT_TRUE(info.hasFrame);
+  EXPECT_FALSE(info.isKeyFrame);
+}
+
+TEST(Av1UtilsTest, SpatialLayers) {
+  std::vector<uint8_t> data;
+  AppendObu(&data, kAv1ObuTemporalDelimiter, {});
+  AppendObu(&data, kAv1ObuSequenceHeader, MakeSequenceHeader());
+  AppendObu(&data, kAv1ObuFrame, MakeKeyFrameHeader(640, 360), 0, 0);
+  AppendObu(&data, kAv1ObuFrame, MakeKeyFrameHeader(1280, 720), 0, 1);
+
+  Av1Parser parser;
+  Av1TemporalUnitInfo info;
+  ASSERT_EQ(parser.parseTemporalUnit(data.data(), data.size(), &info), OK);
+  EXPECT_TRUE(info.isKeyFrame);
+  EXPECT_EQ(info.spatialId, 0);
+  EXPECT_EQ(info.maxSpatialId, 1);
+  EXPECT_EQ(info.width, 1280u);
+  EXPECT_EQ(info.height, 720u);
+}
+
+}  // namespace ave
@@ -0,0 +1,328 @@
+/*
+ * avc_parameter_sets_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../avc_parameter_sets.h"
+#include "../media_errors.h"
+#include "bit_writer.h"
+
+namespace ave {
+
+namespace {
+
+// 320x240 baseline, 4 bit frame_num and 4 bit pic_order_cnt_lsb for type 0.
+// Type 1 cycles through reference frame offsets of 2 and 6, non-reference
+// pictures are 3 less.
+std::vector<uint8_t> MakeSps(uint32_t spsId, uint32_t pocType) {
+  BitWriter bw;
+  bw.Put(66, 8);  // profile_idc
+  bw.Put(0, 8);
+  bw.Put(30, 8);  // level_idc
+  bw.PutUE(spsId);
+  bw.PutUE(0);  // log2_max_frame_num_minus4
+  bw.PutUE(pocType);
+  if (pocType == 0) {
+    bw.PutUE(0);  // log2_max_pic_order_cnt_lsb_minus4
+  } else if (pocType == 1) {
+    bw.Put(0, 1);  // delta_pic_order_always_zero_flag
+    bw.PutSE(-3);  // offset_for_non_ref_pic
+    bw.PutSE(0);   // offset_for_top_to_bottom_field
+    bw.PutUE(2);   // num_ref_frames_in_pic_order_cnt_cycle
+    bw.PutSE(2);
+    bw.PutSE(6);
+  }
+  bw.PutUE(1);  // max_num_ref_frames
+  bw.Put(0, 1);
+  bw.PutUE(19);  // pic_width_in_mbs_minus1
+  bw.PutUE(14);  // pic_height_in_map_units_minus1
+  bw.Put(1, 1);  // frame_mbs_only_flag
+  bw.Put(1, 1);
+  bw.Put(0, 1);  // frame_cropping_flag
+  bw.Put(1, 1);  // vui_parameters_present_flag
+  bw.Put(1, 1);  // aspect_ratio_info_present_flag
+  bw.Put(1, 8);  // 1:1
+  return bw.FinishNAL({0x67});
+}
+
+std::vector<uint8_t> MakePps(uint32_t ppsId, uint32_t spsId) {
+  BitWriter bw;
+  bw.PutUE(ppsId);
+  bw.PutUE(spsId);
+  bw.Put(0, 2);
+  bw.PutUE(0);  // num_slice_groups_minus1
+  bw.PutUE(0);
+  bw.PutUE(0);
+  bw.Put(0, 3);
+  bw.PutSE(0);
+  bw.PutSE(0);
+  bw.PutSE(0);
+  bw.Put(4, 3);
+  return bw.FinishNAL({0x68});
+}
+
+struct Slice {
+  uint8_t nalRefIdc;
+  bool idr;
+  uint32_t sliceType;
+  uint32_t ppsId;
+  uint32_t frameNum;
+  uint32_t pocLsb;
+  uint32_t firstMb;
+  // delta_pic_order_cnt[0] of type 1
+  int32_t deltaPicOrderCnt = 0;
+  // memory_management_control_operation 5
+  bool mmco5 = false;
+};
+
+std::vector<uint8_t> MakeSlice(const Slice& s, uint32_t pocType) {
+  BitWriter bw;
+  bw.PutUE(s.firstMb);
+  bw.PutUE(s.sliceType + 5);
+  bw.PutUE(s.ppsId);
+  bw.Put(s.frameNum, 4);
+  if (s.idr) {
+    bw.PutUE(0);  // idr_pic_id
+  }
+  if (pocType == 0) {
+    bw.Put(s.pocLsb, 4);
+  } else if (pocType == 1) {
+    bw.PutSE(s.deltaPicOrderCnt);
+  }
+  if (s.nalRefIdc != 0 && !s.idr) {
+    if (s.sliceType == kAvcSliceTypeP) {
+      bw.Put(0, 2);  // no override, no list modification
+    }
+    bw.Put(s.mmco5, 1);  // adaptive_ref_pic_marking_mode_flag
+    if (s.mmco5) {
+      bw.PutUE(5);
+      bw.PutUE(0);
+    }
+  }
+  bw.PutSE(0);  // slice_qp_delta
+  uint8_t header = (s.nalRefIdc << 5) | (s.idr ? 5 : 1);
+  return bw.FinishNAL({header});
+}
+
+void Append(std::vector<uint8_t>* au, const std::vector<uint8_t>& nal) {
+  const uint8_t kStartCode[] = {0x00, 0x00, 0x00, 0x01};
+  au->insert(au->end(), kStartCode, kStartCode + sizeof(kStartCode));
+  au->insert(au->end(), nal.begin(), nal.end());
+}
+
+}  // namespace
+
+TEST(AvcParameterSetsTest, ParameterSets) {
+  AvcParameterSets sets;
+  auto sps = MakeSps(3, 0);
+  auto pps = MakePps(7, 3);
+  ASSERT_EQ(sets.addNalUnit(sps.data(), sps.size()), OK);
+  ASSERT_EQ(sets.addNalUnit(pps.data(), pps.size()), OK);
+
+  const AvcSps* parsedSps = sets.getSps(3);
+  ASSERT_NE(parsedSps, nullptr);
+  EXPECT_EQ(parsedSps->profileIdc, 66);
+  EXPECT_EQ(parsedSps->width, 320);
+  EXPECT_EQ(parsedSps->height, 240);
+  EXPECT_EQ(parsedSps->sarWidth, 1);
+  EXPECT_EQ(parsedSps->log2MaxFrameNum, 4u);
+  EXPECT_EQ(parsedSps->log2MaxPicOrderCntLsb, 4u);
+  const AvcPps* parsedPps = sets.getPps(7);
+  ASSERT_NE(parsedPps, nullptr);
+  EXPECT_EQ(parsedPps->spsId, 3u);
+  EXPECT_EQ(sets.getSps(0), nullptr);
+  EXPECT_EQ(sets.getPps(0), nullptr);
+
+  // a slice referring to a missing PPS
+  auto slice = MakeSlice({3, true, kAvcSliceTypeI, 1, 0, 0, 0}, 0);
+  AvcSliceHeader header;
+  EXPECT_EQ(sets.parseSliceHeader(slice.data(), slice.size(), &header),
+            ERROR_MALFORMED);
+
+  // truncated SPS
+  EXPECT_NE(sets.addNalUnit(sps.data(), 4), OK);
+}
+
+TEST(AvcParameterSetsTest, PicOrderCntType0) {
+  AvcParameterSets sets;
+  auto sps = MakeSps(0, 0);
+  auto pps = MakePps(0, 0);
+  ASSERT_EQ(sets.addNalUnit(sps.data(), sps.size()), OK);
+  ASSERT_EQ(sets.addNalUnit(pps.data(), pps.size()), OK);
+
+  const struct {
+    Slice slice;
+    bool first;
+    int32_t poc;
+  } kSlices[] = {
+      {{3, true, kAvcSliceTypeI, 0, 0, 0, 0}, true, 0},
+      {{3, true, kAvcSliceTypeI, 0, 0, 0, 40}, false, 0},
+      {{2, false, kAvcSliceTypeP, 0, 1, 8, 0}, true, 8},
+      {{0, false, kAvcSliceTypeP, 0, 2, 4, 0}, true, 4},
+      {{2, false, kAvcSliceTypeP, 0, 2, 14, 0}, true, 14},
+      // pic_order_cnt_lsb wraps around
+      {{2, false, kAvcSliceTypeP, 0, 3, 2, 0}, true, 18},
+      {{2, false, kAvcSliceTypeP, 0, 3, 2, 60}, false, 18},
+      {{3, true, kAvcSliceTypeI, 0, 0, 2, 0}, true, 2},
+  };
+  for (const auto& entry : kSlices) {
+    auto nal = MakeSlice(entry.slice, 0);
+    AvcSliceHeader header;
+    ASSERT_EQ(sets.parseSliceHeader(nal.data(), nal.size(), &header), OK);
+    EXPECT_EQ(header.frameNum, entry.slice.frameNum);
+    EXPECT_EQ(header.picOrderCntLsb, entry.slice.pocLsb);
+    EXPECT_EQ(header.firstMbInSlice, entry.slice.firstMb);
+    EXPECT_EQ(sets.addSlice(header), entry.first);
+    EXPECT_EQ(sets.picOrderCnt(), entry.poc);
+  }
+}
+
+TEST(AvcParameterSetsTest, PicOrderCntType1) {
+  AvcParameterSets sets;
+  auto sps = MakeSps(0, 1);
+  auto pps = MakePps(0, 0);
+  ASSERT_EQ(sets.addNalUnit(sps.data(), sps.size()), OK);
+  ASSERT_EQ(sets.addNalUnit(pps.data(), pps.size()), OK);
+  const AvcSps* parsedSps = sets.getSps(0);
+  ASSERT_NE(parsedSps, nullptr);
+  EXPECT_EQ(parsedSps->numRefFramesInPicOrderCntCycle, 2u);
+  EXPECT_EQ(parsedSps->offsetForRefFrame[1], 6);
+  EXPECT_EQ(parsedSps->offsetForNonRefPic, -3);
+
+  const struct {
+    Slice slice;
+    bool first;
+    int32_t poc;
+  } kSlices[] = {
+      {{3, true, kAvcSliceTypeI, 0, 0, 0, 0}, true, 0},
+      // the first and second offset of the first cycle
+      {{2, false, kAvcSliceTypeP, 0, 1, 0, 0}, true, 2},
+      {{2, false, kAvcSliceTypeP, 0, 2, 0, 0}, true, 8},
+      // a new cycle, moved by delta_pic_order_cnt[0]
+      {{2, false, kAvcSliceTypeP, 0, 3, 0, 0, 1}, true, 11},
+      {{2, false, kAvcSliceTypeP, 0, 3, 0, 60, 1}, false, 11},
+      // a non-reference picture counts as the reference frame before it
+      {{0, false, kAvcSliceTypeP, 0, 4, 0, 0}, true, 7},
+      {{2, false, kAvcSliceTypeP, 0, 4, 0, 0, -2}, true, 14},
+      // frame_num wraps around, FrameNumOffset grows by 16
+      {{2, false, kAvcSliceTypeP, 0, 1, 0, 0}, true, 66},
+  };
+  for (const auto& entry : kSlices) {
+    auto nal = MakeSlice(entry.slice, 1);
+    AvcSliceHeader header;
+    ASSERT_EQ(sets.parseSliceHeader(nal.data(), nal.size(), &header), OK);
+    EXPECT_EQ(header.deltaPicOrderCnt[0], entry.slice.deltaPicOrderCnt);
+    EXPECT_EQ(sets.addSlice(header), entry.first);
+    EXPECT_EQ(sets.picOrderCnt(), entry.poc);
+  }
+}
+
+TEST(AvcParameterSetsTest, Mmco5ResetsPicOrderCnt) {
+  // after memory_management_control_operation 5 the next picture counts
+  // from 0 again: pic_order_cnt_lsb 2 is 2, not 18, and frame_num 1 is not
+  // taken for a wrap around of frame_num
+  const struct {
+    uint32_t pocType;
+    int32_t pocs[4];
+  } kCases[] = {
+      {0, {0, 8, 12, 2}},
+      {2, {0, 2, 4, 2}},
+  };
+  for (const auto& entry : kCases) {
+    AvcParameterSets sets;
+    auto sps = MakeSps(0, entry.pocType);
+    auto pps = MakePps(0, 0);
+    ASSERT_EQ(sets.addNalUnit(sps.data(), sps.size()), OK);
+    ASSERT_EQ(sets.addNalUnit(pps.data(), pps.size()), OK);
+
+    const Slice kSlices[] = {
+        {3, true, kAvcSliceTypeI, 0, 0, 0, 0},
+        {2, false, kAvcSliceTypeP, 0, 1, 8, 0},
+        {2, false, kAvcSliceTypeP, 0, 2, 12, 0, 0, true},
+        {2, false, kAvcSliceTypeP, 0, 1, 2, 0},
+    };
+    for (size_t i = 0; i < 4; ++i) {
+      auto nal = MakeSlice(kSlices[i], entry.pocType);
+      AvcSliceHeader header;
+      ASSERT_EQ(sets.parseSliceHeader(nal.data(), nal.size(), &header), OK);
+      EXPECT_EQ(header.hasMmco5, kSlices[i].mmco5);
+      EXPECT_TRUE(sets.addSlice(header));
+      EXPECT_EQ(sets.picOrderCnt(), entry.pocs[i])
+          << "type " << entry.pocType << ", picture " << i;
+    }
+  }
+}
+
+TEST(AvcParameterSetsTest, AccessUnits) {
+  AvcParameterSets sets;
+  std::vector<uint8_t> au;
+  Append(&au, MakeSps(1, 2));
+  Append(&au, MakePps(2, 1));
+  Append(&au, MakeSlice({3, true, kAvcSliceTypeI, 2, 0, 0, 0}, 2));
+  Append(&au, MakeSlice({3, true, kAvcSliceTypeI, 2, 0, 0, 40}, 2));
+
+  AvcAccessUnitInfo info;
+  ASSERT_EQ(sets.parseAccessUnit(au.data(), au.size(), &info), OK);
+  EXPECT_TRUE(info.hasPicture);
+  EXPECT_TRUE(info.isIdr);
+  EXPECT_TRUE(info.isKeyFrame);
+  EXPECT_TRUE(info.isReference);
+  EXPECT_TRUE(info.startsNewPicture);
+  EXPECT_EQ(info.sliceType, static_cast<uint32_t>(kAvcSliceTypeI));
+  EXPECT_EQ(info.picOrderCnt, 0);
+
+  // type 2 order count follows frame_num, non-reference pictures go first
+  au.clear();
+  Append(&au, MakeSlice({2, false, kAvcSliceTypeP, 2, 1, 0, 0}, 2));
+  ASSERT_EQ(sets.parseAccessUnit(au.data(), au.size(), &info), OK);
+  EXPECT_FALSE(info.isKeyFrame);
+  EXPECT_TRUE(info.isReference);
+  EXPECT_EQ(info.picOrderCnt, 2);
+
+  au.clear();
+  Append(&au, MakeSlice({0, false, kAvcSliceTypeP, 2, 2, 0, 0}, 2));
+  ASSERT_EQ(sets.parseAccessUnit(au.data(), au.size(), &info), OK);
+  EXPECT_FALSE(info.isReference);
+  EXPECT_EQ(info.picOrderCnt, 3);
+
+  // an I picture with a recovery point is a key frame as well
+  au.clear();
+  const uint8_t kRecoveryPoint[] = {0x06, 0x06, 0x01, 0x84, 0x80};
+  Append(&au, std::vector<uint8_t>(kRecoveryPoint,
+                                   kRecoveryPoint + sizeof(kRecoveryPoint)));
+  Append(&au, MakeSlice({2, false, kAvcSliceTypeI, 2, 2, 0, 0}, 2));
+  ASSERT_EQ(sets.parseAccessUnit(au.data(), au.size(), &info), OK);
+  EXPECT_FALSE(info.isIdr);
+  EXPECT_TRUE(info.isKeyFrame);
+  EXPECT_EQ(info.picOrderCnt, 4);
+
+  // ... but not without one
+  au.clear();
+  Append(&au, MakeSlice({2, false, kAvcSliceTypeI, 2, 3, 0, 0}, 2));
+  ASSERT_EQ(sets.parseAccessUnit(au.data(), au.size(), &info), OK);
+  EXPECT_FALSE(info.isKeyFrame);
+  EXPECT_EQ(info.picOrderCnt, 6);
+
+  // the slice of the next picture ends the access unit without being taken
+  // into the order count state
+  au.clear();
+  Append(&au, MakeSlice({2, false, kAvcSliceTypeP, 2, 4, 0, 0}, 2));
+  std::vector<uint8_t> next;
+  Append(&next, MakeSlice({2, false, kAvcSliceTypeP, 2, 5, 0, 0}, 2));
+  au.insert(au.end(), next.begin(), next.end());
+  ASSERT_EQ(sets.parseAccessUnit(au.data(), au.size(), &info), OK);
+  EXPECT_EQ(info.frameNum, 4u);
+  EXPECT_EQ(info.picOrderCnt, 8);
+  ASSERT_EQ(sets.parseAccessUnit(next.data(), next.size(), &info), OK);
+  EXPECT_TRUE(info.startsNewPicture);
+  EXPECT_EQ(info.frameNum, 5u);
+  EXPECT_EQ(info.picOrderCnt, 10);
+}
+
+}  // namespace ave
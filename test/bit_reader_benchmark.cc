@@ -0,0 +1,156 @@
+/*
+ * bit_reader_benchmark.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../avc_utils.h"
+#include "../bit_reader.h"
+#include "../fast_bit_reader.h"
+#include "bit_writer.h"
+
+namespace ave {
+
+namespace {
+
+const size_t kNumCodes = 4 * 1024 * 1024;
+const int kRounds = 5;
+
+std::vector<uint8_t> AddEmulationPrevention(const std::vector<uint8_t>& rbsp) {
+  std::vector<uint8_t> out;
+  size_t zeros = 0;
+  for (uint8_t byte : rbsp) {
+    if (zeros >= 2 && byte <= 3) {
+      out.push_back(0x03);
+      zeros = 0;
+    }
+    out.push_back(byte);
+    zeros = byte == 0 ? zeros + 1 : 0;
+  }
+  return out;
+}
+
+struct Workload {
+  std::vector<uint8_t> rbsp;
+  std::vector<uint8_t> ebsp;
+  // whether each code is se(v)
+  std::vector<bool> signed_codes;
+};
+
+// SPS and slice header syntax is mostly small ue(v) ids and counts, se(v)
+// deltas and single bit flags.
+Workload MakeWorkload() {
+  std::mt19937 rng(1);
+  BitWriter writer;
+  Workload workload;
+  for (size_t i = 0; i < kNumCodes; i++) {
+    uint32_t r = rng() % 16;
+    if (r < 8) {
+      writer.PutUE(rng() % 4);
+    } else if (r < 12) {
+      writer.PutUE(rng() % 300);
+    } else {
+      writer.PutSE(static_cast<int32_t>(rng() % 64) - 32);
+    }
+    workload.signed_codes.push_back(r >= 12);
+    writer.Put(rng() & 1, 1);
+  }
+  workload.rbsp = writer.Finish();
+  workload.ebsp = AddEmulationPrevention(workload.rbsp);
+  return workload;
+}
+
+// parseUE() and parseSE() reading one bit at a time, for any reader.
+template <typename Reader>
+unsigned ParseUE(Reader* br) {
+  unsigned numZeroes = 0;
+  while (br->getBits(1) == 0) {
+    ++numZeroes;
+  }
+  unsigned x = br->getBits(numZeroes);
+  return x + (1u << numZeroes) - 1;
+}
+
+template <typename Reader>
+signed ParseSE(Reader* br) {
+  unsigned codeNum = ParseUE(br);
+  return (codeNum & 1) ? (codeNum + 1) / 2 : -signed(codeNum / 2);
+}
+
+template <typename Reader>
+void Measure(const char* name,
+             const std::vector<uint8_t>& data,
+             const std::vector<bool>& signed_codes,
+             unsigned (*parse_ue)(Reader*),
+             signed (*parse_se)(Reader*)) {
+  uint64_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < kRounds; round++) {
+    Reader br(data.data(), data.size());
+    for (size_t i = 0; i < kNumCodes; i++) {
+      checksum += signed_codes[i] ? parse_se(&br) : parse_ue(&br);
+      checksum += br.getBits(1);
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("%s: %.1f M codes/s (checksum %llu)\n", name,
+         kNumCodes * kRounds / seconds / 1e6,
+         static_cast<unsigned long long>(checksum / kRounds));
+}
+
+template <typename Reader>
+unsigned ParseUEBase(Reader* br) {
+  return parseUE(br);
+}
+
+template <typename Reader>
+signed ParseSEBase(Reader* br) {
+  return parseSE(br);
+}
+
+template <typename Reader>
+unsigned GetUE(Reader* br) {
+  return br->getUE();
+}
+
+template <typename Reader>
+signed GetSE(Reader* br) {
+  return br->getSE();
+}
+
+}  // namespace
+
+TEST(BitReaderBenchmark, ExpGolomb) {
+  Workload workload = MakeWorkload();
+  const auto& codes = workload.signed_codes;
+  Measure<BitReader>("BitReader bitwise", workload.rbsp, codes,
+                     ParseUE<BitReader>, ParseSE<BitReader>);
+  Measure<BitReader>("BitReader parseUE", workload.rbsp, codes,
+                     ParseUEBase<BitReader>, ParseSEBase<BitReader>);
+  Measure<FastRawBitReader>("FastRawBitReader bitwise", workload.rbsp, codes,
+                            ParseUE<FastRawBitReader>,
+                            ParseSE<FastRawBitReader>);
+  Measure<FastRawBitReader>("FastRawBitReader getUE", workload.rbsp, codes,
+                            GetUE<FastRawBitReader>, GetSE<FastRawBitReader>);
+  Measure<NALBitReader>("NALBitReader bitwise", workload.ebsp, codes,
+                        ParseUE<NALBitReader>, ParseSE<NALBitReader>);
+  Measure<NALBitReader>("NALBitReader parseUE", workload.ebsp, codes,
+                        ParseUEBase<NALBitReader>, ParseSEBase<NALBitReader>);
+  Measure<FastNALBitReader>("FastNALBitReader bitwise", workload.ebsp, codes,
+                            ParseUE<FastNALBitReader>,
+                            ParseSE<FastNALBitReader>);
+  Measure<FastNALBitReader>("FastNALBitReader getUE", workload.ebsp, codes,
+                            GetUE<FastNALBitReader>, GetSE<FastNALBitReader>);
+}
+
+}  // namespace ave
@@ -0,0 +1,70 @@
+/*
+ * bit_writer.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef TEST_BIT_WRITER_H
+#define TEST_BIT_WRITER_H
+
+#include <vector>
+
+#include "../rbsp.h"
+
+namespace ave {
+
+// Writes bitstreams for the parser tests, MSB first.
+class BitWriter {
+ public:
+  void Put(uint32_t value, size_t n) {
+    for (size_t i = n; i > 0; i--) {
+      current_ = (current_ << 1) | ((value >> (i - 1)) & 1);
+      if (++bits_ == 8) {
+        data_.push_back(current_);
+        current_ = 0;
+        bits_ = 0;
+      }
+    }
+  }
+
+  void PutUE(uint32_t value) {
+    uint32_t code = value + 1;
+    size_t len = 32 - __builtin_clz(code);
+    Put(0, len - 1);
+    Put(code, len);
+  }
+
+  void PutSE(int32_t value) {
+    PutUE(value > 0 ? 2 * value - 1 : -2 * value);
+  }
+
+  // Flushes, returns the RBSP.
+  std::vector<uint8_t> Finish() {
+    if (bits_ > 0) {
+      Put(0, 8 - bits_);
+    }
+    return data_;
+  }
+
+  // Adds rbsp_trailing_bits() and returns the NAL unit: |header| followed by
+  // the escaped payload.
+  std::vector<uint8_t> FinishNAL(const std::vector<uint8_t>& header) {
+    Put(1, 1);
+    std::vector<uint8_t> rbsp = Finish();
+    std::vector<uint8_t> nal(header);
+    nal.resize(header.size() + MaxEBSPSize(rbsp.size()));
+    uint8_t* payload = nal.data() + header.size();
+    nal.resize(header.size() + RBSPToEBSP(rbsp.data(), rbsp.size(), payload));
+    return nal;
+  }
+
+ private:
+  std::vector<uint8_t> data_;
+  uint8_t current_ = 0;
+  size_t bits_ = 0;
+};
+
+}  // namespace ave
+
+#endif /* !TEST_BIT_WRITER_H */
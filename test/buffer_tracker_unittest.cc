@@ -0,0 +1,154 @@
+/*
+ * buffer_tracker_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <set>
+#include <string>
+#include <thread>
+
+#include "test/gtest.h"
+
+#include "../buffer.h"
+#include "../buffer_tracker.h"
+#include "../media_buffer.h"
+#include "../media_packet.h"
+
+namespace ave {
+
+namespace {
+
+BufferTracker::TagStats FindTag(const std::string& tag) {
+  for (const auto& stats : BufferTracker::GetInstance().GetTagStats()) {
+    if (stats.tag == tag) {
+      return stats;
+    }
+  }
+  return {tag, 0, 0, 0, 0};
+}
+
+class BufferTrackerTest : public testing::Test {
+ protected:
+  void SetUp() override { BufferTracker::GetInstance().SetEnabled(true); }
+  void TearDown() override { BufferTracker::GetInstance().SetEnabled(false); }
+};
+
+}  // namespace
+
+TEST_F(BufferTrackerTest, Disabled) {
+  BufferTracker::GetInstance().SetEnabled(false);
+  auto buffer = std::make_shared<Buffer>(1024);
+  buffer->setTrackingTag("unittest-disabled");
+  EXPECT_EQ(FindTag("unittest-disabled").total_count, 0);
+}
+
+TEST_F(BufferTrackerTest, PerTagAccounting) {
+  {
+    auto first = std::make_shared<Buffer>(1000);
+    first->setTrackingTag("unittest-tag");
+    auto stats = FindTag("unittest-tag");
+    EXPECT_EQ(stats.live_bytes, 1000);
+    EXPECT_EQ(stats.live_count, 1);
+
+    {
+      auto second = std::make_shared<Buffer>(3000);
+      second->setTrackingTag("unittest-tag");
+      stats = FindTag("unittest-tag");
+      EXPECT_EQ(stats.live_bytes, 4000);
+      EXPECT_EQ(stats.live_count, 2);
+    }
+    stats = FindTag("unittest-tag");
+    EXPECT_EQ(stats.live_bytes, 1000);
+    EXPECT_EQ(stats.peak_bytes, 4000);
+  }
+
+  auto stats = FindTag("unittest-tag");
+  EXPECT_EQ(stats.live_bytes, 0);
+  EXPECT_EQ(stats.live_count, 0);
+  EXPECT_EQ(stats.peak_bytes, 4000);
+  EXPECT_EQ(stats.total_count, 2);
+}
+
+TEST_F(BufferTrackerTest, MediaPacketCopiesShareAccounting) {
+  MediaPacket packet = MediaPacket::Create(512);
+  packet.SetTrackingTag("unittest-packet");
+  {
+    MediaPacket copy = packet;
+    EXPECT_EQ(FindTag("unittest-packet").live_count, 1);
+  }
+  EXPECT_EQ(FindTag("unittest-packet").live_bytes, 512);
+
+  // growing the payload is accounted
+  packet.SetSize(2048);
+  EXPECT_EQ(FindTag("unittest-packet").live_bytes, 2048);
+}
+
+TEST_F(BufferTrackerTest, MediaBuffer) {
+  MediaBuffer media_buffer(std::make_shared<Buffer>(64));
+  media_buffer.setTrackingTag("unittest-media-buffer");
+  auto stats = FindTag("unittest-media-buffer");
+  EXPECT_EQ(stats.live_count, 1);
+  // payload is accounted to the Buffer
+  EXPECT_EQ(stats.live_bytes, 0);
+}
+
+TEST_F(BufferTrackerTest, SiteHistogram) {
+  auto buffer = std::make_shared<Buffer>(4096);
+  buffer->setTrackingTag("unittest-site");
+
+  bool found = false;
+  for (const auto& site : BufferTracker::GetInstance().GetSiteStats()) {
+    if (site.tag == "unittest-site") {
+      EXPECT_NE(site.site, nullptr);
+      EXPECT_EQ(site.live_bytes, 4096);
+      EXPECT_EQ(site.live_count, 1);
+      found = true;
+    }
+  }
+  EXPECT_TRUE(found);
+  EXPECT_NE(BufferTracker::GetInstance().Dump().find("unittest-site"),
+            std::string::npos);
+}
+
+TEST_F(BufferTrackerTest, FactoriesAccountTheCaller) {
+  auto first = Buffer::Create(16);
+  first->setTrackingTag("unittest-factory");
+  auto second = Buffer::CreateAsCopy(first->data(), first->size());
+  second->setTrackingTag("unittest-factory");
+  auto media_buffer = MediaBuffer::Create(first);
+  media_buffer->setTrackingTag("unittest-factory");
+
+  // every call above is a site of its own
+  std::set<const void*> sites;
+  for (const auto& site : BufferTracker::GetInstance().GetSiteStats()) {
+    if (site.tag == "unittest-factory") {
+      EXPECT_EQ(site.live_count, 1);
+      sites.insert(site.site);
+    }
+  }
+  EXPECT_EQ(sites.size(), 3u);
+}
+
+TEST_F(BufferTrackerTest, DumpLiveByThread) {
+  std::shared_ptr<Buffer> leaked;
+  std::thread::id thread_id;
+  std::thread thread([&]() {
+    leaked = std::make_shared<Buffer>(100);
+    leaked->setTrackingTag("unittest-live");
+    thread_id = std::this_thread::get_id();
+  });
+  thread.join();
+
+  auto& tracker = BufferTracker::GetInstance();
+  EXPECT_NE(tracker.DumpLive(thread_id).find("unittest-live"),
+            std::string::npos);
+  EXPECT_EQ(tracker.DumpLive(std::this_thread::get_id()).find("unittest-live"),
+            std::string::npos);
+
+  leaked.reset();
+  EXPECT_TRUE(tracker.DumpLive(thread_id).empty());
+}
+
+}  // namespace ave
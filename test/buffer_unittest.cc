@@ -0,0 +1,93 @@
+/*
+ * buffer_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "test/gtest.h"
+
+#include "../buffer.h"
+#include "../media_buffer.h"
+
+namespace ave {
+
+namespace {
+const size_t kCapacity = 128;
+}  // namespace
+
+TEST(BufferTest, SampleMetaWithoutMessage) {
+  auto buffer = std::make_shared<Buffer>(kCapacity);
+  EXPECT_EQ(buffer->sampleMeta().pts_us, -1);
+  EXPECT_FALSE(buffer->sampleMeta().sync);
+
+  buffer->sampleMeta().pts_us = 40000;
+  buffer->sampleMeta().dts_us = 0;
+  buffer->sampleMeta().sync = true;
+  buffer->sampleMeta().layer_id = 1;
+  EXPECT_FALSE(buffer->hasMeta());
+
+  const Buffer& const_buffer = *buffer;
+  EXPECT_EQ(const_buffer.sampleMeta().pts_us, 40000);
+  EXPECT_EQ(const_buffer.sampleMeta().layer_id, 1);
+}
+
+TEST(BufferTest, LazyMeta) {
+  auto buffer = std::make_shared<Buffer>(kCapacity);
+  EXPECT_FALSE(buffer->hasMeta());
+
+  auto meta = buffer->meta();
+  ASSERT_NE(meta, nullptr);
+  EXPECT_TRUE(buffer->hasMeta());
+  EXPECT_EQ(buffer->meta(), meta);
+}
+
+TEST(BufferTest, CopyMetaFrom) {
+  auto source = Buffer::Create(kCapacity);
+  source->sampleMeta().pts_us = 40000;
+  source->setInt32Data(3);
+  source->meta()->setInt32("key", 1);
+
+  auto buffer = Buffer::Create(kCapacity);
+  buffer->copyMetaFrom(*source);
+  EXPECT_EQ(buffer->sampleMeta().pts_us, 40000);
+  EXPECT_EQ(buffer->int32Data(), 3);
+  int32_t value = 0;
+  ASSERT_TRUE(buffer->hasMeta());
+  EXPECT_TRUE(buffer->meta()->findInt32("key", &value));
+  EXPECT_EQ(value, 1);
+  // a copy, not the same Message
+  EXPECT_NE(buffer->meta(), source->meta());
+
+  // the meta of a buffer without any is dropped
+  buffer->copyMetaFrom(*Buffer::Create(kCapacity));
+  EXPECT_EQ(buffer->sampleMeta().pts_us, -1);
+  EXPECT_EQ(buffer->int32Data(), 0);
+  EXPECT_FALSE(buffer->hasMeta());
+}
+
+TEST(MediaBufferTest, LazyMeta) {
+  MediaBuffer media_buffer(std::make_shared<Buffer>(kCapacity));
+  EXPECT_EQ(media_buffer.capacity(), kCapacity);
+  EXPECT_FALSE(media_buffer.hasMeta());
+
+  media_buffer.sampleMeta().eos = true;
+  EXPECT_FALSE(media_buffer.hasMeta());
+  EXPECT_TRUE(media_buffer.sampleMeta().eos);
+
+  ASSERT_NE(media_buffer.meta(), nullptr);
+  EXPECT_TRUE(media_buffer.hasMeta());
+}
+
+TEST(MediaBufferTest, SetMeta) {
+  MediaBuffer media_buffer(std::make_shared<Buffer>(kCapacity));
+  auto meta = std::make_shared<Message>();
+  // no meta allocated yet
+  media_buffer.setMeta(meta);
+  EXPECT_EQ(media_buffer.meta(), meta);
+
+  media_buffer.setMeta(nullptr);
+  EXPECT_FALSE(media_buffer.hasMeta());
+}
+
+}  // namespace ave
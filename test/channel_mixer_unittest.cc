@@ -0,0 +1,357 @@
+/*
+ * channel_mixer_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../channel_mixer.h"
+#include "../vector_math.h"
+
+namespace ave {
+
+namespace {
+
+const float kHalfPower = static_cast<float>(M_SQRT1_2);
+
+const vector_math::Impl kImpls[] = {
+    vector_math::Impl::kScalar,
+    vector_math::Impl::kSSE,
+    vector_math::Impl::kAVX2,
+    vector_math::Impl::kNEON,
+};
+
+std::vector<std::vector<float>> MakeMatrix(ChannelLayout input,
+                                           ChannelLayout output,
+                                           bool* remapping) {
+  ChannelMixingMatrix builder(input, ChannelLayoutToChannelCount(input),
+                              output, ChannelLayoutToChannelCount(output));
+  std::vector<std::vector<float>> matrix;
+  *remapping = builder.CreateTransformationMatrix(&matrix);
+  return matrix;
+}
+
+// The mixer output of |in|, |frames| interleaved float frames, computed in
+// double straight from the matrix.
+std::vector<double> ReferenceMix(const std::vector<std::vector<float>>& matrix,
+                                 const std::vector<float>& in,
+                                 size_t frames) {
+  size_t outputs = matrix.size();
+  size_t inputs = matrix[0].size();
+  std::vector<double> out(frames * outputs);
+  for (size_t i = 0; i < frames; i++) {
+    for (size_t o = 0; o < outputs; o++) {
+      double sum = 0;
+      for (size_t c = 0; c < inputs; c++) {
+        sum += matrix[o][c] * in[i * inputs + c];
+      }
+      out[i * outputs + o] = sum;
+    }
+  }
+  return out;
+}
+
+}  // namespace
+
+TEST(ChannelMixingMatrixTest, FiveOneToStereo) {
+  bool remapping = true;
+  auto matrix =
+      MakeMatrix(CHANNEL_LAYOUT_5_1, CHANNEL_LAYOUT_STEREO, &remapping);
+  EXPECT_FALSE(remapping);
+  // L R C LFE SL SR, the LFE is dropped
+  std::vector<std::vector<float>> expected = {
+      {1, 0, kHalfPower, 0, kHalfPower, 0},
+      {0, 1, kHalfPower, 0, 0, kHalfPower},
+  };
+  EXPECT_EQ(matrix, expected);
+}
+
+TEST(ChannelMixingMatrixTest, SevenOneToStereo) {
+  bool remapping = true;
+  auto matrix =
+      MakeMatrix(CHANNEL_LAYOUT_7_1, CHANNEL_LAYOUT_STEREO, &remapping);
+  EXPECT_FALSE(remapping);
+  // L R C LFE SL SR BL BR
+  std::vector<std::vector<float>> expected = {
+      {1, 0, kHalfPower, 0, kHalfPower, 0, kHalfPower, 0},
+      {0, 1, kHalfPower, 0, 0, kHalfPower, 0, kHalfPower},
+  };
+  EXPECT_EQ(matrix, expected);
+}
+
+TEST(ChannelMixingMatrixTest, MonoAndStereo) {
+  bool remapping = false;
+  auto matrix =
+      MakeMatrix(CHANNEL_LAYOUT_STEREO, CHANNEL_LAYOUT_MONO, &remapping);
+  EXPECT_FALSE(remapping);
+  EXPECT_EQ(matrix, (std::vector<std::vector<float>>{{0.5f, 0.5f}}));
+
+  matrix = MakeMatrix(CHANNEL_LAYOUT_MONO, CHANNEL_LAYOUT_STEREO, &remapping);
+  EXPECT_TRUE(remapping);
+  EXPECT_EQ(matrix, (std::vector<std::vector<float>>{{1}, {1}}));
+}
+
+TEST(ChannelMixingMatrixTest, BackToSide) {
+  // the back pair of 5.1 goes to the side pair of 7.1 unchanged
+  bool remapping = false;
+  auto matrix =
+      MakeMatrix(CHANNEL_LAYOUT_5_1_BACK, CHANNEL_LAYOUT_7_1, &remapping);
+  EXPECT_TRUE(remapping);
+  EXPECT_EQ(matrix[4][4], 1);
+  EXPECT_EQ(matrix[5][5], 1);
+  EXPECT_EQ(matrix[6], std::vector<float>(6, 0));
+  EXPECT_EQ(matrix[7], std::vector<float>(6, 0));
+}
+
+TEST(ChannelMixingMatrixTest, Discrete) {
+  ChannelMixingMatrix builder(CHANNEL_LAYOUT_DISCRETE, 3,
+                              CHANNEL_LAYOUT_STEREO, 2);
+  std::vector<std::vector<float>> matrix;
+  EXPECT_TRUE(builder.CreateTransformationMatrix(&matrix));
+  EXPECT_EQ(matrix, (std::vector<std::vector<float>>{{1, 0, 0}, {0, 1, 0}}));
+}
+
+TEST(ChannelMixerTest, Identity) {
+  ChannelMixer mixer(CHANNEL_LAYOUT_5_1, CHANNEL_LAYOUT_5_1);
+  EXPECT_TRUE(mixer.IsIdentity());
+
+  std::vector<int16_t> in(6 * 100);
+  for (size_t i = 0; i < in.size(); i++) {
+    in[i] = static_cast<int16_t>(i * 37);
+  }
+  std::vector<int16_t> out(in.size());
+  ASSERT_EQ(mixer.Transform(kAudioEncodingPcm16bit, in.data(), out.data(),
+                            100),
+            OK);
+  EXPECT_EQ(out, in);
+}
+
+TEST(ChannelMixerTest, Reorder) {
+  // L R C BC LFE into L R C LFE BL BR BC
+  ChannelMixer mixer(CHANNEL_LAYOUT_4_1, CHANNEL_LAYOUT_6_1_BACK);
+  EXPECT_TRUE(mixer.IsReorder());
+
+  const size_t frames = 3;
+  std::vector<int32_t> in;
+  for (size_t i = 0; i < frames; i++) {
+    for (int32_t ch = 0; ch < 5; ch++) {
+      in.push_back(static_cast<int32_t>(i * 10 + ch + 1));
+    }
+  }
+  std::vector<int32_t> out(frames * 7, -1);
+  ASSERT_EQ(mixer.Transform(kAudioEncodingPcm32bit, in.data(), out.data(),
+                            frames),
+            OK);
+  for (size_t i = 0; i < frames; i++) {
+    int32_t base = static_cast<int32_t>(i * 10);
+    std::vector<int32_t> expected = {base + 1, base + 2, base + 3, base + 5,
+                                     0,        0,        base + 4};
+    EXPECT_EQ(std::vector<int32_t>(out.begin() + i * 7,
+                                   out.begin() + (i + 1) * 7),
+              expected);
+  }
+
+  // planar
+  std::vector<std::vector<int32_t>> in_planes(5);
+  std::vector<std::vector<int32_t>> out_planes(7,
+                                               std::vector<int32_t>(frames));
+  std::vector<const void*> in_ptrs;
+  std::vector<void*> out_ptrs;
+  for (int ch = 0; ch < 5; ch++) {
+    for (size_t i = 0; i < frames; i++) {
+      in_planes[ch].push_back(in[i * 5 + ch]);
+    }
+    in_ptrs.push_back(in_planes[ch].data());
+  }
+  for (auto& plane : out_planes) {
+    out_ptrs.push_back(plane.data());
+  }
+  ASSERT_EQ(mixer.TransformPlanar(kAudioEncodingPcm32bit, in_ptrs.data(),
+                                  out_ptrs.data(), frames),
+            OK);
+  for (int ch = 0; ch < 7; ch++) {
+    for (size_t i = 0; i < frames; i++) {
+      EXPECT_EQ(out_planes[ch][i], out[i * 7 + ch]);
+    }
+  }
+}
+
+TEST(ChannelMixerTest, Downmix) {
+  const ChannelLayout kInputs[] = {CHANNEL_LAYOUT_5_1, CHANNEL_LAYOUT_7_1,
+                                   CHANNEL_LAYOUT_6_1};
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> dist(-0.3f, 0.3f);
+  // not a multiple of the block size
+  const size_t frames = 1000;
+
+  for (ChannelLayout layout : kInputs) {
+    ChannelMixer mixer(layout, CHANNEL_LAYOUT_STEREO);
+    EXPECT_FALSE(mixer.IsIdentity());
+    EXPECT_FALSE(mixer.IsReorder());
+    int channels = mixer.input_channels();
+
+    std::vector<float> in(frames * channels);
+    for (auto& sample : in) {
+      sample = dist(rng);
+    }
+    auto expected = ReferenceMix(mixer.matrix(), in, frames);
+
+    std::vector<float> out(frames * 2);
+    ASSERT_EQ(mixer.Transform(kAudioEncodingPcmFloat, in.data(), out.data(),
+                              frames),
+              OK);
+    for (size_t i = 0; i < out.size(); i++) {
+      ASSERT_NEAR(out[i], expected[i], 1e-6) << i;
+    }
+
+    // 16 and 32 bit at full scale, rounded to the nearest sample
+    std::vector<int16_t> in16(in.size());
+    std::vector<int32_t> in32(in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+      in16[i] = static_cast<int16_t>(lrintf(in[i] * 32768));
+      in32[i] = static_cast<int32_t>(lrintf(in[i] * 2147483648.0f));
+    }
+    std::vector<int16_t> out16(frames * 2);
+    std::vector<int32_t> out32(frames * 2);
+    ASSERT_EQ(mixer.Transform(kAudioEncodingPcm16bit, in16.data(),
+                              out16.data(), frames),
+              OK);
+    ASSERT_EQ(mixer.Transform(kAudioEncodingPcm32bit, in32.data(),
+                              out32.data(), frames),
+              OK);
+    for (size_t i = 0; i < out.size(); i++) {
+      ASSERT_NEAR(out16[i], expected[i] * 32768, 2) << i;
+      ASSERT_NEAR(out32[i], expected[i] * 2147483648.0, 2048) << i;
+    }
+
+    // planar gives the same samples
+    std::vector<std::vector<int16_t>> planes(channels);
+    std::vector<const void*> in_ptrs;
+    for (int ch = 0; ch < channels; ch++) {
+      for (size_t i = 0; i < frames; i++) {
+        planes[ch].push_back(in16[i * channels + ch]);
+      }
+      in_ptrs.push_back(planes[ch].data());
+    }
+    std::vector<int16_t> left(frames), right(frames);
+    void* out_ptrs[] = {left.data(), right.data()};
+    ASSERT_EQ(mixer.TransformPlanar(kAudioEncodingPcm16bit, in_ptrs.data(),
+                                    out_ptrs, frames),
+              OK);
+    for (size_t i = 0; i < frames; i++) {
+      ASSERT_EQ(left[i], out16[i * 2]);
+      ASSERT_EQ(right[i], out16[i * 2 + 1]);
+    }
+
+    std::vector<std::vector<float>> float_planes(channels);
+    in_ptrs.clear();
+    for (int ch = 0; ch < channels; ch++) {
+      for (size_t i = 0; i < frames; i++) {
+        float_planes[ch].push_back(in[i * channels + ch]);
+      }
+      in_ptrs.push_back(float_planes[ch].data());
+    }
+    std::vector<float> float_left(frames), float_right(frames);
+    void* float_out_ptrs[] = {float_left.data(), float_right.data()};
+    ASSERT_EQ(mixer.TransformPlanar(kAudioEncodingPcmFloat, in_ptrs.data(),
+                                    float_out_ptrs, frames),
+              OK);
+    for (size_t i = 0; i < frames; i++) {
+      ASSERT_EQ(float_left[i], out[i * 2]);
+      ASSERT_EQ(float_right[i], out[i * 2 + 1]);
+    }
+
+    // in place, left written over the right input before right is mixed
+    void* in_place_ptrs[] = {float_planes[1].data(), float_planes[0].data()};
+    ASSERT_EQ(mixer.TransformPlanar(kAudioEncodingPcmFloat, in_ptrs.data(),
+                                    in_place_ptrs, frames),
+              OK);
+    for (size_t i = 0; i < frames; i++) {
+      ASSERT_EQ(float_planes[1][i], out[i * 2]);
+      ASSERT_EQ(float_planes[0][i], out[i * 2 + 1]);
+    }
+  }
+}
+
+TEST(ChannelMixerTest, Saturation) {
+  ChannelMixer mixer(CHANNEL_LAYOUT_5_1, CHANNEL_LAYOUT_STEREO);
+  const int16_t in16[] = {32767, -32768, 32767, 32767, 32767, -32768};
+  int16_t out16[2];
+  ASSERT_EQ(mixer.Transform(kAudioEncodingPcm16bit, in16, out16, 1), OK);
+  EXPECT_EQ(out16[0], 32767);
+  // -32768 + 0.707 * 32767 - 0.707 * 32768
+  EXPECT_EQ(out16[1], -32768);
+
+  const int32_t in32[] = {INT32_MAX, INT32_MIN, INT32_MAX,
+                          0,         INT32_MAX, INT32_MIN};
+  int32_t out32[2];
+  ASSERT_EQ(mixer.Transform(kAudioEncodingPcm32bit, in32, out32, 1), OK);
+  EXPECT_EQ(out32[0], INT32_MAX);
+  EXPECT_EQ(out32[1], INT32_MIN);
+}
+
+TEST(ChannelMixerTest, UnsupportedEncoding) {
+  ChannelMixer mixer(CHANNEL_LAYOUT_5_1, CHANNEL_LAYOUT_STEREO);
+  uint8_t in[6] = {};
+  uint8_t out[2];
+  EXPECT_EQ(mixer.Transform(kAudioEncodingPcm8bit, in, out, 1),
+            ERROR_UNSUPPORTED);
+}
+
+TEST(VectorMathTest, AllImplementationsAgree) {
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  std::vector<float> src(1031);
+  std::vector<float> dest(src.size());
+  for (size_t i = 0; i < src.size(); i++) {
+    src[i] = dist(rng);
+    dest[i] = dist(rng);
+  }
+
+  for (vector_math::Impl impl : kImpls) {
+    vector_math::FMACProc fmac = vector_math::GetFMAC(impl);
+    vector_math::FMULProc fmul = vector_math::GetFMUL(impl);
+    vector_math::DotProductProc dot = vector_math::GetDotProduct(impl);
+    if (fmac == nullptr) {
+      EXPECT_EQ(fmul, nullptr);
+      EXPECT_EQ(dot, nullptr);
+      continue;
+    }
+    // unaligned starts and every tail length
+    for (size_t offset = 0; offset < 3; offset++) {
+      for (size_t len : {0, 1, 7, 8, 9, 31, 1024}) {
+        std::vector<float> mac = dest;
+        std::vector<float> mul = dest;
+        fmac(src.data() + offset, 0.75f, len, mac.data() + offset);
+        fmul(src.data() + offset, -1.5f, len, mul.data() + offset);
+        for (size_t i = 0; i < dest.size(); i++) {
+          bool in_range = i >= offset && i < offset + len;
+          float product = in_range ? src[i] * 0.75f : 0;
+          float expected_mac = dest[i] + product;
+          float expected_mul = in_range ? src[i] * -1.5f : dest[i];
+          // the compiler may fuse either side into a single rounding
+          ASSERT_NEAR(mac[i], expected_mac,
+                      1e-6f * (std::fabs(dest[i]) + std::fabs(product)))
+              << i;
+          ASSERT_FLOAT_EQ(mul[i], expected_mul) << i;
+        }
+        double expected_dot = 0;
+        for (size_t i = offset; i < offset + len; i++) {
+          expected_dot += static_cast<double>(src[i]) * dest[i];
+        }
+        // only the order of the additions differs
+        ASSERT_NEAR(dot(src.data() + offset, dest.data() + offset, len),
+                    expected_dot, 1e-4)
+            << len;
+      }
+    }
+  }
+}
+
+}  // namespace ave
@@ -0,0 +1,99 @@
+/*
+ * color_transform_benchmark.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../color_transform.h"
+#include "test_worker_pool.h"
+
+namespace ave {
+
+namespace {
+
+const uint32_t kWidth = 3840;
+const uint32_t kHeight = 2160;
+const int kFrames = 10;
+
+const struct {
+  ColorTransform::Impl impl;
+  const char* name;
+} kImpls[] = {
+    {ColorTransform::Impl::kScalar, "scalar"},
+    {ColorTransform::Impl::kAVX2, "AVX2"},
+    {ColorTransform::Impl::kNEON, "NEON"},
+};
+
+// Random 10 bit samples in the high bits of P010.
+std::vector<uint8_t> MakeFrame() {
+  std::mt19937 rng(1);
+  std::vector<uint16_t> samples(
+      FrameView::FrameSize(AV_PIX_FMT_P010LE, kWidth, kHeight) / 2);
+  for (auto& sample : samples) {
+    sample = static_cast<uint16_t>((64 + rng() % 877) << 6);
+  }
+  std::vector<uint8_t> data(samples.size() * 2);
+  memcpy(data.data(), samples.data(), data.size());
+  return data;
+}
+
+double FramesPerSecond(ColorTransform& transform,
+                       const FrameView& src,
+                       const FrameView& dst,
+                       WorkerPool* pool) {
+  // builds the LUT and warms up the caches
+  transform.Transform(src, dst, pool);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kFrames; i++) {
+    transform.Transform(src, dst, pool);
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return kFrames / seconds;
+}
+
+}  // namespace
+
+TEST(ColorTransformBenchmark, PqToSdr) {
+  ColorAspects pq = {ColorAspects::RangeLimited, ColorAspects::PrimariesBT2020,
+                     ColorAspects::TransferST2084, ColorAspects::MatrixBT2020};
+  ColorAspects sdr = {ColorAspects::RangeLimited,
+                      ColorAspects::PrimariesBT709_5,
+                      ColorAspects::TransferSMPTE170M,
+                      ColorAspects::MatrixBT709_5};
+  std::vector<uint8_t> in = MakeFrame();
+  std::vector<uint8_t> out(
+      FrameView::FrameSize(AV_PIX_FMT_NV12, kWidth, kHeight));
+  FrameView src = FrameView::Create(in.data(), in.size(), AV_PIX_FMT_P010LE,
+                                    kWidth, kHeight);
+  FrameView dst = FrameView::Create(out.data(), out.size(), AV_PIX_FMT_NV12,
+                                    kWidth, kHeight);
+
+  ColorTransform transform(pq, sdr, kWidth, kHeight);
+  for (const auto& impl : kImpls) {
+    if (transform.SetImplForTesting(impl.impl) != OK) {
+      continue;
+    }
+    double single = FramesPerSecond(transform, src, dst, nullptr);
+    double threaded;
+    {
+      TestWorkerPool pool(3);
+      threaded = FramesPerSecond(transform, src, dst, &pool);
+    }
+    printf("P010 PQ to NV12 SDR %-8s %6.1f 2160p frames/s, %6.1f with 4 "
+           "threads\n",
+           impl.name, single, threaded);
+  }
+}
+
+}  // namespace ave
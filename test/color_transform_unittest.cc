@@ -0,0 +1,434 @@
+/*
+ * color_transform_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../color_transform.h"
+#include "../media_packet.h"
+#include "test_frame.h"
+#include "test_worker_pool.h"
+
+namespace ave {
+
+namespace {
+
+const ColorTransform::Impl kImpls[] = {
+    ColorTransform::Impl::kScalar,
+    ColorTransform::Impl::kAVX2,
+    ColorTransform::Impl::kNEON,
+};
+
+ColorAspects MakeAspects(ColorAspects::Primaries primaries,
+                         ColorAspects::Transfer transfer,
+                         ColorAspects::MatrixCoeffs matrix,
+                         ColorAspects::Range range) {
+  ColorAspects aspects;
+  aspects.mRange = range;
+  aspects.mPrimaries = primaries;
+  aspects.mTransfer = transfer;
+  aspects.mMatrixCoeffs = matrix;
+  return aspects;
+}
+
+const ColorAspects kSdr =
+    MakeAspects(ColorAspects::PrimariesBT709_5,
+                ColorAspects::TransferSMPTE170M,
+                ColorAspects::MatrixBT709_5, ColorAspects::RangeLimited);
+const ColorAspects kPq =
+    MakeAspects(ColorAspects::PrimariesBT2020, ColorAspects::TransferST2084,
+                ColorAspects::MatrixBT2020, ColorAspects::RangeLimited);
+const ColorAspects kHlg =
+    MakeAspects(ColorAspects::PrimariesBT2020, ColorAspects::TransferHLG,
+                ColorAspects::MatrixBT2020, ColorAspects::RangeLimited);
+
+HDRStaticInfo MakeHdrInfo(uint16_t max_display, uint16_t max_content) {
+  HDRStaticInfo info;
+  memset(&info, 0, sizeof(info));
+  info.mID = HDRStaticInfo::kType1;
+  info.sType1.mMaxDisplayLuminance = max_display;
+  info.sType1.mMaxContentLightLevel = max_content;
+  return info;
+}
+
+// A 4:2:0 test frame with access to its samples by channel.
+struct Frame : public TestFrame {
+  using TestFrame::TestFrame;
+
+  // The sample of |channel| 0 (Y), 1 (Cb) or 2 (Cr) at |x|, |y| of its
+  // plane.
+  uint8_t* Sample(int channel, uint32_t x, uint32_t y) const {
+    if (channel == 0 || view.num_planes() == 3) {
+      const FrameView::Plane& plane = view.plane(channel);
+      return plane.row(y) + x * plane.col_inc;
+    }
+    const FrameView::Plane& plane = view.plane(1);
+    bool second = (channel == 2) != (view.format() == AV_PIX_FMT_NV21);
+    return plane.row(y) + x * plane.col_inc +
+           (second ? BytesPerPixel(view.format()) : 0);
+  }
+
+  int Get(int channel, uint32_t x, uint32_t y) const {
+    const uint8_t* p = Sample(channel, x, y);
+    switch (view.format()) {
+      case AV_PIX_FMT_P010LE:
+        return (p[0] | p[1] << 8) >> 6;
+      case AV_PIX_FMT_YUV420P10LE:
+        return p[0] | p[1] << 8;
+      default:
+        return p[0];
+    }
+  }
+
+  void Set(int channel, uint32_t x, uint32_t y, int value) {
+    uint8_t* p = Sample(channel, x, y);
+    switch (view.format()) {
+      case AV_PIX_FMT_P010LE:
+        value <<= 6;
+        p[0] = static_cast<uint8_t>(value);
+        p[1] = static_cast<uint8_t>(value >> 8);
+        break;
+      case AV_PIX_FMT_YUV420P10LE:
+        p[0] = static_cast<uint8_t>(value);
+        p[1] = static_cast<uint8_t>(value >> 8);
+        break;
+      default:
+        p[0] = static_cast<uint8_t>(value);
+        break;
+    }
+  }
+
+  void FillFlat(int y, int u, int v) {
+    for (uint32_t row = 0; row < view.height(); row++) {
+      for (uint32_t x = 0; x < view.width(); x++) {
+        Set(0, x, row, y);
+      }
+    }
+    for (uint32_t row = 0; row < (view.height() + 1) / 2; row++) {
+      for (uint32_t x = 0; x < (view.width() + 1) / 2; x++) {
+        Set(1, x, row, u);
+        Set(2, x, row, v);
+      }
+    }
+  }
+
+  // Random samples in [|low|, |high|].
+  void Fill(uint32_t seed, int low, int high) {
+    auto next = [&seed, low, high]() {
+      return low +
+             static_cast<int>((NextTestRandom(&seed) >> 8) % (high - low + 1));
+    };
+    for (uint32_t row = 0; row < view.height(); row++) {
+      for (uint32_t x = 0; x < view.width(); x++) {
+        Set(0, x, row, next());
+      }
+    }
+    for (uint32_t row = 0; row < (view.height() + 1) / 2; row++) {
+      for (uint32_t x = 0; x < (view.width() + 1) / 2; x++) {
+        Set(1, x, row, next());
+        Set(2, x, row, next());
+      }
+    }
+  }
+
+};
+
+// Y, Cb and Cr of a flat frame converted from |y|, |u|, |v|.
+void ConvertFlat(ColorTransform& transform,
+                 PixelFormat from,
+                 PixelFormat to,
+                 int y,
+                 int u,
+                 int v,
+                 int out[3]) {
+  Frame src(from, 6, 4);
+  src.FillFlat(y, u, v);
+  Frame dst(to, 6, 4);
+  ASSERT_EQ(transform.Transform(src.view, dst.view), OK);
+  for (int c = 0; c < 3; c++) {
+    out[c] = dst.Get(c, 1, 1);
+  }
+}
+
+}  // namespace
+
+TEST(ColorTransformTest, SameAspectsKeepPixels) {
+  ColorTransform transform(kSdr, kSdr, 1920, 1080);
+  ASSERT_EQ(transform.InitCheck(), OK);
+  EXPECT_FALSE(transform.tone_mapping());
+  for (PixelFormat format : {AV_PIX_FMT_YUV420P, AV_PIX_FMT_P010LE}) {
+    const int scale = format == AV_PIX_FMT_P010LE ? 4 : 1;
+    // chroma shared by the whole frame, it is averaged over the 2x2 blocks
+    Frame src(format, 40, 12, 6);
+    src.Fill(5, 16 * scale, 235 * scale);
+    for (uint32_t y = 0; y < 6; y++) {
+      for (uint32_t x = 0; x < 20; x++) {
+        src.Set(1, x, y, 100 * scale);
+        src.Set(2, x, y, 150 * scale);
+      }
+    }
+    Frame dst(format, 40, 12);
+    ASSERT_EQ(transform.Transform(src.view, dst.view), OK);
+    for (uint32_t y = 0; y < 12; y++) {
+      for (uint32_t x = 0; x < 40; x++) {
+        ASSERT_NEAR(dst.Get(0, x, y), src.Get(0, x, y), 1) << x << "," << y;
+      }
+    }
+    for (uint32_t y = 0; y < 6; y++) {
+      for (uint32_t x = 0; x < 20; x++) {
+        ASSERT_NEAR(dst.Get(1, x, y), 100 * scale, 1);
+        ASSERT_NEAR(dst.Get(2, x, y), 150 * scale, 1);
+      }
+    }
+  }
+}
+
+TEST(ColorTransformTest, RangeAndBitDepth) {
+  ColorAspects full = kSdr;
+  full.mRange = ColorAspects::RangeFull;
+  ColorTransform expand(kSdr, full, 1920, 1080);
+  int out[3];
+  ConvertFlat(expand, AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, 16, 128, 128, out);
+  EXPECT_EQ(out[0], 0);
+  EXPECT_EQ(out[1], 128);
+  EXPECT_EQ(out[2], 128);
+  ConvertFlat(expand, AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, 235, 128, 128, out);
+  EXPECT_EQ(out[0], 255);
+  ConvertFlat(expand, AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, 126, 16, 240, out);
+  // (126 - 16) * 255 / 219 and (x - 128) * 255 / 224 + 128
+  EXPECT_NEAR(out[0], 128, 1);
+  EXPECT_NEAR(out[1], 1, 1);
+  EXPECT_NEAR(out[2], 255, 1);
+
+  ColorTransform same(kSdr, kSdr, 1920, 1080);
+  ConvertFlat(same, AV_PIX_FMT_NV21, AV_PIX_FMT_YUV420P10LE, 235, 16, 240,
+              out);
+  EXPECT_NEAR(out[0], 940, 1);
+  EXPECT_NEAR(out[1], 64, 1);
+  EXPECT_NEAR(out[2], 960, 1);
+}
+
+TEST(ColorTransformTest, Primaries) {
+  ColorAspects bt2020 = kSdr;
+  bt2020.mPrimaries = ColorAspects::PrimariesBT2020;
+  bt2020.mMatrixCoeffs = ColorAspects::MatrixBT2020;
+  ColorTransform transform(bt2020, kSdr, 1920, 1080);
+  EXPECT_FALSE(transform.tone_mapping());
+
+  int out[3];
+  ConvertFlat(transform, AV_PIX_FMT_P010LE, AV_PIX_FMT_NV12, 502, 512, 512,
+              out);
+  EXPECT_NEAR(out[0], 126, 1);
+  EXPECT_NEAR(out[1], 128, 1);
+  EXPECT_NEAR(out[2], 128, 1);
+
+  // BT.2020 red is out of the BT.709 gamut and clipped to its red
+  const double kr = 0.2627;
+  const double kb = 0.0593;
+  int y = static_cast<int>(64 + 876 * kr + 0.5);
+  int u = static_cast<int>(512 - 896 * kr / (2 * (1 - kb)) + 0.5);
+  ConvertFlat(transform, AV_PIX_FMT_P010LE, AV_PIX_FMT_NV12, y, u, 960, out);
+  EXPECT_NEAR(out[0], 16 + 219 * 0.2126, 1);
+  EXPECT_NEAR(out[1], 128 - 224 * 0.2126 / (2 * (1 - 0.0722)), 1);
+  EXPECT_NEAR(out[2], 240, 1);
+}
+
+TEST(ColorTransformTest, PqToSdr) {
+  HDRStaticInfo info = MakeHdrInfo(1000, 0);
+  ColorTransform transform(kPq, kSdr, 3840, 2160, &info);
+  ASSERT_EQ(transform.InitCheck(), OK);
+  EXPECT_TRUE(transform.tone_mapping());
+
+  int out[3];
+  ConvertFlat(transform, AV_PIX_FMT_P010LE, AV_PIX_FMT_NV12, 64, 512, 512,
+              out);
+  EXPECT_EQ(out[0], 16);
+  EXPECT_EQ(out[1], 128);
+  EXPECT_EQ(out[2], 128);
+  // 1000 cd/m^2, the peak, is SDR white
+  ConvertFlat(transform, AV_PIX_FMT_P010LE, AV_PIX_FMT_NV12, 723, 512, 512,
+              out);
+  EXPECT_NEAR(out[0], 235, 1);
+  EXPECT_NEAR(out[1], 128, 1);
+  EXPECT_NEAR(out[2], 128, 1);
+  const int white = out[0];
+
+  // the tone curve keeps the order of the grey levels
+  int last = 0;
+  for (int y = 64; y <= 940; y += 4) {
+    ConvertFlat(transform, AV_PIX_FMT_P010LE, AV_PIX_FMT_NV12, y, 512, 512,
+                out);
+    ASSERT_GE(out[0], last) << y;
+    last = out[0];
+  }
+
+  // brighter content is compressed more
+  HDRStaticInfo bright = MakeHdrInfo(4000, 4000);
+  ColorTransform bright_transform(kPq, kSdr, 3840, 2160, &bright);
+  ConvertFlat(bright_transform, AV_PIX_FMT_P010LE, AV_PIX_FMT_NV12, 723, 512,
+              512, out);
+  EXPECT_LT(out[0], white);
+}
+
+TEST(ColorTransformTest, HlgAndSdrToPq) {
+  ColorTransform hlg(kHlg, kSdr, 3840, 2160);
+  EXPECT_TRUE(hlg.tone_mapping());
+  int out[3];
+  ConvertFlat(hlg, AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P, 940, 512, 512,
+              out);
+  EXPECT_NEAR(out[0], 235, 1);
+  EXPECT_NEAR(out[1], 128, 1);
+  EXPECT_NEAR(out[2], 128, 1);
+  ConvertFlat(hlg, AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P, 64, 512, 512,
+              out);
+  EXPECT_EQ(out[0], 16);
+
+  // SDR white at 203 cd/m^2, 0.5806 in PQ
+  ColorTransform pq(kSdr, kPq, 1920, 1080);
+  EXPECT_FALSE(pq.tone_mapping());
+  ConvertFlat(pq, AV_PIX_FMT_YUV420P, AV_PIX_FMT_P010LE, 235, 128, 128, out);
+  EXPECT_NEAR(out[0], 64 + 876 * 0.5806, 1);
+  EXPECT_NEAR(out[1], 512, 1);
+  EXPECT_NEAR(out[2], 512, 1);
+}
+
+TEST(ColorTransformTest, ImplementationsAgree) {
+  const struct {
+    PixelFormat from;
+    PixelFormat to;
+    uint32_t width;
+    uint32_t height;
+  } kCases[] = {
+      {AV_PIX_FMT_P010LE, AV_PIX_FMT_NV12, 67, 41},
+      {AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P, 64, 36},
+      {AV_PIX_FMT_NV21, AV_PIX_FMT_P010LE, 35, 9},
+      {AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P, 7, 3},
+  };
+  HDRStaticInfo info = MakeHdrInfo(1000, 600);
+  ColorTransform transform(kPq, kSdr, 3840, 2160, &info);
+  for (const auto& c : kCases) {
+    Frame src(c.from, c.width, c.height, 4);
+    src.Fill(c.width, 0, Frame::BytesPerPixel(c.from) == 2 ? 1023 : 255);
+    ASSERT_EQ(transform.SetImplForTesting(ColorTransform::Impl::kScalar), OK);
+    Frame expected(c.to, c.width, c.height);
+    ASSERT_EQ(transform.Transform(src.view, expected.view), OK);
+    for (auto impl : kImpls) {
+      if (transform.SetImplForTesting(impl) != OK) {
+        continue;
+      }
+      Frame dst(c.to, c.width, c.height);
+      ASSERT_EQ(transform.Transform(src.view, dst.view), OK);
+      EXPECT_EQ(dst.data, expected.data)
+          << "impl " << static_cast<int>(impl) << " " << c.from << " to "
+          << c.to;
+    }
+  }
+}
+
+// The bits a 10 bit format leaves unused, 10 to 15 of YUV420P10LE and 0 to 5
+// of P010, do not change the output, also not in the vector implementations.
+TEST(ColorTransformTest, UnusedBitsAreIgnored) {
+  HDRStaticInfo info = MakeHdrInfo(1000, 600);
+  ColorTransform transform(kPq, kSdr, 3840, 2160, &info);
+  for (PixelFormat format : {AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE}) {
+    Frame src(format, 37, 21, 4);
+    src.TestFrame::Fill(17);
+    Frame clean(format, 37, 21, 4);
+    // the view points into the buffer, copy into it
+    std::copy(src.data.begin(), src.data.end(), clean.data.begin());
+    const uint8_t mask[2] = {
+        static_cast<uint8_t>(format == AV_PIX_FMT_P010LE ? 0xc0 : 0xff),
+        static_cast<uint8_t>(format == AV_PIX_FMT_P010LE ? 0xff : 0x03)};
+    for (size_t i = 0; i < clean.data.size(); i++) {
+      clean.data[i] &= mask[i % 2];
+    }
+    ASSERT_EQ(transform.SetImplForTesting(ColorTransform::Impl::kScalar), OK);
+    Frame expected(AV_PIX_FMT_NV12, 37, 21);
+    ASSERT_EQ(transform.Transform(clean.view, expected.view), OK);
+    for (auto impl : kImpls) {
+      if (transform.SetImplForTesting(impl) != OK) {
+        continue;
+      }
+      Frame dst(AV_PIX_FMT_NV12, 37, 21);
+      ASSERT_EQ(transform.Transform(src.view, dst.view), OK);
+      EXPECT_EQ(dst.data, expected.data)
+          << "impl " << static_cast<int>(impl) << " " << format;
+    }
+  }
+}
+
+TEST(ColorTransformTest, PoolGivesSameFrame) {
+  TestWorkerPool pool(3);
+  ColorTransform transform(kHlg, kSdr, 3840, 2160);
+  Frame src(AV_PIX_FMT_P010LE, 320, 181);
+  src.Fill(9, 64, 940);
+  Frame expected(AV_PIX_FMT_NV12, 320, 181);
+  Frame dst(AV_PIX_FMT_NV12, 320, 181);
+  ASSERT_EQ(transform.Transform(src.view, expected.view), OK);
+  ASSERT_EQ(transform.Transform(src.view, dst.view, &pool), OK);
+  EXPECT_EQ(dst.data, expected.data);
+}
+
+TEST(ColorTransformTest, Errors) {
+  ColorTransform transform(kPq, kSdr, 1920, 1080);
+  Frame src(AV_PIX_FMT_P010LE, 16, 16);
+  Frame small(AV_PIX_FMT_NV12, 16, 8);
+  EXPECT_EQ(transform.Transform(src.view, small.view), BAD_VALUE);
+  EXPECT_EQ(transform.Transform(src.view, FrameView()), BAD_VALUE);
+
+  std::vector<uint8_t> rgba(FrameView::FrameSize(AV_PIX_FMT_RGBA, 16, 16));
+  FrameView rgba_view = FrameView::Create(rgba.data(), rgba.size(),
+                                          AV_PIX_FMT_RGBA, 16, 16);
+  EXPECT_EQ(transform.Transform(src.view, rgba_view), ERROR_UNSUPPORTED);
+}
+
+TEST(ColorTransformTest, MediaPacket) {
+  const int16_t kWidth = 64;
+  const int16_t kHeight = 36;
+  const int16_t kStride = 160;
+  MediaPacket src = MediaPacket::Create(
+      FrameView::FrameSize(AV_PIX_FMT_P010LE, kWidth, kHeight, kStride));
+  src.SetMediaType(MediaType::VIDEO);
+  src.video_info()->width = kWidth;
+  src.video_info()->height = kHeight;
+  src.video_info()->stride = kStride;
+  src.video_info()->pixel_format = AV_PIX_FMT_P010LE;
+  src.video_info()->timestamp_us = 40000;
+  // black, 64 << 6, and neutral chroma, 512 << 6
+  FrameView view = FrameView::Create(src);
+  for (uint32_t y = 0; y < kHeight; y++) {
+    uint16_t* row = reinterpret_cast<uint16_t*>(view.plane(0).row(y));
+    std::fill(row, row + kWidth, 64 << 6);
+  }
+  for (uint32_t y = 0; y < kHeight / 2; y++) {
+    uint16_t* row = reinterpret_cast<uint16_t*>(view.plane(1).row(y));
+    std::fill(row, row + kWidth, 512 << 6);
+  }
+
+  MediaPacket dst = MediaPacket::Create(16);
+  dst.SetMediaType(MediaType::VIDEO);
+  dst.video_info()->pixel_format = AV_PIX_FMT_NV12;
+
+  ColorTransform transform(kPq, kSdr, kWidth, kHeight);
+  ASSERT_EQ(transform.Transform(src, dst), OK);
+  EXPECT_EQ(dst.size(),
+            FrameView::FrameSize(AV_PIX_FMT_NV12, kWidth, kHeight));
+  EXPECT_EQ(dst.video_info()->width, kWidth);
+  EXPECT_EQ(dst.video_info()->timestamp_us, 40000);
+  EXPECT_EQ(dst.video_info()->pixel_format, AV_PIX_FMT_NV12);
+  EXPECT_EQ(dst.data()[0], 16);
+  EXPECT_EQ(dst.data()[dst.size() - 1], 128);
+
+  dst.video_info()->pixel_format = AV_PIX_FMT_RGBA;
+  EXPECT_EQ(transform.Transform(src, dst), ERROR_UNSUPPORTED);
+}
+
+}  // namespace ave
@@ -0,0 +1,250 @@
+/*
+ * color_utils_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "test/gtest.h"
+
+#include "../color_utils.h"
+
+namespace ave {
+
+namespace {
+typedef ColorAspects CA;
+typedef ColorUtils CU;
+
+ColorAspects MakeAspects(uint32_t range,
+                         uint32_t primaries,
+                         uint32_t transfer,
+                         uint32_t coeffs) {
+  ColorAspects aspects;
+  aspects.mRange = static_cast<CA::Range>(range);
+  aspects.mPrimaries = static_cast<CA::Primaries>(primaries);
+  aspects.mTransfer = static_cast<CA::Transfer>(transfer);
+  aspects.mMatrixCoeffs = static_cast<CA::MatrixCoeffs>(coeffs);
+  return aspects;
+}
+
+// the packed conversions must match the ones of the unpacked aspects
+void ExpectPackedMatches(const ColorAspects& aspects) {
+  uint32_t packed = 0;
+  ASSERT_EQ(OK, CU::packToU32Checked(aspects, &packed));
+  EXPECT_EQ(packed, CU::packToU32(aspects));
+
+  int32_t range, standard, transfer;
+  EXPECT_EQ(OK, CU::convertCodecColorAspectsToPlatformAspects(
+                    aspects, &range, &standard, &transfer));
+  int32_t packed_range, packed_standard, packed_transfer;
+  CU::convertPackedCodecColorAspectsToPlatformAspects(
+      packed, &packed_range, &packed_standard, &packed_transfer);
+  EXPECT_EQ(range, packed_range);
+  EXPECT_EQ(standard, packed_standard);
+  EXPECT_EQ(transfer, packed_transfer);
+
+  int32_t primaries, iso_transfer, coeffs;
+  bool full_range;
+  CU::convertCodecColorAspectsToIsoAspects(aspects, &primaries, &iso_transfer,
+                                           &coeffs, &full_range);
+  int32_t packed_primaries, packed_iso_transfer, packed_coeffs;
+  bool packed_full_range;
+  CU::convertPackedCodecColorAspectsToIsoAspects(
+      packed, &packed_primaries, &packed_iso_transfer, &packed_coeffs,
+      &packed_full_range);
+  EXPECT_EQ(primaries, packed_primaries);
+  EXPECT_EQ(iso_transfer, packed_iso_transfer);
+  EXPECT_EQ(coeffs, packed_coeffs);
+  EXPECT_EQ(full_range, packed_full_range);
+}
+}  // namespace
+
+TEST(ColorUtilsTest, WrapsIntoPlatformAspects) {
+  EXPECT_EQ(CU::kColorStandardBT709,
+            CU::wrapColorAspectsIntoColorStandard(CA::PrimariesBT709_5,
+                                                  CA::MatrixBT709_5));
+  EXPECT_EQ(CU::kColorStandardFilm,
+            CU::wrapColorAspectsIntoColorStandard(CA::PrimariesGenericFilm,
+                                                  CA::MatrixBT2020));
+  EXPECT_EQ(CU::kColorStandardBT2020Constant,
+            CU::wrapColorAspectsIntoColorStandard(CA::PrimariesBT2020,
+                                                  CA::MatrixBT2020Constant));
+  // defined but without a platform standard
+  EXPECT_EQ(static_cast<int32_t>(CU::kColorStandardExtendedStart +
+                                 CA::PrimariesBT709_5 +
+                                 CA::MatrixBT601_6 * (CA::PrimariesBT2020 + 1)),
+            CU::wrapColorAspectsIntoColorStandard(CA::PrimariesBT709_5,
+                                                  CA::MatrixBT601_6));
+  EXPECT_EQ(static_cast<int32_t>(CU::kColorStandardVendorStart + 0x20 +
+                                 CA::MatrixBT709_5 * 0x100),
+            CU::wrapColorAspectsIntoColorStandard(
+                static_cast<CA::Primaries>(0x20), CA::MatrixBT709_5));
+  EXPECT_EQ(CU::kColorStandardUnspecified,
+            CU::wrapColorAspectsIntoColorStandard(
+                static_cast<CA::Primaries>(0x100), CA::MatrixBT709_5));
+
+  EXPECT_EQ(CU::kColorRangeLimited,
+            CU::wrapColorAspectsIntoColorRange(CA::RangeLimited));
+  EXPECT_EQ(static_cast<int32_t>(CU::kColorRangeVendorStart + CA::RangeOther),
+            CU::wrapColorAspectsIntoColorRange(CA::RangeOther));
+  EXPECT_EQ(CU::kColorRangeUnspecified,
+            CU::wrapColorAspectsIntoColorRange(static_cast<CA::Range>(0x100)));
+
+  EXPECT_EQ(CU::kColorTransferHLG,
+            CU::wrapColorAspectsIntoColorTransfer(CA::TransferHLG));
+  EXPECT_EQ(static_cast<int32_t>(CU::kColorTransferExtendedStart +
+                                 CA::TransferST428),
+            CU::wrapColorAspectsIntoColorTransfer(CA::TransferST428));
+  EXPECT_EQ(static_cast<int32_t>(CU::kColorTransferVendorStart +
+                                 CA::TransferOther),
+            CU::wrapColorAspectsIntoColorTransfer(CA::TransferOther));
+  EXPECT_EQ(CU::kColorTransferUnspecified,
+            CU::wrapColorAspectsIntoColorTransfer(
+                static_cast<CA::Transfer>(0x1000)));
+}
+
+TEST(ColorUtilsTest, UnwrapsWrappedAspects) {
+  for (uint32_t p = 0; p <= CA::PrimariesOther; ++p) {
+    for (uint32_t c = 0; c <= CA::MatrixOther; ++c) {
+      int32_t standard = CU::wrapColorAspectsIntoColorStandard(
+          static_cast<CA::Primaries>(p), static_cast<CA::MatrixCoeffs>(c));
+      CA::Primaries primaries;
+      CA::MatrixCoeffs coeffs;
+      ASSERT_EQ(OK, CU::unwrapColorAspectsFromColorStandard(
+                        standard, &primaries, &coeffs));
+      ASSERT_EQ(p, primaries);
+      ASSERT_EQ(c, coeffs);
+    }
+  }
+  for (uint32_t v = 0; v <= 0xff; ++v) {
+    CA::Range range;
+    EXPECT_EQ(OK, CU::unwrapColorAspectsFromColorRange(
+                      CU::wrapColorAspectsIntoColorRange(
+                          static_cast<CA::Range>(v)),
+                      &range));
+    EXPECT_EQ(v, range);
+    CA::Transfer transfer;
+    EXPECT_EQ(OK, CU::unwrapColorAspectsFromColorTransfer(
+                      CU::wrapColorAspectsIntoColorTransfer(
+                          static_cast<CA::Transfer>(v)),
+                      &transfer));
+    EXPECT_EQ(v, transfer);
+  }
+
+  CA::Range range;
+  EXPECT_EQ(BAD_VALUE, CU::unwrapColorAspectsFromColorRange(-1, &range));
+  EXPECT_EQ(CA::RangeOther, range);
+  CA::Transfer transfer;
+  EXPECT_EQ(BAD_VALUE, CU::unwrapColorAspectsFromColorTransfer(20, &transfer));
+  EXPECT_EQ(CA::TransferOther, transfer);
+}
+
+TEST(ColorUtilsTest, ConvertsIsoAspects) {
+  int32_t primaries, transfer, coeffs;
+  bool full_range;
+  CU::convertCodecColorAspectsToIsoAspects(
+      MakeAspects(CA::RangeFull, CA::PrimariesBT601_6_525,
+                  CA::TransferSMPTE170M, CA::MatrixBT601_6),
+      &primaries, &transfer, &coeffs, &full_range);
+  // the main ISO values of the aspects
+  EXPECT_EQ(6, primaries);
+  EXPECT_EQ(1, transfer);
+  EXPECT_EQ(6, coeffs);
+  EXPECT_TRUE(full_range);
+
+  // Other, the aspects without an ISO value and invalid ones are Unspecified
+  CU::convertCodecColorAspectsToIsoAspects(
+      MakeAspects(CA::RangeLimited, CA::PrimariesOther, 0x20, 0x100),
+      &primaries, &transfer, &coeffs, &full_range);
+  EXPECT_EQ(2, primaries);
+  EXPECT_EQ(2, transfer);
+  EXPECT_EQ(2, coeffs);
+  EXPECT_FALSE(full_range);
+
+  ColorAspects aspects;
+  CU::convertIsoColorAspectsToCodecAspects(7, 16, 5, false, aspects);
+  EXPECT_EQ(CA::PrimariesBT601_6_525, aspects.mPrimaries);
+  EXPECT_EQ(CA::TransferST2084, aspects.mTransfer);
+  EXPECT_EQ(CA::MatrixBT601_6, aspects.mMatrixCoeffs);
+  EXPECT_EQ(CA::RangeLimited, aspects.mRange);
+
+  CU::convertIsoColorAspectsToCodecAspects(10, 9, 0, true, aspects);
+  EXPECT_EQ(CA::PrimariesOther, aspects.mPrimaries);
+  EXPECT_EQ(CA::TransferOther, aspects.mTransfer);
+  EXPECT_EQ(CA::MatrixOther, aspects.mMatrixCoeffs);
+  EXPECT_EQ(CA::RangeFull, aspects.mRange);
+
+  CU::convertIsoColorAspectsToCodecAspects(3, -1, 0x10000, true, aspects);
+  EXPECT_EQ(CA::PrimariesUnspecified, aspects.mPrimaries);
+  EXPECT_EQ(CA::TransferUnspecified, aspects.mTransfer);
+  EXPECT_EQ(CA::MatrixUnspecified, aspects.mMatrixCoeffs);
+}
+
+TEST(ColorUtilsTest, ConvertsIsoToPlatformAspects) {
+  for (int32_t p = -1; p < 40; ++p) {
+    for (int32_t t = -1; t < 40; ++t) {
+      for (int32_t c = -1; c < 40; ++c) {
+        bool full_range = (p + t + c) & 1;
+        ColorAspects aspects;
+        CU::convertIsoColorAspectsToCodecAspects(p, t, c, full_range,
+                                                 aspects);
+        int32_t range, standard, transfer;
+        CU::convertCodecColorAspectsToPlatformAspects(aspects, &range,
+                                                      &standard, &transfer);
+        int32_t iso_range, iso_standard, iso_transfer;
+        CU::convertIsoColorAspectsToPlatformAspects(
+            p, t, c, full_range, &iso_range, &iso_standard, &iso_transfer);
+        ASSERT_EQ(range, iso_range);
+        ASSERT_EQ(standard, iso_standard);
+        ASSERT_EQ(transfer, iso_transfer);
+      }
+    }
+  }
+}
+
+TEST(ColorUtilsTest, PackedConversionsMatchUnpacked) {
+  const uint32_t kValues[] = {0, 1, 2, 3, 6, 7, 0x20, 0xff};
+  for (uint32_t v = 0; v <= 0xff; ++v) {
+    for (uint32_t other : kValues) {
+      ExpectPackedMatches(MakeAspects(v, other, other, other));
+      ExpectPackedMatches(MakeAspects(other, v, other, other));
+      ExpectPackedMatches(MakeAspects(other, other, v, other));
+      ExpectPackedMatches(MakeAspects(other, other, other, v));
+    }
+  }
+  for (uint32_t p = 0; p <= 0xff; ++p) {
+    for (uint32_t c = 0; c <= 0xff; ++c) {
+      ExpectPackedMatches(MakeAspects(CA::RangeLimited, p, CA::TransferHLG, c));
+    }
+  }
+
+  ColorAspects aspects = MakeAspects(CA::RangeFull, CA::PrimariesBT2020,
+                                     CA::TransferST2084, CA::MatrixBT2020);
+  EXPECT_EQ(CU::packToU32(aspects),
+            CU::packToU32(CU::unpackToColorAspects(CU::packToU32(aspects))));
+}
+
+TEST(ColorUtilsTest, PackingRejectsAspectsPastTheirByte) {
+  // MetaData values that are no aspect, the unpacked conversion rejects
+  // them too
+  const ColorAspects kInvalid[] = {
+      MakeAspects(0x100, CA::PrimariesBT709_5, CA::TransferSMPTE170M,
+                  CA::MatrixBT709_5),
+      MakeAspects(CA::RangeLimited, 0x101, CA::TransferSMPTE170M,
+                  CA::MatrixBT709_5),
+      MakeAspects(CA::RangeLimited, CA::PrimariesBT709_5, 0x1000,
+                  CA::MatrixBT709_5),
+      MakeAspects(CA::RangeLimited, CA::PrimariesBT709_5,
+                  CA::TransferSMPTE170M, 0x100),
+  };
+  for (const ColorAspects& aspects : kInvalid) {
+    uint32_t packed = 0x12345678;
+    EXPECT_EQ(BAD_VALUE, CU::packToU32Checked(aspects, &packed));
+    EXPECT_EQ(packed, 0x12345678u);
+    int32_t range, standard, transfer;
+    EXPECT_EQ(BAD_VALUE, CU::convertCodecColorAspectsToPlatformAspects(
+                             aspects, &range, &standard, &transfer));
+  }
+}
+
+}  // namespace ave
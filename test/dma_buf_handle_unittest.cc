@@ -0,0 +1,194 @@
+/*
+ * dma_buf_handle_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../dma_buf_handle.h"
+#include "../media_packet.h"
+
+namespace ave {
+
+namespace {
+const size_t kHandleSize = 4096;
+const char* kTestString = "hello world";
+
+bool IsFdOpen(int fd) {
+  return fcntl(fd, F_GETFD) != -1;
+}
+
+// Sends the message SendHandle() would, with the fields picked by the test.
+void SendRaw(int socket, uint64_t size, const std::vector<int>& fds) {
+  struct {
+    uint64_t size;
+    uint32_t type;
+  } header = {size, static_cast<uint32_t>(DmaBufHandle::Type::kMemfd)};
+  struct iovec iov = {&header, sizeof(header)};
+
+  std::vector<char> control(CMSG_SPACE(fds.size() * sizeof(int)));
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds.data(), fds.size() * sizeof(int));
+
+  ASSERT_EQ(sendmsg(socket, &msg, 0), static_cast<ssize_t>(sizeof(header)));
+}
+}  // namespace
+
+TEST(DmaBufHandleTest, MemfdMapOnDemand) {
+  auto handle = DmaBufHandle::CreateMemfd(kHandleSize, "unittest");
+  ASSERT_NE(handle, nullptr);
+  EXPECT_EQ(handle->type(), DmaBufHandle::Type::kMemfd);
+  EXPECT_EQ(handle->size(), kHandleSize);
+  EXPECT_GE(handle->fd(), 0);
+  EXPECT_FALSE(handle->mapped());
+
+  uint8_t* data = handle->data();
+  ASSERT_NE(data, nullptr);
+  EXPECT_TRUE(handle->mapped());
+  // mapping is reused
+  EXPECT_EQ(handle->data(), data);
+
+  EXPECT_EQ(handle->BeginCpuAccess(DmaBufHandle::kSyncWrite), OK);
+  memcpy(data, kTestString, strlen(kTestString));
+  EXPECT_EQ(handle->EndCpuAccess(DmaBufHandle::kSyncWrite), OK);
+  EXPECT_EQ(handle->BeginCpuAccess(0), BAD_VALUE);
+}
+
+TEST(DmaBufHandleTest, ImportSharesMemory) {
+  auto handle = DmaBufHandle::CreateMemfd(kHandleSize);
+  ASSERT_NE(handle, nullptr);
+  memcpy(handle->data(), kTestString, strlen(kTestString));
+
+  // size 0 is queried from the fd
+  auto imported =
+      DmaBufHandle::Import(handle->fd(), 0, DmaBufHandle::Type::kMemfd);
+  ASSERT_NE(imported, nullptr);
+  EXPECT_NE(imported->fd(), handle->fd());
+  EXPECT_EQ(imported->size(), kHandleSize);
+  EXPECT_NE(imported->data(), handle->data());
+  EXPECT_EQ(memcmp(imported->data(), kTestString, strlen(kTestString)), 0);
+
+  // writes are visible through both mappings
+  imported->data()[0] = 'H';
+  EXPECT_EQ(handle->data()[0], 'H');
+}
+
+TEST(DmaBufHandleTest, CloseOnLastReference) {
+  auto handle = DmaBufHandle::CreateMemfd(kHandleSize);
+  ASSERT_NE(handle, nullptr);
+  int fd = handle->fd();
+
+  {
+    MediaPacket packet = MediaPacket::CreateWithHandle(handle);
+    handle.reset();
+    {
+      MediaPacket copy = packet;
+      EXPECT_TRUE(IsFdOpen(fd));
+    }
+    EXPECT_TRUE(IsFdOpen(fd));
+  }
+  EXPECT_FALSE(IsFdOpen(fd));
+}
+
+TEST(DmaBufHandleTest, SendOverSocket) {
+  int sockets[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets), 0);
+
+  auto handle = DmaBufHandle::CreateMemfd(kHandleSize);
+  ASSERT_NE(handle, nullptr);
+  memcpy(handle->data(), kTestString, strlen(kTestString));
+
+  EXPECT_EQ(DmaBufHandle::SendHandle(sockets[0], *handle), OK);
+  auto received = DmaBufHandle::ReceiveHandle(sockets[1]);
+  ASSERT_NE(received, nullptr);
+  EXPECT_EQ(received->size(), kHandleSize);
+  EXPECT_EQ(received->type(), DmaBufHandle::Type::kMemfd);
+  EXPECT_EQ(memcmp(received->data(), kTestString, strlen(kTestString)), 0);
+
+  close(sockets[0]);
+  close(sockets[1]);
+}
+
+TEST(DmaBufHandleTest, SendToClosedPeerFails) {
+  int sockets[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets), 0);
+  close(sockets[1]);
+
+  auto handle = DmaBufHandle::CreateMemfd(kHandleSize);
+  ASSERT_NE(handle, nullptr);
+  EXPECT_NE(DmaBufHandle::SendHandle(sockets[0], *handle), OK);
+
+  close(sockets[0]);
+}
+
+TEST(DmaBufHandleTest, ReceiveRejectsOversizedHeader) {
+  int sockets[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets), 0);
+
+  auto handle = DmaBufHandle::CreateMemfd(kHandleSize);
+  ASSERT_NE(handle, nullptr);
+
+  SendRaw(sockets[0], kHandleSize * 2, {handle->fd()});
+  EXPECT_EQ(DmaBufHandle::ReceiveHandle(sockets[1]), nullptr);
+
+  SendRaw(sockets[0], kHandleSize, {handle->fd()});
+  EXPECT_NE(DmaBufHandle::ReceiveHandle(sockets[1]), nullptr);
+
+  close(sockets[0]);
+  close(sockets[1]);
+}
+
+TEST(DmaBufHandleTest, ReceiveRejectsExtraDescriptors) {
+  int sockets[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets), 0);
+
+  auto handle = DmaBufHandle::CreateMemfd(kHandleSize);
+  ASSERT_NE(handle, nullptr);
+
+  SendRaw(sockets[0], kHandleSize, {handle->fd(), handle->fd(), handle->fd()});
+  EXPECT_EQ(DmaBufHandle::ReceiveHandle(sockets[1]), nullptr);
+
+  close(sockets[0]);
+  close(sockets[1]);
+}
+
+TEST(DmaBufHandleTest, MediaPacketWithHandle) {
+  auto handle = DmaBufHandle::CreateMemfd(kHandleSize);
+  ASSERT_NE(handle, nullptr);
+
+  MediaPacket packet = MediaPacket::CreateWithHandle(handle);
+  EXPECT_EQ(packet.buffer_type(),
+            MediaPacket::PacketBufferType::kTypeNativeHandle);
+  EXPECT_EQ(packet.native_handle(), handle.get());
+  EXPECT_EQ(packet.dma_buf_handle(), handle);
+  EXPECT_EQ(packet.size(), kHandleSize);
+  ASSERT_NE(packet.data(), nullptr);
+  EXPECT_EQ(packet.data(), handle->data());
+
+  packet.SetSize(strlen(kTestString));
+  EXPECT_EQ(packet.size(), strlen(kTestString));
+
+  MediaPacket copy = packet;
+  EXPECT_EQ(copy.dma_buf_handle(), handle);
+  EXPECT_EQ(copy.data(), packet.data());
+}
+
+}  // namespace ave
@@ -0,0 +1,195 @@
+/*
+ * fast_bit_reader_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../avc_utils.h"
+#include "../bit_reader.h"
+#include "../fast_bit_reader.h"
+
+namespace ave {
+
+namespace {
+
+// Random reads and skips on both readers must give the same results. Bits
+// left are counted in raw bytes, which are read ahead differently when
+// emulation prevention bytes are skipped.
+template <typename Reference, typename Fast>
+void CompareReaders(const std::vector<uint8_t>& data,
+                    uint32_t seed,
+                    bool compare_bits_left) {
+  std::mt19937 rng(seed);
+  Reference reference(data.data(), data.size());
+  Fast fast(data.data(), data.size());
+
+  while (!reference.overRead()) {
+    size_t n = rng() % 33;
+    if (rng() % 8 == 0) {
+      n = rng() % 100;
+      ASSERT_EQ(fast.skipBits(n), reference.skipBits(n));
+    } else {
+      uint32_t expected = 0xdeadbeef;
+      uint32_t actual = 0xdeadbeef;
+      bool ok = reference.getBitsGraceful(n, &expected);
+      ASSERT_EQ(fast.getBitsGraceful(n, &actual), ok);
+      if (ok) {
+        ASSERT_EQ(actual, expected);
+      }
+    }
+    ASSERT_EQ(fast.overRead(), reference.overRead());
+    if (compare_bits_left && !reference.overRead()) {
+      ASSERT_EQ(fast.numBitsLeft(), reference.numBitsLeft());
+    }
+  }
+}
+
+std::vector<uint8_t> RandomData(std::mt19937* rng, size_t size) {
+  std::vector<uint8_t> data(size);
+  for (auto& byte : data) {
+    // lots of zeros and threes for emulation prevention bytes
+    uint32_t r = (*rng)() % 8;
+    byte = r < 3 ? 0x00 : r < 5 ? 0x03 : static_cast<uint8_t>((*rng)());
+  }
+  return data;
+}
+
+// parseUEWithFallback() before it counted leading zeros a reservoir at a time.
+unsigned BitwiseParseUEWithFallback(BitReader* br, unsigned fallback) {
+  unsigned numZeroes = 0;
+  while (br->getBitsWithFallback(1, 1) == 0) {
+    ++numZeroes;
+  }
+  uint32_t x;
+  if (numZeroes < 32) {
+    if (br->getBitsGraceful(numZeroes, &x)) {
+      return x + (1u << numZeroes) - 1;
+    } else {
+      return fallback;
+    }
+  } else {
+    br->skipBits(numZeroes);
+    return fallback;
+  }
+}
+
+// Mostly short codes, some long zero runs and truncated codes at the end.
+std::vector<uint8_t> RandomCodes(std::mt19937* rng, size_t size) {
+  std::vector<uint8_t> data(size);
+  for (auto& byte : data) {
+    uint32_t r = (*rng)() % 8;
+    byte = r < 2 ? 0x00 : r < 3 ? 0x01 : static_cast<uint8_t>((*rng)());
+  }
+  return data;
+}
+
+template <typename Reference, typename Fast>
+void CompareExpGolomb(const std::vector<uint8_t>& data, uint32_t seed) {
+  std::mt19937 rng(seed);
+  Reference reference(data.data(), data.size());
+  Reference bitwise(data.data(), data.size());
+  Fast fast(data.data(), data.size());
+
+  while (!reference.overRead()) {
+    if (rng() % 2 == 0) {
+      unsigned expected = BitwiseParseUEWithFallback(&bitwise, 12345);
+      ASSERT_EQ(parseUEWithFallback(&reference, 12345), expected);
+      ASSERT_EQ(fast.getUEWithFallback(12345), expected);
+    } else {
+      ASSERT_EQ(fast.getSEWithFallback(-7),
+                parseSEWithFallback(&reference, -7));
+      parseSEWithFallback(&bitwise, -7);
+    }
+    ASSERT_EQ(reference.numBitsLeft(), bitwise.numBitsLeft());
+    ASSERT_EQ(fast.overRead(), reference.overRead());
+    uint32_t flag = rng() % 2;
+    ASSERT_EQ(fast.getBitsWithFallback(flag, 5),
+              reference.getBitsWithFallback(flag, 5));
+    bitwise.getBitsWithFallback(flag, 5);
+  }
+}
+
+}  // namespace
+
+TEST(FastBitReaderTest, Basic) {
+  const uint8_t data[] = {0xa5, 0x0f, 0xff, 0x00, 0x12, 0x34, 0x56,
+                          0x78, 0x9a, 0xbc, 0xde, 0xf0};
+  FastRawBitReader br(data, sizeof(data));
+  EXPECT_EQ(br.showBits(4), 0xau);
+  EXPECT_EQ(br.getBits(4), 0xau);
+  EXPECT_EQ(br.getBits(8), 0x50u);
+  EXPECT_EQ(br.data(), data + 1);
+  EXPECT_TRUE(br.skipBits(12));
+  EXPECT_EQ(br.getBits(32), 0x00123456u);
+  EXPECT_EQ(br.getBits(0), 0u);
+  EXPECT_EQ(br.numBitsLeft(), 40u);
+  EXPECT_TRUE(br.skipBits(36));
+  EXPECT_EQ(br.showBits(8), 0u);
+  EXPECT_EQ(br.getBitsWithFallback(8, 7), 7u);
+  EXPECT_TRUE(br.overRead());
+}
+
+TEST(FastBitReaderTest, SkipsEmulationPreventionBytes) {
+  const uint8_t data[] = {0x00, 0x00, 0x03, 0x01, 0x00, 0x00, 0x03,
+                          0x00, 0x00, 0x03, 0x03, 0xff, 0x11, 0x22};
+  FastNALBitReader br(data, sizeof(data));
+  EXPECT_EQ(br.getBits(24), 0x000001u);
+  EXPECT_EQ(br.getBits(32), 0x00000000u);
+  EXPECT_EQ(br.getBits(24), 0x03ff11u);
+}
+
+TEST(FastBitReaderTest, MatchesBitReader) {
+  std::mt19937 rng(3);
+  for (uint32_t i = 0; i < 200; i++) {
+    auto data = RandomData(&rng, rng() % 200);
+    CompareReaders<BitReader, FastRawBitReader>(data, i, true);
+  }
+}
+
+TEST(FastBitReaderTest, MatchesNALBitReader) {
+  std::mt19937 rng(5);
+  for (uint32_t i = 0; i < 200; i++) {
+    auto data = RandomData(&rng, rng() % 200);
+    CompareReaders<NALBitReader, FastNALBitReader>(data, i, false);
+  }
+}
+
+TEST(FastBitReaderTest, ExpGolomb) {
+  // 1, 010, 011, 00100, 000000011111111 as ue(v), then as se(v) and two
+  // bits of a truncated code
+  const uint8_t data[] = {0xa6, 0x40, 0x1f, 0xf4, 0xc8, 0x03, 0xfc};
+  FastRawBitReader fast(data, sizeof(data));
+  BitReader br(data, sizeof(data));
+  const unsigned kCodes[] = {0, 1, 2, 3, 254};
+  for (unsigned code : kCodes) {
+    EXPECT_EQ(parseUE(&br), code);
+    EXPECT_EQ(fast.getUE(), code);
+  }
+  const signed kSigned[] = {0, 1, -1, 2, -127};
+  for (signed code : kSigned) {
+    EXPECT_EQ(parseSE(&br), code);
+    EXPECT_EQ(fast.getSE(), code);
+  }
+  EXPECT_EQ(br.numBitsLeft(), 2u);
+  EXPECT_EQ(fast.numBitsLeft(), 2u);
+
+  EXPECT_EQ(parseUEWithFallback(&br, 3), 3u);
+  EXPECT_EQ(fast.getUEWithFallback(3), 3u);
+}
+
+TEST(FastBitReaderTest, ExpGolombMatchesBitReader) {
+  std::mt19937 rng(11);
+  for (uint32_t i = 0; i < 300; i++) {
+    auto data = RandomCodes(&rng, rng() % 100);
+    CompareExpGolomb<BitReader, FastRawBitReader>(data, i);
+    CompareExpGolomb<NALBitReader, FastNALBitReader>(data, i);
+  }
+}
+
+}  // namespace ave
@@ -0,0 +1,250 @@
+/*
+ * frame_view_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <cstring>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../frame_view.h"
+#include "../media_errors.h"
+#include "../media_packet.h"
+#include "../message.h"
+#include "../meta_data.h"
+
+namespace ave {
+
+namespace {
+const uint32_t kWidth = 64;
+const uint32_t kHeight = 48;
+const uint32_t kStride = 80;
+
+MediaImage2 MakeNV12Image(uint32_t width, uint32_t height, uint32_t stride) {
+  MediaImage2 image;
+  memset(&image, 0, sizeof(image));
+  image.mType = MediaImage2::MEDIA_IMAGE_TYPE_YUV;
+  image.mNumPlanes = 3;
+  image.mWidth = width;
+  image.mHeight = height;
+  image.mBitDepth = 8;
+  image.mBitDepthAllocated = 8;
+
+  image.mPlane[MediaImage2::Y] = {0, 1, static_cast<int32_t>(stride), 1, 1};
+  uint32_t uv_offset = stride * height;
+  image.mPlane[MediaImage2::U] = {uv_offset, 2, static_cast<int32_t>(stride),
+                                  2, 2};
+  image.mPlane[MediaImage2::V] = {uv_offset + 1, 2,
+                                  static_cast<int32_t>(stride), 2, 2};
+  return image;
+}
+}  // namespace
+
+TEST(FrameViewTest, YUV420PLayout) {
+  size_t size = FrameView::FrameSize(AV_PIX_FMT_YUV420P, kWidth, kHeight);
+  EXPECT_EQ(size, kWidth * kHeight * 3 / 2);
+  std::vector<uint8_t> buffer(size);
+
+  FrameView view = FrameView::Create(buffer.data(), buffer.size(),
+                                     AV_PIX_FMT_YUV420P, kWidth, kHeight);
+  ASSERT_TRUE(view.valid());
+  ASSERT_EQ(view.num_planes(), 3u);
+  EXPECT_EQ(view.plane(0).data, buffer.data());
+  EXPECT_EQ(view.plane(0).stride, static_cast<int32_t>(kWidth));
+  EXPECT_EQ(view.plane(1).data, buffer.data() + kWidth * kHeight);
+  EXPECT_EQ(view.plane(1).stride, static_cast<int32_t>(kWidth / 2));
+  EXPECT_EQ(view.plane(1).height, kHeight / 2);
+  EXPECT_EQ(view.plane(2).data, buffer.data() + kWidth * kHeight * 5 / 4);
+  EXPECT_EQ(view.plane(2).size(), kWidth * kHeight / 4);
+
+  // too small
+  EXPECT_FALSE(FrameView::Create(buffer.data(), size - 1, AV_PIX_FMT_YUV420P,
+                                 kWidth, kHeight)
+                   .valid());
+  // unsupported
+  EXPECT_FALSE(FrameView::Create(buffer.data(), size, AV_PIX_FMT_PAL8, kWidth,
+                                 kHeight)
+                   .valid());
+}
+
+TEST(FrameViewTest, NV12WithStride) {
+  size_t size = FrameView::FrameSize(AV_PIX_FMT_NV12, kWidth, kHeight, kStride);
+  EXPECT_EQ(size, kStride * kHeight * 3 / 2);
+  std::vector<uint8_t> buffer(size);
+
+  FrameView view = FrameView::Create(buffer.data(), buffer.size(),
+                                     AV_PIX_FMT_NV12, kWidth, kHeight, kStride);
+  ASSERT_TRUE(view.valid());
+  ASSERT_EQ(view.num_planes(), 2u);
+  EXPECT_EQ(view.plane(1).data, buffer.data() + kStride * kHeight);
+  EXPECT_EQ(view.plane(1).stride, static_cast<int32_t>(kStride));
+  EXPECT_EQ(view.plane(1).col_inc, 2);
+  EXPECT_EQ(view.plane(1).width, kWidth / 2);
+  // the padding after the last row is not part of the plane
+  EXPECT_EQ(view.plane(0).size(), kStride * (kHeight - 1) + kWidth);
+}
+
+TEST(FrameViewTest, RowIteration) {
+  std::vector<uint8_t> buffer(
+      FrameView::FrameSize(AV_PIX_FMT_GRAY8, kWidth, kHeight, kStride));
+  FrameView view =
+      FrameView::Create(buffer.data(), buffer.size(), AV_PIX_FMT_GRAY8, kWidth,
+                        kHeight, kStride);
+  ASSERT_TRUE(view.valid());
+
+  uint32_t y = 0;
+  for (uint8_t* row : view.rows(0)) {
+    EXPECT_EQ(row, view.plane(0).row(y));
+    memset(row, static_cast<int>(y), view.plane(0).width);
+    y++;
+  }
+  EXPECT_EQ(y, kHeight);
+  EXPECT_EQ(buffer[kStride * 5 + kWidth - 1], 5);
+  // padding untouched
+  EXPECT_EQ(buffer[kStride * 5 + kWidth], 0);
+}
+
+TEST(FrameViewTest, RowIterationOfTemporaryView) {
+  std::vector<uint8_t> buffer(
+      FrameView::FrameSize(AV_PIX_FMT_GRAY8, kWidth, kHeight, kStride));
+  // the range outlives the view it was taken from
+  uint32_t y = 0;
+  for (uint8_t* row :
+       FrameView::Create(buffer.data(), buffer.size(), AV_PIX_FMT_GRAY8,
+                         kWidth, kHeight, kStride)
+           .rows(0)) {
+    EXPECT_EQ(row, buffer.data() + kStride * y);
+    y++;
+  }
+  EXPECT_EQ(y, kHeight);
+}
+
+TEST(FrameViewTest, Crop) {
+  std::vector<uint8_t> buffer(
+      FrameView::FrameSize(AV_PIX_FMT_YUV420P, kWidth, kHeight));
+  FrameView view = FrameView::Create(buffer.data(), buffer.size(),
+                                     AV_PIX_FMT_YUV420P, kWidth, kHeight);
+
+  FrameView cropped = view.Crop(8, 4, 31, 20);
+  ASSERT_TRUE(cropped.valid());
+  EXPECT_EQ(cropped.width(), 31u);
+  EXPECT_EQ(cropped.height(), 20u);
+  EXPECT_EQ(cropped.plane(0).data, view.plane(0).row(4) + 8);
+  EXPECT_EQ(cropped.plane(0).stride, view.plane(0).stride);
+  EXPECT_EQ(cropped.plane(1).data, view.plane(1).row(2) + 4);
+  EXPECT_EQ(cropped.plane(1).width, 16u);
+  EXPECT_EQ(cropped.plane(2).height, 10u);
+
+  // chroma misaligned origin and out of frame
+  EXPECT_FALSE(view.Crop(1, 0, 16, 16).valid());
+  EXPECT_FALSE(view.Crop(0, 0, kWidth + 1, kHeight).valid());
+  EXPECT_FALSE(view.Crop(kWidth, 0, 1, 1).valid());
+}
+
+TEST(FrameViewTest, CropFromMeta) {
+  std::vector<uint8_t> buffer(
+      FrameView::FrameSize(AV_PIX_FMT_NV12, kWidth, kHeight));
+  FrameView view = FrameView::Create(buffer.data(), buffer.size(),
+                                     AV_PIX_FMT_NV12, kWidth, kHeight);
+
+  MetaData meta;
+  EXPECT_EQ(view.Crop(meta).width(), kWidth);
+  meta.setRect(kKeyCropRect, 2, 2, kWidth - 3, kHeight - 3);
+  FrameView cropped = view.Crop(meta);
+  ASSERT_TRUE(cropped.valid());
+  EXPECT_EQ(cropped.width(), kWidth - 4);
+  EXPECT_EQ(cropped.height(), kHeight - 4);
+  EXPECT_EQ(cropped.plane(0).data, view.plane(0).row(2) + 2);
+  EXPECT_EQ(cropped.plane(1).data, view.plane(1).row(1) + 2);
+
+  Message format;
+  format.setRect("crop", 0, 0, 15, 15);
+  cropped = view.Crop(format);
+  ASSERT_TRUE(cropped.valid());
+  EXPECT_EQ(cropped.width(), 16u);
+  EXPECT_EQ(cropped.plane(1).width, 8u);
+}
+
+TEST(FrameViewTest, MediaImage2) {
+  std::vector<uint8_t> buffer(kStride * kHeight * 3 / 2);
+  MediaImage2 image = MakeNV12Image(kWidth, kHeight, kStride);
+
+  FrameView view = FrameView::Create(buffer.data(), buffer.size(), image);
+  ASSERT_TRUE(view.valid());
+  EXPECT_EQ(view.format(), AV_PIX_FMT_NV12);
+  ASSERT_EQ(view.num_planes(), 2u);
+  EXPECT_EQ(view.plane(1).data, buffer.data() + kStride * kHeight);
+  EXPECT_EQ(view.plane(1).col_inc, 2);
+
+  // V before U
+  image.mPlane[MediaImage2::U].mOffset = kStride * kHeight + 1;
+  image.mPlane[MediaImage2::V].mOffset = kStride * kHeight;
+  view = FrameView::Create(buffer.data(), buffer.size(), image);
+  ASSERT_TRUE(view.valid());
+  EXPECT_EQ(view.format(), AV_PIX_FMT_NV21);
+  EXPECT_EQ(view.plane(1).data, buffer.data() + kStride * kHeight);
+
+  // the last chroma row ends before the padding
+  size_t end = kStride * kHeight + kStride * (kHeight / 2 - 1) + kWidth;
+  EXPECT_TRUE(FrameView::Create(buffer.data(), end, image).valid());
+  EXPECT_FALSE(FrameView::Create(buffer.data(), end - 1, image).valid());
+}
+
+TEST(FrameViewTest, FromMediaPacket) {
+  size_t size = FrameView::FrameSize(AV_PIX_FMT_YUV420P, kWidth, kHeight);
+  MediaPacket packet = MediaPacket::Create(size);
+  EXPECT_FALSE(FrameView::Create(packet).valid());
+
+  packet.SetMediaType(MediaType::VIDEO);
+  packet.video_info()->width = kWidth;
+  packet.video_info()->height = kHeight;
+  packet.video_info()->pixel_format = AV_PIX_FMT_YUV420P;
+
+  FrameView view = FrameView::Create(packet);
+  ASSERT_TRUE(view.valid());
+  EXPECT_EQ(view.plane(0).data, packet.data());
+  EXPECT_EQ(view.plane(2).data + view.plane(2).size(), packet.data() + size);
+}
+
+TEST(FrameViewTest, PrepareOutput) {
+  MediaPacket src = MediaPacket::Create(
+      FrameView::FrameSize(AV_PIX_FMT_YUV420P, kWidth, kHeight));
+  src.SetMediaType(MediaType::VIDEO);
+  src.video_info()->width = kWidth;
+  src.video_info()->height = kHeight;
+  src.video_info()->pixel_format = AV_PIX_FMT_YUV420P;
+  src.video_info()->timestamp_us = 40000;
+
+  // grows a normal packet and keeps its stride
+  MediaPacket dst = MediaPacket::Create(16);
+  dst.SetMediaType(MediaType::VIDEO);
+  dst.video_info()->stride = kStride;
+  ASSERT_EQ(FrameView::PrepareOutput(src, dst, AV_PIX_FMT_NV12, kWidth / 2,
+                                     kHeight / 2),
+            OK);
+  EXPECT_EQ(dst.size(), FrameView::FrameSize(AV_PIX_FMT_NV12, kWidth / 2,
+                                             kHeight / 2, kStride));
+  EXPECT_EQ(dst.video_info()->pixel_format, AV_PIX_FMT_NV12);
+  EXPECT_EQ(dst.video_info()->width, static_cast<int16_t>(kWidth / 2));
+  EXPECT_EQ(dst.video_info()->height, static_cast<int16_t>(kHeight / 2));
+  EXPECT_EQ(dst.video_info()->stride, static_cast<int16_t>(kStride));
+  EXPECT_EQ(dst.video_info()->timestamp_us, 40000);
+  EXPECT_TRUE(FrameView::Create(dst).valid());
+
+  // a native handle can not grow
+  int handle = 0;
+  MediaPacket native =
+      MediaPacket::CreateWithHandle(static_cast<void*>(&handle));
+  native.SetMediaType(MediaType::VIDEO);
+  EXPECT_EQ(FrameView::PrepareOutput(src, native, AV_PIX_FMT_NV12, kWidth,
+                                     kHeight),
+            BAD_VALUE);
+  EXPECT_EQ(FrameView::PrepareOutput(src, dst, AV_PIX_FMT_NONE, kWidth,
+                                     kHeight),
+            ERROR_UNSUPPORTED);
+}
+
+}  // namespace ave
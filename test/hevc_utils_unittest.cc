@@ -0,0 +1,346 @@
+/*
+ * hevc_utils_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../hevc_utils.h"
+#include "../media_errors.h"
+#include "bit_writer.h"
+
+namespace ave {
+
+namespace {
+
+// Main profile, level 3.1 by default
+void PutProfileTierLevel(BitWriter* bw, uint8_t levelIdc = 93) {
+  bw->Put(0, 2);  // general_profile_space
+  bw->Put(0, 1);  // general_tier_flag
+  bw->Put(1, 5);  // general_profile_idc
+  bw->Put(0x60000000, 32);
+  bw->Put(0x9000, 16);
+  bw->Put(0, 32);
+  bw->Put(levelIdc, 8);  // general_level_idc
+}
+
+std::vector<uint8_t> MakeVps(uint8_t levelIdc = 93) {
+  BitWriter bw;
+  bw.Put(0, 4);  // vps_video_parameter_set_id
+  bw.Put(3, 2);
+  bw.Put(0, 6);  // vps_max_layers_minus1
+  bw.Put(0, 3);  // vps_max_sub_layers_minus1
+  bw.Put(1, 1);
+  bw.Put(0xffff, 16);
+  PutProfileTierLevel(&bw, levelIdc);
+  return bw.FinishNAL({kHevcNalUnitTypeVps << 1, 1});
+}
+
+// 1920x1080 with 64x64 CTBs, 8 bit pic_order_cnt_lsb, PQ colour, 10 Mbit/s
+// HRD.
+std::vector<uint8_t> MakeSps() {
+  BitWriter bw;
+  bw.Put(0, 4);  // sps_video_parameter_set_id
+  bw.Put(0, 3);  // sps_max_sub_layers_minus1
+  bw.Put(1, 1);
+  PutProfileTierLevel(&bw);
+  bw.PutUE(0);     // sps_seq_parameter_set_id
+  bw.PutUE(1);     // chroma_format_idc
+  bw.PutUE(1920);  // pic_width_in_luma_samples
+  bw.PutUE(1088);  // pic_height_in_luma_samples
+  bw.Put(1, 1);    // conformance_window_flag
+  bw.PutUE(0);
+  bw.PutUE(0);
+  bw.PutUE(0);
+  bw.PutUE(4);  // conf_win_bottom_offset
+  bw.PutUE(2);  // bit_depth_luma_minus8
+  bw.PutUE(2);
+  bw.PutUE(4);  // log2_max_pic_order_cnt_lsb_minus4
+  bw.Put(1, 1);
+  bw.PutUE(4);  // sps_max_dec_pic_buffering_minus1
+  bw.PutUE(2);  // sps_max_num_reorder_pics
+  bw.PutUE(0);
+  bw.PutUE(0);  // log2_min_luma_coding_block_size_minus3
+  bw.PutUE(3);  // log2_diff_max_min_luma_coding_block_size
+  bw.PutUE(0);
+  bw.PutUE(3);
+  bw.PutUE(0);
+  bw.PutUE(0);
+  bw.Put(0, 1);  // scaling_list_enabled_flag
+  bw.Put(3, 2);
+  bw.Put(0, 1);  // pcm_enabled_flag
+  bw.PutUE(1);   // num_short_term_ref_pic_sets
+  bw.PutUE(1);   // num_negative_pics
+  bw.PutUE(0);
+  bw.PutUE(0);
+  bw.Put(1, 1);
+  bw.Put(0, 1);  // long_term_ref_pics_present_flag
+  bw.Put(3, 2);
+  bw.Put(1, 1);  // vui_parameters_present_flag
+
+  bw.Put(1, 1);  // aspect_ratio_info_present_flag
+  bw.Put(1, 8);
+  bw.Put(0, 1);
+  bw.Put(1, 1);  // video_signal_type_present_flag
+  bw.Put(5, 3);
+  bw.Put(0, 1);  // video_full_range_flag
+  bw.Put(1, 1);
+  bw.Put(9, 8);   // colour_primaries
+  bw.Put(16, 8);  // transfer_characteristics
+  bw.Put(9, 8);   // matrix_coeffs
+  bw.Put(0, 1);
+  bw.Put(0, 3);
+  bw.Put(0, 1);     // default_display_window_flag
+  bw.Put(1, 1);     // vui_timing_info_present_flag
+  bw.Put(1001, 32);
+  bw.Put(60000, 32);
+  bw.Put(0, 1);
+  bw.Put(1, 1);  // vui_hrd_parameters_present_flag
+  bw.Put(1, 1);  // nal_hrd_parameters_present_flag
+  bw.Put(0, 1);
+  bw.Put(0, 1);  // sub_pic_hrd_params_present_flag
+  bw.Put(0, 4);  // bit_rate_scale
+  bw.Put(2, 4);  // cpb_size_scale
+  bw.Put(23, 5);
+  bw.Put(23, 5);
+  bw.Put(4, 5);
+  bw.Put(1, 1);  // fixed_pic_rate_general_flag
+  bw.PutUE(0);
+  bw.PutUE(0);       // cpb_cnt_minus1
+  bw.PutUE(156249);  // bit_rate_value_minus1
+  bw.PutUE(9999);    // cpb_size_value_minus1
+  bw.Put(0, 1);
+  bw.Put(0, 1);  // bitstream_restriction_flag
+
+  bw.Put(0, 1);  // sps_extension_present_flag
+  return bw.FinishNAL({kHevcNalUnitTypeSps << 1, 1});
+}
+
+std::vector<uint8_t> MakePps() {
+  BitWriter bw;
+  bw.PutUE(0);   // pps_pic_parameter_set_id
+  bw.PutUE(0);   // pps_seq_parameter_set_id
+  bw.Put(1, 1);  // dependent_slice_segments_enabled_flag
+  bw.Put(0, 1);
+  bw.Put(0, 3);  // num_extra_slice_header_bits
+  bw.Put(0, 2);
+  bw.PutUE(0);
+  bw.PutUE(0);
+  bw.PutSE(-4);  // init_qp_minus26
+  bw.Put(0, 2);
+  bw.Put(1, 1);  // cu_qp_delta_enabled_flag
+  bw.PutUE(1);
+  bw.PutSE(0);
+  bw.PutSE(0);
+  bw.Put(0, 4);
+  bw.Put(1, 1);  // tiles_enabled_flag
+  bw.Put(0, 1);
+  bw.PutUE(1);   // num_tile_columns_minus1
+  bw.PutUE(0);
+  bw.Put(1, 1);  // uniform_spacing_flag
+  bw.Put(1, 1);
+  bw.Put(1, 1);
+  bw.Put(1, 1);  // deblocking_filter_control_present_flag
+  bw.Put(0, 2);
+  bw.PutSE(-1);  // pps_beta_offset_div2
+  bw.PutSE(2);   // pps_tc_offset_div2
+  bw.Put(0, 2);
+  bw.PutUE(0);
+  bw.Put(0, 2);
+  return bw.FinishNAL({kHevcNalUnitTypePps << 1, 1});
+}
+
+struct Slice {
+  uint8_t nalUnitType;
+  bool first;
+  bool dependent;
+  uint32_t address;
+  uint32_t sliceType;
+  uint32_t pocLsb;
+};
+
+std::vector<uint8_t> MakeSlice(const Slice& s) {
+  BitWriter bw;
+  bw.Put(s.first, 1);
+  if (s.nalUnitType >= 16 && s.nalUnitType <= 23) {
+    bw.Put(0, 1);  // no_output_of_prior_pics_flag
+  }
+  bw.PutUE(0);
+  if (!s.first) {
+    bw.Put(s.dependent, 1);
+    bw.Put(s.address, 9);  // 510 CTBs
+  }
+  if (!s.dependent) {
+    bw.PutUE(s.sliceType);
+    if (s.nalUnitType != 19 && s.nalUnitType != 20) {
+      bw.Put(s.pocLsb, 8);
+    }
+  }
+  bw.Put(0x5a, 8);
+  uint8_t type = s.nalUnitType << 1;
+  return bw.FinishNAL({type, 1});
+}
+
+void AddParameterSets(HevcParameterSets* sets) {
+  for (const auto& nal : {MakeVps(), MakeSps(), MakePps()}) {
+    ASSERT_EQ(sets->addNalUnit(nal.data(), nal.size()), OK);
+  }
+}
+
+}  // namespace
+
+TEST(HevcParameterSetsTest, ParameterSets) {
+  HevcParameterSets sets;
+  AddParameterSets(&sets);
+
+  const HevcSps* sps = sets.getSps(0);
+  ASSERT_NE(sps, nullptr);
+  EXPECT_EQ(sps->profileTierLevel.generalProfileIdc, 1);
+  EXPECT_EQ(sps->profileTierLevel.generalLevelIdc, 93);
+  EXPECT_EQ(sps->width, 1920);
+  EXPECT_EQ(sps->height, 1080);
+  EXPECT_EQ(sps->bitDepthLumaMinus8, 2);
+  EXPECT_EQ(sps->log2MaxPicOrderCntLsb, 8u);
+  EXPECT_EQ(sps->maxNumReorderPics[0], 2u);
+  EXPECT_EQ(sps->log2CtbSize, 6u);
+  EXPECT_EQ(sps->picSizeInCtbs, 30u * 17u);
+
+  const HevcVui& vui = sps->vui;
+  ASSERT_TRUE(sps->vuiParametersPresent);
+  EXPECT_EQ(vui.sarWidth, 0);
+  EXPECT_EQ(vui.aspectRatioIdc, 1);
+  EXPECT_EQ(vui.videoFormat, 5);
+  EXPECT_EQ(vui.colourPrimaries, 9);
+  EXPECT_EQ(vui.numUnitsInTick, 1001u);
+  EXPECT_EQ(vui.timeScale, 60000u);
+  ASSERT_TRUE(vui.hrdParametersPresent);
+  EXPECT_TRUE(vui.hrd.nalHrdParametersPresent);
+  EXPECT_EQ(vui.hrd.subLayers[0].bitRate, 10000000u);
+  EXPECT_EQ(vui.hrd.subLayers[0].cpbSize, 640000u);
+  EXPECT_FALSE(vui.bitstreamRestriction);
+
+  const HevcPps* pps = sets.getPps(0);
+  ASSERT_NE(pps, nullptr);
+  EXPECT_TRUE(pps->dependentSliceSegmentsEnabled);
+  EXPECT_EQ(pps->initQpMinus26, -4);
+  EXPECT_EQ(pps->diffCuQpDeltaDepth, 1u);
+  EXPECT_TRUE(pps->tilesEnabled);
+  EXPECT_EQ(pps->numTileColumnsMinus1, 1u);
+  EXPECT_EQ(pps->betaOffsetDiv2, -1);
+  EXPECT_EQ(pps->tcOffsetDiv2, 2);
+
+  EXPECT_EQ(sets.getInfo(), HevcParameterSets::kInfoIsHdr |
+                                HevcParameterSets::kInfoHasColorDescription);
+  uint32_t transfer = 0;
+  EXPECT_TRUE(sets.findParam32(kTransferCharacteristics, &transfer));
+  EXPECT_EQ(transfer, 16u);
+  uint8_t profile = 0;
+  EXPECT_TRUE(sets.findParam8(kGeneralProfileIdc, &profile));
+  EXPECT_EQ(profile, 1);
+
+  uint8_t hvcc[512];
+  size_t hvccSize = sizeof(hvcc);
+  ASSERT_EQ(sets.makeHvcc(hvcc, &hvccSize, 4), OK);
+  EXPECT_EQ(hvcc[1], 1);    // profile
+  EXPECT_EQ(hvcc[12], 93);  // level
+  EXPECT_EQ(hvcc[17], 0xfa);
+  EXPECT_EQ(hvcc[22], 3);  // VPS, SPS and PPS arrays
+}
+
+TEST(HevcParameterSetsTest, FindParamUsesFirstParameterSets) {
+  HevcParameterSets sets;
+  AddParameterSets(&sets);
+
+  // level 4 with the same id replaces the VPS, not the params
+  std::vector<uint8_t> vps = MakeVps(120);
+  ASSERT_EQ(sets.addNalUnit(vps.data(), vps.size()), OK);
+  ASSERT_NE(sets.getVps(0), nullptr);
+  EXPECT_EQ(sets.getVps(0)->profileTierLevel.generalLevelIdc, 120);
+
+  uint8_t level = 0;
+  EXPECT_TRUE(sets.findParam8(kGeneralLevelIdc, &level));
+  EXPECT_EQ(level, 93);
+}
+
+TEST(HevcParameterSetsTest, SliceHeader) {
+  HevcParameterSets sets;
+  AddParameterSets(&sets);
+
+  HevcSliceHeader header;
+  auto nal = MakeSlice({1, false, false, 300, kHevcSliceTypeB, 77});
+  ASSERT_EQ(sets.parseSliceHeader(nal.data(), nal.size(), &header), OK);
+  EXPECT_FALSE(header.firstSliceSegmentInPic);
+  EXPECT_FALSE(header.dependentSliceSegment);
+  EXPECT_EQ(header.sliceSegmentAddress, 300u);
+  EXPECT_EQ(header.sliceType, static_cast<uint32_t>(kHevcSliceTypeB));
+  EXPECT_EQ(header.picOrderCntLsb, 77u);
+  EXPECT_EQ(header.temporalId, 0);
+
+  // a dependent slice segment takes the type of the independent one
+  nal = MakeSlice({1, false, false, 200, kHevcSliceTypeP, 78});
+  HevcSliceHeader independent;
+  ASSERT_EQ(sets.parseSliceHeader(nal.data(), nal.size(), &independent), OK);
+  nal = MakeSlice({1, false, true, 301, 0, 0});
+  ASSERT_EQ(
+      sets.parseSliceHeader(nal.data(), nal.size(), &header, &independent),
+      OK);
+  EXPECT_TRUE(header.dependentSliceSegment);
+  EXPECT_EQ(header.sliceSegmentAddress, 301u);
+  EXPECT_EQ(header.sliceType, static_cast<uint32_t>(kHevcSliceTypeP));
+  EXPECT_EQ(header.picOrderCntLsb, 78u);
+  ASSERT_EQ(sets.parseSliceHeader(nal.data(), nal.size(), &independent,
+                                  &independent),
+            OK);
+  EXPECT_EQ(independent.sliceType, static_cast<uint32_t>(kHevcSliceTypeP));
+  ASSERT_EQ(sets.parseSliceHeader(nal.data(), nal.size(), &header), OK);
+  EXPECT_EQ(header.sliceType, static_cast<uint32_t>(kHevcSliceTypeUnknown));
+
+  nal = MakeSlice({19, true, false, 0, kHevcSliceTypeI, 0});
+  ASSERT_EQ(sets.parseSliceHeader(nal.data(), nal.size(), &header), OK);
+  EXPECT_TRUE(header.firstSliceSegmentInPic);
+  EXPECT_TRUE(header.isIdr());
+  EXPECT_EQ(header.sliceType, static_cast<uint32_t>(kHevcSliceTypeI));
+
+  // parameter sets are not slices
+  auto pps = MakePps();
+  EXPECT_EQ(sets.parseSliceHeader(pps.data(), pps.size(), &header),
+            ERROR_UNSUPPORTED);
+}
+
+TEST(HevcParameterSetsTest, PicOrderCnt) {
+  HevcParameterSets sets;
+  AddParameterSets(&sets);
+
+  const struct {
+    uint8_t nalUnitType;
+    uint32_t pocLsb;
+    int32_t poc;
+  } kPictures[] = {
+      {19, 0, 0},   {1, 8, 8},     {0, 4, 4},    {1, 100, 100},
+      {1, 200, 200},
+      // pic_order_cnt_lsb wraps around
+      {1, 40, 296},
+      // a CRA in the middle of the stream continues the order
+      {21, 50, 306},
+  };
+  for (const auto& picture : kPictures) {
+    auto nal = MakeSlice(
+        {picture.nalUnitType, true, false, 0, kHevcSliceTypeP, picture.pocLsb});
+    HevcSliceHeader header;
+    ASSERT_EQ(sets.parseSliceHeader(nal.data(), nal.size(), &header), OK);
+    EXPECT_EQ(sets.computePicOrderCnt(header), picture.poc);
+  }
+
+  // ... unless it starts a new coded video sequence
+  sets.resetPicOrderCnt();
+  auto nal = MakeSlice({21, true, false, 0, kHevcSliceTypeI, 60});
+  HevcSliceHeader header;
+  ASSERT_EQ(sets.parseSliceHeader(nal.data(), nal.size(), &header), OK);
+  EXPECT_EQ(sets.computePicOrderCnt(header), 60);
+}
+
+}  // namespace ave
@@ -0,0 +1,107 @@
+/*
+ * media_packet_ring_benchmark.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../media_packet_ring.h"
+
+namespace ave {
+
+namespace {
+
+const size_t kSlotCount = 8;
+const int kFrameCount = 300;
+
+int64_t SteadyNowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Producer and consumer use separate mappings of the same memfd, which is
+// what two processes see after passing the handle over a socket.
+void RunRing(const char* name, int width, int height) {
+  const size_t frame_size = static_cast<size_t>(width) * height * 3 / 2;
+  auto producer = MediaPacketRing::Create(kSlotCount, frame_size);
+  ASSERT_NE(producer, nullptr);
+  auto consumer = MediaPacketRing::Attach(DmaBufHandle::Import(
+      producer->handle()->fd(), 0, DmaBufHandle::Type::kMemfd));
+  ASSERT_NE(consumer, nullptr);
+
+  std::vector<uint8_t> frame(frame_size, 0x80);
+  std::vector<int64_t> latencies;
+  latencies.reserve(kFrameCount);
+
+  // gtest assertions only return from the lambda, so a failing side closes
+  // the ring to wake the other one up.
+  std::atomic<bool> write_failed(false);
+  int64_t start_us = SteadyNowUs();
+  std::thread writer([&]() {
+    for (int i = 0; i < kFrameCount; i++) {
+      auto* slot = producer->AcquireWriteSlot();
+      if (slot == nullptr) {
+        write_failed = true;
+        producer->Close();
+        return;
+      }
+      memcpy(slot->data(), frame.data(), frame_size);
+      slot->SetSize(frame_size);
+      slot->SetMediaType(MediaType::VIDEO);
+      slot->video_info()->width = static_cast<int16_t>(width);
+      slot->video_info()->height = static_cast<int16_t>(height);
+      slot->video_info()->timestamp_us = SteadyNowUs();
+      producer->CommitWriteSlot();
+    }
+  });
+
+  uint64_t checksum = 0;
+  for (int i = 0; i < kFrameCount; i++) {
+    auto* slot = consumer->AcquireReadSlot();
+    if (slot == nullptr) {
+      consumer->Close();
+      break;
+    }
+    // touch the payload so the consumer pays for the transfer.
+    checksum += slot->data()[0] + slot->data()[slot->size() - 1];
+    latencies.push_back(SteadyNowUs() - slot->video_info()->timestamp_us);
+    consumer->ReleaseReadSlot();
+  }
+  writer.join();
+  int64_t elapsed_us = std::max<int64_t>(SteadyNowUs() - start_us, 1);
+  EXPECT_FALSE(write_failed);
+  ASSERT_EQ(latencies.size(), static_cast<size_t>(kFrameCount));
+
+  std::sort(latencies.begin(), latencies.end());
+  double fps = kFrameCount * 1e6 / elapsed_us;
+  double gbps = fps * frame_size / 1e9;
+  printf("%s: %d frames of %zu bytes, %.1f frames/s, %.2f GB/s, "
+         "latency p50 %lld us p99 %lld us (checksum %llu)\n",
+         name, kFrameCount, frame_size, fps, gbps,
+         static_cast<long long>(latencies[latencies.size() / 2]),
+         static_cast<long long>(latencies[latencies.size() * 99 / 100]),
+         static_cast<unsigned long long>(checksum));
+}
+
+}  // namespace
+
+TEST(MediaPacketRingBenchmark, Yuv420p1080p) {
+  RunRing("1080p", 1920, 1080);
+}
+
+TEST(MediaPacketRingBenchmark, Yuv420p4K) {
+  RunRing("4K", 3840, 2160);
+}
+
+}  // namespace ave
@@ -0,0 +1,258 @@
+/*
+ * media_packet_ring_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <cstring>
+#include <thread>
+
+#include "test/gtest.h"
+
+#include "../media_errors.h"
+#include "../media_packet_ring.h"
+
+namespace ave {
+
+namespace {
+const size_t kSlotCount = 4;
+const size_t kSlotCapacity = 1024;
+const char* kTestString = "hello world";
+
+// the peer side maps the ring through its own descriptor, as it would after
+// DmaBufHandle::ReceiveHandle().
+std::shared_ptr<MediaPacketRing> AttachPeer(const MediaPacketRing& ring) {
+  return MediaPacketRing::Attach(DmaBufHandle::Import(
+      ring.handle()->fd(), 0, DmaBufHandle::Type::kMemfd));
+}
+
+// the leading fields of the ring header in the shared memory, as a faulty
+// peer would see them, see media_packet_ring.cc
+struct RingLayout {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t slot_capacity;
+  uint32_t slot_stride;
+};
+
+RingLayout* GetLayout(const MediaPacketRing& ring) {
+  return reinterpret_cast<RingLayout*>(ring.handle()->data());
+}
+
+// the media type and size leading the header of slot |index|
+uint32_t* GetSlotHeader(const MediaPacketRing& ring, size_t index) {
+  const RingLayout* layout = GetLayout(ring);
+  uint8_t* slots = ring.handle()->data() + ring.handle()->size() -
+                   layout->slot_count * layout->slot_stride;
+  return reinterpret_cast<uint32_t*>(slots + index * layout->slot_stride);
+}
+}  // namespace
+
+TEST(MediaPacketRingTest, CreateAndAttach) {
+  auto ring = MediaPacketRing::Create(kSlotCount, kSlotCapacity);
+  ASSERT_NE(ring, nullptr);
+  EXPECT_EQ(ring->slot_count(), kSlotCount);
+  EXPECT_EQ(ring->slot_capacity(), kSlotCapacity);
+
+  auto peer = AttachPeer(*ring);
+  ASSERT_NE(peer, nullptr);
+  EXPECT_EQ(peer->slot_count(), kSlotCount);
+  EXPECT_EQ(peer->slot_capacity(), kSlotCapacity);
+
+  EXPECT_EQ(MediaPacketRing::Create(0, kSlotCapacity), nullptr);
+  EXPECT_EQ(MediaPacketRing::Attach(DmaBufHandle::CreateMemfd(4096)),
+            nullptr);
+}
+
+TEST(MediaPacketRingTest, WriteRead) {
+  auto producer = MediaPacketRing::Create(kSlotCount, kSlotCapacity);
+  ASSERT_NE(producer, nullptr);
+  auto consumer = AttachPeer(*producer);
+  ASSERT_NE(consumer, nullptr);
+
+  MediaPacket audio = MediaPacket::Create(strlen(kTestString));
+  audio.SetData(reinterpret_cast<uint8_t*>(const_cast<char*>(kTestString)),
+                strlen(kTestString));
+  audio.SetMediaType(MediaType::AUDIO);
+  audio.audio_info()->timestamp_us = 1000;
+  audio.audio_info()->sample_rate_hz = 48000;
+  EXPECT_EQ(producer->Write(audio), OK);
+
+  MediaPacket video = MediaPacket::Create(kSlotCapacity);
+  memset(video.data(), 0xa5, kSlotCapacity);
+  video.SetMediaType(MediaType::VIDEO);
+  video.video_info()->width = 1920;
+  video.video_info()->height = 1080;
+  EXPECT_EQ(producer->Write(video), OK);
+
+  std::unique_ptr<MediaPacket> packet;
+  ASSERT_EQ(consumer->Read(packet), OK);
+  EXPECT_EQ(packet->media_type(), MediaType::AUDIO);
+  ASSERT_EQ(packet->size(), strlen(kTestString));
+  EXPECT_EQ(memcmp(packet->data(), kTestString, strlen(kTestString)), 0);
+  ASSERT_NE(packet->audio_info(), nullptr);
+  EXPECT_EQ(packet->audio_info()->timestamp_us, 1000);
+  EXPECT_EQ(packet->audio_info()->sample_rate_hz, 48000);
+
+  ASSERT_EQ(consumer->Read(packet), OK);
+  EXPECT_EQ(packet->media_type(), MediaType::VIDEO);
+  ASSERT_EQ(packet->size(), kSlotCapacity);
+  EXPECT_EQ(packet->data()[kSlotCapacity - 1], 0xa5);
+  ASSERT_NE(packet->video_info(), nullptr);
+  EXPECT_EQ(packet->video_info()->width, 1920);
+  EXPECT_EQ(packet->video_info()->height, 1080);
+}
+
+TEST(MediaPacketRingTest, WriteInPlace) {
+  auto producer = MediaPacketRing::Create(kSlotCount, kSlotCapacity);
+  ASSERT_NE(producer, nullptr);
+  auto consumer = AttachPeer(*producer);
+  ASSERT_NE(consumer, nullptr);
+
+  auto* slot = producer->AcquireWriteSlot();
+  ASSERT_NE(slot, nullptr);
+  EXPECT_EQ(slot->capacity(), kSlotCapacity);
+  memcpy(slot->data(), kTestString, strlen(kTestString));
+  slot->SetSize(strlen(kTestString));
+  slot->SetMediaType(MediaType::VIDEO);
+  EXPECT_EQ(slot->audio_info(), nullptr);
+  slot->video_info()->timestamp_us = 40000;
+  producer->CommitWriteSlot();
+
+  auto* read = consumer->AcquireReadSlot();
+  ASSERT_NE(read, nullptr);
+  EXPECT_EQ(read->size(), strlen(kTestString));
+  EXPECT_EQ(memcmp(read->data(), kTestString, strlen(kTestString)), 0);
+  ASSERT_NE(read->video_info(), nullptr);
+  EXPECT_EQ(read->video_info()->timestamp_us, 40000);
+  consumer->ReleaseReadSlot();
+}
+
+TEST(MediaPacketRingTest, Timeout) {
+  auto ring = MediaPacketRing::Create(kSlotCount, kSlotCapacity);
+  ASSERT_NE(ring, nullptr);
+
+  std::unique_ptr<MediaPacket> packet;
+  EXPECT_EQ(ring->Read(packet, 0), TIMED_OUT);
+  EXPECT_EQ(ring->Read(packet, 10000), TIMED_OUT);
+
+  MediaPacket small = MediaPacket::Create(16);
+  for (size_t i = 0; i < kSlotCount; i++) {
+    EXPECT_EQ(ring->Write(small, 0), OK);
+  }
+  EXPECT_EQ(ring->Write(small, 0), TIMED_OUT);
+  EXPECT_EQ(ring->Write(small, 10000), TIMED_OUT);
+
+  MediaPacket large = MediaPacket::Create(kSlotCapacity + 1);
+  EXPECT_EQ(ring->Write(large, 0), ERROR_BUFFER_TOO_SMALL);
+}
+
+TEST(MediaPacketRingTest, IgnoresLayoutChangesAfterAttach) {
+  auto producer = MediaPacketRing::Create(kSlotCount, kSlotCapacity);
+  ASSERT_NE(producer, nullptr);
+  auto consumer = AttachPeer(*producer);
+  ASSERT_NE(consumer, nullptr);
+
+  RingLayout* layout = GetLayout(*producer);
+  layout->slot_count = 1 << 30;
+  layout->slot_capacity = 1 << 30;
+  layout->slot_stride = 1 << 30;
+  EXPECT_EQ(consumer->slot_count(), kSlotCount);
+  EXPECT_EQ(consumer->slot_capacity(), kSlotCapacity);
+
+  MediaPacket packet = MediaPacket::Create(kSlotCapacity);
+  for (size_t i = 0; i < kSlotCount * 2; i++) {
+    EXPECT_EQ(producer->Write(packet), OK);
+    std::unique_ptr<MediaPacket> read;
+    ASSERT_EQ(consumer->Read(read), OK);
+    EXPECT_EQ(read->size(), kSlotCapacity);
+  }
+
+  layout->slot_stride = 0;
+  EXPECT_EQ(AttachPeer(*producer), nullptr);
+}
+
+TEST(MediaPacketRingTest, DropsCorruptSlots) {
+  auto producer = MediaPacketRing::Create(kSlotCount, kSlotCapacity);
+  ASSERT_NE(producer, nullptr);
+  auto consumer = AttachPeer(*producer);
+  ASSERT_NE(consumer, nullptr);
+
+  MediaPacket packet = MediaPacket::Create(16);
+  packet.SetMediaType(MediaType::AUDIO);
+  for (size_t i = 0; i < 3; i++) {
+    EXPECT_EQ(producer->Write(packet), OK);
+  }
+  GetSlotHeader(*producer, 0)[1] = kSlotCapacity + 1;
+  GetSlotHeader(*producer, 1)[0] = 100;
+
+  std::unique_ptr<MediaPacket> read;
+  EXPECT_EQ(consumer->Read(read), ERROR_MALFORMED);
+  EXPECT_EQ(consumer->AcquireReadSlot(0), nullptr);
+  ASSERT_EQ(consumer->Read(read), OK);
+  EXPECT_EQ(read->size(), 16u);
+  EXPECT_EQ(read->media_type(), MediaType::AUDIO);
+  EXPECT_EQ(consumer->Read(read, 0), TIMED_OUT);
+}
+
+TEST(MediaPacketRingTest, WakeUpAcrossThreads) {
+  auto producer = MediaPacketRing::Create(kSlotCount, kSlotCapacity);
+  ASSERT_NE(producer, nullptr);
+  auto consumer = AttachPeer(*producer);
+  ASSERT_NE(consumer, nullptr);
+
+  const int kPacketCount = 1000;
+  std::thread writer([&producer]() {
+    MediaPacket packet = MediaPacket::Create(sizeof(int));
+    packet.SetMediaType(MediaType::AUDIO);
+    for (int i = 0; i < kPacketCount; i++) {
+      memcpy(packet.data(), &i, sizeof(i));
+      EXPECT_EQ(producer->Write(packet), OK);
+    }
+  });
+
+  std::unique_ptr<MediaPacket> packet;
+  for (int i = 0; i < kPacketCount; i++) {
+    ASSERT_EQ(consumer->Read(packet), OK);
+    int value;
+    memcpy(&value, packet->data(), sizeof(value));
+    EXPECT_EQ(value, i);
+  }
+  writer.join();
+}
+
+TEST(MediaPacketRingTest, CloseDrainsPending) {
+  auto producer = MediaPacketRing::Create(kSlotCount, kSlotCapacity);
+  ASSERT_NE(producer, nullptr);
+  auto consumer = AttachPeer(*producer);
+  ASSERT_NE(consumer, nullptr);
+
+  MediaPacket packet = MediaPacket::Create(16);
+  EXPECT_EQ(producer->Write(packet), OK);
+  producer->Close();
+  EXPECT_TRUE(consumer->closed());
+  EXPECT_EQ(producer->Write(packet), ERROR_END_OF_STREAM);
+
+  std::unique_ptr<MediaPacket> read;
+  EXPECT_EQ(consumer->Read(read), OK);
+  EXPECT_EQ(consumer->Read(read), ERROR_END_OF_STREAM);
+}
+
+TEST(MediaPacketRingTest, CloseWakesUpReader) {
+  auto producer = MediaPacketRing::Create(kSlotCount, kSlotCapacity);
+  ASSERT_NE(producer, nullptr);
+  auto consumer = AttachPeer(*producer);
+  ASSERT_NE(consumer, nullptr);
+
+  std::thread reader([&consumer]() {
+    std::unique_ptr<MediaPacket> packet;
+    EXPECT_EQ(consumer->Read(packet), ERROR_END_OF_STREAM);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  producer->Close();
+  reader.join();
+}
+
+}  // namespace ave
@@ -0,0 +1,57 @@
+/*
+ * message_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <string>
+
+#include "test/gtest.h"
+
+#include "../buffer.h"
+#include "../message.h"
+
+namespace ave {
+
+TEST(MessageTest, DupCopiesItems) {
+  auto message = std::make_shared<Message>();
+  message->setWhat(7);
+  message->setInt32("int32", 1);
+  message->setInt64("int64", 2);
+  message->setString("string", "three");
+  auto nested = std::make_shared<Message>();
+  message->setMessage("nested", nested);
+  auto buffer = Buffer::Create(16);
+  message->setBuffer("buffer", buffer);
+
+  auto copy = message->dup();
+  ASSERT_NE(copy, message);
+  EXPECT_EQ(copy->what(), 7u);
+  int32_t int32 = 0;
+  EXPECT_TRUE(copy->findInt32("int32", &int32));
+  EXPECT_EQ(int32, 1);
+  int64_t int64 = 0;
+  EXPECT_TRUE(copy->findInt64("int64", &int64));
+  EXPECT_EQ(int64, 2);
+  std::string string;
+  EXPECT_TRUE(copy->findString("string", string));
+  EXPECT_EQ(string, "three");
+
+  // nested messages and buffers are shared
+  std::shared_ptr<Message> found_message;
+  EXPECT_TRUE(copy->findMessage("nested", found_message));
+  EXPECT_EQ(found_message, nested);
+  std::shared_ptr<Buffer> found_buffer;
+  EXPECT_TRUE(copy->findBuffer("buffer", found_buffer));
+  EXPECT_EQ(found_buffer, buffer);
+
+  // the items are not shared with the original
+  copy->setInt32("int32", 5);
+  copy->setInt32("added", 6);
+  EXPECT_TRUE(message->findInt32("int32", &int32));
+  EXPECT_EQ(int32, 1);
+  EXPECT_FALSE(message->contains("added"));
+}
+
+}  // namespace ave
@@ -0,0 +1,198 @@
+/*
+ * mpeg_audio_framer_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../mpeg_audio_framer.h"
+
+namespace ave {
+
+namespace {
+
+using Frame = MPEGAudioFramer::Frame;
+
+// MPEG-1 layer III, 128 kbit/s, 44.1 kHz, stereo: 417 bytes, 418 padded.
+const uint8_t kHeader[] = {0xff, 0xfb, 0x90, 0x00};
+const size_t kFrameSize = 417;
+
+std::vector<uint8_t> MakeFrame(std::mt19937* rng, bool padding = false) {
+  std::vector<uint8_t> frame(kHeader, kHeader + sizeof(kHeader));
+  if (padding) {
+    frame[2] |= 0x02;
+  }
+  // no FF bytes, so there is no sync word in the payload
+  while (frame.size() < kFrameSize + padding) {
+    frame.push_back(static_cast<uint8_t>((*rng)() % 0xff));
+  }
+  return frame;
+}
+
+std::vector<uint8_t> MakeId3Tag() {
+  // 20 bytes of frames after the header, syncsafe size
+  std::vector<uint8_t> tag = {'I', 'D', '3', 4, 0, 0, 0, 0, 0, 20};
+  tag.resize(tag.size() + 20, 0xff);
+  return tag;
+}
+
+struct Result {
+  std::vector<std::string> frames;
+  std::vector<int64_t> pts;
+};
+
+Result Split(MPEGAudioFramer* framer,
+             const std::vector<uint8_t>& stream,
+             uint32_t seed,
+             int64_t ptsUs = 0) {
+  std::mt19937 rng(seed);
+  Result result;
+  std::vector<Frame> frames;
+  auto collect = [&]() {
+    for (const Frame& frame : frames) {
+      result.frames.emplace_back(reinterpret_cast<const char*>(frame.data),
+                                 frame.size);
+      result.pts.push_back(frame.pts_us);
+      EXPECT_EQ(frame.num_samples, 1152);
+      EXPECT_EQ(frame.sample_rate, 44100);
+      EXPECT_EQ(frame.channels, 2);
+      EXPECT_EQ(frame.bitrate, 128);
+    }
+    frames.clear();
+  };
+  size_t offset = 0;
+  while (offset < stream.size()) {
+    size_t size = std::min<size_t>(1 + rng() % 700, stream.size() - offset);
+    framer->Push(stream.data() + offset, size, offset == 0 ? ptsUs : -1,
+                 &frames);
+    collect();
+    offset += size;
+  }
+  framer->Flush(&frames);
+  collect();
+  return result;
+}
+
+std::string AsString(const std::vector<uint8_t>& data) {
+  return std::string(data.begin(), data.end());
+}
+
+}  // namespace
+
+TEST(MPEGAudioFramerTest, Split) {
+  std::mt19937 rng(1);
+  std::vector<std::vector<uint8_t>> frames;
+  std::vector<uint8_t> stream = MakeId3Tag();
+  // junk with a sync word and a valid header that no frame follows
+  const uint8_t kJunk[] = {0x12, 0xff, 0xfb, 0x90, 0x00, 0x34, 0xff};
+  stream.insert(stream.end(), kJunk, kJunk + sizeof(kJunk));
+  for (int i = 0; i < 10; ++i) {
+    frames.push_back(MakeFrame(&rng, i % 3 == 1));
+    stream.insert(stream.end(), frames.back().begin(), frames.back().end());
+  }
+
+  for (uint32_t seed = 0; seed < 20; ++seed) {
+    MPEGAudioFramer framer;
+    Result result = Split(&framer, stream, seed, 100000);
+    ASSERT_EQ(result.frames.size(), frames.size()) << seed;
+    for (size_t i = 0; i < frames.size(); ++i) {
+      EXPECT_EQ(result.frames[i], AsString(frames[i]));
+      EXPECT_EQ(result.pts[i],
+                100000 + static_cast<int64_t>(i) * 1152 * 1000000 / 44100);
+    }
+    EXPECT_EQ(framer.vbr_header(), nullptr);
+  }
+}
+
+TEST(MPEGAudioFramerTest, Resync) {
+  std::mt19937 rng(2);
+  std::vector<std::vector<uint8_t>> frames;
+  std::vector<uint8_t> stream;
+  for (int i = 0; i < 10; ++i) {
+    frames.push_back(MakeFrame(&rng));
+    if (i == 5) {
+      // a damaged header
+      frames.back()[2] = 0xf0;
+    }
+    stream.insert(stream.end(), frames.back().begin(), frames.back().end());
+  }
+
+  for (uint32_t seed = 0; seed < 20; ++seed) {
+    MPEGAudioFramer framer;
+    Result result = Split(&framer, stream, seed, -1);
+    ASSERT_EQ(result.frames.size(), 9u) << seed;
+    for (size_t i = 0; i < result.frames.size(); ++i) {
+      EXPECT_EQ(result.frames[i], AsString(frames[i < 5 ? i : i + 1]));
+      EXPECT_EQ(result.pts[i], -1);
+    }
+  }
+}
+
+TEST(MPEGAudioFramerTest, XingLameHeader) {
+  std::mt19937 rng(3);
+  std::vector<uint8_t> info = MakeFrame(&rng);
+  // after 32 bytes of side information
+  uint8_t* xing = info.data() + 4 + 32;
+  memcpy(xing, "Xing", 4);
+  memset(xing + 4, 0, 12);
+  xing[7] = 0x0f;  // frames, bytes, TOC, quality
+  xing[11] = 10;
+  xing[14] = 0x10;
+  for (int i = 0; i < 100; ++i) {
+    xing[16 + i] = static_cast<uint8_t>(i * 2);
+  }
+  uint8_t* lame = xing + 120;
+  memcpy(lame, "LAME3.100", 9);
+  // delay 576, padding 1234
+  lame[21] = 0x24;
+  lame[22] = 0x04;
+  lame[23] = 0xd2;
+
+  std::vector<uint8_t> stream = info;
+  for (int i = 0; i < 9; ++i) {
+    std::vector<uint8_t> frame = MakeFrame(&rng);
+    stream.insert(stream.end(), frame.begin(), frame.end());
+  }
+
+  MPEGAudioFramer framer;
+  Result result = Split(&framer, stream, 0);
+  EXPECT_EQ(result.frames.size(), 9u);
+  EXPECT_EQ(result.pts[0], 0);
+  const MPEGAudioVbrHeader* header = framer.vbr_header();
+  ASSERT_NE(header, nullptr);
+  EXPECT_EQ(header->type, MPEGAudioVbrHeader::Type::kXing);
+  EXPECT_EQ(header->num_frames, 10u);
+  EXPECT_EQ(header->num_bytes, 0x1000u);
+  EXPECT_TRUE(header->has_toc);
+  EXPECT_EQ(header->toc[99], 198);
+  EXPECT_EQ(header->encoder_delay, 576);
+  EXPECT_EQ(header->encoder_padding, 1234);
+}
+
+TEST(MPEGAudioFramerTest, VbriHeader) {
+  std::mt19937 rng(4);
+  std::vector<uint8_t> frame = MakeFrame(&rng);
+  uint8_t* vbri = frame.data() + 4 + 32;
+  memcpy(vbri, "VBRI", 4);
+  memset(vbri + 4, 0, 14);
+  vbri[12] = 0x20;  // bytes
+  vbri[17] = 42;    // frames
+  MPEGAudioVbrHeader header;
+  ASSERT_TRUE(ParseMPEGAudioVbrHeader(frame.data(), frame.size(), &header));
+  EXPECT_EQ(header.type, MPEGAudioVbrHeader::Type::kVbri);
+  EXPECT_EQ(header.num_bytes, 0x2000u);
+  EXPECT_EQ(header.num_frames, 42u);
+  EXPECT_EQ(header.encoder_delay, -1);
+
+  frame = MakeFrame(&rng);
+  EXPECT_FALSE(ParseMPEGAudioVbrHeader(frame.data(), frame.size(), &header));
+}
+
+}  // namespace ave
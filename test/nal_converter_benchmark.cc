@@ -0,0 +1,127 @@
+/*
+ * nal_converter_benchmark.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../media_errors.h"
+#include "../nal_converter.h"
+
+namespace ave {
+
+namespace {
+
+const size_t kNumSamples = 600;
+const int kRounds = 5;
+
+// A GOP of 30 like a remuxed 1080p stream: IDR samples carry SPS/PPS and
+// large slices, the others smaller ones. Every NAL unit fits 2 byte lengths,
+// payloads are random bytes without start code emulations.
+std::vector<std::vector<uint8_t>> MakeSamples(size_t startCodeSize) {
+  std::mt19937 rng(1);
+  std::vector<std::vector<uint8_t>> samples(kNumSamples);
+  auto append = [&](std::vector<uint8_t>* sample, uint8_t header,
+                    size_t size) {
+    sample->insert(sample->end(), startCodeSize - 1, 0x00);
+    sample->push_back(0x01);
+    sample->push_back(header);
+    for (size_t i = 1; i < size; ++i) {
+      sample->push_back(static_cast<uint8_t>(0x10 + rng() % 0xf0));
+    }
+  };
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    if (i % 30 == 0) {
+      append(&samples[i], 0x67, 24);
+      append(&samples[i], 0x68, 6);
+      for (size_t slice = 0; slice < 4; ++slice) {
+        append(&samples[i], 0x65, 40000 + rng() % 20000);
+      }
+    } else {
+      for (size_t slice = 0; slice < 4; ++slice) {
+        append(&samples[i], 0x41, 2000 + rng() % 10000);
+      }
+    }
+  }
+  return samples;
+}
+
+// Converts fresh copies of |samples| each round, only the conversion is
+// timed. |slack| is the spare capacity of the copies.
+void Measure(const char* name,
+             const std::vector<std::vector<uint8_t>>& samples,
+             size_t lengthSize,
+             bool toAnnexB,
+             size_t slack) {
+  NALConverter converter(lengthSize);
+  size_t bytes = 0;
+  uint64_t checksum = 0;
+  double seconds = 0;
+  for (int round = 0; round < kRounds; round++) {
+    std::vector<std::shared_ptr<Buffer>> buffers;
+    for (const auto& sample : samples) {
+      auto buffer = std::make_shared<Buffer>(sample.size() + slack);
+      memcpy(buffer->data(), sample.data(), sample.size());
+      buffer->setRange(0, sample.size());
+      buffers.push_back(buffer);
+      bytes += sample.size();
+    }
+    auto start = std::chrono::steady_clock::now();
+    status_t err = toAnnexB ? converter.ToAnnexB(&buffers)
+                            : converter.ToLengthPrefixed(&buffers);
+    seconds += std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+    ASSERT_EQ(err, OK);
+    for (const auto& buffer : buffers) {
+      checksum += buffer->size() + buffer->data()[buffer->size() - 1];
+    }
+  }
+  printf("%s: %.1f MB/s (checksum %llu)\n", name, bytes / seconds / 1e6,
+         static_cast<unsigned long long>(checksum / kRounds));
+}
+
+std::vector<std::vector<uint8_t>> ToLengthPrefixed(
+    const std::vector<std::vector<uint8_t>>& samples,
+    size_t lengthSize) {
+  NALConverter converter(lengthSize);
+  std::vector<std::vector<uint8_t>> result;
+  for (const auto& sample : samples) {
+    std::vector<uint8_t> out(sample.size() + 64);
+    size_t size = 0;
+    EXPECT_EQ(converter.ToLengthPrefixed(sample.data(), sample.size(),
+                                         out.data(), out.size(), &size),
+              OK);
+    out.resize(size);
+    result.push_back(out);
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(NALConverterBenchmark, Remux) {
+  auto annexb4 = MakeSamples(4);
+  auto annexb3 = MakeSamples(3);
+  auto avcc4 = ToLengthPrefixed(annexb4, 4);
+  auto avcc2 = ToLengthPrefixed(annexb4, 2);
+
+  Measure("4 byte lengths to Annex-B, in place", avcc4, 4, true, 0);
+  Measure("2 byte lengths to Annex-B, out of place", avcc2, 2, true, 0);
+  Measure("Annex-B to 4 byte lengths, in place", annexb4, 4, false, 0);
+  Measure("Annex-B 3 byte start codes to 4 byte lengths, in place", annexb3,
+          4, false, 64);
+  Measure("Annex-B 3 byte start codes to 4 byte lengths, out of place",
+          annexb3, 4, false, 0);
+}
+
+}  // namespace ave
@@ -0,0 +1,206 @@
+/*
+ * nal_converter_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../media_errors.h"
+#include "../nal_converter.h"
+
+namespace ave {
+
+namespace {
+
+// SPS, PPS, IDR slice with an emulation prevention byte and trailing zeros.
+const uint8_t kAnnexB3[] = {
+    0x00, 0x00, 0x01, 0x67, 0x42, 0x00, 0x1e, 0x00, 0x00, 0x01, 0x68,
+    0xce, 0x3c, 0x80, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00, 0x00,
+    0x03, 0x01, 0x00, 0x00,
+};
+
+const uint8_t kAnnexB4[] = {
+    0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0x00, 0x1e, 0x00, 0x00,
+    0x00, 0x01, 0x68, 0xce, 0x3c, 0x80, 0x00, 0x00, 0x00, 0x01,
+    0x65, 0x88, 0x84, 0x00, 0x00, 0x03, 0x01,
+};
+
+std::string LengthPrefixed(size_t lengthSize) {
+  const std::string kNals[] = {
+      std::string("\x67\x42\x00\x1e", 4),
+      std::string("\x68\xce\x3c\x80", 4),
+      std::string("\x65\x88\x84\x00\x00\x03\x01", 7),
+  };
+  std::string result;
+  for (const auto& nal : kNals) {
+    result.append(lengthSize - 1, '\0');
+    result.push_back(static_cast<char>(nal.size()));
+    result += nal;
+  }
+  return result;
+}
+
+std::string Contents(const std::shared_ptr<Buffer>& buffer) {
+  return std::string(reinterpret_cast<const char*>(buffer->data()),
+                     buffer->size());
+}
+
+std::shared_ptr<Buffer> MakeBuffer(const uint8_t* data,
+                                   size_t size,
+                                   size_t capacity) {
+  auto buffer = std::make_shared<Buffer>(capacity);
+  memcpy(buffer->data(), data, size);
+  buffer->setRange(0, size);
+  return buffer;
+}
+
+}  // namespace
+
+TEST(NALConverterTest, RoundTrip) {
+  for (size_t lengthSize : {1, 2, 4}) {
+    NALConverter converter(lengthSize);
+    std::vector<uint8_t> out(64);
+    size_t size = 0;
+    ASSERT_EQ(converter.ToLengthPrefixed(kAnnexB3, sizeof(kAnnexB3),
+                                         out.data(), out.size(), &size),
+              OK);
+    EXPECT_EQ(std::string(reinterpret_cast<char*>(out.data()), size),
+              LengthPrefixed(lengthSize));
+
+    std::vector<uint8_t> annexb(64);
+    ASSERT_EQ(converter.ToAnnexB(out.data(), size, annexb.data(),
+                                 annexb.size(), &size),
+              OK);
+    EXPECT_EQ(std::string(reinterpret_cast<char*>(annexb.data()), size),
+              std::string(reinterpret_cast<const char*>(kAnnexB4),
+                          sizeof(kAnnexB4)));
+
+    EXPECT_EQ(converter.ToAnnexB(out.data(), 0, annexb.data(), 26, &size),
+              OK);
+    EXPECT_EQ(size, 0u);
+    EXPECT_EQ(converter.ToLengthPrefixed(kAnnexB3, sizeof(kAnnexB3),
+                                         out.data(), 10, &size),
+              ERROR_BUFFER_TOO_SMALL);
+  }
+}
+
+TEST(NALConverterTest, InPlace) {
+  NALConverter converter(4);
+  auto buffer = MakeBuffer(kAnnexB4, sizeof(kAnnexB4), sizeof(kAnnexB4));
+  Buffer* original = buffer.get();
+  ASSERT_EQ(converter.ToLengthPrefixed(&buffer), OK);
+  EXPECT_EQ(buffer.get(), original);
+  EXPECT_EQ(Contents(buffer), LengthPrefixed(4));
+  ASSERT_EQ(converter.ToAnnexB(&buffer), OK);
+  EXPECT_EQ(buffer.get(), original);
+  EXPECT_EQ(Contents(buffer),
+            std::string(reinterpret_cast<const char*>(kAnnexB4),
+                        sizeof(kAnnexB4)));
+
+  // 3 byte start codes grow into the spare capacity, from the back
+  buffer = MakeBuffer(kAnnexB3, sizeof(kAnnexB3), 64);
+  original = buffer.get();
+  ASSERT_EQ(converter.ToLengthPrefixed(&buffer), OK);
+  EXPECT_EQ(buffer.get(), original);
+  EXPECT_EQ(Contents(buffer), LengthPrefixed(4));
+
+  // 2 byte lengths shrink towards the front
+  NALConverter shortConverter(2);
+  buffer = MakeBuffer(kAnnexB4, sizeof(kAnnexB4), sizeof(kAnnexB4));
+  original = buffer.get();
+  ASSERT_EQ(shortConverter.ToLengthPrefixed(&buffer), OK);
+  EXPECT_EQ(buffer.get(), original);
+  EXPECT_EQ(Contents(buffer), LengthPrefixed(2));
+}
+
+TEST(NALConverterTest, Pool) {
+  NALConverter converter(2);
+  std::string input = LengthPrefixed(2);
+  auto buffer = MakeBuffer(reinterpret_cast<const uint8_t*>(input.data()),
+                           input.size(), input.size());
+  buffer->sampleMeta().pts_us = 40000;
+  buffer->sampleMeta().sync = true;
+  buffer->setInt32Data(7);
+  buffer->meta()->setInt32("layer", 1);
+  Buffer* original = buffer.get();
+  ASSERT_EQ(converter.ToAnnexB(&buffer), OK);
+  ASSERT_NE(buffer.get(), original);
+  EXPECT_EQ(Contents(buffer),
+            std::string(reinterpret_cast<const char*>(kAnnexB4),
+                        sizeof(kAnnexB4)));
+  EXPECT_EQ(buffer->sampleMeta().pts_us, 40000);
+  EXPECT_TRUE(buffer->sampleMeta().sync);
+  EXPECT_EQ(buffer->int32Data(), 7);
+  int32_t layer = 0;
+  ASSERT_TRUE(buffer->hasMeta());
+  EXPECT_TRUE(buffer->meta()->findInt32("layer", &layer));
+  EXPECT_EQ(layer, 1);
+
+  // a second sample while the first one is in use gets another buffer
+  auto second = MakeBuffer(reinterpret_cast<const uint8_t*>(input.data()),
+                           input.size(), input.size());
+  ASSERT_EQ(converter.ToAnnexB(&second), OK);
+  EXPECT_NE(second.get(), buffer.get());
+
+  // dropped buffers are reused
+  Buffer* pooled = buffer.get();
+  buffer = MakeBuffer(reinterpret_cast<const uint8_t*>(input.data()),
+                      input.size(), input.size());
+  ASSERT_EQ(converter.ToAnnexB(&buffer), OK);
+  EXPECT_EQ(buffer.get(), pooled);
+  // nothing of the previous sample is left
+  EXPECT_EQ(buffer->sampleMeta().pts_us, -1);
+  EXPECT_EQ(buffer->int32Data(), 0);
+  EXPECT_FALSE(buffer->hasMeta());
+}
+
+TEST(NALConverterTest, Batch) {
+  NALConverter converter(4);
+  std::vector<std::shared_ptr<Buffer>> buffers;
+  for (int i = 0; i < 10; ++i) {
+    buffers.push_back(i % 2 ? MakeBuffer(kAnnexB3, sizeof(kAnnexB3),
+                                         sizeof(kAnnexB3))
+                            : MakeBuffer(kAnnexB4, sizeof(kAnnexB4),
+                                         sizeof(kAnnexB4)));
+  }
+  ASSERT_EQ(converter.ToLengthPrefixed(&buffers), OK);
+  for (const auto& buffer : buffers) {
+    EXPECT_EQ(Contents(buffer), LengthPrefixed(4));
+  }
+  ASSERT_EQ(converter.ToAnnexB(&buffers), OK);
+  for (const auto& buffer : buffers) {
+    EXPECT_EQ(Contents(buffer),
+              std::string(reinterpret_cast<const char*>(kAnnexB4),
+                          sizeof(kAnnexB4)));
+  }
+}
+
+TEST(NALConverterTest, Malformed) {
+  NALConverter converter(1);
+  std::vector<uint8_t> out(1024);
+  size_t size = 0;
+  // a NAL unit of 300 bytes does not fit a 1 byte length
+  std::vector<uint8_t> annexb = {0x00, 0x00, 0x01, 0x65};
+  annexb.resize(annexb.size() + 299, 0x80);
+  EXPECT_EQ(converter.ToLengthPrefixed(annexb.data(), annexb.size(),
+                                       out.data(), out.size(), &size),
+            ERROR_OUT_OF_RANGE);
+
+  const uint8_t kTruncated[] = {0x04, 0x67, 0x42, 0x00};
+  EXPECT_EQ(converter.ToAnnexB(kTruncated, sizeof(kTruncated), out.data(),
+                               out.size(), &size),
+            ERROR_MALFORMED);
+  NALConverter longConverter(4);
+  EXPECT_EQ(longConverter.ToAnnexB(kTruncated, 2, out.data(), out.size(),
+                                   &size),
+            ERROR_MALFORMED);
+}
+
+}  // namespace ave
@@ -0,0 +1,138 @@
+/*
+ * nal_indexer_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../avc_utils.h"
+
+namespace ave {
+
+namespace {
+
+// SPS, PPS, IDR slice and a slice with an emulation prevention byte.
+const uint8_t kAvcStream[] = {
+    0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0x00, 0x1e, 0x00, 0x00, 0x01,
+    0x68, 0xce, 0x3c, 0x80, 0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84,
+    0x00, 0x00, 0x03, 0x01, 0x00, 0x00, 0x01, 0x41, 0x9a, 0x00,
+};
+
+std::vector<std::string> Contents(const uint8_t* data,
+                                  const std::vector<NALPosition>& nals) {
+  std::vector<std::string> contents;
+  for (const auto& nal : nals) {
+    contents.emplace_back(
+        reinterpret_cast<const char*>(data) + nal.nalOffset, nal.nalSize);
+  }
+  return contents;
+}
+
+}  // namespace
+
+TEST(NALIndexerTest, AVC) {
+  std::vector<NALPosition> nals;
+  FindNALUnits(kAvcStream, sizeof(kAvcStream), NALFormat::kAVC, &nals);
+  ASSERT_EQ(nals.size(), 4u);
+
+  EXPECT_EQ(nals[0].nalOffset, 4u);
+  EXPECT_EQ(nals[0].nalSize, 4u);
+  EXPECT_EQ(nals[0].nalType, 7);
+  EXPECT_EQ(nals[1].nalOffset, 11u);
+  // the zero of the next four byte start code is not part of the NAL unit
+  EXPECT_EQ(nals[1].nalSize, 4u);
+  EXPECT_EQ(nals[1].nalType, 8);
+  EXPECT_EQ(nals[2].nalOffset, 19u);
+  EXPECT_EQ(nals[2].nalSize, 7u);
+  EXPECT_EQ(nals[2].nalType, 5);
+  EXPECT_EQ(nals[3].nalOffset, 29u);
+  EXPECT_EQ(nals[3].nalSize, 2u);
+  EXPECT_EQ(nals[3].nalType, 1);
+}
+
+TEST(NALIndexerTest, HEVC) {
+  const uint8_t stream[] = {
+      0x00, 0x00, 0x00, 0x01, 0x40, 0x01, 0x0c, 0x00, 0x00, 0x00, 0x01,
+      0x42, 0x01, 0x01, 0x00, 0x00, 0x01, 0x44, 0x01, 0xc1, 0x00, 0x00,
+      0x01, 0x26, 0x01, 0xaf, 0x00, 0x00, 0x01, 0x02, 0x01, 0xd0,
+  };
+  std::vector<NALPosition> nals;
+  FindNALUnits(stream, sizeof(stream), NALFormat::kHEVC, &nals);
+  ASSERT_EQ(nals.size(), 5u);
+  EXPECT_EQ(nals[0].nalType, 32);
+  EXPECT_EQ(nals[0].nalSize, 3u);
+  EXPECT_EQ(nals[1].nalType, 33);
+  EXPECT_EQ(nals[2].nalType, 34);
+  EXPECT_EQ(nals[3].nalType, 19);
+  EXPECT_EQ(nals[4].nalType, 1);
+  EXPECT_EQ(nals[4].nalOffset, 29u);
+  EXPECT_EQ(nals[4].nalSize, 3u);
+}
+
+TEST(NALIndexerTest, NoStartCode) {
+  const uint8_t garbage[] = {0x12, 0x00, 0x00, 0x02, 0x34};
+  std::vector<NALPosition> nals;
+  FindNALUnits(garbage, sizeof(garbage), NALFormat::kAVC, &nals);
+  EXPECT_TRUE(nals.empty());
+
+  // data before the first start code is dropped, the tail is kept in case a
+  // start code continues in the next chunk
+  NALIndexer indexer(NALFormat::kAVC);
+  const uint8_t head[] = {0xaa, 0xbb, 0xcc, 0x00, 0x00};
+  EXPECT_EQ(indexer.Index(head, sizeof(head), &nals), 3u);
+  const uint8_t rest[] = {0x00, 0x00, 0x01, 0x09, 0xf0};
+  EXPECT_EQ(indexer.Index(rest, sizeof(rest), &nals, true), sizeof(rest));
+  ASSERT_EQ(nals.size(), 1u);
+  EXPECT_EQ(nals[0].nalOffset, 3u);
+  EXPECT_EQ(nals[0].nalType, 9);
+}
+
+TEST(NALIndexerTest, StreamingMatchesOneShot) {
+  std::vector<uint8_t> stream;
+  std::mt19937 rng(7);
+  for (int i = 0; i < 200; i++) {
+    const uint8_t start_code[] = {0x00, 0x00, 0x00, 0x01};
+    stream.insert(stream.end(), start_code + (rng() % 2), start_code + 4);
+    stream.push_back(static_cast<uint8_t>(0x01 + rng() % 0x1f));
+    size_t length = rng() % 64;
+    for (size_t j = 0; j < length; j++) {
+      uint32_t r = rng() % 8;
+      stream.push_back(r < 2 ? 0x00 : r < 3 ? 0x03 : 0xa5);
+    }
+  }
+
+  std::vector<NALPosition> expected;
+  FindNALUnits(stream.data(), stream.size(), NALFormat::kAVC, &expected);
+  auto expected_contents = Contents(stream.data(), expected);
+
+  for (int round = 0; round < 50; round++) {
+    NALIndexer indexer(NALFormat::kAVC);
+    std::vector<uint8_t> buffer;
+    std::vector<std::string> contents;
+    size_t pos = 0;
+    while (pos < stream.size()) {
+      size_t chunk = std::min<size_t>(1 + rng() % 40, stream.size() - pos);
+      buffer.insert(buffer.end(), stream.begin() + pos,
+                    stream.begin() + pos + chunk);
+      pos += chunk;
+
+      std::vector<NALPosition> nals;
+      size_t consumed = indexer.Index(buffer.data(), buffer.size(), &nals,
+                                      pos == stream.size());
+      for (const auto& content : Contents(buffer.data(), nals)) {
+        contents.push_back(content);
+      }
+      buffer.erase(buffer.begin(), buffer.begin() + consumed);
+    }
+    EXPECT_TRUE(buffer.empty());
+    ASSERT_EQ(contents, expected_contents) << "round " << round;
+  }
+}
+
+}  // namespace ave
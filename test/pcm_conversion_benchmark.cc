@@ -0,0 +1,182 @@
+/*
+ * pcm_conversion_benchmark.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../pcm_conversion.h"
+
+namespace ave {
+
+namespace {
+
+// 10 ms of 48 kHz stereo at a time, as a render callback converts it
+const size_t kChunkSamples = 960;
+// about a minute of 48 kHz stereo
+const size_t kSamples = 960 * 6000;
+
+const struct {
+  PcmImpl impl;
+  const char* name;
+} kImpls[] = {
+    {PcmImpl::kScalar, "scalar"},
+    {PcmImpl::kSSE2, "SSE2"},
+    {PcmImpl::kAVX2, "AVX2"},
+    {PcmImpl::kNEON, "NEON"},
+};
+
+const struct {
+  AudioEncoding encoding;
+  const char* name;
+} kEncodings[] = {
+    {kAudioEncodingPcm8bit, "u8"},
+    {kAudioEncodingPcm16bit, "s16"},
+    {kAudioEncodingPcm24bitPacked, "s24"},
+    {kAudioEncodingPcm32bit, "s32"},
+    {kAudioEncodingPcmFloat, "float"},
+};
+
+// Random bytes make valid samples of every encoding but float, which gets
+// values in [-1, 1).
+std::vector<uint8_t> MakeInput(AudioEncoding encoding) {
+  std::mt19937 rng(1);
+  std::vector<uint8_t> data(kSamples * GetPcmSampleSize(encoding));
+  if (encoding == kAudioEncodingPcmFloat) {
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    float* floats = reinterpret_cast<float*>(data.data());
+    for (size_t i = 0; i < kSamples; i++) {
+      floats[i] = dist(rng);
+    }
+  } else {
+    for (auto& byte : data) {
+      byte = static_cast<uint8_t>(rng());
+    }
+  }
+  return data;
+}
+
+// Runs |convert| over the input chunk by chunk and prints samples per
+// second.
+template <typename Convert>
+void Measure(const char* name, size_t samples, Convert convert) {
+  // warm up the caches and the dispatch
+  convert(0, kChunkSamples);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t done = 0; done < samples; done += kChunkSamples) {
+    convert(done, std::min(kChunkSamples, samples - done));
+  }
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  printf("%-32s %8.1f M samples/s\n", name, samples / seconds / 1e6);
+}
+
+}  // namespace
+
+TEST(PcmConversionBenchmark, Kernels) {
+  for (const auto& from : kEncodings) {
+    auto in = MakeInput(from.encoding);
+    size_t in_size = GetPcmSampleSize(from.encoding);
+    for (const auto& to : kEncodings) {
+      size_t out_size = GetPcmSampleSize(to.encoding);
+      std::vector<uint8_t> out(kSamples * out_size);
+      for (const auto& impl : kImpls) {
+        PcmConvertProc convert =
+            GetPcmConverter(impl.impl, from.encoding, to.encoding);
+        if (convert == nullptr) {
+          continue;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "%s to %s, %s", from.name, to.name,
+                 impl.name);
+        Measure(name, kSamples, [&](size_t offset, size_t count) {
+          convert(in.data() + offset * in_size, out.data() + offset * out_size,
+                  count);
+        });
+      }
+    }
+  }
+
+  auto in = MakeInput(kAudioEncodingPcmFloat);
+  const float* floats = reinterpret_cast<const float*>(in.data());
+  std::vector<int16_t> out(kSamples);
+  for (const auto& impl : kImpls) {
+    PcmDitherProc convert = GetPcmDitherConverter(impl.impl);
+    if (convert == nullptr) {
+      continue;
+    }
+    uint32_t state[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    char name[64];
+    snprintf(name, sizeof(name), "float to s16 dithered, %s", impl.name);
+    Measure(name, kSamples, [&](size_t offset, size_t count) {
+      convert(floats + offset, out.data() + offset, count, state);
+    });
+  }
+}
+
+// Every pair through ConvertPcm(), including the composed ones.
+TEST(PcmConversionBenchmark, ConvertPcm) {
+  for (const auto& from : kEncodings) {
+    auto in = MakeInput(from.encoding);
+    size_t in_size = GetPcmSampleSize(from.encoding);
+    for (const auto& to : kEncodings) {
+      if (from.encoding == to.encoding) {
+        continue;
+      }
+      size_t out_size = GetPcmSampleSize(to.encoding);
+      std::vector<uint8_t> out(kSamples * out_size);
+      char name[64];
+      snprintf(name, sizeof(name), "%s to %s", from.name, to.name);
+      Measure(name, kSamples, [&](size_t offset, size_t count) {
+        ConvertPcm(from.encoding, in.data() + offset * in_size, to.encoding,
+                   out.data() + offset * out_size, count);
+      });
+    }
+  }
+}
+
+TEST(PcmConversionBenchmark, Interleave) {
+  const size_t kChannels[] = {1, 2, 4, 6, 8};
+  for (const auto& encoding : kEncodings) {
+    auto in = MakeInput(encoding.encoding);
+    size_t size = GetPcmSampleSize(encoding.encoding);
+    std::vector<uint8_t> out(in.size());
+    for (size_t channels : kChannels) {
+      size_t frames = kSamples / channels;
+      std::vector<const void*> planes(channels);
+      std::vector<void*> out_planes(channels);
+      char name[64];
+      snprintf(name, sizeof(name), "interleave %zu x %s", channels,
+               encoding.name);
+      Measure(name, frames * channels, [&](size_t offset, size_t count) {
+        size_t frame = offset / channels;
+        for (size_t ch = 0; ch < channels; ch++) {
+          planes[ch] = in.data() + (ch * frames + frame) * size;
+        }
+        InterleavePcm(encoding.encoding, planes.data(), channels,
+                      count / channels, out.data() + offset * size);
+      });
+      snprintf(name, sizeof(name), "deinterleave %zu x %s", channels,
+               encoding.name);
+      Measure(name, frames * channels, [&](size_t offset, size_t count) {
+        size_t frame = offset / channels;
+        for (size_t ch = 0; ch < channels; ch++) {
+          out_planes[ch] = out.data() + (ch * frames + frame) * size;
+        }
+        DeinterleavePcm(encoding.encoding, in.data() + offset * size,
+                        channels, count / channels, out_planes.data());
+      });
+    }
+  }
+}
+
+}  // namespace ave
@@ -0,0 +1,311 @@
+/*
+ * pcm_conversion_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../pcm_conversion.h"
+
+namespace ave {
+
+namespace {
+
+const PcmImpl kImpls[] = {
+    PcmImpl::kScalar,
+    PcmImpl::kSSE2,
+    PcmImpl::kAVX2,
+    PcmImpl::kNEON,
+};
+
+const AudioEncoding kEncodings[] = {
+    kAudioEncodingPcm8bit,        kAudioEncodingPcm16bit,
+    kAudioEncodingPcm24bitPacked, kAudioEncodingPcm32bit,
+    kAudioEncodingPcmFloat,
+};
+
+// Random samples of |encoding|, with the extremes at the start. Floats go a
+// bit beyond full scale to exercise the clamping.
+std::vector<uint8_t> MakeSamples(AudioEncoding encoding,
+                                 size_t samples,
+                                 uint32_t seed) {
+  std::mt19937 rng(seed);
+  size_t size = GetPcmSampleSize(encoding);
+  std::vector<uint8_t> data(samples * size);
+  for (auto& byte : data) {
+    byte = static_cast<uint8_t>(rng());
+  }
+  if (samples == 0) {
+    return data;
+  }
+  if (encoding == kAudioEncodingPcmFloat) {
+    std::uniform_real_distribution<float> dist(-1.2f, 1.2f);
+    float* floats = reinterpret_cast<float*>(data.data());
+    for (size_t i = 0; i < samples; i++) {
+      floats[i] = dist(rng);
+    }
+    const float extremes[] = {1.0f, -1.0f, 0.0f, 0.99999f, -1.00001f, 2.0f};
+    memcpy(floats, extremes, std::min(sizeof(extremes), data.size()));
+  } else if (encoding == kAudioEncodingPcm32bit) {
+    int32_t* ints = reinterpret_cast<int32_t*>(data.data());
+    const int32_t extremes[] = {std::numeric_limits<int32_t>::max(),
+                                std::numeric_limits<int32_t>::min(),
+                                0x7fff8000, 0x7fffff80, -1, 0x8000};
+    memcpy(ints, extremes, std::min(sizeof(extremes), data.size()));
+  } else if (encoding == kAudioEncodingPcm16bit) {
+    int16_t* shorts = reinterpret_cast<int16_t*>(data.data());
+    const int16_t extremes[] = {32767, -32768, -1, 0x80, 0x7f, 0};
+    memcpy(shorts, extremes, std::min(sizeof(extremes), data.size()));
+  }
+  return data;
+}
+
+std::vector<uint8_t> Convert(AudioEncoding from,
+                             const std::vector<uint8_t>& in,
+                             AudioEncoding to) {
+  size_t samples = in.size() / GetPcmSampleSize(from);
+  std::vector<uint8_t> out(samples * GetPcmSampleSize(to));
+  EXPECT_EQ(ConvertPcm(from, in.data(), to, out.data(), samples), OK);
+  return out;
+}
+
+}  // namespace
+
+TEST(PcmConversionTest, AllImplementationsAgree) {
+  for (AudioEncoding from : kEncodings) {
+    for (AudioEncoding to : kEncodings) {
+      PcmConvertProc reference =
+          GetPcmConverter(PcmImpl::kScalar, from, to);
+      for (PcmImpl impl : kImpls) {
+        PcmConvertProc convert = GetPcmConverter(impl, from, to);
+        if (convert == nullptr) {
+          continue;
+        }
+        ASSERT_NE(reference, nullptr);
+        // every tail length of the widest kernels
+        for (size_t samples : {0, 1, 15, 16, 33, 1000}) {
+          auto in = MakeSamples(from, samples, 5);
+          std::vector<uint8_t> expected(samples * GetPcmSampleSize(to));
+          std::vector<uint8_t> out(expected.size());
+          reference(in.data(), expected.data(), samples);
+          convert(in.data(), out.data(), samples);
+          ASSERT_EQ(out, expected)
+              << from << " to " << to << ", impl "
+              << static_cast<int>(impl) << ", " << samples << " samples";
+        }
+      }
+    }
+  }
+}
+
+TEST(PcmConversionTest, Values) {
+  const float floats[] = {1.0f, -1.0f, 0.5f, -0.25f, 1.5f, 0.0f};
+  int16_t s16[6];
+  int32_t s32[6];
+  uint8_t u8[6];
+  ASSERT_EQ(ConvertPcm(kAudioEncodingPcmFloat, floats, kAudioEncodingPcm16bit,
+                       s16, 6),
+            OK);
+  EXPECT_EQ(std::vector<int16_t>(s16, s16 + 6),
+            (std::vector<int16_t>{32767, -32768, 16384, -8192, 32767, 0}));
+  ASSERT_EQ(ConvertPcm(kAudioEncodingPcmFloat, floats, kAudioEncodingPcm32bit,
+                       s32, 6),
+            OK);
+  EXPECT_EQ(std::vector<int32_t>(s32, s32 + 6),
+            (std::vector<int32_t>{std::numeric_limits<int32_t>::max(),
+                                  std::numeric_limits<int32_t>::min(),
+                                  1 << 30, -(1 << 29),
+                                  std::numeric_limits<int32_t>::max(), 0}));
+  ASSERT_EQ(ConvertPcm(kAudioEncodingPcmFloat, floats, kAudioEncodingPcm8bit,
+                       u8, 6),
+            OK);
+  EXPECT_EQ(std::vector<uint8_t>(u8, u8 + 6),
+            (std::vector<uint8_t>{255, 0, 192, 96, 255, 128}));
+
+  // rounding halves up, saturating at the top
+  const int16_t shorts[] = {0x7f, 0x80, -0x80, -0x81, 32767, -32768};
+  ASSERT_EQ(ConvertPcm(kAudioEncodingPcm16bit, shorts, kAudioEncodingPcm8bit,
+                       u8, 6),
+            OK);
+  EXPECT_EQ(std::vector<uint8_t>(u8, u8 + 6),
+            (std::vector<uint8_t>{128, 129, 128, 127, 255, 0}));
+
+  const int32_t ints[] = {0x12345678, -0x12345678, 0x7fffffff};
+  uint8_t s24[9];
+  ASSERT_EQ(ConvertPcm(kAudioEncodingPcm32bit, ints,
+                       kAudioEncodingPcm24bitPacked, s24, 3),
+            OK);
+  EXPECT_EQ(std::vector<uint8_t>(s24, s24 + 9),
+            (std::vector<uint8_t>{0x56, 0x34, 0x12, 0xaa, 0xcb, 0xed, 0xff,
+                                  0xff, 0x7f}));
+}
+
+// Widening and narrowing back gives the original samples, whichever way the
+// conversion is composed.
+TEST(PcmConversionTest, RoundTrip) {
+  for (AudioEncoding narrow : kEncodings) {
+    for (AudioEncoding wide : kEncodings) {
+      if (GetPcmSampleSize(wide) < GetPcmSampleSize(narrow) ||
+          narrow == kAudioEncodingPcmFloat ||
+          (narrow == kAudioEncodingPcm32bit &&
+           wide == kAudioEncodingPcmFloat)) {
+        continue;
+      }
+      auto in = MakeSamples(narrow, 777, 9);
+      EXPECT_EQ(Convert(wide, Convert(narrow, in, wide), narrow), in)
+          << narrow << " through " << wide;
+    }
+  }
+}
+
+TEST(PcmConversionTest, InPlace) {
+  for (AudioEncoding from : kEncodings) {
+    for (AudioEncoding to : kEncodings) {
+      if (GetPcmSampleSize(to) > GetPcmSampleSize(from)) {
+        continue;
+      }
+      const size_t samples = 1001;
+      auto in = MakeSamples(from, samples, 11);
+      auto expected = Convert(from, in, to);
+      ASSERT_EQ(ConvertPcm(from, in.data(), to, in.data(), samples), OK);
+      in.resize(expected.size());
+      EXPECT_EQ(in, expected) << from << " to " << to;
+    }
+  }
+}
+
+TEST(PcmConversionTest, Dither) {
+  std::vector<float> silence(4096, 0.0f);
+  std::vector<int16_t> out(silence.size());
+  PcmDither dither;
+  ASSERT_EQ(ConvertPcm(kAudioEncodingPcmFloat, silence.data(),
+                       kAudioEncodingPcm16bit, out.data(), out.size(),
+                       &dither),
+            OK);
+  // TPDF noise of one LSB peak
+  int sum = 0;
+  int nonzero = 0;
+  for (int16_t sample : out) {
+    ASSERT_GE(sample, -1);
+    ASSERT_LE(sample, 1);
+    sum += sample;
+    nonzero += sample != 0;
+  }
+  EXPECT_GT(nonzero, 200);
+  EXPECT_LT(std::abs(sum), 100);
+
+  // splitting the buffer does not change the noise
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> dist(-1.1f, 1.1f);
+  std::vector<float> in(1003);
+  for (auto& sample : in) {
+    sample = dist(rng);
+  }
+  std::vector<int16_t> whole(in.size());
+  std::vector<int16_t> split(in.size());
+  PcmDither whole_dither(42);
+  PcmDither split_dither(42);
+  ASSERT_EQ(ConvertPcm(kAudioEncodingPcmFloat, in.data(),
+                       kAudioEncodingPcm16bit, whole.data(), in.size(),
+                       &whole_dither),
+            OK);
+  ASSERT_EQ(ConvertPcm(kAudioEncodingPcmFloat, in.data(),
+                       kAudioEncodingPcm16bit, split.data(), 512,
+                       &split_dither),
+            OK);
+  ASSERT_EQ(ConvertPcm(kAudioEncodingPcmFloat, in.data() + 512,
+                       kAudioEncodingPcm16bit, split.data() + 512,
+                       in.size() - 512, &split_dither),
+            OK);
+  EXPECT_EQ(split, whole);
+
+  // every implementation draws the same noise
+  const uint32_t kState[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  std::vector<int16_t> expected(in.size());
+  uint32_t reference_state[8];
+  memcpy(reference_state, kState, sizeof(kState));
+  GetPcmDitherConverter(PcmImpl::kScalar)(in.data(), expected.data(),
+                                          in.size(), reference_state);
+  for (PcmImpl impl : kImpls) {
+    PcmDitherProc convert = GetPcmDitherConverter(impl);
+    if (convert == nullptr) {
+      continue;
+    }
+    uint32_t state[8];
+    memcpy(state, kState, sizeof(kState));
+    std::vector<int16_t> result(in.size());
+    convert(in.data(), result.data(), in.size(), state);
+    for (size_t i = 0; i < in.size(); i++) {
+      // a fused multiply-add may round the other way
+      ASSERT_NEAR(result[i], expected[i], 1)
+          << "impl " << static_cast<int>(impl) << ", sample " << i;
+    }
+    EXPECT_EQ(memcmp(state, reference_state, sizeof(state)), 0);
+  }
+}
+
+TEST(PcmConversionTest, Interleave) {
+  const AudioEncoding kInterleaved[] = {
+      kAudioEncodingPcm8bit, kAudioEncodingPcm16bit,
+      kAudioEncodingPcm24bitPacked, kAudioEncodingPcmFloat};
+  const size_t frames = 37;
+  for (AudioEncoding encoding : kInterleaved) {
+    size_t size = GetPcmSampleSize(encoding);
+    for (size_t channels = 1; channels <= 8; channels++) {
+      std::vector<uint8_t> interleaved(frames * channels * size);
+      for (size_t i = 0; i < interleaved.size(); i++) {
+        interleaved[i] = static_cast<uint8_t>(i * 7 + i / 251);
+      }
+      std::vector<std::vector<uint8_t>> planes(
+          channels, std::vector<uint8_t>(frames * size));
+      std::vector<void*> plane_ptrs;
+      for (auto& plane : planes) {
+        plane_ptrs.push_back(plane.data());
+      }
+      ASSERT_EQ(DeinterleavePcm(encoding, interleaved.data(), channels,
+                                frames, plane_ptrs.data()),
+                OK);
+      for (size_t ch = 0; ch < channels; ch++) {
+        for (size_t i = 0; i < frames; i++) {
+          ASSERT_EQ(memcmp(planes[ch].data() + i * size,
+                           interleaved.data() + (i * channels + ch) * size,
+                           size),
+                    0)
+              << encoding << ", " << channels << " channels";
+        }
+      }
+
+      std::vector<uint8_t> out(interleaved.size());
+      std::vector<const void*> const_ptrs(plane_ptrs.begin(),
+                                          plane_ptrs.end());
+      ASSERT_EQ(InterleavePcm(encoding, const_ptrs.data(), channels, frames,
+                              out.data()),
+                OK);
+      EXPECT_EQ(out, interleaved);
+    }
+  }
+
+  std::vector<int16_t> samples(9 * 4);
+  std::vector<void*> planes(9, samples.data());
+  EXPECT_EQ(DeinterleavePcm(kAudioEncodingPcm16bit, samples.data(), 9, 4,
+                            planes.data()),
+            ERROR_UNSUPPORTED);
+}
+
+TEST(PcmConversionTest, UnsupportedEncoding) {
+  int16_t in[2] = {};
+  int16_t out[2];
+  EXPECT_EQ(GetPcmSampleSize(static_cast<AudioEncoding>(1)), 0u);
+  EXPECT_EQ(ConvertPcm(static_cast<AudioEncoding>(1), in,
+                       kAudioEncodingPcm16bit, out, 2),
+            ERROR_UNSUPPORTED);
+}
+
+}  // namespace ave
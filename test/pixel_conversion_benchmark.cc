@@ -0,0 +1,88 @@
+/*
+ * pixel_conversion_benchmark.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../pixel_conversion.h"
+
+namespace ave {
+
+namespace {
+
+const uint32_t kWidth = 1920;
+const uint32_t kHeight = 1080;
+const int kFrames = 100;
+
+const struct {
+  PixelImpl impl;
+  const char* name;
+} kImpls[] = {
+    {PixelImpl::kScalar, "scalar"},
+    {PixelImpl::kAVX2, "AVX2"},
+    {PixelImpl::kNEON, "NEON"},
+};
+
+const struct {
+  PixelFormat from;
+  PixelFormat to;
+  const char* name;
+} kPairs[] = {
+    {AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P, "NV12 to I420"},
+    {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, "I420 to NV12"},
+    {AV_PIX_FMT_YUYV422, AV_PIX_FMT_YUV420P, "YUYV to I420"},
+    {AV_PIX_FMT_P010LE, AV_PIX_FMT_YUV420P10LE, "P010 to I010"},
+    {AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE, "I010 to P010"},
+    {AV_PIX_FMT_RGBA, AV_PIX_FMT_YUV420P, "RGBA to I420"},
+    {AV_PIX_FMT_YUV420P, AV_PIX_FMT_RGBA, "I420 to RGBA"},
+};
+
+// Random bytes, which are valid pixels for the benchmark's purpose.
+std::vector<uint8_t> MakeFrame(PixelFormat format) {
+  std::mt19937 rng(1);
+  std::vector<uint8_t> data(FrameView::FrameSize(format, kWidth, kHeight));
+  for (auto& byte : data) {
+    byte = static_cast<uint8_t>(rng());
+  }
+  return data;
+}
+
+}  // namespace
+
+TEST(PixelConversionBenchmark, ConvertFrame) {
+  YuvColorSpace color;
+  color.matrix = YuvColorSpace::kBT709;
+  for (const auto& pair : kPairs) {
+    std::vector<uint8_t> in = MakeFrame(pair.from);
+    std::vector<uint8_t> out(FrameView::FrameSize(pair.to, kWidth, kHeight));
+    FrameView src =
+        FrameView::Create(in.data(), in.size(), pair.from, kWidth, kHeight);
+    FrameView dst =
+        FrameView::Create(out.data(), out.size(), pair.to, kWidth, kHeight);
+    for (const auto& impl : kImpls) {
+      // warm up the caches
+      if (ConvertFrame(src, dst, color, impl.impl) != OK) {
+        continue;
+      }
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < kFrames; i++) {
+        ConvertFrame(src, dst, color, impl.impl);
+      }
+      double seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+      printf("%-14s %-8s %8.1f 1080p frames/s\n", pair.name, impl.name,
+             kFrames / seconds);
+    }
+  }
+}
+
+}  // namespace ave
@@ -0,0 +1,268 @@
+/*
+ * pixel_conversion_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <cstring>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../media_packet.h"
+#include "../pixel_conversion.h"
+#include "test_frame.h"
+
+namespace ave {
+
+namespace {
+
+const PixelImpl kImpls[] = {
+    PixelImpl::kScalar,
+    PixelImpl::kAVX2,
+    PixelImpl::kNEON,
+};
+
+const struct {
+  PixelFormat from;
+  PixelFormat to;
+} kPairs[] = {
+    {AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P},
+    {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12},
+    {AV_PIX_FMT_YUYV422, AV_PIX_FMT_YUV420P},
+    {AV_PIX_FMT_P010LE, AV_PIX_FMT_YUV420P10LE},
+    {AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE},
+    {AV_PIX_FMT_RGBA, AV_PIX_FMT_YUV420P},
+    {AV_PIX_FMT_YUV420P, AV_PIX_FMT_RGBA},
+    {AV_PIX_FMT_NV12, AV_PIX_FMT_NV12},
+};
+
+// Random samples, 10 bit ones in the bits of their format.
+void FillSamples(TestFrame* frame, uint32_t seed) {
+  frame->Fill(seed);
+  std::vector<uint8_t>& data = frame->data;
+  if (frame->view.format() == AV_PIX_FMT_YUV420P10LE) {
+    for (size_t i = 1; i < data.size(); i += 2) {
+      data[i] &= 0x03;
+    }
+  } else if (frame->view.format() == AV_PIX_FMT_P010LE) {
+    for (size_t i = 0; i < data.size(); i += 2) {
+      data[i] &= 0xc0;
+    }
+  }
+}
+
+uint16_t Sample16(const FrameView& view, size_t plane, uint32_t x, uint32_t y) {
+  uint16_t value;
+  memcpy(&value, view.plane(plane).row(y) + x * view.plane(plane).col_inc,
+         sizeof(value));
+  return value;
+}
+
+}  // namespace
+
+TEST(PixelConversionTest, ColorSpaceFromAspects) {
+  ColorAspects aspects;
+  memset(&aspects, 0, sizeof(aspects));
+  aspects.mRange = ColorAspects::RangeUnspecified;
+  aspects.mMatrixCoeffs = ColorAspects::MatrixUnspecified;
+
+  YuvColorSpace color = GetYuvColorSpace(aspects, 1920, 1080);
+  EXPECT_EQ(color.matrix, YuvColorSpace::kBT709);
+  EXPECT_FALSE(color.full_range);
+  EXPECT_EQ(GetYuvColorSpace(aspects, 640, 480).matrix, YuvColorSpace::kBT601);
+  EXPECT_EQ(GetYuvColorSpace(aspects, 3840, 2160).matrix,
+            YuvColorSpace::kBT2020);
+
+  aspects.mRange = ColorAspects::RangeFull;
+  aspects.mMatrixCoeffs = ColorAspects::MatrixBT601_6;
+  color = GetYuvColorSpace(aspects, 1920, 1080);
+  EXPECT_EQ(color.matrix, YuvColorSpace::kBT601);
+  EXPECT_TRUE(color.full_range);
+  aspects.mMatrixCoeffs = ColorAspects::MatrixSMPTE240M;
+  EXPECT_EQ(GetYuvColorSpace(aspects, 1920, 1080).matrix,
+            YuvColorSpace::kBT601);
+}
+
+// Every implementation writes the same pixels as the scalar one, the odd
+// sizes run through the tails of the SIMD loops.
+TEST(PixelConversionTest, ImplementationsAgree) {
+  const struct {
+    uint32_t width;
+    uint32_t height;
+  } kSizes[] = {{2, 2}, {66, 35}, {67, 34}, {130, 66}};
+  YuvColorSpace color;
+  color.matrix = YuvColorSpace::kBT709;
+  for (const auto& pair : kPairs) {
+    for (const auto& size : kSizes) {
+      if (pair.from == AV_PIX_FMT_YUYV422 && size.width % 2 != 0) {
+        continue;
+      }
+      TestFrame src(pair.from, size.width, size.height, 12);
+      FillSamples(&src, size.width * 31 + size.height);
+      TestFrame expected(pair.to, size.width, size.height, 4);
+      ASSERT_EQ(ConvertFrame(src.view, expected.view, color,
+                             PixelImpl::kScalar),
+                OK);
+      for (PixelImpl impl : kImpls) {
+        TestFrame dst(pair.to, size.width, size.height, 4);
+        status_t result = ConvertFrame(src.view, dst.view, color, impl);
+        if (result == ERROR_UNSUPPORTED) {
+          continue;
+        }
+        ASSERT_EQ(result, OK);
+        EXPECT_EQ(dst.data, expected.data)
+            << pair.from << " to " << pair.to << " " << size.width << "x"
+            << size.height << " impl " << static_cast<int>(impl);
+      }
+    }
+  }
+}
+
+TEST(PixelConversionTest, SemiPlanarRoundTrip) {
+  TestFrame nv12(AV_PIX_FMT_NV12, 99, 37, 5);
+  FillSamples(&nv12, 1);
+  TestFrame i420(AV_PIX_FMT_YUV420P, 99, 37);
+  ASSERT_EQ(ConvertFrame(nv12.view, i420.view), OK);
+  EXPECT_EQ(i420.view.plane(1).row(3)[7], nv12.view.plane(1).row(3)[14]);
+  EXPECT_EQ(i420.view.plane(2).row(18)[49], nv12.view.plane(1).row(18)[99]);
+
+  TestFrame back(AV_PIX_FMT_NV12, 99, 37, 5);
+  ASSERT_EQ(ConvertFrame(i420.view, back.view), OK);
+  for (size_t i = 0; i < back.view.num_planes(); i++) {
+    const FrameView::Plane& a = nv12.view.plane(i);
+    const FrameView::Plane& b = back.view.plane(i);
+    for (uint32_t y = 0; y < a.height; y++) {
+      ASSERT_EQ(memcmp(a.row(y), b.row(y), a.width * a.col_inc), 0);
+    }
+  }
+
+  TestFrame p010(AV_PIX_FMT_P010LE, 75, 21, 6);
+  FillSamples(&p010, 2);
+  TestFrame i010(AV_PIX_FMT_YUV420P10LE, 75, 21);
+  ASSERT_EQ(ConvertFrame(p010.view, i010.view), OK);
+  EXPECT_EQ(Sample16(i010.view, 0, 74, 20),
+            Sample16(p010.view, 0, 74, 20) >> 6);
+  EXPECT_EQ(Sample16(i010.view, 1, 37, 10),
+            Sample16(p010.view, 1, 37, 10) >> 6);
+
+  TestFrame p010_back(AV_PIX_FMT_P010LE, 75, 21, 6);
+  ASSERT_EQ(ConvertFrame(i010.view, p010_back.view), OK);
+  for (uint32_t y = 0; y < 21; y++) {
+    for (uint32_t x = 0; x < 75; x++) {
+      ASSERT_EQ(Sample16(p010_back.view, 0, x, y),
+                Sample16(p010.view, 0, x, y));
+    }
+  }
+}
+
+TEST(PixelConversionTest, YUYV) {
+  // two rows of two pixels: Y0 U Y1 V
+  uint8_t yuyv[] = {10, 100, 20, 200, 30, 51, 40, 150};
+  FrameView src =
+      FrameView::Create(yuyv, sizeof(yuyv), AV_PIX_FMT_YUYV422, 2, 2);
+  TestFrame dst(AV_PIX_FMT_YUV420P, 2, 2);
+  ASSERT_EQ(ConvertFrame(src, dst.view), OK);
+  EXPECT_EQ(dst.data, (std::vector<uint8_t>{10, 20, 30, 40, 76, 175}));
+
+  TestFrame odd(AV_PIX_FMT_YUV420P, 3, 2);
+  uint8_t yuyv3[12] = {};
+  src = FrameView::Create(yuyv3, sizeof(yuyv3), AV_PIX_FMT_YUYV422, 3, 2);
+  EXPECT_EQ(ConvertFrame(src, odd.view), ERROR_UNSUPPORTED);
+}
+
+TEST(PixelConversionTest, RGBAColors) {
+  const struct {
+    YuvColorSpace::Matrix matrix;
+    bool full_range;
+    uint8_t rgb[3];
+    uint8_t yuv[3];
+  } kColors[] = {
+      {YuvColorSpace::kBT601, false, {255, 0, 0}, {82, 90, 240}},
+      {YuvColorSpace::kBT601, false, {0, 0, 255}, {41, 240, 110}},
+      {YuvColorSpace::kBT709, false, {255, 0, 0}, {63, 102, 240}},
+      {YuvColorSpace::kBT709, false, {0, 255, 0}, {173, 42, 26}},
+      {YuvColorSpace::kBT709, false, {255, 255, 255}, {235, 128, 128}},
+      {YuvColorSpace::kBT709, false, {0, 0, 0}, {16, 128, 128}},
+      {YuvColorSpace::kBT601, true, {255, 255, 255}, {255, 128, 128}},
+      {YuvColorSpace::kBT601, true, {255, 0, 0}, {76, 85, 255}},
+      {YuvColorSpace::kBT2020, false, {255, 0, 0}, {74, 97, 240}},
+  };
+  for (const auto& color : kColors) {
+    YuvColorSpace space;
+    space.matrix = color.matrix;
+    space.full_range = color.full_range;
+    TestFrame rgba(AV_PIX_FMT_RGBA, 6, 4);
+    for (size_t i = 0; i < rgba.data.size(); i += 4) {
+      memcpy(&rgba.data[i], color.rgb, 3);
+      rgba.data[i + 3] = 0;
+    }
+    TestFrame i420(AV_PIX_FMT_YUV420P, 6, 4);
+    ASSERT_EQ(ConvertFrame(rgba.view, i420.view, space), OK);
+    for (size_t i = 0; i < 3; i++) {
+      EXPECT_NEAR(i420.view.plane(i).row(1)[2], color.yuv[i], 1)
+          << "plane " << i << " of " << int(color.rgb[0]) << ","
+          << int(color.rgb[1]) << "," << int(color.rgb[2]);
+    }
+
+    TestFrame back(AV_PIX_FMT_RGBA, 6, 4);
+    ASSERT_EQ(ConvertFrame(i420.view, back.view, space), OK);
+    for (size_t i = 0; i < back.data.size(); i += 4) {
+      for (size_t c = 0; c < 3; c++) {
+        ASSERT_NEAR(back.data[i + c], color.rgb[c], 2);
+      }
+      ASSERT_EQ(back.data[i + 3], 255);
+    }
+  }
+}
+
+TEST(PixelConversionTest, Errors) {
+  TestFrame nv12(AV_PIX_FMT_NV12, 16, 16);
+  TestFrame small(AV_PIX_FMT_YUV420P, 16, 8);
+  EXPECT_EQ(ConvertFrame(nv12.view, small.view), BAD_VALUE);
+  EXPECT_EQ(ConvertFrame(nv12.view, FrameView()), BAD_VALUE);
+
+  TestFrame nv21(AV_PIX_FMT_NV21, 16, 16);
+  TestFrame i420(AV_PIX_FMT_YUV420P, 16, 16);
+  EXPECT_EQ(ConvertFrame(nv21.view, i420.view), ERROR_UNSUPPORTED);
+  TestFrame rgba(AV_PIX_FMT_RGBA, 16, 16);
+  EXPECT_EQ(ConvertFrame(nv12.view, rgba.view), ERROR_UNSUPPORTED);
+}
+
+TEST(PixelConversionTest, MediaPacket) {
+  const int16_t kWidth = 64;
+  const int16_t kHeight = 36;
+  const int16_t kStride = 80;
+  MediaPacket src = MediaPacket::Create(
+      FrameView::FrameSize(AV_PIX_FMT_YUV420P, kWidth, kHeight, kStride));
+  src.SetMediaType(MediaType::VIDEO);
+  src.video_info()->width = kWidth;
+  src.video_info()->height = kHeight;
+  src.video_info()->stride = kStride;
+  src.video_info()->pixel_format = AV_PIX_FMT_YUV420P;
+  src.video_info()->timestamp_us = 40000;
+  memset(src.data(), 0x80, src.size());
+
+  MediaPacket dst = MediaPacket::Create(16);
+  dst.SetMediaType(MediaType::VIDEO);
+  dst.video_info()->pixel_format = AV_PIX_FMT_RGBA;
+
+  ColorAspects aspects;
+  memset(&aspects, 0, sizeof(aspects));
+  ASSERT_EQ(ConvertFrame(src, dst, aspects), OK);
+  EXPECT_EQ(dst.size(),
+            FrameView::FrameSize(AV_PIX_FMT_RGBA, kWidth, kHeight));
+  EXPECT_EQ(dst.video_info()->width, kWidth);
+  EXPECT_EQ(dst.video_info()->height, kHeight);
+  EXPECT_EQ(dst.video_info()->timestamp_us, 40000);
+  EXPECT_EQ(dst.video_info()->pixel_format, AV_PIX_FMT_RGBA);
+  // limited range grey
+  EXPECT_EQ(dst.data()[0], 130);
+  EXPECT_EQ(dst.data()[dst.size() - 1], 255);
+
+  dst.video_info()->pixel_format = AV_PIX_FMT_NV21;
+  EXPECT_EQ(ConvertFrame(src, dst, aspects), ERROR_UNSUPPORTED);
+}
+
+}  // namespace ave
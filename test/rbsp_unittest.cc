@@ -0,0 +1,94 @@
+/*
+ * rbsp_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../bit_reader.h"
+#include "../rbsp.h"
+
+namespace ave {
+
+namespace {
+
+std::vector<uint8_t> ReferenceEscape(const std::vector<uint8_t>& rbsp) {
+  std::vector<uint8_t> ebsp;
+  size_t zeros = 0;
+  for (uint8_t byte : rbsp) {
+    if (zeros >= 2 && byte <= 3) {
+      ebsp.push_back(0x03);
+      zeros = 0;
+    }
+    ebsp.push_back(byte);
+    zeros = byte == 0 ? zeros + 1 : 0;
+  }
+  if (!ebsp.empty() && ebsp.back() == 0x00) {
+    ebsp.push_back(0x03);
+  }
+  return ebsp;
+}
+
+}  // namespace
+
+TEST(RBSPTest, Unescape) {
+  const uint8_t ebsp[] = {0x65, 0x00, 0x00, 0x03, 0x01, 0x00, 0x00,
+                          0x03, 0x00, 0x00, 0x03, 0x03, 0x88};
+  const uint8_t expected[] = {0x65, 0x00, 0x00, 0x01, 0x00, 0x00,
+                              0x00, 0x00, 0x03, 0x88};
+  EXPECT_TRUE(HasEmulationPrevention(ebsp, sizeof(ebsp)));
+  EXPECT_FALSE(HasEmulationPrevention(expected, 4));
+
+  uint8_t rbsp[sizeof(ebsp)];
+  size_t size = EBSPToRBSP(ebsp, sizeof(ebsp), rbsp);
+  ASSERT_EQ(size, sizeof(expected));
+  EXPECT_EQ(memcmp(rbsp, expected, size), 0);
+
+  // in place
+  std::vector<uint8_t> buffer(ebsp, ebsp + sizeof(ebsp));
+  size = EBSPToRBSP(buffer.data(), buffer.size(), buffer.data());
+  ASSERT_EQ(size, sizeof(expected));
+  EXPECT_EQ(memcmp(buffer.data(), expected, size), 0);
+}
+
+TEST(RBSPTest, RoundTrip) {
+  std::mt19937 rng(9);
+  for (int i = 0; i < 500; i++) {
+    std::vector<uint8_t> rbsp(rng() % 300);
+    for (auto& byte : rbsp) {
+      uint32_t r = rng() % 8;
+      byte = r < 4 ? 0 : r < 6 ? static_cast<uint8_t>(rng() % 4)
+                               : static_cast<uint8_t>(rng());
+    }
+
+    std::vector<uint8_t> ebsp(MaxEBSPSize(rbsp.size()));
+    ebsp.resize(RBSPToEBSP(rbsp.data(), rbsp.size(), ebsp.data()));
+    ASSERT_EQ(ebsp, ReferenceEscape(rbsp));
+
+    std::vector<uint8_t> unescaped(ebsp);
+    unescaped.resize(
+        EBSPToRBSP(unescaped.data(), unescaped.size(), unescaped.data()));
+    // a final 03 after a cabac_zero_word is not removed
+    if (unescaped.size() > rbsp.size() && rbsp.back() == 0x00) {
+      unescaped.pop_back();
+    }
+    ASSERT_EQ(unescaped, rbsp);
+
+    // NALBitReader reads the same bits from both
+    NALBitReader escaped_reader(ebsp.data(), ebsp.size());
+    NALBitReader unescaped_reader(rbsp.data(), rbsp.size(), true);
+    for (size_t j = 0; j < rbsp.size(); j++) {
+      ASSERT_EQ(escaped_reader.getBits(8), unescaped_reader.getBits(8));
+    }
+    EXPECT_TRUE(unescaped_reader.atLeastNumBitsLeft(0));
+    EXPECT_FALSE(unescaped_reader.atLeastNumBitsLeft(1));
+  }
+}
+
+}  // namespace ave
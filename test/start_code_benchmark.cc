@@ -0,0 +1,146 @@
+/*
+ * start_code_benchmark.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../avc_utils.h"
+#include "../start_code.h"
+
+namespace ave {
+
+namespace {
+
+// Annex-B elementary streams to scan, separated by ':'. A synthetic stream is
+// used when unset.
+const char* kStreamsEnv = "AVE_BENCHMARK_ANNEXB_STREAMS";
+const size_t kSyntheticSize = 64 * 1024 * 1024;
+const int kRounds = 5;
+
+// Random slice payloads with emulation prevention applied, like the entropy
+// coded data that makes up almost all of a real stream.
+std::vector<uint8_t> MakeSyntheticStream() {
+  std::mt19937 rng(1);
+  std::vector<uint8_t> stream;
+  stream.reserve(kSyntheticSize + 256 * 1024);
+  while (stream.size() < kSyntheticSize) {
+    const uint8_t start_code[] = {0x00, 0x00, 0x00, 0x01, 0x65};
+    stream.insert(stream.end(), std::begin(start_code), std::end(start_code));
+    size_t nal_size = 1024 + rng() % (128 * 1024);
+    size_t zeros = 0;
+    for (size_t i = 0; i < nal_size; i++) {
+      uint8_t byte = static_cast<uint8_t>(rng());
+      if (zeros >= 2 && byte <= 3) {
+        stream.push_back(0x03);
+        zeros = 0;
+      }
+      stream.push_back(byte);
+      zeros = byte == 0 ? zeros + 1 : 0;
+    }
+    stream.push_back(0x80);
+  }
+  return stream;
+}
+
+std::vector<std::pair<std::string, std::vector<uint8_t>>> LoadStreams() {
+  std::vector<std::pair<std::string, std::vector<uint8_t>>> streams;
+  const char* env = getenv(kStreamsEnv);
+  if (env != nullptr) {
+    std::stringstream paths(env);
+    std::string path;
+    while (std::getline(paths, path, ':')) {
+      std::ifstream file(path, std::ios::binary);
+      if (!file) {
+        printf("can not open %s\n", path.c_str());
+        continue;
+      }
+      streams.emplace_back(path, std::vector<uint8_t>(
+                                     std::istreambuf_iterator<char>(file),
+                                     std::istreambuf_iterator<char>()));
+    }
+  }
+  if (streams.empty()) {
+    streams.emplace_back("synthetic", MakeSyntheticStream());
+  }
+  return streams;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+}  // namespace
+
+TEST(StartCodeBenchmark, Finders) {
+  const struct {
+    StartCodeImpl impl;
+    const char* name;
+  } kImpls[] = {
+      {StartCodeImpl::kScalar, "scalar"},
+      {StartCodeImpl::kSSE2, "sse2"},
+      {StartCodeImpl::kAVX2, "avx2"},
+      {StartCodeImpl::kNEON, "neon"},
+  };
+
+  for (const auto& stream : LoadStreams()) {
+    const uint8_t* data = stream.second.data();
+    const size_t size = stream.second.size();
+    for (const auto& impl : kImpls) {
+      StartCodeFinder find = GetStartCodeFinder(impl.impl);
+      if (find == nullptr) {
+        continue;
+      }
+      size_t count = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (int round = 0; round < kRounds; round++) {
+        for (size_t offset = 0; offset < size; offset += 3) {
+          offset += find(data + offset, size - offset);
+          count++;
+        }
+      }
+      double seconds = SecondsSince(start);
+      printf("%s %s: %.1f MB/s, %zu start codes\n", stream.first.c_str(),
+             impl.name, size * kRounds / seconds / 1e6, count / kRounds - 1);
+    }
+  }
+}
+
+TEST(StartCodeBenchmark, GetNextNALUnit) {
+  for (const auto& stream : LoadStreams()) {
+    size_t count = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kRounds; round++) {
+      const uint8_t* data = stream.second.data();
+      size_t size = stream.second.size();
+      const uint8_t* nal;
+      size_t nal_size;
+      while (getNextNALUnit(&data, &size, &nal, &nal_size, true) == OK) {
+        count++;
+        if (data == nullptr) {
+          break;
+        }
+      }
+    }
+    double seconds = SecondsSince(start);
+    printf("%s getNextNALUnit: %.1f MB/s, %zu NAL units\n",
+           stream.first.c_str(),
+           stream.second.size() * kRounds / seconds / 1e6, count / kRounds);
+  }
+}
+
+}  // namespace ave
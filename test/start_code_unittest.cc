@@ -0,0 +1,206 @@
+/*
+ * start_code_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../avc_utils.h"
+#include "../start_code.h"
+#include "../utils.h"
+
+namespace ave {
+
+namespace {
+
+const StartCodeImpl kImpls[] = {
+    StartCodeImpl::kScalar,
+    StartCodeImpl::kSSE2,
+    StartCodeImpl::kAVX2,
+    StartCodeImpl::kNEON,
+};
+
+size_t ReferenceFind(const uint8_t* data,
+                     size_t size,
+                     ScanPattern pattern = ScanPattern::kStartCode) {
+  for (size_t i = 0; i + 2 < size; i++) {
+    if (data[i] != 0 || data[i + 1] != 0) {
+      continue;
+    }
+    uint8_t third = data[i + 2];
+    if ((pattern == ScanPattern::kStartCode && third == 1) ||
+        (pattern == ScanPattern::kEmulationPrevention && third == 3) ||
+        (pattern == ScanPattern::kStartCodeEmulation && third <= 3)) {
+      return i;
+    }
+  }
+  return size;
+}
+
+}  // namespace
+
+TEST(StartCodeTest, AllImplementationsAgree) {
+  std::mt19937 rng(42);
+  std::vector<uint8_t> data(4096);
+  for (auto& byte : data) {
+    // plenty of zeros and ones so start codes show up at every offset
+    uint32_t r = rng() % 8;
+    byte = r < 4 ? 0 : r < 6 ? 1 : static_cast<uint8_t>(rng());
+  }
+
+  for (StartCodeImpl impl : kImpls) {
+    StartCodeFinder find = GetStartCodeFinder(impl);
+    if (find == nullptr) {
+      continue;
+    }
+    for (size_t offset = 0; offset < 200; offset++) {
+      for (size_t size = 0; size < 100; size++) {
+        ASSERT_EQ(find(data.data() + offset, size),
+                  ReferenceFind(data.data() + offset, size))
+            << "impl " << static_cast<int>(impl) << " offset " << offset
+            << " size " << size;
+      }
+    }
+  }
+}
+
+TEST(StartCodeTest, EmulationPatterns) {
+  std::mt19937 rng(43);
+  std::vector<uint8_t> data(4096);
+  for (auto& byte : data) {
+    uint32_t r = rng() % 8;
+    byte = r < 4 ? 0 : r < 6 ? static_cast<uint8_t>(rng() % 5)
+                             : static_cast<uint8_t>(rng());
+  }
+
+  const ScanPattern kPatterns[] = {ScanPattern::kEmulationPrevention,
+                                   ScanPattern::kStartCodeEmulation};
+  for (ScanPattern pattern : kPatterns) {
+    for (StartCodeImpl impl : kImpls) {
+      StartCodeFinder find = GetStartCodeFinder(impl, pattern);
+      if (find == nullptr) {
+        continue;
+      }
+      for (size_t offset = 0; offset < 200; offset++) {
+        for (size_t size = 0; size < 100; size++) {
+          ASSERT_EQ(find(data.data() + offset, size),
+                    ReferenceFind(data.data() + offset, size, pattern))
+              << "impl " << static_cast<int>(impl) << " pattern "
+              << static_cast<int>(pattern) << " offset " << offset
+              << " size " << size;
+        }
+      }
+    }
+  }
+
+  const uint8_t escaped[] = {0x00, 0x00, 0x01, 0x00, 0x00, 0x03, 0x01};
+  EXPECT_EQ(FindEmulationPrevention(escaped, sizeof(escaped)), 3u);
+  EXPECT_EQ(FindStartCodeEmulation(escaped, sizeof(escaped)), 0u);
+}
+
+TEST(StartCodeTest, MPEGAudioSync) {
+  std::mt19937 rng(44);
+  std::vector<uint8_t> data(4096);
+  for (auto& byte : data) {
+    uint32_t r = rng() % 8;
+    byte = r < 3 ? 0xff : r < 5 ? static_cast<uint8_t>(0xe0 | rng())
+                                : static_cast<uint8_t>(rng());
+  }
+
+  auto reference = [](const uint8_t* p, size_t size) {
+    for (size_t i = 0; i + 1 < size; i++) {
+      if (p[i] == 0xff && (p[i + 1] & 0xe0) == 0xe0) {
+        return i;
+      }
+    }
+    return size;
+  };
+  for (StartCodeImpl impl : kImpls) {
+    StartCodeFinder find =
+        GetStartCodeFinder(impl, ScanPattern::kMPEGAudioSync);
+    if (find == nullptr) {
+      continue;
+    }
+    for (size_t offset = 0; offset < 200; offset++) {
+      for (size_t size = 0; size < 100; size++) {
+        ASSERT_EQ(find(data.data() + offset, size),
+                  reference(data.data() + offset, size))
+            << "impl " << static_cast<int>(impl) << " offset " << offset
+            << " size " << size;
+      }
+    }
+  }
+
+  // a sync word at every position relative to the blocks, FF bytes without
+  // one around it
+  for (size_t pos = 0; pos < 70; pos++) {
+    std::vector<uint8_t> sync(72, 0xff);
+    for (size_t i = 1; i < sync.size(); i += 2) {
+      sync[i] = 0x12;
+    }
+    if (pos > 0) {
+      sync[pos - 1] = 0x34;
+    }
+    sync[pos] = 0xff;
+    sync[pos + 1] = 0xfb;
+    EXPECT_EQ(FindMPEGAudioSync(sync.data(), sync.size()), pos);
+    EXPECT_EQ(FindMPEGAudioSync(sync.data(), pos + 1), pos + 1);
+  }
+}
+
+TEST(StartCodeTest, BlockBoundaries) {
+  // a start code at every position relative to the 16/32 byte blocks
+  for (size_t pos = 0; pos < 70; pos++) {
+    std::vector<uint8_t> data(72, 0xff);
+    data[pos] = 0;
+    data[pos + 1] = 0;
+    data[pos + 2] = 1;
+    EXPECT_EQ(FindStartCode(data.data(), data.size()), pos);
+    // truncated start code is not reported
+    EXPECT_EQ(FindStartCode(data.data(), pos + 2), pos + 2);
+  }
+  EXPECT_EQ(FindStartCode(nullptr, 0), 0u);
+}
+
+TEST(StartCodeTest, GetNextNALUnit) {
+  const uint8_t stream[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0x00,
+                            0x00, 0x01, 0x68, 0xce, 0x00, 0x00, 0x00,
+                            0x01, 0x65, 0x88, 0x84, 0x00};
+  const uint8_t* data = stream;
+  size_t size = sizeof(stream);
+  const uint8_t* nal;
+  size_t nal_size;
+
+  ASSERT_EQ(getNextNALUnit(&data, &size, &nal, &nal_size, true), OK);
+  EXPECT_EQ(nal, stream + 4);
+  EXPECT_EQ(nal_size, 2u);
+  ASSERT_EQ(getNextNALUnit(&data, &size, &nal, &nal_size, true), OK);
+  EXPECT_EQ(nal, stream + 9);
+  // trailing zeros belong to the next four byte start code
+  EXPECT_EQ(nal_size, 2u);
+  ASSERT_EQ(getNextNALUnit(&data, &size, &nal, &nal_size, true), OK);
+  EXPECT_EQ(nal, stream + 15);
+  EXPECT_EQ(nal_size, 3u);
+  EXPECT_EQ(data, nullptr);
+
+  // without a following start code the last NAL is incomplete
+  data = stream + 11;
+  size = sizeof(stream) - 11;
+  EXPECT_EQ(getNextNALUnit(&data, &size, &nal, &nal_size, false), -EAGAIN);
+}
+
+TEST(StartCodeTest, FindNextNalStartCode) {
+  const uint8_t four[] = {0xaa, 0x00, 0x00, 0x00, 0x01, 0x65};
+  EXPECT_EQ(findNextNalStartCode(four, sizeof(four)), four + 1);
+  const uint8_t three[] = {0xaa, 0xbb, 0x00, 0x00, 0x01, 0x65};
+  EXPECT_EQ(findNextNalStartCode(three, sizeof(three)), three + 2);
+  const uint8_t none[] = {0xaa, 0x00, 0x00, 0x02, 0x01};
+  EXPECT_EQ(findNextNalStartCode(none, sizeof(none)), none + sizeof(none));
+}
+
+}  // namespace ave
@@ -0,0 +1,68 @@
+/*
+ * test_frame.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef TEST_TEST_FRAME_H
+#define TEST_TEST_FRAME_H
+
+#include <cstdint>
+#include <vector>
+
+#include "../frame_view.h"
+
+namespace ave {
+
+// The next value of the generator behind TestFrame::Fill().
+inline uint32_t NextTestRandom(uint32_t* seed) {
+  *seed = *seed * 1664525 + 1013904223;
+  return *seed;
+}
+
+// A frame in its own buffer, the rows padded by |padding| bytes, for the
+// tests of the frame converters.
+struct TestFrame {
+  TestFrame(PixelFormat format,
+            uint32_t width,
+            uint32_t height,
+            uint32_t padding = 0) {
+    uint32_t row_bytes = width * BytesPerPixel(format);
+    stride = padding != 0 ? row_bytes + padding : 0;
+    data.resize(FrameView::FrameSize(format, width, height, stride));
+    view = FrameView::Create(data.data(), data.size(), format, width, height,
+                             stride);
+  }
+
+  // Of the first plane.
+  static uint32_t BytesPerPixel(PixelFormat format) {
+    switch (format) {
+      case AV_PIX_FMT_RGBA:
+        return 4;
+      case AV_PIX_FMT_RGB24:
+        return 3;
+      case AV_PIX_FMT_YUYV422:
+      case AV_PIX_FMT_P010LE:
+      case AV_PIX_FMT_YUV420P10LE:
+        return 2;
+      default:
+        return 1;
+    }
+  }
+
+  // Random bytes, the padding and the unused bits of 10 bit samples too.
+  void Fill(uint32_t seed) {
+    for (size_t i = 0; i < data.size(); i++) {
+      data[i] = static_cast<uint8_t>(NextTestRandom(&seed) >> 24);
+    }
+  }
+
+  std::vector<uint8_t> data;
+  uint32_t stride = 0;
+  FrameView view;
+};
+
+}  // namespace ave
+
+#endif /* !TEST_TEST_FRAME_H */
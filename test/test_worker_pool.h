@@ -0,0 +1,78 @@
+/*
+ * test_worker_pool.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef TEST_TEST_WORKER_POOL_H
+#define TEST_TEST_WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../worker_pool.h"
+
+namespace ave {
+
+// Threads running the posted tasks in order, for the tests and benchmarks of
+// the frame converters.
+class TestWorkerPool : public WorkerPool {
+ public:
+  explicit TestWorkerPool(size_t threads) {
+    for (size_t i = 0; i < threads; i++) {
+      threads_.emplace_back([this]() { Run(); });
+    }
+  }
+
+  ~TestWorkerPool() override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+    }
+    cond_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  size_t concurrency() const override { return threads_.size(); }
+
+  void PostTask(std::function<void()> task) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    cond_.notify_one();
+  }
+
+ private:
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cond_.wait(lock, [this]() { return quit_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      std::function<void()> task = std::move(tasks_.front());
+      tasks_.pop_front();
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::function<void()>> tasks_;
+  bool quit_ = false;
+};
+
+}  // namespace ave
+
+#endif /* !TEST_TEST_WORKER_POOL_H */
@@ -0,0 +1,115 @@
+/*
+ * video_scaler_benchmark.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../video_scaler.h"
+#include "test_worker_pool.h"
+
+namespace ave {
+
+namespace {
+
+const int kFrames = 20;
+
+const struct {
+  VideoScaler::Impl impl;
+  const char* name;
+} kImpls[] = {
+    {VideoScaler::Impl::kScalar, "scalar"},
+    {VideoScaler::Impl::kAVX2, "AVX2"},
+    {VideoScaler::Impl::kNEON, "NEON"},
+};
+
+const struct {
+  VideoScaler::Filter filter;
+  const char* name;
+} kFilters[] = {
+    {VideoScaler::Filter::kBilinear, "bilinear"},
+    {VideoScaler::Filter::kBicubic, "bicubic"},
+    {VideoScaler::Filter::kBox, "box"},
+};
+
+const struct {
+  PixelFormat format;
+  uint32_t src_width;
+  uint32_t src_height;
+  uint32_t dst_width;
+  uint32_t dst_height;
+  const char* name;
+} kCases[] = {
+    {AV_PIX_FMT_YUV420P, 1920, 1080, 640, 360, "I420 1080p to 360p"},
+    {AV_PIX_FMT_YUV420P, 3840, 2160, 1920, 1080, "I420 2160p to 1080p"},
+    {AV_PIX_FMT_NV12, 1280, 720, 1920, 1080, "NV12 720p to 1080p"},
+    {AV_PIX_FMT_RGBA, 1920, 1080, 640, 360, "RGBA 1080p to 360p"},
+};
+
+// Random bytes, which are valid pixels for the benchmark's purpose.
+std::vector<uint8_t> MakeFrame(PixelFormat format,
+                               uint32_t width,
+                               uint32_t height) {
+  std::mt19937 rng(1);
+  std::vector<uint8_t> data(FrameView::FrameSize(format, width, height));
+  for (auto& byte : data) {
+    byte = static_cast<uint8_t>(rng());
+  }
+  return data;
+}
+
+double FramesPerSecond(VideoScaler& scaler,
+                       const FrameView& src,
+                       const FrameView& dst,
+                       WorkerPool* pool) {
+  // warm up the caches
+  scaler.Scale(src, dst, pool);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kFrames; i++) {
+    scaler.Scale(src, dst, pool);
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return kFrames / seconds;
+}
+
+}  // namespace
+
+TEST(VideoScalerBenchmark, Scale) {
+  for (const auto& c : kCases) {
+    std::vector<uint8_t> in = MakeFrame(c.format, c.src_width, c.src_height);
+    std::vector<uint8_t> out(
+        FrameView::FrameSize(c.format, c.dst_width, c.dst_height));
+    FrameView src = FrameView::Create(in.data(), in.size(), c.format,
+                                      c.src_width, c.src_height);
+    FrameView dst = FrameView::Create(out.data(), out.size(), c.format,
+                                      c.dst_width, c.dst_height);
+    for (const auto& filter : kFilters) {
+      VideoScaler scaler(c.format, c.src_width, c.src_height, c.dst_width,
+                         c.dst_height, filter.filter);
+      for (const auto& impl : kImpls) {
+        if (scaler.SetImplForTesting(impl.impl) != OK) {
+          continue;
+        }
+        double single = FramesPerSecond(scaler, src, dst, nullptr);
+        double threaded;
+        {
+          TestWorkerPool pool(3);
+          threaded = FramesPerSecond(scaler, src, dst, &pool);
+        }
+        printf("%-20s %-8s %-6s %8.1f frames/s, %8.1f with 4 threads\n",
+               c.name, filter.name, impl.name, single, threaded);
+      }
+    }
+  }
+}
+
+}  // namespace ave
@@ -0,0 +1,325 @@
+/*
+ * video_scaler_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../media_packet.h"
+#include "../meta_data.h"
+#include "../video_scaler.h"
+#include "test_frame.h"
+#include "test_worker_pool.h"
+
+namespace ave {
+
+namespace {
+
+const VideoScaler::Impl kImpls[] = {
+    VideoScaler::Impl::kScalar,
+    VideoScaler::Impl::kAVX2,
+    VideoScaler::Impl::kNEON,
+};
+
+const VideoScaler::Filter kFilters[] = {
+    VideoScaler::Filter::kBilinear,
+    VideoScaler::Filter::kBicubic,
+    VideoScaler::Filter::kBox,
+};
+
+const PixelFormat kFormats[] = {
+    AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P, AV_PIX_FMT_NV12,
+    AV_PIX_FMT_GRAY8,   AV_PIX_FMT_RGBA,    AV_PIX_FMT_RGB24,
+};
+
+// A test frame with the helpers of the scaler tests.
+struct Frame : public TestFrame {
+  using TestFrame::TestFrame;
+
+  // Every sample of a plane and channel the same.
+  void FillFlat() {
+    for (size_t i = 0; i < view.num_planes(); i++) {
+      const FrameView::Plane& plane = view.plane(i);
+      for (uint32_t y = 0; y < plane.height; y++) {
+        for (uint32_t x = 0; x < plane.width * plane.col_inc; x++) {
+          plane.row(y)[x] = FlatValue(i, x % plane.col_inc);
+        }
+      }
+    }
+  }
+
+  static uint8_t FlatValue(size_t plane, size_t channel) {
+    return static_cast<uint8_t>(40 + 50 * plane + 30 * channel);
+  }
+
+  // The samples of the rows, without the padding.
+  std::vector<uint8_t> Pixels() const {
+    std::vector<uint8_t> pixels;
+    for (size_t i = 0; i < view.num_planes(); i++) {
+      const FrameView::Plane& plane = view.plane(i);
+      for (uint32_t y = 0; y < plane.height; y++) {
+        pixels.insert(pixels.end(), plane.row(y),
+                      plane.row(y) + plane.width * plane.col_inc);
+      }
+    }
+    return pixels;
+  }
+};
+
+}  // namespace
+
+TEST(VideoScalerTest, FlatColor) {
+  const struct {
+    uint32_t width;
+    uint32_t height;
+  } kSizes[] = {{64, 50}, {13, 9}, {37, 23}, {1, 1}};
+  for (PixelFormat format : kFormats) {
+    Frame src(format, 37, 23, 5);
+    src.FillFlat();
+    for (const auto& size : kSizes) {
+      Frame dst(format, size.width, size.height);
+      for (auto filter : kFilters) {
+        VideoScaler scaler(format, 37, 23, size.width, size.height, filter);
+        ASSERT_EQ(scaler.InitCheck(), OK);
+        ASSERT_EQ(scaler.Scale(src.view, dst.view), OK);
+        for (size_t i = 0; i < dst.view.num_planes(); i++) {
+          const FrameView::Plane& plane = dst.view.plane(i);
+          for (uint32_t y = 0; y < plane.height; y++) {
+            for (uint32_t x = 0; x < plane.width * plane.col_inc; x++) {
+              ASSERT_EQ(plane.row(y)[x],
+                        Frame::FlatValue(i, x % plane.col_inc))
+                  << "format " << format << " plane " << i << " " << x
+                  << "," << y;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(VideoScalerTest, ImplementationsAgree) {
+  const struct {
+    uint32_t src_width;
+    uint32_t src_height;
+    uint32_t dst_width;
+    uint32_t dst_height;
+  } kSizes[] = {
+      {67, 41, 160, 90}, {160, 90, 67, 41}, {200, 120, 33, 17},
+      {5, 3, 40, 30},    {40, 30, 3, 5},
+  };
+  for (PixelFormat format : kFormats) {
+    for (const auto& size : kSizes) {
+      Frame src(format, size.src_width, size.src_height, 7);
+      src.Fill(format * 31 + size.src_width);
+      for (auto filter : kFilters) {
+        VideoScaler scaler(format, size.src_width, size.src_height,
+                           size.dst_width, size.dst_height, filter);
+        ASSERT_EQ(scaler.SetImplForTesting(VideoScaler::Impl::kScalar), OK);
+        Frame expected(format, size.dst_width, size.dst_height);
+        ASSERT_EQ(scaler.Scale(src.view, expected.view), OK);
+        for (auto impl : kImpls) {
+          if (scaler.SetImplForTesting(impl) != OK) {
+            continue;
+          }
+          Frame dst(format, size.dst_width, size.dst_height, 3);
+          ASSERT_EQ(scaler.Scale(src.view, dst.view), OK);
+          EXPECT_EQ(dst.Pixels(), expected.Pixels())
+              << "format " << format << " impl " << static_cast<int>(impl)
+              << " filter " << static_cast<int>(filter) << " "
+              << size.src_width << "x" << size.src_height << " to "
+              << size.dst_width << "x" << size.dst_height;
+        }
+      }
+    }
+  }
+}
+
+// The 1 channel planes of GRAY8 and I420 and the 2 channel chroma plane of
+// NV12 through the NEON kernels, with widths that leave pixels to the scalar
+// loop.
+TEST(VideoScalerTest, NEONPlanesOfOneAndTwoChannels) {
+  const struct {
+    uint32_t src_width;
+    uint32_t src_height;
+    uint32_t dst_width;
+    uint32_t dst_height;
+  } kSizes[] = {
+      {70, 40, 131, 77}, {131, 77, 70, 40}, {640, 360, 17, 9}, {9, 7, 8, 6},
+  };
+  for (PixelFormat format :
+       {AV_PIX_FMT_GRAY8, AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12}) {
+    for (const auto& size : kSizes) {
+      Frame src(format, size.src_width, size.src_height, 5);
+      src.Fill(format * 17 + size.dst_width);
+      for (auto filter : kFilters) {
+        VideoScaler scaler(format, size.src_width, size.src_height,
+                           size.dst_width, size.dst_height, filter);
+        Frame expected(format, size.dst_width, size.dst_height);
+        ASSERT_EQ(scaler.SetImplForTesting(VideoScaler::Impl::kScalar), OK);
+        ASSERT_EQ(scaler.Scale(src.view, expected.view), OK);
+        if (scaler.SetImplForTesting(VideoScaler::Impl::kNEON) != OK) {
+          return;
+        }
+        Frame dst(format, size.dst_width, size.dst_height, 3);
+        ASSERT_EQ(scaler.Scale(src.view, dst.view), OK);
+        EXPECT_EQ(dst.Pixels(), expected.Pixels())
+            << "format " << format << " filter " << static_cast<int>(filter)
+            << " " << size.src_width << "x" << size.src_height << " to "
+            << size.dst_width << "x" << size.dst_height;
+      }
+    }
+  }
+}
+
+TEST(VideoScalerTest, PoolGivesSameFrame) {
+  TestWorkerPool pool(3);
+  for (PixelFormat format : {AV_PIX_FMT_YUV420P, AV_PIX_FMT_RGBA}) {
+    Frame src(format, 320, 180);
+    src.Fill(7);
+    VideoScaler scaler(format, 320, 180, 200, 150,
+                       VideoScaler::Filter::kBicubic);
+    Frame expected(format, 200, 150);
+    Frame dst(format, 200, 150);
+    ASSERT_EQ(scaler.Scale(src.view, expected.view), OK);
+    ASSERT_EQ(scaler.Scale(src.view, dst.view, &pool), OK);
+    EXPECT_EQ(dst.data, expected.data);
+  }
+}
+
+TEST(VideoScalerTest, BoxHalvesAverage) {
+  Frame src(AV_PIX_FMT_GRAY8, 32, 16);
+  src.Fill(3);
+  Frame dst(AV_PIX_FMT_GRAY8, 16, 8);
+  VideoScaler scaler(AV_PIX_FMT_GRAY8, 32, 16, 16, 8,
+                     VideoScaler::Filter::kBox);
+  ASSERT_EQ(scaler.Scale(src.view, dst.view), OK);
+  const FrameView::Plane& in = src.view.plane(0);
+  const FrameView::Plane& out = dst.view.plane(0);
+  for (uint32_t y = 0; y < 8; y++) {
+    for (uint32_t x = 0; x < 16; x++) {
+      int sum = in.row(2 * y)[2 * x] + in.row(2 * y)[2 * x + 1] +
+                in.row(2 * y + 1)[2 * x] + in.row(2 * y + 1)[2 * x + 1];
+      ASSERT_EQ(out.row(y)[x], (sum + 2) / 4) << x << "," << y;
+    }
+  }
+}
+
+TEST(VideoScalerTest, SameSizeCopies) {
+  for (auto filter : kFilters) {
+    Frame src(AV_PIX_FMT_NV12, 48, 26, 4);
+    src.Fill(11);
+    Frame dst(AV_PIX_FMT_NV12, 48, 26);
+    VideoScaler scaler(AV_PIX_FMT_NV12, 48, 26, 48, 26, filter);
+    ASSERT_EQ(scaler.Scale(src.view, dst.view), OK);
+    EXPECT_EQ(dst.Pixels(), src.Pixels());
+  }
+}
+
+TEST(VideoScalerTest, ThumbnailSize) {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  MetaData meta;
+  EXPECT_FALSE(VideoScaler::GetThumbnailSize(meta, 1920, 1080, &width,
+                                             &height));
+
+  meta.setInt32(kKeyThumbnailWidth, 320);
+  ASSERT_TRUE(VideoScaler::GetThumbnailSize(meta, 1920, 1080, &width,
+                                            &height));
+  EXPECT_EQ(width, 320u);
+  EXPECT_EQ(height, 180u);
+  // 135 rounded to even
+  ASSERT_TRUE(VideoScaler::GetThumbnailSize(meta, 1280, 540, &width,
+                                            &height));
+  EXPECT_EQ(height, 136u);
+
+  meta.setInt32(kKeyThumbnailHeight, 100);
+  ASSERT_TRUE(VideoScaler::GetThumbnailSize(meta, 1920, 1080, &width,
+                                            &height));
+  EXPECT_EQ(width, 320u);
+  EXPECT_EQ(height, 100u);
+
+  MetaData only_height;
+  only_height.setInt32(kKeyThumbnailHeight, 90);
+  ASSERT_TRUE(VideoScaler::GetThumbnailSize(only_height, 1080, 1920, &width,
+                                            &height));
+  EXPECT_EQ(width, 50u);
+  EXPECT_EQ(height, 90u);
+}
+
+TEST(VideoScalerTest, Errors) {
+  EXPECT_NE(VideoScaler(AV_PIX_FMT_YUYV422, 16, 16, 8, 8).InitCheck(), OK);
+  EXPECT_NE(VideoScaler(AV_PIX_FMT_YUV420P, 0, 16, 8, 8).InitCheck(), OK);
+  EXPECT_NE(VideoScaler(AV_PIX_FMT_YUV420P, 16, 16, 8, 0).InitCheck(), OK);
+
+  VideoScaler scaler(AV_PIX_FMT_YUV420P, 16, 16, 8, 8);
+  ASSERT_EQ(scaler.InitCheck(), OK);
+  Frame src(AV_PIX_FMT_YUV420P, 16, 16);
+  Frame dst(AV_PIX_FMT_YUV420P, 8, 8);
+  Frame wrong_size(AV_PIX_FMT_YUV420P, 8, 10);
+  Frame wrong_format(AV_PIX_FMT_NV12, 8, 8);
+  EXPECT_EQ(scaler.Scale(src.view, dst.view), OK);
+  EXPECT_EQ(scaler.Scale(src.view, wrong_size.view), BAD_VALUE);
+  EXPECT_EQ(scaler.Scale(src.view, wrong_format.view), BAD_VALUE);
+  EXPECT_EQ(scaler.Scale(dst.view, src.view), BAD_VALUE);
+  EXPECT_EQ(scaler.Scale(src.view, FrameView()), BAD_VALUE);
+}
+
+TEST(VideoScalerTest, MediaPacket) {
+  const int16_t kWidth = 64;
+  const int16_t kHeight = 36;
+  const int16_t kStride = 80;
+  MediaPacket src = MediaPacket::Create(
+      FrameView::FrameSize(AV_PIX_FMT_YUV420P, kWidth, kHeight, kStride));
+  src.SetMediaType(MediaType::VIDEO);
+  src.video_info()->width = kWidth;
+  src.video_info()->height = kHeight;
+  src.video_info()->stride = kStride;
+  src.video_info()->pixel_format = AV_PIX_FMT_YUV420P;
+  src.video_info()->timestamp_us = 40000;
+  memset(src.data(), 0x50, src.size());
+
+  MediaPacket dst = MediaPacket::Create(16);
+  dst.SetMediaType(MediaType::VIDEO);
+
+  VideoScaler scaler(AV_PIX_FMT_YUV420P, kWidth, kHeight, kWidth / 2,
+                     kHeight / 2);
+  ASSERT_EQ(scaler.Scale(src, dst), OK);
+  EXPECT_EQ(dst.size(), FrameView::FrameSize(AV_PIX_FMT_YUV420P, kWidth / 2,
+                                             kHeight / 2));
+  EXPECT_EQ(dst.video_info()->width, kWidth / 2);
+  EXPECT_EQ(dst.video_info()->height, kHeight / 2);
+  EXPECT_EQ(dst.video_info()->timestamp_us, 40000);
+  EXPECT_EQ(dst.video_info()->pixel_format, AV_PIX_FMT_YUV420P);
+  EXPECT_EQ(dst.data()[0], 0x50);
+  EXPECT_EQ(dst.data()[dst.size() - 1], 0x50);
+
+  VideoScaler other(AV_PIX_FMT_NV12, kWidth, kHeight, 8, 8);
+  EXPECT_EQ(other.Scale(src, dst), BAD_VALUE);
+}
+
+TEST(WorkerPoolTest, ParallelForRunsEveryIndexOnce) {
+  TestWorkerPool pool(4);
+  for (size_t count : {0, 1, 2, 100}) {
+    std::vector<std::atomic<int>> calls(count);
+    for (auto& call : calls) {
+      call = 0;
+    }
+    ParallelFor(&pool, count, [&calls](size_t index) { calls[index]++; });
+    for (size_t i = 0; i < count; i++) {
+      EXPECT_EQ(calls[i], 1) << i;
+    }
+    ParallelFor(nullptr, count, [&calls](size_t index) { calls[index]++; });
+    for (size_t i = 0; i < count; i++) {
+      EXPECT_EQ(calls[i], 2) << i;
+    }
+  }
+}
+
+}  // namespace ave
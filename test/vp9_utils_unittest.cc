@@ -0,0 +1,230 @@
+/*
+ * vp9_utils_unittest.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include <vector>
+
+#include "test/gtest.h"
+
+#include "../media_errors.h"
+#include "../vp9_utils.h"
+#include "bit_writer.h"
+
+namespace ave {
+
+namespace {
+
+// Profile 0, BT.709.
+std::vector<uint8_t> MakeKeyFrame(uint32_t width, uint32_t height) {
+  BitWriter bw;
+  bw.Put(2, 2);  // frame_marker
+  bw.Put(0, 2);  // profile
+  bw.Put(0, 1);  // show_existing_frame
+  bw.Put(0, 1);  // frame_type
+  bw.Put(1, 1);  // show_frame
+  bw.Put(0, 1);  // error_resilient_mode
+  bw.Put(0x498342, 24);
+  bw.Put(2, 3);  // color_space
+  bw.Put(0, 1);  // color_range
+  bw.Put(width - 1, 16);
+  bw.Put(height - 1, 16);
+  bw.Put(0, 1);  // render_and_frame_size_different
+  bw.Put(0x5a5a, 16);
+  return bw.Finish();
+}
+
+// Refreshes |refresh|, and takes its size from slot |sizeRef| or codes it.
+std::vector<uint8_t> MakeInterFrame(uint8_t refresh,
+                                    int sizeRef,
+                                    uint32_t width = 0,
+                                    uint32_t height = 0,
+                                    bool show = true) {
+  BitWriter bw;
+  bw.Put(2, 2);
+  bw.Put(0, 2);
+  bw.Put(0, 1);
+  bw.Put(1, 1);  // frame_type
+  bw.Put(show, 1);
+  bw.Put(0, 1);
+  if (!show) {
+    bw.Put(0, 1);  // intra_only
+  }
+  bw.Put(0, 2);  // reset_frame_context
+  bw.Put(refresh, 8);
+  for (uint32_t i = 0; i < 3; ++i) {
+    bw.Put(i, 3);  // ref_frame_idx
+    bw.Put(0, 1);
+  }
+  if (sizeRef >= 0) {
+    for (int i = 0; i < sizeRef; ++i) {
+      bw.Put(0, 1);  // found_ref
+    }
+    bw.Put(1, 1);
+  } else {
+    bw.Put(0, 3);
+    bw.Put(width - 1, 16);
+    bw.Put(height - 1, 16);
+  }
+  bw.Put(0x5a5a, 16);
+  return bw.Finish();
+}
+
+std::vector<uint8_t> MakeShowExistingFrame(uint8_t mapIdx) {
+  BitWriter bw;
+  bw.Put(2, 2);
+  bw.Put(0, 2);
+  bw.Put(1, 1);  // show_existing_frame
+  bw.Put(mapIdx, 3);
+  return bw.Finish();
+}
+
+std::vector<uint8_t> MakeSuperframe(
+    const std::vector<std::vector<uint8_t>>& frames) {
+  std::vector<uint8_t> data;
+  for (const auto& frame : frames) {
+    data.insert(data.end(), frame.begin(), frame.end());
+  }
+  // 2 bytes per frame size
+  uint8_t marker = 0xc0 | (1 << 3) | (frames.size() - 1);
+  data.push_back(marker);
+  for (const auto& frame : frames) {
+    data.push_back(frame.size() & 0xff);
+    data.push_back(frame.size() >> 8);
+  }
+  data.push_back(marker);
+  return data;
+}
+
+}  // namespace
+
+TEST(Vp9UtilsTest, FrameHeader) {
+  std::vector<uint8_t> frame = MakeKeyFrame(1920, 1080);
+  Vp9FrameHeader header;
+  ASSERT_EQ(ParseVp9FrameHeader(frame.data(), frame.size(), &header), OK);
+  EXPECT_TRUE(header.isKeyFrame());
+  EXPECT_TRUE(header.showFrame);
+  EXPECT_EQ(header.profile, 0);
+  EXPECT_EQ(header.bitDepth, 8u);
+  EXPECT_EQ(header.colorSpace, 2);
+  EXPECT_TRUE(header.subsamplingX);
+  EXPECT_EQ(header.width, 1920u);
+  EXPECT_EQ(header.height, 1080u);
+  EXPECT_EQ(header.refreshFrameFlags, 0xff);
+
+  frame = MakeInterFrame(0x01, 2);
+  ASSERT_EQ(ParseVp9FrameHeader(frame.data(), frame.size(), &header), OK);
+  EXPECT_FALSE(header.isKeyFrame());
+  EXPECT_EQ(header.refreshFrameFlags, 0x01);
+  EXPECT_EQ(header.refFrameIdx[2], 2);
+  EXPECT_EQ(header.sizeFromRef, 2);
+  EXPECT_EQ(header.width, 0u);
+
+  const uint8_t kShowExisting[] = {0x8d};
+  ASSERT_EQ(ParseVp9FrameHeader(kShowExisting, 1, &header), OK);
+  EXPECT_TRUE(header.showExistingFrame);
+  EXPECT_EQ(header.frameToShowMapIdx, 5);
+
+  const uint8_t kBadMarker[] = {0x40, 0x00};
+  EXPECT_EQ(ParseVp9FrameHeader(kBadMarker, 2, &header), ERROR_MALFORMED);
+  frame.resize(2);
+  EXPECT_EQ(ParseVp9FrameHeader(frame.data(), frame.size(), &header),
+            ERROR_MALFORMED);
+}
+
+TEST(Vp9UtilsTest, Superframe) {
+  std::vector<uint8_t> first = MakeKeyFrame(640, 360);
+  std::vector<uint8_t> second = MakeKeyFrame(1280, 720);
+  std::vector<uint8_t> data = MakeSuperframe({first, second});
+
+  std::vector<Vp9Frame> frames;
+  ASSERT_EQ(SplitVp9Superframe(data.data(), data.size(), &frames), OK);
+  ASSERT_EQ(frames.size(), 2u);
+  EXPECT_EQ(frames[0].data, data.data());
+  EXPECT_EQ(frames[0].size, first.size());
+  EXPECT_EQ(frames[1].data, data.data() + first.size());
+  EXPECT_EQ(frames[1].size, second.size());
+
+  // a single frame
+  ASSERT_EQ(SplitVp9Superframe(first.data(), first.size(), &frames), OK);
+  ASSERT_EQ(frames.size(), 1u);
+  EXPECT_EQ(frames[0].size, first.size());
+
+  // sizes past the end of the sample
+  data[data.size() - 4] = 0xff;
+  EXPECT_EQ(SplitVp9Superframe(data.data(), data.size(), &frames),
+            ERROR_MALFORMED);
+}
+
+TEST(Vp9UtilsTest, HiddenFrames) {
+  Vp9Parser parser;
+  Vp9SampleInfo info;
+  std::vector<uint8_t> data = MakeKeyFrame(640, 360);
+  ASSERT_EQ(parser.parseSample(data.data(), data.size(), &info), OK);
+
+  // an alt-ref of another size in slot 2, then the frame shown
+  data = MakeSuperframe({MakeInterFrame(0x04, -1, 1280, 720, false),
+                         MakeInterFrame(0x01, 0)});
+  ASSERT_EQ(parser.parseSample(data.data(), data.size(), &info), OK);
+  EXPECT_EQ(info.numFrames, 2u);
+  EXPECT_EQ(info.numShownFrames, 1u);
+  EXPECT_EQ(info.maxSpatialId, 0);
+  EXPECT_EQ(info.width, 640u);
+  EXPECT_EQ(info.height, 360u);
+
+  // the shown frame first
+  data = MakeSuperframe({MakeInterFrame(0x01, 0),
+                         MakeInterFrame(0x04, -1, 1280, 720, false)});
+  ASSERT_EQ(parser.parseSample(data.data(), data.size(), &info), OK);
+  EXPECT_EQ(info.maxSpatialId, 0);
+  EXPECT_EQ(info.width, 640u);
+
+  // showing the alt-ref later
+  data = MakeShowExistingFrame(2);
+  ASSERT_EQ(parser.parseSample(data.data(), data.size(), &info), OK);
+  EXPECT_FALSE(info.isKeyFrame);
+  EXPECT_EQ(info.numShownFrames, 1u);
+  EXPECT_EQ(info.width, 1280u);
+  EXPECT_EQ(info.height, 720u);
+}
+
+TEST(Vp9UtilsTest, SpatialLayers) {
+  Vp9Parser parser;
+  parser.setSpatialLayers(2);
+  Vp9SampleInfo info;
+  // L2T1: each superframe has a frame per spatial layer, only the top one is
+  // shown
+  std::vector<uint8_t> base = MakeKeyFrame(640, 360);
+  base[0] &= ~0x02;  // show_frame
+  std::vector<uint8_t> data =
+      MakeSuperframe({base, MakeInterFrame(0x02, -1, 1280, 720)});
+  std::vector<Vp9Frame> frames;
+  ASSERT_EQ(parser.parseSample(data.data(), data.size(), &info, &frames), OK);
+  EXPECT_EQ(frames.size(), 2u);
+  EXPECT_EQ(info.numFrames, 2u);
+  EXPECT_TRUE(info.isKeyFrame);
+  EXPECT_EQ(info.numShownFrames, 1u);
+  EXPECT_EQ(info.maxSpatialId, 1);
+  EXPECT_EQ(info.width, 1280u);
+  EXPECT_EQ(info.height, 720u);
+
+  // the sizes come from slot 0 and 1
+  data = MakeSuperframe({MakeInterFrame(0x01, 0), MakeInterFrame(0x02, 1)});
+  ASSERT_EQ(parser.parseSample(data.data(), data.size(), &info), OK);
+  EXPECT_FALSE(info.isKeyFrame);
+  EXPECT_EQ(info.maxSpatialId, 1);
+  EXPECT_EQ(info.width, 1280u);
+  EXPECT_EQ(info.height, 720u);
+
+  // only the base layer
+  data = MakeInterFrame(0x01, 0);
+  ASSERT_EQ(parser.parseSample(data.data(), data.size(), &info), OK);
+  EXPECT_EQ(info.numFrames, 1u);
+  EXPECT_EQ(info.maxSpatialId, 0);
+  EXPECT_EQ(info.width, 640u);
+  EXPECT_EQ(info.height, 360u);
+}
+
+}  // namespace ave
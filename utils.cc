@@ -15,6 +15,7 @@
 #include "base/logging.h"
 
 #include "Lookup.h"
+#include "aac_utils.h"
 #include "buffer.h"
 #include "codec_constants.h"
 #include "color_utils.h"
@@ -23,6 +24,7 @@
 #include "media_defs.h"
 #include "message.h"
 #include "meta_data.h"
+#include "start_code.h"
 
 #define AMEDIAFORMAT_KEY_MPEGH_PROFILE_LEVEL_INDICATION \
   "mpegh-profile-level-indication"
@@ -39,12 +41,19 @@ constexpr static int32_t DolbyVisionLevelUnknown = 0;
 }  // namespace
 
 namespace ave {
+// Codec specific data is sent as a config sample at time 0. The flags live
+// in SampleMeta, so no Message is allocated for them.
+static void markAsCodecConfig(Buffer* buffer) {
+  buffer->sampleMeta().codec_config = true;
+  buffer->sampleMeta().pts_us = 0;
+}
+
 static status_t copyNALUToBuffer(std::shared_ptr<Buffer>& buffer,
                                  const uint8_t* ptr,
                                  size_t length) {
   if ((buffer->size() + 4 + length) > (buffer->capacity() - buffer->offset())) {
     std::shared_ptr<Buffer> tmpBuffer =
-        std::make_shared<Buffer>(buffer->size() + 4 + length + 1024);
+        Buffer::Create(buffer->size() + 4 + length + 1024);
     if (tmpBuffer.get() == nullptr || tmpBuffer->base() == nullptr) {
       return NO_MEMORY;
     }
@@ -79,11 +88,13 @@ static void convertMetaDataToMessageColorAspects(
   colorAspects.mTransfer = (ColorAspects::Transfer)transferFunction;
   colorAspects.mMatrixCoeffs = (ColorAspects::MatrixCoeffs)colorMatrix;
 
-  int32_t rangeMsg, standardMsg, transferMsg;
-  if (ColorUtils::convertCodecColorAspectsToPlatformAspects(
-          colorAspects, &rangeMsg, &standardMsg, &transferMsg) != OK) {
+  uint32_t packed;
+  if (ColorUtils::packToU32Checked(colorAspects, &packed) != OK) {
     return;
   }
+  int32_t rangeMsg, standardMsg, transferMsg;
+  ColorUtils::convertPackedCodecColorAspectsToPlatformAspects(
+      packed, &rangeMsg, &standardMsg, &transferMsg);
 
   // save specified values to msg
   if (rangeMsg != 0) {
@@ -127,11 +138,23 @@ static void parseAacProfileFromCsd(const std::shared_ptr<Buffer>& csd,
     return;
   }
 
-  uint16_t audioObjectType = U16_AT((uint8_t*)csd->data());
-  if ((audioObjectType & 0xF800) == 0xF800) {
-    audioObjectType = 32 + ((audioObjectType >> 5) & 0x3F);
+  uint16_t audioObjectType;
+  AudioSpecificConfig config;
+  if (ParseAudioSpecificConfig(csd->data(), csd->size(), &config) == OK) {
+    // the profile signalled, also backward compatibly, not the core one
+    audioObjectType = config.object_type;
+    if (config.ps_present) {
+      audioObjectType = AACObjectHE_PS;
+    } else if (config.sbr_present) {
+      audioObjectType = AACObjectHE;
+    }
   } else {
-    audioObjectType >>= 11;
+    audioObjectType = U16_AT((uint8_t*)csd->data());
+    if ((audioObjectType & 0xF800) == 0xF800) {
+      audioObjectType = 32 + ((audioObjectType >> 5) & 0x3F);
+    } else {
+      audioObjectType >>= 11;
+    }
   }
 
   const static Lookup<uint16_t, int32_t> profiles{
@@ -791,8 +814,7 @@ void convertMetaDataToMessageFromMappings(const MetaData* meta,
     size_t size;
     if (meta->findData(elem.second, &type, &data, &size)) {
       std::shared_ptr<Buffer> buf = Buffer::CreateAsCopy(data, size);
-      buf->meta()->setInt32("csd", true);
-      buf->meta()->setInt64("timeUs", 0);
+      markAsCodecConfig(buf.get());
       format->setBuffer(elem.first, buf);
     }
   }
@@ -838,7 +860,7 @@ status_t convertMetaDataToMessage(const MetaData* meta,
   const void* data;
   size_t size;
   if (meta->findData(kKeyCASessionID, &type, &data, &size)) {
-    auto buffer = std::make_shared<Buffer>(size);
+    auto buffer = Buffer::Create(size);
     if (buffer.get() == nullptr || buffer->base() == nullptr) {
       return NO_MEMORY;
     }
@@ -848,7 +870,7 @@ status_t convertMetaDataToMessage(const MetaData* meta,
   }
 
   if (meta->findData(kKeyCAPrivateData, &type, &data, &size)) {
-    auto buffer = std::make_shared<Buffer>(size);
+    auto buffer = Buffer::Create(size);
     if (buffer.get() == nullptr || buffer->base() == nullptr) {
       return NO_MEMORY;
     }
@@ -961,7 +983,7 @@ status_t convertMetaDataToMessage(const MetaData* meta,
 
     if (meta->findData(kKeyHdr10PlusInfo, &hdr_type, &hdr_data, &hdr_size) &&
         hdr_size > 0) {
-      auto buffer = std::make_shared<Buffer>(hdr_size);
+      auto buffer = Buffer::Create(hdr_size);
       if (buffer.get() == nullptr || buffer->base() == nullptr) {
         return NO_MEMORY;
       }
@@ -1018,7 +1040,7 @@ status_t convertMetaDataToMessage(const MetaData* meta,
     //                    mpeghReferenceChannelLayout);
     //    }
     //    if (meta->findData(kKeyMpeghCompatibleSets, &type, &data, &size)) {
-    //      auto buffer = std::make_shared<Buffer>(size);
+    //      auto buffer = Buffer::Create(size);
     //      if (buffer.get() == nullptr || buffer->base() == nullptr) {
     //        return NO_MEMORY;
     //      }
@@ -1094,7 +1116,7 @@ status_t convertMetaDataToMessage(const MetaData* meta,
     ptr += 6;
     size -= 6;
 
-    auto buffer = std::make_shared<Buffer>(1024);
+    auto buffer = Buffer::Create(1024);
     if (buffer.get() == nullptr || buffer->base() == nullptr) {
       return NO_MEMORY;
     }
@@ -1122,12 +1144,11 @@ status_t convertMetaDataToMessage(const MetaData* meta,
       size -= length;
     }
 
-    buffer->meta()->setInt32("csd", true);
-    buffer->meta()->setInt64("timeUs", 0);
+    markAsCodecConfig(buffer.get());
 
     msg->setBuffer("csd-0", buffer);
 
-    buffer = std::make_shared<Buffer>(1024);
+    buffer = Buffer::Create(1024);
     if (buffer.get() == nullptr || buffer->base() == nullptr) {
       return NO_MEMORY;
     }
@@ -1163,8 +1184,7 @@ status_t convertMetaDataToMessage(const MetaData* meta,
       size -= length;
     }
 
-    buffer->meta()->setInt32("csd", true);
-    buffer->meta()->setInt64("timeUs", 0);
+    markAsCodecConfig(buffer.get());
     msg->setBuffer("csd-1", buffer);
   } else if (meta->findData(kKeyHVCC, &type, &data, &size)) {
     const uint8_t* ptr = (const uint8_t*)data;
@@ -1185,7 +1205,7 @@ status_t convertMetaDataToMessage(const MetaData* meta,
     size -= 1;
     size_t j = 0, i = 0;
 
-    auto buffer = std::make_shared<Buffer>(1024);
+    auto buffer = Buffer::Create(1024);
     if (buffer.get() == nullptr || buffer->base() == nullptr) {
       return NO_MEMORY;
     }
@@ -1230,8 +1250,7 @@ status_t convertMetaDataToMessage(const MetaData* meta,
         size -= length;
       }
     }
-    buffer->meta()->setInt32("csd", true);
-    buffer->meta()->setInt64("timeUs", 0);
+    markAsCodecConfig(buffer.get());
     msg->setBuffer("csd-0", buffer);
 
     // if we saw VUI color information we know whether this is HDR because VUI
@@ -1289,9 +1308,11 @@ status_t convertMetaDataToMessage(const MetaData* meta,
         }
       }
 
-      int32_t standard, transfer, range;
-      if (ColorUtils::convertCodecColorAspectsToPlatformAspects(
-              aspects, &range, &standard, &transfer) == OK) {
+      uint32_t packed;
+      if (ColorUtils::packToU32Checked(aspects, &packed) == OK) {
+        int32_t standard, transfer, range;
+        ColorUtils::convertPackedCodecColorAspectsToPlatformAspects(
+            packed, &range, &standard, &transfer);
         msg->setInt32("color-standard", standard);
         msg->setInt32("color-transfer", transfer);
         msg->setInt32("color-range", range);
@@ -1300,14 +1321,13 @@ status_t convertMetaDataToMessage(const MetaData* meta,
 
     parseHevcProfileLevelFromHvcc((const uint8_t*)data, dataSize, msg);
   } else if (meta->findData(kKeyAV1C, &type, &data, &size)) {
-    auto buffer = std::make_shared<Buffer>(size);
+    auto buffer = Buffer::Create(size);
     if (buffer.get() == nullptr || buffer->base() == nullptr) {
       return NO_MEMORY;
     }
     memcpy(buffer->data(), data, size);
 
-    buffer->meta()->setInt32("csd", true);
-    buffer->meta()->setInt64("timeUs", 0);
+    markAsCodecConfig(buffer.get());
     msg->setBuffer("csd-0", buffer);
     parseAV1ProfileLevelFromCsd(buffer, msg);
   } else if (meta->findData(kKeyESDS, &type, &data, &size)) {
@@ -1320,15 +1340,14 @@ status_t convertMetaDataToMessage(const MetaData* meta,
     size_t codec_specific_data_size;
     esds.getCodecSpecificInfo(&codec_specific_data, &codec_specific_data_size);
 
-    auto buffer = std::make_shared<Buffer>(codec_specific_data_size);
+    auto buffer = Buffer::Create(codec_specific_data_size);
     if (buffer.get() == nullptr || buffer->base() == nullptr) {
       return NO_MEMORY;
     }
 
     memcpy(buffer->data(), codec_specific_data, codec_specific_data_size);
 
-    buffer->meta()->setInt32("csd", true);
-    buffer->meta()->setInt64("timeUs", 0);
+    markAsCodecConfig(buffer.get());
     msg->setBuffer("csd-0", buffer);
 
     if (!strcasecmp(mime, MEDIA_MIMETYPE_VIDEO_MPEG4)) {
@@ -1359,52 +1378,48 @@ status_t convertMetaDataToMessage(const MetaData* meta,
     const uint8_t* ptr = (const uint8_t*)data;
     parseH263ProfileLevelFromD263(ptr, size, msg);
   } else if (meta->findData(kKeyOpusHeader, &type, &data, &size)) {
-    auto buffer = std::make_shared<Buffer>(size);
+    auto buffer = Buffer::Create(size);
     if (buffer.get() == nullptr || buffer->base() == nullptr) {
       return NO_MEMORY;
     }
     memcpy(buffer->data(), data, size);
 
-    buffer->meta()->setInt32("csd", true);
-    buffer->meta()->setInt64("timeUs", 0);
+    markAsCodecConfig(buffer.get());
     msg->setBuffer("csd-0", buffer);
 
     if (!meta->findData(kKeyOpusCodecDelay, &type, &data, &size)) {
       return -EINVAL;
     }
 
-    buffer = std::make_shared<Buffer>(size);
+    buffer = Buffer::Create(size);
     if (buffer.get() == nullptr || buffer->base() == nullptr) {
       return NO_MEMORY;
     }
     memcpy(buffer->data(), data, size);
 
-    buffer->meta()->setInt32("csd", true);
-    buffer->meta()->setInt64("timeUs", 0);
+    markAsCodecConfig(buffer.get());
     msg->setBuffer("csd-1", buffer);
 
     if (!meta->findData(kKeyOpusSeekPreRoll, &type, &data, &size)) {
       return -EINVAL;
     }
 
-    buffer = std::make_shared<Buffer>(size);
+    buffer = Buffer::Create(size);
     if (buffer.get() == nullptr || buffer->base() == nullptr) {
       return NO_MEMORY;
     }
     memcpy(buffer->data(), data, size);
 
-    buffer->meta()->setInt32("csd", true);
-    buffer->meta()->setInt64("timeUs", 0);
+    markAsCodecConfig(buffer.get());
     msg->setBuffer("csd-2", buffer);
   } else if (meta->findData(kKeyVp9CodecPrivate, &type, &data, &size)) {
-    auto buffer = std::make_shared<Buffer>(size);
+    auto buffer = Buffer::Create(size);
     if (buffer.get() == nullptr || buffer->base() == nullptr) {
       return NO_MEMORY;
     }
     memcpy(buffer->data(), data, size);
 
-    buffer->meta()->setInt32("csd", true);
-    buffer->meta()->setInt64("timeUs", 0);
+    markAsCodecConfig(buffer.get());
     msg->setBuffer("csd-0", buffer);
 
     parseVp9ProfileLevelFromCsd(buffer, msg);
@@ -1412,14 +1427,13 @@ status_t convertMetaDataToMessage(const MetaData* meta,
     AVE_LOG(LS_VERBOSE)
         << "convertMetaDataToMessage found kKeyAlacMagicCookie of size "
         << size;
-    auto buffer = std::make_shared<Buffer>(size);
+    auto buffer = Buffer::Create(size);
     if (buffer.get() == nullptr || buffer->base() == nullptr) {
       return NO_MEMORY;
     }
     memcpy(buffer->data(), data, size);
 
-    buffer->meta()->setInt32("csd", true);
-    buffer->meta()->setInt64("timeUs", 0);
+    markAsCodecConfig(buffer.get());
     msg->setBuffer("csd-0", buffer);
   }
 
@@ -1428,7 +1442,7 @@ status_t convertMetaDataToMessage(const MetaData* meta,
       meta->findData(kKeyDVWC, &type, &data, &size)) {
     std::shared_ptr<Buffer> buffer, csdOrg;
     if (msg->findBuffer("csd-0", csdOrg)) {
-      buffer = std::make_shared<Buffer>(size + csdOrg->size());
+      buffer = Buffer::Create(size + csdOrg->size());
       if (buffer.get() == nullptr || buffer->base() == nullptr) {
         return NO_MEMORY;
       }
@@ -1436,15 +1450,14 @@ status_t convertMetaDataToMessage(const MetaData* meta,
       memcpy(buffer->data(), csdOrg->data(), csdOrg->size());
       memcpy(buffer->data() + csdOrg->size(), data, size);
     } else {
-      buffer = std::make_shared<Buffer>(size);
+      buffer = Buffer::Create(size);
       if (buffer.get() == nullptr || buffer->base() == nullptr) {
         return NO_MEMORY;
       }
       memcpy(buffer->data(), data, size);
     }
 
-    buffer->meta()->setInt32("csd", true);
-    buffer->meta()->setInt64("timeUs", 0);
+    markAsCodecConfig(buffer.get());
     msg->setBuffer("csd-0", buffer);
 
     const uint8_t* ptr = (const uint8_t*)data;
@@ -1468,4 +1481,12 @@ status_t convertMessageToMetaData(const std::shared_ptr<Message>& format,
   return OK;
 }
 
+const uint8_t* findNextNalStartCode(const uint8_t* data, size_t length) {
+  size_t offset = FindStartCode(data, length);
+  if (offset < length && offset > 0 && data[offset - 1] == 0x00) {
+    --offset;
+  }
+  return &data[offset];
+}
+
 } /* namespace ave */
@@ -26,8 +26,8 @@ status_t convertMessageToMetaData(const std::shared_ptr<Message>& format,
 
 // Returns a pointer to the next NAL start code in buffer of size |length|
 // starting at |data|, or a pointer to the end of the buffer if the start code
-// is not found.
-// TODO: combine this with avc_utils::getNextNALUnit
+// is not found. A four byte start code is returned from its first zero byte.
+// Shares the scanner of avc_utils::getNextNALUnit, see start_code.h.
 const uint8_t* findNextNalStartCode(const uint8_t* data, size_t length);
 
 struct HLSTime {
@@ -0,0 +1,297 @@
+/*
+ * vector_math.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "vector_math.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AVE_VECTOR_MATH_X86 1
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define AVE_VECTOR_MATH_NEON 1
+#endif
+
+namespace ave {
+namespace vector_math {
+
+namespace {
+
+void FMACScalar(const float* src, float scale, size_t len, float* dest) {
+  for (size_t i = 0; i < len; i++) {
+    dest[i] += src[i] * scale;
+  }
+}
+
+void FMULScalar(const float* src, float scale, size_t len, float* dest) {
+  for (size_t i = 0; i < len; i++) {
+    dest[i] = src[i] * scale;
+  }
+}
+
+float DotProductScalar(const float* a, const float* b, size_t len) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < len; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+// The vector versions use unaligned loads, on current CPUs they cost the
+// same as aligned ones when the data happens to be aligned. The tail is left
+// to the scalar loop.
+
+#if defined(AVE_VECTOR_MATH_X86) && defined(__SSE__)
+void FMACSSE(const float* src, float scale, size_t len, float* dest) {
+  const size_t rounded = len & ~size_t(3);
+  const __m128 m_scale = _mm_set1_ps(scale);
+  for (size_t i = 0; i < rounded; i += 4) {
+    __m128 d = _mm_loadu_ps(dest + i);
+    d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(src + i), m_scale));
+    _mm_storeu_ps(dest + i, d);
+  }
+  FMACScalar(src + rounded, scale, len - rounded, dest + rounded);
+}
+
+void FMULSSE(const float* src, float scale, size_t len, float* dest) {
+  const size_t rounded = len & ~size_t(3);
+  const __m128 m_scale = _mm_set1_ps(scale);
+  for (size_t i = 0; i < rounded; i += 4) {
+    _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_loadu_ps(src + i), m_scale));
+  }
+  FMULScalar(src + rounded, scale, len - rounded, dest + rounded);
+}
+
+// Two accumulators to hide the latency of the additions.
+float DotProductSSE(const float* a, const float* b, size_t len) {
+  const size_t rounded = len & ~size_t(7);
+  __m128 sum0 = _mm_setzero_ps();
+  __m128 sum1 = _mm_setzero_ps();
+  for (size_t i = 0; i < rounded; i += 8) {
+    sum0 = _mm_add_ps(sum0,
+                      _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sum1 = _mm_add_ps(
+        sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  __m128 sum = _mm_add_ps(sum0, sum1);
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum) +
+         DotProductScalar(a + rounded, b + rounded, len - rounded);
+}
+#endif
+
+#if defined(AVE_VECTOR_MATH_X86)
+// Multiply and add separately, so no FMA support is needed beyond AVX2.
+__attribute__((target("avx2"))) void FMACAVX2(const float* src,
+                                              float scale,
+                                              size_t len,
+                                              float* dest) {
+  const size_t rounded = len & ~size_t(7);
+  const __m256 m_scale = _mm256_set1_ps(scale);
+  for (size_t i = 0; i < rounded; i += 8) {
+    __m256 d = _mm256_loadu_ps(dest + i);
+    d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(src + i), m_scale));
+    _mm256_storeu_ps(dest + i, d);
+  }
+  FMACScalar(src + rounded, scale, len - rounded, dest + rounded);
+}
+
+__attribute__((target("avx2"))) void FMULAVX2(const float* src,
+                                              float scale,
+                                              size_t len,
+                                              float* dest) {
+  const size_t rounded = len & ~size_t(7);
+  const __m256 m_scale = _mm256_set1_ps(scale);
+  for (size_t i = 0; i < rounded; i += 8) {
+    _mm256_storeu_ps(dest + i,
+                     _mm256_mul_ps(_mm256_loadu_ps(src + i), m_scale));
+  }
+  FMULScalar(src + rounded, scale, len - rounded, dest + rounded);
+}
+
+__attribute__((target("avx2"))) float DotProductAVX2(const float* a,
+                                                     const float* b,
+                                                     size_t len) {
+  const size_t rounded = len & ~size_t(7);
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= rounded; i += 16) {
+    sum0 = _mm256_add_ps(
+        sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                             _mm256_loadu_ps(b + i + 8)));
+  }
+  if (i < rounded) {
+    sum0 = _mm256_add_ps(
+        sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+  }
+  __m256 sum8 = _mm256_add_ps(sum0, sum1);
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8),
+                          _mm256_extractf128_ps(sum8, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum) +
+         DotProductScalar(a + rounded, b + rounded, len - rounded);
+}
+#endif
+
+#if defined(AVE_VECTOR_MATH_NEON)
+void FMACNEON(const float* src, float scale, size_t len, float* dest) {
+  const size_t rounded = len & ~size_t(3);
+  const float32x4_t m_scale = vmovq_n_f32(scale);
+  for (size_t i = 0; i < rounded; i += 4) {
+    float32x4_t d = vld1q_f32(dest + i);
+    d = vaddq_f32(d, vmulq_f32(vld1q_f32(src + i), m_scale));
+    vst1q_f32(dest + i, d);
+  }
+  FMACScalar(src + rounded, scale, len - rounded, dest + rounded);
+}
+
+void FMULNEON(const float* src, float scale, size_t len, float* dest) {
+  const size_t rounded = len & ~size_t(3);
+  const float32x4_t m_scale = vmovq_n_f32(scale);
+  for (size_t i = 0; i < rounded; i += 4) {
+    vst1q_f32(dest + i, vmulq_f32(vld1q_f32(src + i), m_scale));
+  }
+  FMULScalar(src + rounded, scale, len - rounded, dest + rounded);
+}
+
+float DotProductNEON(const float* a, const float* b, size_t len) {
+  const size_t rounded = len & ~size_t(7);
+  float32x4_t sum0 = vdupq_n_f32(0.0f);
+  float32x4_t sum1 = vdupq_n_f32(0.0f);
+  for (size_t i = 0; i < rounded; i += 8) {
+    sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+    sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  return vaddvq_f32(vaddq_f32(sum0, sum1)) +
+         DotProductScalar(a + rounded, b + rounded, len - rounded);
+}
+#endif
+
+const Impl kPreferred[] = {
+    Impl::kAVX2,
+    Impl::kSSE,
+    Impl::kNEON,
+};
+
+// The widest implementation the CPU supports.
+FMACProc SelectFMAC() {
+  for (Impl impl : kPreferred) {
+    FMACProc proc = GetFMAC(impl);
+    if (proc != nullptr) {
+      return proc;
+    }
+  }
+  return FMACScalar;
+}
+
+FMULProc SelectFMUL() {
+  for (Impl impl : kPreferred) {
+    FMULProc proc = GetFMUL(impl);
+    if (proc != nullptr) {
+      return proc;
+    }
+  }
+  return FMULScalar;
+}
+
+DotProductProc SelectDotProduct() {
+  for (Impl impl : kPreferred) {
+    DotProductProc proc = GetDotProduct(impl);
+    if (proc != nullptr) {
+      return proc;
+    }
+  }
+  return DotProductScalar;
+}
+
+}  // namespace
+
+void FMAC(const float* src, float scale, size_t len, float* dest) {
+  static const FMACProc proc = SelectFMAC();
+  proc(src, scale, len, dest);
+}
+
+void FMUL(const float* src, float scale, size_t len, float* dest) {
+  static const FMULProc proc = SelectFMUL();
+  proc(src, scale, len, dest);
+}
+
+float DotProduct(const float* a, const float* b, size_t len) {
+  static const DotProductProc proc = SelectDotProduct();
+  return proc(a, b, len);
+}
+
+FMACProc GetFMAC(Impl impl) {
+  switch (impl) {
+    case Impl::kScalar:
+      return FMACScalar;
+#if defined(AVE_VECTOR_MATH_X86) && defined(__SSE__)
+    case Impl::kSSE:
+      return FMACSSE;
+#endif
+#if defined(AVE_VECTOR_MATH_X86)
+    case Impl::kAVX2:
+      return __builtin_cpu_supports("avx2") ? FMACAVX2 : nullptr;
+#endif
+#if defined(AVE_VECTOR_MATH_NEON)
+    case Impl::kNEON:
+      return FMACNEON;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+FMULProc GetFMUL(Impl impl) {
+  switch (impl) {
+    case Impl::kScalar:
+      return FMULScalar;
+#if defined(AVE_VECTOR_MATH_X86) && defined(__SSE__)
+    case Impl::kSSE:
+      return FMULSSE;
+#endif
+#if defined(AVE_VECTOR_MATH_X86)
+    case Impl::kAVX2:
+      return __builtin_cpu_supports("avx2") ? FMULAVX2 : nullptr;
+#endif
+#if defined(AVE_VECTOR_MATH_NEON)
+    case Impl::kNEON:
+      return FMULNEON;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+DotProductProc GetDotProduct(Impl impl) {
+  switch (impl) {
+    case Impl::kScalar:
+      return DotProductScalar;
+#if defined(AVE_VECTOR_MATH_X86) && defined(__SSE__)
+    case Impl::kSSE:
+      return DotProductSSE;
+#endif
+#if defined(AVE_VECTOR_MATH_X86)
+    case Impl::kAVX2:
+      return __builtin_cpu_supports("avx2") ? DotProductAVX2 : nullptr;
+#endif
+#if defined(AVE_VECTOR_MATH_NEON)
+    case Impl::kNEON:
+      return DotProductNEON;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+}  // namespace vector_math
+}  // namespace ave
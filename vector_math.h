@@ -0,0 +1,51 @@
+/*
+ * vector_math.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef VECTOR_MATH_H
+#define VECTOR_MATH_H
+
+#include <cstddef>
+
+namespace ave {
+namespace vector_math {
+
+// Multiply each element of |src| by |scale| and add to |dest|.
+// dest[i] += src[i] * scale. |src| and |dest| need no particular alignment.
+void FMAC(const float* src, float scale, size_t len, float* dest);
+
+// Multiply each element of |src| by |scale| and store in |dest|, which may
+// be |src|. dest[i] = src[i] * scale.
+void FMUL(const float* src, float scale, size_t len, float* dest);
+
+// Sum of a[i] * b[i]. The order of the additions depends on the
+// implementation, so the result may differ in the last bits.
+float DotProduct(const float* a, const float* b, size_t len);
+
+enum class Impl {
+  kScalar,
+  kSSE,
+  kAVX2,
+  kNEON,
+};
+
+using FMACProc = void (*)(const float* src,
+                          float scale,
+                          size_t len,
+                          float* dest);
+using FMULProc = FMACProc;
+using DotProductProc = float (*)(const float* a, const float* b, size_t len);
+
+// Returns the given implementation, or nullptr if it is not built in or not
+// supported by this CPU. For tests and benchmarks.
+FMACProc GetFMAC(Impl impl);
+FMULProc GetFMUL(Impl impl);
+DotProductProc GetDotProduct(Impl impl);
+
+}  // namespace vector_math
+}  // namespace ave
+
+#endif /* !VECTOR_MATH_H */
@@ -0,0 +1,833 @@
+/*
+ * video_scaler.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "video_scaler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "base/logging.h"
+
+#include "media_packet.h"
+#include "meta_data.h"
+#include "worker_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AVE_SCALER_X86 1
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define AVE_SCALER_NEON 1
+#endif
+
+namespace ave {
+
+// The filter of one axis of a plane, in fixed point.
+struct VideoScaler::AxisFilter {
+  uint32_t src_size = 0;
+  uint32_t dst_size = 0;
+  // of every output sample, the same for all
+  int taps = 0;
+  // first source sample of every output sample, never decreasing
+  std::vector<int32_t> starts;
+  // Q14 and tap major: coefs[tap * dst_size + output], the taps of an
+  // output sum up to exactly 1 << 14
+  std::vector<int16_t> coefs;
+};
+
+struct VideoScaler::Kernels {
+  // Filters a row of |channels| interleaved samples horizontally into |dst|,
+  // with 6 fractional bits.
+  void (*horizontal)(const uint8_t* src,
+                     uint32_t src_width,
+                     const int32_t* starts,
+                     const int16_t* coefs,
+                     int taps,
+                     int outputs,
+                     int channels,
+                     int16_t* dst);
+  // Sums |taps| horizontally filtered rows of |width| samples weighted by
+  // |coefs| into |dst|.
+  void (*vertical)(const int16_t* const* rows,
+                   const int16_t* coefs,
+                   int taps,
+                   uint8_t* dst,
+                   int width);
+};
+
+// The rows of a plane in a scale.
+struct VideoScaler::PlaneJob {
+  const FrameView::Plane* src;
+  const FrameView::Plane* dst;
+  const AxisFilter* horizontal;
+  const AxisFilter* vertical;
+  int channels;
+};
+
+namespace {
+
+const int kCoefBits = 14;
+// The horizontal pass keeps 6 of the 14 fractional bits, the vertical one
+// drops the 20 left over.
+const int kHorizontalShift = 8;
+const int kVerticalShift = 20;
+
+// Output rows of a band scaled by one task.
+const uint32_t kMinBandRows = 16;
+
+struct ScaleFormat {
+  PixelFormat format;
+  uint8_t num_planes;
+  // interleaved samples per pixel of every plane
+  uint8_t channels[FrameView::kMaxPlanes];
+  // chroma subsampling of planes 1 and 2
+  uint8_t log2_chroma_w;
+  uint8_t log2_chroma_h;
+};
+
+// clang-format off
+const ScaleFormat kScaleFormats[] = {
+  {AV_PIX_FMT_YUV420P,  3, {1, 1, 1, 0}, 1, 1},
+  {AV_PIX_FMT_YUVJ420P, 3, {1, 1, 1, 0}, 1, 1},
+  {AV_PIX_FMT_YUV422P,  3, {1, 1, 1, 0}, 1, 0},
+  {AV_PIX_FMT_YUVJ422P, 3, {1, 1, 1, 0}, 1, 0},
+  {AV_PIX_FMT_YUV444P,  3, {1, 1, 1, 0}, 0, 0},
+  {AV_PIX_FMT_YUVJ444P, 3, {1, 1, 1, 0}, 0, 0},
+  {AV_PIX_FMT_YUVA420P, 4, {1, 1, 1, 1}, 1, 1},
+  {AV_PIX_FMT_GRAY8,    1, {1, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_NV12,     2, {1, 2, 0, 0}, 1, 1},
+  {AV_PIX_FMT_NV21,     2, {1, 2, 0, 0}, 1, 1},
+  {AV_PIX_FMT_RGBA,     1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_BGRA,     1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_ARGB,     1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_ABGR,     1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_RGB0,     1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_0RGB,     1, {4, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_RGB24,    1, {3, 0, 0, 0}, 0, 0},
+  {AV_PIX_FMT_BGR24,    1, {3, 0, 0, 0}, 0, 0},
+};
+// clang-format on
+
+const ScaleFormat* FindScaleFormat(PixelFormat format) {
+  for (const auto& info : kScaleFormats) {
+    if (info.format == format) {
+      return &info;
+    }
+  }
+  return nullptr;
+}
+
+uint32_t CeilDiv(uint32_t value, uint32_t divisor) {
+  return (value + divisor - 1) / divisor;
+}
+
+bool IsChromaPlane(size_t index) {
+  return index == 1 || index == 2;
+}
+
+double Triangle(double x) {
+  x = std::fabs(x);
+  return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+// Catmull-Rom, the cubic of Keys with a = -0.5
+double CatmullRom(double x) {
+  x = std::fabs(x);
+  if (x < 1.0) {
+    return (1.5 * x - 2.5) * x * x + 1.0;
+  }
+  if (x < 2.0) {
+    return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+  }
+  return 0.0;
+}
+
+uint8_t Clamp255(int32_t value) {
+  return static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+}
+
+void HorizontalScalarRange(const uint8_t* src,
+                           const int32_t* starts,
+                           const int16_t* coefs,
+                           int taps,
+                           int outputs,
+                           int channels,
+                           int begin,
+                           int16_t* dst) {
+  const int32_t round = 1 << (kHorizontalShift - 1);
+  for (int x = begin; x < outputs; x++) {
+    const uint8_t* p = src + starts[x] * channels;
+    for (int c = 0; c < channels; c++) {
+      int32_t sum = round;
+      for (int t = 0; t < taps; t++) {
+        sum += coefs[t * outputs + x] * p[t * channels + c];
+      }
+      dst[x * channels + c] = static_cast<int16_t>(sum >> kHorizontalShift);
+    }
+  }
+}
+
+void HorizontalScalar(const uint8_t* src,
+                      uint32_t /*src_width*/,
+                      const int32_t* starts,
+                      const int16_t* coefs,
+                      int taps,
+                      int outputs,
+                      int channels,
+                      int16_t* dst) {
+  HorizontalScalarRange(src, starts, coefs, taps, outputs, channels, 0, dst);
+}
+
+void VerticalScalarRange(const int16_t* const* rows,
+                         const int16_t* coefs,
+                         int taps,
+                         uint8_t* dst,
+                         int begin,
+                         int width) {
+  const int32_t round = 1 << (kVerticalShift - 1);
+  for (int x = begin; x < width; x++) {
+    int32_t sum = round;
+    for (int t = 0; t < taps; t++) {
+      sum += coefs[t] * rows[t][x];
+    }
+    dst[x] = Clamp255(sum >> kVerticalShift);
+  }
+}
+
+void VerticalScalar(const int16_t* const* rows,
+                    const int16_t* coefs,
+                    int taps,
+                    uint8_t* dst,
+                    int width) {
+  VerticalScalarRange(rows, coefs, taps, dst, 0, width);
+}
+
+#if defined(AVE_SCALER_X86)
+
+#define AVE_SCALER_AVX2 __attribute__((target("avx2")))
+
+// Eight output pixels at a time, every tap gathers the source pixels of
+// all eight. The gathers load 4 bytes, so the pixels near the end of the
+// row are left to the scalar loop when they are narrower.
+template <int kChannels>
+AVE_SCALER_AVX2 void HorizontalAVX2Channels(const uint8_t* src,
+                                            uint32_t src_width,
+                                            const int32_t* starts,
+                                            const int16_t* coefs,
+                                            int taps,
+                                            int outputs,
+                                            int16_t* dst) {
+  const int64_t row_bytes = int64_t{src_width} * kChannels;
+  int end = outputs;
+  while (end > 0 &&
+         (int64_t{starts[end - 1]} + taps - 1) * kChannels + 4 > row_bytes) {
+    end--;
+  }
+
+  const int shift = kChannels == 1 ? 0 : (kChannels == 2 ? 1 : 2);
+  const __m256i round = _mm256_set1_epi32(1 << (kHorizontalShift - 1));
+  const __m256i mask = _mm256_set1_epi32(0xff);
+  int x = 0;
+  for (; x + 8 <= end; x += 8) {
+    __m256i offsets = _mm256_slli_epi32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(starts + x)),
+        shift);
+    __m256i sums[kChannels];
+    for (int c = 0; c < kChannels; c++) {
+      sums[c] = round;
+    }
+    for (int t = 0; t < taps; t++) {
+      __m256i pixels = _mm256_i32gather_epi32(
+          reinterpret_cast<const int*>(src + t * kChannels), offsets, 1);
+      // the sign extended coefficient times the zero extended sample
+      __m256i coef = _mm256_cvtepi16_epi32(_mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(coefs + t * outputs + x)));
+      for (int c = 0; c < kChannels; c++) {
+        __m256i samples =
+            _mm256_and_si256(_mm256_srli_epi32(pixels, 8 * c), mask);
+        sums[c] = _mm256_add_epi32(sums[c], _mm256_madd_epi16(samples, coef));
+      }
+    }
+    for (int c = 0; c < kChannels; c++) {
+      sums[c] = _mm256_srai_epi32(sums[c], kHorizontalShift);
+    }
+
+    if (kChannels == 1) {
+      __m256i words = _mm256_permute4x64_epi64(
+          _mm256_packs_epi32(sums[0], sums[0]), 0x08);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                       _mm256_castsi256_si128(words));
+    } else if (kChannels == 2) {
+      // u0-u3 v0-v3 | u4-u7 v4-v7 to u0 v0 u1 v1 ...
+      const __m256i interleave = _mm256_setr_epi8(
+          0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15, 0, 1, 8, 9, 2,
+          3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+      __m256i words = _mm256_shuffle_epi8(
+          _mm256_packs_epi32(sums[0], sums[kChannels - 1]), interleave);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * x), words);
+    } else {
+      // r0-r3 g0-g3 | r4-r7 g4-g7 and the same of b and a
+      __m256i rg = _mm256_packs_epi32(sums[0], sums[1 % kChannels]);
+      __m256i ba = _mm256_packs_epi32(sums[2 % kChannels],
+                                      sums[3 % kChannels]);
+      __m256i rb = _mm256_unpacklo_epi16(rg, ba);
+      __m256i ga = _mm256_unpackhi_epi16(rg, ba);
+      // pixels 0 1 | 4 5 and 2 3 | 6 7
+      __m256i lo = _mm256_unpacklo_epi16(rb, ga);
+      __m256i hi = _mm256_unpackhi_epi16(rb, ga);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * x),
+                          _mm256_permute2x128_si256(lo, hi, 0x20));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * x + 16),
+                          _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+  }
+  HorizontalScalarRange(src, starts, coefs, taps, outputs, kChannels, x, dst);
+}
+
+AVE_SCALER_AVX2 void HorizontalAVX2(const uint8_t* src,
+                                    uint32_t src_width,
+                                    const int32_t* starts,
+                                    const int16_t* coefs,
+                                    int taps,
+                                    int outputs,
+                                    int channels,
+                                    int16_t* dst) {
+  switch (channels) {
+    case 1:
+      HorizontalAVX2Channels<1>(src, src_width, starts, coefs, taps, outputs,
+                                dst);
+      break;
+    case 2:
+      HorizontalAVX2Channels<2>(src, src_width, starts, coefs, taps, outputs,
+                                dst);
+      break;
+    case 4:
+      HorizontalAVX2Channels<4>(src, src_width, starts, coefs, taps, outputs,
+                                dst);
+      break;
+    default:
+      HorizontalScalar(src, src_width, starts, coefs, taps, outputs, channels,
+                       dst);
+      break;
+  }
+}
+
+// Sixteen samples at a time, the rows are taken in pairs for madd.
+AVE_SCALER_AVX2 void VerticalAVX2(const int16_t* const* rows,
+                                  const int16_t* coefs,
+                                  int taps,
+                                  uint8_t* dst,
+                                  int width) {
+  const __m256i round = _mm256_set1_epi32(1 << (kVerticalShift - 1));
+  const __m256i zero = _mm256_setzero_si256();
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m256i lo = round;
+    __m256i hi = round;
+    for (int t = 0; t < taps; t += 2) {
+      __m256i a =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[t] + x));
+      __m256i b = zero;
+      uint32_t pair = static_cast<uint16_t>(coefs[t]);
+      if (t + 1 < taps) {
+        b = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(rows[t + 1] + x));
+        pair |= static_cast<uint32_t>(static_cast<uint16_t>(coefs[t + 1]))
+                << 16;
+      }
+      __m256i c = _mm256_set1_epi32(static_cast<int32_t>(pair));
+      lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b),
+                                                  c));
+      hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b),
+                                                  c));
+    }
+    __m256i words =
+        _mm256_packs_epi32(_mm256_srai_epi32(lo, kVerticalShift),
+                           _mm256_srai_epi32(hi, kVerticalShift));
+    __m256i bytes =
+        _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                     _mm256_castsi256_si128(bytes));
+  }
+  VerticalScalarRange(rows, coefs, taps, dst, x, width);
+}
+
+#undef AVE_SCALER_AVX2
+
+#endif
+
+#if defined(AVE_SCALER_NEON)
+
+// The sample at |offset| of each of the eight outputs at |p|.
+inline uint8x8_t GatherNEON(const uint8_t* const* p, int offset) {
+  uint8x8_t v = vdup_n_u8(0);
+  v = vld1_lane_u8(p[0] + offset, v, 0);
+  v = vld1_lane_u8(p[1] + offset, v, 1);
+  v = vld1_lane_u8(p[2] + offset, v, 2);
+  v = vld1_lane_u8(p[3] + offset, v, 3);
+  v = vld1_lane_u8(p[4] + offset, v, 4);
+  v = vld1_lane_u8(p[5] + offset, v, 5);
+  v = vld1_lane_u8(p[6] + offset, v, 6);
+  v = vld1_lane_u8(p[7] + offset, v, 7);
+  return v;
+}
+
+// The two interleaved samples at |offset| of each of the eight outputs at
+// |p|, split into one vector per channel.
+inline uint8x8x2_t Gather2NEON(const uint8_t* const* p, int offset) {
+  uint8x8x2_t v = {{vdup_n_u8(0), vdup_n_u8(0)}};
+  v = vld2_lane_u8(p[0] + offset, v, 0);
+  v = vld2_lane_u8(p[1] + offset, v, 1);
+  v = vld2_lane_u8(p[2] + offset, v, 2);
+  v = vld2_lane_u8(p[3] + offset, v, 3);
+  v = vld2_lane_u8(p[4] + offset, v, 4);
+  v = vld2_lane_u8(p[5] + offset, v, 5);
+  v = vld2_lane_u8(p[6] + offset, v, 6);
+  v = vld2_lane_u8(p[7] + offset, v, 7);
+  return v;
+}
+
+// Eight output pixels of 1 or 2 channels at a time, every tap loads the
+// source samples of all eight into the lanes of a vector. The lane loads
+// read no more than the scalar loop, so only the last pixels of an odd
+// count are left to it.
+template <int kChannels>
+void HorizontalNEONChannels(const uint8_t* src,
+                            const int32_t* starts,
+                            const int16_t* coefs,
+                            int taps,
+                            int outputs,
+                            int16_t* dst) {
+  const int32x4_t round = vdupq_n_s32(1 << (kHorizontalShift - 1));
+  int x = 0;
+  for (; x + 8 <= outputs; x += 8) {
+    const uint8_t* p[8];
+    for (int i = 0; i < 8; i++) {
+      p[i] = src + starts[x + i] * kChannels;
+    }
+    int32x4_t lo[kChannels];
+    int32x4_t hi[kChannels];
+    for (int c = 0; c < kChannels; c++) {
+      lo[c] = round;
+      hi[c] = round;
+    }
+    for (int t = 0; t < taps; t++) {
+      int16x8_t coef = vld1q_s16(coefs + t * outputs + x);
+      int16x8_t samples[kChannels];
+      if (kChannels == 1) {
+        samples[0] = vreinterpretq_s16_u16(vmovl_u8(GatherNEON(p, t)));
+      } else {
+        uint8x8x2_t uv = Gather2NEON(p, 2 * t);
+        samples[0] = vreinterpretq_s16_u16(vmovl_u8(uv.val[0]));
+        samples[kChannels - 1] = vreinterpretq_s16_u16(vmovl_u8(uv.val[1]));
+      }
+      for (int c = 0; c < kChannels; c++) {
+        lo[c] = vmlal_s16(lo[c], vget_low_s16(samples[c]), vget_low_s16(coef));
+        hi[c] =
+            vmlal_s16(hi[c], vget_high_s16(samples[c]), vget_high_s16(coef));
+      }
+    }
+    int16x8_t words[kChannels];
+    for (int c = 0; c < kChannels; c++) {
+      words[c] = vcombine_s16(vshrn_n_s32(lo[c], kHorizontalShift),
+                              vshrn_n_s32(hi[c], kHorizontalShift));
+    }
+    if (kChannels == 1) {
+      vst1q_s16(dst + x, words[0]);
+    } else {
+      int16x8x2_t uv = {{words[0], words[kChannels - 1]}};
+      vst2q_s16(dst + 2 * x, uv);
+    }
+  }
+  HorizontalScalarRange(src, starts, coefs, taps, outputs, kChannels, x, dst);
+}
+
+// Packed 4 channel pixels one at a time with all channels in a vector.
+void HorizontalNEON4(const uint8_t* src,
+                     const int32_t* starts,
+                     const int16_t* coefs,
+                     int taps,
+                     int outputs,
+                     int16_t* dst) {
+  const int32x4_t round = vdupq_n_s32(1 << (kHorizontalShift - 1));
+  for (int x = 0; x < outputs; x++) {
+    const uint8_t* p = src + starts[x] * 4;
+    int32x4_t sum = round;
+    for (int t = 0; t < taps; t++) {
+      uint32_t pixel;
+      memcpy(&pixel, p + 4 * t, sizeof(pixel));
+      int16x4_t samples = vget_low_s16(
+          vreinterpretq_s16_u16(vmovl_u8(vcreate_u8(pixel))));
+      sum = vmlal_n_s16(sum, samples, coefs[t * outputs + x]);
+    }
+    vst1_s16(dst + 4 * x, vshrn_n_s32(sum, kHorizontalShift));
+  }
+}
+
+void HorizontalNEON(const uint8_t* src,
+                    uint32_t src_width,
+                    const int32_t* starts,
+                    const int16_t* coefs,
+                    int taps,
+                    int outputs,
+                    int channels,
+                    int16_t* dst) {
+  switch (channels) {
+    case 1:
+      HorizontalNEONChannels<1>(src, starts, coefs, taps, outputs, dst);
+      break;
+    case 2:
+      HorizontalNEONChannels<2>(src, starts, coefs, taps, outputs, dst);
+      break;
+    case 4:
+      HorizontalNEON4(src, starts, coefs, taps, outputs, dst);
+      break;
+    default:
+      HorizontalScalar(src, src_width, starts, coefs, taps, outputs, channels,
+                       dst);
+      break;
+  }
+}
+
+void VerticalNEON(const int16_t* const* rows,
+                  const int16_t* coefs,
+                  int taps,
+                  uint8_t* dst,
+                  int width) {
+  const int32x4_t round = vdupq_n_s32(1 << (kVerticalShift - 1));
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    int32x4_t lo = round;
+    int32x4_t hi = round;
+    for (int t = 0; t < taps; t++) {
+      int16x8_t samples = vld1q_s16(rows[t] + x);
+      lo = vmlal_n_s16(lo, vget_low_s16(samples), coefs[t]);
+      hi = vmlal_n_s16(hi, vget_high_s16(samples), coefs[t]);
+    }
+    vst1_u8(dst + x, vqmovun_s16(vcombine_s16(
+                         vqshrn_n_s32(lo, kVerticalShift),
+                         vqshrn_n_s32(hi, kVerticalShift))));
+  }
+  VerticalScalarRange(rows, coefs, taps, dst, x, width);
+}
+
+#endif
+
+}  // namespace
+
+VideoScaler::VideoScaler(PixelFormat format,
+                         uint32_t src_width,
+                         uint32_t src_height,
+                         uint32_t dst_width,
+                         uint32_t dst_height,
+                         Filter filter)
+    : format_(format),
+      src_width_(src_width),
+      src_height_(src_height),
+      dst_width_(dst_width),
+      dst_height_(dst_height),
+      init_check_(NO_INIT),
+      num_planes_(0),
+      kernels_(nullptr) {
+  const ScaleFormat* info = FindScaleFormat(format);
+  if (info == nullptr) {
+    AVE_LOG(LS_ERROR) << "can not scale pixel format " << format;
+    return;
+  }
+  // beyond that the Q6 rows of a plane overflow the int of the kernels
+  const uint32_t kMaxSize = 1 << 16;
+  if (src_width == 0 || src_height == 0 || dst_width == 0 ||
+      dst_height == 0 || src_width > kMaxSize || src_height > kMaxSize ||
+      dst_width > kMaxSize || dst_height > kMaxSize) {
+    AVE_LOG(LS_ERROR) << "can not scale " << src_width << "x" << src_height
+                      << " to " << dst_width << "x" << dst_height;
+    return;
+  }
+
+  // the filters of every distinct pair of sizes
+  std::vector<std::pair<uint32_t, uint32_t>> sizes;
+  auto add_filter = [&](uint32_t src, uint32_t dst) -> size_t {
+    for (size_t i = 0; i < sizes.size(); i++) {
+      if (sizes[i] == std::make_pair(src, dst)) {
+        return i;
+      }
+    }
+    sizes.emplace_back(src, dst);
+    filters_.push_back(MakeAxisFilter(src, dst, filter));
+    return filters_.size() - 1;
+  };
+  num_planes_ = info->num_planes;
+  for (size_t i = 0; i < num_planes_; i++) {
+    uint32_t horiz = IsChromaPlane(i) ? 1u << info->log2_chroma_w : 1;
+    uint32_t vert = IsChromaPlane(i) ? 1u << info->log2_chroma_h : 1;
+    plane_filters_[i][0] =
+        add_filter(CeilDiv(src_width, horiz), CeilDiv(dst_width, horiz));
+    plane_filters_[i][1] =
+        add_filter(CeilDiv(src_height, vert), CeilDiv(dst_height, vert));
+  }
+
+  const Impl kPreferred[] = {Impl::kAVX2, Impl::kNEON, Impl::kScalar};
+  for (Impl impl : kPreferred) {
+    kernels_ = GetKernels(impl);
+    if (kernels_ != nullptr) {
+      break;
+    }
+  }
+  init_check_ = OK;
+}
+
+VideoScaler::~VideoScaler() = default;
+
+status_t VideoScaler::InitCheck() const {
+  return init_check_;
+}
+
+const VideoScaler::Kernels* VideoScaler::GetKernels(Impl impl) {
+  static const Kernels kScalar = {HorizontalScalar, VerticalScalar};
+  switch (impl) {
+    case Impl::kScalar:
+      return &kScalar;
+#if defined(AVE_SCALER_X86)
+    case Impl::kAVX2: {
+      static const Kernels kAVX2 = {HorizontalAVX2, VerticalAVX2};
+      return __builtin_cpu_supports("avx2") ? &kAVX2 : nullptr;
+    }
+#endif
+#if defined(AVE_SCALER_NEON)
+    case Impl::kNEON: {
+      static const Kernels kNEON = {HorizontalNEON, VerticalNEON};
+      return &kNEON;
+    }
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+status_t VideoScaler::SetImplForTesting(Impl impl) {
+  const Kernels* kernels = GetKernels(impl);
+  if (kernels == nullptr) {
+    return ERROR_UNSUPPORTED;
+  }
+  kernels_ = kernels;
+  return OK;
+}
+
+VideoScaler::AxisFilter VideoScaler::MakeAxisFilter(uint32_t src,
+                                                    uint32_t dst,
+                                                    Filter filter) {
+  const double scale = static_cast<double>(src) / dst;
+  // the kernels are stretched when downscaling
+  const double stretch = std::max(scale, 1.0);
+  double (*kernel)(double) = filter == Filter::kBicubic ? CatmullRom : Triangle;
+  const double support = (filter == Filter::kBicubic ? 2.0 : 1.0) * stretch;
+
+  // the weights of every output over the source samples [first, ...)
+  std::vector<int32_t> firsts(dst);
+  std::vector<std::vector<double>> weights(dst);
+  size_t max_taps = 1;
+  for (uint32_t x = 0; x < dst; x++) {
+    std::vector<double>& w = weights[x];
+    if (filter == Filter::kBox) {
+      // the overlap of the output pixel with every source pixel
+      double lo = x * scale;
+      double hi = (x + 1) * scale;
+      int32_t first = static_cast<int32_t>(std::floor(lo));
+      int32_t last = static_cast<int32_t>(std::ceil(hi)) - 1;
+      for (int32_t j = first; j <= last; j++) {
+        w.push_back(std::min<double>(hi, j + 1) - std::max<double>(lo, j));
+      }
+      firsts[x] = first;
+    } else {
+      double center = (x + 0.5) * scale - 0.5;
+      int32_t first = static_cast<int32_t>(std::floor(center - support)) + 1;
+      int32_t last = static_cast<int32_t>(std::floor(center + support));
+      for (int32_t j = first; j <= last; j++) {
+        w.push_back(kernel((j - center) / stretch));
+      }
+      firsts[x] = first;
+    }
+    max_taps = std::max(max_taps, w.size());
+  }
+
+  AxisFilter axis;
+  axis.src_size = src;
+  axis.dst_size = dst;
+  axis.taps = static_cast<int>(std::min<size_t>(max_taps, src));
+  axis.starts.resize(dst);
+  axis.coefs.assign(size_t{dst} * axis.taps, 0);
+  std::vector<double> folded(axis.taps);
+  for (uint32_t x = 0; x < dst; x++) {
+    // the samples outside of the plane repeat the edge ones
+    const int32_t start = std::min(std::max(firsts[x], 0),
+                                   static_cast<int32_t>(src) - axis.taps);
+    std::fill(folded.begin(), folded.end(), 0.0);
+    double sum = 0;
+    for (size_t i = 0; i < weights[x].size(); i++) {
+      int32_t j = std::min(std::max(firsts[x] + static_cast<int32_t>(i), 0),
+                           static_cast<int32_t>(src) - 1);
+      folded[j - start] += weights[x][i];
+      sum += weights[x][i];
+    }
+
+    // rounded to sum up to exactly one, the error goes to the largest tap
+    int32_t total = 0;
+    int largest = 0;
+    for (int t = 0; t < axis.taps; t++) {
+      int32_t coef =
+          static_cast<int32_t>(std::lround(folded[t] / sum * (1 << kCoefBits)));
+      axis.coefs[size_t(t) * dst + x] = static_cast<int16_t>(coef);
+      total += coef;
+      if (std::fabs(folded[t]) > std::fabs(folded[largest])) {
+        largest = t;
+      }
+    }
+    axis.coefs[size_t(largest) * dst + x] = static_cast<int16_t>(
+        axis.coefs[size_t(largest) * dst + x] + (1 << kCoefBits) - total);
+    axis.starts[x] = start;
+  }
+  return axis;
+}
+
+void VideoScaler::ScaleRows(const PlaneJob& job,
+                            uint32_t begin,
+                            uint32_t end) const {
+  const AxisFilter& h = *job.horizontal;
+  const AxisFilter& v = *job.vertical;
+  const int taps = v.taps;
+  const size_t samples = size_t{h.dst_size} * job.channels;
+  // the horizontally filtered source rows of the filter window, source row
+  // r in slot r % taps, so every source row is filtered once per band
+  std::vector<int16_t> cache(samples * taps);
+  std::vector<const int16_t*> rows(taps);
+  std::vector<int16_t> coefs(taps);
+  int32_t next = v.starts[begin];
+  for (uint32_t y = begin; y < end; y++) {
+    const int32_t start = v.starts[y];
+    for (int32_t r = std::max(next, start); r < start + taps; r++) {
+      kernels_->horizontal(job.src->row(r), h.src_size, h.starts.data(),
+                           h.coefs.data(), h.taps, h.dst_size, job.channels,
+                           &cache[(r % taps) * samples]);
+    }
+    next = start + taps;
+    for (int t = 0; t < taps; t++) {
+      rows[t] = &cache[((start + t) % taps) * samples];
+      coefs[t] = v.coefs[size_t(t) * v.dst_size + y];
+    }
+    kernels_->vertical(rows.data(), coefs.data(), taps, job.dst->row(y),
+                       static_cast<int>(samples));
+  }
+}
+
+status_t VideoScaler::Scale(const FrameView& src,
+                            const FrameView& dst,
+                            WorkerPool* pool) {
+  if (init_check_ != OK) {
+    return init_check_;
+  }
+  if (!src.valid() || !dst.valid() || src.format() != format_ ||
+      dst.format() != format_ || src.width() != src_width_ ||
+      src.height() != src_height_ || dst.width() != dst_width_ ||
+      dst.height() != dst_height_ || src.num_planes() != num_planes_ ||
+      dst.num_planes() != num_planes_) {
+    AVE_LOG(LS_ERROR) << "the frames do not match the scaler of "
+                      << src_width_ << "x" << src_height_ << " to "
+                      << dst_width_ << "x" << dst_height_;
+    return BAD_VALUE;
+  }
+  const ScaleFormat* info = FindScaleFormat(format_);
+  for (size_t i = 0; i < num_planes_; i++) {
+    if (src.plane(i).col_inc != info->channels[i] ||
+        dst.plane(i).col_inc != info->channels[i]) {
+      AVE_LOG(LS_ERROR) << "can not scale plane " << i << " with samples "
+                        << src.plane(i).col_inc << " and "
+                        << dst.plane(i).col_inc << " bytes apart";
+      return ERROR_UNSUPPORTED;
+    }
+  }
+
+  // every plane split into bands of rows, a few per thread to even out
+  // the smaller chroma planes
+  struct Band {
+    size_t plane;
+    uint32_t begin;
+    uint32_t end;
+  };
+  PlaneJob jobs[FrameView::kMaxPlanes];
+  std::vector<Band> bands;
+  const uint32_t max_bands =
+      pool != nullptr ? static_cast<uint32_t>(pool->concurrency() + 1) * 2
+                      : 1;
+  for (size_t i = 0; i < num_planes_; i++) {
+    jobs[i] = {&src.plane(i), &dst.plane(i), &filters_[plane_filters_[i][0]],
+               &filters_[plane_filters_[i][1]], info->channels[i]};
+    const uint32_t height = dst.plane(i).height;
+    const uint32_t count =
+        std::min(max_bands, std::max(1u, height / kMinBandRows));
+    for (uint32_t b = 0; b < count; b++) {
+      bands.push_back({i, height * b / count, height * (b + 1) / count});
+    }
+  }
+  ParallelFor(pool, bands.size(), [&](size_t index) {
+    const Band& band = bands[index];
+    ScaleRows(jobs[band.plane], band.begin, band.end);
+  });
+  return OK;
+}
+
+status_t VideoScaler::Scale(MediaPacket& src,
+                            MediaPacket& dst,
+                            WorkerPool* pool) {
+  FrameView in = FrameView::Create(src);
+  VideoSampleInfo* info = dst.video_info();
+  if (!in.valid() || info == nullptr) {
+    AVE_LOG(LS_ERROR) << "can not scale, the packets are no video frames";
+    return BAD_VALUE;
+  }
+  if (in.format() != format_) {
+    AVE_LOG(LS_ERROR) << "can not scale pixel format " << in.format()
+                      << " with a scaler of " << format_;
+    return BAD_VALUE;
+  }
+
+  status_t err =
+      FrameView::PrepareOutput(src, dst, format_, dst_width_, dst_height_);
+  if (err != OK) {
+    return err;
+  }
+
+  FrameView out = FrameView::Create(dst);
+  return Scale(in, out, pool);
+}
+
+bool VideoScaler::GetThumbnailSize(const MetaData& meta,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   uint32_t* thumbnail_width,
+                                   uint32_t* thumbnail_height) {
+  int32_t w = 0;
+  int32_t h = 0;
+  bool has_width = meta.findInt32(kKeyThumbnailWidth, &w) && w > 0;
+  bool has_height = meta.findInt32(kKeyThumbnailHeight, &h) && h > 0;
+  if ((!has_width && !has_height) || width == 0 || height == 0) {
+    return false;
+  }
+  auto even = [](double value) {
+    return std::max<uint32_t>(2, 2 * static_cast<uint32_t>(
+                                         std::lround(value / 2)));
+  };
+  *thumbnail_width =
+      has_width ? static_cast<uint32_t>(w) : even(double(h) * width / height);
+  *thumbnail_height =
+      has_height ? static_cast<uint32_t>(h) : even(double(w) * height / width);
+  return true;
+}
+
+}  // namespace ave
@@ -0,0 +1,138 @@
+/*
+ * video_scaler.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef VIDEO_SCALER_H
+#define VIDEO_SCALER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "base/constructor_magic.h"
+#include "base/types.h"
+
+#include "frame_view.h"
+#include "media_errors.h"
+#include "pixel_format.h"
+
+namespace ave {
+
+class MediaPacket;
+class MetaData;
+class WorkerPool;
+
+// Scales 8 bit video frames with a separable filter: every source row is
+// filtered horizontally once into a small cache of rows, and the output
+// rows are filtered vertically from that cache. The filter coefficients
+// only depend on the sizes and are computed at construction, so keep one
+// scaler per size, e.g. per rung of a preview ladder.
+//
+// Supported are the planar YUV formats (YUV420P, YUV422P, YUV444P and
+// their J variants, YUVA420P, GRAY8), NV12, NV21 and the packed RGB ones
+// (RGBA, BGRA, ARGB, ABGR, RGB0, 0RGB, RGB24, BGR24). The chroma planes
+// are scaled to the chroma size of the output, the samples of packed
+// pixels are filtered independently.
+//
+// Scale() may be called from one thread at a time.
+class VideoScaler {
+ public:
+  enum class Filter {
+    // triangle filter, 2 taps when upscaling
+    kBilinear,
+    // Catmull-Rom, 4 taps when upscaling, sharper
+    kBicubic,
+    // the average of the covered area, for downscaling, e.g. thumbnails
+    kBox,
+  };
+
+  // When downscaling the bilinear and bicubic filters are stretched by the
+  // ratio, so every source pixel contributes and nothing aliases.
+  VideoScaler(PixelFormat format,
+              uint32_t src_width,
+              uint32_t src_height,
+              uint32_t dst_width,
+              uint32_t dst_height,
+              Filter filter = Filter::kBilinear);
+  ~VideoScaler();
+
+  status_t InitCheck() const;
+
+  // Scales |src| into |dst|, both of the scaler's format and sizes and of
+  // any stride. With a |pool| the rows are split into bands scaled in
+  // parallel, the output does not depend on it.
+  status_t Scale(const FrameView& src,
+                 const FrameView& dst,
+                 WorkerPool* pool = nullptr);
+
+  // Scales the frame described by the VideoSampleInfo of |src| into |dst|,
+  // which gets the VideoSampleInfo of |src| at the output size. A stride of
+  // 0 or less in |dst|'s packs the rows tightly. |dst| grows if it is too
+  // small and can.
+  status_t Scale(MediaPacket& src,
+                 MediaPacket& dst,
+                 WorkerPool* pool = nullptr);
+
+  // The size of the thumbnail of a |width| x |height| frame asked for by
+  // kKeyThumbnailWidth and kKeyThumbnailHeight in |meta|. With only one of
+  // them the other follows the aspect ratio of the frame, rounded to even.
+  // Returns false if neither is set.
+  static bool GetThumbnailSize(const MetaData& meta,
+                               uint32_t width,
+                               uint32_t height,
+                               uint32_t* thumbnail_width,
+                               uint32_t* thumbnail_height);
+
+  PixelFormat format() const { return format_; }
+  uint32_t src_width() const { return src_width_; }
+  uint32_t src_height() const { return src_height_; }
+  uint32_t dst_width() const { return dst_width_; }
+  uint32_t dst_height() const { return dst_height_; }
+
+  enum class Impl {
+    kScalar,
+    kAVX2,
+    kNEON,
+  };
+
+  // Uses the kernels of |impl| from now on, ERROR_UNSUPPORTED if they are
+  // not built in or not supported by this CPU. All implementations give
+  // the same pixels. For tests and benchmarks.
+  status_t SetImplForTesting(Impl impl);
+
+ private:
+  struct AxisFilter;
+  struct Kernels;
+  struct PlaneJob;
+
+  // The kernels of |impl|, nullptr if they are not available.
+  static const Kernels* GetKernels(Impl impl);
+  // Builds the filter scaling |src| samples to |dst| ones.
+  static AxisFilter MakeAxisFilter(uint32_t src, uint32_t dst, Filter filter);
+
+  // Scales the output rows [|begin|, |end|) of a plane.
+  void ScaleRows(const PlaneJob& job, uint32_t begin, uint32_t end) const;
+
+  const PixelFormat format_;
+  const uint32_t src_width_;
+  const uint32_t src_height_;
+  const uint32_t dst_width_;
+  const uint32_t dst_height_;
+  status_t init_check_;
+
+  // of the luma plane and the chroma planes, which may be the same
+  std::vector<AxisFilter> filters_;
+  // the filters of every plane in filters_, horizontal and vertical
+  size_t plane_filters_[FrameView::kMaxPlanes][2];
+  size_t num_planes_;
+  const Kernels* kernels_;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(VideoScaler);
+};
+
+}  // namespace ave
+
+#endif /* !VIDEO_SCALER_H */
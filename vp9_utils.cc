@@ -0,0 +1,261 @@
+/*
+ * vp9_utils.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "vp9_utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+
+#include "fast_bit_reader.h"
+#include "media_errors.h"
+
+namespace ave {
+
+namespace {
+
+const uint8_t kCsRgb = 7;
+const uint8_t kCsBt601 = 1;
+
+bool ReadSyncCode(FastRawBitReader* br) {
+  // frame_sync_code(), 6.2.1
+  return br->getBitsWithFallback(8, 0) == 0x49 &&
+         br->getBitsWithFallback(8, 0) == 0x83 &&
+         br->getBitsWithFallback(8, 0) == 0x42;
+}
+
+// color_config(), 6.2.2
+void ReadColorConfig(FastRawBitReader* br, Vp9FrameHeader* header) {
+  header->bitDepth = 8;
+  if (header->profile >= 2) {
+    header->bitDepth = br->getBitsWithFallback(1, 0) ? 12 : 10;
+  }
+  header->colorSpace = br->getBitsWithFallback(3, 0);
+  bool oddProfile = header->profile == 1 || header->profile == 3;
+  if (header->colorSpace != kCsRgb) {
+    header->colorRange = br->getBitsWithFallback(1, 0);
+    header->subsamplingX = true;
+    header->subsamplingY = true;
+    if (oddProfile) {
+      header->subsamplingX = br->getBitsWithFallback(1, 0);
+      header->subsamplingY = br->getBitsWithFallback(1, 0);
+      br->skipBits(1);  // reserved_zero
+    }
+  } else {
+    header->colorRange = true;
+    if (oddProfile) {
+      br->skipBits(1);  // reserved_zero
+    }
+  }
+}
+
+// frame_size(), 6.2.3
+void ReadFrameSize(FastRawBitReader* br, Vp9FrameHeader* header) {
+  header->width = br->getBitsWithFallback(16, 0) + 1;
+  header->height = br->getBitsWithFallback(16, 0) + 1;
+}
+
+}  // namespace
+
+status_t SplitVp9Superframe(const uint8_t* data,
+                            size_t size,
+                            std::vector<Vp9Frame>* frames) {
+  frames->clear();
+  if (size == 0) {
+    return OK;
+  }
+  // superframe_index(), B.3
+  uint8_t marker = data[size - 1];
+  if ((marker & 0xe0) == 0xc0) {
+    size_t numFrames = (marker & 0x07) + 1;
+    size_t bytesPerSize = ((marker >> 3) & 0x03) + 1;
+    size_t indexSize = 2 + bytesPerSize * numFrames;
+    if (size >= indexSize && data[size - indexSize] == marker) {
+      const uint8_t* index = data + size - indexSize + 1;
+      size_t offset = 0;
+      for (size_t i = 0; i < numFrames; ++i) {
+        size_t frameSize = 0;
+        for (size_t j = 0; j < bytesPerSize; ++j) {
+          frameSize |= static_cast<size_t>(*index++) << (8 * j);
+        }
+        if (frameSize > size - indexSize - offset) {
+          AVE_LOG(LS_ERROR) << "superframe frame " << i << " of "
+                            << frameSize << " bytes exceeds the sample";
+          frames->clear();
+          return ERROR_MALFORMED;
+        }
+        if (frameSize > 0) {
+          frames->push_back({data + offset, frameSize});
+        }
+        offset += frameSize;
+      }
+      return OK;
+    }
+  }
+  frames->push_back({data, size});
+  return OK;
+}
+
+status_t ParseVp9FrameHeader(const uint8_t* data,
+                             size_t size,
+                             Vp9FrameHeader* header) {
+  // uncompressed_header(), 6.2
+  FastRawBitReader br(data, size);
+  memset(header, 0, sizeof(*header));
+  header->sizeFromRef = -1;
+  if (br.getBitsWithFallback(2, 0) != 2) {
+    AVE_LOG(LS_ERROR) << "invalid frame_marker";
+    return ERROR_MALFORMED;
+  }
+  uint32_t profileLow = br.getBitsWithFallback(1, 0);
+  uint32_t profileHigh = br.getBitsWithFallback(1, 0);
+  header->profile = (profileHigh << 1) + profileLow;
+  if (header->profile == 3) {
+    br.skipBits(1);  // reserved_zero
+  }
+  header->showExistingFrame = br.getBitsWithFallback(1, 0);
+  if (header->showExistingFrame) {
+    header->frameToShowMapIdx = br.getBitsWithFallback(3, 0);
+    header->showFrame = true;
+    if (br.overRead()) {
+      return ERROR_MALFORMED;
+    }
+    return OK;
+  }
+  header->frameType = br.getBitsWithFallback(1, 0);
+  header->showFrame = br.getBitsWithFallback(1, 0);
+  header->errorResilientMode = br.getBitsWithFallback(1, 0);
+
+  if (header->frameType == kVp9KeyFrame) {
+    if (!ReadSyncCode(&br)) {
+      AVE_LOG(LS_ERROR) << "invalid frame_sync_code";
+      return ERROR_MALFORMED;
+    }
+    ReadColorConfig(&br, header);
+    ReadFrameSize(&br, header);
+    header->refreshFrameFlags = 0xff;
+  } else {
+    if (!header->showFrame) {
+      header->intraOnly = br.getBitsWithFallback(1, 0);
+    }
+    if (!header->errorResilientMode) {
+      br.skipBits(2);  // reset_frame_context
+    }
+    if (header->intraOnly) {
+      if (!ReadSyncCode(&br)) {
+        AVE_LOG(LS_ERROR) << "invalid frame_sync_code";
+        return ERROR_MALFORMED;
+      }
+      if (header->profile > 0) {
+        ReadColorConfig(&br, header);
+      } else {
+        header->bitDepth = 8;
+        header->colorSpace = kCsBt601;
+        header->subsamplingX = true;
+        header->subsamplingY = true;
+      }
+      header->refreshFrameFlags = br.getBitsWithFallback(8, 0);
+      ReadFrameSize(&br, header);
+    } else {
+      header->refreshFrameFlags = br.getBitsWithFallback(8, 0);
+      for (size_t i = 0; i < 3; ++i) {
+        header->refFrameIdx[i] = br.getBitsWithFallback(3, 0);
+        br.skipBits(1);  // ref_frame_sign_bias
+      }
+      // frame_size_with_refs(), 6.2.6
+      for (size_t i = 0; i < 3; ++i) {
+        if (br.getBitsWithFallback(1, 0)) {  // found_ref
+          header->sizeFromRef = header->refFrameIdx[i];
+          break;
+        }
+      }
+      if (header->sizeFromRef < 0) {
+        ReadFrameSize(&br, header);
+      }
+    }
+  }
+
+  if (br.overRead()) {
+    AVE_LOG(LS_ERROR) << "truncated uncompressed header";
+    return ERROR_MALFORMED;
+  }
+  return OK;
+}
+
+Vp9Parser::Vp9Parser() : mSpatialLayers(1) {
+  reset();
+}
+
+void Vp9Parser::setSpatialLayers(size_t count) {
+  mSpatialLayers = std::max<size_t>(count, 1);
+}
+
+void Vp9Parser::reset() {
+  memset(mRefWidth, 0, sizeof(mRefWidth));
+  memset(mRefHeight, 0, sizeof(mRefHeight));
+}
+
+status_t Vp9Parser::parseSample(const uint8_t* data,
+                                size_t size,
+                                Vp9SampleInfo* info,
+                                std::vector<Vp9Frame>* frames) {
+  memset(info, 0, sizeof(*info));
+  std::vector<Vp9Frame>* sampleFrames = frames ? frames : &mFrames;
+  status_t err = SplitVp9Superframe(data, size, sampleFrames);
+  if (err != OK) {
+    return err;
+  }
+
+  size_t spatialId = 0;
+  bool hasShownSize = false;
+  for (const Vp9Frame& frame : *sampleFrames) {
+    Vp9FrameHeader header;
+    err = ParseVp9FrameHeader(frame.data, frame.size, &header);
+    if (err != OK) {
+      return err;
+    }
+    if (info->numFrames == 0) {
+      info->isKeyFrame = !header.showExistingFrame && header.isKeyFrame();
+    }
+    ++info->numFrames;
+    if (header.showFrame) {
+      ++info->numShownFrames;
+    }
+
+    uint32_t width = header.width;
+    uint32_t height = header.height;
+    if (header.showExistingFrame) {
+      width = mRefWidth[header.frameToShowMapIdx];
+      height = mRefHeight[header.frameToShowMapIdx];
+    } else {
+      if (header.sizeFromRef >= 0) {
+        width = mRefWidth[header.sizeFromRef];
+        height = mRefHeight[header.sizeFromRef];
+      }
+      for (size_t i = 0; i < 8; ++i) {
+        if (header.refreshFrameFlags & (1 << i)) {
+          mRefWidth[i] = width;
+          mRefHeight[i] = height;
+        }
+      }
+      if (mSpatialLayers > 1) {
+        info->maxSpatialId =
+            static_cast<uint8_t>(std::min(spatialId++, mSpatialLayers - 1));
+      }
+    }
+    // a hidden frame, e.g. an alt-ref, does not replace the shown size
+    if (header.showFrame || !hasShownSize) {
+      info->width = width;
+      info->height = height;
+      hasShownSize = header.showFrame;
+    }
+  }
+  return OK;
+}
+
+}  // namespace ave
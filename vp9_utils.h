@@ -0,0 +1,115 @@
+/*
+ * vp9_utils.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef VP9_UTILS_H
+#define VP9_UTILS_H
+
+#include <vector>
+
+#include "base/constructor_magic.h"
+#include "base/types.h"
+
+namespace ave {
+
+enum {
+  kVp9KeyFrame = 0,
+  kVp9NonKeyFrame = 1,
+};
+
+// A frame within a sample, nothing is copied.
+struct Vp9Frame {
+  const uint8_t* data;
+  size_t size;
+};
+
+// Splits a sample at its superframe index, Annex B of the VP9 bitstream
+// specification. A sample without an index is a single frame.
+status_t SplitVp9Superframe(const uint8_t* data,
+                            size_t size,
+                            std::vector<Vp9Frame>* frames);
+
+// VP9 bitstream 6.2, up to frame_size() and refresh_frame_flags.
+struct Vp9FrameHeader {
+  uint8_t profile;
+  bool showExistingFrame;
+  uint8_t frameToShowMapIdx;
+  uint8_t frameType;
+  bool showFrame;
+  bool errorResilientMode;
+  bool intraOnly;
+  uint8_t refreshFrameFlags;
+  // color_config(), for key and intra-only frames
+  uint32_t bitDepth;
+  uint8_t colorSpace;
+  bool colorRange;
+  bool subsamplingX;
+  bool subsamplingY;
+  // frame_size(), 0 if an inter frame takes it from a reference
+  uint32_t width;
+  uint32_t height;
+  // ref_frame_idx[] of inter frames, and the first of them found_ref points
+  // at, -1 if the size is coded
+  uint8_t refFrameIdx[3];
+  int32_t sizeFromRef;
+
+  bool isKeyFrame() const { return frameType == kVp9KeyFrame; }
+};
+
+status_t ParseVp9FrameHeader(const uint8_t* data,
+                             size_t size,
+                             Vp9FrameHeader* header);
+
+// What a sample holds, from the headers of its frames.
+struct Vp9SampleInfo {
+  size_t numFrames;
+  // the first frame is a key frame
+  bool isKeyFrame;
+  // the number of frames the sample shows, 0 or 1 normally
+  size_t numShownFrames;
+  // the frames of a spatial SVC superframe are its layers, this is the
+  // highest one with a frame. Always 0 unless the stream is known to be SVC,
+  // see Vp9Parser::setSpatialLayers(). VP9 has no temporal layer id in the
+  // bitstream, that comes from the RTP payload descriptor.
+  uint8_t maxSpatialId;
+  // of the last shown frame (the highest spatial layer of SVC), or of the
+  // last frame if none is shown, 0 if not known yet
+  uint32_t width;
+  uint32_t height;
+};
+
+// Tracks the frame sizes of the 8 reference slots, so the size of inter
+// frames that copy it from a reference is known.
+class Vp9Parser {
+ public:
+  Vp9Parser();
+
+  // Superframes of spatial SVC hold a frame per layer, but those of other
+  // streams a hidden frame and the one shown, which the bitstream does not
+  // tell apart. Set the layer count once it is known, e.g. from the RTP
+  // payload descriptor, 1 by default.
+  void setSpatialLayers(size_t count);
+
+  // |frames| optionally returns the frames of the sample.
+  status_t parseSample(const uint8_t* data,
+                       size_t size,
+                       Vp9SampleInfo* info,
+                       std::vector<Vp9Frame>* frames = nullptr);
+
+  void reset();
+
+ private:
+  uint32_t mRefWidth[8];
+  uint32_t mRefHeight[8];
+  std::vector<Vp9Frame> mFrames;
+  size_t mSpatialLayers;
+
+  AVE_DISALLOW_COPY_AND_ASSIGN(Vp9Parser);
+};
+
+}  // namespace ave
+
+#endif /* !VP9_UTILS_H */
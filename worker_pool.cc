@@ -0,0 +1,50 @@
+/*
+ * worker_pool.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "base/count_down_latch.h"
+
+namespace ave {
+
+void ParallelFor(WorkerPool* pool,
+                 size_t count,
+                 const std::function<void(size_t index)>& work) {
+  size_t helpers = 0;
+  if (pool != nullptr && count > 1) {
+    helpers = std::min(pool->concurrency(), count - 1);
+  }
+  if (helpers == 0) {
+    for (size_t i = 0; i < count; i++) {
+      work(i);
+    }
+    return;
+  }
+
+  // the indices are taken in order by whoever is free, a helper that
+  // starts late finds nothing left and only counts down
+  std::atomic<size_t> next(0);
+  base::CountDownLatch done(static_cast<int>(helpers));
+  auto run = [&next, count, &work]() {
+    for (size_t i = next++; i < count; i = next++) {
+      work(i);
+    }
+  };
+  for (size_t i = 0; i < helpers; i++) {
+    pool->PostTask([&run, &done]() {
+      run();
+      done.CountDown();
+    });
+  }
+  run();
+  done.Wait();
+}
+
+}  // namespace ave
@@ -0,0 +1,39 @@
+/*
+ * worker_pool.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <cstddef>
+#include <functional>
+
+namespace ave {
+
+// Threads of the caller that frame operations can split their work over,
+// e.g. the scaler runs bands of rows on them. The library never creates
+// threads itself.
+class WorkerPool {
+ public:
+  virtual ~WorkerPool() = default;
+
+  // Tasks the pool runs at the same time, the work is split accordingly.
+  virtual size_t concurrency() const = 0;
+  // Runs |task| on one of the threads, eventually.
+  virtual void PostTask(std::function<void()> task) = 0;
+};
+
+// Calls |work| with every index in [0, |count|), on the threads of |pool|
+// and the calling one, and returns when all calls have finished. Without a
+// pool everything runs on the calling thread. Must not be called from a
+// task of |pool|, which may wait for itself then.
+void ParallelFor(WorkerPool* pool,
+                 size_t count,
+                 const std::function<void(size_t index)>& work);
+
+}  // namespace ave
+
+#endif /* !WORKER_POOL_H */